@@ -4,6 +4,7 @@ typedef double GLclampd;
 #include <GLES2/gl2.h>
 #include <AndroidAdapters/gles_adapter.h>
 #include <stdlib.h>
+#include <string.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -71,13 +72,21 @@ namespace gles_adapter {
   GLuint INDEX_COLOR = 3;
   GLuint INDEX_TEXTURE_COORD = 4;
 
-  const int BUFFER_POSITION = 0;
-  const int BUFFER_NORMAL = 1;
-  const int BUFFER_COLOR = 2;
-  const int BUFFER_TEXTURE_COORD = 3;
-  const int BUFFER_ELEMENTS = 4;
-  const int BUFFER_COUNT = 5;
-  GLuint buffers[BUFFER_COUNT];
+  // streaming buffer, data of each draw is appended and storage is orphaned when it is full
+  struct StreamRing {
+      GLenum target;
+      GLuint buffer;
+      GLsizeiptr size;
+      GLintptr offset;  // where data of next draw goes
+      bool allocated;   // storage of current size was given to GL
+  };
+  StreamRing vertexRing {GL_ARRAY_BUFFER, 0, 2 * 1024 * 1024, 0, false};
+  StreamRing indexRing {GL_ELEMENT_ARRAY_BUFFER, 0, 512 * 1024, 0, false};
+
+  // vertex count of current arrays as told by engine (0 if unknown, indices are scanned then)
+  GLsizei knownVertices = 0;
+  // GL_OES_element_index_uint is supported
+  bool hasUintIndices = false;
 
   // used in glDrawArrays to convert GL_QUADS into GL_TRIANGLES
   GLuint INDEX_DUMMY_ELEMENT_BUFFER = 10;
@@ -91,6 +100,64 @@ namespace gles_adapter {
 
   GenericBuffer vp, tp, cp;
 
+  // GL functions used for drawing
+  const GlesFunctions realFunctions = {
+    &glUseProgram,
+    &glUniformMatrix4fv,
+    &glUniform1f,
+    &glVertexAttribPointer,
+    &glEnableVertexAttribArray,
+    &glDisableVertexAttribArray,
+    &glBindBuffer,
+    &glBufferData,
+    &glBufferSubData,
+    &glDrawArrays,
+    &glDrawElements,
+    &glGetError,
+    &glEnable,
+    &glDisable,
+    &glBlendFunc,
+    &glBindTexture,
+  };
+  GlesFunctions glf = realFunctions;
+
+  // attribute state that was last sent to GL
+  struct AttribCache {
+      bool enabled;
+      bool valid; // pointer below was sent
+      GLint size;
+      GLenum type;
+      GLboolean normalized;
+      GLsizei stride;
+      const GLvoid *ptr;
+      GLuint buffer;
+  };
+  AttribCache positionCache {}, texCoordCache {}, colorCache {};
+
+  // program and uniform state that was last sent to GL
+  bool useStateCache = true;
+  bool isProgramCurrent = false;
+  bool isProjMatDirty = true;
+  bool isModelViewMatDirty = true;
+  float sentEnableTexture = -1;
+  float sentEnableAlphaTest = -1;
+
+  // draws that wait to be merged with following draws of the same state
+  const GLsizei MERGE_MAX_VERTICES = 1024;    // bigger draws are not copied, but drawn at once
+  const GLsizei MERGE_BATCH_VERTICES = 16384; // must fit 16 bit indices
+  struct PendingBatch {
+      GLsizei draws;
+      GLsizei vertices;
+      bool useTexCoord;
+      bool useColor;
+      GenericBuffer vp, tp, cp; // formats of arrays
+      std::vector<uint8_t> positions, texCoords, colors;
+      std::vector<uint16_t> indices;
+  };
+  PendingBatch pending {};
+  bool useDrawMerging = true;
+  DrawMergeCounts drawMergeCounts {};
+
   const char *VERTEX_SHADER = R"***(
     precision highp float;
 
@@ -152,6 +219,22 @@ namespace gles_adapter {
   glm::mat4 projMat = glm::mat4(1);
   glm::mat4 *currentMatrix = &modelViewMat;
 
+  void markMatrixDirty() {
+    if (currentMatrix == &projMat) {
+      isProjMatDirty = true;
+    } else {
+      isModelViewMatDirty = true;
+    }
+  }
+
+  // change current matrix, pending draws are flushed only if it really changes
+  void setCurrentMatrix(const glm::mat4 &matrix) {
+    if (matrix == *currentMatrix) return;
+    flushDraws();
+    *currentMatrix = matrix;
+    markMatrixDirty();
+  }
+
   float *getProjMat() {
     return glm::value_ptr(gles_adapter::projMat);
   }
@@ -209,6 +292,7 @@ namespace gles_adapter {
   }
 
   void gles_adp_glFinish(void) {
+    flushDraws();
     glFinish();
     setError(glGetError());
   };
@@ -246,7 +330,11 @@ namespace gles_adapter {
       blockingError("Something wrong with OpenGL: ", error);
     }
 
-    glGenBuffers(BUFFER_COUNT, buffers);
+    glGenBuffers(1, &vertexRing.buffer);
+    glGenBuffers(1, &indexRing.buffer);
+
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    hasUintIndices = extensions && strstr(extensions, "GL_OES_element_index_uint");
     glGenBuffers(1, &INDEX_DUMMY_ELEMENT_BUFFER);
   }
 
@@ -262,81 +350,268 @@ namespace gles_adapter {
       }
   }
 
-  void syncBuffers(GLsizei vertices) {
-    uint32_t totalSize;
-    // upload vertex buffer
-    if (USE_BUFFER_DATA) {
-      totalSize = (vp.stride ? vp.stride : vp.size * byterPer(vp.type)) * vertices;
-      glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_POSITION]);
-      glBufferData(GL_ARRAY_BUFFER, totalSize, vp.ptr, GL_STREAM_DRAW);
-      glVertexAttribPointer(INDEX_POSITION, vp.size, vp.type, GL_FALSE, vp.stride, 0);
-      glBindBuffer(GL_ARRAY_BUFFER, 0);
-    } else {
-      glVertexAttribPointer(INDEX_POSITION, vp.size, vp.type, GL_FALSE, vp.stride, vp.ptr);
-    }
-    glEnableVertexAttribArray(INDEX_POSITION);
-
-    // upload Texture buffer
-    if (isGL_TEXTURE_COORD_ARRAY) {
-      if (USE_BUFFER_DATA) {
-        totalSize = (tp.stride ? tp.stride : tp.size * byterPer(tp.type)) * vertices;
-        glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_TEXTURE_COORD]);
-        glBufferData(GL_ARRAY_BUFFER, totalSize, tp.ptr, GL_STREAM_DRAW);
-        glVertexAttribPointer(INDEX_TEXTURE_COORD, tp.size, tp.type, GL_FALSE, tp.stride, 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-      } else {
-        glVertexAttribPointer(INDEX_TEXTURE_COORD, tp.size, tp.type, GL_FALSE, tp.stride, tp.ptr);
+  void disableAttrib(GLuint index, AttribCache &cache) {
+    if (cache.enabled) {
+      glf.disableVertexAttribArray(index);
+      cache.enabled = false;
+    }
+  }
+
+  // set attribute pointer (buffer must be bound if given) and enable it, skipping what is already set
+  void syncAttrib(GLuint index, AttribCache &cache, const GenericBuffer &b, GLboolean normalized, GLuint buffer, const GLvoid *ptr) {
+    if (!cache.valid || cache.size != b.size || cache.type != b.type || cache.normalized != normalized ||
+        cache.stride != b.stride || cache.ptr != ptr || cache.buffer != buffer) {
+      glf.vertexAttribPointer(index, b.size, b.type, normalized, b.stride, ptr);
+      cache.valid = true;
+      cache.size = b.size;
+      cache.type = b.type;
+      cache.normalized = normalized;
+      cache.stride = b.stride;
+      cache.ptr = ptr;
+      cache.buffer = buffer;
+    }
+    if (!cache.enabled) {
+      glf.enableVertexAttribArray(index);
+      cache.enabled = true;
+    }
+  }
+
+  void forgetUniforms() {
+    isProjMatDirty = true;
+    isModelViewMatDirty = true;
+    sentEnableTexture = -1;
+    sentEnableAlphaTest = -1;
+  }
+
+  void releaseAttribs() {
+    disableAttrib(INDEX_POSITION, positionCache);
+    disableAttrib(INDEX_TEXTURE_COORD, texCoordCache);
+    disableAttrib(INDEX_COLOR, colorCache);
+    // someone else might change pointers of these indices
+    positionCache.valid = false;
+    texCoordCache.valid = false;
+    colorCache.valid = false;
+    // uniforms belong to our program, so they don't need to be sent again
+    isProgramCurrent = false;
+  }
+
+  void releaseState() {
+    flushDraws();
+    releaseAttribs();
+  }
+
+  // copy data to ring (its buffer must be bound), returns offset of data in buffer
+  GLintptr streamData(StreamRing &ring, const GLvoid *data, GLsizeiptr bytes) {
+    GLsizeiptr alignedBytes = (bytes + 15) & ~(GLsizeiptr) 15;
+    if (alignedBytes > ring.size) {
+      while (ring.size < alignedBytes) {
+        ring.size *= 2;
       }
-      glEnableVertexAttribArray(INDEX_TEXTURE_COORD);
+      ring.allocated = false;
     }
+    if (!ring.allocated || ring.offset + alignedBytes > ring.size) {
+      // orphan old storage (driver keeps it until draws that use it are done) and start from beginning
+      glf.bufferData(ring.target, ring.size, NULL, GL_STREAM_DRAW);
+      ring.allocated = true;
+      ring.offset = 0;
+    }
+    GLintptr offset = ring.offset;
+    glf.bufferSubData(ring.target, offset, bytes, data);
+    ring.offset += alignedBytes;
+    return offset;
+  }
 
-    // upload Color buffer
-    if (isGL_COLOR_ARRAY) {
-      if (USE_BUFFER_DATA) {
-        totalSize = (cp.stride ? cp.stride : cp.size * byterPer(cp.type)) * vertices;
-        glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_COLOR]);
-        glBufferData(GL_ARRAY_BUFFER, totalSize, cp.ptr, GL_STREAM_DRAW);
-        glVertexAttribPointer(INDEX_COLOR, cp.size, cp.type, GL_TRUE, cp.stride, 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-      } else {
-        glVertexAttribPointer(INDEX_COLOR, cp.size, cp.type, GL_TRUE, cp.stride, cp.ptr);
+  // bytes of array used by given number of vertices
+  GLsizeiptr arrayBytes(const GenericBuffer &b, GLsizei vertices) {
+    GLsizeiptr elementSize = b.size * byterPer(b.type);
+    if (vertices <= 0) return 0;
+    return (b.stride ? b.stride : elementSize) * (vertices - 1) + elementSize;
+  }
+
+  // upload arrays to vertex ring (it must be bound) and get their offsets,
+  // arrays that overlap (interleaved vertices) are uploaded together
+  void streamArrays(GLsizei vertices, const GenericBuffer *arrays[], const GLvoid *offsets[], int count) {
+    const uint8_t *begins[3], *ends[3];
+    int order[3];
+    for (int i = 0; i < count; i++) {
+      begins[i] = (const uint8_t *) arrays[i]->ptr;
+      ends[i] = begins[i] + arrayBytes(*arrays[i], vertices);
+      // keep order sorted by start
+      int j = i;
+      while (j > 0 && begins[order[j - 1]] > begins[i]) {
+        order[j] = order[j - 1];
+        j--;
+      }
+      order[j] = i;
+    }
+
+    int first = 0;
+    while (first < count) {
+      const uint8_t *begin = begins[order[first]];
+      const uint8_t *end = ends[order[first]];
+      int last = first + 1;
+      while (last < count && begins[order[last]] <= end) {
+        if (ends[order[last]] > end) end = ends[order[last]];
+        last++;
       }
-      glEnableVertexAttribArray(INDEX_COLOR);
+      GLintptr offset = streamData(vertexRing, begin, end - begin);
+      for (int k = first; k < last; k++) {
+        offsets[order[k]] = (const GLvoid *) (offset + (begins[order[k]] - begin));
+      }
+      first = last;
+    }
+  }
+
+  void syncBuffers(GLsizei vertices) {
+    bool useTexCoord = isGL_TEXTURE_COORD_ARRAY;
+    bool useColor = isGL_COLOR_ARRAY;
+    const GLvoid *positionPtr = vp.ptr;
+    const GLvoid *texCoordPtr = tp.ptr;
+    const GLvoid *colorPtr = cp.ptr;
+    GLuint buffer = 0;
+
+    // upload arrays
+    if (USE_BUFFER_DATA) {
+      const GenericBuffer *arrays[3] = {&vp};
+      const GLvoid *offsets[3];
+      int count = 1;
+      if (useTexCoord) arrays[count++] = &tp;
+      if (useColor) arrays[count++] = &cp;
+      buffer = vertexRing.buffer;
+      glf.bindBuffer(GL_ARRAY_BUFFER, buffer);
+      streamArrays(vertices, arrays, offsets, count);
+      count = 0;
+      positionPtr = offsets[count++];
+      if (useTexCoord) texCoordPtr = offsets[count++];
+      if (useColor) colorPtr = offsets[count++];
+    }
+
+    // vertex attributes
+    syncAttrib(INDEX_POSITION, positionCache, vp, GL_FALSE, buffer, positionPtr);
+    if (useTexCoord) {
+      syncAttrib(INDEX_TEXTURE_COORD, texCoordCache, tp, GL_FALSE, buffer, texCoordPtr);
+    } else {
+      disableAttrib(INDEX_TEXTURE_COORD, texCoordCache);
+    }
+    if (useColor) {
+      syncAttrib(INDEX_COLOR, colorCache, cp, GL_TRUE, buffer, colorPtr);
     } else {
+      disableAttrib(INDEX_COLOR, colorCache);
       reportError("color array disabled");
     }
+    if (buffer) {
+      glf.bindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
     // program
-    glUseProgram(program);
+    if (!isProgramCurrent) {
+      glf.useProgram(program);
+      isProgramCurrent = true;
+    }
 
     // uniforms
-    glUniformMatrix4fv(projMatIdx, 1, GL_FALSE, glm::value_ptr(projMat));
-    glUniformMatrix4fv(modelViewMatIdx, 1, GL_FALSE, glm::value_ptr(modelViewMat));
-    glUniform1f(enableTextureLoc, isGL_TEXTURE_2D ? 1 : 0);
+    if (isProjMatDirty) {
+      glf.uniformMatrix4fv(projMatIdx, 1, GL_FALSE, glm::value_ptr(projMat));
+      isProjMatDirty = false;
+    }
+    if (isModelViewMatDirty) {
+      glf.uniformMatrix4fv(modelViewMatIdx, 1, GL_FALSE, glm::value_ptr(modelViewMat));
+      isModelViewMatDirty = false;
+    }
+    float enableTexture = isGL_TEXTURE_2D ? 1 : 0;
+    if (enableTexture != sentEnableTexture) {
+      glf.uniform1f(enableTextureLoc, enableTexture);
+      sentEnableTexture = enableTexture;
+    }
 
     if (alphaTestFunc != GL_GEQUAL || alphaTestRef != 0.5f) {
       blockingError("glAlphaFunc with invalid arguments");
     }
-    glUniform1f(enableAlphaTestLoc, isGL_ALPHA_TEST ? 1 : 0);
+    float enableAlphaTest = isGL_ALPHA_TEST ? 1 : 0;
+    if (enableAlphaTest != sentEnableAlphaTest) {
+      glf.uniform1f(enableAlphaTestLoc, enableAlphaTest);
+      sentEnableAlphaTest = enableAlphaTest;
+    }
   }
 
   void syncBuffersPost() {
-    glDisableVertexAttribArray(INDEX_POSITION);
-    if (isGL_TEXTURE_COORD_ARRAY) {
-      glDisableVertexAttribArray(INDEX_TEXTURE_COORD);
-    }
-    if (isGL_COLOR_ARRAY) {
-      glDisableVertexAttribArray(INDEX_COLOR);
+    // without caching, leave nothing behind (arrays are disabled and everything is sent again)
+    if (!useStateCache) {
+      releaseAttribs();
+      forgetUniforms();
     }
   }
 
+  void runWithGlesFunctions(const GlesFunctions &functions, void (*commandStream)()) {
+    // bring real GL to a known state (this also draws what is pending)
+    releaseState();
+
+    // remember what the stream might change
+    bool oldGL_ALPHA_TEST = isGL_ALPHA_TEST;
+    bool oldGL_TEXTURE_2D = isGL_TEXTURE_2D;
+    bool oldGL_VERTEX_ARRAY = isGL_VERTEX_ARRAY;
+    bool oldGL_TEXTURE_COORD_ARRAY = isGL_TEXTURE_COORD_ARRAY;
+    bool oldGL_NORMAL_ARRAY = isGL_NORMAL_ARRAY;
+    bool oldGL_COLOR_ARRAY = isGL_COLOR_ARRAY;
+    glm::mat4 oldModelViewMat = modelViewMat;
+    glm::mat4 oldProjMat = projMat;
+    glm::mat4 *oldCurrentMatrix = currentMatrix;
+    GenericBuffer oldVp = vp, oldTp = tp, oldCp = cp;
+    GLenum oldAlphaTestFunc = alphaTestFunc;
+    GLclampf oldAlphaTestRef = alphaTestRef;
+    GLenum oldLastError = lastError;
+    size_t oldDummyElements = dummyElementBuffer.size();
+    StreamRing oldVertexRing = vertexRing, oldIndexRing = indexRing;
+    GLsizei oldKnownVertices = knownVertices;
+
+    forgetUniforms();
+    // buffers need names even if GL was never initialized (like INDEX_DUMMY_ELEMENT_BUFFER)
+    if (!vertexRing.buffer) vertexRing.buffer = 11;
+    if (!indexRing.buffer) indexRing.buffer = 12;
+    glf = functions;
+    commandStream();
+    flushDraws();
+    glf = realFunctions;
+
+    // real GL has seen none of that (its arrays were disabled above)
+    positionCache = {};
+    texCoordCache = {};
+    colorCache = {};
+    isProgramCurrent = false;
+    forgetUniforms();
+    // quad indices beyond the old size were never uploaded
+    dummyElementBuffer.resize(oldDummyElements);
+    // nor anything streamed to rings
+    vertexRing = oldVertexRing;
+    indexRing = oldIndexRing;
+    knownVertices = oldKnownVertices;
+
+    isGL_ALPHA_TEST = oldGL_ALPHA_TEST;
+    isGL_TEXTURE_2D = oldGL_TEXTURE_2D;
+    isGL_VERTEX_ARRAY = oldGL_VERTEX_ARRAY;
+    isGL_TEXTURE_COORD_ARRAY = oldGL_TEXTURE_COORD_ARRAY;
+    isGL_NORMAL_ARRAY = oldGL_NORMAL_ARRAY;
+    isGL_COLOR_ARRAY = oldGL_COLOR_ARRAY;
+    modelViewMat = oldModelViewMat;
+    projMat = oldProjMat;
+    currentMatrix = oldCurrentMatrix;
+    vp = oldVp;
+    tp = oldTp;
+    cp = oldCp;
+    alphaTestFunc = oldAlphaTestFunc;
+    alphaTestRef = oldAlphaTestRef;
+    lastError = oldLastError;
+  }
+
   // state managment
   void gles_adp_glEnable(GLenum cap) {
     switch (cap) {
       case GL_TEXTURE_2D:
+        if (!isGL_TEXTURE_2D) flushDraws();
         isGL_TEXTURE_2D = true;
         break;
       case GL_ALPHA_TEST:
+        if (!isGL_ALPHA_TEST) flushDraws();
         isGL_ALPHA_TEST = true;
         break;
       case GL_CLIP_PLANE0:
@@ -352,8 +627,9 @@ namespace gles_adapter {
       case GL_SAMPLE_COVERAGE:
       case GL_SCISSOR_TEST:
       case GL_STENCIL_TEST:
-        glEnable(cap);
-        setError(glGetError());
+        flushDraws();
+        glf.enable(cap);
+        setError(glf.getError());
         break;
       default:
         reportError("glEnable");
@@ -363,9 +639,11 @@ namespace gles_adapter {
   void gles_adp_glDisable(GLenum cap) {
     switch (cap) {
       case GL_TEXTURE_2D:
+        if (isGL_TEXTURE_2D) flushDraws();
         isGL_TEXTURE_2D = false;
         break;
       case GL_ALPHA_TEST:
+        if (isGL_ALPHA_TEST) flushDraws();
         isGL_ALPHA_TEST = false;
         break;
       case GL_CLIP_PLANE0:
@@ -380,8 +658,9 @@ namespace gles_adapter {
       case GL_SAMPLE_COVERAGE:
       case GL_SCISSOR_TEST:
       case GL_STENCIL_TEST:
-        glDisable(cap);
-        setError(glGetError());
+        flushDraws();
+        glf.disable(cap);
+        setError(glf.getError());
         break;
       default:
         reportError("glDisable");
@@ -429,35 +708,42 @@ namespace gles_adapter {
   }
 
   void gles_adp_glClear(GLbitfield mask) {
+    flushDraws();
     glClear(mask);
     setError(glGetError());
   };
 
   void gles_adp_glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) {
+    flushDraws();
     glColorMask(red, green, blue, alpha);
   }
 
   void gles_adp_glAlphaFunc(GLenum func, GLclampf ref) {
+    if (func != alphaTestFunc || ref != alphaTestRef) flushDraws();
     alphaTestFunc = func;
     alphaTestRef = ref;
   };
 
   void gles_adp_glBlendFunc(GLenum sfactor, GLenum dfactor) {
-    glBlendFunc(sfactor, dfactor);
-    setError(glGetError());
+    flushDraws();
+    glf.blendFunc(sfactor, dfactor);
+    setError(glf.getError());
   };
 
   void gles_adp_glCullFace(GLenum mode) {
+    flushDraws();
     glCullFace(mode);
     setError(glGetError());
   };
 
   void gles_adp_glFrontFace(GLenum mode) {
+    flushDraws();
     glFrontFace(mode);
     setError(glGetError());
   };
 
   void gles_adp_glScissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+    flushDraws();
     glScissor(x, y, width, height);
     setError(glGetError());
   }
@@ -524,16 +810,19 @@ namespace gles_adapter {
   };
 
   void gles_adp_glDepthFunc(GLenum func) {
+    flushDraws();
     glDepthFunc(func);
     setError(glGetError());
   };
 
   void gles_adp_glDepthMask(GLboolean flag) {
+    flushDraws();
     glDepthMask(flag);
     setError(glGetError());
   };
 
   void gles_adp_glDepthRange(GLclampd near_val, GLclampd far_val) {
+    flushDraws();
     glDepthRangef(near_val, far_val);
     setError(glGetError());
   };
@@ -562,7 +851,7 @@ namespace gles_adapter {
   gles_adp_glOrtho(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble near_val,
                    GLdouble far_val) {
     glm::mat4 toMult = glm::ortho(left, right, bottom, top, near_val, far_val);
-    (*currentMatrix) *= toMult;
+    setCurrentMatrix(*currentMatrix * toMult);
   }
 
   void
@@ -570,33 +859,34 @@ namespace gles_adapter {
                      GLdouble near_val,
                      GLdouble far_val) {
     glm::mat4 toMult = glm::frustum(left, right, bottom, top, near_val, far_val);
-    (*currentMatrix) *= toMult;
+    setCurrentMatrix(*currentMatrix * toMult);
   }
 
   void gles_adp_glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    flushDraws();
     glViewport(x, y, width, height);
   }
 
   void gles_adp_glLoadIdentity(void) {
-    *currentMatrix = glm::mat4(1);
+    setCurrentMatrix(glm::mat4(1));
   };
 
   void gles_adp_glLoadMatrixd(const GLdouble *m) {
-    (*currentMatrix) = glm::make_mat4(m);
+    setCurrentMatrix(glm::make_mat4(m));
   };
 
   void gles_adp_glLoadMatrixf(const GLfloat *m) {
-    (*currentMatrix) = glm::make_mat4(m);
+    setCurrentMatrix(glm::make_mat4(m));
   };
 
   void gles_adp_glMultMatrixd(const GLdouble *m) {
     glm::mat4 toMult = glm::make_mat4(m);
-    (*currentMatrix) *= toMult;
+    setCurrentMatrix(*currentMatrix * toMult);
   };
 
   void gles_adp_glMultMatrixf(const GLfloat *m) {
     glm::mat4 toMult = glm::make_mat4(m);
-    (*currentMatrix) *= toMult;
+    setCurrentMatrix(*currentMatrix * toMult);
   };
 
   void gles_adp_glVertexPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *ptr) {
@@ -605,6 +895,12 @@ namespace gles_adapter {
     vp.type = type;
     vp.stride = stride;
     vp.ptr = ptr;
+    // new arrays, vertex count is not known until engine tells it
+    knownVertices = 0;
+  }
+
+  void setVertexCount(GLsizei vertices) {
+    knownVertices = vertices;
   }
 
   void gles_adp_glColorPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *ptr) {
@@ -621,6 +917,144 @@ namespace gles_adapter {
     tp.ptr = ptr;
   }
 
+  bool sameFormat(const GenericBuffer &a, const GenericBuffer &b) {
+    return a.size == b.size && a.type == b.type;
+  }
+
+  // append vertices of array to its tightly packed copy
+  void copyArray(std::vector<uint8_t> &copy, const GenericBuffer &b, GLsizei vertices) {
+    size_t elementSize = b.size * byterPer(b.type);
+    size_t stride = b.stride ? b.stride : elementSize;
+    size_t start = copy.size();
+    copy.resize(start + elementSize * vertices);
+    uint8_t *dst = copy.data() + start;
+    const uint8_t *src = (const uint8_t *) b.ptr;
+    if (stride == elementSize) {
+      memcpy(dst, src, elementSize * vertices);
+      return;
+    }
+    for (GLsizei i = 0; i < vertices; i++) {
+      memcpy(dst, src, elementSize);
+      dst += elementSize;
+      src += stride;
+    }
+  }
+
+  // copy draw into pending batch with its indices rebased (NULL indices draw quads),
+  // returns false if it must be drawn at once (pending draws are flushed then)
+  bool mergeDraw(GLsizei vertices, GLsizei count, GLenum type, const GLvoid *indices) {
+    if (!useDrawMerging || vertices <= 0 || vertices > MERGE_MAX_VERTICES) {
+      flushDraws();
+      return false;
+    }
+
+    bool useTexCoord = isGL_TEXTURE_COORD_ARRAY;
+    bool useColor = isGL_COLOR_ARRAY;
+    if (pending.draws > 0) {
+      bool compatible = pending.useTexCoord == useTexCoord && pending.useColor == useColor &&
+                        sameFormat(pending.vp, vp) &&
+                        (!useTexCoord || sameFormat(pending.tp, tp)) &&
+                        (!useColor || sameFormat(pending.cp, cp)) &&
+                        pending.vertices + vertices <= MERGE_BATCH_VERTICES;
+      if (!compatible) {
+        flushDraws();
+      }
+    }
+    if (pending.draws == 0) {
+      pending.useTexCoord = useTexCoord;
+      pending.useColor = useColor;
+      pending.vp = vp;
+      pending.tp = tp;
+      pending.cp = cp;
+    }
+
+    copyArray(pending.positions, vp, vertices);
+    if (useTexCoord) copyArray(pending.texCoords, tp, vertices);
+    if (useColor) copyArray(pending.colors, cp, vertices);
+
+    uint16_t base = (uint16_t) pending.vertices;
+    size_t start = pending.indices.size();
+    if (!indices) {
+      GLsizei quads = vertices / 4;
+      pending.indices.resize(start + quads * 6);
+      uint16_t *dst = pending.indices.data() + start;
+      for (GLsizei i = 0; i < quads; i++) {
+        uint16_t first = base + i * 4;
+        *(dst++) = first + 0;
+        *(dst++) = first + 1;
+        *(dst++) = first + 2;
+        *(dst++) = first + 2;
+        *(dst++) = first + 3;
+        *(dst++) = first + 0;
+      }
+    } else {
+      pending.indices.resize(start + count);
+      uint16_t *dst = pending.indices.data() + start;
+      if (type == GL_UNSIGNED_SHORT) {
+        const uint16_t *src = (const uint16_t *) indices;
+        for (GLsizei i = 0; i < count; i++) dst[i] = base + src[i];
+      } else {
+        const uint8_t *src = (const uint8_t *) indices;
+        for (GLsizei i = 0; i < count; i++) dst[i] = base + src[i];
+      }
+    }
+
+    pending.vertices += vertices;
+    pending.draws++;
+    return true;
+  }
+
+  // draw indexed triangles from current arrays
+  void drawTriangles(GLsizei vertices, GLsizei count, GLenum type, const GLvoid *indices, uint32_t bytePerElement) {
+    drawMergeCounts.batches++;
+    syncBuffers(vertices);
+    if (USE_BUFFER_DATA) {
+      glf.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexRing.buffer);
+      GLintptr offset = streamData(indexRing, indices, count * bytePerElement);
+      glf.drawElements(GL_TRIANGLES, count, type, (const GLvoid *) offset);
+      glf.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    } else {
+      glf.drawElements(GL_TRIANGLES, count, type, indices);
+    }
+    syncBuffersPost();
+    setError(glf.getError());
+  }
+
+  void flushDraws() {
+    if (pending.draws == 0) return;
+
+    // draw from copies (arrays of engine are left as they were)
+    GenericBuffer oldVp = vp, oldTp = tp, oldCp = cp;
+    bool oldGL_TEXTURE_COORD_ARRAY = isGL_TEXTURE_COORD_ARRAY;
+    bool oldGL_COLOR_ARRAY = isGL_COLOR_ARRAY;
+    vp = pending.vp;
+    vp.stride = 0;
+    vp.ptr = pending.positions.data();
+    tp = pending.tp;
+    tp.stride = 0;
+    tp.ptr = pending.texCoords.data();
+    cp = pending.cp;
+    cp.stride = 0;
+    cp.ptr = pending.colors.data();
+    isGL_TEXTURE_COORD_ARRAY = pending.useTexCoord;
+    isGL_COLOR_ARRAY = pending.useColor;
+
+    drawTriangles(pending.vertices, pending.indices.size(), GL_UNSIGNED_SHORT, pending.indices.data(), 2);
+
+    vp = oldVp;
+    tp = oldTp;
+    cp = oldCp;
+    isGL_TEXTURE_COORD_ARRAY = oldGL_TEXTURE_COORD_ARRAY;
+    isGL_COLOR_ARRAY = oldGL_COLOR_ARRAY;
+
+    pending.draws = 0;
+    pending.vertices = 0;
+    pending.positions.clear();
+    pending.texCoords.clear();
+    pending.colors.clear();
+    pending.indices.clear();
+  }
+
   void gles_adp_glDrawArrays(GLenum mode, GLint first, GLsizei count) {
     if (!enableDraws) return;
     if (!isGL_VERTEX_ARRAY) return;
@@ -629,6 +1063,11 @@ namespace gles_adapter {
       blockingError("unimplemented mode");
     }
 
+    drawMergeCounts.draws++;
+    if (mergeDraw(count, 0, 0, NULL)) {
+      return;
+    }
+
     // index buffer
     std::vector<uint16_t> &buffer = dummyElementBuffer;
 
@@ -647,17 +1086,18 @@ namespace gles_adapter {
         faceNumber++;
       }
       // upload
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, INDEX_DUMMY_ELEMENT_BUFFER);
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER, vertices * 2, buffer.data(), GL_STATIC_DRAW);
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+      glf.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, INDEX_DUMMY_ELEMENT_BUFFER);
+      glf.bufferData(GL_ELEMENT_ARRAY_BUFFER, vertices * 2, buffer.data(), GL_STATIC_DRAW);
+      glf.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
 
-    syncBuffers(vertices);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, INDEX_DUMMY_ELEMENT_BUFFER);
-    glDrawElements(GL_TRIANGLES, vertices, GL_UNSIGNED_SHORT, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    drawMergeCounts.batches++;
+    syncBuffers(count);
+    glf.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, INDEX_DUMMY_ELEMENT_BUFFER);
+    glf.drawElements(GL_TRIANGLES, vertices, GL_UNSIGNED_SHORT, 0);
+    glf.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     syncBuffersPost();
-    setError(glGetError());
+    setError(glf.getError());
   }
 
   void gles_adp_glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices) {
@@ -667,34 +1107,47 @@ namespace gles_adapter {
     if (mode != GL_TRIANGLES) {
       blockingError("unimplemented mode");
     }
+    drawMergeCounts.draws++;
 
-    uint32_t totalVertices = 0;
+    // without vertex count from engine, indices must be scanned (for upload size, merging and 16 bit overflow)
+    GLsizei totalVertices = knownVertices;
+    bool scan = totalVertices <= 0;
+    bool needCount = USE_BUFFER_DATA || (useDrawMerging && count <= MERGE_MAX_VERTICES * 3);
     uint32_t bytePerElement = 0;
     if (type == GL_UNSIGNED_INT) {
-      if (count > dummyIndexBuffer.size()) {
-        dummyIndexBuffer.resize(count);
-      }
-      uint32_t *bf = (uint32_t *) indices;
-      for (uint32_t i = 0; i < count; i++) {
-        dummyIndexBuffer[i] = (uint16_t) bf[i];
-        if (dummyIndexBuffer[i] != bf[i]) {
-          blockingError("Panic!: uint16_t overflow");
+      const uint32_t *bf = (const uint32_t *) indices;
+      if (!scan && totalVertices > 0x10000 && hasUintIndices) {
+        // too many vertices for 16 bit indices, draw them as they are
+        bytePerElement = 4;
+      } else {
+        if (count > dummyIndexBuffer.size()) {
+          dummyIndexBuffer.resize(count);
         }
-      }
-      if (USE_BUFFER_DATA) {
-        for (uint32_t i = 0; i < count; i++) {
-          if (dummyIndexBuffer[i] >= totalVertices) {
-            totalVertices = bf[i] + 1;
+        uint16_t *narrow = dummyIndexBuffer.data();
+        if (!scan && totalVertices <= 0x10000) {
+          // all indices are below vertex count, so they fit
+          for (GLsizei i = 0; i < count; i++) {
+            narrow[i] = (uint16_t) bf[i];
+          }
+        } else {
+          uint32_t maxIndex = 0;
+          for (GLsizei i = 0; i < count; i++) {
+            narrow[i] = (uint16_t) bf[i];
+            if (narrow[i] != bf[i]) {
+              blockingError("Panic!: uint16_t overflow");
+            }
+            if (bf[i] > maxIndex) maxIndex = bf[i];
           }
+          if (scan && count > 0) totalVertices = maxIndex + 1;
         }
+        indices = (const GLvoid *) narrow;
+        type = GL_UNSIGNED_SHORT;
+        bytePerElement = 2;
       }
-      indices = (void*) dummyIndexBuffer.data();
-      type = GL_UNSIGNED_SHORT;
-      bytePerElement = 2;
     } else if (type == GL_UNSIGNED_SHORT) {
-      uint16_t *bf = (uint16_t *) indices;
-      if (USE_BUFFER_DATA) {
-        for (uint32_t i = 0; i < count; i++) {
+      const uint16_t *bf = (const uint16_t *) indices;
+      if (scan && needCount) {
+        for (GLsizei i = 0; i < count; i++) {
           if (bf[i] >= totalVertices) {
             totalVertices = bf[i] + 1;
           }
@@ -702,9 +1155,9 @@ namespace gles_adapter {
       }
       bytePerElement = 2;
     } else if (type == GL_UNSIGNED_BYTE) {
-      uint8_t *bf = (uint8_t *) indices;
-      if (USE_BUFFER_DATA) {
-        for (uint32_t i = 0; i < count; i++) {
+      const uint8_t *bf = (const uint8_t *) indices;
+      if (scan && needCount) {
+        for (GLsizei i = 0; i < count; i++) {
           if (bf[i] >= totalVertices) {
             totalVertices = bf[i] + 1;
           }
@@ -715,17 +1168,12 @@ namespace gles_adapter {
       blockingError("Invalid type in glDrawElements");
     }
 
-    syncBuffers(totalVertices);
-    if (USE_BUFFER_DATA) {
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[BUFFER_ELEMENTS]);
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * bytePerElement, indices, GL_STREAM_DRAW);
-      glDrawElements(mode, count, type, 0);
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    } else {
-      glDrawElements(mode, count, type, indices);
+    if (bytePerElement == 4) {
+      flushDraws();
+    } else if (mergeDraw(totalVertices, count, type, indices)) {
+      return;
     }
-    syncBuffersPost();
-    setError(glGetError());
+    drawTriangles(totalVertices, count, type, indices, bytePerElement);
   }
 
   void gles_adp_glPixelStorei(GLenum pname, GLint param) {
@@ -736,6 +1184,7 @@ namespace gles_adapter {
   void
   gles_adp_glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type,
                         GLvoid *pixels) {
+    flushDraws();
     if (format == GL_DEPTH_COMPONENT && type == GL_FLOAT) {
       float *it = (float*) pixels;
       for (GLsizei y = 0; y < height; y++) {
@@ -808,16 +1257,19 @@ namespace gles_adapter {
         return;
       }
     }
+    flushDraws();
     glTexParameteri(target, pname, param);
     setError(glGetError());
   };
 
   void gles_adp_glTexParameterfv(GLenum target, GLenum pname, const GLfloat *params) {
+    flushDraws();
     glTexParameterfv(target, pname, params);
     setError(glGetError());
   }
 
   void gles_adp_glTexParameteriv(GLenum target, GLenum pname, const GLint *params) {
+    flushDraws();
     glTexParameteriv(target, pname, params);
     setError(glGetError());
   }
@@ -837,6 +1289,7 @@ namespace gles_adapter {
                              const GLvoid *pixels) {
     // NB: internalFormat is ignored, the type should be managed by shader
     (void) internalFormat;
+    flushDraws();
     glTexImage2D(target, level, format, width, height, border, format, type, pixels);
     setError(glGetError());
   }
@@ -847,18 +1300,21 @@ namespace gles_adapter {
   };
 
   void gles_adp_glDeleteTextures(GLsizei n, const GLuint *textures) {
+    flushDraws();
     glDeleteTextures(n, textures);
     setError(glGetError());
   };
 
   void gles_adp_glBindTexture(GLenum target, GLuint texture) {
-    glBindTexture(target, texture);
-    setError(glGetError());
+    flushDraws();
+    glf.bindTexture(target, texture);
+    setError(glf.getError());
   };
 
   void
   gles_adp_glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width,
                            GLsizei height, GLenum format, GLenum type, const GLvoid *pixels) {
+    flushDraws();
     glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
     setError(glGetError());
   }
@@ -927,6 +1383,9 @@ namespace gles_adapter {
 
   void gles_adp_glEnd(void) {
     if (!enableDraws) return;
+    flushDraws();
+    drawMergeCounts.draws++;
+    drawMergeCounts.batches++;
 
     bool oldGL_VERTEX_ARRAY = isGL_VERTEX_ARRAY;
     bool oldGL_TEXTURE_COORD_ARRAY = isGL_TEXTURE_COORD_ARRAY;
@@ -941,9 +1400,9 @@ namespace gles_adapter {
     gles_adp_glTexCoordPointer(2, GL_FLOAT, sizeof(ImmediateVertex), (uint8_t *) immediateVertices.data() + sizeof(float) * 8);
 
     syncBuffers(offset);
-    glDrawArrays(mode, 0, offset);
+    glf.drawArrays(mode, 0, offset);
     syncBuffersPost();
-    setError(glGetError());
+    setError(glf.getError());
 
     isGL_VERTEX_ARRAY = oldGL_VERTEX_ARRAY;
     isGL_TEXTURE_COORD_ARRAY = oldGL_TEXTURE_COORD_ARRAY;
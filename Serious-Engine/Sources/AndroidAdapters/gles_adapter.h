@@ -10,6 +10,73 @@ namespace gles_adapter {
   void syncError();
   void gles_adp_init();
 
+  // GL entry points used when drawing (can be replaced, e.g. with a mock that counts calls)
+  struct GlesFunctions {
+    void (*useProgram)(GLuint program);
+    void (*uniformMatrix4fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+    void (*uniform1f)(GLint location, GLfloat v0);
+    void (*vertexAttribPointer)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *ptr);
+    void (*enableVertexAttribArray)(GLuint index);
+    void (*disableVertexAttribArray)(GLuint index);
+    void (*bindBuffer)(GLenum target, GLuint buffer);
+    void (*bufferData)(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage);
+    void (*bufferSubData)(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data);
+    void (*drawArrays)(GLenum mode, GLint first, GLsizei count);
+    void (*drawElements)(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices);
+    GLenum (*getError)(void);
+    void (*enable)(GLenum cap);
+    void (*disable)(GLenum cap);
+    void (*blendFunc)(GLenum sfactor, GLenum dfactor);
+    void (*bindTexture)(GLenum target, GLuint texture);
+  };
+
+  // when false, program, uniforms and attributes are sent again on every draw
+  extern bool useStateCache;
+  // when true, arrays and indices are streamed to buffers instead of being drawn from client memory
+  extern bool USE_BUFFER_DATA;
+  // number of vertices in arrays that were just set (lets draws skip scanning of indices)
+  void setVertexCount(GLsizei vertices);
+  // when true, small consecutive draws with the same state are copied and drawn as one
+  extern bool useDrawMerging;
+  // draw what is waiting to be merged (done on every state change and readback)
+  void flushDraws();
+  // draws given to adapter, and draws that it issued to GL
+  struct DrawMergeCounts {
+    uint32_t draws;
+    uint32_t batches;
+  };
+  extern DrawMergeCounts drawMergeCounts;
+  // disable adapter's vertex arrays and forget which program is current
+  // (must be called before code that uses its own programs and attributes)
+  void releaseState();
+  // run a command stream with GL replaced by given functions, adapter state is left as it was
+  void runWithGlesFunctions(const GlesFunctions &functions, void (*commandStream)());
+
+  // GL calls issued by a command stream (counted by mock GL functions)
+  struct GlesCallCounts {
+    uint32_t useProgram;
+    uint32_t uniforms;
+    uint32_t attribPointers;
+    uint32_t attribEnables;
+    uint32_t attribDisables;
+    uint32_t bufferBinds;
+    uint32_t bufferUploads;    // glBufferData (allocations and orphaning)
+    uint32_t bufferSubUploads; // glBufferSubData
+    uint32_t draws;
+    uint32_t getErrors;
+    uint32_t stateChanges;     // enables, blending and texture binds
+    uint32_t bytesUploaded;    // not a call, data given to buffers
+    uint32_t adapterDraws;     // not a call, draws given to adapter
+    uint32_t renderHash;       // not a call, hash of drawn vertices and state they were drawn with
+    uint32_t total() const {
+      return useProgram + uniforms + attribPointers + attribEnables + attribDisables + bufferBinds + bufferUploads + bufferSubUploads + draws + getErrors + stateChanges;
+    }
+  };
+  // run a command stream with mock GL and count the calls it would issue
+  GlesCallCounts countGlesCalls(void (*commandStream)());
+  // command stream recorded from a typical frame of menu and HUD drawing
+  void replayRecordedStream();
+
     /*
      * Miscellaneous
      */
@@ -0,0 +1,375 @@
+typedef double GLdouble;
+typedef double GLclampd;
+
+#include <GLES2/gl2.h>
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include <AndroidAdapters/gles_adapter.h>
+
+#define GL_QUADS 0x0007
+#define GL_MODELVIEW 0x1700
+#define GL_PROJECTION 0x1701
+#define GL_ALPHA_TEST 0x0BC0
+#ifndef GL_VERTEX_ARRAY
+#define GL_VERTEX_ARRAY 0x8074
+#endif
+#ifndef GL_TEXTURE_COORD_ARRAY
+#define GL_TEXTURE_COORD_ARRAY 0x8078
+#endif
+#define GL_COLOR_ARRAY 0x8076
+
+namespace gles_adapter {
+  GlesCallCounts counts;
+
+  // state of mock GL, kept so drawn vertices can be hashed together with state they are drawn with
+  struct MockAttrib {
+      bool enabled;
+      GLint size;
+      GLenum type;
+      GLsizei stride;
+      const GLvoid *ptr;
+      GLuint buffer;
+  };
+  MockAttrib mockAttribs[8];
+  GLuint mockArrayBuffer, mockElementBuffer;
+  std::map<GLuint, std::vector<uint8_t>> mockBuffers;
+  std::map<GLint, std::vector<float>> mockUniforms;
+  std::map<GLenum, bool> mockCaps;
+  GLenum mockBlend[2];
+  GLuint mockTexture;
+  bool isMockStateChanged;
+  uint32_t mockStateHash;
+
+  void resetMock() {
+    counts = {};
+    memset(mockAttribs, 0, sizeof(mockAttribs));
+    mockArrayBuffer = 0;
+    mockElementBuffer = 0;
+    mockBuffers.clear();
+    mockUniforms.clear();
+    mockCaps.clear();
+    mockBlend[0] = mockBlend[1] = 0;
+    mockTexture = 0;
+    isMockStateChanged = true;
+    counts.renderHash = 2166136261u;
+  }
+
+  uint32_t hashBytes(uint32_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t *) data;
+    for (size_t i = 0; i < size; i++) {
+      hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+  }
+
+  uint32_t getMockStateHash() {
+    if (!isMockStateChanged) return mockStateHash;
+    uint32_t hash = 2166136261u;
+    for (auto &uniform : mockUniforms) {
+      hash = hashBytes(hash, &uniform.first, sizeof(uniform.first));
+      hash = hashBytes(hash, uniform.second.data(), uniform.second.size() * sizeof(float));
+    }
+    for (auto &cap : mockCaps) {
+      if (cap.second) hash = hashBytes(hash, &cap.first, sizeof(cap.first));
+    }
+    hash = hashBytes(hash, mockBlend, sizeof(mockBlend));
+    hash = hashBytes(hash, &mockTexture, sizeof(mockTexture));
+    mockStateHash = hash;
+    isMockStateChanged = false;
+    return hash;
+  }
+
+  const uint8_t *mockData(GLuint buffer, const GLvoid *ptr) {
+    if (!buffer) return (const uint8_t *) ptr;
+    return mockBuffers[buffer].data() + (size_t) ptr;
+  }
+
+  // hash what one vertex would be drawn with
+  void drawMockVertex(uint32_t index) {
+    uint32_t state = getMockStateHash();
+    counts.renderHash = hashBytes(counts.renderHash, &state, sizeof(state));
+    for (GLuint i = 0; i < 8; i++) {
+      const MockAttrib &attrib = mockAttribs[i];
+      if (!attrib.enabled) continue;
+      GLsizei elementSize = attrib.size * (attrib.type == GL_FLOAT ? 4 : 1);
+      GLsizei stride = attrib.stride ? attrib.stride : elementSize;
+      counts.renderHash = hashBytes(counts.renderHash, &i, sizeof(i));
+      counts.renderHash = hashBytes(counts.renderHash, mockData(attrib.buffer, attrib.ptr) + stride * index, elementSize);
+    }
+  }
+
+  // mock GL, counts the calls and tracks state
+  void mockUseProgram(GLuint program) {
+    counts.useProgram++;
+  }
+
+  void mockUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
+    counts.uniforms++;
+    mockUniforms[location].assign(value, value + 16);
+    isMockStateChanged = true;
+  }
+
+  void mockUniform1f(GLint location, GLfloat v0) {
+    counts.uniforms++;
+    mockUniforms[location].assign(1, v0);
+    isMockStateChanged = true;
+  }
+
+  void mockVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *ptr) {
+    counts.attribPointers++;
+    MockAttrib &attrib = mockAttribs[index];
+    attrib.size = size;
+    attrib.type = type;
+    attrib.stride = stride;
+    attrib.ptr = ptr;
+    attrib.buffer = mockArrayBuffer;
+  }
+
+  void mockEnableVertexAttribArray(GLuint index) {
+    counts.attribEnables++;
+    mockAttribs[index].enabled = true;
+  }
+
+  void mockDisableVertexAttribArray(GLuint index) {
+    counts.attribDisables++;
+    mockAttribs[index].enabled = false;
+  }
+
+  void mockBindBuffer(GLenum target, GLuint buffer) {
+    counts.bufferBinds++;
+    if (target == GL_ARRAY_BUFFER) {
+      mockArrayBuffer = buffer;
+    } else {
+      mockElementBuffer = buffer;
+    }
+  }
+
+  void mockBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage) {
+    counts.bufferUploads++;
+    if (data) counts.bytesUploaded += size;
+    std::vector<uint8_t> &buffer = mockBuffers[target == GL_ARRAY_BUFFER ? mockArrayBuffer : mockElementBuffer];
+    buffer.assign(size, 0);
+    if (data) memcpy(buffer.data(), data, size);
+  }
+
+  void mockBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data) {
+    counts.bufferSubUploads++;
+    counts.bytesUploaded += size;
+    std::vector<uint8_t> &buffer = mockBuffers[target == GL_ARRAY_BUFFER ? mockArrayBuffer : mockElementBuffer];
+    if (buffer.size() < offset + size) buffer.resize(offset + size);
+    memcpy(buffer.data() + offset, data, size);
+  }
+
+  void mockDrawArrays(GLenum mode, GLint first, GLsizei count) {
+    counts.draws++;
+    for (GLsizei i = 0; i < count; i++) {
+      drawMockVertex(first + i);
+    }
+  }
+
+  void mockDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices) {
+    counts.draws++;
+    const uint8_t *src = mockData(mockElementBuffer, indices);
+    for (GLsizei i = 0; i < count; i++) {
+      if (type == GL_UNSIGNED_INT) {
+        drawMockVertex(((const uint32_t *) src)[i]);
+      } else if (type == GL_UNSIGNED_SHORT) {
+        drawMockVertex(((const uint16_t *) src)[i]);
+      } else {
+        drawMockVertex(src[i]);
+      }
+    }
+  }
+
+  GLenum mockGetError(void) {
+    counts.getErrors++;
+    return GL_NO_ERROR;
+  }
+
+  void mockEnable(GLenum cap) {
+    counts.stateChanges++;
+    mockCaps[cap] = true;
+    isMockStateChanged = true;
+  }
+
+  void mockDisable(GLenum cap) {
+    counts.stateChanges++;
+    mockCaps[cap] = false;
+    isMockStateChanged = true;
+  }
+
+  void mockBlendFunc(GLenum sfactor, GLenum dfactor) {
+    counts.stateChanges++;
+    mockBlend[0] = sfactor;
+    mockBlend[1] = dfactor;
+    isMockStateChanged = true;
+  }
+
+  void mockBindTexture(GLenum target, GLuint texture) {
+    counts.stateChanges++;
+    mockTexture = texture;
+    isMockStateChanged = true;
+  }
+
+  const GlesFunctions mockFunctions = {
+    &mockUseProgram,
+    &mockUniformMatrix4fv,
+    &mockUniform1f,
+    &mockVertexAttribPointer,
+    &mockEnableVertexAttribArray,
+    &mockDisableVertexAttribArray,
+    &mockBindBuffer,
+    &mockBufferData,
+    &mockBufferSubData,
+    &mockDrawArrays,
+    &mockDrawElements,
+    &mockGetError,
+    &mockEnable,
+    &mockDisable,
+    &mockBlendFunc,
+    &mockBindTexture,
+  };
+
+  GlesCallCounts countGlesCalls(void (*commandStream)()) {
+    resetMock();
+    DrawMergeCounts oldDrawMergeCounts = drawMergeCounts;
+    drawMergeCounts = {};
+    runWithGlesFunctions(mockFunctions, commandStream);
+    counts.adapterDraws = drawMergeCounts.draws;
+    drawMergeCounts = oldDrawMergeCounts;
+    return counts;
+  }
+
+  // recorded commands
+  enum RecordedOp {
+    OP_ORTHO,       // new 2D projection
+    OP_TEXTURE,     // enable/disable texturing
+    OP_ALPHATEST,   // enable/disable alpha test
+    OP_COLORARRAY,  // enable/disable color array
+    OP_BLEND,       // enable/disable blending
+    OP_BIND,        // bind texture
+    OP_QUADS,       // draw quads from arrays
+    OP_ELEMENTS,    // draw indexed triangles from arrays
+  };
+
+  struct RecordedCommand {
+    RecordedOp op;
+    int param;      // on/off, texture, or number of primitives
+    int repeat;
+  };
+
+  // one frame of menu and HUD: a background, many text/icon quads with the same state, some untextured fills
+  const RecordedCommand recordedFrame[] = {
+    {OP_ORTHO, 0, 1},
+    {OP_COLORARRAY, 1, 1},
+    {OP_TEXTURE, 1, 1},
+    {OP_BIND, 1, 1},
+    {OP_QUADS, 1, 1},
+    {OP_BLEND, 1, 1},
+    {OP_ALPHATEST, 1, 1},
+    {OP_BIND, 2, 1},
+    {OP_QUADS, 8, 120},
+    {OP_ALPHATEST, 0, 1},
+    {OP_TEXTURE, 0, 1},
+    {OP_QUADS, 1, 20},
+    {OP_TEXTURE, 1, 1},
+    {OP_BIND, 3, 1},
+    {OP_ELEMENTS, 32, 40},
+    {OP_BIND, 2, 1},
+    {OP_QUADS, 16, 60},
+    {OP_BLEND, 0, 1},
+    {OP_ORTHO, 0, 1},
+    {OP_QUADS, 4, 30},
+  };
+
+  struct RecordedVertex {
+    float x, y, z, w;
+    float s, t;
+    uint8_t r, g, b, a;
+  };
+
+  // engine fills the same arrays for each draw
+  void fillRecordedVertices(RecordedVertex *vertices, int count, int draw) {
+    for (int i = 0; i < count; i++) {
+      RecordedVertex &v = vertices[i];
+      v.x = (float) (draw * 8 + i);
+      v.y = (float) (draw + i * 16);
+      v.z = 0;
+      v.w = 1;
+      v.s = (float) (i & 1);
+      v.t = (float) ((i >> 1) & 1);
+      v.r = (uint8_t) draw;
+      v.g = (uint8_t) i;
+      v.b = 255;
+      v.a = (uint8_t) (draw * 3);
+    }
+  }
+
+  void replayRecordedStream() {
+    static RecordedVertex vertices[16 * 4];
+    int draw = 0;
+    static uint16_t indices[32 * 3];
+    for (int i = 0; i < 32 * 3; i++) {
+      indices[i] = (uint16_t) (i % (16 * 4));
+    }
+
+    gles_adp_glAlphaFunc(GL_GEQUAL, 0.5f);
+    gles_adp_glEnableClientState(GL_VERTEX_ARRAY);
+    gles_adp_glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    gles_adp_glVertexPointer(4, GL_FLOAT, sizeof(RecordedVertex), &vertices[0].x);
+    setVertexCount(16 * 4);
+    gles_adp_glTexCoordPointer(2, GL_FLOAT, sizeof(RecordedVertex), &vertices[0].s);
+    gles_adp_glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(RecordedVertex), &vertices[0].r);
+
+    for (const RecordedCommand &cmd : recordedFrame) {
+      for (int i = 0; i < cmd.repeat; i++) {
+        switch (cmd.op) {
+          case OP_ORTHO:
+            gles_adp_glMatrixMode(GL_PROJECTION);
+            gles_adp_glLoadIdentity();
+            gles_adp_glOrtho(0, 640, 480, 0, -1, 1);
+            gles_adp_glMatrixMode(GL_MODELVIEW);
+            gles_adp_glLoadIdentity();
+            break;
+          case OP_TEXTURE:
+            if (cmd.param) gles_adp_glEnable(GL_TEXTURE_2D);
+            else gles_adp_glDisable(GL_TEXTURE_2D);
+            break;
+          case OP_ALPHATEST:
+            if (cmd.param) gles_adp_glEnable(GL_ALPHA_TEST);
+            else gles_adp_glDisable(GL_ALPHA_TEST);
+            break;
+          case OP_COLORARRAY:
+            if (cmd.param) gles_adp_glEnableClientState(GL_COLOR_ARRAY);
+            else gles_adp_glDisableClientState(GL_COLOR_ARRAY);
+            break;
+          case OP_BLEND:
+            if (cmd.param) {
+              gles_adp_glEnable(GL_BLEND);
+              gles_adp_glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            } else {
+              gles_adp_glDisable(GL_BLEND);
+            }
+            break;
+          case OP_BIND:
+            gles_adp_glBindTexture(GL_TEXTURE_2D, cmd.param);
+            break;
+          case OP_QUADS:
+            fillRecordedVertices(vertices, cmd.param * 4, draw++);
+            gles_adp_glDrawArrays(GL_QUADS, 0, cmd.param * 4);
+            break;
+          case OP_ELEMENTS:
+            fillRecordedVertices(vertices, 16 * 4, draw++);
+            gles_adp_glDrawElements(GL_TRIANGLES, cmd.param * 3, GL_UNSIGNED_SHORT, indices);
+            break;
+        }
+      }
+    }
+
+    gles_adp_glDisableClientState(GL_COLOR_ARRAY);
+    gles_adp_glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    gles_adp_glDisableClientState(GL_VERTEX_ARRAY);
+  }
+}
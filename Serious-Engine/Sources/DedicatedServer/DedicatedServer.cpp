@@ -15,8 +15,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "StdAfx.h"
 #include <GameMP/Game.h>
+#include <Engine/Network/CommunicationInterface.h>
 #define DECL_DLL
 
+#ifdef PLATFORM_UNIX
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <errno.h>
+#include <fcntl.h>
+#endif
+
 #if 0  /* rcg10042001 Doesn't seem to exist. */
 #include <Entities/Global.h>
 #endif
@@ -28,6 +38,7 @@ static BOOL _bForceNextMap = FALSE;
 
 extern CTString _strSamVersion = "no version information";
 extern INDEX ded_iMaxFPS = 100;
+extern INDEX ded_bWaitForTraffic = TRUE;
 extern CTString ded_strConfig = "";
 extern CTString ded_strLevel = "";
 extern INDEX ded_bRestartWhenEmpty = TRUE;
@@ -39,6 +50,28 @@ extern CTString sam_strGameName = "serioussam";
 
 CTimerValue _tvLastLevelEnd(-1i64);
 
+// name of this program, for starting more instances of it
+static CTString _strExeName;
+// soak test: run for given time with simulated bots connected over loopback and report
+static BOOL  _bSoak = FALSE;
+static INDEX _ctSoakBots = 0;
+static TIME  _tmSoakDuration = 0.0f;
+// this instance is a simulated bot, connecting to local server on given port
+static BOOL  _bBot = FALSE;
+static INDEX _iBotPort = 0;
+
+// soak test measurements
+static CTimerValue _tvSoakStart;
+static INDEX  _ctSoakFrames = 0;
+static INDEX  _ctSoakTicks = 0;
+static DOUBLE _dSoakTickLatency = 0.0;
+static DOUBLE _dSoakTickLatencyMax = 0.0;
+static INDEX  _ctSoakMaxPlayers = 0;
+static __int64 _llSoakBytesSent = 0;
+static __int64 _llSoakBytesReceived = 0;
+// last timer tick that the main loop has handled
+static TIME _tmLastHandledTick = -1.0f;
+
 void InitializeGame(void)
 {
   try {
@@ -98,11 +131,28 @@ void LimitFrameRate(void)
   ded_iMaxFPS = ClampDn( ded_iMaxFPS,   1L);
   TIME tmWantedDelta  = 1.0f / ded_iMaxFPS;
   if( tmCurrentDelta<tmWantedDelta) Sleep( (tmWantedDelta-tmCurrentDelta)*1000.0f);
+
+  // if waiting for traffic, sleep until a packet arrives or the next game tick is due
+  if (ded_bWaitForTraffic && _pTimer->GetRealTimeTick()==_tmLastHandledTick) {
+    tvNow = _pTimer->GetHighPrecisionTimer();
+    TIME tmToNextTick = _pTimer->TickQuantum - (tvNow-_pTimer->tm_tvLastTimeOnTime).GetSeconds();
+    tmToNextTick = Clamp(tmToNextTick, 0.0f, _pTimer->TickQuantum);
+    if (tmToNextTick>0) {
+      _cmiComm.WaitForTraffic(tmToNextTick);
+    }
+  }
   
   // remember new time
   tvLast = _pTimer->GetHighPrecisionTimer();
 }
 
+#ifdef PLATFORM_UNIX
+// break/terminate handler
+static void SignalHandler(int iSignal)
+{
+  _bRunning = FALSE;
+}
+#else
 // break/close handler
 BOOL WINAPI HandlerRoutine(
   DWORD dwCtrlType   //  control signal type
@@ -117,6 +167,135 @@ BOOL WINAPI HandlerRoutine(
   }
   return TRUE;
 }
+#endif
+
+// other instances of this program that this one has started
+#ifdef PLATFORM_UNIX
+typedef pid_t InstanceID;
+#else
+typedef HANDLE InstanceID;
+#endif
+#define MAX_INSTANCES 64
+static InstanceID _aiidInstances[MAX_INSTANCES];
+static INDEX _ctInstances = 0;
+
+// start another instance of this program with given arguments
+static BOOL StartInstance(INDEX ctArgs, const CTString *astrArgs)
+{
+  if (_ctInstances>=MAX_INSTANCES) {
+    return FALSE;
+  }
+#ifdef PLATFORM_UNIX
+  const char *astrArgv[16];
+  ASSERT(ctArgs<15);
+  astrArgv[0] = _strExeName;
+  for (INDEX i=0; i<ctArgs; i++) {
+    astrArgv[i+1] = astrArgs[i];
+  }
+  astrArgv[ctArgs+1] = NULL;
+  // child reports failed exec through a pipe that is closed when exec succeeds
+  int aiPipe[2];
+  if (pipe(aiPipe)!=0) {
+    return FALSE;
+  }
+  fcntl(aiPipe[1], F_SETFD, FD_CLOEXEC);
+  pid_t pid = fork();
+  if (pid==0) {
+    close(aiPipe[0]);
+    // argv[0] need not be a path (if started from PATH), so run same executable as this one
+    execv("/proc/self/exe", (char **)astrArgv);
+    execvp(astrArgv[0], (char **)astrArgv);
+    int iError = errno;
+    write(aiPipe[1], &iError, sizeof(iError));
+    _exit(127);
+  }
+  close(aiPipe[1]);
+  if (pid<0) {
+    close(aiPipe[0]);
+    return FALSE;
+  }
+  int iError = 0;
+  ssize_t ctRead;
+  while ((ctRead=read(aiPipe[0], &iError, sizeof(iError)))<0 && errno==EINTR) {}
+  close(aiPipe[0]);
+  if (ctRead==sizeof(iError)) {
+    waitpid(pid, NULL, 0);
+    printf("Cannot run '%s': %s\n", (const char*)_strExeName, strerror(iError));
+    return FALSE;
+  }
+  _aiidInstances[_ctInstances++] = pid;
+#else
+  CTString strCommand = "\"" + _strExeName + "\"";
+  for (INDEX i=0; i<ctArgs; i++) {
+    strCommand += " \"" + astrArgs[i] + "\"";
+  }
+  STARTUPINFOA si;
+  PROCESS_INFORMATION pi;
+  memset(&si, 0, sizeof(si));
+  memset(&pi, 0, sizeof(pi));
+  si.cb = sizeof(si);
+  if (!CreateProcessA(NULL, (char *)(const char *)strCommand, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi)) {
+    return FALSE;
+  }
+  CloseHandle(pi.hThread);
+  _aiidInstances[_ctInstances++] = pi.hProcess;
+#endif
+  return TRUE;
+}
+
+// wait for all started instances to finish (stop them first if needed)
+static void WaitInstances(BOOL bStop)
+{
+#ifdef PLATFORM_UNIX
+  for (INDEX i=0; i<_ctInstances; i++) {
+    if (bStop) kill(_aiidInstances[i], SIGTERM);
+  }
+  // reap them in order they finish, so failures are reported when they happen
+  INDEX ctLeft = _ctInstances;
+  while (ctLeft>0) {
+    int iStatus;
+    const pid_t pid = waitpid(-1, &iStatus, 0);
+    if (pid<0) {
+      if (errno==EINTR) continue;
+      break;
+    }
+    INDEX i=0;
+    for (; i<_ctInstances; i++) {
+      if (_aiidInstances[i]==pid) break;
+    }
+    if (i==_ctInstances) continue;
+    ctLeft--;
+    if (WIFEXITED(iStatus) && WEXITSTATUS(iStatus)!=0) {
+      printf("Instance %d exited with code %d\n", (int)pid, WEXITSTATUS(iStatus));
+    } else if (WIFSIGNALED(iStatus) && !(bStop && WTERMSIG(iStatus)==SIGTERM)) {
+      printf("Instance %d was killed by signal %d\n", (int)pid, WTERMSIG(iStatus));
+    }
+  }
+#else
+  for (INDEX i=0; i<_ctInstances; i++) {
+    if (bStop) TerminateProcess(_aiidInstances[i], 0);
+    WaitForSingleObject(_aiidInstances[i], INFINITE);
+    CloseHandle(_aiidInstances[i]);
+  }
+#endif
+  _ctInstances = 0;
+}
+
+// get CPU time used by this process so far
+static void GetProcessCPUTime(DOUBLE &dUser, DOUBLE &dSystem)
+{
+#ifdef PLATFORM_UNIX
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  dUser   = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec/1E6;
+  dSystem = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec/1E6;
+#else
+  FILETIME ftCreation, ftExit, ftKernel, ftUser;
+  GetProcessTimes(GetCurrentProcess(), &ftCreation, &ftExit, &ftKernel, &ftUser);
+  dUser   = ((__int64(ftUser.dwHighDateTime)<<32)  |ftUser.dwLowDateTime)  /1E7;
+  dSystem = ((__int64(ftKernel.dwHighDateTime)<<32)|ftKernel.dwLowDateTime)/1E7;
+#endif
+}
 
 #define REFRESHTIME (0.1f)
 
@@ -179,28 +358,28 @@ void ExecScript(const CTString &str)
   _pShell->Execute(strCmd);
 }
 
-BOOL Init(int argc, char* argv[])
+BOOL Init(const CTString &strConfig, const CTString &strMod)
 {
   _bDedicatedServer = TRUE;
 
-  if (argc!=1+1 && argc!=2+1) {
-    // NOTE: this cannot be translated - translations are not loaded yet
-    printf("Usage: DedicatedServer <configname> [<modname>]\n"
-      "This starts a server reading configs from directory 'Scripts\\Dedicated\\<configname>\\'\n");
-    getch();
-    exit(0);
-  }
-
-  SetConsoleTitleA(argv[1]);
+#ifndef PLATFORM_UNIX
+  SetConsoleTitleA(strConfig);
+#endif
 
-  ded_strConfig = CTString("Scripts\\Dedicated\\")+argv[1]+"\\";
+  ded_strConfig = CTString("Scripts\\Dedicated\\")+strConfig+"\\";
 
-  if (argc==2+1) {
-    _fnmMod = CTString("Mods\\")+argv[2]+"\\";
+  if (strMod!="") {
+    _fnmMod = CTString("Mods\\")+strMod+"\\";
   }
 
 
-  _strLogFile = CTString("Dedicated_")+argv[1];
+  if (_bBot) {
+    CTString strBot;
+    strBot.PrintF("Bot%d_", _iBotPort);
+    _strLogFile = CTString("Dedicated_")+strBot+strConfig;
+  } else {
+    _strLogFile = CTString("Dedicated_")+strConfig;
+  }
 
   // initialize engine
   SE_InitEngine(sam_strGameName);
@@ -232,6 +411,7 @@ BOOL Init(int argc, char* argv[])
 
   // declare shell symbols
   _pShell->DeclareSymbol("persistent user INDEX ded_iMaxFPS;", &ded_iMaxFPS);
+  _pShell->DeclareSymbol("persistent user INDEX ded_bWaitForTraffic;", &ded_bWaitForTraffic);
   _pShell->DeclareSymbol("user void Quit(void);", &QuitGame);
   _pShell->DeclareSymbol("user CTString ded_strLevel;", &ded_strLevel);
   _pShell->DeclareSymbol("user FLOAT ded_tmTimeout;", &ded_tmTimeout);
@@ -249,7 +429,12 @@ BOOL Init(int argc, char* argv[])
   LoadStringVar(CTString("Data\\Var\\Sam_Version.var"), _strSamVersion);
   CPrintF(TRANS("Serious Sam version: %s\n"), _strSamVersion);
 
+#ifdef PLATFORM_UNIX
+  signal(SIGINT,  SignalHandler);
+  signal(SIGTERM, SignalHandler);
+#else
   SetConsoleCtrlHandler(HandlerRoutine, TRUE);
+#endif
 
   // if there is a mod
   if (_fnmMod!="") {
@@ -341,9 +526,27 @@ void RoundEnd(void)
   iRound++;
 }
 
+// remember how late the main loop was for a new timer tick
+static void MeasureTickLatency(void)
+{
+  const TIME tmTick = _pTimer->GetRealTimeTick();
+  if (tmTick==_tmLastHandledTick) {
+    return;
+  }
+  _tmLastHandledTick = tmTick;
+  if (_bSoak) {
+    const DOUBLE dLatency = (_pTimer->GetHighPrecisionTimer()-_pTimer->tm_tvLastTimeOnTime).GetSeconds();
+    _dSoakTickLatency += dLatency;
+    _dSoakTickLatencyMax = Max(_dSoakTickLatencyMax, dLatency);
+    _ctSoakTicks++;
+  }
+}
+
 // do the main game loop and render screen
 void DoGame(void)
 {
+  MeasureTickLatency();
+
   // do the main game loop
   if( _pGame->gm_bGameOn) {
     _pGame->GameMainLoop();
@@ -383,11 +586,117 @@ void DoGame(void)
   LimitFrameRate();
 }
 
-int SubMain(int argc, char* argv[])
+// start bots and measurements of a soak test
+static void SoakBegin(const CTString &strConfig, const CTString &strMod)
+{
+  CPrintF(TRANS("Soak test: %d bots for %.0f seconds\n"), _ctSoakBots, _tmSoakDuration);
+  CTString strPort;
+  strPort.PrintF("%d", _pShell->GetINDEX("net_iPort"));
+  for (INDEX iBot=0; iBot<_ctSoakBots; iBot++) {
+    CTString astrArgs[4] = { "-bot", strPort, strConfig, strMod };
+    if (!StartInstance(strMod=="" ? 3 : 4, astrArgs)) {
+      CPrintF(TRANS("Cannot start bot %d!\n"), iBot);
+      break;
+    }
+  }
+  _tvSoakStart = _pTimer->GetHighPrecisionTimer();
+  _llSoakBytesSent     = _cmiComm.cci_llBytesSent;
+  _llSoakBytesReceived = _cmiComm.cci_llBytesReceived;
+}
+
+// stop bots and report results of a soak test
+static void SoakEnd(void)
+{
+  WaitInstances(TRUE);
+
+  const DOUBLE dWall = (_pTimer->GetHighPrecisionTimer()-_tvSoakStart).GetSeconds();
+  DOUBLE dUser, dSystem;
+  GetProcessCPUTime(dUser, dSystem);
+  const INDEX ctClients = ClampDn(_ctSoakMaxPlayers, 1L);
+  const DOUBLE dSent     = (_cmiComm.cci_llBytesSent    -_llSoakBytesSent)    /dWall/ctClients;
+  const DOUBLE dReceived = (_cmiComm.cci_llBytesReceived-_llSoakBytesReceived)/dWall/ctClients;
+
+  CPrintF(TRANS("\nSOAK REPORT: %s\n"), (const char*)ded_strConfig);
+  CPrintF(TRANS("  time: %.1f s, %d frames (%.1f fps)\n"), dWall, _ctSoakFrames, _ctSoakFrames/dWall);
+  CPrintF(TRANS("  CPU: %.1f%% of one core (user %.2f s, system %.2f s)\n"),
+    (dUser+dSystem)/dWall*100.0, dUser, dSystem);
+  CPrintF(TRANS("  tick latency: average %.2f ms, max %.2f ms over %d ticks\n"),
+    _ctSoakTicks>0 ? _dSoakTickLatency/_ctSoakTicks*1000.0 : 0.0, _dSoakTickLatencyMax*1000.0, _ctSoakTicks);
+  CPrintF(TRANS("  clients: %d, per client sent %.0f B/s, received %.0f B/s\n"),
+    _ctSoakMaxPlayers, dSent, dReceived);
+}
+
+#define BOT_FIRE (1L<<0)  // PLACT_FIRE in Player.es
+
+// drives the local player of a bot with random movement
+class CBotTimerHandler : public CTimerHandler {
+public:
+  INDEX bth_ctTicks;
+  FLOAT3D bth_vWander;
+  CBotTimerHandler(void) : bth_ctTicks(0), bth_vWander(0,0,0) {};
+  void HandleTimer(void)
+  {
+    CPlayerSource *ppls = _pGame->gm_lpLocalPlayers[0].lp_pplsPlayerSource;
+    if (!_pGame->gm_bGameOn || ppls==NULL) {
+      return;
+    }
+    // pick a new direction every second or so
+    if (bth_ctTicks%20==0) {
+      bth_vWander = FLOAT3D(FLOAT(rand()%3-1), 0.0f, FLOAT(rand()%3-1))*10.0f;
+    }
+    bth_ctTicks++;
+    // set action after the game has set its own for this tick
+    CPlayerAction pa = ppls->pls_paAction;
+    pa.pa_vTranslation = bth_vWander;
+    pa.pa_aRotation = ANGLE3D(5.0f, 0.0f, 0.0f);
+    pa.pa_ulButtons = (rand()%4==0) ? BOT_FIRE : 0;
+    ppls->SetAction(pa);
+  }
+};
+
+// run as a simulated client connected to the local server
+static int BotMain(void)
+{
+  CTString strCmd;
+  strCmd.PrintF("net_iPort=%d;", _iBotPort);
+  _pShell->Execute(strCmd);
+
+  _pGame->gm_StartSplitScreenCfg = CGame::SSC_PLAY1;
+  _pGame->gm_aiStartLocalPlayers[0] = 0;
+  _pGame->gm_aiStartLocalPlayers[1] = -1;
+  _pGame->gm_aiStartLocalPlayers[2] = -1;
+  _pGame->gm_aiStartLocalPlayers[3] = -1;
+  _pGame->gm_strNetworkProvider = "TCP/IP Client";
+
+  // server may still be loading the level, so retry for a while
+  BOOL bJoined = FALSE;
+  for (INDEX iTry=0; iTry<30 && _bRunning && !bJoined; iTry++) {
+    bJoined = _pGame->JoinGame(CNetworkSession("127.0.0.1"));
+    if (!bJoined) {
+      Sleep(1000);
+    }
+  }
+
+  if (bJoined) {
+    CBotTimerHandler bth;
+    _pTimer->AddHandler(&bth);
+    while (_bRunning && _pGame->gm_bGameOn) {
+      _pGame->GameMainLoop();
+      LimitFrameRate();
+    }
+    _pTimer->RemHandler(&bth);
+  }
+
+  _pGame->StopGame();
+  End();
+  return bJoined ? 0 : -1;
+}
+
+int SubMain(const CTString &strConfig, const CTString &strMod)
 {
 
   // initialize
-  if( !Init(argc, argv)) {
+  if( !Init(strConfig, strMod)) {
     End();
     return -1;
   }
@@ -395,6 +704,10 @@ int SubMain(int argc, char* argv[])
   // initialy, application is running
   _bRunning = TRUE;
 
+  if (_bBot) {
+    return BotMain();
+  }
+
   // execute dedicated server startup script
   ExecScript(CTFILENAME("Scripts\\Dedicated_startup.ini"));
   // execute startup script for this config
@@ -402,12 +715,24 @@ int SubMain(int argc, char* argv[])
   // start first round
   RoundBegin();
 
+  if (_bSoak && _bRunning) {
+    SoakBegin(strConfig, strMod);
+  }
+
   // while it is still running
   while( _bRunning)
   {
     // do the main game loop
     DoGame();
 
+    if (_bSoak) {
+      _ctSoakFrames++;
+      _ctSoakMaxPlayers = Max(_ctSoakMaxPlayers, _pGame->GetPlayersCount());
+      if ((_pTimer->GetHighPrecisionTimer()-_tvSoakStart).GetSeconds()>_tmSoakDuration) {
+        _bRunning = FALSE;
+      }
+    }
+
     // if game is finished
     if (_pNetwork->IsGameFinished()) {
       // if not yet remembered end of level
@@ -445,6 +770,10 @@ int SubMain(int argc, char* argv[])
 
   } // end of main application loop
 
+  if (_bSoak) {
+    SoakEnd();
+  }
+
   _pGame->StopGame();
 
   End();
@@ -453,13 +782,95 @@ int SubMain(int argc, char* argv[])
 }
 
 
+// each session is hosted by its own instance of this program, since engine state is global
+static int RunSessions(INDEX ctConfigs, const CTString *astrConfigs, const CTString &strMod)
+{
+#ifdef PLATFORM_UNIX
+  signal(SIGINT,  SIG_IGN);
+#endif
+  for (INDEX iConfig=0; iConfig<ctConfigs; iConfig++) {
+    CTString astrArgs[5];
+    INDEX ctArgs = 0;
+    if (_bSoak) {
+      astrArgs[ctArgs++] = "-soak";
+      astrArgs[ctArgs++].PrintF("%d", _ctSoakBots);
+      astrArgs[ctArgs++].PrintF("%g", _tmSoakDuration);
+    }
+    astrArgs[ctArgs++] = astrConfigs[iConfig];
+    if (strMod!="") {
+      astrArgs[ctArgs++] = strMod;
+    }
+    if (!StartInstance(ctArgs, astrArgs)) {
+      printf("Cannot start session '%s'!\n", (const char*)astrConfigs[iConfig]);
+    }
+  }
+  // sessions stop on their own (Ctrl+C reaches all of them)
+  WaitInstances(FALSE);
+  return 0;
+}
+
+static void Usage(void)
+{
+  // NOTE: this cannot be translated - translations are not loaded yet
+  printf("Usage: DedicatedServer <configname>[,<configname>...] [<modname>]\n"
+    "       DedicatedServer -soak <bots> <seconds> <configname>[,<configname>...] [<modname>]\n"
+    "This starts a server reading configs from directory 'Scripts\\Dedicated\\<configname>\\'\n"
+    "Each given config is hosted as a separate session (they must use different ports).\n"
+    "With -soak, each session runs for given time with simulated bots connected over\n"
+    "loopback, and then reports CPU usage, tick latency and traffic per client.\n");
+#ifndef PLATFORM_UNIX
+  getch();
+#endif
+  exit(0);
+}
+
 int main(int argc, char* argv[])
 {
+  _strExeName = argv[0];
+
+  // parse options
+  INDEX iArg = 1;
+  if (argc>iArg && strcmp(argv[iArg], "-soak")==0) {
+    if (argc<iArg+3) Usage();
+    _bSoak = TRUE;
+    _ctSoakBots = ClampDn(INDEX(atoi(argv[iArg+1])), 0L);
+    _tmSoakDuration = ClampDn(FLOAT(atof(argv[iArg+2])), 1.0f);
+    iArg += 3;
+  } else if (argc>iArg && strcmp(argv[iArg], "-bot")==0) {
+    if (argc<iArg+2) Usage();
+    _bBot = TRUE;
+    _iBotPort = atoi(argv[iArg+1]);
+    iArg += 2;
+  }
+  if (argc!=iArg+1 && argc!=iArg+2) {
+    Usage();
+  }
+  const CTString strMod = (argc==iArg+2) ? CTString(argv[iArg+1]) : CTString("");
+
+  // split list of configs
+  CTString astrConfigs[MAX_INSTANCES];
+  INDEX ctConfigs = 0;
+  for (const char *strList=argv[iArg]; *strList!=0 && ctConfigs<MAX_INSTANCES; ) {
+    const char *strComma = strchr(strList, ',');
+    const INDEX ctChars = strComma!=NULL ? INDEX(strComma-strList) : INDEX(strlen(strList));
+    if (ctChars>0) {
+      astrConfigs[ctConfigs] = strList;
+      astrConfigs[ctConfigs].TrimRight(ctChars);
+      ctConfigs++;
+    }
+    strList += ctChars + (strComma!=NULL ? 1 : 0);
+  }
+  if (ctConfigs==0) {
+    Usage();
+  }
+  if (ctConfigs>1) {
+    return RunSessions(ctConfigs, astrConfigs, strMod);
+  }
+
   int iResult;
   CTSTREAM_BEGIN {
-    iResult = SubMain(argc, argv);
+    iResult = SubMain(astrConfigs[0], strMod);
   } CTSTREAM_END;
 
   return iResult;
 }
-
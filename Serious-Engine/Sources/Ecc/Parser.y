@@ -122,9 +122,163 @@ void CreateInternalHandlerFunction(char *strFunctionName, char *strID)
   AddHandlerFunction(strFunctionName, iID);
 }
 
+/*
+ * Packed property functions.
+ * Each class gets functions that write and read its properties in the same format as
+ * CEntity::WriteProperties_t()/ReadProperties_t(), but without looking up each property
+ * and switching on its type. Layout ID is calculated the same way as in
+ * CDLLEntityClass::CalculatePropertyLayout(), so that engine can check that the functions
+ * match the property table (ENTITYPROPERTIES_LAYOUTVERSION must be same as in engine).
+ */
+#define ENTITYPROPERTIES_LAYOUTVERSION 1
+
+// how values of each property type are written (must match CEntity::WritePropertyValue_t())
+enum PackedKind {
+  PK_INDEX,       // as INDEX
+  PK_FLOAT,       // as FLOAT
+  PK_STRING,      // as CTString
+  PK_STRINGTRANS, // as CTString after 'DTRS' chunk
+  PK_FILENAME,    // as CTFileName (but engine must read it, to replace missing files)
+  PK_RAW,         // memory image of the value
+  PK_ENGINE,      // engine writes and reads it
+};
+static struct PackedType {
+  char *pt_strType;
+  int pt_iType;   // must match numbers in CEntityProperty::PropertyType
+  int pt_iKind;
+} _aptPackedTypes[] = {
+  { "CEntityProperty::EPT_ENUM",             1, PK_INDEX },
+  { "CEntityProperty::EPT_BOOL",             2, PK_INDEX },
+  { "CEntityProperty::EPT_FLOAT",            3, PK_FLOAT },
+  { "CEntityProperty::EPT_COLOR",            4, PK_INDEX },
+  { "CEntityProperty::EPT_STRING",           5, PK_STRING },
+  { "CEntityProperty::EPT_RANGE",            6, PK_FLOAT },
+  { "CEntityProperty::EPT_ENTITYPTR",        7, PK_ENGINE },
+  { "CEntityProperty::EPT_FILENAME",         8, PK_FILENAME },
+  { "CEntityProperty::EPT_INDEX",            9, PK_INDEX },
+  { "CEntityProperty::EPT_ANIMATION",       10, PK_INDEX },
+  { "CEntityProperty::EPT_ILLUMINATIONTYPE",11, PK_INDEX },
+  { "CEntityProperty::EPT_FLOATAABBOX3D",   12, PK_RAW },
+  { "CEntityProperty::EPT_ANGLE",           13, PK_INDEX },
+  { "CEntityProperty::EPT_FLOAT3D",         14, PK_RAW },
+  { "CEntityProperty::EPT_ANGLE3D",         15, PK_RAW },
+  { "CEntityProperty::EPT_FLOATplane3D",    16, PK_RAW },
+  { "CEntityProperty::EPT_MODELOBJECT",     17, PK_ENGINE },
+  { "CEntityProperty::EPT_PLACEMENT3D",     18, PK_RAW },
+  { "CEntityProperty::EPT_ANIMOBJECT",      19, PK_ENGINE },
+  { "CEntityProperty::EPT_FILENAMENODEP",   20, PK_STRING },
+  { "CEntityProperty::EPT_SOUNDOBJECT",     21, PK_ENGINE },
+  { "CEntityProperty::EPT_STRINGTRANS",     22, PK_STRINGTRANS },
+  { "CEntityProperty::EPT_FLOATQUAT3D",     23, PK_RAW },
+  { "CEntityProperty::EPT_FLOATMATRIX3D",   24, PK_RAW },
+  { "CEntityProperty::EPT_FLAGS",           25, PK_INDEX },
+  { "CEntityProperty::EPT_MODELINSTANCE",   26, PK_ENGINE },
+};
+
+static SType _strPackedWrite;
+static SType _strPackedRead;
+static unsigned int _ulPackedLayout;
+static int _ctPackedProperties;
+
+void AddPackedCode(SType &strCode, const char *strFormat, ...)
+{
+  char strLine[1024];
+  va_list arg;
+  va_start(arg, strFormat);
+  vsprintf(strLine, strFormat, arg);
+  va_end(arg);
+  strCode = strCode+SType(strLine);
+}
+
+void BeginPackedProperties(void)
+{
+  _strPackedWrite = SType("");
+  _strPackedRead = SType("");
+  _ulPackedLayout = (2166136261u^ENTITYPROPERTIES_LAYOUTVERSION)*16777619u;
+  _ctPackedProperties = 0;
+}
+
+void AddPackedProperty(char *strType, char *strID, char *strIdentifier)
+{
+  struct PackedType *ppt = NULL;
+  for (int i=0; i<sizeof(_aptPackedTypes)/sizeof(_aptPackedTypes[0]); i++) {
+    if (strcmp(_aptPackedTypes[i].pt_strType, strType)==0) {
+      ppt = &_aptPackedTypes[i];
+      break;
+    }
+  }
+  if (ppt==NULL) {
+    yyerror((SType("Property type not supported in packed functions: ")+strType).strString);
+    return;
+  }
+  _ctPackedProperties++;
+
+  // add to layout
+  unsigned int ulID = (((unsigned int)_iCurrentClassID)<<8)+(unsigned int)strtoul(RemoveLineDirective(strID), NULL, 0);
+  _ulPackedLayout = (_ulPackedLayout^ulID)*16777619u;
+  _ulPackedLayout = (_ulPackedLayout^ppt->pt_iType)*16777619u;
+
+  // packed identifier, as written by engine
+  char strIDAndType[256];
+  sprintf(strIDAndType, "PACKEDPROPERTY_ID((0x%08x<<8)+%s, %s)", _iCurrentClassID, strID, strType);
+  AddPackedCode(_strPackedWrite, "  strm<<(ULONG)%s;\n", strIDAndType);
+  AddPackedCode(_strPackedRead, "  if (!ExpectPackedProperty_t(strm, ctRemaining, %s)) return FALSE;\n", strIDAndType);
+
+  switch (ppt->pt_iKind) {
+  case PK_INDEX:
+    AddPackedCode(_strPackedWrite, "  strm<<(INDEX &)pen->%s;\n", strIdentifier);
+    AddPackedCode(_strPackedRead,  "  strm>>(INDEX &)pen->%s;\n", strIdentifier);
+    break;
+  case PK_FLOAT:
+    AddPackedCode(_strPackedWrite, "  strm<<(FLOAT &)pen->%s;\n", strIdentifier);
+    AddPackedCode(_strPackedRead,  "  strm>>(FLOAT &)pen->%s;\n", strIdentifier);
+    break;
+  case PK_STRINGTRANS:
+    AddPackedCode(_strPackedWrite, "  strm.WriteID_t(\"DTRS\");\n");
+    AddPackedCode(_strPackedRead,  "  strm.ExpectID_t(\"DTRS\");\n");
+    // fall through
+  case PK_STRING:
+    AddPackedCode(_strPackedWrite, "  strm<<(CTString &)pen->%s;\n", strIdentifier);
+    AddPackedCode(_strPackedRead,  "  strm>>(CTString &)pen->%s;\n", strIdentifier);
+    break;
+  case PK_FILENAME:
+    AddPackedCode(_strPackedWrite, "  strm<<(CTFileName &)pen->%s;\n", strIdentifier);
+    AddPackedCode(_strPackedRead,  "  pen->ReadPropertyValue_t(strm, %s, offsetof(%s, %s));\n",
+      strType, _strCurrentClass, strIdentifier);
+    break;
+  case PK_RAW:
+    AddPackedCode(_strPackedWrite, "  strm.Write_t(&pen->%s, sizeof(pen->%s));\n", strIdentifier, strIdentifier);
+    AddPackedCode(_strPackedRead,  "  strm.Read_t(&pen->%s, sizeof(pen->%s));\n", strIdentifier, strIdentifier);
+    break;
+  default:
+    AddPackedCode(_strPackedWrite, "  pen->WritePropertyValue_t(strm, %s, offsetof(%s, %s));\n",
+      strType, _strCurrentClass, strIdentifier);
+    AddPackedCode(_strPackedRead,  "  pen->ReadPropertyValue_t(strm, %s, offsetof(%s, %s));\n",
+      strType, _strCurrentClass, strIdentifier);
+    break;
+  }
+}
+
+void EndPackedProperties(void)
+{
+  fprintf(_fTables, "#define %s_packedlayout 0x%08x\n", _strCurrentClass, _ulPackedLayout);
+  fprintf(_fTables, "void %s_WritePacked_t(CEntity *penThis, CTStream &strm) {\n", _strCurrentClass);
+  if (_ctPackedProperties>0) {
+    fprintf(_fTables, "  %s *pen = (%s *)penThis;\n", _strCurrentClass, _strCurrentClass);
+  }
+  fprintf(_fTables, "%s};\n", _strPackedWrite.strString);
+  fprintf(_fTables, "BOOL %s_ReadPacked_t(CEntity *penThis, CTStream &strm, INDEX &ctRemaining) {\n", _strCurrentClass);
+  if (_ctPackedProperties>0) {
+    fprintf(_fTables, "  %s *pen = (%s *)penThis;\n", _strCurrentClass, _strCurrentClass);
+  }
+  fprintf(_fTables, "%s  return TRUE;\n};\n", _strPackedRead.strString);
+  fprintf(_fTables, "\n");
+}
+
 void DeclareFeatureProperties(void)
 {
   if (_bFeature_CanBePredictable) {
+    AddPackedProperty("CEntityProperty::EPT_ENTITYPTR", "255", "m_penPrediction");
     fprintf(_fTables, " CEntityProperty(CEntityProperty::EPT_ENTITYPTR, NULL, (0x%08x<<8)+%s, offsetof(%s, %s), %s, %s, %s, %s),\n",
       _iCurrentClassID,
       "255",
@@ -336,11 +490,20 @@ event_declaration
       _strCurrentEvent);
     fprintf(_fDeclaration, "%s();\n", _strCurrentEvent );
     fprintf(_fDeclaration, "CEntityEvent *MakeCopy(void);\n");
+    fprintf(_fDeclaration, "SLONG GetSizeOf(void);\n");
+    fprintf(_fDeclaration, "CEntityEvent *MakeCopyInPlace(void *pvMemory);\n");
     fprintf(_fImplementation, 
       "CEntityEvent *%s::MakeCopy(void) { "
       "CEntityEvent *peeCopy = new %s(*this); "
       "return peeCopy;}\n",
       _strCurrentEvent, _strCurrentEvent);
+    fprintf(_fImplementation, 
+      "SLONG %s::GetSizeOf(void) { return sizeof(%s);}\n",
+      _strCurrentEvent, _strCurrentEvent);
+    fprintf(_fImplementation, 
+      "CEntityEvent *%s::MakeCopyInPlace(void *pvMemory) { "
+      "return new(pvMemory) %s(*this);}\n",
+      _strCurrentEvent, _strCurrentEvent);
     fprintf(_fImplementation, "%s::%s() : CEntityEvent(EVENTCODE_%s) {;\n",
       _strCurrentEvent, _strCurrentEvent, _strCurrentEvent);
   } '{' event_members_list opt_comma '}' ';' {
@@ -395,6 +558,7 @@ class_declaration
     fprintf(_fDeclaration, "  %s virtual void SetDefaultProperties(void);\n", _bClassIsExported?"":"DECL_DLL");
     fprintf(_fImplementation, "void %s::SetDefaultProperties(void) {\n", _strCurrentClass);
     fprintf(_fTables, "CEntityProperty %s_properties[] = {\n", _strCurrentClass);
+    BeginPackedProperties();
 
   } k_properties ':' property_declaration_list {
     fprintf(_fImplementation, "  %s::SetDefaultProperties();\n}\n", _strCurrentBase);
@@ -566,6 +730,7 @@ property_declaration_list
     fprintf(_fTables, "#define %s_propertiesct 0\n", _strCurrentClass);
     fprintf(_fTables, "\n");
     fprintf(_fTables, "\n");
+    EndPackedProperties();
   }
   | nonempty_property_declaration_list opt_comma {
     DeclareFeatureProperties();
@@ -573,6 +738,7 @@ property_declaration_list
     fprintf(_fTables, "#define %s_propertiesct ARRAYCOUNT(%s_properties)\n", 
       _strCurrentClass, _strCurrentClass);
     fprintf(_fTables, "\n");
+    EndPackedProperties();
   }
   ;
 nonempty_property_declaration_list
@@ -596,6 +762,7 @@ property_declaration
       _strCurrentPropertyShortcut,
       _strCurrentPropertyColor,
       _strCurrentPropertyFlags);
+    AddPackedProperty(_strCurrentPropertyPropertyType, _strCurrentPropertyID, _strCurrentPropertyIdentifier);
     fprintf(_fDeclaration, "  %s %s;\n",
       _strCurrentPropertyDataType,
       _strCurrentPropertyIdentifier
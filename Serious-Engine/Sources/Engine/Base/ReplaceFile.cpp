@@ -600,6 +600,7 @@ void ReadModelInstanceOld_t(CTStream &strm, CModelInstance &mi)
     CAnimSet *pas = _pAnimSetStock->Obtain_t(fnAnimSet);
     mi.mi_aAnimSet.Add(pas);
   }
+  mi.mi_ctLookupAnimSets = -1;
 
   // read colision boxes
   strm>>ctcb;
@@ -734,6 +735,7 @@ void ReadAnimSets_t(CTStream &strm, CModelInstance &mi)
     CAnimSet *pas = _pAnimSetStock->Obtain_t(fnAnimSet);
     mi.mi_aAnimSet.Add(pas);
   }
+  mi.mi_ctLookupAnimSets = -1;
 }
 
 void ReadAnimQueue_t(CTStream &strm, CModelInstance &mi)
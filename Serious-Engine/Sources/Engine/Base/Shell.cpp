@@ -22,6 +22,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Templates/DynamicStackArray.h>
 #include <Engine/Base/Console.h>
 #include <Engine/Base/Stream.h>
+#include <Engine/Base/Timer.h>
+#include <Engine/Math/Functions.h>
 
 #include <Engine/Templates/AllocationArray.cpp>
 #include <Engine/Templates/DynamicArray.cpp>
@@ -143,17 +145,59 @@ CTString CShellSymbol::GetCompletionString(void) const
   }
 }
 
+// make sure that everything written before is visible to other threads before what is written after
+#ifdef _MSC_VER
+  #define SHELL_WRITEBARRIER() MemoryBarrier()
+#else
+  #define SHELL_WRITEBARRIER() __sync_synchronize()
+#endif
+
+// open addressing hash table of symbol pointers
+class CShellHashTable {
+public:
+  ULONG sht_ulMask;             // number of slots - 1
+  INDEX sht_ctUsed;             // number of used slots
+  CShellSymbol **sht_apssSlots; // NULL if empty
+  CShellHashTable *sht_pshtOld; // previous (smaller) table, kept for readers that might still use it
+
+  CShellHashTable(INDEX ctSlots, CShellHashTable *pshtOld) {
+    sht_ulMask = ctSlots-1;
+    sht_ctUsed = 0;
+    sht_apssSlots = new CShellSymbol*[ctSlots];
+    memset(sht_apssSlots, 0, ctSlots*sizeof(CShellSymbol*));
+    sht_pshtOld = pshtOld;
+  };
+  ~CShellHashTable(void) {
+    delete[] sht_apssSlots;
+    delete sht_pshtOld;
+  };
+  // put a symbol in first free slot
+  void Add(CShellSymbol *pss) {
+    ULONG ulSlot = pss->ss_strName.GetHash()&sht_ulMask;
+    while (sht_apssSlots[ulSlot]!=NULL) {
+      ulSlot = (ulSlot+1)&sht_ulMask;
+    }
+    // symbol must be complete before readers can see it
+    SHELL_WRITEBARRIER();
+    sht_apssSlots[ulSlot] = pss;
+    sht_ctUsed++;
+  };
+};
+
 // Constructor.
 CShell::CShell(void)
 {
   // allocate undefined symbol
   _shell_istUndeclared = _shell_ast.Allocate();
   pwoCurrentWorld = NULL;
+  sh_pshtHash = new CShellHashTable(1024, NULL);
 };
 CShell::~CShell(void)
 {
   _shell_astrExtStrings.Clear();
   _shell_afExtFloats.Clear();
+  delete sh_pshtHash;
+  sh_pshtHash = NULL;
 };
 
 static const INDEX _bTRUE  = TRUE;
@@ -386,6 +430,53 @@ static void ListSymbols(void)
   ListSymbolsByPattern("*");
 }
 
+// time symbol lookups by name, through a handle and from scripts
+static void ShellSymbolBenchmark(void* pArgs)
+{
+  INDEX ctCalls = NEXTARGUMENT(INDEX);
+  if (ctCalls<=0) ctCalls = 100000;
+  const CTString strName = "tmp_fAdd";
+  FLOAT fOld = _pShell->GetFLOAT(strName);
+  CPrintF(TRANS("Looking up '%s' among %d symbols %d times...\n"), (const char*)strName, _pShell->sh_assSymbols.Count(), ctCalls);
+
+  // linear search (how names were looked up before)
+  CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+  FLOAT fSum = 0;
+  for (INDEX iCall=0; iCall<ctCalls; iCall++) {
+    CTSingleLock slShell(&_pShell->sh_csShell, TRUE);
+    FOREACHINDYNAMICARRAY(_pShell->sh_assSymbols, CShellSymbol, itss) {
+      if (itss->ss_strName==strName) {
+        fSum += *(FLOAT*)itss->ss_pvValue;
+        break;
+      }
+    }
+  }
+  // hashed
+  CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+  for (INDEX iCall=0; iCall<ctCalls; iCall++) {
+    fSum += _pShell->GetFLOAT(strName);
+  }
+  // through handle
+  CTimerValue tv2 = _pTimer->GetHighPrecisionTimer();
+  CShellSymbolHandle sshAdd(strName);
+  for (INDEX iCall=0; iCall<ctCalls; iCall++) {
+    fSum += sshAdd.GetFLOAT();
+  }
+  // scripts are parsed each time, so do less of them
+  CTimerValue tv3 = _pTimer->GetHighPrecisionTimer();
+  const INDEX ctExecutes = ClampDn(ctCalls/100, 1L);
+  for (INDEX iCall=0; iCall<ctExecutes; iCall++) {
+    _pShell->Execute("tmp_fAdd = tmp_fAdd+con_iLastLines*0;");
+  }
+  CTimerValue tv4 = _pTimer->GetHighPrecisionTimer();
+  _pShell->SetFLOAT(strName, fOld);
+
+  CPrintF(TRANS("  linear GetFLOAT: %.1f ns per call\n"), (tv1-tv0).GetSeconds()*1E9/ctCalls);
+  CPrintF(TRANS("  hashed GetFLOAT: %.1f ns per call\n"), (tv2-tv1).GetSeconds()*1E9/ctCalls);
+  CPrintF(TRANS("  handle GetFLOAT: %.1f ns per call\n"), (tv3-tv2).GetSeconds()*1E9/ctCalls);
+  CPrintF(TRANS("  Execute:         %.1f us per call\n"), (tv4-tv3).GetSeconds()*1E6/ctExecutes);
+  (void)fSum;
+}
 
 // output any string to console
 void Echo(void* pArgs)
@@ -544,6 +635,7 @@ void CShell::Initialize(void)
   DeclareSymbol("user void LoadCommands(void);", (void*) &LoadCommands);
   DeclareSymbol("user void ListSymbols(void);", (void*) &ListSymbols);
   DeclareSymbol("user void MemoryInfo(void);",  (void*) &MemoryInfo);
+  DeclareSymbol("user void ShellSymbolBenchmark(INDEX);", (void*) &ShellSymbolBenchmark);
   DeclareSymbol("user void MakeAccessViolation(INDEX);", (void*) &MakeAccessViolation);
   DeclareSymbol("user void MakeStackOverflow(INDEX);",   (void*) &MakeStackOverflow);
   DeclareSymbol("user void MakeFatalError(INDEX);",      (void*) &MakeFatalError);
@@ -619,19 +711,51 @@ void CShell::Execute(const CTString &strCommands)
   }
 };
 
-// Get a shell symbol by its name.
-CShellSymbol *CShell::GetSymbol(const CTString &strName, BOOL bDeclaredOnly)
+// Find a symbol in hash index (no locking needed).
+CShellSymbol *CShell::FindSymbol(const CTString &strName)
 {
-  // synchronize access to shell
-  CTSingleLock slShell(&sh_csShell, TRUE);
+  // table is never changed in a way that would confuse readers, only replaced when full
+  CShellHashTable *psht = sh_pshtHash;
+  ULONG ulSlot = strName.GetHash()&psht->sht_ulMask;
+  CShellSymbol *pss;
+  while ((pss=psht->sht_apssSlots[ulSlot])!=NULL) {
+    if (pss->ss_strName==strName) {
+      return pss;
+    }
+    ulSlot = (ulSlot+1)&psht->sht_ulMask;
+  }
+  return NULL;
+}
 
-  // for each of symbols in the shell
-  FOREACHINDYNAMICARRAY(sh_assSymbols, CShellSymbol, itss) {
-    // if it is the right one
-    if (itss->ss_strName==strName) {
-      // return it
-      return itss;
+// Add a new symbol to hash index (shell must be locked).
+void CShell::HashSymbol(CShellSymbol *pss)
+{
+  CShellHashTable *psht = sh_pshtHash;
+  // if table would become more than half full
+  if ((psht->sht_ctUsed+1)*2>INDEX(psht->sht_ulMask+1)) {
+    // make a bigger one with all symbols
+    CShellHashTable *pshtNew = new CShellHashTable((psht->sht_ulMask+1)*2, psht);
+    FOREACHINDYNAMICARRAY(sh_assSymbols, CShellSymbol, itss) {
+      if (&*itss!=pss) {
+        pshtNew->Add(itss);
+      }
     }
+    pshtNew->Add(pss);
+    // readers may switch to it only when it is complete
+    SHELL_WRITEBARRIER();
+    sh_pshtHash = pshtNew;
+    return;
+  }
+  psht->Add(pss);
+}
+
+// Get a shell symbol by its name.
+CShellSymbol *CShell::GetSymbol(const CTString &strName, BOOL bDeclaredOnly)
+{
+  // if found, it is returned without locking
+  CShellSymbol *pss = FindSymbol(strName);
+  if (pss!=NULL) {
+    return pss;
   }
   // if none is found...
 
@@ -642,6 +766,13 @@ CShellSymbol *CShell::GetSymbol(const CTString &strName, BOOL bDeclaredOnly)
 
   // if undeclared symbols are allowed
   } else {
+    // synchronize access to shell
+    CTSingleLock slShell(&sh_csShell, TRUE);
+    // someone might have added it meanwhile
+    pss = FindSymbol(strName);
+    if (pss!=NULL) {
+      return pss;
+    }
     // create a new one with that name and undefined type
     CShellSymbol &ssNew = *sh_assSymbols.New(1);
     ssNew.ss_strName = strName;
@@ -650,122 +781,151 @@ CShellSymbol *CShell::GetSymbol(const CTString &strName, BOOL bDeclaredOnly)
     ssNew.ss_ulFlags = 0;
     ssNew.ss_pPreFunc = NULL;
     ssNew.ss_pPostFunc = NULL;
+    HashSymbol(&ssNew);
     return &ssNew;
   }
 };
 
 FLOAT CShell::GetFLOAT(const CTString &strName)
 {
-  // get the symbol
-  CShellSymbol *pss = GetSymbol(strName, TRUE);
+  return CShellSymbolHandle(strName).GetFLOAT();
+}
+
+void CShell::SetFLOAT(const CTString &strName, FLOAT fValue)
+{
+  CShellSymbolHandle(strName).SetFLOAT(fValue);
+}
+
+INDEX CShell::GetINDEX(const CTString &strName)
+{
+  return CShellSymbolHandle(strName).GetINDEX();
+}
 
+void CShell::SetINDEX(const CTString &strName, INDEX iValue)
+{
+  CShellSymbolHandle(strName).SetINDEX(iValue);
+}
+
+CTString CShell::GetString(const CTString &strName)
+{
+  return CShellSymbolHandle(strName).GetString();
+}
+
+void CShell::SetString(const CTString &strName, const CTString &strValue)
+{
+  CShellSymbolHandle(strName).SetString(strValue);
+}
+
+CTString CShell::GetValue(const CTString &strName)
+{
+  return CShellSymbolHandle(strName).GetValue();
+}
+
+void CShell::SetValue(const CTString &strName, const CTString &strValue)
+{
+  CShellSymbolHandle(strName).SetValue(strValue);
+}
+
+// find symbol with given name, returns FALSE if not found
+BOOL CShellSymbolHandle::Resolve(const CTString &strName)
+{
+  ssh_pss = _pShell->GetSymbol(strName, TRUE);
+  return ssh_pss!=NULL;
+}
+
+FLOAT CShellSymbolHandle::GetFLOAT(void) const
+{
   // if it doesn't exist or is not of given type
-  if (pss==NULL || _shell_ast[pss->ss_istType].st_sttType!=STT_FLOAT) {
+  if (ssh_pss==NULL || _shell_ast[ssh_pss->ss_istType].st_sttType!=STT_FLOAT) {
     // error
     ASSERT(FALSE);
     return -666.0f;
   } 
   // get it
-  return *(FLOAT*)pss->ss_pvValue;
+  return *(FLOAT*)ssh_pss->ss_pvValue;
 }
 
-void CShell::SetFLOAT(const CTString &strName, FLOAT fValue)
+void CShellSymbolHandle::SetFLOAT(FLOAT fValue) const
 {
-  CShellSymbol *pss = GetSymbol(strName, TRUE);
-
   // if it doesn't exist or is not of given type
-  if (pss==NULL || _shell_ast[pss->ss_istType].st_sttType!=STT_FLOAT) {
+  if (ssh_pss==NULL || _shell_ast[ssh_pss->ss_istType].st_sttType!=STT_FLOAT) {
     // error
     ASSERT(FALSE);
     return;
   } 
   // set it
-  *(FLOAT*)pss->ss_pvValue = fValue;
+  *(FLOAT*)ssh_pss->ss_pvValue = fValue;
 }
 
-INDEX CShell::GetINDEX(const CTString &strName)
+INDEX CShellSymbolHandle::GetINDEX(void) const
 {
-  // get the symbol
-  CShellSymbol *pss = GetSymbol(strName, TRUE);
-
   // if it doesn't exist or is not of given type
-  if (pss==NULL || _shell_ast[pss->ss_istType].st_sttType!=STT_INDEX) {
+  if (ssh_pss==NULL || _shell_ast[ssh_pss->ss_istType].st_sttType!=STT_INDEX) {
     // error
     ASSERT(FALSE);
     return -666;
   } 
   // get it
-  return *(INDEX*)pss->ss_pvValue;
+  return *(INDEX*)ssh_pss->ss_pvValue;
 }
 
-void CShell::SetINDEX(const CTString &strName, INDEX iValue)
+void CShellSymbolHandle::SetINDEX(INDEX iValue) const
 {
-  CShellSymbol *pss = GetSymbol(strName, TRUE);
-
   // if it doesn't exist or is not of given type
-  if (pss==NULL || _shell_ast[pss->ss_istType].st_sttType!=STT_INDEX) {
+  if (ssh_pss==NULL || _shell_ast[ssh_pss->ss_istType].st_sttType!=STT_INDEX) {
     // error
     ASSERT(FALSE);
     return;
   } 
   // set it
-  *(INDEX*)pss->ss_pvValue = iValue;
+  *(INDEX*)ssh_pss->ss_pvValue = iValue;
 }
 
-CTString CShell::GetString(const CTString &strName)
+CTString CShellSymbolHandle::GetString(void) const
 {
-  // get the symbol
-  CShellSymbol *pss = GetSymbol(strName, TRUE);
-
   // if it doesn't exist or is not of given type
-  if (pss==NULL || _shell_ast[pss->ss_istType].st_sttType!=STT_STRING) {
+  if (ssh_pss==NULL || _shell_ast[ssh_pss->ss_istType].st_sttType!=STT_STRING) {
     // error
     ASSERT(FALSE);
     return "<invalid>";
   } 
   // get it
-  return *(CTString*)pss->ss_pvValue;
+  return *(CTString*)ssh_pss->ss_pvValue;
 }
 
-void CShell::SetString(const CTString &strName, const CTString &strValue)
+void CShellSymbolHandle::SetString(const CTString &strValue) const
 {
-  CShellSymbol *pss = GetSymbol(strName, TRUE);
-
   // if it doesn't exist or is not of given type
-  if (pss==NULL || _shell_ast[pss->ss_istType].st_sttType!=STT_STRING) {
+  if (ssh_pss==NULL || _shell_ast[ssh_pss->ss_istType].st_sttType!=STT_STRING) {
     // error
     ASSERT(FALSE);
     return;
   } 
   // set it
-  *(CTString*)pss->ss_pvValue = strValue;
+  *(CTString*)ssh_pss->ss_pvValue = strValue;
 }
 
-
-CTString CShell::GetValue(const CTString &strName)
+CTString CShellSymbolHandle::GetValue(void) const
 {
-  // get the symbol
-  CShellSymbol *pss = GetSymbol(strName, TRUE);
-
   // if it doesn't exist
-  if (pss==NULL) {
+  if (ssh_pss==NULL) {
     // error
     ASSERT(FALSE);
     return "<invalid>";
   } 
 
   // get it
-  ShellTypeType stt = _shell_ast[pss->ss_istType].st_sttType;
+  ShellTypeType stt = _shell_ast[ssh_pss->ss_istType].st_sttType;
   CTString strValue;
   switch(stt) {
   case STT_STRING:
-    strValue = *(CTString*)pss->ss_pvValue;
+    strValue = *(CTString*)ssh_pss->ss_pvValue;
     break;
   case STT_INDEX:
-    strValue.PrintF("%d", *(INDEX*)pss->ss_pvValue);
+    strValue.PrintF("%d", *(INDEX*)ssh_pss->ss_pvValue);
     break;
   case STT_FLOAT:
-    strValue.PrintF("%g", *(FLOAT*)pss->ss_pvValue);
+    strValue.PrintF("%g", *(FLOAT*)ssh_pss->ss_pvValue);
     break;
   default:
     ASSERT(FALSE);
@@ -775,34 +935,29 @@ CTString CShell::GetValue(const CTString &strName)
   return strValue;
 }
 
-void CShell::SetValue(const CTString &strName, const CTString &strValue)
+void CShellSymbolHandle::SetValue(const CTString &strValue) const
 {
-  // get the symbol
-  CShellSymbol *pss = GetSymbol(strName, TRUE);
-
   // if it doesn't exist
-  if (pss==NULL) {
+  if (ssh_pss==NULL) {
     // error
     ASSERT(FALSE);
     return;
   } 
-  // get it
-  ShellTypeType stt = _shell_ast[pss->ss_istType].st_sttType;
+  // set it
+  ShellTypeType stt = _shell_ast[ssh_pss->ss_istType].st_sttType;
   switch(stt) {
   case STT_STRING:
-    *(CTString*)pss->ss_pvValue = strValue;
+    *(CTString*)ssh_pss->ss_pvValue = strValue;
     break;
   case STT_INDEX:
-    ((CTString&)strValue).ScanF("%d", (INDEX*)pss->ss_pvValue);
+    ((CTString&)strValue).ScanF("%d", (INDEX*)ssh_pss->ss_pvValue);
     break;
   case STT_FLOAT:
-    ((CTString&)strValue).ScanF("%g", (FLOAT*)pss->ss_pvValue);
+    ((CTString&)strValue).ScanF("%g", (FLOAT*)ssh_pss->ss_pvValue);
     break;
   default:
     ASSERT(FALSE);
   }
-
-  return;
 }
 
 /*
@@ -32,9 +32,14 @@ public:
 // implementation:
   CTCriticalSection sh_csShell; // critical section for access to shell data
   CDynamicArray<CShellSymbol> sh_assSymbols;  // all defined symbols
+  class CShellHashTable *volatile sh_pshtHash; // hashed index of all symbols (read without locking)
   CWorld* pwoCurrentWorld;
   // Get a shell symbol by its name.
   CShellSymbol *GetSymbol(const CTString &strName, BOOL bDeclaredOnly);
+  // Find a symbol in hash index (no locking needed).
+  CShellSymbol *FindSymbol(const CTString &strName);
+  // Add a new symbol to hash index (shell must be locked).
+  void HashSymbol(CShellSymbol *pss);
   // Report error in shell script processing.
   void ErrorF(const char *strFormat, ...);
 
@@ -74,6 +79,29 @@ public:
   }
 };
 
+// Shell symbol resolved by name once, to be accessed often without looking it up again.
+// (symbols are never removed from the shell, so the handle stays valid)
+class ENGINE_API CShellSymbolHandle {
+public:
+  CShellSymbol *ssh_pss;  // the symbol (NULL if not found)
+
+  CShellSymbolHandle(void) { ssh_pss = NULL; };
+  CShellSymbolHandle(const CTString &strName) { Resolve(strName); };
+  // find symbol with given name, returns FALSE if not found
+  BOOL Resolve(const CTString &strName);
+  BOOL IsValid(void) const { return ssh_pss!=NULL; };
+
+  // get/set symbol value
+  FLOAT GetFLOAT(void) const;
+  void SetFLOAT(FLOAT fValue) const;
+  INDEX GetINDEX(void) const;
+  void SetINDEX(INDEX iValue) const;
+  CTString GetString(void) const;
+  void SetString(const CTString &strValue) const;
+  CTString GetValue(void) const;
+  void SetValue(const CTString &strValue) const;
+};
+
 // pointer to global shell object
 ENGINE_API extern CShell *_pShell;
 
@@ -19,15 +19,20 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Base/Console.h>
 #include <Engine/Base/Translation.h>
 
+#include <Engine/Base/Shell.h>
 #include <Engine/Base/Registry.h>
 #include <Engine/Base/Profiling.h>
 #include <Engine/Base/ErrorReporting.h>
 #include <Engine/Base/Statistics_Internal.h>
+#include <Engine/Math/Functions.h>
 
 #include <Engine/Base/ListIterator.inl>
 #include <Engine/Base/Priority.inl>
+#include <Engine/Templates/StaticArray.cpp>
 #include "unistd.h"
 #include "pthread.h"
+#include <time.h>
+#include <errno.h>
 
 // Read the Pentium TimeStampCounter
 static inline __int64 ReadTSC(void)
@@ -58,6 +63,107 @@ pthread_t g_timerMainThread;
 
 const TIME CTimer::TickQuantum = TIME(1/20.0);    // 20 ticks per second
 
+// tick source (0=monotonic clock, 1=virtual clock advanced by AdvanceVirtualClock())
+INDEX tim_iTickSource = 0;
+// how many ticks late can timer be before it gives up catching up
+INDEX tim_iMaxCatchUpTicks = 2;
+// tick statistics
+FLOAT tim_fTickJitter    = 0.0f;  // average distance from tick deadline (ms)
+FLOAT tim_fTickJitterMax = 0.0f;  // worst distance from tick deadline (ms)
+INDEX tim_ctLateTicks    = 0;     // ticks that started more than half a tick late
+INDEX tim_ctDroppedTicks = 0;     // ticks skipped because timer was too late
+
+// nanoseconds in one tick
+static const __int64 _llTickQuantumNs = __int64(1/20.0*1E9+0.5);
+
+
+// hardware monotonic clock, sleeping to absolute deadlines so that it doesn't drift
+class CMonotonicTickSource : public CTimerTickSource {
+public:
+  __int64 GetTimeNs(void)
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return __int64(ts.tv_sec)*1000000000LL + ts.tv_nsec;
+  }
+  BOOL WaitUntil(__int64 llDeadlineNs)
+  {
+    struct timespec ts;
+    ts.tv_sec  = llDeadlineNs/1000000000LL;
+    ts.tv_nsec = llDeadlineNs%1000000000LL;
+    // returns non-zero only if interrupted by a signal
+    return clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)==0;
+  }
+};
+
+// deterministic clock that moves only when explicitly advanced (for headless runs)
+class CVirtualTickSource : public CTimerTickSource {
+public:
+  pthread_mutex_t vts_mxLock;
+  pthread_cond_t  vts_cvChanged;
+  __int64 vts_llNowNs;    // time seen by the timer
+  __int64 vts_llLimitNs;  // time the clock was advanced to
+  __int64 vts_llDoneNs;   // last tick that timer has finished
+
+  CVirtualTickSource(void)
+  {
+    pthread_mutex_init(&vts_mxLock, NULL);
+    pthread_cond_init(&vts_cvChanged, NULL);
+    vts_llNowNs = vts_llLimitNs = vts_llDoneNs = 0;
+  }
+  ~CVirtualTickSource(void)
+  {
+    pthread_cond_destroy(&vts_cvChanged);
+    pthread_mutex_destroy(&vts_mxLock);
+  }
+  __int64 GetTimeNs(void)
+  {
+    pthread_mutex_lock(&vts_mxLock);
+    __int64 llNow = vts_llNowNs;
+    pthread_mutex_unlock(&vts_mxLock);
+    return llNow;
+  }
+  BOOL WaitUntil(__int64 llDeadlineNs)
+  {
+    pthread_mutex_lock(&vts_mxLock);
+    if (vts_llLimitNs<llDeadlineNs) {
+      // wake up now and then, so that the timer can notice if the source was switched
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_nsec += 100*1000*1000;
+      if (ts.tv_nsec>=1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+      pthread_cond_timedwait(&vts_cvChanged, &vts_mxLock, &ts);
+    }
+    BOOL bReached = vts_llLimitNs>=llDeadlineNs;
+    if (bReached) {
+      vts_llNowNs = llDeadlineNs;
+    }
+    pthread_mutex_unlock(&vts_mxLock);
+    return bReached;
+  }
+  void TickDone(__int64 llDeadlineNs)
+  {
+    pthread_mutex_lock(&vts_mxLock);
+    vts_llDoneNs = llDeadlineNs;
+    pthread_cond_broadcast(&vts_cvChanged);
+    pthread_mutex_unlock(&vts_mxLock);
+  }
+  // move the clock forward and wait until timer thread catches up with it
+  void Advance(__int64 llDeltaNs, BOOL bWait)
+  {
+    pthread_mutex_lock(&vts_mxLock);
+    vts_llLimitNs += llDeltaNs;
+    pthread_cond_broadcast(&vts_cvChanged);
+    while (bWait && vts_llDoneNs+_llTickQuantumNs<=vts_llLimitNs) {
+      pthread_cond_wait(&vts_cvChanged, &vts_mxLock);
+    }
+    pthread_mutex_unlock(&vts_mxLock);
+  }
+};
+
+static CMonotonicTickSource _ttsMonotonic;
+static CVirtualTickSource   _ttsVirtual;
+
 /*
  * Timer interrupt callback function.
  */
@@ -123,21 +229,61 @@ void CTimer_TimerFunc_internal(void)
 //  } CTSTREAM_END;
 }
 
+// update tick statistics with how late the tick was
+static void UpdateTickStats(__int64 llLateNs)
+{
+  const FLOAT fDeltaMS = FLOAT(Abs(llLateNs))/1E6f;
+  tim_fTickJitter = Lerp(tim_fTickJitter, fDeltaMS, 0.05f);
+  tim_fTickJitterMax = Max(tim_fTickJitterMax, fDeltaMS);
+  if (llLateNs>_llTickQuantumNs/2) {
+    tim_ctLateTicks++;
+  }
+}
+
 void *CTimer_TimerMain(void *input) {
+  CTimerTickSource *ptts = NULL;
+  __int64 llDeadline = 0;
   while(true) {
-    // sleep
-    usleep(ULONG(_pTimer->TickQuantum * 1000.0f * 1000.0f)); // microsecond
+    // if tick source was changed, start counting from its current time
+    CTimerTickSource *pttsCurrent = _pTimer->GetTickSource();
+    if (pttsCurrent!=ptts) {
+      ptts = pttsCurrent;
+      llDeadline = ptts->GetTimeNs() + _llTickQuantumNs;
+    }
+
+    // sleep until the deadline, not for a fixed period, so that time spent in handlers
+    // and scheduling delays don't accumulate
+    if (!ptts->WaitUntil(llDeadline)) {
+      continue;
+    }
+    const __int64 llNow = ptts->GetTimeNs();
 
     // TODO: unsynch
     if (_pTimer->tm_bPaused) {
-      usleep(50000);
+      // don't catch up on the paused time
+      ptts->TickDone(llDeadline);
+      llDeadline = llNow + _llTickQuantumNs;
       continue;
     }
 
-    // access to the list of handlers must be locked
-    CTSingleLock slHooks(&_pTimer->tm_csHooks, TRUE);
-    // handle all timers
-    CTimer_TimerFunc_internal();
+    UpdateTickStats(llNow-llDeadline);
+    {
+      // access to the list of handlers must be locked
+      CTSingleLock slHooks(&_pTimer->tm_csHooks, TRUE);
+      // handle all timers
+      CTimer_TimerFunc_internal();
+    }
+    ptts->TickDone(llDeadline);
+
+    // schedule next tick; if we fell too far behind, skip ticks instead of running them in a burst
+    llDeadline += _llTickQuantumNs;
+    const __int64 llBehind = ptts->GetTimeNs() - llDeadline;
+    const __int64 llMaxBehind = Max(tim_iMaxCatchUpTicks, 0L)*_llTickQuantumNs;
+    if (llBehind>llMaxBehind) {
+      const __int64 ctSkip = (llBehind-llMaxBehind)/_llTickQuantumNs+1;
+      tim_ctDroppedTicks += ctSkip;
+      llDeadline += ctSkip*_llTickQuantumNs;
+    }
   }
 }
 
@@ -157,6 +303,7 @@ CTimer::CTimer(BOOL bInterrupt /*=TRUE*/)
   ASSERT(_pTimer == NULL);
   _pTimer = this;
   tm_bInterrupt = bInterrupt;
+  tm_pttsCustom = NULL;
 
   { // this part of code must be executed as precisely as possible
 //    CSetPriority sp(REALTIME_PRIORITY_CLASS, THREAD_PRIORITY_TIME_CRITICAL);
@@ -259,6 +406,33 @@ void CTimer::HandleTimerHandlers(void)
   CTimer_TimerFunc_internal();
 }
 
+/* Set tick source that drives the timer (NULL to use the one selected by tim_iTickSource). */
+void CTimer::SetTickSource(CTimerTickSource *pttsNew)
+{
+  ASSERT(this!=NULL);
+  tm_pttsCustom = pttsNew;
+}
+
+/* Get tick source that currently drives the timer. */
+CTimerTickSource *CTimer::GetTickSource(void)
+{
+  ASSERT(this!=NULL);
+  if (tm_pttsCustom!=NULL) {
+    return tm_pttsCustom;
+  }
+  return (tim_iTickSource==1) ? (CTimerTickSource*)&_ttsVirtual : (CTimerTickSource*)&_ttsMonotonic;
+}
+
+/* Advance the virtual tick source and wait until timer handles those ticks. */
+void CTimer::AdvanceVirtualClock(INDEX ctTicks)
+{
+  ASSERT(this!=NULL);
+  if (ctTicks<=0) return;
+  // wait for the timer only if it is actually driven by the virtual clock
+  const BOOL bWait = tm_bInterrupt && !tm_bPaused && GetTickSource()==&_ttsVirtual;
+  _ttsVirtual.Advance(ctTicks*_llTickQuantumNs, bWait);
+}
+
 
 /*
  * Set the real time tick value.
@@ -317,6 +491,106 @@ void CTimer::DisableLerp(void)
   tm_fLerpFactor2=1.0f;
 }
 
+
+// shell function for stepping the virtual clock
+void AdvanceVirtualClock(void *pArgs)
+{
+  INDEX ctTicks = NEXTARGUMENT(INDEX);
+  _pTimer->AdvanceVirtualClock(ctTicks);
+}
+
+// records times at which timer ticks arrived
+class CTickRecorder : public CTimerHandler {
+public:
+  CStaticArray<__int64> tr_allTimes;
+  volatile INDEX tr_ctRecorded;
+  void HandleTimer(void)
+  {
+    if (tr_ctRecorded<tr_allTimes.Count()) {
+      tr_allTimes[tr_ctRecorded] = _ttsMonotonic.GetTimeNs();
+      tr_ctRecorded++;
+    }
+  }
+};
+
+// keeps a CPU busy while ticks are measured
+static volatile BOOL _bLoadRunning = FALSE;
+static void *TimerLoadThread(void *pArgs)
+{
+  ULONG ulDummy = 1;
+  while (_bLoadRunning) {
+    for (INDEX i=0; i<10000; i++) {
+      ulDummy = ulDummy*1664525UL+1013904223UL;
+    }
+  }
+  return (void*)(size_t)ulDummy;
+}
+
+// record given number of ticks and print how evenly they were spaced
+static void MeasureTicks(const char *strName, INDEX ctTicks)
+{
+  CTickRecorder tr;
+  tr.tr_allTimes.New(ctTicks+1);
+  tr.tr_ctRecorded = 0;
+  const INDEX ctLateBefore    = tim_ctLateTicks;
+  const INDEX ctDroppedBefore = tim_ctDroppedTicks;
+
+  _pTimer->AddHandler(&tr);
+  while (tr.tr_ctRecorded<=ctTicks) {
+    usleep(10*1000);
+  }
+  _pTimer->RemHandler(&tr);
+
+  // statistics of intervals between ticks
+  DOUBLE dSum = 0, dSum2 = 0, dMin = 1E9, dMax = 0;
+  for (INDEX i=0; i<ctTicks; i++) {
+    const DOUBLE dInterval = (tr.tr_allTimes[i+1]-tr.tr_allTimes[i])/1E6;
+    dSum  += dInterval;
+    dSum2 += dInterval*dInterval;
+    dMin = Min(dMin, dInterval);
+    dMax = Max(dMax, dInterval);
+  }
+  const DOUBLE dMean = dSum/ctTicks;
+  const DOUBLE dVariance = Max(dSum2/ctTicks-dMean*dMean, 0.0);
+  // how far did the last tick move away from where it should be
+  const DOUBLE dDrift = (tr.tr_allTimes[ctTicks]-tr.tr_allTimes[0])/1E6 - ctTicks*_llTickQuantumNs/1E6;
+
+  CPrintF(TRANS("  %-6s mean %.3f ms, stddev %.3f ms (variance %.4f), min %.3f ms, max %.3f ms\n"),
+    strName, dMean, sqrt(dVariance), dVariance, dMin, dMax);
+  CPrintF(TRANS("         drift %.3f ms, late ticks %d, dropped ticks %d\n"),
+    dDrift, tim_ctLateTicks-ctLateBefore, tim_ctDroppedTicks-ctDroppedBefore);
+}
+
+// measure spacing of timer ticks, first idle and then with all CPUs kept busy
+void TimerTickBenchmark(void *pArgs)
+{
+  INDEX ctTicks = NEXTARGUMENT(INDEX);
+  if (ctTicks<=0) ctTicks = 100;
+
+  if (!_pTimer->tm_bInterrupt || _pTimer->tm_bPaused || _pTimer->GetTickSource()!=&_ttsMonotonic) {
+    CPrintF(TRANS("Timer is not driven by the monotonic clock, cannot measure ticks.\n"));
+    return;
+  }
+  CPrintF(TRANS("Measuring %d timer ticks (%.1f s each pass)...\n"), ctTicks, ctTicks*_pTimer->TickQuantum);
+
+  MeasureTicks("idle:", ctTicks);
+
+  const INDEX ctThreads = Max(INDEX(sysconf(_SC_NPROCESSORS_ONLN)), 1L);
+  CStaticArray<pthread_t> athLoad;
+  athLoad.New(ctThreads);
+  _bLoadRunning = TRUE;
+  INDEX ctStarted = 0;
+  for (; ctStarted<ctThreads; ctStarted++) {
+    if (pthread_create(&athLoad[ctStarted], NULL, &TimerLoadThread, NULL)!=0) break;
+  }
+  CPrintF(TRANS("  (%d load threads)\n"), ctStarted);
+  MeasureTicks("load:", ctTicks);
+  _bLoadRunning = FALSE;
+  for (INDEX i=0; i<ctStarted; i++) {
+    pthread_join(athLoad[i], NULL);
+  }
+}
+
 // convert a time value to a printable string (hh:mm:ss)
 CTString TimeToString(FLOAT fTime)
 {
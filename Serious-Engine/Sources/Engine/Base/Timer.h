@@ -68,6 +68,18 @@ public:
   ENGINE_API virtual void HandleTimer(void)=0;
 };
 
+// source of time that drives the timer thread
+class CTimerTickSource {
+public:
+  virtual ~CTimerTickSource(void) {}
+  /* Get current time of this source in nanoseconds. */
+  virtual __int64 GetTimeNs(void)=0;
+  /* Sleep until the given time of this source (returns FALSE if woken up before that). */
+  virtual BOOL WaitUntil(__int64 llDeadlineNs)=0;
+  /* Called by timer thread when it is done with the tick for the given deadline. */
+  virtual void TickDone(__int64 llDeadlineNs) {};
+};
+
 // class for an object that maintains global timer(s)
 class ENGINE_API CTimer {
 // implementation:
@@ -89,6 +101,7 @@ public:
   CListHead         tm_lhHooks;   // a list head for timer hooks
   BOOL tm_bInterrupt;       // set if interrupt is added
   BOOL tm_bPaused = false;       // true if all timer should be paused
+  CTimerTickSource *tm_pttsCustom;  // tick source set by application (NULL for default)
 
 // interface:
 public:
@@ -106,6 +119,13 @@ public:
   /* Handle timer handlers manually. */
   void HandleTimerHandlers(void);
 
+  /* Set tick source that drives the timer (NULL to use the one selected by tim_iTickSource). */
+  void SetTickSource(CTimerTickSource *pttsNew);
+  /* Get tick source that currently drives the timer. */
+  CTimerTickSource *GetTickSource(void);
+  /* Advance the virtual tick source and wait until timer handles those ticks. */
+  void AdvanceVirtualClock(INDEX ctTicks);
+
   /* Set the real time tick value. */
   void SetRealTimeTick(TIME tNewRealTimeTick);
   /* Get the real time tick value. */
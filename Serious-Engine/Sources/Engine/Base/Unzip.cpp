@@ -492,6 +492,10 @@ const CTFileName &UNZIPGetFileAtIndex(INDEX i)
 {
   return _azeFiles[i].ze_fnm;
 }
+const CTFileName &UNZIPGetArchiveAtIndex(INDEX i)
+{
+  return *_azeFiles[i].ze_pfnmArchive;
+}
 
 BOOL UNZIPIsFileAtIndexMod(INDEX i)
 {
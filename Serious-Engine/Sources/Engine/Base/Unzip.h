@@ -42,6 +42,8 @@ void UNZIPGetFileInfo(INDEX iHandle, CTFileName &fnmZip,
 // enumeration for all files in all zips
 INDEX UNZIPGetFileCount(void);
 const CTFileName &UNZIPGetFileAtIndex(INDEX i);
+// archive that a file at index is in
+const CTFileName &UNZIPGetArchiveAtIndex(INDEX i);
 
 // get index of a file (-1 for no file)
 INDEX UNZIPGetFileIndex(const CTFileName &fnm);
@@ -0,0 +1,272 @@
+/* Copyright (c) 2002-2012 Croteam Ltd.
+This program is free software; you can redistribute it and/or modify
+it under the terms of version 2 of the GNU General Public License as published by
+the Free Software Foundation
+
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA. */
+
+#include "StdH.h"
+
+#include <Engine/Base/WorkerPool.h>
+#include <Engine/Base/Console.h>
+#include <Engine/Base/Translation.h>
+#include <Engine/Base/ErrorReporting.h>
+#include <Engine/Base/Memory.h>
+#include <Engine/Base/ListIterator.inl>
+#include <Engine/Math/Functions.h>
+#include "unistd.h"
+
+// number of worker threads (-1 = one less than number of CPU cores, 0 = none)
+INDEX sys_iWorkerThreads = -1;
+
+// pointer to global worker pool object
+CWorkerPool *_pWorkerPool = NULL;
+
+// max worker threads ever started
+#define MAX_WORKER_THREADS 16
+
+// set for worker threads only
+static CThreadLocal<BOOL> _bWorkerThread;
+
+
+static void *CWorkerPool_WorkerMain(void *pvPool)
+{
+  CWorkerPool &wp = *(CWorkerPool*)pvPool;
+  *_bWorkerThread = TRUE;
+
+  pthread_mutex_lock(&wp.wp_mxState);
+  while (!wp.wp_bQuit) {
+    // data-parallel jobs have priority because someone is waiting for them
+    if (wp.ProcessOneChunk()) {
+      continue;
+    }
+    // if there is a background task
+    if (!wp.wp_lhTasks.IsEmpty()) {
+      CWorkerTask *pwt = LIST_HEAD(wp.wp_lhTasks, CWorkerTask, wt_lnNode);
+      pwt->wt_lnNode.Remove();
+      pthread_mutex_unlock(&wp.wp_mxState);
+      pwt->Execute();
+      pthread_mutex_lock(&wp.wp_mxState);
+      continue;
+    }
+    // nothing to do
+    pthread_cond_wait(&wp.wp_cvWork, &wp.wp_mxState);
+  }
+  pthread_mutex_unlock(&wp.wp_mxState);
+  return NULL;
+}
+
+
+/*
+ * Constructor.
+ */
+CWorkerPool::CWorkerPool(void)
+{
+  wp_apthThreads = NULL;
+  wp_ctThreads = 0;
+  wp_bStarted = FALSE;
+  wp_bQuit = FALSE;
+  wp_pwjJob = NULL;
+  wp_iNextItem = 0;
+  wp_ctItems = 0;
+  wp_ctItemsPerChunk = 1;
+  wp_ctBusy = 0;
+  pthread_mutex_init(&wp_mxState, NULL);
+  pthread_mutex_init(&wp_mxRun, NULL);
+  pthread_cond_init(&wp_cvWork, NULL);
+  pthread_cond_init(&wp_cvDone, NULL);
+}
+
+/*
+ * Destructor.
+ */
+CWorkerPool::~CWorkerPool(void)
+{
+  Stop();
+  pthread_cond_destroy(&wp_cvDone);
+  pthread_cond_destroy(&wp_cvWork);
+  pthread_mutex_destroy(&wp_mxRun);
+  pthread_mutex_destroy(&wp_mxState);
+}
+
+
+// start worker threads if not started yet
+void CWorkerPool::Start(void)
+{
+  if (wp_bStarted) {
+    return;
+  }
+  wp_bStarted = TRUE;
+
+  // determine number of workers
+  INDEX ctThreads = sys_iWorkerThreads;
+  if (ctThreads<0) {
+    ctThreads = sysconf(_SC_NPROCESSORS_ONLN)-1;
+  }
+  ctThreads = Clamp(ctThreads, (INDEX)0, (INDEX)MAX_WORKER_THREADS);
+  if (ctThreads==0) {
+    return;
+  }
+
+  wp_apthThreads = (pthread_t*)AllocMemory(ctThreads*sizeof(pthread_t));
+  for (INDEX iThread=0; iThread<ctThreads; iThread++) {
+    int ret = pthread_create(&wp_apthThreads[wp_ctThreads], NULL, &CWorkerPool_WorkerMain, this);
+    if (ret!=0) {
+      CPrintF(TRANS("Cannot create worker thread: %s (%i)\n"), strerror(ret), ret);
+      break;
+    }
+    wp_ctThreads++;
+  }
+  CPrintF(TRANS("Started %d worker threads\n"), wp_ctThreads);
+}
+
+// stop all worker threads
+void CWorkerPool::Stop(void)
+{
+  pthread_mutex_lock(&wp_mxState);
+  wp_bQuit = TRUE;
+  pthread_cond_broadcast(&wp_cvWork);
+  pthread_mutex_unlock(&wp_mxState);
+
+  for (INDEX iThread=0; iThread<wp_ctThreads; iThread++) {
+    pthread_join(wp_apthThreads[iThread], NULL);
+  }
+  if (wp_apthThreads!=NULL) {
+    FreeMemory(wp_apthThreads);
+    wp_apthThreads = NULL;
+  }
+  wp_ctThreads = 0;
+
+  // tasks that never got started are executed here so nobody waits for them forever
+  while (!wp_lhTasks.IsEmpty()) {
+    CWorkerTask *pwt = LIST_HEAD(wp_lhTasks, CWorkerTask, wt_lnNode);
+    pwt->wt_lnNode.Remove();
+    pwt->Execute();
+  }
+}
+
+
+// take one chunk of the current job and process it (state must be locked)
+BOOL CWorkerPool::ProcessOneChunk(void)
+{
+  if (wp_pwjJob==NULL || wp_iNextItem>=wp_ctItems) {
+    return FALSE;
+  }
+  CWorkerJob *pwj = wp_pwjJob;
+  const INDEX iFirst = wp_iNextItem;
+  const INDEX iLast  = Min(iFirst+wp_ctItemsPerChunk, wp_ctItems);
+  wp_iNextItem = iLast;
+  wp_ctBusy++;
+  pthread_mutex_unlock(&wp_mxState);
+
+  pwj->ProcessRange(iFirst, iLast);
+
+  pthread_mutex_lock(&wp_mxState);
+  wp_ctBusy--;
+  if (wp_ctBusy==0 && wp_iNextItem>=wp_ctItems) {
+    pthread_cond_broadcast(&wp_cvDone);
+  }
+  return TRUE;
+}
+
+
+/* Get number of threads that will process a job (including the calling thread). */
+INDEX CWorkerPool::GetThreadsCount(void)
+{
+  pthread_mutex_lock(&wp_mxState);
+  Start();
+  INDEX ctThreads = wp_ctThreads+1;
+  pthread_mutex_unlock(&wp_mxState);
+  return ctThreads;
+}
+
+
+/* Process all items of a job in parallel and return when all are done. */
+void CWorkerPool::Run(CWorkerJob &wj, INDEX ctItems, INDEX ctItemsPerChunk/*=1*/)
+{
+  ASSERT(ctItemsPerChunk>0);
+  if (ctItems<=0) {
+    return;
+  }
+
+  // nested jobs, jobs that fit in one chunk and jobs posted while another one
+  // is running are done on the calling thread
+  if (ctItems<=ctItemsPerChunk || IsWorkerThread() || pthread_mutex_trylock(&wp_mxRun)!=0) {
+    wj.ProcessRange(0, ctItems);
+    return;
+  }
+
+  pthread_mutex_lock(&wp_mxState);
+  Start();
+  if (wp_ctThreads==0) {
+    pthread_mutex_unlock(&wp_mxState);
+    pthread_mutex_unlock(&wp_mxRun);
+    wj.ProcessRange(0, ctItems);
+    return;
+  }
+
+  // post the job
+  wp_pwjJob = &wj;
+  wp_iNextItem = 0;
+  wp_ctItems = ctItems;
+  wp_ctItemsPerChunk = ctItemsPerChunk;
+  wp_ctBusy = 0;
+  pthread_cond_broadcast(&wp_cvWork);
+
+  // help with the job and wait until all chunks are done
+  while (ProcessOneChunk()) {
+    NOTHING;
+  }
+  while (wp_ctBusy>0 || wp_iNextItem<wp_ctItems) {
+    pthread_cond_wait(&wp_cvDone, &wp_mxState);
+  }
+  wp_pwjJob = NULL;
+  pthread_mutex_unlock(&wp_mxState);
+  pthread_mutex_unlock(&wp_mxRun);
+}
+
+
+/* Queue a task for background execution and return immediately. */
+void CWorkerPool::AddTask(CWorkerTask *pwt)
+{
+  ASSERT(pwt!=NULL && !pwt->wt_lnNode.IsLinked());
+  pthread_mutex_lock(&wp_mxState);
+  Start();
+  // without worker threads, task is executed right away
+  if (wp_ctThreads==0 || wp_bQuit) {
+    pthread_mutex_unlock(&wp_mxState);
+    pwt->Execute();
+    return;
+  }
+  wp_lhTasks.AddTail(pwt->wt_lnNode);
+  pthread_cond_signal(&wp_cvWork);
+  pthread_mutex_unlock(&wp_mxState);
+}
+
+
+/* Remove a task that has not been started yet (returns FALSE if it is already running or done). */
+BOOL CWorkerPool::RemoveTask(CWorkerTask *pwt)
+{
+  pthread_mutex_lock(&wp_mxState);
+  BOOL bRemoved = pwt->wt_lnNode.IsLinked();
+  if (bRemoved) {
+    pwt->wt_lnNode.Remove();
+  }
+  pthread_mutex_unlock(&wp_mxState);
+  return bRemoved;
+}
+
+
+/* Check if called from one of the worker threads. */
+BOOL CWorkerPool::IsWorkerThread(void)
+{
+  return *_bWorkerThread;
+}
@@ -0,0 +1,96 @@
+/* Copyright (c) 2002-2012 Croteam Ltd.
+This program is free software; you can redistribute it and/or modify
+it under the terms of version 2 of the GNU General Public License as published by
+the Free Software Foundation
+
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA. */
+
+#ifndef SE_INCL_WORKERPOOL_H
+#define SE_INCL_WORKERPOOL_H
+#ifdef PRAGMA_ONCE
+  #pragma once
+#endif
+
+#include <Engine/Base/Lists.h>
+#include <Engine/Base/Synchronization.h>
+
+// a data-parallel job that can be split into independent ranges of items
+class CWorkerJob {
+public:
+  virtual ~CWorkerJob(void) {}
+  /* Process items in range [iFirst, iLast). Called concurrently from several threads! */
+  ENGINE_API virtual void ProcessRange(INDEX iFirst, INDEX iLast)=0;
+};
+
+// a task that is executed in background on one of the worker threads
+class CWorkerTask {
+public:
+  CListNode wt_lnNode;   // node in list of pending tasks
+public:
+  virtual ~CWorkerTask(void) {}
+  /* Do the work. Called from a worker thread (or inline if no workers are running). */
+  ENGINE_API virtual void Execute(void)=0;
+};
+
+// pool of worker threads shared by all engine subsystems
+class ENGINE_API CWorkerPool {
+public:
+  pthread_t *wp_apthThreads;      // worker threads
+  INDEX wp_ctThreads;             // number of worker threads (0 if running single-threaded)
+  BOOL  wp_bStarted;              // set once threads have been started
+  BOOL  wp_bQuit;                 // set when workers should exit
+
+  pthread_mutex_t wp_mxState;     // guards everything below
+  pthread_cond_t  wp_cvWork;      // signalled when new work is posted
+  pthread_cond_t  wp_cvDone;      // signalled when all chunks of a job are done
+  pthread_mutex_t wp_mxRun;       // only one data-parallel job can run at a time
+
+  CWorkerJob *wp_pwjJob;          // currently running data-parallel job
+  INDEX wp_iNextItem;             // first item that has not been taken yet
+  INDEX wp_ctItems;               // total items in current job
+  INDEX wp_ctItemsPerChunk;       // how many items to take at once
+  INDEX wp_ctBusy;                // how many threads are processing a chunk of current job
+
+  CListHead wp_lhTasks;           // pending background tasks
+
+  // take one chunk of the current job and process it (state must be locked)
+  BOOL ProcessOneChunk(void);
+  // start worker threads if not started yet
+  void Start(void);
+  // stop all worker threads
+  void Stop(void);
+
+public:
+  /* Constructor. */
+  CWorkerPool(void);
+  /* Destructor. */
+  ~CWorkerPool(void);
+
+  /* Get number of threads that will process a job (including the calling thread). */
+  INDEX GetThreadsCount(void);
+  /* Process all items of a job in parallel and return when all are done. */
+  void Run(CWorkerJob &wj, INDEX ctItems, INDEX ctItemsPerChunk=1);
+  /* Queue a task for background execution and return immediately. */
+  void AddTask(CWorkerTask *pwt);
+  /* Remove a task that has not been started yet (returns FALSE if it is already running or done). */
+  BOOL RemoveTask(CWorkerTask *pwt);
+  /* Check if called from one of the worker threads. */
+  static BOOL IsWorkerThread(void);
+};
+
+// number of worker threads (-1 = one less than number of CPU cores, 0 = none)
+ENGINE_API extern INDEX sys_iWorkerThreads;
+
+// pointer to global worker pool object
+ENGINE_API extern CWorkerPool *_pWorkerPool;
+
+
+#endif  /* include-once check. */
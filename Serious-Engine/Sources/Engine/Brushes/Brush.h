@@ -31,7 +31,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Brushes/BrushBase.h>
 #include <Engine/Templates/DynamicArray.h>
 #include <Engine/Templates/StaticArray.h>
+#include <Engine/Templates/StaticStackArray.h>
 #include <Engine/Templates/Selection.h>
+#include <Engine/Light/Gradient.h>
 
 // a vertex in brush
 #define BVXF_DRAWNINWIREFRAME     (1L<<0)  // vertex is already drawn in wireframe
@@ -185,6 +187,8 @@ public:
   SLONG bsl_slSizeInPixels; // size of bit mask in pixels (with all mip-maps)
   UBYTE *bsl_pubLayer;  // bit mask set where the polygon is lighted
   COLOR bsl_colLastAnim;  // last animating color cached
+  const UBYTE *bsl_pubMaskCRC;  // mask that bsl_ulMaskCRC was calculated for (NULL if none)
+  ULONG bsl_ulMaskCRC;          // CRC of bit mask (for persistent shadow cache)
 
 // interface:
   CBrushShadowLayer();
@@ -199,6 +203,36 @@ public:
 };
 
 
+// light source of one shadow layer, as it was when mixing started
+class CShadowMixLayer {
+public:
+  CBrushShadowLayer *sml_pbsl;  // the layer (only layers of static lights are read while mixing)
+  ULONG sml_ulLightFlags;       // flags of the light source
+  FLOAT3D sml_vLight;           // position of the light source
+  FLOAT3D sml_vLightDirection;  // direction of the light source (for directional lights)
+  RANGE sml_rHotSpot;
+  RANGE sml_rFallOff;
+  COLOR sml_colLight;           // color of the light in current animation frame
+  COLOR sml_colAmbient;         // ambient color in current animation frame (for directional lights)
+  COLOR sml_colAmbientBase;     // ambient color without animation
+  BOOL  sml_bAnimating;         // set if the light has color animation
+};
+
+// everything that layers are mixed with besides layers themselves (taken on main thread,
+// so that background mixing doesn't read lights and entities that are changed meanwhile)
+class CShadowMixInputs {
+public:
+  CStaticStackArray<CShadowMixLayer> smi_asmlLayers;  // all layers of the shadow map
+  ULONG smi_ulPolygonFlags;       // flags of the polygon
+  COLOR smi_colSectorAmbient;     // ambient color of the polygon's sector
+  FLOATplane3D smi_plAbsolute;    // plane of the polygon in absolute space
+  CMappingVectors smi_mvRelative; // default mapping of the plane in brush space
+  FLOATmatrix3D smi_mRotation;    // placement of the brush entity
+  FLOAT3D smi_vPosition;
+  BOOL smi_bHasGradient;          // gradient of the polygon (if any)
+  CGradientParameters smi_gpGradient;
+};
+
 class ENGINE_API CBrushShadowMap : public CShadowMap {
 public:
 // implementation:
@@ -224,6 +258,21 @@ public:
 
   // returns TRUE if shadowmap is all flat along with colFlat variable set to that color
   virtual BOOL IsShadowFlat( COLOR &colFlat);
+  // remember lights for background mixing (returns FALSE if it cannot or need not be mixed in background)
+  virtual BOOL PrepareBackgroundMixing( INDEX iFirstMip, INDEX iLastMip, CShadowMixInputs &smi);
+  // mix static layers into given buffer (called from a worker thread)
+  virtual void MixLayersInBackground( ULONG *pulShadowMap, SLONG slMemoryUsed, INDEX iFirstMip, INDEX iLastMip,
+                                      const CShadowMixInputs &smi, BOOL &bAnimatingLights);
+  // filter layers that were mixed in background (called on main thread once they are cached)
+  virtual void FinishBackgroundMixing( INDEX iFirstMip, INDEX iLastMip, const CShadowMixInputs &smi);
+  // remember current state of lights and polygon for mixing (called on main thread)
+  void TakeMixInputs( CShadowMixInputs &smi, BOOL bDynamic);
+  // get keys of static layers for persistent shadow cache (returns FALSE if it cannot be cached)
+  BOOL GetPersistentCacheKey( ULONG &ulParamsCRC, ULONG &ulLayersCRC);
+  // load static mip-maps from persistent cache (returns FALSE if some are missing)
+  BOOL LoadFromPersistentCache( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iFirstMip, INDEX iLastMip);
+  // save static mip-maps to persistent cache
+  void StoreToPersistentCache( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iFirstMip, INDEX iLastMip);
 
   // calculate the rectangle where a light influences the shadow map
   void FindLightRectangle(CLightSource &ls, class CLightRectangle &lr);
@@ -537,6 +586,7 @@ public:
   INDEX bsc_ispo0;   // screen polygons used in rendering
   INDEX bsc_ctspo;
   INDEX bsc_ivvx0;   // view vertices used in rendering
+  class CSectorNearIndex *bsc_psniNearIndex;  // spatial index of polygons for near polygon search (NULL if not made)
 
   /* Default constructor. */
   CBrushSector(void);
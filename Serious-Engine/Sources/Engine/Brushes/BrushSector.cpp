@@ -57,11 +57,16 @@ CBrushSector::CBrushSector(void)
 , bsc_ulVisFlags(0)
 , bsc_strName("")
 , bsc_bspBSPTree(*new DOUBLEbsptree3D)
+, bsc_psniNearIndex(NULL)
 {
 
 };
+// free the near polygon index of a sector (in NearestPolygon.cpp)
+extern void DiscardNearIndex(CBrushSector *pbsc);
+
 CBrushSector::~CBrushSector(void)
 {
+  DiscardNearIndex(this);
   delete &bsc_bspBSPTree;
 }
 
@@ -73,6 +78,9 @@ void CBrushSector::CalculateBoundingBoxes(CSimpleProjection3D_DOUBLE &prRelative
   // assure that floating point precision is 53 bits
   AssureFPT_53();
 
+  // polygons are moving, near polygon index must be remade
+  DiscardNearIndex(this);
+
   // discard portal-sector links to this sector
   extern BOOL _bDontDiscardLinks;
   if (!(bsc_ulTempFlags&BSCTF_PRELOADEDLINKS) && !_bDontDiscardLinks) {
@@ -273,6 +281,7 @@ void CBrushSector::Clear(void)
   bsc_rdOtherSidePortals.Clear();
   bsc_rsEntities.Clear();
   bsc_strName.Clear();
+  DiscardNearIndex(this);
 //  bsc_bspBSPTree.Destroy();
 }
 
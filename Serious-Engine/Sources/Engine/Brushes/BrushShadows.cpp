@@ -48,6 +48,8 @@ CBrushShadowLayer::CBrushShadowLayer()
   bsl_slSizeInPixels = 0;
   bsl_pubLayer = NULL;
   bsl_colLastAnim = C_BLACK;
+  bsl_pubMaskCRC = NULL;
+  bsl_ulMaskCRC = 0;
 }
 
 // destructor
@@ -67,6 +69,8 @@ void CBrushShadowLayer::DiscardShadows(void)
     bsl_pubLayer = NULL;
     bsl_slSizeInPixels = 0;
   }
+  // memory might be reused for another mask
+  bsl_pubMaskCRC = NULL;
   bsl_ulFlags&=~(BSLF_CALCULATED|BSLF_ALLDARK|BSLF_ALLLIGHT);
 }
 
@@ -408,6 +412,8 @@ CBrushShadowMap::CBrushShadowMap(void)
 // discard all layers on this shadow map
 void CBrushShadowMap::DiscardAllLayers(void)
 {
+  // layers must not be mixed in background while they change
+  FinishBackgroundCache(TRUE);
   // for each shadow layer
   FORDELETELIST(CBrushShadowLayer, bsl_lnInShadowMap, bsm_lhLayers, itbsl) {
     // delete it
@@ -421,6 +427,8 @@ void CBrushShadowMap::DiscardAllLayers(void)
 // discard shadows on all layers on this shadow map
 void CBrushShadowMap::DiscardShadows(void)
 {
+  // layers must not be mixed in background while they change
+  FinishBackgroundCache(TRUE);
   // for each shadow layer
   FORDELETELIST(CBrushShadowLayer, bsl_lnInShadowMap, bsm_lhLayers, itbsl) {
     // discard shadows on it
@@ -432,6 +440,8 @@ void CBrushShadowMap::DiscardShadows(void)
 // remove shadow layers without valid light source
 void CBrushShadowMap::RemoveDummyLayers(void)
 {
+  // layers must not be mixed in background while they change
+  FinishBackgroundCache(TRUE);
   // for each shadow layer
   FORDELETELIST(CBrushShadowLayer, bsl_lnInShadowMap, bsm_lhLayers, itbsl) {
     // if dummy
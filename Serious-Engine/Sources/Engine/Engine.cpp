@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Base/CRC.h>
 #include <Engine/Base/CRCTable.h>
 #include <Engine/Base/ProgressHook.h>
+#include <Engine/Base/WorkerPool.h>
 #include <Engine/Sound/SoundListener.h>
 #include <Engine/Sound/SoundLibrary.h>
 #include <Engine/Graphics/GfxLibrary.h>
@@ -266,6 +267,7 @@ ENGINE_API void SE_InitEngine(CTString strGameID)
   _pShaderStock      = new CStock_CShader;
 
   _pTimer = new CTimer;
+  _pWorkerPool = new CWorkerPool;
   _pGfx   = new CGfxLibrary;
   _pSound = new CSoundLibrary;
   _pInput = new CInput;
@@ -375,10 +377,30 @@ ENGINE_API void SE_InitEngine(CTString strGameID)
   // add console variables
   extern INDEX con_bNoWarnings;
   extern INDEX wld_bFastObjectOptimization;
+  extern INDEX wld_bCookedBrushes;
   extern INDEX fil_bPreferZips;
   extern FLOAT mth_fCSGEpsilon;
   _pShell->DeclareSymbol("user INDEX con_bNoWarnings;", &con_bNoWarnings);
   _pShell->DeclareSymbol("user INDEX wld_bFastObjectOptimization;", &wld_bFastObjectOptimization);
+  _pShell->DeclareSymbol("persistent user INDEX wld_bCookedBrushes;", &wld_bCookedBrushes);
+  extern INDEX ent_bPooledEvents;
+  extern void EventQueueBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user INDEX ent_bPooledEvents;", &ent_bPooledEvents);
+  _pShell->DeclareSymbol("user void EventQueueBenchmark(INDEX);", (void*) &EventQueueBenchmark);
+  extern void EntityRemapBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user void EntityRemapBenchmark(INDEX);", (void*) &EntityRemapBenchmark);
+  extern INDEX ent_bNearPolygonIndex;
+  extern INDEX ent_bFieldTouchGrid;
+  extern void NearestPolygonBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user INDEX ent_bNearPolygonIndex;", &ent_bNearPolygonIndex);
+  _pShell->DeclareSymbol("user INDEX ent_bFieldTouchGrid;", &ent_bFieldTouchGrid);
+  _pShell->DeclareSymbol("user void NearestPolygonBenchmark(INDEX);", (void*) &NearestPolygonBenchmark);
+  extern INDEX ent_bPackedProperties;
+  extern void PropertySerializationBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user INDEX ent_bPackedProperties;", &ent_bPackedProperties);
+  _pShell->DeclareSymbol("user void PropertySerializationBenchmark(INDEX);", (void*) &PropertySerializationBenchmark);
+  extern void WorldLoadBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user void WorldLoadBenchmark(CTString);", (void*) &WorldLoadBenchmark);
   _pShell->DeclareSymbol("user FLOAT mth_fCSGEpsilon;", &mth_fCSGEpsilon);
   _pShell->DeclareSymbol("persistent user INDEX fil_bPreferZips;", &fil_bPreferZips);
   // OS info
@@ -406,6 +428,8 @@ ENGINE_API void SE_InitEngine(CTString strGameID)
   // MOD info
   _pShell->DeclareSymbol("user const CTString sys_strModName;", &sys_strModName);
   _pShell->DeclareSymbol("user const CTString sys_strModExt;",  &sys_strModExt);
+  // worker threads
+  _pShell->DeclareSymbol("persistent user INDEX sys_iWorkerThreads;", &sys_iWorkerThreads);
 
   // Stock clearing
   extern void FreeUnusedStock(void);
@@ -413,6 +437,23 @@ ENGINE_API void SE_InitEngine(CTString strGameID)
   
   // Timer tick quantum
   _pShell->DeclareSymbol("user const FLOAT fTickQuantum;", (FLOAT*)&_pTimer->TickQuantum);
+  // timer tick source and statistics
+  extern INDEX tim_iTickSource;
+  extern INDEX tim_iMaxCatchUpTicks;
+  extern FLOAT tim_fTickJitter;
+  extern FLOAT tim_fTickJitterMax;
+  extern INDEX tim_ctLateTicks;
+  extern INDEX tim_ctDroppedTicks;
+  extern void AdvanceVirtualClock(void *pArgs);
+  extern void TimerTickBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user INDEX tim_iTickSource;",      &tim_iTickSource);
+  _pShell->DeclareSymbol("user INDEX tim_iMaxCatchUpTicks;", &tim_iMaxCatchUpTicks);
+  _pShell->DeclareSymbol("user const FLOAT tim_fTickJitter;",    &tim_fTickJitter);
+  _pShell->DeclareSymbol("user const FLOAT tim_fTickJitterMax;", &tim_fTickJitterMax);
+  _pShell->DeclareSymbol("user const INDEX tim_ctLateTicks;",    &tim_ctLateTicks);
+  _pShell->DeclareSymbol("user const INDEX tim_ctDroppedTicks;", &tim_ctDroppedTicks);
+  _pShell->DeclareSymbol("user void AdvanceVirtualClock(INDEX);", (void*) &AdvanceVirtualClock);
+  _pShell->DeclareSymbol("user void TimerTickBenchmark(INDEX);",  (void*) &TimerTickBenchmark);
 
   // init MODs and stuff ...
   extern void InitStreams(void);
@@ -516,6 +557,9 @@ ENGINE_API void SE_EndEngine(void)
 //    ReleaseDC( NULL, hdc);
   }
 
+  // stop worker threads before anything they might be using is freed
+  delete _pWorkerPool;  _pWorkerPool = NULL;
+
   // free stocks
   delete _pEntityClassStock;  _pEntityClassStock = NULL;
   delete _pModelStock;        _pModelStock       = NULL; 
@@ -57,6 +57,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Base/Stream.h>
 #include <Engine/Base/Lists.h>
 #include <Engine/Base/Timer.h>
+#include <Engine/Base/WorkerPool.h>
 #include <Engine/Base/ListIterator.inl>
 #include <Engine/Base/Console.h>
 #include <Engine/Base/Console_internal.h>
@@ -32,6 +32,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <Engine/Base/CRC.h>
 #include <Engine/Base/Console.h>
+#include <Engine/Base/Shell.h>
 #include <Engine/Base/Statistics_Internal.h>
 #include <Engine/Network/Network.h>
 #include <Engine/Network/PlayerTarget.h>
@@ -2030,17 +2031,172 @@ class CSentEvent {
 public:
   CEntityPointer se_penEntity;
   CEntityEvent *se_peeEvent;
+  BOOL se_bPooled;    // event lives in the event pool, not on heap
   inline void Clear(void) { se_penEntity = NULL; }
 };
 
-static CStaticStackArray<CSentEvent> _aseSentEvents;  // delayed events
+// use pooled memory for sent events
+INDEX ent_bPooledEvents = TRUE;
+
+#define EVENTPOOL_BLOCKSIZE (64*1024)
+
+/*
+ * Memory for events waiting for delivery. Events are constructed in blocks one after
+ * another, and all are released at once when sent events are handled. Blocks are kept
+ * for next ticks and never move, so events can be sent while others are being handled.
+ */
+class CSentEventPool {
+public:
+  CStaticStackArray<UBYTE *> sep_apubBlocks;
+  INDEX sep_iBlock;     // block that is being filled
+  SLONG sep_slUsed;     // bytes used in that block
+
+  CSentEventPool(void) : sep_iBlock(0), sep_slUsed(0) {};
+  ~CSentEventPool(void) {
+    for (INDEX i=0; i<sep_apubBlocks.Count(); i++) {
+      FreeMemoryAligned(sep_apubBlocks[i]);
+    }
+  }
+  // get memory for an event (NULL if event is too big)
+  void *Allocate(SLONG slSize) {
+    slSize = (slSize+15)&~15;
+    if (slSize>EVENTPOOL_BLOCKSIZE) {
+      return NULL;
+    }
+    // if it doesn't fit in current block, go to next one
+    if (sep_slUsed+slSize>EVENTPOOL_BLOCKSIZE) {
+      sep_iBlock++;
+      sep_slUsed = 0;
+    }
+    if (sep_iBlock>=sep_apubBlocks.Count()) {
+      sep_apubBlocks.Push() = (UBYTE *)AllocMemoryAligned(EVENTPOOL_BLOCKSIZE, 16);
+      _pfPhysicsProfile.IncrementCounter(CPhysicsProfile::PCI_EVENTPOOLBLOCKS);
+    }
+    void *pv = sep_apubBlocks[sep_iBlock]+sep_slUsed;
+    sep_slUsed += slSize;
+    return pv;
+  }
+  // release all events at once
+  void Reset(void) {
+    sep_iBlock = 0;
+    sep_slUsed = 0;
+  }
+};
+
+/*
+ * Queue of events waiting for delivery, in order in which they were sent.
+ */
+class CSentEventQueue {
+public:
+  CStaticStackArray<CSentEvent> seq_aseEvents;
+  CSentEventPool seq_sepPool;
+
+  // add a copy of the event to the end of the queue
+  inline void Add(CEntity *pen, const CEntityEvent &ee, BOOL bPooled) {
+    CSentEvent &se = seq_aseEvents.Push();
+    se.se_penEntity = pen;
+    CEntityEvent &eeSrc = (CEntityEvent&)ee;  // discard const qualifier
+    // if possible, construct the copy in pool
+    void *pvPooled = NULL;
+    if (bPooled) {
+      const SLONG slSize = eeSrc.GetSizeOf();
+      if (slSize>0) {
+        pvPooled = seq_sepPool.Allocate(slSize);
+      }
+    }
+    if (pvPooled!=NULL) {
+      se.se_peeEvent = eeSrc.MakeCopyInPlace(pvPooled);
+      se.se_bPooled = TRUE;
+      _pfPhysicsProfile.IncrementCounter(CPhysicsProfile::PCI_EVENTSPOOLED);
+    } else {
+      se.se_peeEvent = eeSrc.MakeCopy();
+      se.se_bPooled = FALSE;
+      _pfPhysicsProfile.IncrementCounter(CPhysicsProfile::PCI_EVENTHEAPCOPIES);
+    }
+  }
+  // destroy all events and release their memory
+  void Clear(void) {
+    for(INDEX iee=0; iee<seq_aseEvents.Count(); iee++) {
+      CSentEvent &se = seq_aseEvents[iee];
+      // release the entity and destroy the event
+      se.se_penEntity = NULL;
+      if (se.se_bPooled) {
+        se.se_peeEvent->~CEntityEvent();
+      } else {
+        delete se.se_peeEvent;
+      }
+      se.se_peeEvent = NULL;
+    }
+    // flush all events
+    seq_aseEvents.PopAll();
+    seq_sepPool.Reset();
+  }
+};
+
+static CSentEventQueue _seqSentEvents;  // delayed events
 /* Send an event to this entity. */
 void CEntity::SendEvent(const CEntityEvent &ee)
 {
   ASSERT(this!=NULL);
-  CSentEvent &se = _aseSentEvents.Push();
-  se.se_penEntity = this;
-  se.se_peeEvent = ((CEntityEvent&)ee).MakeCopy();  // discard const qualifier
+  _seqSentEvents.Add(this, ee, ent_bPooledEvents);
+}
+
+// events similar to damage and timer events, for the benchmark
+class CBenchDamageEvent : public CEntityEvent {
+public:
+  CEntityPointer penInflictor;
+  FLOAT3D vDirection;
+  FLOAT3D vHitPoint;
+  FLOAT fAmount;
+  INDEX dmtType;
+  CBenchDamageEvent(void) : CEntityEvent(0x7FFF0001), vDirection(0,0,1), vHitPoint(0,0,0), fAmount(10), dmtType(0) {};
+  CEntityEvent *MakeCopy(void) { return new CBenchDamageEvent(*this); };
+  SLONG GetSizeOf(void) { return sizeof(CBenchDamageEvent); };
+  CEntityEvent *MakeCopyInPlace(void *pvMemory) { return new(pvMemory) CBenchDamageEvent(*this); };
+};
+class CBenchTimerEvent : public CEntityEvent {
+public:
+  CBenchTimerEvent(void) : CEntityEvent(0x7FFF0002) {};
+  CEntityEvent *MakeCopy(void) { return new CBenchTimerEvent(*this); };
+  SLONG GetSizeOf(void) { return sizeof(CBenchTimerEvent); };
+  CEntityEvent *MakeCopyInPlace(void *pvMemory) { return new(pvMemory) CBenchTimerEvent(*this); };
+};
+
+// time sending and releasing of events in ticks of a heavy fight, with and without pool
+void EventQueueBenchmark(void *pArgs)
+{
+  INDEX ctEvents = NEXTARGUMENT(INDEX);
+  if (ctEvents<=0) ctEvents = 5000;
+  const INDEX ctTicks = 100;
+
+  CBenchDamageEvent eDamage;
+  CBenchTimerEvent  eTimer;
+  CPrintF(TRANS("Sending %d events per tick for %d ticks...\n"), ctEvents, ctTicks);
+
+  for (INDEX iPooled=0; iPooled<2; iPooled++) {
+    CSentEventQueue seq;
+    // count allocations done by the queue itself: heap copies of events and new pool blocks
+    const INDEX ctHeapCopiesBefore = _pfPhysicsProfile.GetCounterCount(CPhysicsProfile::PCI_EVENTHEAPCOPIES);
+    const INDEX ctPoolBlocksBefore = _pfPhysicsProfile.GetCounterCount(CPhysicsProfile::PCI_EVENTPOOLBLOCKS);
+    CTimerValue tvStart = _pTimer->GetHighPrecisionTimer();
+    for (INDEX iTick=0; iTick<ctTicks; iTick++) {
+      for (INDEX iEvent=0; iEvent<ctEvents; iEvent++) {
+        // mostly damage, with some touches and timers in between
+        if (iEvent%4==3) {
+          seq.Add(NULL, eTimer, iPooled);
+        } else {
+          seq.Add(NULL, eDamage, iPooled);
+        }
+      }
+      seq.Clear();
+    }
+    const DOUBLE dTime = (_pTimer->GetHighPrecisionTimer()-tvStart).GetSeconds();
+    const INDEX ctAllocs =
+      _pfPhysicsProfile.GetCounterCount(CPhysicsProfile::PCI_EVENTHEAPCOPIES)-ctHeapCopiesBefore +
+      _pfPhysicsProfile.GetCounterCount(CPhysicsProfile::PCI_EVENTPOOLBLOCKS)-ctPoolBlocksBefore;
+    CPrintF(TRANS("  %s: %.3f ms per tick, %.1f ns per event, %d allocations\n"),
+      iPooled ? "pooled" : "heap  ", dTime*1000.0/ctTicks, dTime*1E9/(ctTicks*ctEvents), ctAllocs);
+  }
 }
 
 // find entities in a box (box must be around this entity)
@@ -2165,8 +2321,8 @@ void CEntity::HandleSentEvents(void)
 
   // while there are any unhandled events
   INDEX iFirstEvent = 0;
-  while (iFirstEvent<_aseSentEvents.Count()) {
-    CSentEvent &se = _aseSentEvents[iFirstEvent];
+  while (iFirstEvent<_seqSentEvents.seq_aseEvents.Count()) {
+    CSentEvent &se = _seqSentEvents.seq_aseEvents[iFirstEvent];
     // if not allowed to execute now
     if (!se.se_penEntity->IsAllowedForPrediction()) {
       // skip it
@@ -2182,17 +2338,8 @@ void CEntity::HandleSentEvents(void)
     iFirstEvent++;
   }
 
-  // for each event
-  for(INDEX iee=0; iee<_aseSentEvents.Count(); iee++) {
-    CSentEvent &se = _aseSentEvents[iee];
-    // release the entity and destroy the event
-    se.se_penEntity = NULL;
-    delete se.se_peeEvent;
-    se.se_peeEvent = NULL;
-  }
-
-  // flush all events
-  _aseSentEvents.PopAll();
+  // destroy all events and release their memory at once
+  _seqSentEvents.Clear();
 
   _pfPhysicsProfile.StopTimer(CPhysicsProfile::PTI_HANDLESENTEVENTS);
 }
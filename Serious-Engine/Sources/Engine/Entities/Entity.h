@@ -233,6 +233,9 @@ public:
   void ReadProperties_t(CTStream &istrm);  // throw char *
   /* Write all properties to a stream. */
   void WriteProperties_t(CTStream &ostrm); // throw char *
+  /* Read/write value of one property (without its identifier). */
+  void ReadPropertyValue_t(CTStream &istrm, ULONG ulType, SLONG slOffset);  // throw char *
+  void WritePropertyValue_t(CTStream &ostrm, ULONG ulType, SLONG slOffset); // throw char *
   /* Copy entity properties from another entity of same class. */
   void CopyEntityProperties(CEntity &enOther, ULONG ulFlags);
 
@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Base/ErrorReporting.h>
 #include <Engine/Entities/Precaching.h>
 #include <Engine/Base/Translation.h>
+#include <Engine/Base/Console.h>
 #include <Engine/Base/CRCTable.h>
 
 #include <Engine/Templates/Stock_CAnimData.h>
@@ -485,6 +486,47 @@ class CEntityProperty *CDLLEntityClass::PropertyForTypeAndID(
   }
 };
 
+/*
+ * Calculate layout ID of properties of this class (without base classes).
+ */
+ULONG CDLLEntityClass::CalculatePropertyLayout(void)
+{
+  // same as calculated by Ecc for packed functions
+  ULONG ulLayout = ((2166136261UL^ENTITYPROPERTIES_LAYOUTVERSION)*16777619UL)&0xFFFFFFFFUL;
+  // for each property
+  for (INDEX iProperty=0; iProperty<dec_ctProperties; iProperty++) {
+    CEntityProperty &ep = dec_aepProperties[iProperty];
+    ulLayout = ((ulLayout^(ep.ep_ulID&0xFFFFFFFFUL))*16777619UL)&0xFFFFFFFFUL;
+    ulLayout = ((ulLayout^(ULONG)ep.ep_eptType)*16777619UL)&0xFFFFFFFFUL;
+  }
+  return ulLayout;
+}
+
+/*
+ * Check if packed functions can be used for this class and all its base classes.
+ */
+BOOL CDLLEntityClass::HasPackedProperties(void)
+{
+  // if not checked yet
+  if (dec_iPackedValid==0) {
+    // base classes in engine have no properties, so they need no functions
+    if (dec_WritePacked_t==NULL || dec_ReadPacked_t==NULL) {
+      dec_iPackedValid = (dec_ctProperties==0) ? +1 : -1;
+    // functions generated for a different property table must not be used
+    } else {
+      dec_iPackedValid = (dec_ulPackedLayout==CalculatePropertyLayout()) ? +1 : -1;
+    }
+    if (dec_iPackedValid<0) {
+      CPrintF(TRANS("Entity class '%s' properties use generic serialization (layout mismatch)\n"), dec_strName);
+    }
+  }
+  if (dec_iPackedValid<0) {
+    return FALSE;
+  }
+  // all base classes must be able to do it too
+  return dec_pdecBase==NULL || dec_pdecBase->HasPackedProperties();
+}
+
 /*
  * Get pointer to component from its identifier.
  */
@@ -22,6 +22,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Base/Translation.h>
 #include <Engine/Base/Timer.h>
 #include <Engine/Base/Console.h>
+#include <Engine/Base/Shell.h>
+#include <Engine/Base/Memory.h>
 
 #include <Engine/Base/ListIterator.inl>
 #include <Engine/Base/ErrorReporting.h>
@@ -49,6 +51,8 @@ public:
 };
 
 static CStaticArray<CPointerRemapping> _aprRemaps;
+static CStaticArray<INDEX> _aiRemapHash;  // open addressing table of indices in remaps (-1 if empty)
+static ULONG _ulRemapHashMask = 0;
 static BOOL _bRemapPointersToNULLs = TRUE;
 BOOL _bReinitEntitiesWhileCopying = TRUE;
 static BOOL _bMirrorAndStretch = FALSE;
@@ -99,6 +103,56 @@ static void MirrorAndStretchPlacement(CPlacement3D &pl)
   pl.pl_PositionVector*=_fStretch;
 }
 
+// get starting slot of an entity pointer in remap hash table
+static inline ULONG RemapHashSlot(const CEntity *pen)
+{
+  // entities are allocated on at least 16 byte boundaries, so low bits carry no information
+  size_t ul = ((size_t)pen)>>4;
+  return ULONG((ul*0x9E3779B1UL) ^ (ul>>15)) & _ulRemapHashMask;
+}
+
+// make hash table for all remaps (must be done before any pointers are remapped)
+static void HashRemaps(void)
+{
+  INDEX ctRemaps = _aprRemaps.Count();
+  // use at most half full table
+  INDEX ctSlots = 16;
+  while (ctSlots<ctRemaps*2) {
+    ctSlots*=2;
+  }
+  _aiRemapHash.Clear();
+  _aiRemapHash.New(ctSlots);
+  _ulRemapHashMask = ctSlots-1;
+  for (INDEX iSlot=0; iSlot<ctSlots; iSlot++) {
+    _aiRemapHash[iSlot] = -1;
+  }
+
+  // for each remap
+  for (INDEX iRemap=0; iRemap<ctRemaps; iRemap++) {
+    CEntity *penOriginal = _aprRemaps[iRemap].pr_penOriginal;
+    // find first free slot, or the same original
+    ULONG ulSlot = RemapHashSlot(penOriginal);
+    while (_aiRemapHash[ulSlot]>=0) {
+      // if already there, keep the first one (same as linear search would find)
+      if (_aprRemaps[_aiRemapHash[ulSlot]].pr_penOriginal==penOriginal) {
+        break;
+      }
+      ulSlot = (ulSlot+1)&_ulRemapHashMask;
+    }
+    if (_aiRemapHash[ulSlot]<0) {
+      _aiRemapHash[ulSlot] = iRemap;
+    }
+  }
+}
+
+// clear all remaps so that nobody reuses them accidentally
+static void ClearRemaps(void)
+{
+  _aprRemaps.Clear();
+  _aiRemapHash.Clear();
+  _ulRemapHashMask = 0;
+}
+
 CEntity *CEntity::FindRemappedEntityPointer(CEntity *penOriginal)
 {
   // if original is null
@@ -108,11 +162,17 @@ CEntity *CEntity::FindRemappedEntityPointer(CEntity *penOriginal)
   }
 
   // try to find valid remap
-  {FOREACHINSTATICARRAY(_aprRemaps, CPointerRemapping, itpr) {
-    if (itpr->pr_penOriginal==penOriginal) {
-      return itpr->pr_penCopy;
+  if (_aprRemaps.Count()>0) {
+    ASSERT(_aiRemapHash.Count()>0);
+    ULONG ulSlot = RemapHashSlot(penOriginal);
+    INDEX iRemap;
+    while ((iRemap=_aiRemapHash[ulSlot])>=0) {
+      if (_aprRemaps[iRemap].pr_penOriginal==penOriginal) {
+        return _aprRemaps[iRemap].pr_penCopy;
+      }
+      ulSlot = (ulSlot+1)&_ulRemapHashMask;
     }
-  }}
+  }
   // if none found, copy is either null or original
   return _bRemapPointersToNULLs?NULL:penOriginal;
 }
@@ -386,7 +446,7 @@ void CWorld::CopyEntities(CWorld &woOther, CDynamicContainer<CEntity> &cenToCopy
   };
 
   // create array of pointer remaps
-  _aprRemaps.Clear();
+  ClearRemaps();
   _aprRemaps.New(ctEntities);
 
 
@@ -429,6 +489,9 @@ void CWorld::CopyEntities(CWorld &woOther, CDynamicContainer<CEntity> &cenToCopy
     iRemap++;
   }}
 
+  // all remaps are known now, make them fast to find
+  HashRemaps();
+
   // PASS 2: copy properties
 
   // for each of the created entities
@@ -494,7 +557,7 @@ void CWorld::CopyEntities(CWorld &woOther, CDynamicContainer<CEntity> &cenToCopy
   }}
 
   // make sure someone doesn't reuse the remap array accidentially
-  _aprRemaps.Clear();
+  ClearRemaps();
 }
 
 /* Copy one entity from another world into this one. */
@@ -648,7 +711,7 @@ void CWorld::CopyEntitiesToPredictors(CDynamicContainer<CEntity> &cenToCopy)
   ULONG ulCopyFlags = COPY_REMAP|COPY_PREDICTOR;
 
   // create array of pointer remaps
-  _aprRemaps.Clear();
+  ClearRemaps();
   _aprRemaps.New(ctEntities);
 
   // PASS 1: create entities
@@ -672,6 +735,9 @@ void CWorld::CopyEntitiesToPredictors(CDynamicContainer<CEntity> &cenToCopy)
   // unfound pointers must be kept unremapped
   _bRemapPointersToNULLs = FALSE;
 
+  // all remaps are known now, make them fast to find
+  HashRemaps();
+
   // PASS 2: copy properties
 
   // for each of the created entities
@@ -739,10 +805,70 @@ void CWorld::CopyEntitiesToPredictors(CDynamicContainer<CEntity> &cenToCopy)
   }}
 
   // make sure someone doesn't reuse the remap array accidentially
-  _aprRemaps.Clear();
+  ClearRemaps();
 
   _bRemapPointersToNULLs = TRUE;
 
   // return current tick
   _pTimer->SetCurrentTick(tmCurrentTickOld);
 }
+
+// remap pointers of densely cross-referenced entities, with linear search and with hash table
+void EntityRemapBenchmark(void *pArgs)
+{
+  INDEX ctEntities = NEXTARGUMENT(INDEX);
+  if (ctEntities<=0) ctEntities = 1000;
+  const INDEX ctReferences = 8;   // pointer properties per entity
+  const INDEX iStride = 64;       // fake entity size (entities are never touched)
+
+  // make fake originals and copies
+  UBYTE *pubEntities = (UBYTE*)AllocMemory(ctEntities*2*iStride);
+  ClearRemaps();
+  _aprRemaps.New(ctEntities);
+  for (INDEX iEntity=0; iEntity<ctEntities; iEntity++) {
+    _aprRemaps[iEntity].pr_penOriginal = (CEntity*)(pubEntities+iEntity*iStride);
+    _aprRemaps[iEntity].pr_penCopy = (CEntity*)(pubEntities+(ctEntities+iEntity)*iStride);
+  }
+  // each entity points to some random others, and some that are not copied
+  CStaticArray<CEntity*> apenReferences;
+  apenReferences.New(ctEntities*ctReferences);
+  ULONG ulSeed = 0x12345678;
+  for (INDEX iRef=0; iRef<apenReferences.Count(); iRef++) {
+    ulSeed = ulSeed*1103515245+12345;
+    INDEX iTarget = (ulSeed>>8)%ctEntities;
+    apenReferences[iRef] = (iRef%ctReferences==ctReferences-1) ? NULL : _aprRemaps[iTarget].pr_penOriginal;
+  }
+  CPrintF(TRANS("Remapping %d pointers of %d entities...\n"), apenReferences.Count(), ctEntities);
+
+  // linear search (how all pointers were remapped before)
+  CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+  ULONG ulLinear = 0;
+  for (INDEX iRef=0; iRef<apenReferences.Count(); iRef++) {
+    CEntity *penOriginal = apenReferences[iRef];
+    CEntity *penCopy = NULL;
+    for (INDEX iRemap=0; penOriginal!=NULL && iRemap<ctEntities; iRemap++) {
+      if (_aprRemaps[iRemap].pr_penOriginal==penOriginal) {
+        penCopy = _aprRemaps[iRemap].pr_penCopy;
+        break;
+      }
+    }
+    ulLinear += (ULONG)(size_t)penCopy;
+  }
+  // hash table (including building it)
+  CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+  HashRemaps();
+  ULONG ulHashed = 0;
+  for (INDEX iRef=0; iRef<apenReferences.Count(); iRef++) {
+    ulHashed += (ULONG)(size_t)CEntity::FindRemappedEntityPointer(apenReferences[iRef]);
+  }
+  CTimerValue tv2 = _pTimer->GetHighPrecisionTimer();
+
+  CPrintF(TRANS("  linear: %.3f ms\n"), (tv1-tv0).GetSeconds()*1000);
+  CPrintF(TRANS("  hashed: %.3f ms (%d slots)\n"), (tv2-tv1).GetSeconds()*1000, _aiRemapHash.Count());
+  if (ulLinear!=ulHashed) {
+    CPrintF(TRANS("  ERROR: remapped pointers differ!\n"));
+  }
+
+  ClearRemaps();
+  FreeMemory(pubEntities);
+}
@@ -19,6 +19,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
   #pragma once
 #endif
 
+#include <new>
+
 // a BOOL that is constructed with value of FALSE (used in some entity initializations)
 class ENGINE_API CBoolDefaultFalse {
 public:
@@ -41,6 +43,13 @@ public:
     CEntityEvent *peeCopy = new CEntityEvent(*this);
     return peeCopy;
   };
+  // size of the event object, for copying into pooled memory (0 if it can only be copied on heap)
+  virtual SLONG GetSizeOf(void) { return 0; };
+  // copy-construct the event in given memory (at least GetSizeOf() bytes)
+  virtual CEntityEvent *MakeCopyInPlace(void *pvMemory) {
+    ASSERTALWAYS("Event cannot be copied in place!");
+    return NULL;
+  };
 };
 // a reference to a void event for use as default parameter
 ENGINE_API extern const CEntityEvent &_eeVoid;
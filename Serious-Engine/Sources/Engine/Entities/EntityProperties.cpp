@@ -20,9 +20,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Base/Stream.h>
 #include <Engine/Base/CRCTable.h>
 #include <Engine/Base/Console.h>
+#include <Engine/Base/Shell.h>
+#include <Engine/Base/Timer.h>
+#include <Engine/Base/Translation.h>
 #include <Engine/World/World.h>
 #include <Engine/Base/ReplaceFile.h>
 #include <Engine/Sound/SoundObject.h>
+#include <Engine/Sound/SoundLibrary.h>
+#include <Engine/Base/Synchronization.h>
 #include <Engine/Math/Quaternion.h>
 
 #include <Engine/Templates/Stock_CAnimData.h>
@@ -38,6 +43,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define PROPERTY(offset, type) ENTITYPROPERTY(this, offset, type)
 
+// use functions generated by Ecc for writing/reading properties when possible
+INDEX ent_bPackedProperties = TRUE;
+
 /////////////////////////////////////////////////////////////////////
 // Property management functions
 
@@ -91,6 +99,264 @@ void CEntity::WriteEntityPointer_t(CTStream *ostrm, CEntityPointer pen)
   }
 }
 
+/*
+ * Read value of one property from a stream.
+ */
+void CEntity::ReadPropertyValue_t(CTStream &istrm, ULONG ulType, SLONG slOffset) // throw char *
+{
+  // depending on the property type
+  switch (ulType) {
+  // if it is BOOL
+  case CEntityProperty::EPT_BOOL:
+    // read BOOL
+    istrm>>(INDEX &)PROPERTY(slOffset, BOOL);
+    break;
+  // if it is INDEX
+  case CEntityProperty::EPT_INDEX:
+  case CEntityProperty::EPT_ENUM:
+  case CEntityProperty::EPT_FLAGS:
+  case CEntityProperty::EPT_ANIMATION:
+  case CEntityProperty::EPT_ILLUMINATIONTYPE:
+  case CEntityProperty::EPT_COLOR:
+  case CEntityProperty::EPT_ANGLE:
+    // read INDEX
+    istrm>>PROPERTY(slOffset, INDEX);
+    break;
+  // if it is FLOAT
+  case CEntityProperty::EPT_FLOAT:
+  case CEntityProperty::EPT_RANGE:
+    // read FLOAT
+    istrm>>PROPERTY(slOffset, FLOAT);
+    break;
+  // if it is STRING
+  case CEntityProperty::EPT_STRING:
+    // read STRING
+    istrm>>PROPERTY(slOffset, CTString);
+    break;
+  // if it is STRINGTRANS
+  case CEntityProperty::EPT_STRINGTRANS:
+    // read STRINGTRANS
+    istrm.ExpectID_t("DTRS");
+    istrm>>PROPERTY(slOffset, CTString);
+    break;
+  // if it is FILENAME
+  case CEntityProperty::EPT_FILENAME:
+    // read FILENAME
+    istrm>>PROPERTY(slOffset, CTFileName);
+    if (PROPERTY(slOffset, CTFileName)=="") {
+      break;
+    }
+    // try to replace file name if it doesn't exist
+    for(;;)
+    {
+      if( !FileExists( PROPERTY(slOffset, CTFileName)))
+      {
+        // if file was not found, ask for replacing file
+        CTFileName fnReplacingFile;
+        if( GetReplacingFile( PROPERTY(slOffset, CTFileName),
+                              fnReplacingFile, FILTER_ALL FILTER_END))
+        {
+          // replacing file was provided
+          PROPERTY(slOffset, CTFileName) = fnReplacingFile;
+        } else {
+          ThrowF_t(TRANS("File '%s' does not exist"), (const char*)PROPERTY(slOffset, CTFileName));
+        }
+      }
+      else
+      {
+        break;
+      }
+    }
+    break;
+  // if it is FILENAMENODEP
+  case CEntityProperty::EPT_FILENAMENODEP:
+    // read FILENAMENODEP
+    istrm>>PROPERTY(slOffset, CTFileNameNoDep);
+    break;
+  // if it is ENTITYPTR
+  case CEntityProperty::EPT_ENTITYPTR:
+    // read the entity pointer
+    ReadEntityPointer_t(&istrm, PROPERTY(slOffset, CEntityPointer));
+    break;
+  // if it is FLOATAABBOX3D
+  case CEntityProperty::EPT_FLOATAABBOX3D:
+    // read FLOATAABBOX3D
+    istrm.Read_t(&PROPERTY(slOffset, FLOATaabbox3D), sizeof(FLOATaabbox3D));
+    break;
+  // if it is FLOATMATRIX3D
+  case CEntityProperty::EPT_FLOATMATRIX3D:
+    // read FLOATMATRIX3D
+    istrm.Read_t(&PROPERTY(slOffset, FLOATmatrix3D), sizeof(FLOATmatrix3D));
+    break;
+  // if it is FLOATQUAT3D
+  case CEntityProperty::EPT_FLOATQUAT3D:
+    // read FLOATQUAT3D
+    istrm.Read_t(&PROPERTY(slOffset, FLOATquat3D), sizeof(FLOATquat3D));
+    break;
+  // if it is FLOAT3D
+  case CEntityProperty::EPT_FLOAT3D:
+    // read FLOAT3D
+    istrm.Read_t(&PROPERTY(slOffset, FLOAT3D), sizeof(FLOAT3D));
+    break;
+  // if it is ANGLE3D
+  case CEntityProperty::EPT_ANGLE3D:
+    // read ANGLE3D
+    istrm.Read_t(&PROPERTY(slOffset, ANGLE3D), sizeof(ANGLE3D));
+    break;
+  // if it is FLOATplane3D
+  case CEntityProperty::EPT_FLOATplane3D:
+    // read FLOATplane3D
+    istrm.Read_t(&PROPERTY(slOffset, FLOATplane3D), sizeof(FLOATplane3D));
+    break;
+  // if it is MODELOBJECT
+  case CEntityProperty::EPT_MODELOBJECT:
+    // read CModelObject
+    ReadModelObject_t(istrm, PROPERTY(slOffset, CModelObject));
+    break;
+  // if it is MODELINSTANCE
+  case CEntityProperty::EPT_MODELINSTANCE:
+    // read CModelObject
+    ReadModelInstance_t(istrm, PROPERTY(slOffset, CModelInstance));
+    break;
+  // if it is ANIMOBJECT
+  case CEntityProperty::EPT_ANIMOBJECT:
+    // read CAnimObject
+    ReadAnimObject_t(istrm, PROPERTY(slOffset, CAnimObject));
+    break;
+  // if it is SOUNDOBJECT
+  case CEntityProperty::EPT_SOUNDOBJECT:
+    // read CSoundObject
+    {
+      CSoundObject &so = PROPERTY(slOffset, CSoundObject);
+      ReadSoundObject_t(istrm, so);
+      so.so_penEntity = this;
+    }
+    break;
+  // if it is CPlacement3D
+  case CEntityProperty::EPT_PLACEMENT3D:
+    // read CPlacement3D
+    istrm.Read_t(&PROPERTY(slOffset, CPlacement3D), sizeof(CPlacement3D));
+    break;
+  default:
+    ASSERTALWAYS("Unknown property type");
+  }
+}
+
+/*
+ * Write value of one property to a stream.
+ */
+void CEntity::WritePropertyValue_t(CTStream &ostrm, ULONG ulType, SLONG slOffset) // throw char *
+{
+  // depending on the property type
+  switch (ulType) {
+  // if it is BOOL
+  case CEntityProperty::EPT_BOOL:
+    // write BOOL
+    ostrm<<(INDEX &)PROPERTY(slOffset, BOOL);
+    break;
+  // if it is INDEX
+  case CEntityProperty::EPT_INDEX:
+  case CEntityProperty::EPT_ENUM:
+  case CEntityProperty::EPT_FLAGS:
+  case CEntityProperty::EPT_ANIMATION:
+  case CEntityProperty::EPT_ILLUMINATIONTYPE:
+  case CEntityProperty::EPT_COLOR:
+  case CEntityProperty::EPT_ANGLE:
+    // write INDEX
+    ostrm<<PROPERTY(slOffset, INDEX);
+    break;
+  // if it is FLOAT
+  case CEntityProperty::EPT_FLOAT:
+  case CEntityProperty::EPT_RANGE:
+    // write FLOAT
+    ostrm<<PROPERTY(slOffset, FLOAT);
+    break;
+  // if it is STRING
+  case CEntityProperty::EPT_STRING:
+    // write STRING
+    ostrm<<PROPERTY(slOffset, CTString);
+    break;
+  // if it is STRINGTRANS
+  case CEntityProperty::EPT_STRINGTRANS:
+    // write STRINGTRANS
+    ostrm.WriteID_t("DTRS");
+    ostrm<<PROPERTY(slOffset, CTString);
+    break;
+  // if it is FILENAME
+  case CEntityProperty::EPT_FILENAME:
+    // write FILENAME
+    ostrm<<PROPERTY(slOffset, CTFileName);
+    break;
+  // if it is FILENAMENODEP
+  case CEntityProperty::EPT_FILENAMENODEP:
+    // write FILENAMENODEP
+    ostrm<<PROPERTY(slOffset, CTFileNameNoDep);
+    break;
+  // if it is FLOATAABBOX3D
+  case CEntityProperty::EPT_FLOATAABBOX3D:
+    // write FLOATAABBOX3D
+    ostrm.Write_t(&PROPERTY(slOffset, FLOATaabbox3D), sizeof(FLOATaabbox3D));
+    break;
+  // if it is FLOATMATRIX3D
+  case CEntityProperty::EPT_FLOATMATRIX3D:
+    // write FLOATMATRIX3D
+    ostrm.Write_t(&PROPERTY(slOffset, FLOATmatrix3D), sizeof(FLOATmatrix3D));
+    break;
+  // if it is FLOATQUAT3D
+  case CEntityProperty::EPT_FLOATQUAT3D:
+    // write FLOATQUAT3D
+    ostrm.Write_t(&PROPERTY(slOffset, FLOATquat3D), sizeof(FLOATquat3D));
+    break;
+  // if it is ANGLE3D
+  case CEntityProperty::EPT_ANGLE3D:
+    // write ANGLE3D
+    ostrm.Write_t(&PROPERTY(slOffset, ANGLE3D), sizeof(ANGLE3D));
+    break;
+  // if it is FLOAT3D
+  case CEntityProperty::EPT_FLOAT3D:
+    // write FLOAT3D
+    ostrm.Write_t(&PROPERTY(slOffset, FLOAT3D), sizeof(FLOAT3D));
+    break;
+  // if it is FLOATplane3D
+  case CEntityProperty::EPT_FLOATplane3D:
+    // write FLOATplane3D
+    ostrm.Write_t(&PROPERTY(slOffset, FLOATplane3D), sizeof(FLOATplane3D));
+    break;
+  // if it is ENTITYPTR
+  case CEntityProperty::EPT_ENTITYPTR:
+    // write entity pointer
+    WriteEntityPointer_t(&ostrm, PROPERTY(slOffset, CEntityPointer));
+    break;
+  // if it is MODELOBJECT
+  case CEntityProperty::EPT_MODELOBJECT:
+    // write CModelObject
+    WriteModelObject_t(ostrm, PROPERTY(slOffset, CModelObject));
+    break;
+  // if it is MODELINSTANCE
+  case CEntityProperty::EPT_MODELINSTANCE:
+    // write CModelInstance
+    WriteModelInstance_t(ostrm, PROPERTY(slOffset, CModelInstance));
+    break;
+  // if it is ANIMOBJECT
+  case CEntityProperty::EPT_ANIMOBJECT:
+    // write CAnimObject
+    WriteAnimObject_t(ostrm, PROPERTY(slOffset, CAnimObject));
+    break;
+  // if it is SOUNDOBJECT
+  case CEntityProperty::EPT_SOUNDOBJECT:
+    // write CSoundObject
+    WriteSoundObject_t(ostrm, PROPERTY(slOffset, CSoundObject));
+    break;
+  // if it is CPlacement3D
+  case CEntityProperty::EPT_PLACEMENT3D:
+    // write CPlacement3D
+    ostrm.Write_t(&PROPERTY(slOffset, CPlacement3D), sizeof(CPlacement3D));
+    break;
+  default:
+    ASSERTALWAYS("Unknown property type");
+  }
+}
+
 /*
  * Read all properties from a stream.
  */
@@ -103,8 +369,19 @@ void CEntity::ReadProperties_t(CTStream &istrm) // throw char *
   // of properties in the class (class might have changed))
   istrm>>ctProperties;
 
-  // for all saved properties
-  for(INDEX iProperty=0; iProperty<ctProperties; iProperty++) {
+  INDEX ctRemaining = ctProperties;
+  // if packed functions can be used
+  if (ent_bPackedProperties && pdecDLLClass->HasPackedProperties()) {
+    // read properties in order in which they are written by this class, while they match
+    for(CDLLEntityClass *pdecRead = pdecDLLClass; pdecRead!=NULL; pdecRead = pdecRead->dec_pdecBase) {
+      if (pdecRead->dec_ReadPacked_t!=NULL && !pdecRead->dec_ReadPacked_t(this, istrm, ctRemaining)) {
+        break;
+      }
+    }
+  }
+
+  // for all saved properties that are left (if class has changed since they were saved)
+  for(INDEX iProperty=ctProperties-ctRemaining; iProperty<ctProperties; iProperty++) {
     // pdecDLLClass->dec_ctProperties;
     // read packed identifier
     ULONG ulIDAndType;
@@ -268,142 +545,8 @@ void CEntity::ReadProperties_t(CTStream &istrm) // throw char *
         eptLoad = CEntityProperty::EPT_STRING;
       }
 
-      // depending on the property type
-      switch (eptLoad) {
-      // if it is BOOL
-      case CEntityProperty::EPT_BOOL:
-        // read BOOL
-        istrm>>(INDEX &)PROPERTY(pepProperty->ep_slOffset, BOOL);
-        break;
-      // if it is INDEX
-      case CEntityProperty::EPT_INDEX:
-      case CEntityProperty::EPT_ENUM:
-      case CEntityProperty::EPT_FLAGS:
-      case CEntityProperty::EPT_ANIMATION:
-      case CEntityProperty::EPT_ILLUMINATIONTYPE:
-      case CEntityProperty::EPT_COLOR:
-      case CEntityProperty::EPT_ANGLE:
-        // read INDEX
-        istrm>>PROPERTY(pepProperty->ep_slOffset, INDEX);
-        break;
-      // if it is FLOAT
-      case CEntityProperty::EPT_FLOAT:
-      case CEntityProperty::EPT_RANGE:
-        // read FLOAT
-        istrm>>PROPERTY(pepProperty->ep_slOffset, FLOAT);
-        break;
-      // if it is STRING
-      case CEntityProperty::EPT_STRING:
-        // read STRING
-        istrm>>PROPERTY(pepProperty->ep_slOffset, CTString);
-        break;
-      // if it is STRINGTRANS
-      case CEntityProperty::EPT_STRINGTRANS:
-        // read STRINGTRANS
-        istrm.ExpectID_t("DTRS");
-        istrm>>PROPERTY(pepProperty->ep_slOffset, CTString);
-        break;
-      // if it is FILENAME
-      case CEntityProperty::EPT_FILENAME:
-        // read FILENAME
-        istrm>>PROPERTY(pepProperty->ep_slOffset, CTFileName);
-        if (PROPERTY(pepProperty->ep_slOffset, CTFileName)=="") {
-          break;
-        }
-        // try to replace file name if it doesn't exist
-        for(;;)
-        {
-          if( !FileExists( PROPERTY(pepProperty->ep_slOffset, CTFileName)))
-          {
-            // if file was not found, ask for replacing file
-            CTFileName fnReplacingFile;
-            if( GetReplacingFile( PROPERTY(pepProperty->ep_slOffset, CTFileName),
-                                  fnReplacingFile, FILTER_ALL FILTER_END))
-            {
-              // replacing file was provided
-              PROPERTY(pepProperty->ep_slOffset, CTFileName) = fnReplacingFile;
-            } else {
-              ThrowF_t(TRANS("File '%s' does not exist"), (const char*)PROPERTY(pepProperty->ep_slOffset, CTFileName));
-            }
-          }
-          else
-          {
-            break;
-          }
-        }
-        break;
-      // if it is FILENAMENODEP
-      case CEntityProperty::EPT_FILENAMENODEP:
-        // read FILENAMENODEP
-        istrm>>PROPERTY(pepProperty->ep_slOffset, CTFileNameNoDep);
-        break;
-      // if it is ENTITYPTR
-      case CEntityProperty::EPT_ENTITYPTR:
-        // read the entity pointer
-        ReadEntityPointer_t(&istrm, PROPERTY(pepProperty->ep_slOffset, CEntityPointer));
-        break;
-      // if it is FLOATAABBOX3D
-      case CEntityProperty::EPT_FLOATAABBOX3D:
-        // read FLOATAABBOX3D
-        istrm.Read_t(&PROPERTY(pepProperty->ep_slOffset, FLOATaabbox3D), sizeof(FLOATaabbox3D));
-        break;
-      // if it is FLOATMATRIX3D
-      case CEntityProperty::EPT_FLOATMATRIX3D:
-        // read FLOATMATRIX3D
-        istrm.Read_t(&PROPERTY(pepProperty->ep_slOffset, FLOATmatrix3D), sizeof(FLOATmatrix3D));
-        break;
-      // if it is FLOATQUAT3D
-      case CEntityProperty::EPT_FLOATQUAT3D:
-        // read FLOATQUAT3D
-        istrm.Read_t(&PROPERTY(pepProperty->ep_slOffset, FLOATquat3D), sizeof(FLOATquat3D));
-        break;
-      // if it is FLOAT3D
-      case CEntityProperty::EPT_FLOAT3D:
-        // read FLOAT3D
-        istrm.Read_t(&PROPERTY(pepProperty->ep_slOffset, FLOAT3D), sizeof(FLOAT3D));
-        break;
-      // if it is ANGLE3D
-      case CEntityProperty::EPT_ANGLE3D:
-        // read ANGLE3D
-        istrm.Read_t(&PROPERTY(pepProperty->ep_slOffset, ANGLE3D), sizeof(ANGLE3D));
-        break;
-      // if it is FLOATplane3D
-      case CEntityProperty::EPT_FLOATplane3D:
-        // read FLOATplane3D
-        istrm.Read_t(&PROPERTY(pepProperty->ep_slOffset, FLOATplane3D), sizeof(FLOATplane3D));
-        break;
-      // if it is MODELOBJECT
-      case CEntityProperty::EPT_MODELOBJECT:
-        // read CModelObject
-        ReadModelObject_t(istrm, PROPERTY(pepProperty->ep_slOffset, CModelObject));
-        break;
-      // if it is MODELINSTANCE
-      case CEntityProperty::EPT_MODELINSTANCE:
-        // read CModelObject
-        ReadModelInstance_t(istrm, PROPERTY(pepProperty->ep_slOffset, CModelInstance));
-        break;
-      // if it is ANIMOBJECT
-      case CEntityProperty::EPT_ANIMOBJECT:
-        // read CAnimObject
-        ReadAnimObject_t(istrm, PROPERTY(pepProperty->ep_slOffset, CAnimObject));
-        break;
-      // if it is SOUNDOBJECT
-      case CEntityProperty::EPT_SOUNDOBJECT:
-        // read CSoundObject
-        {
-          CSoundObject &so = PROPERTY(pepProperty->ep_slOffset, CSoundObject);
-          ReadSoundObject_t(istrm, so);
-          so.so_penEntity = this;
-        }
-        break;
-      // if it is CPlacement3D
-      case CEntityProperty::EPT_PLACEMENT3D:
-        // read CPlacement3D
-        istrm.Read_t(&PROPERTY(pepProperty->ep_slOffset, CPlacement3D), sizeof(CPlacement3D));
-        break;
-      default:
-        ASSERTALWAYS("Unknown property type");
-      }
+      // read the value
+      ReadPropertyValue_t(istrm, eptLoad, pepProperty->ep_slOffset);
     }
   }
 }
@@ -426,6 +569,19 @@ void CEntity::WriteProperties_t(CTStream &ostrm) // throw char *
   // write number of properties
   ostrm<<ctProperties;
 
+  // if packed functions can be used
+  if (ent_bPackedProperties && en_pecClass->ec_pdecDLLClass->HasPackedProperties()) {
+    // let each class write its properties
+    for(CDLLEntityClass *pdecDLLClass = en_pecClass->ec_pdecDLLClass;
+        pdecDLLClass!=NULL;
+        pdecDLLClass = pdecDLLClass->dec_pdecBase) {
+      if (pdecDLLClass->dec_WritePacked_t!=NULL) {
+        pdecDLLClass->dec_WritePacked_t(this, ostrm);
+      }
+    }
+    return;
+  }
+
   // for all classes in hierarchy of this entity
   {for(CDLLEntityClass *pdecDLLClass = en_pecClass->ec_pdecDLLClass;
       pdecDLLClass!=NULL;
@@ -441,118 +597,117 @@ void CEntity::WriteProperties_t(CTStream &ostrm) // throw char *
       // write the packed identifier
       ostrm<<ulIDAndType;
 
-      // depending on the property type
-      switch (epProperty.ep_eptType) {
-      // if it is BOOL
-      case CEntityProperty::EPT_BOOL:
-        // write BOOL
-        ostrm<<(INDEX &)PROPERTY(epProperty.ep_slOffset, BOOL);
-        break;
-      // if it is INDEX
-      case CEntityProperty::EPT_INDEX:
-      case CEntityProperty::EPT_ENUM:
-      case CEntityProperty::EPT_FLAGS:
-      case CEntityProperty::EPT_ANIMATION:
-      case CEntityProperty::EPT_ILLUMINATIONTYPE:
-      case CEntityProperty::EPT_COLOR:
-      case CEntityProperty::EPT_ANGLE:
-        // write INDEX
-        ostrm<<PROPERTY(epProperty.ep_slOffset, INDEX);
-        break;
-      // if it is FLOAT
-      case CEntityProperty::EPT_FLOAT:
-      case CEntityProperty::EPT_RANGE:
-        // write FLOAT
-        ostrm<<PROPERTY(epProperty.ep_slOffset, FLOAT);
-        break;
-      // if it is STRING
-      case CEntityProperty::EPT_STRING:
-        // write STRING
-        ostrm<<PROPERTY(epProperty.ep_slOffset, CTString);
-        break;
-      // if it is STRINGTRANS
-      case CEntityProperty::EPT_STRINGTRANS:
-        // write STRINGTRANS
-        ostrm.WriteID_t("DTRS");
-        ostrm<<PROPERTY(epProperty.ep_slOffset, CTString);
-        break;
-      // if it is FILENAME
-      case CEntityProperty::EPT_FILENAME:
-        // write FILENAME
-        ostrm<<PROPERTY(epProperty.ep_slOffset, CTFileName);
-        break;
-      // if it is FILENAMENODEP
-      case CEntityProperty::EPT_FILENAMENODEP:
-        // write FILENAMENODEP
-        ostrm<<PROPERTY(epProperty.ep_slOffset, CTFileNameNoDep);
-        break;
-      // if it is FLOATAABBOX3D
-      case CEntityProperty::EPT_FLOATAABBOX3D:
-        // write FLOATAABBOX3D
-        ostrm.Write_t(&PROPERTY(epProperty.ep_slOffset, FLOATaabbox3D), sizeof(FLOATaabbox3D));
-        break;
-      // if it is FLOATMATRIX3D
-      case CEntityProperty::EPT_FLOATMATRIX3D:
-        // write FLOATMATRIX3D
-        ostrm.Write_t(&PROPERTY(epProperty.ep_slOffset, FLOATmatrix3D), sizeof(FLOATmatrix3D));
-        break;
-      // if it is FLOATQUAT3D
-      case CEntityProperty::EPT_FLOATQUAT3D:
-        // write FLOATQUAT3D
-        ostrm.Write_t(&PROPERTY(epProperty.ep_slOffset, FLOATquat3D), sizeof(FLOATquat3D));
-        break;
-      // if it is ANGLE3D
-      case CEntityProperty::EPT_ANGLE3D:
-        // write ANGLE3D
-        ostrm.Write_t(&PROPERTY(epProperty.ep_slOffset, ANGLE3D), sizeof(ANGLE3D));
-        break;
-      // if it is FLOAT3D
-      case CEntityProperty::EPT_FLOAT3D:
-        // write FLOAT3D
-        ostrm.Write_t(&PROPERTY(epProperty.ep_slOffset, FLOAT3D), sizeof(FLOAT3D));
-        break;
-      // if it is FLOATplane3D
-      case CEntityProperty::EPT_FLOATplane3D:
-        // write FLOATplane3D
-        ostrm.Write_t(&PROPERTY(epProperty.ep_slOffset, FLOATplane3D), sizeof(FLOATplane3D));
-        break;
-      // if it is ENTITYPTR
-      case CEntityProperty::EPT_ENTITYPTR:
-        // write entity pointer
-        WriteEntityPointer_t(&ostrm, PROPERTY(epProperty.ep_slOffset, CEntityPointer));
-        break;
-      // if it is MODELOBJECT
-      case CEntityProperty::EPT_MODELOBJECT:
-        // write CModelObject
-        WriteModelObject_t(ostrm, PROPERTY(epProperty.ep_slOffset, CModelObject));
-        break;
-      // if it is MODELINSTANCE
-      case CEntityProperty::EPT_MODELINSTANCE:
-        // write CModelInstance
-        WriteModelInstance_t(ostrm, PROPERTY(epProperty.ep_slOffset, CModelInstance));
-        break;
-      // if it is ANIMOBJECT
-      case CEntityProperty::EPT_ANIMOBJECT:
-        // write CAnimObject
-        WriteAnimObject_t(ostrm, PROPERTY(epProperty.ep_slOffset, CAnimObject));
-        break;
-      // if it is SOUNDOBJECT
-      case CEntityProperty::EPT_SOUNDOBJECT:
-        // write CSoundObject
-        WriteSoundObject_t(ostrm, PROPERTY(epProperty.ep_slOffset, CSoundObject));
-        break;
-      // if it is CPlacement3D
-      case CEntityProperty::EPT_PLACEMENT3D:
-        // write CPlacement3D
-        ostrm.Write_t(&PROPERTY(epProperty.ep_slOffset, CPlacement3D), sizeof(CPlacement3D));
-        break;
-      default:
-        ASSERTALWAYS("Unknown property type");
-      }
+      // write the value
+      WritePropertyValue_t(ostrm, epProperty.ep_eptType, epProperty.ep_slOffset);
     }
   }}
 }
 
+// write properties of all entities in world
+static void WriteWorldProperties_t(CWorld &wo, CTMemoryStream &strm) // throw char *
+{
+  strm.SetPos_t(0);
+  FOREACHINDYNAMICCONTAINER(wo.wo_cenAllEntities, CEntity, iten) {
+    if (iten->en_ulFlags&ENF_DELETED) continue;
+    iten->WriteProperties_t(strm);
+  }
+}
+
+// read properties written from world into scratch copies of its entities
+static void ReadScratchProperties_t(CDynamicContainer<CEntity> &cenScratch, CTMemoryStream &strm) // throw char *
+{
+  strm.SetPos_t(0);
+  FOREACHINDYNAMICCONTAINER(cenScratch, CEntity, iten) {
+    iten->ReadProperties_t(strm);
+  }
+}
+
+// time writing and reading of properties of all entities in world, with generic and packed functions
+// (properties are read into scratch copies of entities, so live ones keep their sounds and models)
+void PropertySerializationBenchmark(void *pArgs)
+{
+  INDEX ctRepeats = NEXTARGUMENT(INDEX);
+  if (ctRepeats<=0) ctRepeats = 5;
+
+  CEntity *penPlayer = CEntity::GetPlayerEntity(0);
+  if (penPlayer==NULL) {
+    CPrintF(TRANS("Property serialization benchmark needs a game in progress.\n"));
+    return;
+  }
+  CWorld &wo = *penPlayer->en_pwoWorld;
+
+  // sound objects that are read start playing, so don't let the mixer see them until scratch is gone
+  CTSingleLock slSounds(&_pSound->sl_csSound, TRUE);
+
+  // create a scratch entity of same class for each entity in world;
+  // they are in scratch world only, but point into the real one so entity pointers can be read
+  CWorld woScratch;
+  CDynamicContainer<CEntity> cenScratch;
+  FOREACHINDYNAMICCONTAINER(wo.wo_cenAllEntities, CEntity, iten) {
+    if (iten->en_ulFlags&ENF_DELETED) continue;
+    CEntity *penScratch = iten->en_pecClass->New();
+    penScratch->en_ulID = iten->en_ulID;
+    penScratch->en_pwoWorld = &wo;
+    penScratch->AddReference();
+    woScratch.wo_cenAllEntities.Add(penScratch);
+    cenScratch.Add(penScratch);
+  }
+
+  extern BOOL _bReadEntitiesByID;
+  const BOOL bOldReadEntitiesByID = _bReadEntitiesByID;
+  const INDEX bOldPackedProperties = ent_bPackedProperties;
+  _bReadEntitiesByID = TRUE;   // entity pointers are written as IDs
+
+  CTMemoryStream astrm[2];
+  DOUBLE adWriteMs[2], adReadMs[2];
+  BOOL bSuccess = TRUE;
+  try {
+    for (INDEX iPacked=0; iPacked<2; iPacked++) {
+      ent_bPackedProperties = iPacked;
+      CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+      for (INDEX iRepeat=0; iRepeat<ctRepeats; iRepeat++) {
+        WriteWorldProperties_t(wo, astrm[iPacked]);
+      }
+      CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+      // (what generic functions wrote must be readable with packed ones too)
+      for (INDEX iRepeat=0; iRepeat<ctRepeats; iRepeat++) {
+        ReadScratchProperties_t(cenScratch, astrm[0]);
+      }
+      CTimerValue tv2 = _pTimer->GetHighPrecisionTimer();
+      adWriteMs[iPacked] = (tv1-tv0).GetSeconds()*1000.0/ctRepeats;
+      adReadMs[iPacked]  = (tv2-tv1).GetSeconds()*1000.0/ctRepeats;
+    }
+  } catch (char *strError) {
+    CPrintF(TRANS("Property serialization benchmark failed: %s\n"), strError);
+    bSuccess = FALSE;
+  }
+  ent_bPackedProperties = bOldPackedProperties;
+  _bReadEntitiesByID = bOldReadEntitiesByID;
+
+  // destroy scratch entities (from scratch world)
+  const INDEX ctEntities = cenScratch.Count();
+  FOREACHINDYNAMICCONTAINER(cenScratch, CEntity, itenScratch) {
+    itenScratch->en_pwoWorld = &woScratch;
+    itenScratch->RemReference();
+  }
+  cenScratch.Clear();
+  if (!bSuccess) return;
+
+  // both must have written exactly the same
+  const SLONG slSize = astrm[0].GetStreamSize();
+  const BOOL bMatch = slSize==astrm[1].GetStreamSize()
+                   && astrm[0].GetStreamCRC32_t()==astrm[1].GetStreamCRC32_t();
+  CPrintF(TRANS("Property serialization benchmark (%d entities, %d KB, %d repeats):\n"),
+    ctEntities, slSize/1024, ctRepeats);
+  CPrintF(TRANS("  generic: write %7.3f ms (%6.1f MB/s), read %7.3f ms (%6.1f MB/s)\n"),
+    adWriteMs[0], slSize/1024.0/1024.0/Max(adWriteMs[0]/1000.0, 1e-6),
+    adReadMs[0],  slSize/1024.0/1024.0/Max(adReadMs[0]/1000.0, 1e-6));
+  CPrintF(TRANS("  packed:  write %7.3f ms (%6.1f MB/s), read %7.3f ms (%6.1f MB/s), %s\n"),
+    adWriteMs[1], slSize/1024.0/1024.0/Max(adWriteMs[1]/1000.0, 1e-6),
+    adReadMs[1],  slSize/1024.0/1024.0/Max(adReadMs[1]/1000.0, 1e-6),
+    bMatch ? TRANS("match") : TRANS("MISMATCH!"));
+}
+
 /////////////////////////////////////////////////////////////////////
 // Component management functions
 
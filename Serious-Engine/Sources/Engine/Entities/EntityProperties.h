@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #endif
 
 #include <Engine/Base/FileName.h>
+#include <Engine/Base/Stream.h>
 #include <Engine/Entities/Entity.h>
 
 /////////////////////////////////////////////////////////////////////
@@ -123,6 +124,32 @@ public:
 // macro for accessing property inside an entity
 #define ENTITYPROPERTY(entityptr, offset, type) (*((type *)(((UBYTE *)entityptr)+offset)))
 
+/////////////////////////////////////////////////////////////////////
+// Packed property functions generated by Ecc
+
+// version of generated functions and layout IDs (must be same in Ecc)
+#define ENTITYPROPERTIES_LAYOUTVERSION 1
+
+// packed identifier of a property, as written in stream
+#define PACKEDPROPERTY_ID(id, type) ((((ULONG)(id))<<8)|(ULONG)(type))
+
+// read packed identifier of next property if it is the expected one
+inline BOOL ExpectPackedProperty_t(CTStream &strm, INDEX &ctRemaining, ULONG ulIDAndType) // throw char *
+{
+  if (ctRemaining<=0) {
+    return FALSE;
+  }
+  ULONG ulRead;
+  strm>>ulRead;
+  // if some other property is there, it has to be read by looking it up
+  if (ulRead!=ulIDAndType) {
+    strm.Seek_t(-(SLONG)sizeof(ulRead), CTStream::SD_CUR);
+    return FALSE;
+  }
+  ctRemaining--;
+  return TRUE;
+}
+
 /////////////////////////////////////////////////////////////////////
 // Classes and macros for defining entity event handler functions
 
@@ -207,10 +234,20 @@ public:
   void (*dec_OnWorldRender)(CWorld *pwoWorld);  // function called for each rendering
   void (*dec_OnWorldEnd)(CWorld *pwoWorld);     // function called on world cleanup
 
+  // functions generated by Ecc for writing/reading properties of this class (without base classes)
+  ULONG dec_ulPackedLayout;           // layout ID of properties the functions were generated for
+  void (*dec_WritePacked_t)(CEntity *pen, CTStream &strm);
+  BOOL (*dec_ReadPacked_t)(CEntity *pen, CTStream &strm, INDEX &ctRemaining);
+  INDEX dec_iPackedValid;             // 0 if not checked yet, 1 if functions can be used, -1 if not
+
   /* Get pointer to entity property from its name. */
   class CEntityProperty *PropertyForName(const CTString &strPropertyName);
   /* Get pointer to entity property from its packed identifier. */
   class CEntityProperty *PropertyForTypeAndID(CEntityProperty::PropertyType eptType, ULONG ulID);
+  /* Calculate layout ID of properties of this class (without base classes). */
+  ULONG CalculatePropertyLayout(void);
+  /* Check if packed functions can be used for this class and all its base classes. */
+  BOOL HasPackedProperties(void);
   /* Get event handler given state and event code. */
   CEntity::pEventHandler HandlerForStateAndEvent(SLONG slState, SLONG slEvent);
   /* Get event handler name for given state. */
@@ -257,7 +294,11 @@ public:
     &classname##_OnWorldInit,                                         \
     &classname##_OnWorldTick,                                         \
     &classname##_OnWorldRender,                                       \
-    &classname##_OnWorldEnd                                           \
+    &classname##_OnWorldEnd,                                          \
+    classname##_packedlayout,                                         \
+    &classname##_WritePacked_t,                                       \
+    &classname##_ReadPacked_t,                                        \
+    0                                                                 \
   };\
   SYMBOLLOCATOR(classname##_DLLClass)
 
@@ -265,7 +306,8 @@ public:
   extern "C" DECLSPEC_DLLEXPORT CDLLEntityClass classname##_DLLClass; \
   CDLLEntityClass classname##_DLLClass = {                            \
     NULL,0, NULL,0, NULL,0, "", "", id,                               \
-    NULL, NULL,NULL,NULL,NULL, NULL,NULL,NULL,NULL                    \
+    NULL, NULL,NULL,NULL,NULL, NULL,NULL,NULL,NULL,                   \
+    0, NULL,NULL, 0                                                   \
   }
 
 inline ENGINE_API void ClearToDefault(FLOAT &f) { f = 0.0f; };
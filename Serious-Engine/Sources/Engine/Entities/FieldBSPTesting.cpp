@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Math/Clipping.inl>
 #include <Engine/Math/OBBox.h>
 #include <Engine/Brushes/Brush.h>
+#include <Engine/World/World.h>
 #include <Engine/Templates/BSP.h>
 #include <Engine/Templates/DynamicArray.cpp>
 #include <Engine/Templates/StaticArray.cpp>
@@ -31,6 +32,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 static CEntity *penField;
 static CBrushSector *_pbsc;
 static CStaticStackArray<CEntity *> _apenActive;
+static CStaticStackArray<CEntity *> _apenNear;
+
+// find entities touching fields through collision grid instead of walking zoning sectors
+INDEX ent_bFieldTouchGrid = TRUE;
 
 static BOOL EntityIsInside(CEntity *pen)
 {
@@ -68,49 +73,18 @@ static BOOL EntityIsInside(CEntity *pen)
   return FALSE;
 }
 
-// find first entity touching a field (this entity must be a field brush)
-CEntity *CEntity::TouchingEntity(BOOL (*ConsiderEntity)(CEntity *), CEntity *penHintMaybeInside)
+// find touching entity by testing all entities in zoning sectors of the field
+static CEntity *TouchingEntityInSectors(BOOL (*ConsiderEntity)(CEntity *))
 {
-  // if not a field brush
-  if (en_RenderType!=RT_FIELDBRUSH) {
-    // error
-    ASSERT(FALSE);
-    return NULL;
-  }
-
-  // remember the entity and its first sector
-  penField = this;
-  CBrushMip *pbm = en_pbrBrush->GetBrushMipByDistance(0.0f);
-  _pbsc = NULL;
-  {FOREACHINDYNAMICARRAY(pbm->bm_abscSectors, CBrushSector, itbsc) {
-    _pbsc = itbsc;
-    break;
-  }}
-  // if illegal number of sectors
-  if (_pbsc==NULL || pbm->bm_abscSectors.Count()>1) {
-    // error
-    CPrintF("Field doesn't have exactly one sector - ignoring!\n");
-    return NULL;
-  }
-
-  // if a specific entity to check is given
-  if (penHintMaybeInside!=NULL) {
-    // if it is inside
-    if (EntityIsInside(penHintMaybeInside)) {
-      // return it
-      return penHintMaybeInside;
-    }
-  }
-
   CEntity *penTouched = NULL;
   // no entities active initially
   _apenActive.PopAll();
   // for each zoning sector that this entity is in
-  {FOREACHSRCOFDST(en_rdSectors, CBrushSector, bsc_rsEntities, pbsc)
+  {FOREACHSRCOFDST(penField->en_rdSectors, CBrushSector, bsc_rsEntities, pbsc)
     // for all movable model entities that should be considered in the sector
     {FOREACHDSTOFSRC(pbsc->bsc_rsEntities, CEntity, en_rdSectors, pen)
       if (!(pen->en_ulPhysicsFlags&EPF_MOVABLE)
-        || (pen->en_RenderType!=RT_MODEL&&pen->en_RenderType!=RT_EDITORMODEL)
+        || (pen->en_RenderType!=CEntity::RT_MODEL&&pen->en_RenderType!=CEntity::RT_EDITORMODEL)
         || (!ConsiderEntity(pen))) {
         continue;
       }
@@ -141,3 +115,94 @@ CEntity *CEntity::TouchingEntity(BOOL (*ConsiderEntity)(CEntity *), CEntity *pen
 
   return penTouched;
 }
+
+// check if an entity is in some of the zoning sectors of the field
+static BOOL IsInFieldSectors(CEntity *pen)
+{
+  {FOREACHSRCOFDST(pen->en_rdSectors, CBrushSector, bsc_rsEntities, pbscEntity)
+    {FOREACHSRCOFDST(penField->en_rdSectors, CBrushSector, bsc_rsEntities, pbscField)
+      if (pbscEntity==pbscField) {
+        return TRUE;
+      }
+    ENDFOR}
+  ENDFOR}
+  return FALSE;
+}
+
+// find touching entity among entities near the field in collision grid
+static CEntity *TouchingEntityInGrid(BOOL (*ConsiderEntity)(CEntity *))
+{
+  // get all entities whose collision boxes are near the field sector (collision spheres
+  // of an entity that is inside the sector must be in its collision box)
+  penField->en_pwoWorld->FindEntitiesNearBox(_pbsc->bsc_boxBoundingBox, _apenNear);
+
+  CEntity *penTouched = NULL;
+  // for all movable model entities that should be considered
+  for (INDEX ien=0; ien<_apenNear.Count(); ien++) {
+    CEntity *pen = _apenNear[ien];
+    if (!(pen->en_ulPhysicsFlags&EPF_MOVABLE)
+      || (pen->en_RenderType!=CEntity::RT_MODEL&&pen->en_RenderType!=CEntity::RT_EDITORMODEL)
+      || pen->en_pciCollisionInfo==NULL
+      || !IsInFieldSectors(pen)
+      || !ConsiderEntity(pen)) {
+      continue;
+    }
+    // if not inside
+    if (!EntityIsInside(pen)) {
+      // skip it
+      continue;
+    }
+    // if there is more than one inside
+    if (penTouched!=NULL) {
+      // which one is returned depends on order of entities in sectors
+      _apenNear.PopAll();
+      return TouchingEntityInSectors(ConsiderEntity);
+    }
+    penTouched = pen;
+  }
+
+  _apenNear.PopAll();
+  return penTouched;
+}
+
+// find first entity touching a field (this entity must be a field brush)
+CEntity *CEntity::TouchingEntity(BOOL (*ConsiderEntity)(CEntity *), CEntity *penHintMaybeInside)
+{
+  // if not a field brush
+  if (en_RenderType!=RT_FIELDBRUSH) {
+    // error
+    ASSERT(FALSE);
+    return NULL;
+  }
+
+  // remember the entity and its first sector
+  penField = this;
+  CBrushMip *pbm = en_pbrBrush->GetBrushMipByDistance(0.0f);
+  _pbsc = NULL;
+  {FOREACHINDYNAMICARRAY(pbm->bm_abscSectors, CBrushSector, itbsc) {
+    _pbsc = itbsc;
+    break;
+  }}
+  // if illegal number of sectors
+  if (_pbsc==NULL || pbm->bm_abscSectors.Count()>1) {
+    // error
+    CPrintF("Field doesn't have exactly one sector - ignoring!\n");
+    return NULL;
+  }
+
+  // if a specific entity to check is given
+  if (penHintMaybeInside!=NULL) {
+    // if it is inside
+    if (EntityIsInside(penHintMaybeInside)) {
+      // return it
+      return penHintMaybeInside;
+    }
+  }
+
+  // find the entity inside
+  if (ent_bFieldTouchGrid && en_pwoWorld!=NULL && en_pwoWorld->wo_pcgCollisionGrid!=NULL) {
+    return TouchingEntityInGrid(ConsiderEntity);
+  } else {
+    return TouchingEntityInSectors(ConsiderEntity);
+  }
+}
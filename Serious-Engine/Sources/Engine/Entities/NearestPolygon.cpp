@@ -17,8 +17,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <Engine/Entities/Entity.h>
 #include <Engine/Brushes/Brush.h>
+#include <Engine/Base/Console.h>
+#include <Engine/Base/Shell.h>
+#include <Engine/Base/Timer.h>
+#include <Engine/Math/Float.h>
+#include <Engine/Network/Network.h>
+#include <Engine/World/World.h>
 
 #include <Engine/Templates/DynamicArray.cpp>
+#include <Engine/Templates/DynamicContainer.cpp>
 #include <Engine/Templates/StaticArray.cpp>
 #include <Engine/Templates/StaticStackArray.cpp>
 #include <Engine/Math/Geometry.inl>
@@ -39,6 +46,303 @@ public:
 
 static CStaticStackArray<CActiveSector> _aas;
 
+// use spatial index of sector polygons when searching for near polygon
+INDEX ent_bNearPolygonIndex = TRUE;
+
+#define NEARINDEX_MINPOLYGONS  32   // smaller sectors are just searched linearly
+#define NEARINDEX_LEAFPOLYGONS  4   // max polygons in leaf node
+#define NEARINDEX_MAXDEPTH     64   // tree is balanced, so this is plenty
+
+// node of polygon tree in a sector
+class CNearIndexNode {
+public:
+  FLOATaabbox3D nin_boxPolygons;  // union of polygon boxes in the node
+  INDEX nin_iFirst;     // first child node (if branch) or first polygon (if leaf)
+  INDEX nin_ctPolygons; // polygons in leaf (0 if branch, children are at iFirst and iFirst+1)
+};
+
+// spatial index of polygons in a sector (made only for sectors of brushes that don't move)
+class CSectorNearIndex {
+public:
+  BOOL sni_bValid;                        // set if sector can be searched through the index
+  CStaticStackArray<CNearIndexNode> sni_annNodes;  // first node is root
+  CStaticArray<INDEX> sni_aiPolygons;     // polygon indices in order of leaves
+};
+
+/* Free the near polygon index of a sector. */
+void DiscardNearIndex(CBrushSector *pbsc)
+{
+  if (pbsc->bsc_psniNearIndex!=NULL) {
+    delete pbsc->bsc_psniNearIndex;
+    pbsc->bsc_psniNearIndex = NULL;
+  }
+}
+
+// polygon centers used while sorting polygons for the index
+static CStaticArray<FLOAT3D> _avCenters;
+static INDEX _iSortAxis;
+
+static int qsort_CompareCenters(const void *pv0, const void *pv1)
+{
+  FLOAT f0 = _avCenters[*(const INDEX*)pv0](_iSortAxis);
+  FLOAT f1 = _avCenters[*(const INDEX*)pv1](_iSortAxis);
+  if (f0<f1) return -1;
+  if (f0>f1) return +1;
+  return (*(const INDEX*)pv0)-(*(const INDEX*)pv1);
+}
+
+/* Make index node for given range of polygons. */
+static void MakeNearIndexNode(CBrushSector *pbsc, INDEX inn, INDEX iFirst, INDEX ctPolygons)
+{
+  CSectorNearIndex &sni = *pbsc->bsc_psniNearIndex;
+  INDEX *piPolygons = &sni.sni_aiPolygons[iFirst];
+  // find bounds of polygons and of their centers
+  FLOATaabbox3D boxPolygons, boxCenters;
+  for (INDEX i=0; i<ctPolygons; i++) {
+    boxPolygons |= pbsc->bsc_abpoPolygons[piPolygons[i]].bpo_boxBoundingBox;
+    boxCenters |= FLOATaabbox3D(_avCenters[piPolygons[i]]);
+  }
+  sni.sni_annNodes[inn].nin_boxPolygons = boxPolygons;
+
+  // if few enough polygons
+  if (ctPolygons<=NEARINDEX_LEAFPOLYGONS) {
+    // make a leaf
+    sni.sni_annNodes[inn].nin_iFirst = iFirst;
+    sni.sni_annNodes[inn].nin_ctPolygons = ctPolygons;
+    return;
+  }
+
+  // split at median along the longest axis of centers
+  FLOAT3D vSize = boxCenters.Size();
+  _iSortAxis = 1;
+  if (vSize(2)>vSize(_iSortAxis)) _iSortAxis = 2;
+  if (vSize(3)>vSize(_iSortAxis)) _iSortAxis = 3;
+  qsort(piPolygons, ctPolygons, sizeof(INDEX), qsort_CompareCenters);
+  INDEX ctFront = ctPolygons/2;
+
+  // make children (node array may move here!)
+  INDEX innChildren = sni.sni_annNodes.Count();
+  sni.sni_annNodes.Push(2);
+  sni.sni_annNodes[inn].nin_iFirst = innChildren;
+  sni.sni_annNodes[inn].nin_ctPolygons = 0;
+  MakeNearIndexNode(pbsc, innChildren+0, iFirst, ctFront);
+  MakeNearIndexNode(pbsc, innChildren+1, iFirst+ctFront, ctPolygons-ctFront);
+}
+
+/* Make near polygon index for a sector. */
+static void MakeNearIndex(CBrushSector *pbsc)
+{
+  ASSERT(pbsc->bsc_psniNearIndex==NULL);
+  CSectorNearIndex &sni = *(pbsc->bsc_psniNearIndex = new CSectorNearIndex);
+  sni.sni_bValid = FALSE;
+  INDEX ctPolygons = pbsc->bsc_abpoPolygons.Count();
+
+  // get polygon centers, and check that all planes are valid (else linear search must be used
+  // to get exactly the same result, as it compares invalid distances in its own way)
+  _avCenters.Clear();
+  _avCenters.New(ctPolygons);
+  for (INDEX ipo=0; ipo<ctPolygons; ipo++) {
+    CBrushPolygon &bpo = pbsc->bsc_abpoPolygons[ipo];
+    const FLOATplane3D &pl = bpo.bpo_pbplPlane->bpl_plAbsolute;
+    if (!IsValidFloat(pl(1)) || !IsValidFloat(pl(2)) || !IsValidFloat(pl(3))
+      ||!IsValidFloat(pl.Distance()) || bpo.bpo_boxBoundingBox.IsEmpty()) {
+      _avCenters.Clear();
+      return;
+    }
+    _avCenters[ipo] = bpo.bpo_boxBoundingBox.Center();
+  }
+
+  // make the tree
+  sni.sni_aiPolygons.New(ctPolygons);
+  for (INDEX ipo=0; ipo<ctPolygons; ipo++) {
+    sni.sni_aiPolygons[ipo] = ipo;
+  }
+  sni.sni_annNodes.SetAllocationStep(ctPolygons/NEARINDEX_LEAFPOLYGONS*2+1);
+  sni.sni_annNodes.Push();
+  MakeNearIndexNode(pbsc, 0, 0, ctPolygons);
+  _avCenters.Clear();
+  sni.sni_bValid = TRUE;
+}
+
+/* Test if handle projects into a polygon not further than given distance. */
+static inline BOOL TestPolygon(CBrushPolygon &bpo, FLOAT fMaxDistance,
+  FLOAT &fDistance, FLOAT3D &vOnPlane)
+{
+  // if it is not a wall
+  if (bpo.bpo_ulFlags&BPOF_PORTAL) {
+    // skip it
+    return FALSE;
+  }
+  const FLOATplane3D &plPolygon = bpo.bpo_pbplPlane->bpl_plAbsolute;
+  // find distance of the polygon plane from the handle
+  fDistance = plPolygon.PointDistance(_vHandle);
+  // if it is behind the plane or further than nearest found
+  if (fDistance<0.0f || fDistance>fMaxDistance) {
+    // skip it
+    return FALSE;
+  }
+  // find projection of handle to the polygon plane
+  vOnPlane = plPolygon.ProjectPoint(_vHandle);
+  // if it is not in the bounding box of polygon
+  const FLOATaabbox3D &boxPolygon = bpo.bpo_boxBoundingBox;
+  const FLOAT EPSILON = 0.01f;
+  if (
+    (boxPolygon.Min()(1)-EPSILON>vOnPlane(1)) ||
+    (boxPolygon.Max()(1)+EPSILON<vOnPlane(1)) ||
+    (boxPolygon.Min()(2)-EPSILON>vOnPlane(2)) ||
+    (boxPolygon.Max()(2)+EPSILON<vOnPlane(2)) ||
+    (boxPolygon.Min()(3)-EPSILON>vOnPlane(3)) ||
+    (boxPolygon.Max()(3)+EPSILON<vOnPlane(3))) {
+    // skip it
+    return FALSE;
+  }
+
+  // find major axes of the polygon plane
+  INDEX iMajorAxis1, iMajorAxis2;
+  GetMajorAxesForPlane(plPolygon, iMajorAxis1, iMajorAxis2);
+
+  // create an intersector
+  CIntersector isIntersector(_vHandle(iMajorAxis1), _vHandle(iMajorAxis2));
+  // for all edges in the polygon
+  FOREACHINSTATICARRAY(bpo.bpo_abpePolygonEdges, CBrushPolygonEdge, itbpePolygonEdge) {
+    // get edge vertices (edge direction is irrelevant here!)
+    const FLOAT3D &vVertex0 = itbpePolygonEdge->bpe_pbedEdge->bed_pbvxVertex0->bvx_vAbsolute;
+    const FLOAT3D &vVertex1 = itbpePolygonEdge->bpe_pbedEdge->bed_pbvxVertex1->bvx_vAbsolute;
+    // pass the edge to the intersector
+    isIntersector.AddEdge(
+      vVertex0(iMajorAxis1), vVertex0(iMajorAxis2),
+      vVertex1(iMajorAxis1), vVertex1(iMajorAxis2));
+  }
+
+  // if the point is not inside polygon
+  if (!isIntersector.IsIntersecting()) {
+    // skip it
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Search polygons of a sector one by one. */
+static void SearchSectorLinear(CBrushSector *pbsc)
+{
+  // for each polygon in the sector
+  {FOREACHINSTATICARRAY(pbsc->bsc_abpoPolygons, CBrushPolygon, itbpo) {
+    CBrushPolygon &bpo = *itbpo;
+    FLOAT fDistance;
+    FLOAT3D vOnPlane;
+    if (TestPolygon(bpo, _fNearDistance, fDistance, vOnPlane)) {
+      // remember the polygon
+      _pbpoNear = &bpo;
+      _fNearDistance = fDistance;
+      _vNearPoint = vOnPlane;
+    }
+  }}
+}
+
+// squared distance of a point from a box
+static inline FLOAT BoxDistance2(const FLOATaabbox3D &box, const FLOAT3D &v)
+{
+  FLOAT fDistance2 = 0.0f;
+  for (INDEX i=1; i<=3; i++) {
+    FLOAT f = 0.0f;
+    if (v(i)<box.Min()(i)) {
+      f = box.Min()(i)-v(i);
+    } else if (v(i)>box.Max()(i)) {
+      f = v(i)-box.Max()(i);
+    }
+    fDistance2 += f*f;
+  }
+  return fDistance2;
+}
+
+/* Search polygons of a sector through its index. */
+static void SearchSectorIndexed(CBrushSector *pbsc)
+{
+  CSectorNearIndex &sni = *pbsc->bsc_psniNearIndex;
+  // polygon can be accepted only if handle projects into its box (expanded by epsilon),
+  // so node can be skipped if its box is further than the best distance (with some tolerance)
+  const FLOAT EPSILON = 0.01f;
+
+  // result must be exactly as with linear search: nearest polygon, and the last one if
+  // there are several at the same distance (polygon from previous sector counts as first)
+  INDEX ipoBest = -1;
+  FLOAT fBest = _fNearDistance;
+  FLOAT3D vBest;
+
+  INDEX aiStack[NEARINDEX_MAXDEPTH*2];
+  INDEX ctStack = 0;
+  aiStack[ctStack++] = 0;
+  while (ctStack>0) {
+    const CNearIndexNode &nn = sni.sni_annNodes[aiStack[--ctStack]];
+    // skip node if too far
+    FLOAT fMax = fBest+EPSILON*2+fBest*(1.0f/1024.0f);
+    FLOATaabbox3D boxNode = nn.nin_boxPolygons;
+    boxNode.Expand(EPSILON*2);
+    if (BoxDistance2(boxNode, _vHandle)>fMax*fMax) {
+      continue;
+    }
+    // if branch
+    if (nn.nin_ctPolygons==0) {
+      // search nearer child first
+      const CNearIndexNode &nn0 = sni.sni_annNodes[nn.nin_iFirst+0];
+      const CNearIndexNode &nn1 = sni.sni_annNodes[nn.nin_iFirst+1];
+      BOOL bFirstNearer = BoxDistance2(nn0.nin_boxPolygons, _vHandle)
+                        <=BoxDistance2(nn1.nin_boxPolygons, _vHandle);
+      ASSERT(ctStack+2<=ARRAYCOUNT(aiStack));
+      aiStack[ctStack++] = nn.nin_iFirst+(bFirstNearer ? 1 : 0);
+      aiStack[ctStack++] = nn.nin_iFirst+(bFirstNearer ? 0 : 1);
+      continue;
+    }
+    // for each polygon in leaf
+    for (INDEX i=0; i<nn.nin_ctPolygons; i++) {
+      INDEX ipo = sni.sni_aiPolygons[nn.nin_iFirst+i];
+      FLOAT fDistance;
+      FLOAT3D vOnPlane;
+      if (!TestPolygon(pbsc->bsc_abpoPolygons[ipo], fBest, fDistance, vOnPlane)) {
+        continue;
+      }
+      // if nearer, or same distance but later in the sector
+      if (fDistance<fBest || ipo>ipoBest) {
+        ipoBest = ipo;
+        fBest = fDistance;
+        vBest = vOnPlane;
+      }
+    }
+  }
+
+  // if some polygon found
+  if (ipoBest>=0) {
+    // remember it
+    _pbpoNear = &pbsc->bsc_abpoPolygons[ipoBest];
+    _fNearDistance = fBest;
+    _vNearPoint = vBest;
+  }
+}
+
+/* Check if a sector should be searched through its index. */
+static BOOL UseNearIndex(CBrushSector *pbsc)
+{
+  // if indices disabled, or some invalid distance is already found
+  if (!ent_bNearPolygonIndex || !IsValidFloat(_fNearDistance)) {
+    return FALSE;
+  }
+  // if already made
+  if (pbsc->bsc_psniNearIndex!=NULL) {
+    return pbsc->bsc_psniNearIndex->sni_bValid;
+  }
+  // if too small to be worth it
+  if (pbsc->bsc_abpoPolygons.Count()<NEARINDEX_MINPOLYGONS) {
+    return FALSE;
+  }
+  // if the brush can move (index would have to be remade after each move)
+  CEntity *penBrush = pbsc->bsc_pbmBrushMip->bm_pbrBrush->br_penEntity;
+  if (penBrush==NULL || (penBrush->en_ulPhysicsFlags&EPF_MOVABLE)) {
+    return FALSE;
+  }
+  MakeNearIndex(pbsc);
+  return pbsc->bsc_psniNearIndex->sni_bValid;
+}
+
 /* Add a sector if needed. */
 static void AddSector(CBrushSector *pbsc)
 {
@@ -67,71 +371,17 @@ static void AddAllSectorsOfBrush(CBrush3D *pbr)
   }
 }
 
-void SearchThroughSectors(void)
+static void SearchThroughSectors(void)
 {
   // for each active sector (sectors are added during iteration!)
   for(INDEX ias=0; ias<_aas.Count(); ias++) {
     CBrushSector *pbsc = _aas[ias].as_pbsc;
-    // for each polygon in the sector
-    {FOREACHINSTATICARRAY(pbsc->bsc_abpoPolygons, CBrushPolygon, itbpo) {
-      CBrushPolygon &bpo = *itbpo;
-      // if it is not a wall
-      if (bpo.bpo_ulFlags&BPOF_PORTAL) {
-        // skip it
-        continue;
-      }
-      const FLOATplane3D &plPolygon = bpo.bpo_pbplPlane->bpl_plAbsolute;
-      // find distance of the polygon plane from the handle
-      FLOAT fDistance = plPolygon.PointDistance(_vHandle);
-      // if it is behind the plane or further than nearest found
-      if (fDistance<0.0f || fDistance>_fNearDistance) {
-        // skip it
-        continue;
-      }
-      // find projection of handle to the polygon plane
-      FLOAT3D vOnPlane = plPolygon.ProjectPoint(_vHandle);
-      // if it is not in the bounding box of polygon
-      const FLOATaabbox3D &boxPolygon = bpo.bpo_boxBoundingBox;
-      const FLOAT EPSILON = 0.01f;
-      if (
-        (boxPolygon.Min()(1)-EPSILON>vOnPlane(1)) ||
-        (boxPolygon.Max()(1)+EPSILON<vOnPlane(1)) ||
-        (boxPolygon.Min()(2)-EPSILON>vOnPlane(2)) ||
-        (boxPolygon.Max()(2)+EPSILON<vOnPlane(2)) ||
-        (boxPolygon.Min()(3)-EPSILON>vOnPlane(3)) ||
-        (boxPolygon.Max()(3)+EPSILON<vOnPlane(3))) {
-        // skip it
-        continue;
-      }
-
-      // find major axes of the polygon plane
-      INDEX iMajorAxis1, iMajorAxis2;
-      GetMajorAxesForPlane(plPolygon, iMajorAxis1, iMajorAxis2);
-
-      // create an intersector
-      CIntersector isIntersector(_vHandle(iMajorAxis1), _vHandle(iMajorAxis2));
-      // for all edges in the polygon
-      FOREACHINSTATICARRAY(bpo.bpo_abpePolygonEdges, CBrushPolygonEdge, itbpePolygonEdge) {
-        // get edge vertices (edge direction is irrelevant here!)
-        const FLOAT3D &vVertex0 = itbpePolygonEdge->bpe_pbedEdge->bed_pbvxVertex0->bvx_vAbsolute;
-        const FLOAT3D &vVertex1 = itbpePolygonEdge->bpe_pbedEdge->bed_pbvxVertex1->bvx_vAbsolute;
-        // pass the edge to the intersector
-        isIntersector.AddEdge(
-          vVertex0(iMajorAxis1), vVertex0(iMajorAxis2),
-          vVertex1(iMajorAxis1), vVertex1(iMajorAxis2));
-      }
-
-      // if the point is not inside polygon
-      if (!isIntersector.IsIntersecting()) {
-        // skip it
-        continue;
-      }
-
-      // remember the polygon
-      _pbpoNear = &bpo;
-      _fNearDistance = fDistance;
-      _vNearPoint = vOnPlane;
-    }}
+    // search its polygons
+    if (UseNearIndex(pbsc)) {
+      SearchSectorIndexed(pbsc);
+    } else {
+      SearchSectorLinear(pbsc);
+    }
 
     // for each entity in the sector
     {FOREACHDSTOFSRC(pbsc->bsc_rsEntities, CEntity, en_rdSectors, pen)
@@ -190,3 +440,94 @@ CBrushPolygon *CEntity::GetNearestPolygon(
     return NULL;
   }
 }
+
+static BOOL ConsiderAllEntities(CEntity *pen)
+{
+  return TRUE;
+}
+
+/* Compare per tick time of indexed and linear near polygon and field touching searches in current world. */
+void NearestPolygonBenchmark(void *pArgs)
+{
+  INDEX ctTicks = NEXTARGUMENT(INDEX);
+  if (ctTicks<=0) ctTicks = 20;
+  extern INDEX ent_bFieldTouchGrid;
+  INDEX bOldNearPolygonIndex = ent_bNearPolygonIndex;
+  INDEX bOldFieldTouchGrid = ent_bFieldTouchGrid;
+
+  // get models that can stand on polygons and fields that check for touching
+  CStaticStackArray<CEntity *> apenModels, apenFields;
+  {FOREACHINDYNAMICCONTAINER(_pNetwork->ga_World.wo_cenEntities, CEntity, iten) {
+    CEntity *pen = iten;
+    if (pen->en_ulFlags&ENF_DELETED) {
+      continue;
+    }
+    if (pen->en_RenderType==CEntity::RT_MODEL && (pen->en_ulPhysicsFlags&EPF_MOVABLE)) {
+      apenModels.Push() = pen;
+    } else if (pen->en_RenderType==CEntity::RT_FIELDBRUSH && pen->en_pbrBrush!=NULL
+      && pen->en_pbrBrush->GetBrushMipByDistance(0.0f)->bm_abscSectors.Count()==1) {
+      apenFields.Push() = pen;
+    }
+  }}
+  CPrintF(TRANS("Searching near polygons of %d models and touching entities of %d fields for %d ticks...\n"),
+    apenModels.Count(), apenFields.Count(), ctTicks);
+
+  // results of linear searches
+  CStaticArray<CBrushPolygon *> apbpoLinear;
+  CStaticArray<FLOAT3D> avPointLinear;
+  CStaticArray<CEntity *> apenTouchedLinear;
+  apbpoLinear.New(apenModels.Count());
+  avPointLinear.New(apenModels.Count());
+  apenTouchedLinear.New(apenFields.Count());
+  INDEX ctDifferent = 0;
+
+  FLOAT fNearLinear=0, fNearIndexed=0, fTouchLinear=0, fTouchIndexed=0;
+  for (INDEX iPass=0; iPass<2; iPass++) {
+    const BOOL bIndexed = iPass==1;
+    ent_bNearPolygonIndex = bIndexed;
+    ent_bFieldTouchGrid = bIndexed;
+
+    // near polygons
+    CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+    for (INDEX iTick=0; iTick<ctTicks; iTick++) {
+      for (INDEX ien=0; ien<apenModels.Count(); ien++) {
+        FLOAT3D vPoint(0,0,0);
+        FLOATplane3D plPlane;
+        FLOAT fDistanceToEdge;
+        CBrushPolygon *pbpo = apenModels[ien]->GetNearestPolygon(vPoint, plPlane, fDistanceToEdge);
+        if (!bIndexed) {
+          apbpoLinear[ien] = pbpo;
+          avPointLinear[ien] = vPoint;
+        } else if (iTick==0 && (pbpo!=apbpoLinear[ien] || vPoint!=avPointLinear[ien])) {
+          ctDifferent++;
+        }
+      }
+    }
+    // touching entities
+    CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+    for (INDEX iTick=0; iTick<ctTicks; iTick++) {
+      for (INDEX ien=0; ien<apenFields.Count(); ien++) {
+        CEntity *penTouched = apenFields[ien]->TouchingEntity(ConsiderAllEntities, NULL);
+        if (!bIndexed) {
+          apenTouchedLinear[ien] = penTouched;
+        } else if (iTick==0 && penTouched!=apenTouchedLinear[ien]) {
+          ctDifferent++;
+        }
+      }
+    }
+    CTimerValue tv2 = _pTimer->GetHighPrecisionTimer();
+
+    (bIndexed ? fNearIndexed  : fNearLinear)  = (tv1-tv0).GetSeconds()*1000/ctTicks;
+    (bIndexed ? fTouchIndexed : fTouchLinear) = (tv2-tv1).GetSeconds()*1000/ctTicks;
+  }
+  ent_bNearPolygonIndex = bOldNearPolygonIndex;
+  ent_bFieldTouchGrid = bOldFieldTouchGrid;
+
+  CPrintF(TRANS("  near polygon linear:  %.3f ms per tick\n"), fNearLinear);
+  CPrintF(TRANS("  near polygon indexed: %.3f ms per tick (including making of indices)\n"), fNearIndexed);
+  CPrintF(TRANS("  touching in sectors:  %.3f ms per tick\n"), fTouchLinear);
+  CPrintF(TRANS("  touching in grid:     %.3f ms per tick\n"), fTouchIndexed);
+  if (ctDifferent>0) {
+    CPrintF(TRANS("  ERROR: %d results differ!\n"), ctDifferent);
+  }
+}
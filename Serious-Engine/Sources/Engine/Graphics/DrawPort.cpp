@@ -19,6 +19,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <Engine/Base/Memory.h>
 #include <Engine/Base/CRC.h>
+#include <Engine/Base/Shell.h>
+#include <Engine/Base/Timer.h>
+#include <Engine/Base/Console.h>
+#include <Engine/Base/Translation.h>
 #include <Engine/Math/Functions.h>
 #include <Engine/Math/Projection.h>
 #include <Engine/Math/AABBox.h>
@@ -35,6 +39,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Templates/StaticStackArray.cpp>
 
 extern INDEX gfx_bDecoratedText;
+extern INDEX gfx_bTextBatching;
+extern INDEX gfx_bTextLayoutCache;
 extern INDEX ogl_iFinish;
 extern INDEX d3d_iFinish;
 
@@ -76,6 +82,10 @@ static void SetScissor( const CDrawPort *pdp, PIX pixI, PIX pixJ, PIX pixW, PIX
 }
 
 
+// text that waits to be drawn in one batch
+static void FlushTextBatch(void);
+
+
 // reset scissor (clipping) to whole drawport
 static void ResetScissor( const CDrawPort *pdp)
 {
@@ -305,6 +315,7 @@ void CDrawPort::RecalculateDimensions(void)
 // set orthogonal projection
 void CDrawPort::SetOrtho(void) const
 {
+  FlushTextBatch();
   // finish all pending render-operations (if required)
   ogl_iFinish = Clamp( ogl_iFinish, 0L, 3L);
   d3d_iFinish = Clamp( d3d_iFinish, 0L, 3L);
@@ -336,6 +347,7 @@ void CDrawPort::SetOrtho(void) const
 // set given projection
 void CDrawPort::SetProjection(CAnyProjection3D &apr) const
 {
+  FlushTextBatch();
   // finish all pending render-operations (if required)
   ogl_iFinish = Clamp( ogl_iFinish, 0L, 3L);
   d3d_iFinish = Clamp( d3d_iFinish, 0L, 3L);
@@ -406,6 +418,7 @@ void CDrawPort::SetProjection(CAnyProjection3D &apr) const
 
 void CDrawPort::Unlock(void)
 {
+  FlushTextBatch();
   dp_Raster->Unlock();
   _pGfx->UnlockDrawPort(this);
 }
@@ -413,6 +426,7 @@ void CDrawPort::Unlock(void)
 
 BOOL CDrawPort::Lock(void)
 {
+  FlushTextBatch();
   _pfGfxProfile.StartTimer( CGfxProfile::PTI_LOCKDRAWPORT);
   BOOL bRasterLocked = dp_Raster->Lock();
   if( bRasterLocked) {
@@ -436,6 +450,7 @@ BOOL CDrawPort::Lock(void)
 // draw one point
 void CDrawPort::DrawPoint( PIX pixI, PIX pixJ, COLOR col, PIX pixRadius/*=1*/) const
 {
+  FlushTextBatch();
   // check API and radius
   const GfxAPIType eAPI = _pGfx->gl_eCurrentAPI;
 #ifdef SE1_D3D
@@ -490,6 +505,7 @@ void CDrawPort::DrawPoint( PIX pixI, PIX pixJ, COLOR col, PIX pixRadius/*=1*/) c
 // draw one point in 3D
 void CDrawPort::DrawPoint3D( FLOAT3D v, COLOR col, FLOAT fRadius/*=1.0f*/) const
 {
+  FlushTextBatch();
   // check API and radius
   const GfxAPIType eAPI = _pGfx->gl_eCurrentAPI;
 #ifdef SE1_D3D
@@ -539,6 +555,7 @@ void CDrawPort::DrawPoint3D( FLOAT3D v, COLOR col, FLOAT fRadius/*=1.0f*/) const
 // draw one line
 void CDrawPort::DrawLine( PIX pixI0, PIX pixJ0, PIX pixI1, PIX pixJ1, COLOR col, ULONG typ/*=_FULL*/) const
 {
+  FlushTextBatch();
   // check API
   const GfxAPIType eAPI = _pGfx->gl_eCurrentAPI;
 #ifdef SE1_D3D
@@ -608,6 +625,7 @@ void CDrawPort::DrawLine( PIX pixI0, PIX pixJ0, PIX pixI1, PIX pixJ1, COLOR col,
 // draw one line in 3D
 void CDrawPort::DrawLine3D( FLOAT3D v0, FLOAT3D v1, COLOR col) const
 {
+  FlushTextBatch();
   // check API
   const GfxAPIType eAPI = _pGfx->gl_eCurrentAPI;
 #ifdef SE1_D3D
@@ -654,6 +672,7 @@ void CDrawPort::DrawLine3D( FLOAT3D v0, FLOAT3D v1, COLOR col) const
 // draw border
 void CDrawPort::DrawBorder( PIX pixI, PIX pixJ, PIX pixWidth, PIX pixHeight, COLOR col, ULONG typ/*=_FULL_*/) const
 {
+  FlushTextBatch();
   // check API
   const GfxAPIType eAPI = _pGfx->gl_eCurrentAPI;
 #ifdef SE1_D3D
@@ -730,6 +749,7 @@ void CDrawPort::DrawBorder( PIX pixI, PIX pixJ, PIX pixWidth, PIX pixHeight, COL
 // fill part of a drawport with a given color
 void CDrawPort::Fill( PIX pixI, PIX pixJ, PIX pixWidth, PIX pixHeight, COLOR col) const
 {
+  FlushTextBatch();
   // if color is tranlucent
   if( ((col&CT_AMASK)>>CT_ASHIFT) != CT_OPAQUE)
   { // draw thru polygon
@@ -791,6 +811,7 @@ void CDrawPort::Fill( PIX pixI, PIX pixJ, PIX pixWidth, PIX pixHeight, COLOR col
 void CDrawPort::Fill( PIX pixI, PIX pixJ, PIX pixWidth, PIX pixHeight, 
                       COLOR colUL, COLOR colUR, COLOR colDL, COLOR colDR) const
 {
+  FlushTextBatch();
   // clip and eventually reject
   const BOOL bInside = ClipToDrawPort( this, pixI, pixJ, pixWidth, pixHeight);
   if( !bInside) return;
@@ -855,6 +876,7 @@ void CDrawPort::Fill( PIX pixI, PIX pixJ, PIX pixWidth, PIX pixHeight,
 // fill an entire drawport with a given color
 void CDrawPort::Fill( COLOR col) const
 {
+  FlushTextBatch();
   // if color is tranlucent
   if( ((col&CT_AMASK)>>CT_ASHIFT) != CT_OPAQUE)
   { // draw thru polygon
@@ -897,6 +919,7 @@ void CDrawPort::Fill( COLOR col) const
 // fill a part of Z-Buffer with a given value
 void CDrawPort::FillZBuffer( PIX pixI, PIX pixJ, PIX pixWidth, PIX pixHeight, FLOAT zval) const
 { 
+  FlushTextBatch();
   // check API
   const GfxAPIType eAPI = _pGfx->gl_eCurrentAPI;
 #ifdef SE1_D3D
@@ -938,6 +961,7 @@ void CDrawPort::FillZBuffer( PIX pixI, PIX pixJ, PIX pixWidth, PIX pixHeight, FL
 // fill an entire Z-Buffer with a given value
 void CDrawPort::FillZBuffer( FLOAT zval) const
 { 
+  FlushTextBatch();
   // check API
   const GfxAPIType eAPI = _pGfx->gl_eCurrentAPI;
 #ifdef SE1_D3D
@@ -969,6 +993,7 @@ void CDrawPort::FillZBuffer( FLOAT zval) const
 // grab screen
 void CDrawPort::GrabScreen( class CImageInfo &iiGrabbedImage, INDEX iGrabZBuffer/*=0*/) const
 {
+  FlushTextBatch();
   // check API
   const GfxAPIType eAPI = _pGfx->gl_eCurrentAPI;
 #ifdef SE1_D3D
@@ -1088,6 +1113,7 @@ BOOL CDrawPort::IsPointVisible( PIX pixI, PIX pixJ, FLOAT fOoK, INDEX iID, INDEX
 void CDrawPort::RenderLensFlare( CTextureObject *pto, FLOAT fI, FLOAT fJ,
                                  FLOAT fSizeI, FLOAT fSizeJ, ANGLE aRotation, COLOR colLight) const
 {
+  FlushTextBatch();
   // check API
   const GfxAPIType eAPI = _pGfx->gl_eCurrentAPI;
 #ifdef SE1_D3D
@@ -1164,12 +1190,123 @@ void CDrawPort::SetFont( CFontData *pfd)
 };
 
 
-// returns width of the longest line in text string
-ULONG CDrawPort::GetTextWidth( const CTString &strText) const
+// TEXT OUTPUT -------------------------------------
+
+// text is parsed into glyphs (positions relative to start of text and styles from special codes),
+// that are cached per string, font and text settings, so same text doesn't need to be parsed each frame;
+// final colors, flashing and clipping are applied when glyphs are put into vertex arrays
+
+#define TGF_BOLD       (1UL<<0)
+#define TGF_ITALIC     (1UL<<1)
+#define TGF_CODECOLOR  (1UL<<2)   // color is set by ^c (instead of default one)
+#define TGF_CODEALPHA  (1UL<<3)   // alpha is set by ^a
+
+struct TextGlyph {
+  PIX   tg_pixX, tg_pixY;   // adjusted location of char relative to start of text
+  PIX   tg_pixCharEnd;      // for clipping
+  COLOR tg_colCode;         // color from ^c (not adjusted)
+  UBYTE tg_ubChar;
+  UBYTE tg_ubFlags;         // TGF_...
+  UBYTE tg_ubAlpha;         // alpha from ^a
+  UBYTE tg_ubFlash;         // flashing frequency (0 if not flashing)
+};
+
+// everything (besides the string) that text layout depends on
+struct TextLayoutKey {
+  const CFontData *tlk_pfd;
+  SLONG tlk_fixScalingX, tlk_fixScalingY;
+  SLONG tlk_slCharSpacing, tlk_slLineSpacing;
+  SLONG tlk_slSpaceEnd;     // space width is often changed after the font has been loaded
+  SLONG tlk_slFlags;        // text mode, fixed width and decorated text
+};
+
+class CTextLayout {
+public:
+  BOOL  tl_bValid;
+  BOOL  tl_bLaidOut;        // glyphs are prepared (only width might be needed)
+  ULONG tl_ulHash;
+  TextLayoutKey tl_tlk;
+  CTString tl_strText;
+  PIX   tl_pixWidth;        // -1 if not calculated yet
+  CStaticStackArray<TextGlyph> tl_atgGlyphs;
+  CTextLayout(void) { tl_bValid = FALSE; tl_bLaidOut = FALSE; tl_ulHash = 0; tl_pixWidth = -1; };
+};
+
+// direct mapped cache of recently used text
+#define TEXTCACHE_SIZE 256  // must be power of 2
+static CTextLayout _atlTextCache[TEXTCACHE_SIZE];
+static CTextLayout _tlUncached;  // when cache is disabled
+
+// pending text of a batch
+static INDEX _ctTextBatchLevel = 0;
+static const CDrawPort *_pdpTextBatch = NULL;
+static CTextureData *_ptdTextBatch = NULL;
+static CStaticStackArray<GFXVertex>   _avtxText;
+static CStaticStackArray<GFXTexCoord> _atexText;
+static CStaticStackArray<GFXColor>    _acolText;
+
+// for checking that batched text is drawn the same as unbatched
+static BOOL  _bTextChecksum = FALSE;
+static ULONG _ulTextChecksum = 0;
+
+
+// forget all cached text (font has been changed)
+void ClearTextLayoutCache(void)
+{
+  for( INDEX i=0; i<TEXTCACHE_SIZE; i++) {
+    _atlTextCache[i].tl_bValid = FALSE;
+    _atlTextCache[i].tl_atgGlyphs.PopAll();
+  }
+}
+
+
+// find text layout in cache (or prepare empty one for it)
+static CTextLayout &GetTextLayout( const CDrawPort *pdp, const CTString &strText)
+{
+  const CFontData *pfd = pdp->dp_FontData;
+  TextLayoutKey tlk;
+  memset( &tlk, 0, sizeof(tlk));
+  tlk.tlk_pfd = pfd;
+  tlk.tlk_fixScalingX = FloatToInt(pdp->dp_fTextScaling*pdp->dp_fTextAspect*65536.0f);
+  tlk.tlk_fixScalingY = FloatToInt(pdp->dp_fTextScaling*65536.0f);
+  tlk.tlk_slCharSpacing = pdp->dp_pixTextCharSpacing;
+  tlk.tlk_slLineSpacing = pdp->dp_pixTextLineSpacing;
+  tlk.tlk_slSpaceEnd = pfd->fd_fcdFontCharData[' '].fcd_pixEnd;
+  tlk.tlk_slFlags = (pdp->dp_iTextMode+1) | (pfd->fd_bFixedWidth ? 4 : 0) | (gfx_bDecoratedText ? 8 : 0);
+
+  CTextLayout *ptl = &_tlUncached;
+  ULONG ulHash = 0;
+  if( gfx_bTextLayoutCache) {
+    // hash string and settings
+    ulHash = 2166136261UL;
+    for( const UBYTE *pub=(const UBYTE*)(const char*)strText; *pub!=0; pub++) ulHash = (ulHash^*pub)*16777619UL;
+    const ULONG *pulKey = (const ULONG*)&tlk;
+    for( INDEX i=0; i<(INDEX)(sizeof(tlk)/sizeof(ULONG)); i++) ulHash = (ulHash^pulKey[i])*16777619UL;
+    // if found in cache, use it
+    ptl = &_atlTextCache[(ulHash^(ulHash>>16)) & (TEXTCACHE_SIZE-1)];
+    if( ptl->tl_bValid && ptl->tl_ulHash==ulHash && memcmp( &ptl->tl_tlk, &tlk, sizeof(tlk))==0
+     && strcmp( ptl->tl_strText, strText)==0) return *ptl;
+  }
+  // replace old contents
+  CTextLayout &tl = *ptl;
+  tl.tl_bValid   = TRUE;
+  tl.tl_bLaidOut = FALSE;
+  tl.tl_ulHash   = ulHash;
+  tl.tl_tlk      = tlk;
+  tl.tl_strText  = strText;
+  tl.tl_pixWidth = -1;
+  tl.tl_atgGlyphs.PopAll();
+  return tl;
+}
+
+
+// calculate width of the longest line in text string
+static PIX CalculateTextWidth( const CDrawPort *pdp, const CTString &strText)
 {
   // prepare scaling factors
-  PIX   pixCellWidth    = dp_FontData->fd_pixCharWidth;
-  SLONG fixTextScalingX = FloatToInt(dp_fTextScaling*dp_fTextAspect*65536.0f);
+  const CFontData *pfd  = pdp->dp_FontData;
+  PIX   pixCellWidth    = pfd->fd_pixCharWidth;
+  SLONG fixTextScalingX = FloatToInt(pdp->dp_fTextScaling*pdp->dp_fTextAspect*65536.0f);
 
   // calculate width of entire text line
   PIX pixStringWidth=0, pixOldWidth=0;
@@ -1185,7 +1322,7 @@ ULONG CDrawPort::GetTextWidth( const CTString &strText) const
       continue;
     }
     // special char encountered and allowed?
-    else if( chrCurrent=='^' && dp_iTextMode!=-1) {
+    else if( chrCurrent=='^' && pdp->dp_iTextMode!=-1) {
       // get next char
       chrCurrent = strText[++i];
       switch( chrCurrent) {
@@ -1202,12 +1339,12 @@ ULONG CDrawPort::GetTextWidth( const CTString &strText) const
     else if( chrCurrent == '\t') continue;
 
     // add current letter's width to result width
-    if( !dp_FontData->fd_bFixedWidth) {
+    if( !pfd->fd_bFixedWidth) {
       // proportional font case
-      pixCharStart = dp_FontData->fd_fcdFontCharData[chrCurrent].fcd_pixStart;
-      pixCharEnd   = dp_FontData->fd_fcdFontCharData[chrCurrent].fcd_pixEnd;
+      pixCharStart = pfd->fd_fcdFontCharData[chrCurrent].fcd_pixStart;
+      pixCharEnd   = pfd->fd_fcdFontCharData[chrCurrent].fcd_pixEnd;
     }
-    pixStringWidth += (((pixCharEnd-pixCharStart)*fixTextScalingX)>>16) +dp_pixTextCharSpacing;
+    pixStringWidth += (((pixCharEnd-pixCharStart)*fixTextScalingX)>>16) +pdp->dp_pixTextCharSpacing;
     ctCharsPrinted++;
   }
   // determine largest width
@@ -1216,90 +1353,53 @@ ULONG CDrawPort::GetTextWidth( const CTString &strText) const
 }
 
 
-// writes text string on drawport (left aligned if not forced otherwise)
-void CDrawPort::PutText( const CTString &strText, PIX pixX0, PIX pixY0, const COLOR colBlend) const
+// parse text string into glyphs
+static void LayoutText( const CDrawPort *pdp, const CTString &strText, CTextLayout &tl)
 {
-  // check API and adjust position for D3D by half pixel
-  const GfxAPIType eAPI = _pGfx->gl_eCurrentAPI;
-#ifdef SE1_D3D
-  ASSERT(eAPI == GAT_OGL || eAPI == GAT_D3D || eAPI == GAT_NONE);
-#else // SE1_D3D
-  ASSERT(eAPI == GAT_OGL || eAPI == GAT_NONE);
-#endif // SE1_D3D
-
-  // skip drawing if text falls above or below draw port
-  if( pixY0>dp_Height || pixX0>dp_Width) return;
-  _pfGfxProfile.StartTimer( CGfxProfile::PTI_PUTTEXT);
   char acTmp[7]; // needed for strtoul()
   char *pcDummy; 
   INDEX iRet;
 
-  // cache char and texture dimensions
-  FLOAT fTextScalingX   = dp_fTextScaling*dp_fTextAspect;
-  SLONG fixTextScalingX = FloatToInt(fTextScalingX  *65536.0f);
-  SLONG fixTextScalingY = FloatToInt(dp_fTextScaling*65536.0f);
-  PIX pixCellWidth  = dp_FontData->fd_pixCharWidth;
-  PIX pixCharHeight = dp_FontData->fd_pixCharHeight-1;
+  // cache char dimensions
+  const CFontData *pfd  = pdp->dp_FontData;
+  SLONG fixTextScalingX = FloatToInt(pdp->dp_fTextScaling*pdp->dp_fTextAspect*65536.0f);
+  SLONG fixTextScalingY = FloatToInt(pdp->dp_fTextScaling*65536.0f);
+  PIX pixCellWidth  = pfd->fd_pixCharWidth;
+  PIX pixCharHeight = pfd->fd_pixCharHeight-1;
   PIX pixScaledWidth  = (pixCellWidth *fixTextScalingX)>>16;
   PIX pixScaledHeight = (pixCharHeight*fixTextScalingY)>>16;
-
-  // prepare font texture
-  gfxSetTextureWrapping( GFX_REPEAT, GFX_REPEAT);
-  CTextureData &td = *dp_FontData->fd_ptdTextureData;
-  td.SetAsCurrent();
-  // setup rendering mode
-  gfxDisableDepthTest();
-  gfxDisableDepthWrite();
-  gfxDisableAlphaTest();
-  gfxEnableBlend();
-  gfxBlendFunc( GFX_SRC_ALPHA, GFX_INV_SRC_ALPHA);
-
-  // calculate and apply correction factor
-  FLOAT fCorrectionU = 1.0f / td.GetPixWidth();
-  FLOAT fCorrectionV = 1.0f / td.GetPixHeight();
   INDEX ctMaxChars = (INDEX)strlen(strText);
-  // determine text color
-  GFXColor glcolDefault( AdjustColor( colBlend, _slTexHueShift, _slTexSaturation));
-  GFXColor glcol = glcolDefault;
-  ULONG ulAlphaDefault = (colBlend&CT_AMASK)>>CT_ASHIFT;;  // for flasher
-  ASSERT( dp_iTextMode==-1 || dp_iTextMode==0 || dp_iTextMode==+1);
-
-  // prepare some text control and output vars
-  INDEX ctCharsPrinted=0, ctBoldsPrinted=0;
-  BOOL bBold    = FALSE;
-  BOOL bItalic  = FALSE;
+  ASSERT( pdp->dp_iTextMode==-1 || pdp->dp_iTextMode==0 || pdp->dp_iTextMode==+1);
+
+  // prepare some text control vars
+  ULONG ulFlags = 0;
   INDEX iFlash  = 0;
-  ULONG ulAlpha = ulAlphaDefault;
-  TIME tmFrame  = _pGfx->gl_tvFrameTime.GetSeconds();
-  BOOL bParse = dp_iTextMode==1;
+  COLOR colCode = 0;
+  UBYTE ubAlpha = 0;
+  BOOL bParse = pdp->dp_iTextMode==1;
 
-  // prepare arrays
-  gfxResetArrays();
-  GFXVertex   *pvtx = _avtxCommon.Push( 2*ctMaxChars*4);  // 2* because of bold
-  GFXTexCoord *ptex = _atexCommon.Push( 2*ctMaxChars*4);
-  GFXColor    *pcol = _acolCommon.Push( 2*ctMaxChars*4);
+  tl.tl_atgGlyphs.PopAll();
+  TextGlyph *ptg = tl.tl_atgGlyphs.Push(ctMaxChars);
+  INDEX ctGlyphs = 0;
 
   // loop thru chars
-  PIX pixAdvancer = ((pixCellWidth*fixTextScalingX)>>16) +dp_pixTextCharSpacing;
-  PIX pixStartX = pixX0;
+  PIX pixX0=0, pixY0=0;
+  PIX pixAdvancer = ((pixCellWidth*fixTextScalingX)>>16) +pdp->dp_pixTextCharSpacing;
   for( INDEX iChar=0; iChar<ctMaxChars; iChar++)
   {
     // get current char
     unsigned char chrCurrent = strText[iChar];
     // if at end of current line
     if( chrCurrent=='\n') {
-      // advance to next line
-      pixX0  = pixStartX;
-      pixY0 += pixScaledHeight+dp_pixTextLineSpacing;
-      if( pixY0>dp_Height) break;
-      // skip to next char
+      // advance to next line (lines below drawport are skipped when drawn)
+      pixX0  = 0;
+      pixY0 += pixScaledHeight+pdp->dp_pixTextLineSpacing;
       continue;
     }
     // special char encountered and allowed?
-    else if( chrCurrent=='^' && dp_iTextMode!=-1) {
+    else if( chrCurrent=='^' && pdp->dp_iTextMode!=-1) {
       // get next char
       chrCurrent = strText[++iChar];
-      COLOR col;
       switch( chrCurrent)
       {
       // color change?
@@ -1309,9 +1409,8 @@ void CDrawPort::PutText( const CTString &strText, PIX pixX0, PIX pixY0, const CO
         iChar+=iRet;
         if( !bParse || iRet<6) continue;
         acTmp[6] = '\0'; // terminate string
-        col = strtoul( acTmp, &pcDummy, 16) <<8;
-        col = AdjustColor( col, _slTexHueShift, _slTexSaturation);
-        glcol.Set( col|glcol.gfxcol.ub.a); // do color change but keep original alpha
+        colCode = strtoul( acTmp, &pcDummy, 16) <<8;
+        ulFlags |= TGF_CODECOLOR;
         continue;
       // alpha change?
       case 'a':
@@ -1320,7 +1419,8 @@ void CDrawPort::PutText( const CTString &strText, PIX pixX0, PIX pixY0, const CO
         iChar+=iRet;
         if( !bParse || iRet<2) continue;
         acTmp[2] = '\0'; // terminate string
-        ulAlpha = strtoul( acTmp, &pcDummy, 16);
+        ubAlpha = strtoul( acTmp, &pcDummy, 16);
+        ulFlags |= TGF_CODEALPHA;
         continue;
       // flash?
       case 'f':
@@ -1329,21 +1429,18 @@ void CDrawPort::PutText( const CTString &strText, PIX pixX0, PIX pixY0, const CO
         continue;
       // reset all?
       case 'r':
-        bBold   = FALSE;
-        bItalic = FALSE;
+        ulFlags = 0;
         iFlash  = 0;
-        glcol   = glcolDefault;
-        ulAlpha = ulAlphaDefault;
         continue;
       // simple codes ...
-      case 'o':  bParse = bParse && gfx_bDecoratedText;  continue;  // allow console override settings?
-      case 'b':  if( bParse) bBold   = TRUE;  continue;  // bold?
-      case 'i':  if( bParse) bItalic = TRUE;  continue;  // italic?
-      case 'C':  glcol   = glcolDefault;      continue;  // color reset?
-      case 'A':  ulAlpha = ulAlphaDefault;    continue;  // alpha reset?
-      case 'B':  bBold   = FALSE;             continue;  // no bold?
-      case 'I':  bItalic = FALSE;             continue;  // italic?
-      case 'F':  iFlash  = 0;                 continue;  // no flash?
+      case 'o':  bParse = bParse && gfx_bDecoratedText;   continue;  // allow console override settings?
+      case 'b':  if( bParse) ulFlags |= TGF_BOLD;         continue;  // bold?
+      case 'i':  if( bParse) ulFlags |= TGF_ITALIC;       continue;  // italic?
+      case 'C':  ulFlags &= ~TGF_CODECOLOR;               continue;  // color reset?
+      case 'A':  ulFlags &= ~TGF_CODEALPHA;               continue;  // alpha reset?
+      case 'B':  ulFlags &= ~TGF_BOLD;                    continue;  // no bold?
+      case 'I':  ulFlags &= ~TGF_ITALIC;                  continue;  // italic?
+      case 'F':  iFlash  = 0;                             continue;  // no flash?
       default:   break;
       } // unrecognized special code or just plain ^
       if( chrCurrent!='^') { iChar--; break; }
@@ -1351,38 +1448,103 @@ void CDrawPort::PutText( const CTString &strText, PIX pixX0, PIX pixY0, const CO
     // ignore tab
     else if( chrCurrent=='\t') continue;
 
-    // get current location and dimensions
-    CFontCharData &fcdCurrent = dp_FontData->fd_fcdFontCharData[chrCurrent];
-    PIX pixCharX = fcdCurrent.fcd_pixXOffset;
-    PIX pixCharY = fcdCurrent.fcd_pixYOffset;
+    // get current dimensions
+    const CFontCharData &fcdCurrent = pfd->fd_fcdFontCharData[chrCurrent];
     PIX pixCharStart = fcdCurrent.fcd_pixStart;
     PIX pixCharEnd   = fcdCurrent.fcd_pixEnd;
     PIX pixXA; // adjusted starting X location of printout
 
     // determine corresponding char width and position adjustments
-    if( dp_FontData->fd_bFixedWidth) {
+    if( pfd->fd_bFixedWidth) {
       // for fixed font
       pixXA = pixX0 - ((pixCharStart*fixTextScalingX)>>16)
             + (((pixScaledWidth<<16) - ((pixCharEnd-pixCharStart)*fixTextScalingX) +0x10000) >>17);
     } else {
       // for proportional font
       pixXA = pixX0 - ((pixCharStart*fixTextScalingX)>>16);
-      pixAdvancer = (((pixCharEnd-pixCharStart)*fixTextScalingX)>>16) +dp_pixTextCharSpacing;
-    }
-    // out of screen (left) ?
-    if( pixXA>dp_Width || (pixXA+pixCharEnd)<0) {
-      // skip to next char
-      pixX0 += pixAdvancer;
-      continue; 
+      pixAdvancer = (((pixCharEnd-pixCharStart)*fixTextScalingX)>>16) +pdp->dp_pixTextCharSpacing;
     }
 
+    // remember glyph
+    TextGlyph &tg = ptg[ctGlyphs++];
+    tg.tg_pixX = pixXA;
+    tg.tg_pixY = pixY0;
+    tg.tg_pixCharEnd = pixCharEnd;
+    tg.tg_colCode  = colCode;
+    tg.tg_ubChar   = chrCurrent;
+    tg.tg_ubFlags  = (UBYTE)ulFlags;
+    tg.tg_ubAlpha  = ubAlpha;
+    tg.tg_ubFlash  = (UBYTE)iFlash;
+
+    // advance to next char
+    pixX0 += pixAdvancer;
+  }
+
+  // adjust glyph array size according to chars that really will be printed out
+  tl.tl_atgGlyphs.PopUntil( ctGlyphs-1);
+  tl.tl_bLaidOut = TRUE;
+}
+
+
+// put glyphs of text to vertex arrays (returns number of quads)
+static INDEX EmitTextGlyphs( const CDrawPort *pdp, const CTextLayout &tl, PIX pixX0, PIX pixY0, const COLOR colBlend,
+                             GFXVertex *pvtx, GFXTexCoord *ptex, GFXColor *pcol)
+{
+  // cache char and texture dimensions
+  const CFontData *pfd  = pdp->dp_FontData;
+  FLOAT fTextScalingX   = pdp->dp_fTextScaling*pdp->dp_fTextAspect;
+  SLONG fixTextScalingX = FloatToInt(fTextScalingX  *65536.0f);
+  SLONG fixTextScalingY = FloatToInt(pdp->dp_fTextScaling*65536.0f);
+  PIX pixCellWidth  = pfd->fd_pixCharWidth;
+  PIX pixCharHeight = pfd->fd_pixCharHeight-1;
+  PIX pixScaledWidth  = (pixCellWidth *fixTextScalingX)>>16;
+  PIX pixScaledHeight = (pixCharHeight*fixTextScalingY)>>16;
+  CTextureData &td = *pfd->fd_ptdTextureData;
+  FLOAT fCorrectionU = 1.0f / td.GetPixWidth();
+  FLOAT fCorrectionV = 1.0f / td.GetPixHeight();
+
+  // determine text color
+  GFXColor glcolDefault( AdjustColor( colBlend, _slTexHueShift, _slTexSaturation));
+  ULONG ulAlphaDefault = (colBlend&CT_AMASK)>>CT_ASHIFT;  // for flasher
+  TIME tmFrame = _pGfx->gl_tvFrameTime.GetSeconds();
+  // color from ^c is adjusted only when it changes
+  GFXColor glcolCode;
+  COLOR colLastCode = 0;
+  BOOL  bCodeAdjusted = FALSE;
+
+  INDEX ctQuads = 0;
+  const INDEX ctGlyphs = tl.tl_atgGlyphs.Count();
+  for( INDEX iGlyph=0; iGlyph<ctGlyphs; iGlyph++)
+  {
+    const TextGlyph &tg = tl.tl_atgGlyphs[iGlyph];
+    // below drawport?
+    const PIX pixY = pixY0+tg.tg_pixY;
+    if( pixY>pdp->dp_Height) break;
+    // out of screen (left or right) ?
+    const PIX pixXA = pixX0+tg.tg_pixX;
+    if( pixXA>pdp->dp_Width || (pixXA+tg.tg_pixCharEnd)<0) continue;
+
+    // determine color
+    GFXColor glcol = glcolDefault;
+    if( tg.tg_ubFlags&TGF_CODECOLOR) {
+      if( !bCodeAdjusted || tg.tg_colCode!=colLastCode) {
+        glcolCode.Set( AdjustColor( tg.tg_colCode, _slTexHueShift, _slTexSaturation));
+        colLastCode   = tg.tg_colCode;
+        bCodeAdjusted = TRUE;
+      }
+      glcol = glcolCode;
+    }
     // adjust alpha for flashing
-    if( iFlash>0) glcol.gfxcol.ub.a = ulAlpha*(sin(iFlash*tmFrame)*0.5f+0.5f);
+    const ULONG ulAlpha = (tg.tg_ubFlags&TGF_CODEALPHA) ? tg.tg_ubAlpha : ulAlphaDefault;
+    if( tg.tg_ubFlash>0) glcol.gfxcol.ub.a = ulAlpha*(sin(tg.tg_ubFlash*tmFrame)*0.5f+0.5f);
     else glcol.gfxcol.ub.a = ulAlpha; 
 
     // prepare coordinates for screen and texture
+    const CFontCharData &fcdCurrent = pfd->fd_fcdFontCharData[tg.tg_ubChar];
+    PIX pixCharX = fcdCurrent.fcd_pixXOffset;
+    PIX pixCharY = fcdCurrent.fcd_pixYOffset;
     const FLOAT fX0 = pixXA;  const FLOAT fX1 = fX0 +pixScaledWidth;
-    const FLOAT fY0 = pixY0;  const FLOAT fY1 = fY0 +pixScaledHeight;
+    const FLOAT fY0 = pixY;   const FLOAT fY1 = fY0 +pixScaledHeight;
     const FLOAT fU0 = pixCharX *fCorrectionU;  const FLOAT fU1 = (pixCharX+pixCellWidth)  *fCorrectionU;
     const FLOAT fV0 = pixCharY *fCorrectionV;  const FLOAT fV1 = (pixCharY+pixCharHeight) *fCorrectionV;
     pvtx[0].x = fX0;  pvtx[0].y = fY0;  pvtx[0].z = 0;
@@ -1399,7 +1561,7 @@ void CDrawPort::PutText( const CTString &strText, PIX pixX0, PIX pixY0, const CO
     pcol[3] = glcol;
 
     // adjust for italic
-    if( bItalic) {
+    if( tg.tg_ubFlags&TGF_ITALIC) {
       const FLOAT fAdjustX = fTextScalingX * (fY1-fY0)*0.2f;  // 20% slanted
       pvtx[0].x += fAdjustX;
       pvtx[3].x += fAdjustX;
@@ -1408,8 +1570,9 @@ void CDrawPort::PutText( const CTString &strText, PIX pixX0, PIX pixY0, const CO
     pvtx += 4;
     ptex += 4;
     pcol += 4;
+    ctQuads++;
     // add bold char
-    if( bBold) {
+    if( tg.tg_ubFlags&TGF_BOLD) {
       const FLOAT fAdjustX = fTextScalingX * ((FLOAT)pixCellWidth)*0.1f;  // 10% fat (extra light mayonnaise:)
       pvtx[0].x = pvtx[0-4].x +fAdjustX;  pvtx[0].y = fY0;  pvtx[0].z = 0;
       pvtx[1].x = pvtx[1-4].x +fAdjustX;  pvtx[1].y = fY1;  pvtx[1].z = 0;
@@ -1426,19 +1589,144 @@ void CDrawPort::PutText( const CTString &strText, PIX pixX0, PIX pixY0, const CO
       pvtx += 4;
       ptex += 4;
       pcol += 4;
-      ctBoldsPrinted++;
+      ctQuads++;
     }
-    // advance to next char
-    pixX0 += pixAdvancer;
-    ctCharsPrinted++;
   }
+  return ctQuads;
+}
+
+
+// prepare font texture and rendering mode for text
+static void SetTextRenderingState( CTextureData &td)
+{
+  gfxSetTextureWrapping( GFX_REPEAT, GFX_REPEAT);
+  td.SetAsCurrent();
+  gfxDisableDepthTest();
+  gfxDisableDepthWrite();
+  gfxDisableAlphaTest();
+  gfxEnableBlend();
+  gfxBlendFunc( GFX_SRC_ALPHA, GFX_INV_SRC_ALPHA);
+}
+
 
-  // adjust vertex arrays size according to chars that really got printed out
-  ctCharsPrinted += ctBoldsPrinted;
-  _avtxCommon.PopUntil( ctCharsPrinted*4-1);
-  _atexCommon.PopUntil( ctCharsPrinted*4-1);
-  _acolCommon.PopUntil( ctCharsPrinted*4-1);
+// draw text quads from common arrays
+static void FlushTextQuads(void)
+{
+  const INDEX ctVertices = _avtxCommon.Count();
+  if( _bTextChecksum && ctVertices>0) {
+    CRC_AddBlock( _ulTextChecksum, (UBYTE*)&_avtxCommon[0], ctVertices*sizeof(GFXVertex));
+    CRC_AddBlock( _ulTextChecksum, (UBYTE*)&_atexCommon[0], ctVertices*sizeof(GFXTexCoord));
+    CRC_AddBlock( _ulTextChecksum, (UBYTE*)&_acolCommon[0], ctVertices*sizeof(GFXColor));
+  }
   gfxFlushQuads();
+}
+
+
+// draw text gathered in current batch
+static void DrawTextBatch(void)
+{
+  const INDEX ctVertices = _avtxText.Count();
+  ASSERT( _ptdTextBatch!=NULL && ctVertices>0);
+  SetTextRenderingState(*_ptdTextBatch);
+  gfxResetArrays();
+  memcpy( _avtxCommon.Push(ctVertices), &_avtxText[0], ctVertices*sizeof(GFXVertex));
+  memcpy( _atexCommon.Push(ctVertices), &_atexText[0], ctVertices*sizeof(GFXTexCoord));
+  memcpy( _acolCommon.Push(ctVertices), &_acolText[0], ctVertices*sizeof(GFXColor));
+  FlushTextQuads();
+  _avtxText.PopAll();
+  _atexText.PopAll();
+  _acolText.PopAll();
+}
+
+// draw pending text (if any) before anything else gets drawn
+static void FlushTextBatch(void)
+{
+  if( _avtxText.Count()>0) DrawTextBatch();
+}
+
+
+// start gathering text (batches can be nested)
+void CDrawPort::BeginTextBatch(void) const
+{
+  _ctTextBatchLevel++;
+}
+
+// draw all text that has been gathered since the batch was started
+void CDrawPort::EndTextBatch(void) const
+{
+  ASSERT( _ctTextBatchLevel>0);
+  _ctTextBatchLevel--;
+  if( _ctTextBatchLevel==0) {
+    FlushTextBatch();
+    _pdpTextBatch = NULL;
+    _ptdTextBatch = NULL;
+  }
+}
+
+
+// returns width of the longest line in text string
+ULONG CDrawPort::GetTextWidth( const CTString &strText) const
+{
+  if( !gfx_bTextLayoutCache) return CalculateTextWidth( this, strText);
+  // width of cached text is calculated only once
+  CTextLayout &tl = GetTextLayout( this, strText);
+  if( tl.tl_pixWidth<0) tl.tl_pixWidth = CalculateTextWidth( this, strText);
+  return tl.tl_pixWidth;
+}
+
+
+// writes text string on drawport (left aligned if not forced otherwise)
+void CDrawPort::PutText( const CTString &strText, PIX pixX0, PIX pixY0, const COLOR colBlend) const
+{
+  // check API and adjust position for D3D by half pixel
+  const GfxAPIType eAPI = _pGfx->gl_eCurrentAPI;
+#ifdef SE1_D3D
+  ASSERT(eAPI == GAT_OGL || eAPI == GAT_D3D || eAPI == GAT_NONE);
+#else // SE1_D3D
+  ASSERT(eAPI == GAT_OGL || eAPI == GAT_NONE);
+#endif // SE1_D3D
+
+  // skip drawing if text falls above or below draw port
+  if( pixY0>dp_Height || pixX0>dp_Width) return;
+  _pfGfxProfile.StartTimer( CGfxProfile::PTI_PUTTEXT);
+
+  // get parsed text
+  CTextLayout &tl = GetTextLayout( this, strText);
+  if( !tl.tl_bLaidOut) LayoutText( this, strText, tl);
+  const INDEX ctMaxQuads = tl.tl_atgGlyphs.Count()*2;  // 2* because of bold
+  CTextureData *ptd = dp_FontData->fd_ptdTextureData;
+
+  // if batching
+  if( _ctTextBatchLevel>0 && gfx_bTextBatching) {
+    // draw what has been gathered if this text cannot go along
+    if( _pdpTextBatch!=this || _ptdTextBatch!=ptd) FlushTextBatch();
+    _pdpTextBatch = this;
+    _ptdTextBatch = ptd;
+    // just add text to batch
+    const INDEX iFirst = _avtxText.Count();
+    GFXVertex   *pvtx = _avtxText.Push( ctMaxQuads*4);
+    GFXTexCoord *ptex = _atexText.Push( ctMaxQuads*4);
+    GFXColor    *pcol = _acolText.Push( ctMaxQuads*4);
+    const INDEX ctQuads = EmitTextGlyphs( this, tl, pixX0, pixY0, colBlend, pvtx, ptex, pcol);
+    _avtxText.PopUntil( iFirst+ctQuads*4-1);
+    _atexText.PopUntil( iFirst+ctQuads*4-1);
+    _acolText.PopUntil( iFirst+ctQuads*4-1);
+  }
+  // if not batching
+  else {
+    // draw it right away
+    FlushTextBatch();
+    SetTextRenderingState(*ptd);
+    gfxResetArrays();
+    GFXVertex   *pvtx = _avtxCommon.Push( ctMaxQuads*4);
+    GFXTexCoord *ptex = _atexCommon.Push( ctMaxQuads*4);
+    GFXColor    *pcol = _acolCommon.Push( ctMaxQuads*4);
+    const INDEX ctQuads = EmitTextGlyphs( this, tl, pixX0, pixY0, colBlend, pvtx, ptex, pcol);
+    _avtxCommon.PopUntil( ctQuads*4-1);
+    _atexCommon.PopUntil( ctQuads*4-1);
+    _acolCommon.PopUntil( ctQuads*4-1);
+    FlushTextQuads();
+  }
 
   // all done
   _pfGfxProfile.StopTimer( CGfxProfile::PTI_PUTTEXT);
@@ -1489,6 +1777,7 @@ void CDrawPort::PutTexture( class CTextureObject *pTO, const PIXaabbox2D &boxScr
 void CDrawPort::PutTexture( class CTextureObject *pTO, const PIXaabbox2D &boxScreen,
                             const COLOR colUL, const COLOR colUR, const COLOR colDL, const COLOR colDR) const
 {
+  FlushTextBatch();
   MEXaabbox2D boxTexture( MEX2D(0,0), MEX2D(pTO->GetWidth(), pTO->GetHeight()));
   PutTexture( pTO, boxScreen, boxTexture, colUL, colUR, colDL, colDR);
 }
@@ -1498,6 +1787,7 @@ void CDrawPort::PutTexture( class CTextureObject *pTO,
                             const PIXaabbox2D &boxScreen, const MEXaabbox2D &boxTexture,
                             const COLOR colUL, const COLOR colUR, const COLOR colDL, const COLOR colDR) const
 {
+  FlushTextBatch();
   _pfGfxProfile.StartTimer( CGfxProfile::PTI_PUTTEXTURE);
 
   // extract screen and texture coordinates
@@ -1585,6 +1875,7 @@ void CDrawPort::PutTexture( class CTextureObject *pTO,
 // prepares texture and rendering arrays
 void CDrawPort::InitTexture( class CTextureObject *pTO, const BOOL bClamp/*=FALSE*/) const
 {
+  FlushTextBatch();
   // prepare
   if( pTO!=NULL) {
     // has texture
@@ -1726,6 +2017,7 @@ void CDrawPort::FlushRenderingQueue(void) const
 // blends screen with accumulation color
 void CDrawPort::BlendScreen(void)
 {
+  FlushTextBatch();
   if( dp_ulBlendingA==0) return;
 
   ULONG fix1oA = 65536 / dp_ulBlendingA;
@@ -1769,3 +2061,132 @@ void CDrawPort::BlendScreen(void)
   dp_ulBlendingA  = 0;
 }
 
+
+
+// one frame of typical console and scoreboard text
+static void DrawBenchmarkText( CDrawPort &dp, CFontData *pfdConsole, CFontData *pfdHUD,
+                               const CTString *astrLines, INDEX ctLines, const CTString *astrNames, INDEX ctPlayers)
+{
+  const PIX pixWidth = dp.GetWidth();
+  // console with some filter underneath
+  dp.Fill( 0, 0, pixWidth, dp.GetHeight()/2, C_BLACK|128);
+  dp.BeginTextBatch();
+  pfdConsole->SetFixedWidth();
+  dp.SetFont( pfdConsole);
+  dp.SetTextScaling( 1.0f);
+  const PIX pixLineHeight = pfdConsole->GetHeight();
+  for( INDEX iLine=0; iLine<ctLines; iLine++) {
+    dp.PutText( astrLines[iLine], 4, iLine*pixLineHeight, C_GREEN|255);
+  }
+  dp.EndTextBatch();
+
+  // scoreboard in upper right corner
+  dp.BeginTextBatch();
+  dp.SetFont( pfdHUD);
+  dp.SetTextScaling( 1.0f);
+  const PIX pixCharWidth  = pfdHUD->GetWidth();
+  const PIX pixCharHeight = pfdHUD->GetHeight();
+  for( INDEX iPlayer=0; iPlayer<ctPlayers; iPlayer++) {
+    CTString strScore, strMana;
+    strScore.PrintF( "%d", iPlayer*1250);
+    strMana.PrintF(  "%d", iPlayer*37);
+    const PIX pixY = iPlayer*pixCharHeight;
+    dp.PutTextR( astrNames[iPlayer]+":", pixWidth-12*pixCharWidth, pixY, C_lGRAY|255);
+    dp.PutText(  "/",                    pixWidth- 5*pixCharWidth, pixY, C_WHITE|255);
+    dp.PutTextC( strScore,               pixWidth- 8*pixCharWidth, pixY, C_WHITE|255);
+    dp.PutTextC( strMana,                pixWidth- 2*pixCharWidth, pixY, C_lGRAY|255);
+  }
+  dp.EndTextBatch();
+}
+
+
+// measure console and scoreboard text output through the recording (NONE) graphics API
+// with and without text layout cache and text batching
+void TextBenchmark(void *pArgs)
+{
+  INDEX ctFrames = NEXTARGUMENT(INDEX);
+  if( ctFrames<=0) ctFrames = 200;
+  const PIX pixSizeI = 1024;
+  const PIX pixSizeJ = 768;
+
+  if( _pGfx->gl_eCurrentAPI!=GAT_NONE) {
+    CPrintF( TRANS("Text benchmark needs the NONE graphics API (headless mode).\n"));
+    return;
+  }
+  if( _pfdConsoleFont==NULL) {
+    CPrintF( TRANS("Text benchmark needs the console font.\n"));
+    return;
+  }
+  CFontData *pfdHUD = (_pfdDisplayFont!=NULL) ? _pfdDisplayFont : _pfdConsoleFont;
+
+  // text as it usually looks in console and in scoreboard
+  const INDEX ctLines = 48;
+  const INDEX ctPlayers = 16;
+  CTString astrLines[ctLines];
+  CTString astrNames[ctPlayers];
+  for( INDEX iLine=0; iLine<ctLines; iLine++) {
+    switch( iLine%4) {
+    case 0: astrLines[iLine].PrintF( "Player%d connected (%d.%d.%d.%d)", iLine, iLine, iLine*3, iLine*7, iLine*11); break;
+    case 1: astrLines[iLine].PrintF( "^cff8000Player%d^C: ^bgg^B ^iwp^I ^a80%d frags^A", iLine, iLine*5); break;
+    case 2: astrLines[iLine].PrintF( "^f5Warning:^F\tserver will change level in %d seconds", iLine); break;
+    case 3: astrLines[iLine].PrintF( "Loading world \"Levels\\\\Level%02d.wld\"...\ndone.", iLine); break;
+    }
+  }
+  for( INDEX iPlayer=0; iPlayer<ctPlayers; iPlayer++) {
+    astrNames[iPlayer].PrintF( "^c%02x80ffPlayer^r%d", iPlayer*16, iPlayer);
+  }
+
+  // offscreen raster without any viewport
+  CRaster raNull( pixSizeI, pixSizeJ, 0);
+  CDrawPort &dp = raNull.ra_MainDrawPort;
+
+  const BOOL bFixedWidth = _pfdConsoleFont->IsFixedWidth();
+  const INDEX iOldBatching = gfx_bTextBatching;
+  const INDEX iOldCache = gfx_bTextLayoutCache;
+  const CTimerValue tvFrame = _pGfx->gl_tvFrameTime;
+  ULONG ulReference = 0;
+  static const char *astrModes[] = { "unbatched, uncached", "unbatched, cached", "batched, cached" };
+
+  CPrintF( TRANS("Text benchmark (%d lines, %d players, %d frames):\n"), ctLines, ctPlayers, ctFrames);
+  for( INDEX iMode=0; iMode<3; iMode++)
+  {
+    gfx_bTextLayoutCache = iMode>=1;
+    gfx_bTextBatching = iMode==2;
+    ClearTextLayoutCache();
+
+    // one frame to check that all text is drawn the same (and to fill the cache)
+    _pGfx->gl_tvFrameTime = tvFrame;  // for flashing text
+    _bTextChecksum = TRUE;
+    CRC_Start(_ulTextChecksum);
+    if( dp.Lock()) {
+      DrawBenchmarkText( dp, _pfdConsoleFont, pfdHUD, astrLines, ctLines, astrNames, ctPlayers);
+      dp.Unlock();
+    }
+    CRC_Finish(_ulTextChecksum);
+    _bTextChecksum = FALSE;
+    if( iMode==0) ulReference = _ulTextChecksum;
+    _pGfx->SwapBuffers(NULL);
+
+    GFX_nsNullAPI.Clear();
+    CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+    for( INDEX iFrame=0; iFrame<ctFrames; iFrame++) {
+      if( dp.Lock()) {
+        DrawBenchmarkText( dp, _pfdConsoleFont, pfdHUD, astrLines, ctLines, astrNames, ctPlayers);
+        dp.Unlock();
+      }
+      _pGfx->SwapBuffers(NULL);
+    }
+    CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+
+    CPrintF( TRANS("  %-20s %6.3f ms/frame, %4d draws/frame, %4d state changes/frame, %s\n"), astrModes[iMode],
+             (tv1-tv0).GetSeconds()*1000.0/ctFrames, GFX_nsNullAPI.ns_ctDrawCalls/ctFrames,
+             GFX_nsNullAPI.ns_ctStateChanges/ctFrames,
+             (_ulTextChecksum==ulReference) ? TRANS("match") : TRANS("MISMATCH!"));
+  }
+
+  // restore settings
+  gfx_bTextBatching = iOldBatching;
+  gfx_bTextLayoutCache = iOldCache;
+  if( !bFixedWidth) _pfdConsoleFont->SetVariableWidth();
+  ClearTextLayoutCache();
+}
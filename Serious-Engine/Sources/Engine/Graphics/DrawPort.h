@@ -107,6 +107,9 @@ public:
   void PutTextCXY( const CTString &strText, PIX pixX0, PIX pixY0, const COLOR colBlend=0xFFFFFFFF) const;
   // writes text string on drawport (right-aligned)
   void PutTextR(   const CTString &strText, PIX pixX0, PIX pixY0, const COLOR colBlend=0xFFFFFFFF) const;
+  // gather text of same font into one draw until end of batch (or until anything else is drawn)
+  void BeginTextBatch(void) const;
+  void EndTextBatch(void) const;
 
   // plain texture display
   void PutTexture( class CTextureObject *pTO, const PIXaabbox2D &boxScreen,
@@ -195,6 +198,8 @@ ENGINE_API CProjection3D *Particle_GetProjection(void);
 void ENGINE_API Particle_PrepareTexture( CTextureObject *pto, enum ParticleBlendType pbt);
 void ENGINE_API Particle_SetTexturePart( MEX mexWidth, MEX mexHeight, INDEX iCol, INDEX iRow);
 void ENGINE_API Particle_RenderSquare( const FLOAT3D &vPos, FLOAT fSize, ANGLE aRotation, COLOR col, FLOAT fYRatio=1.0f);
+void ENGINE_API Particle_RenderSquares( INDEX ctParticles, const FLOAT3D *avPos, const FLOAT *afSize, const ANGLE *aaRotation,
+                                       const COLOR *acol, FLOAT fYRatio=1.0f);
 void ENGINE_API Particle_RenderQuad3D( const FLOAT3D &vPos0, const FLOAT3D &vPos1, const FLOAT3D &vPos2,
                                        const FLOAT3D &vPos3, COLOR col);
 void ENGINE_API Particle_RenderLine( const FLOAT3D &vPos0, const FLOAT3D &vPos1, FLOAT fWidth, COLOR col);
@@ -24,9 +24,27 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Graphics/Fog_internal.h>
 #include <Engine/Base/Statistics_Internal.h>
 
+#include <Engine/Base/Shell.h>
+#include <Engine/Base/Timer.h>
+#include <Engine/Base/Console.h>
+#include <Engine/Base/Translation.h>
+
 #include <Engine/Templates/StaticArray.cpp>
 #include <Engine/Templates/StaticStackArray.cpp>
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PARTICLE_NEON 1
+#else
+#define PARTICLE_NEON 0
+#endif
+#if !PARTICLE_NEON && defined(__SSE2__)
+#include <emmintrin.h>
+#define PARTICLE_SSE2 1
+#else
+#define PARTICLE_SSE2 0
+#endif
+
 
 extern const FLOAT *pfSinTable;
 extern const FLOAT *pfCosTable;
@@ -51,6 +69,12 @@ static CDrawPort *_pDP;
 static CStaticStackArray<GFXTexCoord> _atexFogHaze;
 static CTextureData *_ptd = NULL;
 static INDEX _iFrame = 0;
+static BOOL _bReferenceParticles = FALSE;  // for benchmarking only
+
+// visible particle squares of a batch (projected)
+static CStaticStackArray<FLOAT> _afSquareI, _afSquareJ, _afSquareOoK, _afSquareRX, _afSquareRY;
+static CStaticStackArray<ANGLE> _aaSquareRotation;
+static CStaticStackArray<GFXColor> _acolSquare;
 
 
 
@@ -188,20 +212,19 @@ void Particle_SetTexturePart( MEX mexWidth, MEX mexHeight, INDEX iCol, INDEX iRo
 
 
 
-// add one particle square to rendering queue
-void Particle_RenderSquare( const FLOAT3D &vPos, FLOAT fSize, ANGLE aRotation, COLOR col, FLOAT fYRatio/*=1.0f*/)
+// project one particle square and apply fog/haze to its color (returns FALSE if it is not visible)
+static inline BOOL PrepareSquare( const FLOAT3D &vPos, FLOAT fSize, COLOR &col, FLOAT3D &vProjected)
 {
   // trivial rejection
-  if( fSize<0.0001f || ((col&CT_AMASK)>>CT_ASHIFT)<2) return;
+  if( fSize<0.0001f || ((col&CT_AMASK)>>CT_ASHIFT)<2) return FALSE;
 
   // project point to screen
-  FLOAT3D vProjected;
   _pprProjection->PreClip( vPos, vProjected);
   // skip if not in screen
   const INDEX iTest = _pprProjection->TestSphereToFrustum( vProjected, fSize);
-  if( iTest<0) return;
+  if( iTest<0) return FALSE;
   const FLOAT fPixSize = fSize * _fPerspectiveFactor / vProjected(3);
-  if( fPixSize<0.5f) return;
+  if( fPixSize<0.5f) return FALSE;
 
   // adjust the need for clipping
   if( iTest==0) _bNeedsClipping = TRUE;
@@ -215,7 +238,7 @@ void Particle_RenderSquare( const FLOAT3D &vPos, FLOAT fSize, ANGLE aRotation, C
   { // get haze strength at particle position
     ptexFogHaze[0].gfxtc.st.s = (-vProjected(3)+_haze_fAdd)*_haze_fMul;
     const ULONG ulH = 255-GetHazeAlpha(ptexFogHaze[0].gfxtc.st.s);
-    if( ulH<4) return;
+    if( ulH<4) return FALSE;
     if( _colAttMask) { // apply haze color (if not transparent)
       const COLOR colH = _colAttMask | RGBAToColor( ulH,ulH,ulH,ulH);
       col = MulColors( col, colH);
@@ -227,7 +250,7 @@ void Particle_RenderSquare( const FLOAT3D &vPos, FLOAT fSize, ANGLE aRotation, C
     ptexFogHaze[0].gfxtc.st.s = -vProjected(3)*_fog_fMulZ;
     ptexFogHaze[0].gfxtc.st.t = (vProjected%_fog_vHDirView+_fog_fAddH)*_fog_fMulH;
     const ULONG ulF = 255-GetFogAlpha(ptexFogHaze[0]);
-    if( ulF<4) return;
+    if( ulF<4) return FALSE;
     if( _colAttMask) { // apply fog color (if not transparent)
       const COLOR colF = _colAttMask | RGBAToColor( ulF,ulF,ulF,ulF);
       col = MulColors( col, colF);
@@ -239,19 +262,15 @@ void Particle_RenderSquare( const FLOAT3D &vPos, FLOAT fSize, ANGLE aRotation, C
     _atexFogHaze.Push(4);
   }
 
-  // prepare screen coords
-  const FLOAT fI0  = vProjected(1);
-  const FLOAT fJ0  = vProjected(2);
-  const FLOAT fOoK = vProjected(3);
+  return TRUE;
+}
 
-  // add to vertex arrays
-  GFXVertex4  *pvtx = _avtxCommon.Push(4);
-  GFXTexCoord *ptex = _atexCommon.Push(4);
-  GFXColor    *pcol = _acolCommon.Push(4);
 
+// write vertices of one particle square
+static inline void EmitSquare( GFXVertex4 *pvtx, GFXTexCoord *ptex, GFXColor *pcol, FLOAT fI0, FLOAT fJ0, FLOAT fOoK,
+                               FLOAT fRX, FLOAT fRY, ANGLE aRotation, const GFXColor &glcol)
+{
   // prepare vertices
-  const FLOAT fRX = fSize;
-  const FLOAT fRY = fSize*fYRatio;
   if( aRotation==0) {
     const FLOAT fIBeg = fI0-fRX;  const FLOAT fIEnd = fI0+fRX;
     const FLOAT fJBeg = fJ0-fRY;  const FLOAT fJEnd = fJ0+fRY;
@@ -276,7 +295,6 @@ void Particle_RenderSquare( const FLOAT3D &vPos, FLOAT fSize, ANGLE aRotation, C
   ptex[2] = _atex[3];
   ptex[3] = _atex[2];
   // prepare colors
-  const GFXColor glcol( AdjustColor( col, _slTexHueShift, _slTexSaturation));
   pcol[0] = glcol;
   pcol[1] = glcol;
   pcol[2] = glcol;
@@ -284,6 +302,147 @@ void Particle_RenderSquare( const FLOAT3D &vPos, FLOAT fSize, ANGLE aRotation, C
 }
 
 
+// add one particle square to rendering queue
+void Particle_RenderSquare( const FLOAT3D &vPos, FLOAT fSize, ANGLE aRotation, COLOR col, FLOAT fYRatio/*=1.0f*/)
+{
+  FLOAT3D vProjected;
+  if( !PrepareSquare( vPos, fSize, col, vProjected)) return;
+
+  // add to vertex arrays
+  GFXVertex4  *pvtx = _avtxCommon.Push(4);
+  GFXTexCoord *ptex = _atexCommon.Push(4);
+  GFXColor    *pcol = _acolCommon.Push(4);
+  const GFXColor glcol( AdjustColor( col, _slTexHueShift, _slTexSaturation));
+  EmitSquare( pvtx, ptex, pcol, vProjected(1), vProjected(2), vProjected(3), fSize, fSize*fYRatio, aRotation, glcol);
+}
+
+
+// add many particle squares to rendering queue (same as adding each one in order, but faster)
+// (array of rotations can be NULL if particles are not rotated)
+void Particle_RenderSquares( INDEX ctParticles, const FLOAT3D *avPos, const FLOAT *afSize, const ANGLE *aaRotation,
+                             const COLOR *acol, FLOAT fYRatio/*=1.0f*/)
+{
+  if( ctParticles<=0) return;
+  // reference implementation
+  if( _bReferenceParticles) {
+    for( INDEX i=0; i<ctParticles; i++) {
+      Particle_RenderSquare( avPos[i], afSize[i], aaRotation!=NULL ? aaRotation[i] : 0, acol[i], fYRatio);
+    }
+    return;
+  }
+
+  // project all particles and keep visible ones
+  _afSquareI.PopAll();    FLOAT *afI   = _afSquareI.Push(ctParticles);
+  _afSquareJ.PopAll();    FLOAT *afJ   = _afSquareJ.Push(ctParticles);
+  _afSquareOoK.PopAll();  FLOAT *afOoK = _afSquareOoK.Push(ctParticles);
+  _afSquareRX.PopAll();   FLOAT *afRX  = _afSquareRX.Push(ctParticles);
+  _afSquareRY.PopAll();   FLOAT *afRY  = _afSquareRY.Push(ctParticles);
+  _aaSquareRotation.PopAll();  ANGLE *aaRot = _aaSquareRotation.Push(ctParticles);
+  _acolSquare.PopAll();   GFXColor *aglcol = _acolSquare.Push(ctParticles);
+  INDEX ctVisible = 0;
+  for( INDEX i=0; i<ctParticles; i++) {
+    FLOAT3D vProjected;
+    COLOR col = acol[i];
+    if( !PrepareSquare( avPos[i], afSize[i], col, vProjected)) continue;
+    afI[ctVisible]   = vProjected(1);
+    afJ[ctVisible]   = vProjected(2);
+    afOoK[ctVisible] = vProjected(3);
+    afRX[ctVisible]  = afSize[i];
+    afRY[ctVisible]  = afSize[i]*fYRatio;
+    aaRot[ctVisible] = aaRotation!=NULL ? aaRotation[i] : 0;
+    aglcol[ctVisible] = GFXColor( AdjustColor( col, _slTexHueShift, _slTexSaturation));
+    ctVisible++;
+  }
+  if( ctVisible==0) return;
+
+  // add all to vertex arrays at once
+  GFXVertex4  *pvtx = _avtxCommon.Push(ctVisible*4);
+  GFXTexCoord *ptex = _atexCommon.Push(ctVisible*4);
+  GFXColor    *pcol = _acolCommon.Push(ctVisible*4);
+  INDEX i = 0;
+#if PARTICLE_NEON || PARTICLE_SSE2
+  // expand 4 squares at once
+  for( ; i+4<=ctVisible; i+=4) {
+    // rotated squares have vertices in different order, so mixed ones are expanded one by one
+    const INDEX ctRotated = (aaRot[i]!=0) + (aaRot[i+1]!=0) + (aaRot[i+2]!=0) + (aaRot[i+3]!=0);
+    if( ctRotated!=0 && ctRotated!=4) {
+      for( INDEX j=i; j<i+4; j++) {
+        EmitSquare( pvtx+j*4, ptex+j*4, pcol+j*4, afI[j], afJ[j], afOoK[j], afRX[j], afRY[j], aaRot[j], aglcol[j]);
+      }
+      continue;
+    }
+    // half-extents of squares along I and J (rotated by the angle, if any)
+    FLOAT afA[4], afB[4];
+    if( ctRotated==0) {
+      for( INDEX j=0; j<4; j++) { afA[j] = afRX[i+j];  afB[j] = afRY[i+j]; }
+    } else {
+      FLOAT afSinA[4], afCosA[4];
+      for( INDEX j=0; j<4; j++) {
+        const INDEX iRot256 = FloatToInt(aaRot[i+j]*0.7111f) & 255; // *256/360
+        afSinA[j] = pfSinTable[iRot256];
+        afCosA[j] = pfCosTable[iRot256];
+      }
+#if PARTICLE_NEON
+      const float32x4_t fSinA = vld1q_f32(afSinA), fCosA = vld1q_f32(afCosA);
+      const float32x4_t fRX = vld1q_f32(afRX+i),   fRY = vld1q_f32(afRY+i);
+      vst1q_f32( afA, vaddq_f32( vmulq_f32(fCosA,fRX), vmulq_f32(fSinA,fRY)));
+      vst1q_f32( afB, vsubq_f32( vmulq_f32(fSinA,fRX), vmulq_f32(fCosA,fRY)));
+#else
+      const __m128 fSinA = _mm_loadu_ps(afSinA), fCosA = _mm_loadu_ps(afCosA);
+      const __m128 fRX = _mm_loadu_ps(afRX+i),   fRY = _mm_loadu_ps(afRY+i);
+      _mm_storeu_ps( afA, _mm_add_ps( _mm_mul_ps(fCosA,fRX), _mm_mul_ps(fSinA,fRY)));
+      _mm_storeu_ps( afB, _mm_sub_ps( _mm_mul_ps(fSinA,fRX), _mm_mul_ps(fCosA,fRY)));
+#endif
+    }
+    FLOAT afIMA[4], afIPA[4], afJMB[4], afJPB[4];
+    FLOAT afIMB[4], afIPB[4], afJMA[4], afJPA[4];
+#if PARTICLE_NEON
+    const float32x4_t fI = vld1q_f32(afI+i),  fA = vld1q_f32(afA);
+    const float32x4_t fJ = vld1q_f32(afJ+i),  fB = vld1q_f32(afB);
+    vst1q_f32( afIMA, vsubq_f32(fI,fA));  vst1q_f32( afIPA, vaddq_f32(fI,fA));
+    vst1q_f32( afJMB, vsubq_f32(fJ,fB));  vst1q_f32( afJPB, vaddq_f32(fJ,fB));
+    if( ctRotated!=0) {
+      vst1q_f32( afIMB, vsubq_f32(fI,fB));  vst1q_f32( afIPB, vaddq_f32(fI,fB));
+      vst1q_f32( afJMA, vsubq_f32(fJ,fA));  vst1q_f32( afJPA, vaddq_f32(fJ,fA));
+    }
+#else
+    const __m128 fI = _mm_loadu_ps(afI+i),  fA = _mm_loadu_ps(afA);
+    const __m128 fJ = _mm_loadu_ps(afJ+i),  fB = _mm_loadu_ps(afB);
+    _mm_storeu_ps( afIMA, _mm_sub_ps(fI,fA));  _mm_storeu_ps( afIPA, _mm_add_ps(fI,fA));
+    _mm_storeu_ps( afJMB, _mm_sub_ps(fJ,fB));  _mm_storeu_ps( afJPB, _mm_add_ps(fJ,fB));
+    if( ctRotated!=0) {
+      _mm_storeu_ps( afIMB, _mm_sub_ps(fI,fB));  _mm_storeu_ps( afIPB, _mm_add_ps(fI,fB));
+      _mm_storeu_ps( afJMA, _mm_sub_ps(fJ,fA));  _mm_storeu_ps( afJPA, _mm_add_ps(fJ,fA));
+    }
+#endif
+    for( INDEX j=0; j<4; j++) {
+      GFXVertex4 *pv = pvtx+(i+j)*4;
+      const FLOAT fOoK = afOoK[i+j];
+      if( ctRotated==0) {
+        pv[0].x = afIMA[j];  pv[0].y = afJMB[j];  pv[0].z = fOoK;
+        pv[1].x = afIMA[j];  pv[1].y = afJPB[j];  pv[1].z = fOoK;
+        pv[2].x = afIPA[j];  pv[2].y = afJPB[j];  pv[2].z = fOoK;
+        pv[3].x = afIPA[j];  pv[3].y = afJMB[j];  pv[3].z = fOoK;
+      } else {
+        pv[0].x = afIMA[j];  pv[0].y = afJMB[j];  pv[0].z = fOoK;
+        pv[1].x = afIPB[j];  pv[1].y = afJMA[j];  pv[1].z = fOoK;
+        pv[2].x = afIPA[j];  pv[2].y = afJPB[j];  pv[2].z = fOoK;
+        pv[3].x = afIMB[j];  pv[3].y = afJPA[j];  pv[3].z = fOoK;
+      }
+      GFXTexCoord *pt = ptex+(i+j)*4;
+      pt[0] = _atex[1];  pt[1] = _atex[0];  pt[2] = _atex[3];  pt[3] = _atex[2];
+      GFXColor *pc = pcol+(i+j)*4;
+      pc[0] = pc[1] = pc[2] = pc[3] = aglcol[i+j];
+    }
+  }
+#endif
+  // remaining squares
+  for( ; i<ctVisible; i++) {
+    EmitSquare( pvtx+i*4, ptex+i*4, pcol+i*4, afI[i], afJ[i], afOoK[i], afRX[i], afRY[i], aaRot[i], aglcol[i]);
+  }
+}
+
+
 
 // add one particle line to rendering queue
 void Particle_RenderLine( const FLOAT3D &vPos0, const FLOAT3D &vPos1, FLOAT fWidth, COLOR col)
@@ -581,63 +740,233 @@ static int qsort_CompareZ3D( const void *pI0, const void *pI1) {
 }
 
 
+// radix sort key of particle depth (larger Z first, i.e. farther particles first)
+static inline ULONG SortKeyZ( FLOAT fZ)
+{
+  if( fZ==0) fZ = 0.0f; // same key for negative zero
+  ULONG ul = *(ULONG*)&fZ;
+  // make unsigned order same as float order
+  ul ^= (ul&0x80000000) ? 0xFFFFFFFF : 0x80000000;
+  return ~ul;
+}
+
+// sort arrays
+static CStaticStackArray<ULONG> _aulSortKeys, _aulSortKeysTmp;
+static CStaticStackArray<INDEX> _aiSortIndices, _aiSortIndicesTmp;
+static CStaticStackArray<GFXVertex>   _avtxSorted;
+static CStaticStackArray<GFXTexCoord> _atexSorted;
+static CStaticStackArray<GFXColor>    _acolSorted;
+
+// stable sort of indices by keys (in 3 passes of 11 bits)
+void RadixSortIndices( ULONG *aulKeys, INDEX *aiIndices, ULONG *aulKeysTmp, INDEX *aiIndicesTmp, INDEX ctKeys)
+{
+  INDEX actBuckets[3][2048];
+  INDEX ctPasses = 0;
+  memset( actBuckets, 0, sizeof(actBuckets));
+  for( INDEX i=0; i<ctKeys; i++) {
+    const ULONG ulKey = aulKeys[i];
+    actBuckets[0][ ulKey     &2047]++;
+    actBuckets[1][(ulKey>>11)&2047]++;
+    actBuckets[2][(ulKey>>22)     ]++;
+  }
+  for( INDEX iPass=0; iPass<3; iPass++) {
+    INDEX *pctBuckets = actBuckets[iPass];
+    const INDEX iShift = iPass*11;
+    // skip pass if all keys fall in the same bucket
+    if( pctBuckets[(aulKeys[0]>>iShift)&2047]==ctKeys) continue;
+    // bucket counts to offsets
+    INDEX iOffset = 0;
+    for( INDEX iBucket=0; iBucket<2048; iBucket++) {
+      const INDEX ct = pctBuckets[iBucket];
+      pctBuckets[iBucket] = iOffset;
+      iOffset += ct;
+    }
+    for( INDEX i=0; i<ctKeys; i++) {
+      const INDEX iWhere = pctBuckets[(aulKeys[i]>>iShift)&2047]++;
+      aulKeysTmp[iWhere]   = aulKeys[i];
+      aiIndicesTmp[iWhere] = aiIndices[i];
+    }
+    Swap( aulKeys, aulKeysTmp);
+    Swap( aiIndices, aiIndicesTmp);
+    ctPasses++;
+  }
+  // sorted indices must end up in original array
+  if( ctPasses&1) memcpy( aiIndicesTmp, aiIndices, ctKeys*sizeof(INDEX));
+}
+
+
 // sorts particles by distance
 void Particle_Sort( BOOL b3D/*=FALSE*/)
 {
-  INDEX i;
   const INDEX ctParticles = _avtxCommon.Count()/4; 
   if( ctParticles<=0) return; // nothing to do!
 
   // generate sort array
-  CStaticArray<INDEX> aiIndices;
-  aiIndices.New(ctParticles);
-  for( i=0; i<ctParticles; i++) aiIndices[i] = i;
-
-  // bubble sort indices by vertex Z coord
-  if(b3D) qsort( &aiIndices[0], ctParticles, sizeof(INDEX), qsort_CompareZ3D);
-  else    qsort( &aiIndices[0], ctParticles, sizeof(INDEX), qsort_CompareZ);
-
-  // generate inverse table
-  CStaticArray<INDEX> aiInverse;
-  aiInverse.New(ctParticles);
-  for( i=0; i<ctParticles; i++) {
-    const INDEX iOrig = aiIndices[i];
-    aiInverse[iOrig] = i;
+  _aiSortIndices.PopAll();
+  INDEX *aiIndices = _aiSortIndices.Push(ctParticles);
+  for( INDEX i=0; i<ctParticles; i++) aiIndices[i] = i;
+
+  if( _bReferenceParticles) {
+    // sort indices by vertex Z coord
+    if(b3D) qsort( aiIndices, ctParticles, sizeof(INDEX), qsort_CompareZ3D);
+    else    qsort( aiIndices, ctParticles, sizeof(INDEX), qsort_CompareZ);
+  } else {
+    // radix sort indices by key of vertex Z coord (keeping order of particles at same depth)
+    _aulSortKeys.PopAll();
+    _aulSortKeysTmp.PopAll();
+    _aiSortIndicesTmp.PopAll();
+    ULONG *aulKeys = _aulSortKeys.Push(ctParticles);
+    const GFXVertex *pvtx = &_avtxCommon[0];
+    for( INDEX i=0; i<ctParticles; i++) {
+      const GFXVertex *pv = pvtx+i*4;
+      aulKeys[i] = SortKeyZ( b3D ? (pv[0].z + pv[1].z + pv[2].z + pv[3].z) / 4.0f : pv[0].z);
+    }
+    RadixSortIndices( aulKeys, aiIndices, _aulSortKeysTmp.Push(ctParticles), _aiSortIndicesTmp.Push(ctParticles), ctParticles);
   }
 
-  // sort vertices by indices
-  for( i=0; i<ctParticles;) // i is incremented in loop
-  { // fetch destination
-    INDEX &iWhere = aiInverse[i];
-    ASSERT( iWhere<ctParticles);
-    // if current is already in place, advance to next index
-    if( iWhere==i) { i++; continue; }
-    // swap vertices
-    Swap( _avtxCommon[iWhere*4+0], _avtxCommon[i*4+0]);
-    Swap( _avtxCommon[iWhere*4+1], _avtxCommon[i*4+1]);
-    Swap( _avtxCommon[iWhere*4+2], _avtxCommon[i*4+2]);
-    Swap( _avtxCommon[iWhere*4+3], _avtxCommon[i*4+3]);
-    // swap texture coords
-    Swap( _atexCommon[iWhere*4+0], _atexCommon[i*4+0]);
-    Swap( _atexCommon[iWhere*4+1], _atexCommon[i*4+1]);
-    Swap( _atexCommon[iWhere*4+2], _atexCommon[i*4+2]);
-    Swap( _atexCommon[iWhere*4+3], _atexCommon[i*4+3]);
-    // swap colors
-    Swap( _acolCommon[iWhere*4+0], _acolCommon[i*4+0]);
-    Swap( _acolCommon[iWhere*4+1], _acolCommon[i*4+1]);
-    Swap( _acolCommon[iWhere*4+2], _acolCommon[i*4+2]);
-    Swap( _acolCommon[iWhere*4+3], _acolCommon[i*4+3]);
-    // swap indices
-    Swap( aiInverse[iWhere], aiInverse[i]);
+  // gather vertices in sorted order
+  const INDEX ctVertices = ctParticles*4;
+  _avtxSorted.PopAll();  GFXVertex   *pvtxSorted = _avtxSorted.Push(ctVertices);
+  _atexSorted.PopAll();  GFXTexCoord *ptexSorted = _atexSorted.Push(ctVertices);
+  _acolSorted.PopAll();  GFXColor    *pcolSorted = _acolSorted.Push(ctVertices);
+  memcpy( pvtxSorted, &_avtxCommon[0], ctVertices*sizeof(GFXVertex));
+  memcpy( ptexSorted, &_atexCommon[0], ctVertices*sizeof(GFXTexCoord));
+  memcpy( pcolSorted, &_acolCommon[0], ctVertices*sizeof(GFXColor));
+  GFXVertex   *pvtx = &_avtxCommon[0];
+  GFXTexCoord *ptex = &_atexCommon[0];
+  GFXColor    *pcol = &_acolCommon[0];
+  for( INDEX i=0; i<ctParticles; i++) {
+    const INDEX iSrc = aiIndices[i]*4;
+    memcpy( pvtx+i*4, pvtxSorted+iSrc, 4*sizeof(GFXVertex));
+    memcpy( ptex+i*4, ptexSorted+iSrc, 4*sizeof(GFXTexCoord));
+    memcpy( pcol+i*4, pcolSorted+iSrc, 4*sizeof(GFXColor));
   }
 
 #ifndef NDEBUG
   // test to see whether the array is sorted
-  INDEX      *pidx = &aiInverse[0];
-  GFXVertex4 *pvtx = &_avtxCommon[0];
-  for( i=0; i<ctParticles-1; i++) {
-    ASSERT( pidx[i] < pidx[i+1]);
-    ASSERT( pvtx[i*4].z >= pvtx[(i+1)*4].z);
+  if( !b3D) {
+    for( INDEX i=0; i<ctParticles-1; i++) {
+      ASSERT( pvtx[i*4].z >= pvtx[(i+1)*4].z);
+    }
   }
 #endif
 }
+
+
+// pseudo-random number in 0..1 for benchmark data
+static FLOAT BenchmarkRandom01(ULONG &ulSeed)
+{
+  ulSeed = ulSeed*1103515245+12345;
+  return (FLOAT)((ulSeed>>8)&0xFFFF)/65535.0f;
+}
+
+// benchmark projection, vertex generation and sorting of particle squares (nothing is rendered)
+void ParticleBenchmark(void *pArgs)
+{
+  INDEX ctParticles = NEXTARGUMENT(INDEX);
+  if( ctParticles<=0) ctParticles = 20000;
+  const INDEX ctFrames = 20;
+
+  // viewer at origin, looking down the -Z axis
+  CPerspectiveProjection3D prPerspective;
+  prPerspective.FOVL() = AngleDeg(90.0f);
+  prPerspective.ScreenBBoxL() = FLOATaabbox2D( FLOAT2D(0.0f, 0.0f), FLOAT2D(1024.0f, 768.0f));
+  prPerspective.AspectRatioL() = 1.0f;
+  prPerspective.FrontClipDistanceL() = 0.3f;
+  prPerspective.ViewerPlacementL() = CPlacement3D( FLOAT3D(0,0,0), ANGLE3D(0,0,0));
+  prPerspective.ObjectPlacementL() = CPlacement3D( FLOAT3D(0,0,0), ANGLE3D(0,0,0));
+  prPerspective.Prepare();
+
+  // setup particle rendering as for a texture without fog and haze, but without touching the drawport
+  CProjection3D *pprOld = _pprProjection;
+  const FLOAT fOldPerspectiveFactor = _fPerspectiveFactor;
+  const FLOAT fOldNearClipDistance  = _fNearClipDistance;
+  const COLOR colOldAttMask = _colAttMask;
+  const BOOL bOldHasFog  = _Particle_bHasFog;
+  const BOOL bOldHasHaze = _Particle_bHasHaze;
+  const BOOL bOldTransFogHaze = _bTransFogHaze;
+  _pprProjection = &prPerspective;
+  _fPerspectiveFactor = prPerspective.ppr_PerspectiveRatios(1);
+  _fNearClipDistance  = -prPerspective.pr_NearClipDistance;
+  _colAttMask = 0xFFFFFF00;
+  _Particle_bHasFog  = FALSE;
+  _Particle_bHasHaze = FALSE;
+  _bTransFogHaze = FALSE;
+  _fTextureCorrectionU = 1.0f/1024.0f;
+  _fTextureCorrectionV = 1.0f/1024.0f;
+  Particle_SetTexturePart( 512, 512, 1, 0);
+
+  // random particles in front of viewer (runs of rotated and unrotated ones)
+  CStaticArray<FLOAT3D> avPos;  avPos.New(ctParticles);
+  CStaticArray<FLOAT>   afSize; afSize.New(ctParticles);
+  CStaticArray<ANGLE>   aaRot;  aaRot.New(ctParticles);
+  CStaticArray<COLOR>   acol;   acol.New(ctParticles);
+  ULONG ulSeed = 0x12345678;
+  for( INDEX i=0; i<ctParticles; i++) {
+    const FLOAT fZ = -1.0f - BenchmarkRandom01(ulSeed)*200.0f;
+    const FLOAT fX = BenchmarkRandom01(ulSeed)-0.5f;
+    const FLOAT fY = BenchmarkRandom01(ulSeed)-0.5f;
+    avPos[i] = FLOAT3D( fX*-fZ*2.2f, fY*-fZ*1.7f, fZ);
+    afSize[i] = 0.05f + BenchmarkRandom01(ulSeed)*0.5f;
+    aaRot[i] = (i&16) ? BenchmarkRandom01(ulSeed)*360.0f : 0.0f;
+    acol[i] = ulSeed|0x80;
+  }
+
+  // 0=reference (one by one, qsort), 1=batched and radix sorted
+  DOUBLE adEmitMs[2] = {0,0}, adSortMs[2] = {0,0};
+  CStaticArray<FLOAT>       afResultXYZ[2];
+  CStaticArray<GFXTexCoord> atexResult[2];
+  CStaticArray<GFXColor>    acolResult[2];
+  for( INDEX iMode=0; iMode<2; iMode++) {
+    _bReferenceParticles = iMode==0;
+    for( INDEX iFrame=0; iFrame<ctFrames; iFrame++) {
+      gfxResetArrays();
+      _atexFogHaze.PopAll();
+      _atexFogHaze.Push(4);
+      CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+      Particle_RenderSquares( ctParticles, &avPos[0], &afSize[0], &aaRot[0], &acol[0]);
+      CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+      Particle_Sort();
+      CTimerValue tv2 = _pTimer->GetHighPrecisionTimer();
+      adEmitMs[iMode] += (tv1-tv0).GetSeconds()*1000.0/ctFrames;
+      adSortMs[iMode] += (tv2-tv1).GetSeconds()*1000.0/ctFrames;
+    }
+    // keep results (without vertex shade, that is not used for particles)
+    const INDEX ctVertices = _avtxCommon.Count();
+    afResultXYZ[iMode].New(ctVertices*3+1);
+    atexResult[iMode].New(ctVertices+1);
+    acolResult[iMode].New(ctVertices+1);
+    for( INDEX iVtx=0; iVtx<ctVertices; iVtx++) {
+      afResultXYZ[iMode][iVtx*3+0] = _avtxCommon[iVtx].x;
+      afResultXYZ[iMode][iVtx*3+1] = _avtxCommon[iVtx].y;
+      afResultXYZ[iMode][iVtx*3+2] = _avtxCommon[iVtx].z;
+      atexResult[iMode][iVtx] = _atexCommon[iVtx];
+      acolResult[iMode][iVtx] = _acolCommon[iVtx];
+    }
+  }
+  _bReferenceParticles = FALSE;
+  const INDEX ctVisible = _avtxCommon.Count()/4;
+  const BOOL bMatch = afResultXYZ[0].Count()==afResultXYZ[1].Count()
+    && memcmp( &afResultXYZ[0][0], &afResultXYZ[1][0], (afResultXYZ[0].Count()-1)*sizeof(FLOAT))==0
+    && memcmp( &atexResult[0][0],  &atexResult[1][0],  (atexResult[0].Count()-1)*sizeof(GFXTexCoord))==0
+    && memcmp( &acolResult[0][0],  &acolResult[1][0],  (acolResult[0].Count()-1)*sizeof(GFXColor))==0;
+
+  // restore
+  gfxResetArrays();
+  _atexFogHaze.PopAll();
+  _bNeedsClipping = FALSE;
+  _pprProjection = pprOld;
+  _fPerspectiveFactor = fOldPerspectiveFactor;
+  _fNearClipDistance  = fOldNearClipDistance;
+  _colAttMask = colOldAttMask;
+  _Particle_bHasFog  = bOldHasFog;
+  _Particle_bHasHaze = bOldHasHaze;
+  _bTransFogHaze = bOldTransFogHaze;
+
+  CPrintF( TRANS("Particle benchmark (%d particles, %d visible, %s):\n"), ctParticles, ctVisible,
+           PARTICLE_NEON ? "NEON" : (PARTICLE_SSE2 ? "SSE2" : "no SIMD"));
+  CPrintF( TRANS("  reference: %6.2f ms submit, %6.2f ms sort (%.0f particles/s)\n"), adEmitMs[0], adSortMs[0],
+           ctParticles*1000.0/Max(adEmitMs[0]+adSortMs[0], 1e-6));
+  CPrintF( TRANS("  batched:   %6.2f ms submit, %6.2f ms sort (%.0f particles/s), %s\n"), adEmitMs[1], adSortMs[1],
+           ctParticles*1000.0/Max(adEmitMs[1]+adSortMs[1], 1e-6), bMatch ? TRANS("match") : TRANS("MISMATCH!"));
+}
@@ -67,6 +67,9 @@ CFontData::~CFontData()
 
 void CFontData::Clear()
 {
+  // forget text laid out with this font
+  extern void ClearTextLayoutCache(void);
+  ClearTextLayoutCache();
   if( fd_ptdTextureData != NULL) {
     fd_fnTexture = CTString("");
     _pTextureStock->Release(fd_ptdTextureData);
@@ -207,5 +210,8 @@ void CFontData::Make_t( const CTFileName &fnTexture, PIX pixCharWidth, PIX pixCh
   // all done
   SetVariableWidth();
   _pTextureStock->Release( fd_ptdTextureData);
+  // text laid out with old letters is not valid anymore
+  extern void ClearTextLayoutCache(void);
+  ClearTextLayoutCache();
 }
 
@@ -40,6 +40,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Graphics/Color.h>
 #include <Engine/Graphics/Font.h>
 #include <Engine/Graphics/MultiMonitor.h>
+#include <GLES2/gl2.h>
+#include <AndroidAdapters/gles_adapter.h>
 
 #include <Engine/Templates/DynamicStackArray.h>
 #include <Engine/Templates/DynamicStackArray.cpp>
@@ -130,6 +132,8 @@ INDEX tex_bProgressiveFilter = FALSE;  // filter mipmaps in creation time (not a
 INDEX tex_bColorizeMipmaps   = FALSE;  // DEBUG: colorize texture's mipmap levels in various colors
 INDEX tex_bCompressAlphaChannel = FALSE;  // for compressed textures, compress alpha channel too   
 INDEX tex_bAlternateCompression = FALSE;  // basically, this is fix for GFs (compress opaque texture as translucent)
+INDEX tex_bMultiThreadedEffects = TRUE;   // split large effect textures between worker threads
+INDEX tex_bMultiThreadedBitmaps = TRUE;   // split mip-mapping, filtering and dithering of large bitmaps between worker threads
 
 INDEX shd_iStaticSize  = 6;    
 INDEX shd_iDynamicSize = 6;    
@@ -145,6 +149,10 @@ INDEX shd_bAllowFlats = TRUE;   // allow optimization of single-color shadowmaps
 INDEX shd_iForceFlats = 0;      // force all shadowmaps to be flat (internal!) - 0=don't, 1=w/o overbrighting, 2=w/ overbrighting
 INDEX shd_bShowFlats  = FALSE;  // colorize flat shadows
 INDEX shd_bColorize   = FALSE;  // colorize shadows by size (gradieng from red=big to green=little)
+INDEX shd_bBackgroundMixing = TRUE; // mix static shadow layers on worker threads (show lower quality meanwhile)
+INDEX shd_iPrefetchShadows  = 64;   // max shadowmaps behind portals to start mixing per frame (0=none)
+INDEX shd_bPersistentCache  = TRUE; // keep mixed shadowmaps of each world on disk for next runs
+INDEX shd_iPersistentCacheMB = 32;  // max size of shadow cache file of one world (mip-maps unused in last run are dropped first)
 
 
 // OpenGL control
@@ -200,6 +208,8 @@ INDEX mdl_bRenderBump       = TRUE;
 INDEX mdl_bAllowOverbright  = TRUE;
 INDEX mdl_bFineQuality      = FALSE;
 INDEX mdl_iShadowQuality    = 1;
+INDEX mdl_bShareUnpackedFrames = TRUE;  // reuse frames unpacked for other models (lerp ratio is quantized)
+INDEX mdl_bParallelSetup    = TRUE;  // find model lights on worker threads and radix sort models
 FLOAT mdl_fLODMul           = 1.0f;
 FLOAT mdl_fLODAdd           = 0.0f;
 INDEX mdl_iLODDisappear     = 1; // 0=never, 1=ignore bias, 2=with bias
@@ -208,6 +218,7 @@ INDEX ska_bShowSkeleton     = FALSE;
 INDEX ska_bShowColision     = FALSE;
 FLOAT ska_fLODMul           = 1.0f;
 FLOAT ska_fLODAdd           = 0.0f;
+INDEX ska_bMultiThreadedSkinning = TRUE;
 // terrain controls
 INDEX ter_bShowQuadTree     = FALSE;
 INDEX ter_bShowWireframe    = FALSE;
@@ -216,6 +227,7 @@ INDEX ter_bShowInfo         = FALSE;
 INDEX ter_bOptimizeRendering = TRUE;
 INDEX ter_bTempFreezeCast   = FALSE;
 INDEX ter_bNoRegeneration   = FALSE;
+INDEX ter_bMultiThreadedShadows = TRUE;
 
 // rendering control
 INDEX wld_bAlwaysAddAll         = FALSE;
@@ -230,6 +242,7 @@ INDEX wld_bShowDetailTextures   = FALSE;
 INDEX wld_iDetailRemovingBias   = 3;
 FLOAT wld_fEdgeOffsetI          = 0.0f; //0.125f;
 FLOAT wld_fEdgeAdjustK          = 1.0f; //1.0001f;
+INDEX wld_iScanBands            = 0;    // bands of scan lines to find visibility in parallel (0=one per thread, 1=serial)
                                      
 INDEX gfx_bRenderWorld      = TRUE;
 INDEX gfx_bRenderParticles  = TRUE;
@@ -239,6 +252,8 @@ INDEX gfx_bRenderFog        = TRUE;
 INDEX gfx_iLensFlareQuality = 3;   // 0=none, 1=corona only, 2=corona and reflections, 3=corona, reflections and glare 
 
 INDEX gfx_bDecoratedText   = TRUE;
+INDEX gfx_bTextBatching    = TRUE;   // draw text of same font in one go (where batched by caller)
+INDEX gfx_bTextLayoutCache = TRUE;   // keep parsed text layout across frames
 INDEX gfx_bClearScreen = FALSE;
 FLOAT gfx_tmProbeDecay = 50.0f;   // seconds
 INDEX gfx_iProbeSize   = 256;     // in KBs
@@ -1134,12 +1149,37 @@ void CGfxLibrary::Init(void)
   _pShell->DeclareSymbol("persistent user INDEX mdl_bAllowOverbright;",  &mdl_bAllowOverbright);
   _pShell->DeclareSymbol("persistent user INDEX mdl_bFineQuality post:MdlPostFunc;", &mdl_bFineQuality);
   _pShell->DeclareSymbol("persistent user INDEX mdl_iShadowQuality;",  &mdl_iShadowQuality);
+  _pShell->DeclareSymbol("persistent user INDEX mdl_bShareUnpackedFrames;", &mdl_bShareUnpackedFrames);
+  _pShell->DeclareSymbol("persistent user INDEX mdl_bParallelSetup;", &mdl_bParallelSetup);
   _pShell->DeclareSymbol("                INDEX mdl_bTruformWeapons;", &mdl_bTruformWeapons);
   
   _pShell->DeclareSymbol("           user INDEX ska_bShowSkeleton;",   &ska_bShowSkeleton);
   _pShell->DeclareSymbol("           user INDEX ska_bShowColision;",   &ska_bShowColision);
   _pShell->DeclareSymbol("persistent user FLOAT ska_fLODMul;",         &ska_fLODMul);
   _pShell->DeclareSymbol("persistent user FLOAT ska_fLODAdd;",         &ska_fLODAdd);
+  _pShell->DeclareSymbol("persistent user INDEX ska_bMultiThreadedSkinning;", &ska_bMultiThreadedSkinning);
+  extern void SkaSkinningBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user void SkaSkinningBenchmark(INDEX);", (void*) &SkaSkinningBenchmark);
+  extern void SkaLookupBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user void SkaLookupBenchmark(INDEX);", (void*) &SkaLookupBenchmark);
+  extern void TextureEffectsBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user void TextureEffectsBenchmark(INDEX);", (void*) &TextureEffectsBenchmark);
+  extern void TextureGROBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user void TextureGROBenchmark(CTString);", (void*) &TextureGROBenchmark);
+  extern void ParticleBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user void ParticleBenchmark(INDEX);", (void*) &ParticleBenchmark);
+  extern void VisibilityBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user void VisibilityBenchmark(INDEX);", (void*) &VisibilityBenchmark);
+  extern void RenderBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user void RenderBenchmark(INDEX);", (void*) &RenderBenchmark);
+  extern void ModelSetupBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user void ModelSetupBenchmark(INDEX);", (void*) &ModelSetupBenchmark);
+  extern void TextBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user void TextBenchmark(INDEX);", (void*) &TextBenchmark);
+  extern void GlesCallCount(void);
+  _pShell->DeclareSymbol("user void GlesCallCount(void);", (void*) &GlesCallCount);
+  extern void GlesDrawMergeCheck(void);
+  _pShell->DeclareSymbol("user void GlesDrawMergeCheck(void);", (void*) &GlesDrawMergeCheck);
   
   _pShell->DeclareSymbol("           user INDEX ter_bShowQuadTree;",   &ter_bShowQuadTree);
   _pShell->DeclareSymbol("           user INDEX ter_bShowWireframe;",  &ter_bShowWireframe);
@@ -1148,6 +1188,11 @@ void CGfxLibrary::Init(void)
   _pShell->DeclareSymbol("           user INDEX ter_bOptimizeRendering;", &ter_bOptimizeRendering);
   _pShell->DeclareSymbol("           user INDEX ter_bTempFreezeCast;   ", &ter_bTempFreezeCast);
   _pShell->DeclareSymbol("           user INDEX ter_bNoRegeneration;   ", &ter_bNoRegeneration);
+  _pShell->DeclareSymbol("persistent user INDEX ter_bMultiThreadedShadows;", &ter_bMultiThreadedShadows);
+  extern void TerrainShadowBenchmark(void);
+  _pShell->DeclareSymbol("user void TerrainShadowBenchmark(void);", (void*) &TerrainShadowBenchmark);
+  extern void ModelUnpackBenchmark(void *pArgs);
+  _pShell->DeclareSymbol("user void ModelUnpackBenchmark(INDEX);", (void*) &ModelUnpackBenchmark);
   
   
   
@@ -1158,6 +1203,8 @@ void CGfxLibrary::Init(void)
   _pShell->DeclareSymbol("persistent user INDEX gfx_bDisableMultiMonSupport;", &gfx_bDisableMultiMonSupport);
   _pShell->DeclareSymbol("persistent user INDEX gfx_bDisableWindowsKeys;",     &gfx_bDisableWindowsKeys);
   _pShell->DeclareSymbol("persistent user INDEX gfx_bDecoratedText;",    &gfx_bDecoratedText);
+  _pShell->DeclareSymbol("persistent user INDEX gfx_bTextBatching;",     &gfx_bTextBatching);
+  _pShell->DeclareSymbol("persistent user INDEX gfx_bTextLayoutCache;",  &gfx_bTextLayoutCache);
   _pShell->DeclareSymbol("     const user INDEX gfx_ctMonitors;",        &gfx_ctMonitors);
   _pShell->DeclareSymbol("     const user INDEX gfx_bMultiMonDisabled;", &gfx_bMultiMonDisabled);
 
@@ -1171,6 +1218,8 @@ void CGfxLibrary::Init(void)
   _pShell->DeclareSymbol("persistent user INDEX tex_iFogSize;",       &tex_iFogSize);
   _pShell->DeclareSymbol("persistent user INDEX tex_bCompressAlphaChannel;", &tex_bCompressAlphaChannel);
   _pShell->DeclareSymbol("persistent user INDEX tex_bAlternateCompression;", &tex_bAlternateCompression);
+  _pShell->DeclareSymbol("persistent user INDEX tex_bMultiThreadedEffects;", &tex_bMultiThreadedEffects);
+  _pShell->DeclareSymbol("persistent user INDEX tex_bMultiThreadedBitmaps;", &tex_bMultiThreadedBitmaps);
   _pShell->DeclareSymbol("persistent user INDEX tex_bDynamicMipmaps;", &tex_bDynamicMipmaps);
   _pShell->DeclareSymbol("persistent user INDEX tex_iDithering;",  &tex_iDithering);
   _pShell->DeclareSymbol("persistent user INDEX tex_iFiltering;",  &tex_iFiltering);
@@ -1192,6 +1241,10 @@ void CGfxLibrary::Init(void)
   _pShell->DeclareSymbol("persistent      INDEX shd_iForceFlats;", &shd_iForceFlats);
   _pShell->DeclareSymbol("           user INDEX shd_bShowFlats;",  &shd_bShowFlats);
   _pShell->DeclareSymbol("           user INDEX shd_bColorize;",   &shd_bColorize);
+  _pShell->DeclareSymbol("persistent user INDEX shd_bBackgroundMixing;", &shd_bBackgroundMixing);
+  _pShell->DeclareSymbol("persistent user INDEX shd_iPrefetchShadows;",  &shd_iPrefetchShadows);
+  _pShell->DeclareSymbol("persistent user INDEX shd_bPersistentCache;",  &shd_bPersistentCache);
+  _pShell->DeclareSymbol("persistent user INDEX shd_iPersistentCacheMB;", &shd_iPersistentCacheMB);
   
   _pShell->DeclareSymbol("           user INDEX gfx_bRenderParticles;", &gfx_bRenderParticles);
   _pShell->DeclareSymbol("           user INDEX gfx_bRenderFog;",       &gfx_bRenderFog);
@@ -1201,6 +1254,7 @@ void CGfxLibrary::Init(void)
   _pShell->DeclareSymbol("persistent user INDEX wld_bRenderMirrors;", &wld_bRenderMirrors);
   _pShell->DeclareSymbol("persistent user FLOAT wld_fEdgeOffsetI;",   &wld_fEdgeOffsetI);
   _pShell->DeclareSymbol("persistent user FLOAT wld_fEdgeAdjustK;",   &wld_fEdgeAdjustK);
+  _pShell->DeclareSymbol("persistent user INDEX wld_iScanBands;",     &wld_iScanBands);
   _pShell->DeclareSymbol("persistent user INDEX wld_iDetailRemovingBias;", &wld_iDetailRemovingBias);
   _pShell->DeclareSymbol("           user INDEX wld_bRenderEmptyBrushes;", &wld_bRenderEmptyBrushes);
   _pShell->DeclareSymbol("           user INDEX wld_bRenderShadowMaps;",   &wld_bRenderShadowMaps);
@@ -1383,6 +1437,12 @@ BOOL CGfxLibrary::StartDisplayMode( enum GfxAPIType eAPI, INDEX iAdapter, PIX pi
   {
     ASSERT( eAPI==GAT_NONE); 
     gl_eCurrentAPI = GAT_NONE;
+    // pretend to be the simplest accelerator, so rendering goes thru usual paths
+    gl_ctTextureUnits = 1;
+    gl_ctRealTextureUnits = 1;
+    gl_iMaxTextureAnisotropy = 1;
+    gl_fMaxTextureLODBias = 0;
+    GFX_nsNullAPI.Clear();
   }
 
   // initialize on first child window
@@ -1455,7 +1515,10 @@ BOOL CGfxLibrary::SetCurrentViewport(CViewPort *pvp)
 #ifdef SE1_D3D
   if( gl_eCurrentAPI==GAT_D3D)  return SetCurrentViewport_D3D(pvp);
 #endif // SE1_D3D
-  if( gl_eCurrentAPI==GAT_NONE) return TRUE;
+  if( gl_eCurrentAPI==GAT_NONE) {
+    gl_pvpActive = pvp;
+    return TRUE;
+  }
   ASSERTALWAYS( "SetCurrenViewport: Wrong API!");
   return FALSE;
 }
@@ -1746,8 +1809,8 @@ void CGfxLibrary::SwapBuffers(CViewPort *pvp)
   ASSERT(gl_eCurrentAPI == GAT_OGL || gl_eCurrentAPI == GAT_NONE);
 #endif // SE1_D3D
 
-  // safety check
-  ASSERT( gl_pvpActive!=NULL);
+  // safety check (NONE API doesn't activate viewports)
+  ASSERT( gl_pvpActive!=NULL || gl_eCurrentAPI==GAT_NONE);
   if( pvp!=gl_pvpActive) {
     ASSERTALWAYS( "Swapping viewport that was not last drawn to!");
     return;
@@ -1781,7 +1844,8 @@ void CGfxLibrary::SwapBuffers(CViewPort *pvp)
         pwglSwapIntervalEXT( gl_iSwapInterval);
       }
     }
-    // swap buffers
+    // swap buffers (draws that wait to be merged must be done first)
+    gles_adapter::flushDraws();
     if (!eglSwapBuffers(pvp->display, pvp->surface)) {
       WarningMessage("eglSwapBuffers() returned error 0x%04X", eglGetError());
     }
@@ -1890,7 +1954,7 @@ void CGfxLibrary::SwapBuffers(CViewPort *pvp)
   }
 
   // clear viewport if needed
-  if( gfx_bClearScreen) pvp->vp_Raster.ra_MainDrawPort.Fill( C_BLACK|CT_OPAQUE);
+  if( gfx_bClearScreen && pvp!=NULL) pvp->vp_Raster.ra_MainDrawPort.Fill( C_BLACK|CT_OPAQUE);
   //pvp->vp_Raster.ra_MainDrawPort.FillZBuffer(ZBUF_BACK);
 
   // adjust gamma table if supported ...
@@ -1942,7 +2006,7 @@ BOOL CGfxLibrary::LockRaster( CRaster *praToLock)
 {
   // don't do this! it can break sync consistency in entities!
   // SetFPUPrecision(FPT_24BIT); 
-  ASSERT( praToLock->ra_pvpViewPort!=NULL);
+  ASSERT( praToLock->ra_pvpViewPort!=NULL || gl_eCurrentAPI==GAT_NONE); // NONE API can draw to raster w/o viewport
   BOOL bRes = SetCurrentViewport( praToLock->ra_pvpViewPort);
   if( bRes) {
     // must signal to picky Direct3D
@@ -64,6 +64,10 @@ GLuint compileShader(GLenum type, const char *name, const char *source) {
 void gfxUseProgram(GfxProgram _program) {
   GfxProgramPrivate *pgm = (GfxProgramPrivate *) _program;
   _currentProgram = pgm;
+  // NONE API doesn't compile anything
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) return;
+  // adapter must not keep its arrays enabled under our program
+  gles_adapter::releaseState();
   if (!pgm) {
     glUseProgram(0);
     return;
@@ -109,6 +113,7 @@ void gfxUseProgram(GfxProgram _program) {
 
 SLONG gfxGetAttribLocation(GfxProgram _program, const char *name) {
   GfxProgramPrivate *pgm = (GfxProgramPrivate *) _program;
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) return -1;
   GLint result = glGetAttribLocation(pgm->pgmObject, name);
   gles_adapter::syncError();
   return result;
@@ -117,6 +122,7 @@ SLONG gfxGetAttribLocation(GfxProgram _program, const char *name) {
 void gfxUniform(const char *uniformName, float f0) {
   GfxProgramPrivate *pgm = _currentProgram;
   ASSERT(pgm);
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) return;
   GLint uniformLocation = glGetUniformLocation(pgm->pgmObject, uniformName);
   if (uniformLocation >= 0) {
     glUniform1f(uniformLocation, f0);
@@ -127,6 +133,7 @@ void gfxUniform(const char *uniformName, float f0) {
 void gfxUniform(const char *uniformName, float f0, float f1) {
   GfxProgramPrivate *pgm = _currentProgram;
   ASSERT(pgm);
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) return;
   GLint uniformLocation = glGetUniformLocation(pgm->pgmObject, uniformName);
   if (uniformLocation >= 0) {
     glUniform2f(uniformLocation, f0, f1);
@@ -137,6 +144,7 @@ void gfxUniform(const char *uniformName, float f0, float f1) {
 void gfxUniform(const char *uniformName, float f0, float f1, float f2) {
   GfxProgramPrivate *pgm = _currentProgram;
   ASSERT(pgm);
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) return;
   GLint uniformLocation = glGetUniformLocation(pgm->pgmObject, uniformName);
   if (uniformLocation >= 0) {
     glUniform3f(uniformLocation, f0, f1, f2);
@@ -147,6 +155,7 @@ void gfxUniform(const char *uniformName, float f0, float f1, float f2) {
 void gfxUniform(const char *uniformName, float f0, float f1, float f2, float f3) {
   GfxProgramPrivate *pgm = _currentProgram;
   ASSERT(pgm);
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) return;
   GLint uniformLocation = glGetUniformLocation(pgm->pgmObject, uniformName);
   if (uniformLocation >= 0) {
     glUniform4f(uniformLocation, f0, f1, f2, f3);
@@ -161,6 +170,7 @@ void gfxUniform(const char *uniformName, GFXColor &color) {
 void gfxUniform(const char *uniformName, const FLOATmatrix3D &matrix) {
   GfxProgramPrivate *pgm = _currentProgram;
   ASSERT(pgm);
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) return;
   GLint uniformLocation = glGetUniformLocation(pgm->pgmObject, uniformName);
   if (uniformLocation >= 0) {
     glUniformMatrix3fv(uniformLocation, 1, GL_FALSE, (const float *) &matrix);
@@ -199,6 +209,11 @@ inline BOOL operator!=(const GFXColor &v1, const GFXColor &v2) {
 void gfxSyncProgram(struct GfxShadersUniforms &params) {
   GfxProgramPrivate *pgm = _currentProgram;
   ASSERT(pgm);
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) {
+    GFX_nsNullAPI.ns_ctProgramSyncs++;
+    return;
+  }
+  gles_adapter::releaseState();
   glUseProgram(pgm->pgmObject);
 
   // update buffers
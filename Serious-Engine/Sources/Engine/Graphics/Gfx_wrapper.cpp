@@ -17,9 +17,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <Engine/Graphics/GfxLibrary.h>
 #include <Engine/Graphics/ViewPort.h>
+#include <Engine/Graphics/Texture.h>
 
 #include <Engine/Graphics/GfxProfile.h>
 #include <Engine/Base/Statistics_Internal.h>
+#include <Engine/Base/Translation.h>
+#include <GLES2/gl2.h>
+#include <AndroidAdapters/gles_adapter.h>
 
 //#include <d3dx8math.h>
 //#pragma comment(lib, "d3dx8.lib")
@@ -140,13 +144,6 @@ void (*gfxSetColorMask)( ULONG ulColorMask) = NULL;
 
 
 
-// dummy function (one size fits all:)
-static void none_void(void)
-{
-  ASSERT( _pGfx->gl_eCurrentAPI==GAT_NONE);
-}
-
-
 // error checkers (this is for debug version only)
 
 extern void OGL_CheckError(void)
@@ -189,6 +186,11 @@ extern void  UploadTexture_D3D( LPDIRECT3DTEXTURE8 *ppd3dTexture, ULONG *pulText
                                 PIX pixSizeU, PIX pixSizeV, D3DFORMAT eInternalFormat, BOOL bDiscard);
 #endif // SE1_D3D
 
+extern void SetTexture_None( CTexParams &tpLocal);
+extern void UploadTexture_None( PIX pixSizeU, PIX pixSizeV);
+extern void GenerateBuffer_None( UINT &uiBufObject);
+extern void DrawElementArrayBuffer_None( INDEX ctElem);
+
 // update texture LOD bias
 FLOAT _fCurrentLODBias = 0;  // LOD bias adjuster
 extern void UpdateLODBias( const FLOAT fLODBias)
@@ -382,6 +384,9 @@ extern void gfxSetTexture( ULONG &ulTexObject, CTexParams &tpLocal)
     MimicTexParams_D3D(tpLocal);
   }
 #endif // SE1_D3D
+  else if( eAPI==GAT_NONE) { // none
+    SetTexture_None(tpLocal);
+  }
   // done
   _pfGfxProfile.StopTimer(CGfxProfile::PTI_SETCURRENTTEXTURE);
   _sfStats.StopTimer(CStatForm::STI_BINDTEXTURE);
@@ -417,6 +422,9 @@ extern void gfxUploadTexture( ULONG *pulTexture, PIX pixWidth, PIX pixHeight, UL
     }
   } 
 #endif // SE1_D3D
+  else if( eAPI==GAT_NONE) { // none
+    UploadTexture_None( pixWidth, pixHeight);
+  }
   _sfStats.StopTimer(CStatForm::STI_GFXAPI);
 }
 
@@ -436,7 +444,7 @@ extern SLONG gfxGetTextureSize( ULONG ulTexObject, BOOL bHasMipmaps/*=TRUE*/)
 #else // SE1_D3D
   ASSERT(eAPI == GAT_OGL || eAPI == GAT_NONE);
 #endif // SE1_D3D
-  SLONG slMipSize;
+  SLONG slMipSize = 0;  // nothing is really uploaded with NONE API
 
   _sfStats.StartTimer(CStatForm::STI_GFXAPI);
 
@@ -522,6 +530,8 @@ extern INDEX gfxGetFormatPixRatio( ULONG ulTextureFormat)
 #ifdef SE1_D3D
   else if( eAPI==GAT_D3D) return GetFormatPixRatio_D3D( (D3DFORMAT)ulTextureFormat);
 #endif // SE1_D3D
+  // NONE API uses OpenGL formats
+  else if( eAPI==GAT_NONE) return GetFormatPixRatio_OGL( (GLenum)ulTextureFormat);
   else return 0;
 }
 
@@ -703,29 +713,7 @@ extern ULONG gfxGetColorMask(void)
 
 #include "Gfx_wrapper_OpenGL.cpp"
 #include "Gfx_wrapper_Direct3D.cpp"
-
-
-
-// DUMMY FUNCTIONS FOR NONE API
-static void none_BlendFunc( GfxBlend eSrc, GfxBlend eDst) { NOTHING; }
-static void none_DepthFunc( GfxComp eFunc) { NOTHING; };
-static void none_DepthRange( FLOAT fMin, FLOAT fMax) { NOTHING; };
-static void none_CullFace( GfxFace eFace) { NOTHING; };
-static void none_ClipPlane( const DOUBLE *pdViewPlane) { NOTHING; };
-static void none_SetOrtho(   const FLOAT fLeft, const FLOAT fRight, const FLOAT fTop, const FLOAT fBottom, const FLOAT fNear, const FLOAT fFar, const BOOL bSubPixelAdjust) { NOTHING; };
-static void none_SetFrustum( const FLOAT fLeft, const FLOAT fRight, const FLOAT fTop, const FLOAT fBottom, const FLOAT fNear, const FLOAT fFar) { NOTHING; };
-static void none_SetMatrix( const FLOAT *pfMatrix) { NOTHING; };
-static void none_PolygonMode( GfxPolyMode ePolyMode) { NOTHING; };
-static void none_SetTextureWrapping( enum GfxWrap eWrapU, enum GfxWrap eWrapV) { NOTHING; };
-static void none_SetTextureModulation( INDEX iScale) { NOTHING; };
-static void none_GenDelTexture( ULONG &ulTexObject) { NOTHING; };
-static void none_SetVertexArray( GFXVertex4 *pvtx, INDEX ctVtx) { NOTHING; };
-static void none_SetNormalArray( GFXNormal *pnor) { NOTHING; };
-static void none_SetTexCoordArray( GFXTexCoord *ptex, BOOL b4) { NOTHING; };
-static void none_SetColorArray( GFXColor *pcol) { NOTHING; };
-static void none_DrawElements( INDEX ctElem, INDEX *pidx) { NOTHING; };
-static void none_SetConstantColor( COLOR col) { NOTHING; };
-static void none_SetColorMask( ULONG ulColorMask) { NOTHING; };
+#include "Gfx_wrapper_None.cpp"
 
 
 
@@ -837,112 +825,129 @@ extern void GFX_SetFunctionPointers( INDEX iAPI)
   // NONE!
   else
   {
-    gfxEnableDepthWrite     = &none_void;
-    gfxEnableDepthBias      = &none_void;
-    gfxEnableDepthTest      = &none_void;
-    gfxEnableAlphaTest      = &none_void;
-    gfxEnableBlend          = &none_void;
-    gfxEnableDither         = &none_void;
-    gfxEnableTexture        = &none_void;
-    gfxEnableClipping       = &none_void;
-    gfxEnableClipPlane      = &none_void;
-    gfxEnableTruform        = &none_void;
-    gfxDisableDepthWrite    = &none_void;
-    gfxDisableDepthBias     = &none_void;
-    gfxDisableDepthTest     = &none_void;
-    gfxDisableAlphaTest     = &none_void;
-    gfxDisableBlend         = &none_void;
-    gfxDisableDither        = &none_void;
-    gfxDisableTexture       = &none_void;
-    gfxDisableClipping      = &none_void;
-    gfxDisableClipPlane     = &none_void;
-    gfxDisableTruform       = &none_void;
+    gfxEnableDepthWrite     = &none_EnableDepthWrite;
+    gfxEnableDepthBias      = &none_SwitchDepthBias;
+    gfxEnableDepthTest      = &none_EnableDepthTest;
+    gfxEnableAlphaTest      = &none_EnableAlphaTest;
+    gfxEnableBlend          = &none_EnableBlend;
+    gfxEnableDither         = &none_EnableDither;
+    gfxEnableTexture        = &none_EnableTexture;
+    gfxEnableClipping       = &none_EnableClipping;
+    gfxEnableClipPlane      = &none_EnableClipPlane;
+    gfxEnableTruform        = &none_EnableTruform;
+    gfxDisableDepthWrite    = &none_DisableDepthWrite;
+    gfxDisableDepthBias     = &none_SwitchDepthBias;
+    gfxDisableDepthTest     = &none_DisableDepthTest;
+    gfxDisableAlphaTest     = &none_DisableAlphaTest;
+    gfxDisableBlend         = &none_DisableBlend;
+    gfxDisableDither        = &none_DisableDither;
+    gfxDisableTexture       = &none_DisableTexture;
+    gfxDisableClipping      = &none_DisableClipping;
+    gfxDisableClipPlane     = &none_DisableClipPlane;
+    gfxDisableTruform       = &none_DisableTruform;
     gfxBlendFunc            = &none_BlendFunc;
     gfxDepthFunc            = &none_DepthFunc;
     gfxDepthRange           = &none_DepthRange;
     gfxCullFace             = &none_CullFace;
-    gfxFrontFace            = &none_CullFace;
+    gfxFrontFace            = &none_FrontFace;
     gfxClipPlane            = &none_ClipPlane;
     gfxSetOrtho             = &none_SetOrtho;
     gfxSetFrustum           = &none_SetFrustum;
-    gfxSetTextureMatrix     = &none_SetMatrix;
-    gfxSetViewMatrix        = &none_SetMatrix;
+    gfxSetTextureMatrix     = &none_SetTextureMatrix;
+    gfxSetViewMatrix        = &none_SetViewMatrix;
     gfxPolygonMode          = &none_PolygonMode;
     gfxSetTextureWrapping   = &none_SetTextureWrapping;
     gfxSetTextureModulation = &none_SetTextureModulation;
-    gfxGenerateTexture      = &none_GenDelTexture;
-    gfxDeleteTexture        = &none_GenDelTexture;   
+    gfxGenerateTexture      = &none_GenerateTexture;
+    gfxDeleteTexture        = &none_DeleteTexture;
     gfxSetVertexArray       = &none_SetVertexArray;  
     gfxSetNormalArray       = &none_SetNormalArray;  
     gfxSetTexCoordArray     = &none_SetTexCoordArray;
     gfxSetColorArray        = &none_SetColorArray;   
     gfxDrawElements         = &none_DrawElements;    
     gfxSetConstantColor     = &none_SetConstantColor;
-    gfxEnableColorArray     = &none_void;
-    gfxDisableColorArray    = &none_void;
-    gfxFinish               = &none_void;
-    gfxLockArrays           = &none_void;
+    gfxEnableColorArray     = &none_EnableColorArray;
+    gfxDisableColorArray    = &none_DisableColorArray;
+    gfxFinish               = &none_Finish;
+    gfxLockArrays           = &none_LockArrays;
     gfxSetColorMask         = &none_SetColorMask;
   }
 }
 
 // gles functions
 // TODO: move in a better place
-#include <GLES2/gl2.h>
 #include <vector>
-#include <AndroidAdapters/gles_adapter.h>
 
 void gfxGenerateBuffer(UINT &uiBufObject) {
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) {
+    GenerateBuffer_None(uiBufObject);
+    return;
+  }
   ASSERT(_pGfx->gl_eCurrentAPI == (INDEX) GAT_OGL);
   glGenBuffers(1, &uiBufObject);
   gles_adapter::syncError();
 }
 
 void gfxSetElementArrayBuffer(UINT uiBufObject) {
+  GFX_uiElementBufObject = uiBufObject;
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) return;
   ASSERT(_pGfx->gl_eCurrentAPI == (INDEX) GAT_OGL);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uiBufObject);
-  GFX_uiElementBufObject = uiBufObject;
   gles_adapter::syncError();
 }
 
 void gfxElementArrayBufferData(UWORD *puwData, ULONG ulCount) {
-  ASSERT(_pGfx->gl_eCurrentAPI == (INDEX) GAT_OGL);
   ASSERT(GFX_uiElementBufObject);
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) {
+    GFX_nsNullAPI.ns_ctBufferUploads++;
+    GFX_nsNullAPI.ns_slBufferUploadBytes += ulCount * sizeof(UWORD);
+    return;
+  }
+  ASSERT(_pGfx->gl_eCurrentAPI == (INDEX) GAT_OGL);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, ulCount * sizeof(UWORD), puwData, GL_STATIC_DRAW);
   gles_adapter::syncError();
 }
 
 void gfxSetArrayBuffer(UINT uiBufObject) {
+  GFX_uiArrayBufObject = uiBufObject;
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) return;
   ASSERT(_pGfx->gl_eCurrentAPI == (INDEX) GAT_OGL);
   glBindBuffer(GL_ARRAY_BUFFER, uiBufObject);
-  GFX_uiArrayBufObject = uiBufObject;
   gles_adapter::syncError();
 }
 
 void gfxArrayBufferData(void *pvData, ULONG ulSize) {
-  ASSERT(_pGfx->gl_eCurrentAPI == (INDEX) GAT_OGL);
   ASSERT(GFX_uiArrayBufObject);
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) {
+    GFX_nsNullAPI.ns_ctBufferUploads++;
+    GFX_nsNullAPI.ns_slBufferUploadBytes += ulSize;
+    return;
+  }
+  ASSERT(_pGfx->gl_eCurrentAPI == (INDEX) GAT_OGL);
   glBufferData(GL_ARRAY_BUFFER, ulSize, pvData, GL_STATIC_DRAW);
   gles_adapter::syncError();
 }
 
 void gfxEnableVertexAttribArray(ULONG index) {
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) return;
   glEnableVertexAttribArray(index);
   gles_adapter::syncError();
 }
 
 void gfxDisableVertexAttribArray(ULONG index) {
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) return;
   glDisableVertexAttribArray(index);
   gles_adapter::syncError();
 }
 
 void gfxVertexAttribPointer(ULONG attribPointer, ULONG size, ULONG stride, ULONG offset) {
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) return;
   glVertexAttribPointer(attribPointer, size, GL_FLOAT, GL_FALSE, stride, (void *) offset);
   gles_adapter::syncError();
 }
 
 void gfxDrawElementArrayBuffer(INDEX iCount, INDEX *pidx) {
-  ASSERT(_pGfx->gl_eCurrentAPI == (INDEX) GAT_OGL);
+  ASSERT(_pGfx->gl_eCurrentAPI == (INDEX) GAT_OGL || _pGfx->gl_eCurrentAPI == GAT_NONE);
   static std::vector<uint16_t> dummyIndexBuffer;
 
   // convert int array to short array
@@ -953,6 +958,67 @@ void gfxDrawElementArrayBuffer(INDEX iCount, INDEX *pidx) {
     dummyIndexBuffer[i] = (uint16_t) pidx[i];
   }
 
+  // NONE API just counts it (index conversion above is still measured)
+  if (_pGfx->gl_eCurrentAPI == GAT_NONE) {
+    DrawElementArrayBuffer_None(iCount);
+    return;
+  }
   glDrawElements(GL_TRIANGLES, iCount, GL_UNSIGNED_SHORT, (void*) dummyIndexBuffer.data());
   gles_adapter::syncError();
 }
+
+// count GL calls issued by the adapter for a recorded frame, with and without its state cache
+// and draw merging, drawing from client memory and from streaming buffers
+void GlesCallCount(void)
+{
+  const bool bOldCache = gles_adapter::useStateCache;
+  const bool bOldBufferData = gles_adapter::USE_BUFFER_DATA;
+  const bool bOldMerging = gles_adapter::useDrawMerging;
+  for (INDEX iCase=0; iCase<8; iCase++) {
+    gles_adapter::useStateCache = (iCase&1)!=0;
+    gles_adapter::USE_BUFFER_DATA = (iCase&2)!=0;
+    gles_adapter::useDrawMerging = (iCase&4)!=0;
+    gles_adapter::GlesCallCounts gcc = gles_adapter::countGlesCalls(&gles_adapter::replayRecordedStream);
+    CPrintF(TRANS("GL calls per frame %s state cache, %s merging, from %s: %d (%d bytes uploaded)\n"),
+      (iCase&1) ? "with" : "without", (iCase&4) ? "with" : "without", (iCase&2) ? "stream buffers" : "client arrays",
+      gcc.total(), gcc.bytesUploaded);
+    CPrintF("  draws %d of %d, programs %d, uniforms %d, pointers %d, enables %d, disables %d, binds %d, allocs %d, uploads %d, states %d, errors %d\n",
+      gcc.draws, gcc.adapterDraws, gcc.useProgram, gcc.uniforms, gcc.attribPointers, gcc.attribEnables, gcc.attribDisables,
+      gcc.bufferBinds, gcc.bufferUploads, gcc.bufferSubUploads, gcc.stateChanges, gcc.getErrors);
+  }
+  gles_adapter::useStateCache = bOldCache;
+  gles_adapter::USE_BUFFER_DATA = bOldBufferData;
+  gles_adapter::useDrawMerging = bOldMerging;
+  CPrintF(TRANS("Since start: %d draws given to adapter, %d drawn after merging\n"),
+    gles_adapter::drawMergeCounts.draws, gles_adapter::drawMergeCounts.batches);
+}
+
+// check that merged draws of a recorded frame reach mock GL as the same vertices with the same state
+void GlesDrawMergeCheck(void)
+{
+  const bool bOldCache = gles_adapter::useStateCache;
+  const bool bOldBufferData = gles_adapter::USE_BUFFER_DATA;
+  const bool bOldMerging = gles_adapter::useDrawMerging;
+  INDEX ctFailed = 0;
+  for (INDEX iCase=0; iCase<4; iCase++) {
+    gles_adapter::useStateCache = (iCase&1)!=0;
+    gles_adapter::USE_BUFFER_DATA = (iCase&2)!=0;
+    gles_adapter::useDrawMerging = false;
+    gles_adapter::GlesCallCounts gccSeparate = gles_adapter::countGlesCalls(&gles_adapter::replayRecordedStream);
+    gles_adapter::useDrawMerging = true;
+    gles_adapter::GlesCallCounts gccMerged = gles_adapter::countGlesCalls(&gles_adapter::replayRecordedStream);
+    const BOOL bSame = gccSeparate.renderHash==gccMerged.renderHash;
+    if (!bSame) ctFailed++;
+    CPrintF("  %s state cache, from %s: %d draws -> %d, %s\n",
+      (iCase&1) ? "with" : "without", (iCase&2) ? "stream buffers" : "client arrays",
+      gccSeparate.draws, gccMerged.draws, bSame ? "same" : "DIFFERENT");
+  }
+  gles_adapter::useStateCache = bOldCache;
+  gles_adapter::USE_BUFFER_DATA = bOldBufferData;
+  gles_adapter::useDrawMerging = bOldMerging;
+  if (ctFailed==0) {
+    CPrintF(TRANS("Draw merging check passed.\n"));
+  } else {
+    CPrintF(TRANS("Draw merging check FAILED in %d cases!\n"), ctFailed);
+  }
+}
@@ -73,6 +73,25 @@ enum GfxPolyMode
 extern void GFX_SetFunctionPointers( INDEX iAPI);
 
 
+// everything that NONE API was asked to do (for measuring rendering without accelerator)
+struct GfxNullStats {
+  INDEX ns_ctDrawCalls;
+  INDEX ns_ctTriangles;
+  INDEX ns_ctVertices;            // in vertex arrays
+  INDEX ns_ctStateChanges;        // only those that would reach the API (cached ones are skipped)
+  INDEX ns_ctProgramSyncs;        // shader program uniform updates
+  INDEX ns_ctTextureBinds;
+  INDEX ns_ctTextureUploads;
+  SLONG ns_slTextureUploadBytes;
+  INDEX ns_ctBufferUploads;
+  SLONG ns_slBufferUploadBytes;
+  inline void Clear(void) { memset( this, 0, sizeof(*this)); };
+};
+extern struct GfxNullStats GFX_nsNullAPI;
+// print recorded stats averaged over given number of frames
+extern void GFX_ReportNullAPI( INDEX ctFrames);
+
+
 // enable operations
 extern void (*gfxEnableDepthWrite)(void);
 extern void (*gfxEnableDepthBias)(void);
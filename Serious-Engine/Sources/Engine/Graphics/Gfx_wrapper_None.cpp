@@ -0,0 +1,332 @@
+/* Copyright (c) 2002-2012 Croteam Ltd.
+This program is free software; you can redistribute it and/or modify
+it under the terms of version 2 of the GNU General Public License as published by
+the Free Software Foundation
+
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA. */
+
+
+// NONE API - nothing is rendered, but everything that would be sent to the accelerator is counted.
+// Cached states are kept the same way as with OpenGL, so only real state changes are counted.
+
+struct GfxNullStats GFX_nsNullAPI = {0};
+
+// texture and buffer objects are just numbers
+static ULONG _ulLastNullObject = 0;
+// parameters of last bound texture (for counting uploaded mip-maps)
+static CTexParams *_ptpNullCurrent = NULL;
+
+
+// ENABLE/DISABLE FUNCTIONS
+
+#define NONE_SWITCH( name, state)                                       \
+static void none_Enable##name(void)                                     \
+{                                                                       \
+  ASSERT( _pGfx->gl_eCurrentAPI==GAT_NONE);                             \
+  if( (state) && gap_bOptimizeStateChanges) return;                     \
+  (state) = TRUE;                                                       \
+  GFX_nsNullAPI.ns_ctStateChanges++;                                    \
+}                                                                       \
+static void none_Disable##name(void)                                    \
+{                                                                       \
+  ASSERT( _pGfx->gl_eCurrentAPI==GAT_NONE);                             \
+  if( !(state) && gap_bOptimizeStateChanges) return;                    \
+  (state) = FALSE;                                                      \
+  GFX_nsNullAPI.ns_ctStateChanges++;                                    \
+}
+
+NONE_SWITCH( Texture,    GFX_abTexture[GFX_iActiveTexUnit])
+NONE_SWITCH( DepthTest,  GFX_bDepthTest)
+NONE_SWITCH( DepthWrite, GFX_bDepthWrite)
+NONE_SWITCH( Dither,     GFX_bDithering)
+NONE_SWITCH( AlphaTest,  GFX_bAlphaTest)
+NONE_SWITCH( Blend,      GFX_bBlending)
+NONE_SWITCH( Clipping,   GFX_bClipping)
+NONE_SWITCH( ClipPlane,  GFX_bClipPlane)
+NONE_SWITCH( ColorArray, GFX_bColorArray)
+NONE_SWITCH( Truform,    GFX_bTruform)
+
+
+// depth bias isn't cached
+static void none_SwitchDepthBias(void)
+{
+  ASSERT( _pGfx->gl_eCurrentAPI==GAT_NONE);
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+// set blending operations
+static void none_BlendFunc( GfxBlend eSrc, GfxBlend eDst)
+{
+  if( eSrc==GFX_eBlendSrc && eDst==GFX_eBlendDst && gap_bOptimizeStateChanges) return;
+  GFX_eBlendSrc = eSrc;
+  GFX_eBlendDst = eDst;
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+// set depth buffer compare mode
+static void none_DepthFunc( GfxComp eFunc)
+{
+  if( eFunc==GFX_eDepthFunc && gap_bOptimizeStateChanges) return;
+  GFX_eDepthFunc = eFunc;
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+// set depth buffer range
+static void none_DepthRange( FLOAT fMin, FLOAT fMax)
+{
+  if( GFX_fMinDepthRange==fMin && GFX_fMaxDepthRange==fMax && gap_bOptimizeStateChanges) return;
+  GFX_fMinDepthRange = fMin;
+  GFX_fMaxDepthRange = fMax;
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+// set face culling
+static void none_CullFace( GfxFace eFace)
+{
+  ASSERT( eFace==GFX_FRONT || eFace==GFX_BACK || eFace==GFX_NONE);
+  if( GFX_eCullFace==eFace && gap_bOptimizeStateChanges) return;
+  GFX_eCullFace = eFace;
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+// set front face
+static void none_FrontFace( GfxFace eFace)
+{
+  ASSERT( eFace==GFX_CW || eFace==GFX_CCW);
+  const BOOL bFrontFace = (eFace==GFX_CCW);
+  if( !bFrontFace==!GFX_bFrontFace && gap_bOptimizeStateChanges) return;
+  GFX_bFrontFace = bFrontFace;
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+// set custom clip plane
+static void none_ClipPlane( const DOUBLE *pdViewPlane)
+{
+  ASSERT( pdViewPlane!=NULL);
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+// color buffer writing enable
+static void none_SetColorMask( ULONG ulColorMask)
+{
+  _ulCurrentColorMask = ulColorMask; // keep for Get...()
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+// polygon mode (point, line or fill)
+static void none_PolygonMode( GfxPolyMode ePolyMode)
+{
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+
+// PROJECTIONS
+
+
+// set texture matrix
+static void none_SetTextureMatrix( const FLOAT *pfMatrix)
+{
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+// set view matrix
+static void none_SetViewMatrix( const FLOAT *pfMatrix)
+{
+  // cached? (only identity matrix)
+  if( pfMatrix==NULL && GFX_bViewMatrix==NONE && gap_bOptimizeStateChanges) return;
+  GFX_bViewMatrix = (pfMatrix!=NULL);
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+// set orthographic matrix
+static void none_SetOrtho( const FLOAT fLeft,   const FLOAT fRight, const FLOAT fTop,
+                           const FLOAT fBottom, const FLOAT fNear,  const FLOAT fFar,
+                           const BOOL bSubPixelAdjust)
+{
+  if( GFX_fLastL==fLeft  && GFX_fLastT==fTop    && GFX_fLastN==fNear
+   && GFX_fLastR==fRight && GFX_fLastB==fBottom && GFX_fLastF==fFar && gap_bOptimizeStateChanges) return;
+  GFX_fLastL = fLeft;   GFX_fLastT = fTop;     GFX_fLastN = fNear;
+  GFX_fLastR = fRight;  GFX_fLastB = fBottom;  GFX_fLastF = fFar;
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+// set frustrum matrix
+static void none_SetFrustum( const FLOAT fLeft, const FLOAT fRight,
+                             const FLOAT fTop,  const FLOAT fBottom,
+                             const FLOAT fNear, const FLOAT fFar)
+{
+  if( GFX_fLastL==-fLeft  && GFX_fLastT==-fTop    && GFX_fLastN==-fNear
+   && GFX_fLastR==-fRight && GFX_fLastB==-fBottom && GFX_fLastF==-fFar && gap_bOptimizeStateChanges) return;
+  GFX_fLastL = -fLeft;   GFX_fLastT = -fTop;     GFX_fLastN = -fNear;
+  GFX_fLastR = -fRight;  GFX_fLastB = -fBottom;  GFX_fLastF = -fFar;
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+
+// TEXTURE MANAGEMENT
+
+
+// set texture wrapping mode
+static void none_SetTextureWrapping( enum GfxWrap eWrapU, enum GfxWrap eWrapV)
+{
+  _tpGlobal[GFX_iActiveTexUnit].tp_eWrapU = eWrapU;
+  _tpGlobal[GFX_iActiveTexUnit].tp_eWrapV = eWrapV;
+}
+
+
+// set texture modulation mode
+static void none_SetTextureModulation( INDEX iScale)
+{
+  ASSERT( iScale==1 || iScale==2);
+  if( GFX_iTexModulation[GFX_iActiveTexUnit]==iScale) return;
+  GFX_iTexModulation[GFX_iActiveTexUnit] = iScale;
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+// generate texture for API
+static void none_GenerateTexture( ULONG &ulTexObject)
+{
+  ulTexObject = ++_ulLastNullObject;
+}
+
+
+// unbind texture from API
+static void none_DeleteTexture( ULONG &ulTexObject)
+{
+  ulTexObject = NONE;
+}
+
+
+// set texture as current
+extern void SetTexture_None( CTexParams &tpLocal)
+{
+  _ptpNullCurrent = &tpLocal;
+  GFX_nsNullAPI.ns_ctTextureBinds++;
+}
+
+
+// upload texture (all mip-maps, as OpenGL would)
+extern void UploadTexture_None( PIX pixSizeU, PIX pixSizeV)
+{
+  ASSERT( pixSizeU>0 && pixSizeV>0);
+  const BOOL bSingleMipmap = (_ptpNullCurrent!=NULL && _ptpNullCurrent->tp_bSingleMipmap);
+  SLONG slSize = 0;
+  while( pixSizeU>0 && pixSizeV>0) {
+    slSize += pixSizeU*pixSizeV *BYTES_PER_TEXEL;
+    pixSizeU >>=1;
+    pixSizeV >>=1;
+    if( bSingleMipmap) break;
+  }
+  GFX_nsNullAPI.ns_ctTextureUploads++;
+  GFX_nsNullAPI.ns_slTextureUploadBytes += slSize;
+}
+
+
+// generate buffer object
+extern void GenerateBuffer_None( UINT &uiBufObject)
+{
+  uiBufObject = ++_ulLastNullObject;
+}
+
+
+
+// VERTEX ARRAYS
+
+
+// prepare vertex array for API
+static void none_SetVertexArray( GFXVertex4 *pvtx, INDEX ctVtx)
+{
+  ASSERT( ctVtx>0 && pvtx!=NULL && GFX_iActiveTexUnit==0);
+  GFX_ctVertices = ctVtx;
+  GFX_bColorArray = FALSE; // same as OpenGL
+  GFX_nsNullAPI.ns_ctVertices += ctVtx;
+}
+
+
+static void none_SetNormalArray( GFXNormal *pnor) { ASSERT( pnor!=NULL); }
+static void none_SetTexCoordArray( GFXTexCoord *ptex, BOOL b4) { ASSERT( ptex!=NULL); }
+
+
+// prepare color array for API (and force rendering with color array!)
+static void none_SetColorArray( GFXColor *pcol)
+{
+  ASSERT( pcol!=NULL);
+  none_EnableColorArray();
+}
+
+
+// set constant color (and force rendering w/o color array!)
+static void none_SetConstantColor( COLOR col)
+{
+  none_DisableColorArray();
+  GFX_nsNullAPI.ns_ctStateChanges++;
+}
+
+
+// draw prepared arrays
+static void none_DrawElements( INDEX ctElem, INDEX *pidx)
+{
+#ifndef NDEBUG
+  // same check as for OpenGL, so bad indices are caught without the accelerator, too
+  if( pidx!=NULL) for( INDEX i=0; i<ctElem; i++) ASSERT( pidx[i] < GFX_ctVertices);
+#endif
+  _pGfx->gl_ctTotalTriangles += ctElem/3;  // for profiling
+  GFX_nsNullAPI.ns_ctDrawCalls++;
+  GFX_nsNullAPI.ns_ctTriangles += ctElem/3;
+}
+
+
+// draw uploaded elements (vertices are already in buffer object)
+extern void DrawElementArrayBuffer_None( INDEX ctElem)
+{
+  _pGfx->gl_ctTotalTriangles += ctElem/3;
+  GFX_nsNullAPI.ns_ctDrawCalls++;
+  GFX_nsNullAPI.ns_ctTriangles += ctElem/3;
+}
+
+
+
+// MISC
+
+static void none_Finish(void) { NOTHING; }
+static void none_LockArrays(void) { NOTHING; }
+
+
+// print what has been recorded since last reset
+extern void GFX_ReportNullAPI( INDEX ctFrames)
+{
+  const GfxNullStats &ns = GFX_nsNullAPI;
+  const DOUBLE dFrames = Max( ctFrames, 1L);
+  CPrintF( TRANS("  draw calls:      %8.1f\n"), ns.ns_ctDrawCalls/dFrames);
+  CPrintF( TRANS("  triangles:       %8.1f\n"), ns.ns_ctTriangles/dFrames);
+  CPrintF( TRANS("  vertices:        %8.1f\n"), ns.ns_ctVertices/dFrames);
+  CPrintF( TRANS("  state changes:   %8.1f\n"), ns.ns_ctStateChanges/dFrames);
+  CPrintF( TRANS("  program syncs:   %8.1f\n"), ns.ns_ctProgramSyncs/dFrames);
+  CPrintF( TRANS("  texture binds:   %8.1f\n"), ns.ns_ctTextureBinds/dFrames);
+  CPrintF( TRANS("  texture uploads: %8.1f (%.1f KB)\n"), ns.ns_ctTextureUploads/dFrames,
+           ns.ns_slTextureUploadBytes/1024.0/dFrames);
+  CPrintF( TRANS("  buffer uploads:  %8.1f (%.1f KB)\n"), ns.ns_ctBufferUploads/dFrames,
+           ns.ns_slBufferUploadBytes/1024.0/dFrames);
+}
@@ -1049,6 +1049,7 @@ static void ogl_SetVertexArray( GFXVertex4 *pvtx, INDEX ctVtx)
   ASSERT( !pglIsEnabled( GL_NORMAL_ARRAY));
   ASSERT(  pglIsEnabled( GL_VERTEX_ARRAY));
   pglVertexPointer( 3, GL_FLOAT, 16, pvtx);
+  gles_adapter::setVertexCount(ctVtx); // so that indices need not be scanned
   OGL_CHECKERROR;
   GFX_bColorArray = FALSE; // mark that color array has been disabled (because of potential LockArrays)
 
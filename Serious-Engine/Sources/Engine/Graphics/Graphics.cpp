@@ -21,11 +21,32 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Graphics/Color.h>
 #include <Engine/Graphics/Texture.h>
 #include <Engine/Graphics/GfxProfile.h>
+#include <Engine/Base/WorkerPool.h>
+#include <Engine/Base/Memory.h>
+#include <Engine/Base/Shell.h>
+#include <Engine/Base/Timer.h>
+#include <Engine/Base/Console.h>
+#include <Engine/Base/Translation.h>
+#include <Engine/Base/Unzip.h>
+#include <Engine/Templates/StaticStackArray.cpp>
 
 #if USE_MMX_INTRINSICS
 #include <mmintrin.h>
 #endif
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BITMAP_NEON 1
+#else
+#define BITMAP_NEON 0
+#endif
+#if !BITMAP_NEON && defined(__SSE2__)
+#include <emmintrin.h>
+#define BITMAP_SSE2 1
+#else
+#define BITMAP_SSE2 0
+#endif
+
 // asm shortcuts
 #define O offset
 #define Q qword ptr
@@ -34,6 +55,24 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define B  byte ptr
 
 extern INDEX tex_bProgressiveFilter; // filter mipmaps in creation time (not afterwards)
+extern INDEX tex_bMultiThreadedBitmaps;
+static BOOL _bScalarBitmaps = FALSE;  // for benchmarking only
+
+// bitmap passes over less texels than this are not worth splitting between threads
+#define BITMAP_MIN_PARALLEL_TEXELS (256*256)
+
+// process rows of a bitmap pass, split between worker threads if large enough
+static void RunBitmapRows( CWorkerJob &wj, PIX pixRows, PIX pixTexelsPerRow)
+{
+  const INDEX ctThreads = _pWorkerPool->GetThreadsCount();
+  if( tex_bMultiThreadedBitmaps && !_bScalarBitmaps && ctThreads>1
+   && pixRows*pixTexelsPerRow >= BITMAP_MIN_PARALLEL_TEXELS) {
+    // few rows per chunk, so faster threads can take more
+    _pWorkerPool->Run( wj, pixRows, Max( pixRows/(ctThreads*4), (PIX)1));
+  } else {
+    wj.ProcessRange( 0, pixRows);
+  }
+}
 
 
 // returns number of mip-maps to skip from original texture
@@ -197,6 +236,75 @@ __int64 mmRounder = 0x0002000200020002ll;
 __int64 mmRounder = 0x0002000200020002;
 #endif
 
+#if !(defined __MSVC_INLINE__) && !(defined __GNU_INLINE_X86_32__)
+// bilinear downsample of rows of lower mip-map (dst width is half of src width)
+static void DownsampleRows( const UBYTE *pubSrc, UBYTE *pubDst, PIX pixWidth, PIX pixFirstRow, PIX pixLastRow)
+{
+  for( PIX pixRow=pixFirstRow; pixRow<pixLastRow; pixRow++) {
+    const UBYTE *pubUp   = pubSrc + pixRow*pixWidth*4*BYTES_PER_TEXEL;
+    const UBYTE *pubDown = pubUp  + pixWidth*2*BYTES_PER_TEXEL;
+    UBYTE *pubRow = pubDst + pixRow*pixWidth*BYTES_PER_TEXEL;
+    PIX pix = 0;
+    if( !_bScalarBitmaps) {
+#if BITMAP_NEON
+      // 4 texels at once (even and odd source texels are separated by load)
+      for( ; pix+4<=pixWidth; pix+=4) {
+        const uint32x4x2_t ulUp   = vld2q_u32( (const uint32_t*)(pubUp  +pix*8));
+        const uint32x4x2_t ulDown = vld2q_u32( (const uint32_t*)(pubDown+pix*8));
+        const uint8x16_t ubUL = vreinterpretq_u8_u32( ulUp.val[0]);
+        const uint8x16_t ubUR = vreinterpretq_u8_u32( ulUp.val[1]);
+        const uint8x16_t ubDL = vreinterpretq_u8_u32( ulDown.val[0]);
+        const uint8x16_t ubDR = vreinterpretq_u8_u32( ulDown.val[1]);
+        const uint16x8_t uwLo = vaddq_u16( vaddl_u8( vget_low_u8(ubUL),  vget_low_u8(ubUR)),
+                                           vaddl_u8( vget_low_u8(ubDL),  vget_low_u8(ubDR)));
+        const uint16x8_t uwHi = vaddq_u16( vaddl_u8( vget_high_u8(ubUL), vget_high_u8(ubUR)),
+                                           vaddl_u8( vget_high_u8(ubDL), vget_high_u8(ubDR)));
+        // rounding shift is the same as adding 2 before shift
+        vst1q_u8( pubRow+pix*4, vcombine_u8( vrshrn_n_u16(uwLo,2), vrshrn_n_u16(uwHi,2)));
+      }
+#elif BITMAP_SSE2
+      const __m128i mZero    = _mm_setzero_si128();
+      const __m128i mRounder = _mm_set1_epi16(2);
+      for( ; pix+4<=pixWidth; pix+=4) {
+        // separate even and odd source texels
+        const __m128i mUp0   = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i*)(pubUp  +pix*8)),    _MM_SHUFFLE(3,1,2,0));
+        const __m128i mUp1   = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i*)(pubUp  +pix*8+16)), _MM_SHUFFLE(3,1,2,0));
+        const __m128i mDown0 = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i*)(pubDown+pix*8)),    _MM_SHUFFLE(3,1,2,0));
+        const __m128i mDown1 = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i*)(pubDown+pix*8+16)), _MM_SHUFFLE(3,1,2,0));
+        const __m128i mUL = _mm_unpacklo_epi64( mUp0, mUp1);
+        const __m128i mUR = _mm_unpackhi_epi64( mUp0, mUp1);
+        const __m128i mDL = _mm_unpacklo_epi64( mDown0, mDown1);
+        const __m128i mDR = _mm_unpackhi_epi64( mDown0, mDown1);
+        __m128i mLo = _mm_add_epi16( _mm_add_epi16( _mm_unpacklo_epi8(mUL,mZero), _mm_unpacklo_epi8(mUR,mZero)),
+                                     _mm_add_epi16( _mm_unpacklo_epi8(mDL,mZero), _mm_unpacklo_epi8(mDR,mZero)));
+        __m128i mHi = _mm_add_epi16( _mm_add_epi16( _mm_unpackhi_epi8(mUL,mZero), _mm_unpackhi_epi8(mUR,mZero)),
+                                     _mm_add_epi16( _mm_unpackhi_epi8(mDL,mZero), _mm_unpackhi_epi8(mDR,mZero)));
+        mLo = _mm_srli_epi16( _mm_add_epi16( mLo, mRounder), 2);
+        mHi = _mm_srli_epi16( _mm_add_epi16( mHi, mRounder), 2);
+        _mm_storeu_si128( (__m128i*)(pubRow+pix*4), _mm_packus_epi16( mLo, mHi));
+      }
+#endif
+    }
+    // remaining texels
+    for( ; pix<pixWidth; pix++) {
+      for( INDEX i=0; i<4; i++) {
+        pubRow[pix*4+i] = (pubUp[pix*8+i] + pubUp[pix*8+4+i] + pubDown[pix*8+i] + pubDown[pix*8+4+i] + 2) /4;
+      }
+    }
+  }
+}
+
+class CDownsampleJob : public CWorkerJob {
+public:
+  const UBYTE *dj_pubSrc;
+  UBYTE *dj_pubDst;
+  PIX dj_pixWidth;
+  void ProcessRange( INDEX iFirst, INDEX iLast) {
+    DownsampleRows( dj_pubSrc, dj_pubDst, dj_pixWidth, iFirst, iLast);
+  }
+};
+#endif
+
 static void MakeOneMipmap( ULONG *pulSrcMipmap, ULONG *pulDstMipmap, PIX pixWidth, PIX pixHeight, BOOL bBilinear)
 {
   // some safety checks
@@ -295,55 +403,11 @@ pixLoopN:
     );
 
    #else
-	UBYTE *src = (UBYTE *) pulSrcMipmap;
-	UBYTE *dest = (UBYTE *) pulDstMipmap;
-	for (int i = 0 ; i < pixHeight; i++)
-	{
-		for (int j = 0; j < pixWidth; j++)
-		{
-			// Grab pixels from image
-			UWORD upleft[4];
-			UWORD upright[4];
-			UWORD downleft[4];
-			UWORD downright[4];
-			upleft[0] = *(src + 0);
-			upleft[1] = *(src + 1);
-			upleft[2] = *(src + 2);
-			upleft[3] = *(src + 3);
-			upright[0] = *(src + 4);
-			upright[1] = *(src + 5);
-			upright[2] = *(src + 6);
-			upright[3] = *(src + 7);
-
-			downleft[0] = *(src + pixWidth*8 + 0);
-			downleft[1] = *(src + pixWidth*8 + 1);
-			downleft[2] = *(src + pixWidth*8 + 2);
-			downleft[3] = *(src + pixWidth*8 + 3);
-			downright[0] = *(src + pixWidth*8 + 4);
-			downright[1] = *(src + pixWidth*8 + 5);
-			downright[2] = *(src + pixWidth*8 + 6);
-			downright[3] = *(src + pixWidth*8 + 7);
-
-			UWORD answer[4];
-			answer[0] = upleft[0] + upright[0] + downleft[0] + downright[0] + 2;
-			answer[1] = upleft[1] + upright[1] + downleft[1] + downright[1] + 2;
-			answer[2] = upleft[2] + upright[2] + downleft[2] + downright[2] + 2;
-			answer[3] = upleft[3] + upright[3] + downleft[3] + downright[3] + 2;
-			answer[0] /= 4;
-			answer[1] /= 4;
-			answer[2] /= 4;
-			answer[3] /= 4;
-
-			*(dest + 0) = answer[0];
-			*(dest + 1) = answer[1];
-			*(dest + 2) = answer[2];
-			*(dest + 3) = answer[3];
-
-			src += 8;
-			dest += 4;
-		}
-		src += 8*pixWidth;
-    }
+    CDownsampleJob dj;
+    dj.dj_pubSrc = (const UBYTE*)pulSrcMipmap;
+    dj.dj_pubDst = (UBYTE*)pulDstMipmap;
+    dj.dj_pixWidth = pixWidth;
+    RunBitmapRows( dj, pixHeight, pixWidth);
 
    #endif
     }
@@ -653,6 +717,63 @@ static inline void IncrementByteWithClip( UBYTE &ub, SLONG slAdd)
 }
 #endif
 
+#if !(defined __MSVC_INLINE__) && !(defined __GNU_INLINE_X86_32__)
+union uConv
+{
+  __int64 val;
+  DWORD dwords[2];
+  UWORD words[4];
+  WORD  iwords[4];
+  UBYTE bytes[8];
+};
+
+// ordered dithering of rows (pairs of texels are dithered, in rows of bitmap width)
+class CDitherOrderJob : public CWorkerJob {
+public:
+  const ULONG *doj_pulSrc;
+  ULONG *doj_pulDst;
+  PIX doj_pixWidth;
+  void ProcessRange( INDEX iFirst, INDEX iLast);
+};
+
+void CDitherOrderJob::ProcessRange( INDEX iFirst, INDEX iLast)
+{
+  const PIX pixPairs = (doj_pixWidth+1)/2;
+  for( INDEX i=iFirst; i<iLast; i++) {
+    int idx = i&3;
+    uConv dith;
+    dith.dwords[0] = pulDitherTable[idx];
+    dith.dwords[1] = pulDitherTable[idx+1];
+    for (int j=0; j<4; j++) { dith.words[j] >>= mmShifter; }
+    dith.val &= mmMask;
+    const uConv* src = (const uConv*)(doj_pulSrc+i*doj_pixWidth);
+    uConv* dst = (uConv*)(doj_pulDst+i*doj_pixWidth);
+    PIX pix = 0;
+    if( !_bScalarBitmaps) {
+      // adding with clip is a saturated add
+#if BITMAP_NEON
+      const uint8x16_t ubDith = vcombine_u8( vld1_u8(dith.bytes), vld1_u8(dith.bytes));
+      for( ; pix+2<=pixPairs; pix+=2) {
+        vst1q_u8( dst[pix].bytes, vqaddq_u8( vld1q_u8(src[pix].bytes), ubDith));
+      }
+#elif BITMAP_SSE2
+      const __m128i mDith = _mm_set1_epi64( *(const __m64*)dith.bytes);
+      for( ; pix+2<=pixPairs; pix+=2) {
+        _mm_storeu_si128( (__m128i*)(dst+pix), _mm_adds_epu8( _mm_loadu_si128( (const __m128i*)(src+pix)), mDith));
+      }
+#endif
+    }
+    for( ; pix<pixPairs; pix++) {
+      uConv p=src[pix];
+      for (int k=0; k<8; k++) {
+        IncrementByteWithClip(p.bytes[k], dith.bytes[k]);
+      }
+      dst[pix] = p;
+    }
+  }
+}
+#endif
+
 // performs dithering of a 32-bit bipmap (can be in-place)
 void DitherBitmap( INDEX iDitherType, ULONG *pulSrc, ULONG *pulDst, PIX pixWidth, PIX pixHeight,
                    PIX pixCanvasWidth, PIX pixCanvasHeight)
@@ -880,32 +1001,14 @@ nextRowO:
   );
 
 #else
-  union uConv
   {
-    __int64 val;
-    DWORD dwords[2];
-    UWORD words[4];
-    WORD  iwords[4];
-    UBYTE bytes[8];
-  };
-  for (int i=0; i<pixHeight; i++) {
-    int idx = i&3;
-    uConv dith;
-    dith.dwords[0] = pulDitherTable[idx];
-    dith.dwords[1] = pulDitherTable[idx+1];
-    for (int j=0; j<4; j++) { dith.words[j] >>= mmShifter; }
-    dith.val &= mmMask;
-    uConv* src = (uConv*)(pulSrc+i*pixWidth);
-    uConv* dst = (uConv*)(pulDst+i*pixWidth);
-    for (int j=0; j<pixWidth; j+=2) {
-      uConv p=src[0];
-      for (int k=0; k<8; k++) {
-        IncrementByteWithClip(p.bytes[k], dith.bytes[k]);
-      }
-      dst[0] = p;
-      src++;
-      dst++;
-    }
+    CDitherOrderJob doj;
+    doj.doj_pulSrc = pulSrc;
+    doj.doj_pulDst = pulDst;
+    doj.doj_pixWidth = pixWidth;
+    // with odd width, row pairs overlap so rows must be done in order
+    if( pixWidth&1) doj.ProcessRange( 0, pixHeight);
+    else RunBitmapRows( doj, pixHeight, pixWidth);
   }
 
 #endif
@@ -1259,72 +1362,141 @@ extern "C" {
 
 
 #if !(defined USE_MMX_INTRINSICS) && !(defined __MSVC_INLINE__) && !(defined __GNU_INLINE_X86_32__)
-typedef SWORD ExtPix[4];
-
-static inline void extpix_fromi64(ExtPix &pix, const __int64 i64)
-{
-    //memcpy(pix, i64, sizeof (ExtPix));
-    pix[0] = ((i64 >>  0) & 0xFFFF);
-    pix[1] = ((i64 >> 16) & 0xFFFF);
-    pix[2] = ((i64 >> 32) & 0xFFFF);
-    pix[3] = ((i64 >> 48) & 0xFFFF);
-}
+// FilterBitmap() INTERNAL: filter weights in 16-bit (as in MMX code)
+// (every border case is the same as middle case with texels clamped to bitmap edges)
+struct FilterWeights {
+  SWORD fw_swCorner, fw_swEdge, fw_swMiddle, fw_swInvDiv;
+};
 
-static inline void extend_pixel(const ULONG ul, ExtPix &pix)
+// filter one texel (with 16-bit wrap-around and saturation, same as MMX code)
+static inline ULONG FilterTexel( const FilterWeights &fw, ULONG ulUL, ULONG ulU, ULONG ulUR,
+                                 ULONG ulL, ULONG ulM, ULONG ulR, ULONG ulDL, ULONG ulD, ULONG ulDR)
 {
-    pix[0] = ((ul >>  0) & 0xFF);
-    pix[1] = ((ul >>  8) & 0xFF);
-    pix[2] = ((ul >> 16) & 0xFF);
-    pix[3] = ((ul >> 24) & 0xFF);
+  ULONG ulResult = 0;
+  for( INDEX iShift=0; iShift<32; iShift+=8) {
+    #define CHANNEL(ul) ((SLONG)(((ul)>>iShift)&0xFF))
+    const SWORD swSum = (SWORD)( (CHANNEL(ulUL)+CHANNEL(ulUR)+CHANNEL(ulDL)+CHANNEL(ulDR)) *fw.fw_swCorner
+                               + (CHANNEL(ulU) +CHANNEL(ulL) +CHANNEL(ulR) +CHANNEL(ulD))  *fw.fw_swEdge
+                               +  CHANNEL(ulM) *fw.fw_swMiddle);
+    #undef CHANNEL
+    const SLONG slRounded = Clamp( (SLONG)swSum+7, (SLONG)-32768, (SLONG)32767);
+    const SLONG slResult  = (SWORD)((slRounded*fw.fw_swInvDiv)>>16);
+    ulResult |= (ULONG)Clamp( slResult, (SLONG)0, (SLONG)255) <<iShift;
+  }
+  return ulResult;
 }
 
-static inline ULONG unextend_pixel(const ExtPix &pix)
+#if BITMAP_NEON
+// filter 2 texels
+static inline uint8x8_t FilterTexelsNEON( const FilterWeights &fw, uint8x8_t ubUL, uint8x8_t ubU, uint8x8_t ubUR,
+                                          uint8x8_t ubL, uint8x8_t ubM, uint8x8_t ubR, uint8x8_t ubDL, uint8x8_t ubD, uint8x8_t ubDR)
 {
-    return
-    (
-        (((ULONG) ((pix[0] >= 255) ? 255 : ((pix[0] <= 0) ? 0 : pix[0]))) <<  0) |
-        (((ULONG) ((pix[1] >= 255) ? 255 : ((pix[1] <= 0) ? 0 : pix[1]))) <<  8) |
-        (((ULONG) ((pix[2] >= 255) ? 255 : ((pix[2] <= 0) ? 0 : pix[2]))) << 16) |
-        (((ULONG) ((pix[3] >= 255) ? 255 : ((pix[3] <= 0) ? 0 : pix[3]))) << 24)
-    );
+  const int16x8_t swCorners = vreinterpretq_s16_u16( vaddq_u16( vaddl_u8(ubUL,ubUR), vaddl_u8(ubDL,ubDR)));
+  const int16x8_t swEdges   = vreinterpretq_s16_u16( vaddq_u16( vaddl_u8(ubU, ubL),  vaddl_u8(ubR, ubD)));
+  const int16x8_t swMiddle  = vreinterpretq_s16_u16( vmovl_u8(ubM));
+  int16x8_t swSum = vmulq_s16( swMiddle, vdupq_n_s16(fw.fw_swMiddle));
+  swSum = vmlaq_s16( swSum, swCorners, vdupq_n_s16(fw.fw_swCorner));
+  swSum = vmlaq_s16( swSum, swEdges,   vdupq_n_s16(fw.fw_swEdge));
+  swSum = vqaddq_s16( swSum, vdupq_n_s16(7));
+  const int16x4_t swInvDiv = vdup_n_s16(fw.fw_swInvDiv);
+  const int16x8_t swResult = vcombine_s16( vshrn_n_s32( vmull_s16( vget_low_s16(swSum),  swInvDiv), 16),
+                                           vshrn_n_s32( vmull_s16( vget_high_s16(swSum), swInvDiv), 16));
+  return vqmovun_s16(swResult);
 }
-
-static inline void extpix_add(ExtPix &p1, const ExtPix &p2)
+#elif BITMAP_SSE2
+// filter 2 texels (unpacked to words)
+static inline __m128i FilterTexelsSSE2( const FilterWeights &fw, __m128i mUL, __m128i mU, __m128i mUR,
+                                        __m128i mL, __m128i mM, __m128i mR, __m128i mDL, __m128i mD, __m128i mDR)
 {
-    p1[0] = (SWORD) (((SLONG) p1[0]) + ((SLONG) p2[0]));
-    p1[1] = (SWORD) (((SLONG) p1[1]) + ((SLONG) p2[1]));
-    p1[2] = (SWORD) (((SLONG) p1[2]) + ((SLONG) p2[2]));
-    p1[3] = (SWORD) (((SLONG) p1[3]) + ((SLONG) p2[3]));
+  const __m128i mCorners = _mm_add_epi16( _mm_add_epi16(mUL,mUR), _mm_add_epi16(mDL,mDR));
+  const __m128i mEdges   = _mm_add_epi16( _mm_add_epi16(mU, mL),  _mm_add_epi16(mR, mD));
+  __m128i mSum = _mm_mullo_epi16( mM, _mm_set1_epi16(fw.fw_swMiddle));
+  mSum = _mm_add_epi16( mSum, _mm_mullo_epi16( mCorners, _mm_set1_epi16(fw.fw_swCorner)));
+  mSum = _mm_add_epi16( mSum, _mm_mullo_epi16( mEdges,   _mm_set1_epi16(fw.fw_swEdge)));
+  mSum = _mm_adds_epi16( mSum, _mm_set1_epi16(7));
+  return _mm_mulhi_epi16( mSum, _mm_set1_epi16(fw.fw_swInvDiv));
 }
+#endif
 
-static inline void extpix_mul(ExtPix &p1, const ExtPix &p2)
+// filter one row; texels to the left are read thru 'L' rows, that can be already filtered when filtering
+// in-place (texels of first column are clamped to edge, so these are never read thru 'L' rows)
+static void FilterRow( const FilterWeights &fw, const ULONG *pulUpL, const ULONG *pulUp, const ULONG *pulMidL, const ULONG *pulMid,
+                       const ULONG *pulDownL, const ULONG *pulDown, ULONG *pulDst, PIX pixWidth)
 {
-    p1[0] = (SWORD) (((SLONG) p1[0]) * ((SLONG) p2[0]));
-    p1[1] = (SWORD) (((SLONG) p1[1]) * ((SLONG) p2[1]));
-    p1[2] = (SWORD) (((SLONG) p1[2]) * ((SLONG) p2[2]));
-    p1[3] = (SWORD) (((SLONG) p1[3]) * ((SLONG) p2[3]));
+  // left edge
+  pulDst[0] = FilterTexel( fw, pulUp[0],   pulUp[0],   pulUp[1],
+                               pulMid[0],  pulMid[0],  pulMid[1],
+                               pulDown[0], pulDown[0], pulDown[1]);
+  PIX pix = 1;
+  const PIX pixLast = pixWidth-1;
+  // only if result doesn't depend on texels just filtered
+  if( !_bScalarBitmaps && pulMidL!=pulDst && pulDownL!=pulDst) {
+#if BITMAP_NEON
+    for( ; pix+4<=pixLast; pix+=4) {
+      #define LOADROW(pul,i) vld1q_u8( (const uint8_t*)((pul)+(i)))
+      const uint8x16_t ubUL = LOADROW(pulUpL,  pix-1), ubU = LOADROW(pulUp,  pix), ubUR = LOADROW(pulUp,  pix+1);
+      const uint8x16_t ubL  = LOADROW(pulMidL, pix-1), ubM = LOADROW(pulMid, pix), ubR  = LOADROW(pulMid, pix+1);
+      const uint8x16_t ubDL = LOADROW(pulDownL,pix-1), ubD = LOADROW(pulDown,pix), ubDR = LOADROW(pulDown,pix+1);
+      #undef LOADROW
+      const uint8x8_t ubLo = FilterTexelsNEON( fw, vget_low_u8(ubUL), vget_low_u8(ubU), vget_low_u8(ubUR),
+                                                   vget_low_u8(ubL),  vget_low_u8(ubM), vget_low_u8(ubR),
+                                                   vget_low_u8(ubDL), vget_low_u8(ubD), vget_low_u8(ubDR));
+      const uint8x8_t ubHi = FilterTexelsNEON( fw, vget_high_u8(ubUL), vget_high_u8(ubU), vget_high_u8(ubUR),
+                                                   vget_high_u8(ubL),  vget_high_u8(ubM), vget_high_u8(ubR),
+                                                   vget_high_u8(ubDL), vget_high_u8(ubD), vget_high_u8(ubDR));
+      vst1q_u8( (uint8_t*)(pulDst+pix), vcombine_u8( ubLo, ubHi));
+    }
+#elif BITMAP_SSE2
+    const __m128i mZero = _mm_setzero_si128();
+    for( ; pix+4<=pixLast; pix+=4) {
+      #define LOADROW(pul,i) _mm_loadu_si128( (const __m128i*)((pul)+(i)))
+      const __m128i mUL = LOADROW(pulUpL,  pix-1), mU = LOADROW(pulUp,  pix), mUR = LOADROW(pulUp,  pix+1);
+      const __m128i mL  = LOADROW(pulMidL, pix-1), mM = LOADROW(pulMid, pix), mR  = LOADROW(pulMid, pix+1);
+      const __m128i mDL = LOADROW(pulDownL,pix-1), mD = LOADROW(pulDown,pix), mDR = LOADROW(pulDown,pix+1);
+      #undef LOADROW
+      #define UNPACK(m,half) _mm_unpack##half##_epi8(m,mZero)
+      const __m128i mLo = FilterTexelsSSE2( fw, UNPACK(mUL,lo), UNPACK(mU,lo), UNPACK(mUR,lo),
+                                                UNPACK(mL,lo),  UNPACK(mM,lo), UNPACK(mR,lo),
+                                                UNPACK(mDL,lo), UNPACK(mD,lo), UNPACK(mDR,lo));
+      const __m128i mHi = FilterTexelsSSE2( fw, UNPACK(mUL,hi), UNPACK(mU,hi), UNPACK(mUR,hi),
+                                                UNPACK(mL,hi),  UNPACK(mM,hi), UNPACK(mR,hi),
+                                                UNPACK(mDL,hi), UNPACK(mD,hi), UNPACK(mDR,hi));
+      #undef UNPACK
+      _mm_storeu_si128( (__m128i*)(pulDst+pix), _mm_packus_epi16( mLo, mHi));
+    }
+#endif
+  }
+  // middle texels
+  for( ; pix<pixLast; pix++) {
+    pulDst[pix] = FilterTexel( fw, pulUpL[pix-1],   pulUp[pix],   pulUp[pix+1],
+                                   pulMidL[pix-1],  pulMid[pix],  pulMid[pix+1],
+                                   pulDownL[pix-1], pulDown[pix], pulDown[pix+1]);
+  }
+  // right edge
+  pulDst[pixLast] = FilterTexel( fw, pulUpL[pixLast-1],   pulUp[pixLast],   pulUp[pixLast],
+                                     pulMidL[pixLast-1],  pulMid[pixLast],  pulMid[pixLast],
+                                     pulDownL[pixLast-1], pulDown[pixLast], pulDown[pixLast]);
 }
 
-static inline void extpix_adds(ExtPix &p1, const ExtPix &p2)
-{
-    SLONG x0 = (((SLONG) ((SWORD) p1[0])) + ((SLONG) ((SWORD) p2[0])));
-    SLONG x1 = (((SLONG) ((SWORD) p1[1])) + ((SLONG) ((SWORD) p2[1])));
-    SLONG x2 = (((SLONG) ((SWORD) p1[2])) + ((SLONG) ((SWORD) p2[2])));
-    SLONG x3 = (((SLONG) ((SWORD) p1[3])) + ((SLONG) ((SWORD) p2[3])));
-
-    p1[0] = (SWORD) ((x0 <= -32768) ? -32768 : ((x0 >= 32767) ? 32767 : x0));
-    p1[1] = (SWORD) ((x1 <= -32768) ? -32768 : ((x1 >= 32767) ? 32767 : x1));
-    p1[2] = (SWORD) ((x2 <= -32768) ? -32768 : ((x2 >= 32767) ? 32767 : x2));
-    p1[3] = (SWORD) ((x3 <= -32768) ? -32768 : ((x3 >= 32767) ? 32767 : x3));
-}
+// filtering of rows when source and destination are different (rows don't depend on each other)
+class CFilterBitmapJob : public CWorkerJob {
+public:
+  FilterWeights fbj_fw;
+  const ULONG *fbj_pulSrc;
+  ULONG *fbj_pulDst;
+  PIX fbj_pixWidth, fbj_pixHeight, fbj_pixCanvasWidth;
+  void ProcessRange( INDEX iFirst, INDEX iLast) {
+    for( INDEX iRow=iFirst; iRow<iLast; iRow++) {
+      const ULONG *pulUp   = fbj_pulSrc + Max( iRow-1, (INDEX)0) *fbj_pixCanvasWidth;
+      const ULONG *pulMid  = fbj_pulSrc + iRow *fbj_pixCanvasWidth;
+      const ULONG *pulDown = fbj_pulSrc + Min( iRow+1, (INDEX)fbj_pixHeight-1) *fbj_pixCanvasWidth;
+      FilterRow( fbj_fw, pulUp, pulUp, pulMid, pulMid, pulDown, pulDown, fbj_pulDst + iRow*fbj_pixCanvasWidth, fbj_pixWidth);
+    }
+  }
+};
 
-static inline void extpix_mulhi(ExtPix &p1, const ExtPix &p2)
-{
-    p1[0] = (SWORD) (((((SLONG) p1[0]) * ((SLONG) p2[0])) >> 16) & 0xFFFF);
-    p1[1] = (SWORD) (((((SLONG) p1[1]) * ((SLONG) p2[1])) >> 16) & 0xFFFF);
-    p1[2] = (SWORD) (((((SLONG) p1[2]) * ((SLONG) p2[2])) >> 16) & 0xFFFF);
-    p1[3] = (SWORD) (((((SLONG) p1[3]) * ((SLONG) p2[3])) >> 16) & 0xFFFF);
-}
+// copies of original rows for in-place filtering
+static CStaticStackArray<ULONG> _aulFilterRows;
 #endif
 
 
@@ -2271,264 +2443,45 @@ lowerLoop:
   );
 
 #else
-    slModulo1 /= BYTES_PER_TEXEL;  // C++ handles incrementing by sizeof type
-    slCanvasWidth /= BYTES_PER_TEXEL;  // C++ handles incrementing by sizeof type
-
-    ULONG *src = pulSrc;
-    ULONG *dst = pulDst;
-    ULONG *rowptr = aulRows;
-
-    ExtPix rmm1={0}, rmm2={0}, rmm3={0}, rmm4={0}, rmm5={0}, rmm6={0}, rmm7={0};
-    #define EXTPIXFROMINT64(x) ExtPix r##x; extpix_fromi64(r##x, x);
-    EXTPIXFROMINT64(mmCm);
-    EXTPIXFROMINT64(mmCe);
-    EXTPIXFROMINT64(mmCc);
-    EXTPIXFROMINT64(mmEch);
-    EXTPIXFROMINT64(mmEcl);
-    EXTPIXFROMINT64(mmEe);
-    EXTPIXFROMINT64(mmEm);
-    EXTPIXFROMINT64(mmMm);
-    EXTPIXFROMINT64(mmMe);
-    EXTPIXFROMINT64(mmMc);
-    EXTPIXFROMINT64(mmAdd);
-    EXTPIXFROMINT64(mmInvDiv);
-    #undef EXTPIXFROMINT64
-
-    // ----------------------- process upper left corner
-    extend_pixel(src[0], rmm1);
-    extend_pixel(src[1], rmm2);
-    extend_pixel(src[pixCanvasWidth], rmm3);
-    extend_pixel(src[pixCanvasWidth+1], rmm4);
-
-    extpix_add(rmm2, rmm3);
-    extpix_mul(rmm1, rmmCm);
-    extpix_mul(rmm2, rmmCe);
-    extpix_mul(rmm4, rmmCc);
-    extpix_add(rmm1, rmm2);
-    extpix_add(rmm1, rmm4);
-    extpix_adds(rmm1, rmmAdd);
-    extpix_mulhi(rmm1, rmmInvDiv);
-    *(rowptr++) = unextend_pixel(rmm1);
-    
-    src++;
-
-    // ----------------------- process upper edge pixels
-    for (PIX i = pixWidth - 2; i != 0; i--)
-    {
-        extend_pixel(src[-1], rmm1);
-        extend_pixel(src[0], rmm2);
-        extend_pixel(src[1], rmm3);
-        extend_pixel(src[pixCanvasWidth-1], rmm4);
-        extend_pixel(src[pixCanvasWidth], rmm5);
-        extend_pixel(src[pixCanvasWidth+1], rmm6);
-
-        extpix_add(rmm1, rmm3);
-        extpix_add(rmm4, rmm6);
-        extpix_mul(rmm1, rmmEch);
-        extpix_mul(rmm2, rmmEm);
-        extpix_mul(rmm4, rmmEcl);
-        extpix_mul(rmm5, rmmEe);
-        extpix_add(rmm1, rmm2);
-        extpix_add(rmm1, rmm4);
-        extpix_add(rmm1, rmm5);
-        extpix_adds(rmm1, rmmAdd);
-        extpix_mulhi(rmm1, rmmInvDiv);
-        *(rowptr++) = unextend_pixel(rmm1);
-        src++;
-    }
-
-    // ----------------------- process upper right corner
-
-    extend_pixel(src[-1], rmm1);
-    extend_pixel(src[0], rmm2);
-    extend_pixel(src[pixCanvasWidth-1], rmm3);
-    extend_pixel(src[pixCanvasWidth], rmm4);
-
-    extpix_add(rmm1, rmm4);
-    extpix_mul(rmm1, rmmCe);
-    extpix_mul(rmm2, rmmCm);
-    extpix_mul(rmm3, rmmCc);
-    extpix_add(rmm1, rmm2);
-    extpix_add(rmm1, rmm3);
-    extpix_adds(rmm1, rmmAdd);
-    extpix_mulhi(rmm1, rmmInvDiv);
-    *rowptr = unextend_pixel(rmm1);
-
-// ----------------------- process bitmap middle pixels
-
-    dst += slCanvasWidth;
-    src += slModulo1;
-
-    // for each row
-    for (size_t i = pixHeight-2; i != 0; i--)  // rowLoop
-    {
-        rowptr = aulRows;
-
-        // process left edge pixel
-        extend_pixel(src[-pixCanvasWidth], rmm1);
-        extend_pixel(src[(-pixCanvasWidth)+1], rmm2);
-        extend_pixel(src[0], rmm3);
-        extend_pixel(src[1], rmm4);
-        extend_pixel(src[pixCanvasWidth], rmm5);
-        extend_pixel(src[pixCanvasWidth+1], rmm6);
-
-        extpix_add(rmm1, rmm5);
-        extpix_add(rmm2, rmm6);
-        extpix_mul(rmm1, rmmEch);
-        extpix_mul(rmm2, rmmEcl);
-        extpix_mul(rmm3, rmmEm);
-        extpix_mul(rmm4, rmmEe);
-        extpix_add(rmm1, rmm2);
-        extpix_add(rmm1, rmm3);
-        extpix_add(rmm1, rmm4);
-        extpix_adds(rmm1, rmmAdd);
-        extpix_mulhi(rmm1, rmmInvDiv);
-        dst[-pixCanvasWidth] = *rowptr;
-        *(rowptr++) = unextend_pixel(rmm1);
-        src++;
-        dst++;
-
-        // for each pixel in current row
-        for (size_t j = pixWidth-2; j != 0; j--)  // pixLoop
-        {
-            // prepare upper convolution row
-            extend_pixel(src[(-pixCanvasWidth)-1], rmm1);
-            extend_pixel(src[-pixCanvasWidth], rmm2);
-            extend_pixel(src[(-pixCanvasWidth)+1], rmm3);
-
-            // prepare middle convolution row
-            extend_pixel(src[-1], rmm4);
-            extend_pixel(src[0], rmm5);
-            extend_pixel(src[1], rmm6);
-
-            // free some registers
-            extpix_add(rmm1, rmm3);
-            extpix_add(rmm2, rmm4);
-            extpix_mul(rmm5, rmmMm);
-
-            // prepare lower convolution row
-            extend_pixel(src[pixCanvasWidth-1], rmm3);
-            extend_pixel(src[pixCanvasWidth], rmm4);
-            extend_pixel(src[pixCanvasWidth+1], rmm7);
-
-            // calc weightened value
-            extpix_add(rmm2, rmm6);
-            extpix_add(rmm1, rmm3);
-            extpix_add(rmm2, rmm4);
-            extpix_add(rmm1, rmm7);
-            extpix_mul(rmm2, rmmMe);
-            extpix_mul(rmm1, rmmMc);
-            extpix_add(rmm2, rmm5);
-            extpix_add(rmm1, rmm2);
-
-            // calc and store wightened value
-            extpix_adds(rmm1, rmmAdd);
-            extpix_mulhi(rmm1, rmmInvDiv);
-            dst[-pixCanvasWidth] = *rowptr;
-            *(rowptr++) = unextend_pixel(rmm1);
-
-            // advance to next pixel
-            src++;
-            dst++;
+  {
+    FilterWeights fw;
+    fw.fw_swCorner = (SWORD)(mmMc &0xFFFF);
+    fw.fw_swEdge   = (SWORD)(mmMe &0xFFFF);
+    fw.fw_swMiddle = (SWORD)(mmMm &0xFFFF);
+    fw.fw_swInvDiv = (SWORD)(mmInvDiv &0xFFFF);
+
+    if( pulSrc!=pulDst) {
+      CFilterBitmapJob fbj;
+      fbj.fbj_fw = fw;
+      fbj.fbj_pulSrc = pulSrc;
+      fbj.fbj_pulDst = pulDst;
+      fbj.fbj_pixWidth  = pixWidth;
+      fbj.fbj_pixHeight = pixHeight;
+      fbj.fbj_pixCanvasWidth = pixCanvasWidth;
+      RunBitmapRows( fbj, pixHeight, pixWidth);
+    } else {
+      // in-place: texels above and to the left are read already filtered (as MMX code does),
+      // so rows must be done in order and only original rows above and at current one are kept
+      _aulFilterRows.PopAll();
+      ULONG *pulOrigAbove = _aulFilterRows.Push( pixWidth*2);
+      ULONG *pulOrigRow   = pulOrigAbove + pixWidth;
+      for( PIX pixRow=0; pixRow<pixHeight; pixRow++) {
+        ULONG *pulRow = pulDst + pixRow*pixCanvasWidth;
+        memcpy( pulOrigRow, pulRow, pixWidth*BYTES_PER_TEXEL);
+        if( pixRow==0) {
+          const ULONG *pulDown = pulRow + pixCanvasWidth;
+          FilterRow( fw, pulOrigRow, pulOrigRow, pulOrigRow, pulOrigRow, pulDown, pulDown, pulRow, pixWidth);
+        } else if( pixRow<pixHeight-1) {
+          const ULONG *pulDown = pulRow + pixCanvasWidth;
+          FilterRow( fw, pulRow-pixCanvasWidth, pulOrigAbove, pulOrigRow, pulOrigRow, pulDown, pulDown, pulRow, pixWidth);
+        } else {
+          // bottom row is written directly, so texels to the left are read already filtered, too
+          FilterRow( fw, pulRow-pixCanvasWidth, pulOrigAbove, pulRow, pulOrigRow, pulRow, pulOrigRow, pulRow, pixWidth);
         }
-
-        // process right edge pixel
-        extend_pixel(src[(-pixCanvasWidth)-1], rmm1);
-        extend_pixel(src[-pixCanvasWidth], rmm2);
-        extend_pixel(src[-1], rmm3);
-        extend_pixel(src[0], rmm4);
-        extend_pixel(src[pixCanvasWidth-1], rmm5);
-        extend_pixel(src[pixCanvasWidth], rmm6);
-
-        extpix_add(rmm1, rmm5);
-        extpix_add(rmm2, rmm6);
-        extpix_mul(rmm1, rmmEcl);
-        extpix_mul(rmm2, rmmEch);
-        extpix_mul(rmm3, rmmEe);
-        extpix_mul(rmm4, rmmEm);
-        extpix_add(rmm1, rmm2);
-        extpix_add(rmm1, rmm3);
-        extpix_add(rmm1, rmm4);
-        extpix_adds(rmm1, rmmAdd);
-        extpix_mulhi(rmm1, rmmInvDiv);
-        dst[-pixCanvasWidth] = *rowptr;
-        *rowptr = unextend_pixel(rmm1);
-
-        // advance to next row
-        src += slModulo1;
-        dst += slModulo1;
-    }
-
-    // ----------------------- process lower left corner
-    rowptr = aulRows;
-    extend_pixel(src[-pixCanvasWidth], rmm1);
-    extend_pixel(src[(-pixCanvasWidth)+1], rmm2);
-    extend_pixel(src[0], rmm3);
-    extend_pixel(src[1], rmm4);
-
-    extpix_add(rmm1, rmm4);
-    extpix_mul(rmm1, rmmCe);
-    extpix_mul(rmm2, rmmCc);
-    extpix_mul(rmm3, rmmCm);
-    extpix_add(rmm1, rmm2);
-    extpix_add(rmm1, rmm3);
-    extpix_adds(rmm1, rmmAdd);
-    extpix_mulhi(rmm1, rmmInvDiv);
-    dst[-pixCanvasWidth] = *rowptr;
-    dst[0] = unextend_pixel(rmm1);
-
-    src++;
-    dst++;
-    rowptr++;
-
-    // ----------------------- process lower edge pixels
-    for (size_t i = pixWidth-2; i != 0; i--)  // lowerLoop
-    {
-        // for each pixel
-        extend_pixel(src[(-pixCanvasWidth)-1], rmm1);
-        extend_pixel(src[-pixCanvasWidth], rmm2);
-        extend_pixel(src[(-pixCanvasWidth)+1], rmm3);
-        extend_pixel(src[-1], rmm4);
-        extend_pixel(src[0], rmm5);
-        extend_pixel(src[1], rmm6);
-
-        extpix_add(rmm1, rmm3);
-        extpix_add(rmm4, rmm6);
-        extpix_mul(rmm1, rmmEcl);
-        extpix_mul(rmm2, rmmEe);
-        extpix_mul(rmm4, rmmEch);
-        extpix_mul(rmm5, rmmEm);
-        extpix_add(rmm1, rmm2);
-        extpix_add(rmm1, rmm4);
-        extpix_add(rmm1, rmm5);
-        extpix_adds(rmm1, rmmAdd);
-        extpix_mulhi(rmm1, rmmInvDiv);
-        dst[-pixCanvasWidth] = *rowptr;
-        dst[0] = unextend_pixel(rmm1);
-
-        // advance to next pixel
-        src++;
-        dst++;
-        rowptr++;
+        Swap( pulOrigAbove, pulOrigRow);
+      }
     }
-
-    // ----------------------- lower right corners
-    extend_pixel(src[(-pixCanvasWidth)-1], rmm1);
-    extend_pixel(src[-pixCanvasWidth], rmm2);
-    extend_pixel(src[-1], rmm3);
-    extend_pixel(src[0], rmm4);
-
-    extpix_add(rmm2, rmm3);
-    extpix_mul(rmm1, rmmCc);
-    extpix_mul(rmm2, rmmCe);
-    extpix_mul(rmm4, rmmCm);
-    extpix_add(rmm1, rmm2);
-    extpix_add(rmm1, rmm4);
-    extpix_adds(rmm1, rmmAdd);
-    extpix_mulhi(rmm1, rmmInvDiv);
-    dst[-pixCanvasWidth] = *rowptr;
-    dst[0] = unextend_pixel(rmm1);
-
+  }
 #endif
 
   // all done (finally)
@@ -3086,3 +3039,76 @@ allDoneE:
     }
 
 #endif
+
+
+// benchmark mip-mapping, filtering and dithering of all textures in a GRO (or all loaded GROs if none given)
+void TextureGROBenchmark(void *pArgs)
+{
+  CTString strGRO = *NEXTARGUMENT(CTString*);
+  const CTFileName fnmGRO = CTFileName(strGRO).FileName()+CTFileName(strGRO).FileExt();
+  const INDEX iOldMultiThreaded = tex_bMultiThreadedBitmaps;
+  INDEX ctTextures = 0;
+  DOUBLE dMB = 0;
+  DOUBLE adSeconds[3] = { 0, 0, 0 };
+  BOOL bMatch = TRUE;
+
+  for( INDEX iFile=0; iFile<UNZIPGetFileCount(); iFile++) {
+    const CTFileName &fnm = UNZIPGetFileAtIndex(iFile);
+    if( fnm.FileExt()!=".tex") continue;
+    if( fnmGRO!="") {
+      const CTFileName &fnmArchive = UNZIPGetArchiveAtIndex(iFile);
+      if( fnmArchive.FileName()+fnmArchive.FileExt()!=fnmGRO) continue;
+    }
+    // load texture and take its first mip-map of first frame
+    CTextureData td;
+    try {
+      td.Load_t(fnm);
+    } catch ( const char *strError) {
+      CPrintF( "%s\n", strError);
+      continue;
+    }
+    const PIX pixWidth  = td.GetPixWidth();
+    const PIX pixHeight = td.GetPixHeight();
+    if( td.td_ptegEffect!=NULL || td.td_pulFrames==NULL || pixWidth<2 || pixHeight<2) continue;
+    const PIX pixMipmaps = GetMipmapOffset( 15, pixWidth, pixHeight);
+
+    // 0=reference, 1=SIMD, 2=SIMD on all threads
+    ULONG *apulResults[3];
+    for( INDEX iMode=0; iMode<3; iMode++) {
+      _bScalarBitmaps = iMode==0;
+      tex_bMultiThreadedBitmaps = iMode==2;
+      ULONG *pulMipmaps = (ULONG*)AllocMemory( pixMipmaps*2 *BYTES_PER_TEXEL);
+      ULONG *pulFiltered = pulMipmaps + pixMipmaps;
+      memcpy( pulMipmaps, td.td_pulFrames, pixWidth*pixHeight *BYTES_PER_TEXEL);
+      CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+      FilterBitmap( 2, pulMipmaps, pulFiltered, pixWidth, pixHeight);
+      MakeMipmaps( 15, pulMipmaps, pixWidth, pixHeight, -2);
+      DitherMipmaps( 4, pulMipmaps, pulMipmaps, pixWidth, pixHeight);
+      CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+      adSeconds[iMode] += (tv1-tv0).GetSeconds();
+      apulResults[iMode] = pulMipmaps;
+    }
+    // results must be exactly the same
+    for( INDEX iMode=1; iMode<3; iMode++) {
+      if( memcmp( apulResults[iMode], apulResults[0], pixMipmaps*2 *BYTES_PER_TEXEL)!=0) {
+        CPrintF( TRANS("  %s: results differ!\n"), (const char*)fnm);
+        bMatch = FALSE;
+      }
+    }
+    for( INDEX iMode=0; iMode<3; iMode++) FreeMemory( apulResults[iMode]);
+    dMB += pixWidth*pixHeight *BYTES_PER_TEXEL /(1024.0*1024.0);
+    ctTextures++;
+  }
+  _bScalarBitmaps = FALSE;
+  tex_bMultiThreadedBitmaps = iOldMultiThreaded;
+
+  if( ctTextures==0) {
+    CPrintF( TRANS("No textures found in '%s'.\n"), (const char*)strGRO);
+    return;
+  }
+  CPrintF( TRANS("Processed %d textures (%.1f MB, %d threads, %s):\n"), ctTextures, dMB,
+           _pWorkerPool->GetThreadsCount(), BITMAP_NEON ? "NEON" : (BITMAP_SSE2 ? "SSE2" : "no SIMD"));
+  CPrintF( TRANS("  reference %7.2f MB/s, SIMD %7.2f MB/s, SIMD parallel %7.2f MB/s, %s\n"),
+           dMB/Max(adSeconds[0],1e-6), dMB/Max(adSeconds[1],1e-6), dMB/Max(adSeconds[2],1e-6),
+           bMatch ? TRANS("match") : TRANS("MISMATCH!"));
+}
@@ -26,6 +26,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Graphics/Texture.h>
 #include <Engine/Graphics/GfxProfile.h>
 #include <Engine/Brushes/Brush.h>
+#include <Engine/Base/WorkerPool.h>
+#include <Engine/Base/ListIterator.inl>
+#include <Engine/Rendering/RenderProfile.h>
+#include <Engine/Templates/StaticStackArray.cpp>
 
 #include <Engine/Base/Statistics_Internal.h>
 
@@ -37,6 +41,7 @@ extern INDEX shd_iDynamicSize;
 extern INDEX shd_bFineQuality;
 extern INDEX shd_iDithering;
 extern INDEX shd_bDynamicMipmaps;
+extern INDEX shd_bBackgroundMixing;
 
 extern INDEX gap_bAllowSingleMipmap;
 extern FLOAT gfx_tmProbeDecay;
@@ -45,12 +50,81 @@ extern BOOL _bShadowsUpdated;
 extern BOOL _bMultiPlayer;
 
 
+// static layers of one shadow map being mixed on a worker thread
+class CShadowMixTask : public CWorkerTask {
+public:
+  CListNode smt_lnInMixTasks;   // for linking in list of all background mixing tasks
+  CShadowMap *smt_psm;          // shadow map that is being mixed
+  ULONG *smt_pulShadowMap;      // buffer that is mixed into (becomes cached shadow map when done)
+  SLONG smt_slMemoryUsed;
+  INDEX smt_iFirstMip;          // range of mip-maps to mix
+  INDEX smt_iLastMip;
+  CShadowMixInputs smt_smiInputs; // lights and polygon as they were when mixing was started
+  BOOL  smt_bAnimatingLights;   // result of mixing
+  BOOL  smt_bDone;              // set by worker thread when finished (guarded by _mxShadowMixing)
+  BOOL  smt_bStale;             // set if shadow map was invalidated in the mean time
+  BOOL  smt_bStallCounted;      // set once renderer had to wait for it
+  CTimerValue smt_tvStarted;    // for measuring latency
+  void Execute(void);
+};
+
+// all background mixing tasks (accessed only from main thread)
+static CListHead _lhShadowMixTasks;
+// for waiting on background mixing
+static pthread_mutex_t _mxShadowMixing = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  _cvShadowMixed  = PTHREAD_COND_INITIALIZER;
+
+
+void CShadowMixTask::Execute(void)
+{
+  smt_psm->MixLayersInBackground( smt_pulShadowMap, smt_slMemoryUsed, smt_iFirstMip, smt_iLastMip,
+                                  smt_smiInputs, smt_bAnimatingLights);
+  pthread_mutex_lock(&_mxShadowMixing);
+  smt_bDone = TRUE;
+  pthread_cond_broadcast(&_cvShadowMixed);
+  pthread_mutex_unlock(&_mxShadowMixing);
+}
+
+// check if task is finished, or make sure that it will not be started (returns FALSE if still running)
+static BOOL StopShadowMixTask( CShadowMixTask &smt, BOOL bWait)
+{
+  pthread_mutex_lock(&_mxShadowMixing);
+  BOOL bDone = smt.smt_bDone;
+  pthread_mutex_unlock(&_mxShadowMixing);
+  if( bDone) return TRUE;
+  // if not started yet, mark it as done with stale results
+  if( _pWorkerPool->RemoveTask(&smt)) {
+    smt.smt_bDone  = TRUE;
+    smt.smt_bStale = TRUE;
+    return TRUE;
+  }
+  if( !bWait) return FALSE;
+  // wait for worker thread to finish it
+  pthread_mutex_lock(&_mxShadowMixing);
+  while( !smt.smt_bDone) pthread_cond_wait( &_cvShadowMixed, &_mxShadowMixing);
+  pthread_mutex_unlock(&_mxShadowMixing);
+  return TRUE;
+}
+
+
+// wait until no shadow map is being mixed in background (call before destroying or rebuilding the world)
+void FinishShadowMixing(void)
+{
+  // tasks that are not started yet are dropped and will be requeued when needed
+  FORDELETELIST( CShadowMixTask, smt_lnInMixTasks, _lhShadowMixTasks, itsmt) {
+    StopShadowMixTask( *itsmt, TRUE);
+    if( itsmt->smt_bStale) itsmt->smt_psm->FinishBackgroundCache(TRUE);
+  }
+}
+
+
 /*
  * Routines that manipulates with shadow cluster map class
  */
 
 CShadowMap::CShadowMap()
 {
+  sm_psmtMixing = NULL;
   sm_pulCachedShadowMap = NULL;
   sm_pulDynamicShadowMap = NULL;
   sm_slMemoryUsed = 0;
@@ -181,6 +255,131 @@ void CShadowMap::Cache( INDEX iWantedMipLevel)
 }
 
 
+// start mixing static layers on a worker thread (returns FALSE if it has to be cached right away)
+BOOL CShadowMap::CacheInBackground( INDEX iWantedMipLevel)
+{
+  ASSERT( !(sm_ulFlags&SMF_MIXPENDING));
+  ASSERT( iWantedMipLevel>=sm_iFirstMipLevel && iWantedMipLevel<=sm_iLastMipLevel);
+
+  // colorized and flat shadowmaps are fast enough to be cached right away
+  extern INDEX shd_bColorize;
+  if( shd_bColorize) return FALSE;
+  COLOR colFlat;
+  if( IsShadowFlat(colFlat)) return FALSE;
+
+  // if smaller mip-maps are already cached, mix only the missing ones
+  const BOOL bKeepOld = sm_pulCachedShadowMap!=NULL && sm_pulCachedShadowMap!=&sm_colFlat && sm_iFirstCachedMipLevel<31;
+  const INDEX iLastMipLevelToCache = bKeepOld ? sm_iFirstCachedMipLevel-1 : sm_iLastMipLevel;
+  CShadowMixTask *psmt = new CShadowMixTask;
+  if( !PrepareBackgroundMixing( iWantedMipLevel, iLastMipLevelToCache, psmt->smt_smiInputs)) {
+    delete psmt;
+    return FALSE;
+  }
+
+  // allocate buffer to mix into
+  const PIX pixSizeU = sm_mexWidth >>iWantedMipLevel;
+  const PIX pixSizeV = sm_mexHeight>>iWantedMipLevel;
+  const SLONG slSize = GetMipmapOffset( 15, pixSizeU, pixSizeV) *BYTES_PER_TEXEL;
+  ULONG *pulNew = (ULONG*)AllocMemory(slSize);
+  ASSERT( slSize>0 && slSize<=SHADOWMAXBYTES);
+  // copy already cached mip-maps at the end of buffer
+  if( bKeepOld) {
+    ASSERT( iWantedMipLevel<sm_iFirstCachedMipLevel && slSize>sm_slMemoryUsed);
+    memcpy( pulNew + (slSize-sm_slMemoryUsed)/BYTES_PER_TEXEL, sm_pulCachedShadowMap, sm_slMemoryUsed);
+  }
+
+  // start the task
+  psmt->smt_psm = this;
+  psmt->smt_pulShadowMap = pulNew;
+  psmt->smt_slMemoryUsed = slSize;
+  psmt->smt_iFirstMip = iWantedMipLevel;
+  psmt->smt_iLastMip  = iLastMipLevelToCache;
+  psmt->smt_bAnimatingLights = FALSE;
+  psmt->smt_bDone  = FALSE;
+  psmt->smt_bStale = FALSE;
+  psmt->smt_bStallCounted = FALSE;
+  psmt->smt_tvStarted = _pTimer->GetHighPrecisionTimer();
+  _lhShadowMixTasks.AddTail( psmt->smt_lnInMixTasks);
+  sm_psmtMixing = psmt;
+  sm_ulFlags |= SMF_MIXPENDING;
+  _pfRenderProfile.IncrementCounter( CRenderProfile::PCI_SHADOWMIXESSTARTED);
+  _pWorkerPool->AddTask(psmt);
+  return TRUE;
+}
+
+
+// use results of background mixing if done or cancel it (returns TRUE if results were used)
+BOOL CShadowMap::FinishBackgroundCache( BOOL bCancel)
+{
+  if( !(sm_ulFlags&SMF_MIXPENDING)) return FALSE;
+  CShadowMixTask &smt = *sm_psmtMixing;
+  if( !StopShadowMixTask( smt, bCancel)) return FALSE;
+
+  // task is done
+  sm_ulFlags &= ~SMF_MIXPENDING;
+  sm_psmtMixing = NULL;
+  smt.smt_lnInMixTasks.Remove();
+  // drop results if not needed any more
+  const BOOL bBetter = sm_pulCachedShadowMap==NULL || sm_pulCachedShadowMap==&sm_colFlat
+                    || smt.smt_iFirstMip<sm_iFirstCachedMipLevel;
+  if( bCancel || smt.smt_bStale || !bBetter) {
+    FreeMemory( smt.smt_pulShadowMap);
+    delete &smt;
+    return FALSE;
+  }
+
+  _pfGfxProfile.StartTimer( CGfxProfile::PTI_CACHESHADOW);
+  _bShadowsUpdated = TRUE;
+  // dynamic layers are invalid when shadowmap is cached
+  sm_ulFlags |= SMF_DYNAMICINVALID;
+  if( sm_pulDynamicShadowMap!=NULL) {
+    FreeMemory( sm_pulDynamicShadowMap);
+    sm_pulDynamicShadowMap = NULL;
+  }
+  // replace old shadow map with the mixed one
+  if( sm_pulCachedShadowMap!=NULL && sm_pulCachedShadowMap!=&sm_colFlat) FreeMemory( sm_pulCachedShadowMap);
+  sm_pulCachedShadowMap   = smt.smt_pulShadowMap;
+  sm_slMemoryUsed         = smt.smt_slMemoryUsed;
+  sm_iFirstCachedMipLevel = smt.smt_iFirstMip;
+  if( smt.smt_bAnimatingLights) sm_ulFlags |=  SMF_ANIMATINGLIGHTS;
+  else                          sm_ulFlags &= ~SMF_ANIMATINGLIGHTS;
+  // let the higher level driver finish its layers
+  FinishBackgroundMixing( smt.smt_iFirstMip, smt.smt_iLastMip, smt.smt_smiInputs);
+  // add it to shadow list
+  if( !sm_lnInGfx.IsLinked()) _pGfx->gl_lhCachedShadows.AddTail( sm_lnInGfx);
+  _pfGfxProfile.StopTimer( CGfxProfile::PTI_CACHESHADOW);
+
+  // measure time since mixing was started
+  CTimerValue tvLatency = _pTimer->GetHighPrecisionTimer() - smt.smt_tvStarted;
+  _pfRenderProfile.IncrementCounter( CRenderProfile::PCI_SHADOWMIXESFINISHED);
+  _pfRenderProfile.IncrementCounter( CRenderProfile::PCI_SHADOWMIXLATENCY, tvLatency.GetMilliseconds());
+  delete &smt;
+  return TRUE;
+}
+
+
+// start background mixing of shadow map that will probably be visible soon (returns TRUE if started)
+BOOL CShadowMap::Prefetch(void)
+{
+  if( !shd_bBackgroundMixing || (sm_ulFlags&SMF_MIXPENDING) || sm_mexWidth==0) return FALSE;
+  // invalidated shadowmaps will be mixed right away when needed
+  if( sm_pulCachedShadowMap!=NULL && sm_iFirstCachedMipLevel>30) return FALSE;
+
+  // determine mip level same as Prepare() does it when not probing
+  shd_iStaticSize = Clamp( shd_iStaticSize, 5L, 8L);
+  PIX pixClampAreaSize = 1L<<(shd_iStaticSize*2);
+  INDEX iFinestMipLevel = sm_iFirstMipLevel + 
+                          ClampTextureSize( pixClampAreaSize, _pGfx->gl_pixMaxTextureDimension,
+                                            sm_mexWidth>>sm_iFirstMipLevel, sm_mexHeight>>sm_iFirstMipLevel);
+  INDEX iWantedMipLevel = ClampUp( iFinestMipLevel, sm_iLastMipLevel);
+  if( sm_pulCachedShadowMap!=NULL && iWantedMipLevel>=sm_iFirstCachedMipLevel) return FALSE;
+
+  if( !CacheInBackground( iWantedMipLevel)) return FALSE;
+  _pfRenderProfile.IncrementCounter( CRenderProfile::PCI_SHADOWPREFETCHES);
+  return TRUE;
+}
+
+
 // update dynamic layers of the shadow map
 // (returns mip in which shadow needs to be uploaded)
 ULONG CShadowMap::UpdateDynamicLayers(void)
@@ -241,6 +440,8 @@ void CShadowMap::Invalidate( BOOL bDynamicOnly/*=FALSE*/)
   } else {
     // mark that no mipmaps are cached
     sm_iFirstCachedMipLevel = 31;
+    // eventual results of background mixing are outdated
+    if( sm_ulFlags&SMF_MIXPENDING) sm_psmtMixing->smt_bStale = TRUE;
   }
 }
 
@@ -261,6 +462,8 @@ void CShadowMap::MarkDrawn(void)
 // uncache the shadow map (returns total ammount of memory that has been freed)
 SLONG CShadowMap::Uncache( void)
 {
+  // stop eventual background mixing
+  FinishBackgroundCache(TRUE);
   _bShadowsUpdated = TRUE;
   // discard uploaded portion
   if( sm_ulObject!=NONE) {
@@ -497,11 +700,37 @@ void CShadowMap::Prepare(void)
     else iWantedMipLevel += iMipOffset;
   }
 
+  // use results of background mixing if done
+  if( (sm_ulFlags&SMF_MIXPENDING) && FinishBackgroundCache(FALSE)) {
+    sm_iFirstUploadMipLevel = sm_iFirstCachedMipLevel;
+  }
+
   // cache if it is not cached at all of not in this mip level
   if( sm_pulCachedShadowMap==NULL || iWantedMipLevel<sm_iFirstCachedMipLevel) {
-    Cache( iWantedMipLevel);
-    ASSERT( sm_iFirstCachedMipLevel<31);
-    sm_iFirstUploadMipLevel = sm_iFirstCachedMipLevel;
+    // if mixing in background
+    BOOL bMixing = FALSE;
+    if( shd_bBackgroundMixing) {
+      // cache smallest mip-map right away to have something to show meanwhile
+      if( sm_pulCachedShadowMap==NULL && iWantedMipLevel<sm_iLastMipLevel) {
+        Cache( sm_iLastMipLevel);
+        sm_iFirstUploadMipLevel = sm_iFirstCachedMipLevel;
+      }
+      // keep showing what is cached until the rest is mixed
+      if( sm_pulCachedShadowMap!=&sm_colFlat && iWantedMipLevel<sm_iFirstCachedMipLevel && sm_iFirstCachedMipLevel<31) {
+        bMixing = (sm_ulFlags&SMF_MIXPENDING) || CacheInBackground( iWantedMipLevel);
+      }
+    }
+    if( bMixing) {
+      // count each shadow map only once
+      if( !sm_psmtMixing->smt_bStallCounted) {
+        sm_psmtMixing->smt_bStallCounted = TRUE;
+        _pfRenderProfile.IncrementCounter( CRenderProfile::PCI_SHADOWSTALLSAVOIDED);
+      }
+    } else if( sm_pulCachedShadowMap==NULL || iWantedMipLevel<sm_iFirstCachedMipLevel) {
+      Cache( iWantedMipLevel);
+      ASSERT( sm_iFirstCachedMipLevel<31);
+      sm_iFirstUploadMipLevel = sm_iFirstCachedMipLevel;
+    }
   }
 
   // update the dynamic layers if they're invalid
@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define SMF_DYNAMICBLACK    (1UL<<1)    // there was no need to mix dynamic shadow layer(s) (they were all black)
 #define SMF_DYNAMICUPLOADED (1UL<<2)    // dynamic shadowmap was uploaded last
 #define SMF_ANIMATINGLIGHTS (1UL<<3)    // set when shadowmap has at least one animating light
+#define SMF_MIXPENDING      (1UL<<4)    // static layers are being mixed in background
 #define SMF_WANTSPROBE      (1UL<<20)   // set if wants to be probed
 #define SMF_PROBED          (1UL<<21)   // set if last binding was as probe-texture
 
@@ -57,6 +58,7 @@ public:
   CTexParams sm_tpLocal;        // local texture parameters
 
   INDEX sm_iRenderFrame; // frame number currently rendering (for profiling)
+  class CShadowMixTask *sm_psmtMixing;  // background mixing in progress (if SMF_MIXPENDING)
 
   // skip old shadows saved in stream
   void Read_old_t(CTStream *inFile); // throw char *
@@ -68,6 +70,11 @@ public:
   virtual BOOL HasDynamicLayers(void);
   // this one always fail - CBrushShadowmap is the one that matters
   inline virtual BOOL IsShadowFlat( COLOR &colFlat) { return FALSE; };
+  // background mixing is also supported only by CBrushShadowmap
+  inline virtual BOOL PrepareBackgroundMixing( INDEX iFirstMip, INDEX iLastMip, class CShadowMixInputs &smi) { return FALSE; };
+  inline virtual void MixLayersInBackground( ULONG *pulShadowMap, SLONG slMemoryUsed, INDEX iFirstMip, INDEX iLastMip,
+                                             const class CShadowMixInputs &smi, BOOL &bAnimatingLights) {};
+  inline virtual void FinishBackgroundMixing( INDEX iFirstMip, INDEX iLastMip, const class CShadowMixInputs &smi) {};
   // mark that shadow has been drawn
   void MarkDrawn(void);
 
@@ -96,6 +103,12 @@ public:
 
   // cache the shadow map
   void Cache( INDEX iWantedMipLevel);
+  // start mixing static layers on a worker thread (returns FALSE if it has to be cached right away)
+  BOOL CacheInBackground( INDEX iWantedMipLevel);
+  // use results of background mixing if done or cancel it (returns TRUE if results were used)
+  BOOL FinishBackgroundCache( BOOL bCancel);
+  // start background mixing of shadow map that will probably be visible soon (returns TRUE if started)
+  BOOL Prefetch(void);
   // update dynamic layers of the shadow map (returns mip in which shadow needs to be uploaded)
   ULONG UpdateDynamicLayers(void);
   // invalidate the shadow map
@@ -116,5 +129,9 @@ public:
 };
 
 
+// wait until no shadow map is being mixed in background (call before destroying or rebuilding the world)
+ENGINE_API extern void FinishShadowMixing(void);
+
+
 #endif  /* include-once check. */
 
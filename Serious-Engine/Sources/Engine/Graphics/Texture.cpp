@@ -57,7 +57,8 @@ struct TextureSettings TS = {0};
 // determine (or assume) support for OpenGL and Direct3D texture internal formats
 extern void DetermineSupportedTextureFormats( GfxAPIType eAPI)
 {
-  if( eAPI==GAT_OGL) {
+  // NONE API records as if it were OpenGL
+  if( eAPI==GAT_OGL || eAPI==GAT_NONE) {
     TS.ts_tfRGB8   = GL_RGB8;
     TS.ts_tfRGBA8  = GL_RGBA8;
     TS.ts_tfRGB5   = GL_RGB5;
@@ -981,7 +982,7 @@ void CTextureData::Read_t( CTStream *inFile)
   INDEX iDitherType = 0;
   if( !(td_ulFlags&TEX_STATIC) || !(td_ulFlags&TEX_CONSTANT)) { // only non-static-constant textures can be dithered
     extern INDEX AdjustDitheringType_OGL(    GLenum eFormat, INDEX iDitheringType);
-    if( eAPI==GAT_OGL) iDitherType = AdjustDitheringType_OGL(    (GLenum)td_ulInternalFormat, tex_iDithering);
+    if( eAPI==GAT_OGL || eAPI==GAT_NONE) iDitherType = AdjustDitheringType_OGL( (GLenum)td_ulInternalFormat, tex_iDithering);
 #ifdef SE1_D3D
     extern INDEX AdjustDitheringType_D3D( D3DFORMAT eFormat, INDEX iDitheringType);
     if( eAPI==GAT_D3D) iDitherType = AdjustDitheringType_D3D( (D3DFORMAT)td_ulInternalFormat, tex_iDithering);
@@ -24,6 +24,24 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Templates/DynamicArray.cpp>
 #include <Engine/Templates/Stock_CTextureData.h>
 #include <Engine/Templates/StaticArray.cpp>
+#include <Engine/Base/WorkerPool.h>
+#include <Engine/Base/Memory.h>
+#include <Engine/Base/Shell.h>
+#include <Engine/Base/Console.h>
+#include <Engine/Base/Translation.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define EFFECT_NEON 1
+#else
+#define EFFECT_NEON 0
+#endif
+#if !EFFECT_NEON && defined(__SSE2__)
+#include <emmintrin.h>
+#define EFFECT_SSE2 1
+#else
+#define EFFECT_SSE2 0
+#endif
 
 // asm shortcuts
 #define O offset
@@ -56,6 +74,25 @@ static INDEX _iWantedMipLevel;
 static UBYTE *_pubDrawBuffer;
 static SWORD *_pswDrawBuffer;
 
+extern INDEX tex_bMultiThreadedEffects;
+static BOOL _bScalarEffects = FALSE;  // for benchmarking only
+
+// effect passes over less texels than this are not worth splitting between threads
+#define EFFECT_MIN_PARALLEL_TEXELS (128*128)
+
+// process rows of an effect pass on worker threads (if worth it)
+static void RunEffectRows( CWorkerJob &wj, PIX pixRows, PIX pixTexelsPerRow)
+{
+  const INDEX ctThreads = _pWorkerPool->GetThreadsCount();
+  if( tex_bMultiThreadedEffects && !_bScalarEffects && ctThreads>1
+   && pixRows*pixTexelsPerRow >= EFFECT_MIN_PARALLEL_TEXELS) {
+    // few rows per chunk, so faster threads can take more
+    _pWorkerPool->Run( wj, pixRows, Max( pixRows/(ctThreads*4), (PIX)1));
+  } else {
+    wj.ProcessRange( 0, pixRows);
+  }
+}
+
 
 // randomizer
 static ULONG ulRNDSeed;
@@ -1091,6 +1128,83 @@ void InitializeWater(void)
 }
 
 
+// move water in texels [pixFirst,pixLast) of height map
+static void MoveWater( SWORD *pNew, const SWORD *pOld, PIX pixFirst, PIX pixLast, SLONG slDensity)
+{
+  const PIX pixRow = _pixBufferWidth;
+  PIX pixOffset = pixFirst;
+  if( !_bScalarEffects) {
+#if EFFECT_NEON
+    // 8 texels at once in 32 bits (sum of neighbours doesn't fit in 16 bits)
+    const int32x4_t s4Shift = vdupq_n_s32(-slDensity);
+    for( ; pixOffset+8<=pixLast; pixOffset+=8) {
+      const int16x8_t swAbove = vld1q_s16( pOld+pixOffset-pixRow);
+      const int16x8_t swBelow = vld1q_s16( pOld+pixOffset+pixRow);
+      const int16x8_t swLeft  = vld1q_s16( pOld+pixOffset-1);
+      const int16x8_t swRight = vld1q_s16( pOld+pixOffset+1);
+      const int16x8_t swNew   = vld1q_s16( pNew+pixOffset);
+      int32x4_t slLo = vaddq_s32( vaddl_s16( vget_low_s16(swAbove),  vget_low_s16(swBelow)),
+                                  vaddl_s16( vget_low_s16(swLeft),   vget_low_s16(swRight)));
+      int32x4_t slHi = vaddq_s32( vaddl_s16( vget_high_s16(swAbove), vget_high_s16(swBelow)),
+                                  vaddl_s16( vget_high_s16(swLeft),  vget_high_s16(swRight)));
+      slLo = vsubq_s32( vshrq_n_s32( slLo, 1), vmovl_s16( vget_low_s16(swNew)));
+      slHi = vsubq_s32( vshrq_n_s32( slHi, 1), vmovl_s16( vget_high_s16(swNew)));
+      slLo = vsubq_s32( slLo, vshlq_s32( slLo, s4Shift));
+      slHi = vsubq_s32( slHi, vshlq_s32( slHi, s4Shift));
+      vst1q_s16( pNew+pixOffset, vcombine_s16( vmovn_s32(slLo), vmovn_s32(slHi)));
+    }
+#elif EFFECT_SSE2
+    // 8 texels at once in 32 bits (sum of neighbours doesn't fit in 16 bits)
+    const __m128i mShift = _mm_cvtsi32_si128(slDensity);
+    #define SIGNEXTLO(m) _mm_srai_epi32( _mm_unpacklo_epi16(m,m), 16)
+    #define SIGNEXTHI(m) _mm_srai_epi32( _mm_unpackhi_epi16(m,m), 16)
+    #define TRUNCATE(m)  _mm_srai_epi32( _mm_slli_epi32(m,16), 16)
+    for( ; pixOffset+8<=pixLast; pixOffset+=8) {
+      const __m128i swAbove = _mm_loadu_si128( (const __m128i*)(pOld+pixOffset-pixRow));
+      const __m128i swBelow = _mm_loadu_si128( (const __m128i*)(pOld+pixOffset+pixRow));
+      const __m128i swLeft  = _mm_loadu_si128( (const __m128i*)(pOld+pixOffset-1));
+      const __m128i swRight = _mm_loadu_si128( (const __m128i*)(pOld+pixOffset+1));
+      const __m128i swNew   = _mm_loadu_si128( (const __m128i*)(pNew+pixOffset));
+      __m128i slLo = _mm_add_epi32( _mm_add_epi32( SIGNEXTLO(swAbove), SIGNEXTLO(swBelow)),
+                                    _mm_add_epi32( SIGNEXTLO(swLeft),  SIGNEXTLO(swRight)));
+      __m128i slHi = _mm_add_epi32( _mm_add_epi32( SIGNEXTHI(swAbove), SIGNEXTHI(swBelow)),
+                                    _mm_add_epi32( SIGNEXTHI(swLeft),  SIGNEXTHI(swRight)));
+      slLo = _mm_sub_epi32( _mm_srai_epi32( slLo, 1), SIGNEXTLO(swNew));
+      slHi = _mm_sub_epi32( _mm_srai_epi32( slHi, 1), SIGNEXTHI(swNew));
+      slLo = _mm_sub_epi32( slLo, _mm_sra_epi32( slLo, mShift));
+      slHi = _mm_sub_epi32( slHi, _mm_sra_epi32( slHi, mShift));
+      _mm_storeu_si128( (__m128i*)(pNew+pixOffset), _mm_packs_epi32( TRUNCATE(slLo), TRUNCATE(slHi)));
+    }
+    #undef SIGNEXTLO
+    #undef SIGNEXTHI
+    #undef TRUNCATE
+#endif
+  }
+  // remaining texels
+  for( ; pixOffset<pixLast; pixOffset++) {
+    const PIX iNew = (( (SLONG)pOld[pixOffset - pixRow]
+                      + (SLONG)pOld[pixOffset + pixRow]
+                      + (SLONG)pOld[pixOffset - 1]
+                      + (SLONG)pOld[pixOffset + 1]
+                     ) >> 1)
+                      - (SLONG)pNew[pixOffset];
+    pNew[pixOffset] =  iNew - (iNew >> slDensity);
+  }
+}
+
+// moves inner rows of water on worker threads
+class CMoveWaterJob : public CWorkerJob {
+public:
+  SWORD *mwj_pNew;
+  const SWORD *mwj_pOld;
+  SLONG mwj_slDensity;
+  void ProcessRange( INDEX iFirst, INDEX iLast)
+  { // rows are counted from the 2nd one, and start at 2nd texel
+    MoveWater( mwj_pNew, mwj_pOld, (iFirst+1)*_pixBufferWidth+1, (iLast+1)*_pixBufferWidth+1, mwj_slDensity);
+  }
+};
+
+
 /*******************************
        Water Animation
 ********************************/
@@ -1103,24 +1217,16 @@ static void AnimateWater( SLONG slDensity)
   SWORD *pNew = (SWORD*)_ptdEffect->td_pubBuffer1;
   SWORD *pOld = (SWORD*)_ptdEffect->td_pubBuffer2;
 
-  PIX pixV, pixU;
+  PIX pixU;
   PIX pixOffset, iNew;
   SLONG slLineAbove, slLineBelow, slLineLeft, slLineRight;
 
   // inner rectangle (without 1 pixel top and bottom line)
-  pixOffset = _pixBufferWidth + 1;
-  for( pixV=_pixBufferHeight-2; pixV>0; pixV--) {
-    for( pixU=_pixBufferWidth; pixU>0; pixU--) {
-      iNew = (( (SLONG)pOld[pixOffset - _pixBufferWidth]
-              + (SLONG)pOld[pixOffset + _pixBufferWidth]
-              + (SLONG)pOld[pixOffset - 1]
-              + (SLONG)pOld[pixOffset + 1]
-             ) >> 1)
-              - (SLONG)pNew[pixOffset];
-      pNew[pixOffset] =  iNew - (iNew >> slDensity);
-      pixOffset++;
-    }
-  }
+  CMoveWaterJob mwj;
+  mwj.mwj_pNew = pNew;
+  mwj.mwj_pOld = pOld;
+  mwj.mwj_slDensity = slDensity;
+  RunEffectRows( mwj, _pixBufferHeight-2, _pixBufferWidth);
 
   // upper horizontal border (without corners)
   slLineAbove = ((_pixBufferHeight-1)*_pixBufferWidth) + 1;
@@ -1209,6 +1315,121 @@ static void AnimateWater( SLONG slDensity)
 #define PIXEL(u,v) pulTextureBase[ ((u)&(SLONG&)mmBaseWidthMask) + ((v)&(SLONG&)mmBaseHeightMask) *pixBaseWidth]
 
 
+// displaces rows of water texture on worker threads
+class CRenderWaterJob : public CWorkerJob {
+public:
+  INDEX  rwj_iMode;             // 0=sub-sampling, 1=bilinear super-sampling 2, 2=bilinear super-sampling 4
+  ULONG *rwj_pulTexture;
+  ULONG *rwj_pulTextureBase;
+  PIX    rwj_pixBaseWidth;
+  SWORD *rwj_pswHeightMap;
+  SLONG  rwj_slHeightMapStep, rwj_slHeightRowStep;  // for sub-sampling only
+  void ProcessRange( INDEX iFirst, INDEX iLast);
+};
+
+void CRenderWaterJob::ProcessRange( INDEX iFirst, INDEX iLast)
+{
+  const PIX pixBaseWidth = rwj_pixBaseWidth;
+  const ULONG *pulTextureBase = rwj_pulTextureBase;
+
+  if( rwj_iMode==0)
+  { // SUB-SAMPLING
+    PIX pixPos, pixDU, pixDV;
+    const SLONG slHeightMapStep = rwj_slHeightMapStep;
+    for( PIX pixV=iFirst; pixV<iLast; pixV++)
+    { // row loop
+      ULONG *pulTexture = rwj_pulTexture + pixV*_pixTexWidth;
+      const SWORD *pswHeightMap = rwj_pswHeightMap + pixV*(_pixTexWidth*slHeightMapStep + rwj_slHeightRowStep);
+      for( PIX pixU=0; pixU<_pixTexWidth; pixU++)
+      { // texel loop
+        pixPos =  pswHeightMap[0];
+        pixDU  = (pswHeightMap[1]               - pixPos) >>(SLONG&)mmShift;
+        pixDV  = (pswHeightMap[_pixBufferWidth] - pixPos) >>(SLONG&)mmShift;
+        pixDU  = (pixU +pixDU) & (SLONG&)mmBaseWidthMask;
+        pixDV  = (pixV +pixDV) & (SLONG&)mmBaseHeightMask;
+        *pulTexture++ = pulTextureBase[pixDV*pixBaseWidth + pixDU];
+        // advance to next texel in height map
+        pswHeightMap += slHeightMapStep;
+      }
+    }
+  }
+  else if( rwj_iMode==1)
+  { // BILINEAR SUPER-SAMPLING 2
+    SLONG slU_00, slU_01, slU_10, slU_11;
+    SLONG slV_00, slV_01, slV_10, slV_11;
+    for( PIX pixV=iFirst; pixV<iLast; pixV++)
+    { // row loop
+      ULONG *pulTexture = rwj_pulTexture + pixV*_pixTexWidth*2;
+      const SWORD *pswHeightMap = rwj_pswHeightMap + pixV*_pixBufferWidth;
+      for( PIX pixU=0; pixU<_pixBufferWidth; pixU++)
+      { // texel loop
+        slU_00 = pswHeightMap[_pixBufferWidth*0+1] - pswHeightMap[_pixBufferWidth*0+0] + ((pixU+0)<<(DISTORSION+1+1));
+        slV_00 = pswHeightMap[_pixBufferWidth*1+0] - pswHeightMap[_pixBufferWidth*0+0] + ((pixV+0)<<(DISTORSION+1+1));
+        slU_01 = pswHeightMap[_pixBufferWidth*0+2] - pswHeightMap[_pixBufferWidth*0+1] + ((pixU+1)<<(DISTORSION+1+1));
+        slV_01 = pswHeightMap[_pixBufferWidth*1+1] - pswHeightMap[_pixBufferWidth*0+1] + ((pixV+0)<<(DISTORSION+1+1));
+        slU_10 = pswHeightMap[_pixBufferWidth*1+1] - pswHeightMap[_pixBufferWidth*1+0] + ((pixU+0)<<(DISTORSION+1+1));
+        slV_10 = pswHeightMap[_pixBufferWidth*2+0] - pswHeightMap[_pixBufferWidth*1+0] + ((pixV+1)<<(DISTORSION+1+1));
+        slU_11 = pswHeightMap[_pixBufferWidth*1+2] - pswHeightMap[_pixBufferWidth*1+1] + ((pixU+1)<<(DISTORSION+1+1));
+        slV_11 = pswHeightMap[_pixBufferWidth*2+1] - pswHeightMap[_pixBufferWidth*1+1] + ((pixV+1)<<(DISTORSION+1+1));
+
+        pulTexture[_pixTexWidth*0+0] = PIXEL( (slU_00                     ) >>(DISTORSION+1  ), (slV_00                     ) >>(DISTORSION+1  ) );
+        pulTexture[_pixTexWidth*0+1] = PIXEL( (slU_00+slU_01              ) >>(DISTORSION+1+1), (slV_00+slV_01              ) >>(DISTORSION+1+1) );
+        pulTexture[_pixTexWidth*1+0] = PIXEL( (slU_00       +slU_10       ) >>(DISTORSION+1+1), (slV_00       +slV_10       ) >>(DISTORSION+1+1) );
+        pulTexture[_pixTexWidth*1+1] = PIXEL( (slU_00+slU_01+slU_10+slU_11) >>(DISTORSION+1+2), (slV_00+slV_01+slV_10+slV_11) >>(DISTORSION+1+2) );
+
+        // advance to next texel
+        pulTexture+=2;
+        pswHeightMap++;
+      }
+    }
+  }
+  else
+  { // BILINEAR SUPER-SAMPLING 4
+    SLONG slU_00, slU_01, slU_10, slU_11;
+    SLONG slV_00, slV_01, slV_10, slV_11;
+    // (height map is not advanced here, same as it always was)
+    const SWORD *pswHeightMap = rwj_pswHeightMap;
+    for( PIX pixV=iFirst; pixV<iLast; pixV++)
+    { // row loop
+      ULONG *pulTexture = rwj_pulTexture + pixV*_pixTexWidth*4;
+      for( PIX pixU=0; pixU<_pixBufferWidth; pixU++)
+      { // texel loop
+        slU_00 = pswHeightMap[_pixBufferWidth*0+1] - pswHeightMap[_pixBufferWidth*0+0] + ((pixU+0)<<(DISTORSION+2));
+        slV_00 = pswHeightMap[_pixBufferWidth*1+0] - pswHeightMap[_pixBufferWidth*0+0] + ((pixV+0)<<(DISTORSION+2));
+        slU_01 = pswHeightMap[_pixBufferWidth*0+2] - pswHeightMap[_pixBufferWidth*0+1] + ((pixU+1)<<(DISTORSION+2));
+        slV_01 = pswHeightMap[_pixBufferWidth*1+1] - pswHeightMap[_pixBufferWidth*0+1] + ((pixV+0)<<(DISTORSION+2));
+        slU_10 = pswHeightMap[_pixBufferWidth*1+1] - pswHeightMap[_pixBufferWidth*1+0] + ((pixU+0)<<(DISTORSION+2));
+        slV_10 = pswHeightMap[_pixBufferWidth*2+0] - pswHeightMap[_pixBufferWidth*1+0] + ((pixV+1)<<(DISTORSION+2));
+        slU_11 = pswHeightMap[_pixBufferWidth*1+2] - pswHeightMap[_pixBufferWidth*1+1] + ((pixU+1)<<(DISTORSION+2));
+        slV_11 = pswHeightMap[_pixBufferWidth*2+1] - pswHeightMap[_pixBufferWidth*1+1] + ((pixV+1)<<(DISTORSION+2));
+
+        pulTexture[_pixTexWidth*0+0] = PIXEL( (slU_00                                 ) >>(DISTORSION  ), (slV_00                                 ) >>(DISTORSION  ) );
+        pulTexture[_pixTexWidth*0+1] = PIXEL( (slU_00* 3+slU_01* 1                    ) >>(DISTORSION+2), (slV_00* 3+slV_01* 1                    ) >>(DISTORSION+2) );
+        pulTexture[_pixTexWidth*0+2] = PIXEL( (slU_00   +slU_01                       ) >>(DISTORSION+1), (slV_00   +slV_01                       ) >>(DISTORSION+1) );
+        pulTexture[_pixTexWidth*0+3] = PIXEL( (slU_00* 1+slU_01* 3                    ) >>(DISTORSION+2), (slV_00* 1+slV_01* 3                    ) >>(DISTORSION+2) );
+
+        pulTexture[_pixTexWidth*1+0] = PIXEL( (slU_00* 3          +slU_10* 1          ) >>(DISTORSION+2), (slV_00* 3          +slV_10             ) >>(DISTORSION+2) );
+        pulTexture[_pixTexWidth*1+1] = PIXEL( (slU_00* 9+slU_01* 3+slU_10* 3+slU_11* 1) >>(DISTORSION+4), (slV_00* 9+slV_01* 3+slV_10* 3+slV_11* 1) >>(DISTORSION+4) );
+        pulTexture[_pixTexWidth*1+2] = PIXEL( (slU_00* 3+slU_01* 3+slU_10* 1+slU_11* 1) >>(DISTORSION+3), (slV_00* 3+slV_01* 3+slV_10* 1+slV_11* 1) >>(DISTORSION+3) );
+        pulTexture[_pixTexWidth*1+3] = PIXEL( (slU_00* 3+slU_01* 9+slU_10* 1+slU_11* 3) >>(DISTORSION+4), (slV_00* 3+slV_01* 9+slV_10* 1+slV_11* 3) >>(DISTORSION+4) );
+
+        pulTexture[_pixTexWidth*2+0] = PIXEL( (slU_00             +slU_10             ) >>(DISTORSION+1), (slV_00             +slV_10             ) >>(DISTORSION+1) );
+        pulTexture[_pixTexWidth*2+1] = PIXEL( (slU_00* 3+slU_01* 1+slU_10* 3+slU_11* 1) >>(DISTORSION+3), (slV_00* 3+slV_01* 1+slV_10* 3+slV_11* 1) >>(DISTORSION+3) );
+        pulTexture[_pixTexWidth*2+2] = PIXEL( (slU_00   +slU_01   +slU_10   +slU_11   ) >>(DISTORSION+2), (slV_00   +slV_01   +slV_10   +slV_11   ) >>(DISTORSION+2) );
+        pulTexture[_pixTexWidth*2+3] = PIXEL( (slU_00* 1+slU_01* 3+slU_10* 1+slU_11* 3) >>(DISTORSION+3), (slV_00* 1+slV_01* 3+slV_10* 1+slV_11* 3) >>(DISTORSION+3) );
+
+        pulTexture[_pixTexWidth*3+0] = PIXEL( (slU_00* 1          +slU_10* 3          ) >>(DISTORSION+2), (slV_00* 1          +slV_10* 3          ) >>(DISTORSION+2) );
+        pulTexture[_pixTexWidth*3+1] = PIXEL( (slU_00* 3+slU_01* 1+slU_10* 9+slU_11* 3) >>(DISTORSION+4), (slV_00* 3+slV_01* 1+slV_10* 9+slV_11* 3) >>(DISTORSION+4) );
+        pulTexture[_pixTexWidth*3+2] = PIXEL( (slU_00* 1+slU_01* 1+slU_10* 3+slU_11* 3) >>(DISTORSION+3), (slV_00* 1+slV_01* 1+slV_10* 3+slV_11* 3) >>(DISTORSION+3) );
+        pulTexture[_pixTexWidth*3+3] = PIXEL( (slU_00* 1+slU_01* 3+slU_10* 3+slU_11* 9) >>(DISTORSION+4), (slV_00* 1+slV_01* 3+slV_10* 3+slV_11* 9) >>(DISTORSION+4) );
+        // advance to next texel
+        pulTexture+=4;
+      }
+    }
+  }
+}
+
+
 #pragma warning(disable: 4731)
 static void RenderWater(void)
 {
@@ -1232,6 +1453,12 @@ static void RenderWater(void)
   memcpy( (void*)(pswHeightMap+(_pixBufferHeight*_pixBufferWidth)), (void*)pswHeightMap,
           _pixBufferWidth*sizeof(SWORD)*2);
 
+  CRenderWaterJob rwj;
+  rwj.rwj_pulTexture     = pulTexture;
+  rwj.rwj_pulTextureBase = pulTextureBase;
+  rwj.rwj_pixBaseWidth   = pixBaseWidth;
+  rwj.rwj_pswHeightMap   = pswHeightMap;
+
   // execute corresponding displace routine
   if( _pixBufferWidth >= _pixTexWidth)
   { // SUB-SAMPLING
@@ -1311,25 +1538,13 @@ pixLoop:
 
 #else
 
-    PIX pixPos, pixDU, pixDV;
     slHeightMapStep  = _pixBufferWidth/pixBaseWidth;
     slHeightRowStep  = (slHeightMapStep-1)*_pixBufferWidth;
     mmShift = DISTORSION+ FastLog2(slHeightMapStep) +2;
-    for( PIX pixV=0; pixV<_pixTexHeight; pixV++)
-    { // row loop
-      for( PIX pixU=0; pixU<_pixTexWidth; pixU++)
-      { // texel loop
-        pixPos =  pswHeightMap[0];
-        pixDU  = (pswHeightMap[1]               - pixPos) >>(SLONG&)mmShift;
-        pixDV  = (pswHeightMap[_pixBufferWidth] - pixPos) >>(SLONG&)mmShift;
-        pixDU  = (pixU +pixDU) & (SLONG&)mmBaseWidthMask;
-        pixDV  = (pixV +pixDV) & (SLONG&)mmBaseHeightMask;
-        *pulTexture++ = pulTextureBase[pixDV*pixBaseWidth + pixDU];
-        // advance to next texel in height map
-        pswHeightMap += slHeightMapStep;
-      }
-      pswHeightMap += slHeightRowStep;
-    }
+    rwj.rwj_iMode = 0;
+    rwj.rwj_slHeightMapStep = slHeightMapStep;
+    rwj.rwj_slHeightRowStep = slHeightRowStep;
+    RunEffectRows( rwj, _pixTexHeight, _pixTexWidth);
 
 #endif
 
@@ -1472,32 +1687,8 @@ pixLoop2:
 
 #else
 
-    SLONG slU_00, slU_01, slU_10, slU_11;
-    SLONG slV_00, slV_01, slV_10, slV_11;
-    for( PIX pixV=0; pixV<_pixBufferHeight; pixV++)
-    { // row loop
-      for( PIX pixU=0; pixU<_pixBufferWidth; pixU++)
-      { // texel loop
-        slU_00 = pswHeightMap[_pixBufferWidth*0+1] - pswHeightMap[_pixBufferWidth*0+0] + ((pixU+0)<<(DISTORSION+1+1));
-        slV_00 = pswHeightMap[_pixBufferWidth*1+0] - pswHeightMap[_pixBufferWidth*0+0] + ((pixV+0)<<(DISTORSION+1+1));
-        slU_01 = pswHeightMap[_pixBufferWidth*0+2] - pswHeightMap[_pixBufferWidth*0+1] + ((pixU+1)<<(DISTORSION+1+1));
-        slV_01 = pswHeightMap[_pixBufferWidth*1+1] - pswHeightMap[_pixBufferWidth*0+1] + ((pixV+0)<<(DISTORSION+1+1));
-        slU_10 = pswHeightMap[_pixBufferWidth*1+1] - pswHeightMap[_pixBufferWidth*1+0] + ((pixU+0)<<(DISTORSION+1+1));
-        slV_10 = pswHeightMap[_pixBufferWidth*2+0] - pswHeightMap[_pixBufferWidth*1+0] + ((pixV+1)<<(DISTORSION+1+1));
-        slU_11 = pswHeightMap[_pixBufferWidth*1+2] - pswHeightMap[_pixBufferWidth*1+1] + ((pixU+1)<<(DISTORSION+1+1));
-        slV_11 = pswHeightMap[_pixBufferWidth*2+1] - pswHeightMap[_pixBufferWidth*1+1] + ((pixV+1)<<(DISTORSION+1+1));
-
-        pulTexture[_pixTexWidth*0+0] = PIXEL( (slU_00                     ) >>(DISTORSION+1  ), (slV_00                     ) >>(DISTORSION+1  ) );
-        pulTexture[_pixTexWidth*0+1] = PIXEL( (slU_00+slU_01              ) >>(DISTORSION+1+1), (slV_00+slV_01              ) >>(DISTORSION+1+1) );
-        pulTexture[_pixTexWidth*1+0] = PIXEL( (slU_00       +slU_10       ) >>(DISTORSION+1+1), (slV_00       +slV_10       ) >>(DISTORSION+1+1) );
-        pulTexture[_pixTexWidth*1+1] = PIXEL( (slU_00+slU_01+slU_10+slU_11) >>(DISTORSION+1+2), (slV_00+slV_01+slV_10+slV_11) >>(DISTORSION+1+2) );
-
-        // advance to next texel
-        pulTexture+=2;
-        pswHeightMap++;
-      }
-      pulTexture+=_pixTexWidth;
-    }
+    rwj.rwj_iMode = 1;
+    RunEffectRows( rwj, _pixBufferHeight, _pixTexWidth*2);
 
 #endif
 
@@ -1842,48 +2033,9 @@ pixLoop4:
 
 #else
 
-    SLONG slU_00, slU_01, slU_10, slU_11;
-    SLONG slV_00, slV_01, slV_10, slV_11;
     mmBaseWidthShift = FastLog2( pixBaseWidth);        // faster multiplying with shift
-    for( PIX pixV=0; pixV<_pixBufferHeight; pixV++)
-    { // row loop
-      for( PIX pixU=0; pixU<_pixBufferWidth; pixU++)
-      { // texel loop
-        slU_00 = pswHeightMap[_pixBufferWidth*0+1] - pswHeightMap[_pixBufferWidth*0+0] + ((pixU+0)<<(DISTORSION+2));
-        slV_00 = pswHeightMap[_pixBufferWidth*1+0] - pswHeightMap[_pixBufferWidth*0+0] + ((pixV+0)<<(DISTORSION+2));
-        slU_01 = pswHeightMap[_pixBufferWidth*0+2] - pswHeightMap[_pixBufferWidth*0+1] + ((pixU+1)<<(DISTORSION+2));
-        slV_01 = pswHeightMap[_pixBufferWidth*1+1] - pswHeightMap[_pixBufferWidth*0+1] + ((pixV+0)<<(DISTORSION+2));
-        slU_10 = pswHeightMap[_pixBufferWidth*1+1] - pswHeightMap[_pixBufferWidth*1+0] + ((pixU+0)<<(DISTORSION+2));
-        slV_10 = pswHeightMap[_pixBufferWidth*2+0] - pswHeightMap[_pixBufferWidth*1+0] + ((pixV+1)<<(DISTORSION+2));
-        slU_11 = pswHeightMap[_pixBufferWidth*1+2] - pswHeightMap[_pixBufferWidth*1+1] + ((pixU+1)<<(DISTORSION+2));
-        slV_11 = pswHeightMap[_pixBufferWidth*2+1] - pswHeightMap[_pixBufferWidth*1+1] + ((pixV+1)<<(DISTORSION+2));
-
-        pulTexture[_pixTexWidth*0+0] = PIXEL( (slU_00                                 ) >>(DISTORSION  ), (slV_00                                 ) >>(DISTORSION  ) );
-        pulTexture[_pixTexWidth*0+1] = PIXEL( (slU_00* 3+slU_01* 1                    ) >>(DISTORSION+2), (slV_00* 3+slV_01* 1                    ) >>(DISTORSION+2) );
-        pulTexture[_pixTexWidth*0+2] = PIXEL( (slU_00   +slU_01                       ) >>(DISTORSION+1), (slV_00   +slV_01                       ) >>(DISTORSION+1) );
-        pulTexture[_pixTexWidth*0+3] = PIXEL( (slU_00* 1+slU_01* 3                    ) >>(DISTORSION+2), (slV_00* 1+slV_01* 3                    ) >>(DISTORSION+2) );
-
-        pulTexture[_pixTexWidth*1+0] = PIXEL( (slU_00* 3          +slU_10* 1          ) >>(DISTORSION+2), (slV_00* 3          +slV_10             ) >>(DISTORSION+2) );
-        pulTexture[_pixTexWidth*1+1] = PIXEL( (slU_00* 9+slU_01* 3+slU_10* 3+slU_11* 1) >>(DISTORSION+4), (slV_00* 9+slV_01* 3+slV_10* 3+slV_11* 1) >>(DISTORSION+4) );
-        pulTexture[_pixTexWidth*1+2] = PIXEL( (slU_00* 3+slU_01* 3+slU_10* 1+slU_11* 1) >>(DISTORSION+3), (slV_00* 3+slV_01* 3+slV_10* 1+slV_11* 1) >>(DISTORSION+3) );
-        pulTexture[_pixTexWidth*1+3] = PIXEL( (slU_00* 3+slU_01* 9+slU_10* 1+slU_11* 3) >>(DISTORSION+4), (slV_00* 3+slV_01* 9+slV_10* 1+slV_11* 3) >>(DISTORSION+4) );
-
-        pulTexture[_pixTexWidth*2+0] = PIXEL( (slU_00             +slU_10             ) >>(DISTORSION+1), (slV_00             +slV_10             ) >>(DISTORSION+1) );
-        pulTexture[_pixTexWidth*2+1] = PIXEL( (slU_00* 3+slU_01* 1+slU_10* 3+slU_11* 1) >>(DISTORSION+3), (slV_00* 3+slV_01* 1+slV_10* 3+slV_11* 1) >>(DISTORSION+3) );
-        pulTexture[_pixTexWidth*2+2] = PIXEL( (slU_00   +slU_01   +slU_10   +slU_11   ) >>(DISTORSION+2), (slV_00   +slV_01   +slV_10   +slV_11   ) >>(DISTORSION+2) );
-        pulTexture[_pixTexWidth*2+3] = PIXEL( (slU_00* 1+slU_01* 3+slU_10* 1+slU_11* 3) >>(DISTORSION+3), (slV_00* 1+slV_01* 3+slV_10* 1+slV_11* 3) >>(DISTORSION+3) );
-
-        pulTexture[_pixTexWidth*3+0] = PIXEL( (slU_00* 1          +slU_10* 3          ) >>(DISTORSION+2), (slV_00* 1          +slV_10* 3          ) >>(DISTORSION+2) );
-        pulTexture[_pixTexWidth*3+1] = PIXEL( (slU_00* 3+slU_01* 1+slU_10* 9+slU_11* 3) >>(DISTORSION+4), (slV_00* 3+slV_01* 1+slV_10* 9+slV_11* 3) >>(DISTORSION+4) );
-        pulTexture[_pixTexWidth*3+2] = PIXEL( (slU_00* 1+slU_01* 1+slU_10* 3+slU_11* 3) >>(DISTORSION+3), (slV_00* 1+slV_01* 1+slV_10* 3+slV_11* 3) >>(DISTORSION+3) );
-        pulTexture[_pixTexWidth*3+3] = PIXEL( (slU_00* 1+slU_01* 3+slU_10* 3+slU_11* 9) >>(DISTORSION+4), (slV_00* 1+slV_01* 3+slV_10* 3+slV_11* 9) >>(DISTORSION+4) );
-
-        // advance to next texel
-        pulTexture+=4;
-//        pHeightMap++;//WTF?
-      }
-      pulTexture+=_pixTexWidth*3;
-    }
+    rwj.rwj_iMode = 2;
+    RunEffectRows( rwj, _pixBufferHeight, _pixTexWidth*4);
 
 #endif
 
@@ -1915,6 +2067,90 @@ enum PlasmaType {
   ptDownTile
 };
 
+// move plasma in texels [pixFirst,pixLast) of heat map (result is stored pixDest texels away)
+static void MovePlasma( UBYTE *pNew, const UBYTE *pOld, PIX pixFirst, PIX pixLast, PIX pixDest, SLONG slDensity)
+{
+  const PIX pixRow = _pixBufferWidth;
+  PIX pixOffset = pixFirst;
+  if( !_bScalarEffects) {
+#if EFFECT_NEON
+    // 16 texels at once in 16 bits
+    const int8x16_t sbShift = vdupq_n_s8(-slDensity);
+    for( ; pixOffset+16<=pixLast; pixOffset+=16) {
+      const uint8x16_t ubAbove = vld1q_u8( pOld+pixOffset-pixRow);
+      const uint8x16_t ubBelow = vld1q_u8( pOld+pixOffset+pixRow);
+      const uint8x16_t ubLeft  = vld1q_u8( pOld+pixOffset-1);
+      const uint8x16_t ubRight = vld1q_u8( pOld+pixOffset+1);
+      const uint8x16_t ubOld   = vld1q_u8( pOld+pixOffset);
+      uint16x8_t uwLo = vaddq_u16( vaddl_u8( vget_low_u8(ubAbove),  vget_low_u8(ubBelow)),
+                                   vaddl_u8( vget_low_u8(ubLeft),   vget_low_u8(ubRight)));
+      uint16x8_t uwHi = vaddq_u16( vaddl_u8( vget_high_u8(ubAbove), vget_high_u8(ubBelow)),
+                                   vaddl_u8( vget_high_u8(ubLeft),  vget_high_u8(ubRight)));
+      uwLo = vshrq_n_u16( vaddw_u8( vshrq_n_u16( uwLo, 2), vget_low_u8(ubOld)),  1);
+      uwHi = vshrq_n_u16( vaddw_u8( vshrq_n_u16( uwHi, 2), vget_high_u8(ubOld)), 1);
+      const uint8x16_t ubNew = vcombine_u8( vmovn_u16(uwLo), vmovn_u16(uwHi));
+      vst1q_u8( pNew+pixOffset+pixDest, vsubq_u8( ubNew, vshlq_u8( ubNew, sbShift)));
+    }
+#elif EFFECT_SSE2
+    // 16 texels at once in 16 bits
+    const __m128i mZero  = _mm_setzero_si128();
+    const __m128i mShift = _mm_cvtsi32_si128(slDensity);
+    for( ; pixOffset+16<=pixLast; pixOffset+=16) {
+      const __m128i ubAbove = _mm_loadu_si128( (const __m128i*)(pOld+pixOffset-pixRow));
+      const __m128i ubBelow = _mm_loadu_si128( (const __m128i*)(pOld+pixOffset+pixRow));
+      const __m128i ubLeft  = _mm_loadu_si128( (const __m128i*)(pOld+pixOffset-1));
+      const __m128i ubRight = _mm_loadu_si128( (const __m128i*)(pOld+pixOffset+1));
+      const __m128i ubOld   = _mm_loadu_si128( (const __m128i*)(pOld+pixOffset));
+      __m128i uwLo = _mm_add_epi16( _mm_add_epi16( _mm_unpacklo_epi8(ubAbove,mZero), _mm_unpacklo_epi8(ubBelow,mZero)),
+                                    _mm_add_epi16( _mm_unpacklo_epi8(ubLeft, mZero), _mm_unpacklo_epi8(ubRight,mZero)));
+      __m128i uwHi = _mm_add_epi16( _mm_add_epi16( _mm_unpackhi_epi8(ubAbove,mZero), _mm_unpackhi_epi8(ubBelow,mZero)),
+                                    _mm_add_epi16( _mm_unpackhi_epi8(ubLeft, mZero), _mm_unpackhi_epi8(ubRight,mZero)));
+      uwLo = _mm_srli_epi16( _mm_add_epi16( _mm_srli_epi16( uwLo, 2), _mm_unpacklo_epi8(ubOld,mZero)), 1);
+      uwHi = _mm_srli_epi16( _mm_add_epi16( _mm_srli_epi16( uwHi, 2), _mm_unpackhi_epi8(ubOld,mZero)), 1);
+      uwLo = _mm_sub_epi16( uwLo, _mm_srl_epi16( uwLo, mShift));
+      uwHi = _mm_sub_epi16( uwHi, _mm_srl_epi16( uwHi, mShift));
+      _mm_storeu_si128( (__m128i*)(pNew+pixOffset+pixDest), _mm_packus_epi16( uwLo, uwHi));
+    }
+#endif
+  }
+  // remaining texels
+  for( ; pixOffset<pixLast; pixOffset++) {
+    const ULONG ulNew = ((((ULONG)pOld[pixOffset - pixRow] +
+                           (ULONG)pOld[pixOffset + pixRow] +
+                           (ULONG)pOld[pixOffset - 1] +
+                           (ULONG)pOld[pixOffset + 1]
+                          )>>2) +
+                           (ULONG)pOld[pixOffset]
+                        )>>1;
+    pNew[pixOffset+pixDest] = ulNew - (ulNew >> slDensity);
+  }
+}
+
+// moves inner rows of plasma on worker threads
+class CMovePlasmaJob : public CWorkerJob {
+public:
+  UBYTE *mpj_pNew;
+  const UBYTE *mpj_pOld;
+  PIX   mpj_pixDest;
+  SLONG mpj_slDensity;
+  void ProcessRange( INDEX iFirst, INDEX iLast)
+  { // rows are counted from the 2nd one
+    MovePlasma( mpj_pNew, mpj_pOld, (iFirst+1)*_pixBufferWidth, (iLast+1)*_pixBufferWidth, mpj_pixDest, mpj_slDensity);
+  }
+};
+
+// move all plasma except 1 pixel border
+static void MovePlasmaInner( UBYTE *pNew, const UBYTE *pOld, PIX pixDest, SLONG slDensity)
+{
+  CMovePlasmaJob mpj;
+  mpj.mpj_pNew = pNew;
+  mpj.mpj_pOld = pOld;
+  mpj.mpj_pixDest = pixDest;
+  mpj.mpj_slDensity = slDensity;
+  RunEffectRows( mpj, _pixBufferHeight-2, _pixBufferWidth);
+}
+
+
 /*******************************
        Plasma Animation
 ********************************/
@@ -1927,7 +2163,7 @@ static void AnimatePlasma( SLONG slDensity, PlasmaType eType)
   UBYTE *pNew = (UBYTE*)_ptdEffect->td_pubBuffer1;
   UBYTE *pOld = (UBYTE*)_ptdEffect->td_pubBuffer2;
 
-  PIX pixV, pixU;
+  PIX pixU;
   PIX pixOffset;
   SLONG slLineAbove, slLineBelow, slLineLeft, slLineRight;
   ULONG ulNew;
@@ -1937,20 +2173,7 @@ static void AnimatePlasma( SLONG slDensity, PlasmaType eType)
   // --------------------------
   if (eType == ptNormal) {
     // inner rectangle (without 1 pixel border)
-    pixOffset = _pixBufferWidth;
-    for( pixV=1; pixV<_pixBufferHeight-1; pixV++) {
-      for( pixU=0; pixU<_pixBufferWidth; pixU++) {
-        ulNew = ((((ULONG)pOld[pixOffset - _pixBufferWidth] +
-                   (ULONG)pOld[pixOffset + _pixBufferWidth] +
-                   (ULONG)pOld[pixOffset - 1] +
-                   (ULONG)pOld[pixOffset + 1]
-                  )>>2) +
-                   (ULONG)pOld[pixOffset]
-                )>>1;
-        pNew[pixOffset] = ulNew - (ulNew >> slDensity);
-        pixOffset++;
-      }
-    }
+    MovePlasmaInner( pNew, pOld, 0, slDensity);
     // upper horizontal border (without corners)
     slLineAbove = ((_pixBufferHeight-1)*_pixBufferWidth) + 1;
     slLineBelow = _pixBufferWidth + 1;
@@ -2036,20 +2259,7 @@ static void AnimatePlasma( SLONG slDensity, PlasmaType eType)
   // --------------------------
   } else if (eType==ptUp || eType==ptUpTile) {
     // inner rectangle (without 1 pixel border)
-    pixOffset = _pixBufferWidth;
-    for( pixV=1; pixV<_pixBufferHeight-1; pixV++) {
-      for( pixU=0; pixU<_pixBufferWidth; pixU++) {
-        ulNew = ((((ULONG)pOld[pixOffset - _pixBufferWidth] +
-                   (ULONG)pOld[pixOffset + _pixBufferWidth] +
-                   (ULONG)pOld[pixOffset - 1] +
-                   (ULONG)pOld[pixOffset + 1]
-                  )>>2) +
-                   (ULONG)pOld[pixOffset]
-                )>>1;
-        pNew[pixOffset-_pixBufferWidth] = ulNew - (ulNew >> slDensity);
-        pixOffset++;
-      }
-    }
+    MovePlasmaInner( pNew, pOld, -_pixBufferWidth, slDensity);
     // tile
     if (eType==ptUpTile) {
       // upper horizontal border (without corners)
@@ -2138,20 +2348,7 @@ static void AnimatePlasma( SLONG slDensity, PlasmaType eType)
   // --------------------------
   } else if (eType==ptDown || eType==ptDownTile) {
     // inner rectangle (without 1 pixel border)
-    pixOffset = _pixBufferWidth;
-    for( pixV=1; pixV<_pixBufferHeight-1; pixV++) {
-      for( pixU=0; pixU<_pixBufferWidth; pixU++) {
-        ulNew = ((((ULONG)pOld[pixOffset - _pixBufferWidth] +
-                   (ULONG)pOld[pixOffset + _pixBufferWidth] +
-                   (ULONG)pOld[pixOffset - 1] +
-                   (ULONG)pOld[pixOffset + 1]
-                  )>>2) +
-                   (ULONG)pOld[pixOffset]
-                )>>1;
-        pNew[pixOffset+_pixBufferWidth] = ulNew - (ulNew >> slDensity);
-        pixOffset++;
-      }
-    }
+    MovePlasmaInner( pNew, pOld, +_pixBufferWidth, slDensity);
     // tile
     if (eType==ptDownTile) {
       // upper horizontal border (without corners)
@@ -2252,6 +2449,7 @@ static void AnimateFire( SLONG slDensity)
 /////////////////////////////////// move fire
 
   // use only one buffer (otherwise it's not working)
+  // (this has to be done in order - randomizer and diffusion depend on texels done before)
   UBYTE *pubNew = (UBYTE*)_ptdEffect->td_pubBuffer2;
   SLONG slBufferMask   = _pixBufferWidth*_pixBufferHeight -1;
   SLONG slColumnModulo = _pixBufferWidth*(_pixBufferHeight-2) -1;
@@ -2336,6 +2534,29 @@ pixDone:
 
 //////////////////////////// displace texture
 
+// colorizes rows of plasma or fire texture on worker threads
+class CRenderPlasmaFireJob : public CWorkerJob {
+public:
+  ULONG *rpfj_pulTexture;
+  const ULONG *rpfj_pulTextureBase;
+  const UBYTE *rpfj_pubHeat;
+  SLONG rpfj_slHeatMapStep, rpfj_slHeatRowStep, rpfj_slBaseMipShift;
+  void ProcessRange( INDEX iFirst, INDEX iLast)
+  {
+    INDEX iPalette;
+    for( INDEX pixV=iFirst; pixV<iLast; pixV++) {
+      ULONG *pulTexture = rpfj_pulTexture + pixV*_pixTexWidth;
+      const UBYTE *pubHeat = rpfj_pubHeat + pixV*(_pixTexWidth*rpfj_slHeatMapStep + rpfj_slHeatRowStep);
+      // for every pixel in horizontal line
+      for( INDEX pixU=0; pixU<_pixTexWidth; pixU++) {
+        iPalette = (*pubHeat)>>rpfj_slBaseMipShift;
+        *pulTexture++ = rpfj_pulTextureBase[iPalette];
+        pubHeat += rpfj_slHeatMapStep;
+      }
+    }
+  }
+};
+
 static void RenderPlasmaFire(void)
 {
 //  _sfStats.StartTimer(CStatForm::STI_EFFECTRENDER);
@@ -2383,16 +2604,14 @@ pixLoopF:
 
 #else
 
-  INDEX iPalette;
-  for( INDEX pixV=0; pixV<_pixTexHeight; pixV++) {
-    // for every pixel in horizontal line
-    for( INDEX pixU=0; pixU<_pixTexWidth; pixU++) {
-      iPalette = (*pubHeat)>>slBaseMipShift;
-      *pulTexture++ = pulTextureBase[iPalette];
-      pubHeat += slHeatMapStep;
-    }
-    pubHeat += slHeatRowStep;
-  }
+  CRenderPlasmaFireJob rpfj;
+  rpfj.rpfj_pulTexture     = pulTexture;
+  rpfj.rpfj_pulTextureBase = pulTextureBase;
+  rpfj.rpfj_pubHeat        = pubHeat;
+  rpfj.rpfj_slHeatMapStep  = slHeatMapStep;
+  rpfj.rpfj_slHeatRowStep  = slHeatRowStep;
+  rpfj.rpfj_slBaseMipShift = slBaseMipShift;
+  RunEffectRows( rpfj, _pixTexHeight, _pixTexWidth);
 
 #endif
 
@@ -2689,3 +2908,134 @@ DOUBLE CTextureEffectGlobal::GetRenderingTime(void)
 }
 
 
+
+// compare optimized effect routines with reference ones
+void TextureEffectsBenchmark(void *pArgs)
+{
+  INDEX ctFrames = NEXTARGUMENT(INDEX);
+  if( ctFrames<=0) ctFrames = 100;
+  if( !bTableSet) {
+    for( INDEX i=0; i<256; i++) asbMod3Sub1Table[i]=(SBYTE)((i%3)-1);
+    bTableSet = TRUE;
+  }
+  // effect cases (water render mode is determined by texture and buffer sizes)
+  struct EffectCase {
+    const char *ec_strName;
+    BOOL ec_bWater;
+    void (*ec_pAnimate)(void);
+    PIX ec_pixBuffer, ec_pixTexture;
+  } aecCases[] = {
+    { "Water sub-sampled",  TRUE,  AWaterMedium,    64,  64 },
+    { "Water 2x",           TRUE,  AWaterMedium,    64, 128 },
+    { "Water 4x",           TRUE,  AWaterFast,      64, 256 },
+    { "Plasma",             FALSE, APlasma,        256, 256 },
+    { "Plasma up tile",     FALSE, APlasmaUpTile,  256, 256 },
+    { "Plasma down tile",   FALSE, APlasmaDownTile,256, 256 },
+    { "Fire",               FALSE, AFire,          256, 256 },
+  };
+  const INDEX ctCases = sizeof(aecCases)/sizeof(aecCases[0]);
+  const INDEX iOldMultiThreaded = tex_bMultiThreadedEffects;
+
+  CPrintF( TRANS("Texture effects benchmark (%d frames, %d threads, %s):\n"), ctFrames,
+           _pWorkerPool->GetThreadsCount(), EFFECT_NEON ? "NEON" : (EFFECT_SSE2 ? "SSE2" : "no SIMD"));
+  for( INDEX iCase=0; iCase<ctCases; iCase++) {
+    const EffectCase &ec = aecCases[iCase];
+    const PIX pixBuffer = ec.ec_pixBuffer;
+    const PIX pixTexture = ec.ec_pixTexture;
+    const SLONG slBufferSize = pixBuffer*(pixBuffer+2)*sizeof(SWORD);
+    const SLONG slTextureSize = pixTexture*pixTexture*sizeof(ULONG);
+
+    // base texture (or palette for plasma & fire) and effect texture
+    CTextureData tdBase, tdEffect;
+    tdBase.td_mexWidth  = ec.ec_bWater ? pixTexture : 256;
+    tdBase.td_mexHeight = ec.ec_bWater ? pixTexture : 1;
+    tdBase.td_pulFrames = (ULONG*)AllocMemory( tdBase.td_mexWidth*tdBase.td_mexHeight*sizeof(ULONG));
+    tdEffect.td_mexWidth  = pixTexture;
+    tdEffect.td_mexHeight = pixTexture;
+    tdEffect.td_pixBufferWidth  = pixBuffer;
+    tdEffect.td_pixBufferHeight = pixBuffer;
+    UBYTE *apubBuffers[2], *apubStart[2];
+    for( INDEX i=0; i<2; i++) {
+      apubBuffers[i] = (UBYTE*)AllocMemory( slBufferSize);
+      apubStart[i]   = (UBYTE*)AllocMemory( slBufferSize);
+    }
+    ULONG *apulResults[3];
+    UBYTE *apubResults[3];
+    for( INDEX i=0; i<3; i++) {
+      apulResults[i] = (ULONG*)AllocMemory( slTextureSize);
+      apubResults[i] = (UBYTE*)AllocMemory( slBufferSize*2);
+    }
+    ULONG ulSeed = 0x12345678;
+    for( INDEX i=0; i<tdBase.td_mexWidth*tdBase.td_mexHeight; i++) {
+      ulSeed = ulSeed*1103515245+12345;
+      tdBase.td_pulFrames[i] = ulSeed;
+    }
+    for( INDEX i=0; i<2; i++) {
+      for( SLONG sl=0; sl<slBufferSize; sl++) {
+        ulSeed = ulSeed*1103515245+12345;
+        // water heights have to be moderate
+        apubStart[i][sl] = (ec.ec_bWater && (sl&1)) ? (UBYTE)((ulSeed>>16)&3) : (UBYTE)(ulSeed>>16);
+      }
+    }
+
+    // 0=reference, 1=SIMD, 2=SIMD on all threads
+    DOUBLE adMs[3];
+    for( INDEX iMode=0; iMode<3; iMode++) {
+      _bScalarEffects = iMode==0;
+      tex_bMultiThreadedEffects = iMode==2;
+      tdEffect.td_pubBuffer1 = apubBuffers[0];
+      tdEffect.td_pubBuffer2 = apubBuffers[1];
+      tdEffect.td_pulFrames  = apulResults[iMode];
+      memcpy( apubBuffers[0], apubStart[0], slBufferSize);
+      memcpy( apubBuffers[1], apubStart[1], slBufferSize);
+      _ptdEffect = &tdEffect;
+      _ptdBase   = &tdBase;
+      _pixBufferWidth  = pixBuffer;
+      _pixBufferHeight = pixBuffer;
+      _ulBufferMask    = pixBuffer*pixBuffer-1;
+      _pixTexWidth  = pixTexture;
+      _pixTexHeight = pixTexture;
+      _iWantedMipLevel = 0;
+      Randomize( 0x87654321);
+
+      CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+      for( INDEX iFrame=0; iFrame<ctFrames; iFrame++) {
+        ec.ec_pAnimate();
+        if( ec.ec_bWater) RenderWater();
+        else RenderPlasmaFire();
+      }
+      CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+      adMs[iMode] = (tv1-tv0).GetSeconds()*1000.0;
+      memcpy( apubResults[iMode],              tdEffect.td_pubBuffer1, slBufferSize);
+      memcpy( apubResults[iMode]+slBufferSize, tdEffect.td_pubBuffer2, slBufferSize);
+    }
+    _bScalarEffects = FALSE;
+    tex_bMultiThreadedEffects = iOldMultiThreaded;
+
+    // results must be exactly the same
+    BOOL bMatch = TRUE;
+    for( INDEX iMode=1; iMode<3; iMode++) {
+      bMatch &= memcmp( apulResults[iMode], apulResults[0], slTextureSize)==0;
+      bMatch &= memcmp( apubResults[iMode], apubResults[0], slBufferSize*2)==0;
+    }
+    CPrintF( TRANS("  %-18s reference %7.2f ms, SIMD %7.2f ms, SIMD parallel %7.2f ms, %s\n"),
+             ec.ec_strName, adMs[0], adMs[1], adMs[2], bMatch ? TRANS("match") : TRANS("MISMATCH!"));
+
+    // texture data must not free what it doesn't own
+    FreeMemory( tdBase.td_pulFrames);
+    tdBase.td_pulFrames = NULL;
+    tdEffect.td_pulFrames  = NULL;
+    tdEffect.td_pubBuffer1 = NULL;
+    tdEffect.td_pubBuffer2 = NULL;
+    for( INDEX i=0; i<2; i++) {
+      FreeMemory( apubBuffers[i]);
+      FreeMemory( apubStart[i]);
+    }
+    for( INDEX i=0; i<3; i++) {
+      FreeMemory( apulResults[i]);
+      FreeMemory( apubResults[i]);
+    }
+  }
+  _ptdEffect = NULL;
+  _ptdBase   = NULL;
+}
@@ -661,6 +661,7 @@ ULONG CLayerMaker::MakeShadowMask(CBrushShadowLayer *pbsl)
   ConvertBytesToBits(lm_pubLayer, lm_pubLayer, lm_mmtLayer.mmt_slTotalSize);
   ShrinkMemory((void **)&lm_pubLayer, (lm_mmtLayer.mmt_slTotalSize+7)/8);
   pbsl->bsl_pubLayer = lm_pubLayer;
+  pbsl->bsl_pubMaskCRC = NULL;
 
   // update statistics
   _ctShadowLayers++;
@@ -857,6 +858,7 @@ BOOL CLayerMaker::CreateLayers(CBrushPolygon &bpo, CWorld &woWorld, BOOL bDoDire
       // free it
       if( bsl.bsl_pubLayer!=NULL) FreeMemory( bsl.bsl_pubLayer);
       bsl.bsl_pubLayer = NULL;
+      bsl.bsl_pubMaskCRC = NULL;
     }
     bCalculatedSome = TRUE;
   }
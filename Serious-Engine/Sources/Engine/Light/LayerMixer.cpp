@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Brushes/BrushTransformed.h>
 #include <Engine/Light/LightSource.h>
 #include <Engine/Light/Gradient.h>
+#include <Engine/Light/ShadowCache.h>
 #include <Engine/Base/ListIterator.inl>
 #include <Engine/Base/Statistics_Internal.h>
 #include <Engine/Graphics/Color.h>
@@ -32,6 +33,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <Engine/Templates/StaticArray.cpp>
 #include <Engine/Templates/DynamicArray.cpp>
+#include <Engine/Templates/StaticStackArray.cpp>
 #include <Engine/Base/LargeColor.h>
 #include <cstdint>
 
@@ -60,6 +62,10 @@ extern UWORD auw1oSqrt[SQRTTABLESIZE];
 CBrushShadowMap *g_pbsm;
 #endif
 
+// profiling is not thread safe, so mixing on worker threads is not profiled
+#define LM_STARTTIMER(iTimer) if( !lm_bAsync) _pfWorldEditingProfile.StartTimer(iTimer)
+#define LM_STOPTIMER(iTimer)  if( !lm_bAsync) _pfWorldEditingProfile.StopTimer(iTimer)
+
 // internal class for layer mixing
 class CLayerMixer
 {
@@ -67,6 +73,12 @@ public:
   CBrushShadowMap *lm_pbsmShadowMap;   // shadow map whose layers are mixed
   CBrushPolygon   *lm_pbpoPolygon;     // polygon of the shadow map
   BOOL lm_bDynamic;    // set while doing dynamic light mixing
+  BOOL lm_bAsync;      // set while mixing on a worker thread
+  ULONG *lm_pulTarget; // buffer to mix into instead of cached shadow map (for background mixing)
+  SLONG lm_slTargetSize;
+  BOOL lm_bAnimatingLights;  // set if any of mixed layers has animating light
+  const CShadowMixInputs *lm_psmi; // lights and polygon that layers are mixed with
+  CShadowMixInputs lm_smiTaken;    // inputs taken right away when mixing on main thread
 
   // dimensions of currently processed shadow map
   MEX   lm_mexOffsetU;   // offsets in mex
@@ -86,18 +98,31 @@ public:
   FLOAT3D lm_vStepU; // step between pixels in same row
   FLOAT3D lm_vStepV; // step between rows
   FLOAT3D lm_vLightDirection; // light direction for directional light sources
-  CLightSource *lm_plsLight;  // current light source
   // color components of current light
   COLOR lm_colLight;
   COLOR lm_colAmbient;
 
+  // variables for easier transfers (members, so several mixers can run in parallel)
+  const FLOAT3D *lm_vLight;
+  FLOAT lm_fMinLightDistance, lm_f1oFallOff;
+  INDEX lm_iPixCt, lm_iRowCt;
+  SLONG lm_slModulo;
+  ULONG lm_ulLightFlags, lm_ulPolyFlags;
+  SLONG lm_slL2Row, lm_slDDL2oDU, lm_slDDL2oDV, lm_slDDL2oDUoDV, lm_slDL2oDURow, lm_slDL2oDV;
+  SLONG lm_slLightMax, lm_slHotSpot, lm_slLightStep;
+  ULONG *lm_pulLayer;
+
   // constructor
   CLayerMixer( CBrushShadowMap *pbsm, INDEX iFirstMip, INDEX iLastMip, BOOL bDynamic);
+  // constructor for background mixing into a separate buffer (pulTarget=NULL to use cached shadow map)
+  CLayerMixer( ULONG *pulTarget, SLONG slTargetSize, const CShadowMixInputs &smi);
 
   // remember general data
   void CalculateData( CBrushShadowMap *pbsm, INDEX iMipmap);
   // mix one mip-map
   void MixOneMipmap( CBrushShadowMap *pbsm, INDEX iMipmap);
+  // filter and dither one mixed mip-map
+  void FilterOneMipmap(void);
   // mix dynamic lights
   void MixOneMipmapDynamic(CBrushShadowMap *pbsm, INDEX iMipmap);
 
@@ -109,16 +134,16 @@ public:
   void AddAmbientMaskPoint( UBYTE *pubMask, UBYTE ubMask);
   void AddDiffusionPoint(void);
   void AddDiffusionMaskPoint( UBYTE *pubMask, UBYTE ubMask);
-  BOOL PrepareOneLayerPoint( CBrushShadowLayer *pbsl, BOOL bNoMask);
-  void AddOneLayerPoint( CBrushShadowLayer *pbsl, UBYTE *pub, UBYTE ubMask=0);
+  BOOL PrepareOneLayerPoint( const CShadowMixLayer &sml, BOOL bNoMask);
+  void AddOneLayerPoint( const CShadowMixLayer &sml, UBYTE *pub, UBYTE ubMask=0);
 
   // add one directional layer to the shadow map
   void AddDirectional(void);
   void AddMaskDirectional( UBYTE *pubMask, UBYTE ubMask);
-  void AddOneLayerDirectional( CBrushShadowLayer *pbsl, UBYTE *pub, UBYTE ubMask=0);
+  void AddOneLayerDirectional( const CShadowMixLayer &sml, UBYTE *pub, UBYTE ubMask=0);
 
   // add one gradient layer to the shadow map
-  void AddOneLayerGradient( CGradientParameters &gp);
+  void AddOneLayerGradient( const CGradientParameters &gp);
 
   // add the intensity to the pixel
   inline void AddToCluster( UBYTE *pub);
@@ -172,7 +197,7 @@ inline void CLayerMixer::AddToCluster( UBYTE *pub, FLOAT fIntensity)
 // remember general data
 void CLayerMixer::CalculateData( CBrushShadowMap *pbsm, INDEX iMipmap)
 {
-  _pfWorldEditingProfile.StartTimer(CWorldEditingProfile::PTI_CALCULATEDATA);
+  LM_STARTTIMER(CWorldEditingProfile::PTI_CALCULATEDATA);
 
   // cache class vars
   lm_pbsmShadowMap = pbsm;
@@ -189,30 +214,31 @@ void CLayerMixer::CalculateData( CBrushShadowMap *pbsm, INDEX iMipmap)
   lm_pixPolygonSizeV = Min( lm_pixCanvasSizeV, (PIX)(lm_pbsmShadowMap->sm_pixPolygonSizeV >>lm_iMipShift)+1L);
 
   // determine where this mip-map is relative to the allocated shadow map memory
-  PIX pixOffset = pbsm->sm_slMemoryUsed/BYTES_PER_TEXEL
+  const SLONG slMemoryUsed = (lm_pulTarget!=NULL) ? lm_slTargetSize : pbsm->sm_slMemoryUsed;
+  PIX pixOffset = slMemoryUsed/BYTES_PER_TEXEL
                 - GetMipmapOffset( 15, lm_pixCanvasSizeU, lm_pixCanvasSizeV);
 
   // get right pointers to the shadow mipmap
   if( lm_bDynamic) {
     lm_pulShadowMap       = pbsm->sm_pulDynamicShadowMap + pixOffset;
     lm_pulStaticShadowMap = pbsm->sm_pulCachedShadowMap  + pixOffset;
+  } else if( lm_pulTarget!=NULL) {
+    lm_pulShadowMap       = lm_pulTarget + pixOffset;
+    lm_pulStaticShadowMap = NULL;
   } else {
     lm_pulShadowMap       = pbsm->sm_pulCachedShadowMap  + pixOffset;
     lm_pulStaticShadowMap = NULL;
   }
 
   // prepare 3D positions
-  CEntity *penWithPolygon = lm_pbpoPolygon->bpo_pbscSector->bsc_pbmBrushMip->bm_pbrBrush->br_penEntity;
-  ASSERT(penWithPolygon!=NULL);
-  const FLOATmatrix3D &mPolygonRotation = penWithPolygon->en_mRotation;
-  const FLOAT3D &vPolygonTranslation = penWithPolygon->GetPlacement().pl_PositionVector;
+  const FLOATmatrix3D &mPolygonRotation = lm_psmi->smi_mRotation;
+  const FLOAT3D &vPolygonTranslation = lm_psmi->smi_vPosition;
 
   // get first pixel in texture in 3D
   Vector<MEX, 2> vmex0;
   vmex0(1) = -lm_mexOffsetU+(1<<(lm_iMipLevel-1));
   vmex0(2) = -lm_mexOffsetV+(1<<(lm_iMipLevel-1));
-  lm_pbpoPolygon->bpo_mdShadow.GetSpaceCoordinates(
-    lm_pbpoPolygon->bpo_pbplPlane->bpl_pwplWorking->wpl_mvRelative, vmex0, lm_vO);
+  lm_pbpoPolygon->bpo_mdShadow.GetSpaceCoordinates( lm_psmi->smi_mvRelative, vmex0, lm_vO);
   lm_vO = lm_vO*mPolygonRotation+vPolygonTranslation;
 
   // get steps for walking in texture in 3D
@@ -222,17 +248,15 @@ void CLayerMixer::CalculateData( CBrushShadowMap *pbsm, INDEX iMipmap)
   vmexV(1) = (0<<lm_iMipLevel)-lm_mexOffsetU+(1<<(lm_iMipLevel-1));
   vmexV(2) = (1<<lm_iMipLevel)-lm_mexOffsetV+(1<<(lm_iMipLevel-1));
 
-  lm_pbpoPolygon->bpo_mdShadow.GetSpaceCoordinates(
-    lm_pbpoPolygon->bpo_pbplPlane->bpl_pwplWorking->wpl_mvRelative, vmexU, lm_vStepU);
+  lm_pbpoPolygon->bpo_mdShadow.GetSpaceCoordinates( lm_psmi->smi_mvRelative, vmexU, lm_vStepU);
   lm_vStepU = lm_vStepU*mPolygonRotation+vPolygonTranslation;
-  lm_pbpoPolygon->bpo_mdShadow.GetSpaceCoordinates(
-    lm_pbpoPolygon->bpo_pbplPlane->bpl_pwplWorking->wpl_mvRelative, vmexV, lm_vStepV);
+  lm_pbpoPolygon->bpo_mdShadow.GetSpaceCoordinates( lm_psmi->smi_mvRelative, vmexV, lm_vStepV);
   lm_vStepV = lm_vStepV*mPolygonRotation+vPolygonTranslation;
   lm_vStepU-= lm_vO;
   lm_vStepV-= lm_vO;
 
   ASSERT( lm_pixPolygonSizeU>0 && lm_pixPolygonSizeV>0);
-  _pfWorldEditingProfile.StopTimer(CWorldEditingProfile::PTI_CALCULATEDATA);
+  LM_STOPTIMER(CWorldEditingProfile::PTI_CALCULATEDATA);
 }
 
 
@@ -254,16 +278,6 @@ void CLayerMixer::FindLayerMipmap( CBrushShadowLayer *pbsl, UBYTE *&pub, UBYTE &
 #define FTOX   0x10000000
 #define SHIFTX (28-SQRTTABLESIZELOG2)
 
-// static variables for easier transfers
-static const FLOAT3D *_vLight;
-static FLOAT _fMinLightDistance, _f1oFallOff;
-static INDEX _iPixCt, _iRowCt;
-static SLONG _slModulo;
-static ULONG _ulLightFlags, _ulPolyFlags;
-static SLONG _slL2Row, _slDDL2oDU, _slDDL2oDV, _slDDL2oDUoDV, _slDL2oDURow, _slDL2oDV;
-static SLONG _slLightMax, _slHotSpot, _slLightStep;
-static ULONG *_pulLayer;
-
 
 // add one layer point light without diffusion and mask
 void CLayerMixer::AddAmbientPoint(void)
@@ -272,20 +286,20 @@ void CLayerMixer::AddAmbientPoint(void)
 #if ASMOPT == 1
 
   // prepare some local variables
-  __int64 mmDDL2oDU = _slDDL2oDU;
-  __int64 mmDDL2oDV = _slDDL2oDV;
+  __int64 mmDDL2oDU = lm_slDDL2oDU;
+  __int64 mmDDL2oDV = lm_slDDL2oDV;
   ULONG ulLightRGB = ByteSwap(lm_colLight);
-  _slLightMax<<=7;
-  _slLightStep>>=1;
+  lm_slLightMax<<=7;
+  lm_slLightStep>>=1;
 
   __asm {
     // prepare interpolants
-    movd    mm0,D [_slL2Row]
-    movd    mm1,D [_slDL2oDURow]
+    movd    mm0,D [lm_slL2Row]
+    movd    mm1,D [lm_slDL2oDURow]
     psllq   mm1,32
     por     mm1,mm0         // MM1 = slDL2oDURow | slL2Row
-    movd    mm0,D [_slDL2oDV]
-    movd    mm2,D [_slDDL2oDUoDV]
+    movd    mm0,D [lm_slDL2oDV]
+    movd    mm2,D [lm_slDDL2oDUoDV]
     psllq   mm2,32
     por     mm2,mm0         // MM2 = slDDL2oDUoDV | slDL2oDV
     // prepare color
@@ -294,15 +308,15 @@ void CLayerMixer::AddAmbientPoint(void)
     punpcklbw mm7,mm0
     psllw   mm7,1
     // loop thru rows
-    mov     edi,D [_pulLayer]
-    mov     ebx,D [_iRowCt]
+    mov     edi,D [lm_pulLayer]
+    mov     ebx,D [lm_iRowCt]
 rowLoop:
     push    ebx
     movd    ebx,mm1         // EBX = slL2Point
     movq    mm3,mm1
     psrlq   mm3,32          // MM3 = 0 | slDL2oDU
     // loop thru pixels in current row
-    mov     ecx,D [_iPixCt]
+    mov     ecx,D [lm_iPixCt]
 pixLoop:
     // check if pixel need to be drawn
     cmp     ebx,FTOX
@@ -313,12 +327,12 @@ pixLoop:
     sar     eax,SHIFTX
     and     eax,(SQRTTABLESIZE-1)
     movzx   eax,B aubSqrt[eax]
-    mov     ecx,D [_slLightMax]
-    cmp     eax,D [_slHotSpot]
+    mov     ecx,D [lm_slLightMax]
+    cmp     eax,D [lm_slHotSpot]
     jle     skipInterpolation
     mov     ecx,255
     sub     ecx,eax
-    imul    ecx,D [_slLightStep]
+    imul    ecx,D [lm_slLightStep]
 skipInterpolation:
     // calculate rgb pixel to add
     movd    mm6,ecx
@@ -342,7 +356,7 @@ skipPixel:
     jnz     pixLoop
     // advance to the next row
     pop     ebx
-    add     edi,D [_slModulo]
+    add     edi,D [lm_slModulo]
     paddd   mm1,mm2
     paddd   mm2,Q [mmDDL2oDV]
     dec     ebx
@@ -353,32 +367,32 @@ skipPixel:
 #else
 
   // for each pixel in the shadow map
-  UBYTE* pubLayer = (UBYTE*)_pulLayer;
-  for( PIX pixV=0; pixV<_iRowCt; pixV++)
+  UBYTE* pubLayer = (UBYTE*)lm_pulLayer;
+  for( PIX pixV=0; pixV<lm_iRowCt; pixV++)
   {
-    SLONG slL2Point = _slL2Row;
-    SLONG slDL2oDU  = _slDL2oDURow;
-    for( PIX pixU=0; pixU<_iPixCt; pixU++)
+    SLONG slL2Point = lm_slL2Row;
+    SLONG slDL2oDU  = lm_slDL2oDURow;
+    for( PIX pixU=0; pixU<lm_iPixCt; pixU++)
     {
       // if the point is not masked
       if(slL2Point<FTOX) {
         SLONG sl1oL = (slL2Point>>SHIFTX)&(SQRTTABLESIZE-1);  // and is just for degenerate cases
         sl1oL = aubSqrt[sl1oL];
-        SLONG slIntensity = _slLightMax;
-        if( sl1oL>_slHotSpot) slIntensity = ((255-sl1oL)*_slLightStep);
+        SLONG slIntensity = lm_slLightMax;
+        if( sl1oL>lm_slHotSpot) slIntensity = ((255-sl1oL)*lm_slLightStep);
         // add the intensity to the pixel
         AddToCluster( pubLayer, (slIntensity>>8)/255.0f);
       }
       // advance to next pixel
       pubLayer+=4;
       slL2Point +=  slDL2oDU;
-      slDL2oDU  += _slDDL2oDU;
+      slDL2oDU  += lm_slDDL2oDU;
     }
     // advance to next row
-    pubLayer     += _slModulo;
-    _slL2Row     += _slDL2oDV;
-    _slDL2oDV    += _slDDL2oDV;
-    _slDL2oDURow += _slDDL2oDUoDV;
+    pubLayer     += lm_slModulo;
+    lm_slL2Row     += lm_slDL2oDV;
+    lm_slDL2oDV    += lm_slDDL2oDV;
+    lm_slDL2oDURow += lm_slDDL2oDUoDV;
   }
 
 #endif
@@ -392,20 +406,20 @@ void CLayerMixer::AddAmbientMaskPoint( UBYTE *pubMask, UBYTE ubMask)
 #if ASMOPT == 1
 
   // prepare some local variables
-  __int64 mmDDL2oDU = _slDDL2oDU;
-  __int64 mmDDL2oDV = _slDDL2oDV;
+  __int64 mmDDL2oDU = lm_slDDL2oDU;
+  __int64 mmDDL2oDV = lm_slDDL2oDV;
   ULONG ulLightRGB = ByteSwap(lm_colLight);
-  _slLightMax<<=7;
-  _slLightStep>>=1;
+  lm_slLightMax<<=7;
+  lm_slLightStep>>=1;
 
   __asm {
     // prepare interpolants
-    movd    mm0,D [_slL2Row]
-    movd    mm1,D [_slDL2oDURow]
+    movd    mm0,D [lm_slL2Row]
+    movd    mm1,D [lm_slDL2oDURow]
     psllq   mm1,32
     por     mm1,mm0         // MM1 = slDL2oDURow | slL2Row
-    movd    mm0,D [_slDL2oDV]
-    movd    mm2,D [_slDDL2oDUoDV]
+    movd    mm0,D [lm_slDL2oDV]
+    movd    mm2,D [lm_slDDL2oDUoDV]
     psllq   mm2,32
     por     mm2,mm0         // MM2 = slDDL2oDUoDV | slDL2oDV
     // prepare color
@@ -415,16 +429,16 @@ void CLayerMixer::AddAmbientMaskPoint( UBYTE *pubMask, UBYTE ubMask)
     psllw   mm7,1
     // loop thru rows
     mov     esi,D [pubMask]
-    mov     edi,D [_pulLayer]
+    mov     edi,D [lm_pulLayer]
     movzx   edx,B [ubMask]
-    mov     ebx,D [_iRowCt]
+    mov     ebx,D [lm_iRowCt]
 rowLoop:
     push    ebx
     movd    ebx,mm1         // EBX = slL2Point
     movq    mm3,mm1
     psrlq   mm3,32          // MM3 = 0 | slDL2oDU
     // loop thru pixels in current row
-    mov     ecx,D [_iPixCt]
+    mov     ecx,D [lm_iPixCt]
 pixLoop:
     // check if pixel need to be drawn; i.e. draw if( [esi] & ubMask && (slL2Point<FTOX))
     cmp     ebx,FTOX
@@ -437,12 +451,12 @@ pixLoop:
     sar     eax,SHIFTX
     and     eax,(SQRTTABLESIZE-1)
     movzx   eax,B aubSqrt[eax]
-    mov     ecx,D [_slLightMax]
-    cmp     eax,D [_slHotSpot]
+    mov     ecx,D [lm_slLightMax]
+    cmp     eax,D [lm_slHotSpot]
     jle     skipInterpolation
     mov     ecx,255
     sub     ecx,eax
-    imul    ecx,D [_slLightStep]
+    imul    ecx,D [lm_slLightStep]
 skipInterpolation:
     // mix underlaying pixels with the calculated one
     movd    mm6,ecx 
@@ -468,7 +482,7 @@ skipPixel:
     jnz     pixLoop
     // advance to the next row
     pop     ebx
-    add     edi,D [_slModulo]
+    add     edi,D [lm_slModulo]
     paddd   mm1,mm2
     paddd   mm2,Q [mmDDL2oDV]
     dec     ebx
@@ -479,26 +493,26 @@ skipPixel:
 #else
 
   // for each pixel in the shadow map
-  UBYTE* pubLayer = (UBYTE*)_pulLayer;
-  for( PIX pixV=0; pixV<_iRowCt; pixV++)
+  UBYTE* pubLayer = (UBYTE*)lm_pulLayer;
+  for( PIX pixV=0; pixV<lm_iRowCt; pixV++)
   {
-    SLONG slL2Point = _slL2Row;
-    SLONG slDL2oDU  = _slDL2oDURow;
-    for( PIX pixU=0; pixU<_iPixCt; pixU++)
+    SLONG slL2Point = lm_slL2Row;
+    SLONG slDL2oDU  = lm_slDL2oDURow;
+    for( PIX pixU=0; pixU<lm_iPixCt; pixU++)
     {
       // if the point is not masked
       if( *pubMask&ubMask && (slL2Point<FTOX)) {
         SLONG sl1oL = (slL2Point>>SHIFTX)&(SQRTTABLESIZE-1);  // and is just for degenerate cases
         sl1oL = aubSqrt[sl1oL];
-        SLONG slIntensity = _slLightMax;
-        if( sl1oL>_slHotSpot) slIntensity = ((255-sl1oL)*_slLightStep);
+        SLONG slIntensity = lm_slLightMax;
+        if( sl1oL>lm_slHotSpot) slIntensity = ((255-sl1oL)*lm_slLightStep);
         // add the intensity to the pixel
         AddToCluster( pubLayer, (slIntensity>>8)/255.0f);
       }
       // advance to next pixel
       pubLayer+=4;
       slL2Point +=  slDL2oDU;
-      slDL2oDU  += _slDDL2oDU;
+      slDL2oDU  += lm_slDDL2oDU;
       ubMask<<=1;
       if( ubMask==0) {
         pubMask++;
@@ -506,10 +520,10 @@ skipPixel:
       }
     }
     // advance to next row
-    pubLayer     += _slModulo;
-    _slL2Row     += _slDL2oDV;
-    _slDL2oDV    += _slDDL2oDV;
-    _slDL2oDURow += _slDDL2oDUoDV;
+    pubLayer     += lm_slModulo;
+    lm_slL2Row     += lm_slDL2oDV;
+    lm_slDL2oDV    += lm_slDDL2oDV;
+    lm_slDL2oDURow += lm_slDDL2oDUoDV;
   }
 
 #endif
@@ -521,26 +535,26 @@ void CLayerMixer::AddDiffusionPoint(void)
 {
   // adjust params for diffusion lighting
   SLONG slMax1oL = MAX_SLONG;
-  _slLightStep = FloatToInt(_slLightStep * _fMinLightDistance * _f1oFallOff);
-  if( _slLightStep!=0) slMax1oL = (256<<8) / _slLightStep +256;
+  lm_slLightStep = FloatToInt(lm_slLightStep * lm_fMinLightDistance * lm_f1oFallOff);
+  if( lm_slLightStep!=0) slMax1oL = (256<<8) / lm_slLightStep +256;
 
 #if ASMOPT == 1
 
   // prepare some local variables
-  __int64 mmDDL2oDU = _slDDL2oDU;
-  __int64 mmDDL2oDV = _slDDL2oDV;
+  __int64 mmDDL2oDU = lm_slDDL2oDU;
+  __int64 mmDDL2oDV = lm_slDDL2oDV;
   ULONG ulLightRGB = ByteSwap(lm_colLight);
-  _slLightMax<<=7;
-  _slLightStep>>=1;
+  lm_slLightMax<<=7;
+  lm_slLightStep>>=1;
 
   __asm {
     // prepare interpolants
-    movd    mm0,D [_slL2Row]
-    movd    mm1,D [_slDL2oDURow]
+    movd    mm0,D [lm_slL2Row]
+    movd    mm1,D [lm_slDL2oDURow]
     psllq   mm1,32
     por     mm1,mm0         // MM1 = slDL2oDURow | slL2Row
-    movd    mm0,D [_slDL2oDV]
-    movd    mm2,D [_slDDL2oDUoDV]
+    movd    mm0,D [lm_slDL2oDV]
+    movd    mm2,D [lm_slDDL2oDUoDV]
     psllq   mm2,32
     por     mm2,mm0         // MM2 = slDDL2oDUoDV | slDL2oDV
     // prepare color
@@ -549,15 +563,15 @@ void CLayerMixer::AddDiffusionPoint(void)
     punpcklbw mm7,mm0
     psllw   mm7,1
     // loop thru rows
-    mov     edi,D [_pulLayer]
-    mov     ebx,D [_iRowCt]
+    mov     edi,D [lm_pulLayer]
+    mov     ebx,D [lm_iRowCt]
 rowLoop:
     push    ebx
     movd    ebx,mm1         // EBX = slL2Point
     movq    mm3,mm1
     psrlq   mm3,32          // MM3 = 0 | slDL2oDU
     // loop thru pixels in current row
-    mov     ecx,D [_iPixCt]
+    mov     ecx,D [lm_iPixCt]
 pixLoop:
     // check if pixel need to be drawn
     cmp     ebx,FTOX
@@ -568,11 +582,11 @@ pixLoop:
     sar     eax,SHIFTX
     and     eax,(SQRTTABLESIZE-1)
     movzx   eax,W auw1oSqrt[eax*2]
-    mov     ecx,D [_slLightMax]
+    mov     ecx,D [lm_slLightMax]
     cmp     eax,D [slMax1oL]
     jge     skipInterpolation
     lea     ecx,[eax-256]
-    imul    ecx,D [_slLightStep]
+    imul    ecx,D [lm_slLightStep]
 skipInterpolation:
     // calculate rgb pixel to add
     movd    mm6,ecx
@@ -596,7 +610,7 @@ skipPixel:
     jnz     pixLoop
     // advance to the next row
     pop     ebx
-    add     edi,D [_slModulo]
+    add     edi,D [lm_slModulo]
     paddd   mm1,mm2
     paddd   mm2,Q [mmDDL2oDV]
     dec     ebx
@@ -607,33 +621,33 @@ skipPixel:
 #else
 
   // for each pixel in the shadow map
-  UBYTE* pubLayer = (UBYTE*)_pulLayer;
-  for( PIX pixV=0; pixV<_iRowCt; pixV++)
+  UBYTE* pubLayer = (UBYTE*)lm_pulLayer;
+  for( PIX pixV=0; pixV<lm_iRowCt; pixV++)
   {
-    SLONG slL2Point = _slL2Row;
-    SLONG slDL2oDU  = _slDL2oDURow;
-    for( PIX pixU=0; pixU<_iPixCt; pixU++)
+    SLONG slL2Point = lm_slL2Row;
+    SLONG slDL2oDU  = lm_slDL2oDURow;
+    for( PIX pixU=0; pixU<lm_iPixCt; pixU++)
     {
       // if the point is not masked
       if((slL2Point<FTOX)) {
         SLONG sl1oL = (slL2Point>>SHIFTX)&(SQRTTABLESIZE-1);  // and is just for degenerate cases
         sl1oL = auw1oSqrt[sl1oL];
-        SLONG slIntensity = _slLightMax;
+        SLONG slIntensity = lm_slLightMax;
 		if( sl1oL<256) slIntensity = 0;
-        else if( sl1oL<slMax1oL) slIntensity = ((sl1oL-256)*_slLightStep);
+        else if( sl1oL<slMax1oL) slIntensity = ((sl1oL-256)*lm_slLightStep);
         // add the intensity to the pixel
         AddToCluster( pubLayer, (slIntensity>>8)/255.0f);
       }
       // advance to next pixel
       pubLayer+=4;
       slL2Point +=  slDL2oDU;
-      slDL2oDU  += _slDDL2oDU;
+      slDL2oDU  += lm_slDDL2oDU;
     }
     // advance to next row
-    pubLayer     += _slModulo;
-    _slL2Row     += _slDL2oDV;
-    _slDL2oDV    += _slDDL2oDV;
-    _slDL2oDURow += _slDDL2oDUoDV;
+    pubLayer     += lm_slModulo;
+    lm_slL2Row     += lm_slDL2oDV;
+    lm_slDL2oDV    += lm_slDDL2oDV;
+    lm_slDL2oDURow += lm_slDDL2oDUoDV;
   }
 
 
@@ -645,26 +659,26 @@ void CLayerMixer::AddDiffusionMaskPoint( UBYTE *pubMask, UBYTE ubMask)
 {
   // adjust params for diffusion lighting
   SLONG slMax1oL = MAX_SLONG;
-  _slLightStep = FloatToInt(_slLightStep * _fMinLightDistance * _f1oFallOff);
-  if( _slLightStep!=0) slMax1oL = (256<<8) / _slLightStep +256;
+  lm_slLightStep = FloatToInt(lm_slLightStep * lm_fMinLightDistance * lm_f1oFallOff);
+  if( lm_slLightStep!=0) slMax1oL = (256<<8) / lm_slLightStep +256;
 
 #if ASMOPT == 1
 
   // prepare some local variables
-  __int64 mmDDL2oDU = _slDDL2oDU;
-  __int64 mmDDL2oDV = _slDDL2oDV;
+  __int64 mmDDL2oDU = lm_slDDL2oDU;
+  __int64 mmDDL2oDV = lm_slDDL2oDV;
   ULONG ulLightRGB = ByteSwap(lm_colLight);
-  _slLightMax<<=7;
-  _slLightStep>>=1;
+  lm_slLightMax<<=7;
+  lm_slLightStep>>=1;
 
   __asm {
     // prepare interpolants
-    movd    mm0,D [_slL2Row]
-    movd    mm1,D [_slDL2oDURow]
+    movd    mm0,D [lm_slL2Row]
+    movd    mm1,D [lm_slDL2oDURow]
     psllq   mm1,32
     por     mm1,mm0         // MM1 = slDL2oDURow | slL2Row
-    movd    mm0,D [_slDL2oDV]
-    movd    mm2,D [_slDDL2oDUoDV]
+    movd    mm0,D [lm_slDL2oDV]
+    movd    mm2,D [lm_slDDL2oDUoDV]
     psllq   mm2,32
     por     mm2,mm0         // MM2 = slDDL2oDUoDV | slDL2oDV
     // prepare color
@@ -674,16 +688,16 @@ void CLayerMixer::AddDiffusionMaskPoint( UBYTE *pubMask, UBYTE ubMask)
     psllw   mm7,1
     // loop thru rows
     mov     esi,D [pubMask]
-    mov     edi,D [_pulLayer]
+    mov     edi,D [lm_pulLayer]
     movzx   edx,B [ubMask]
-    mov     ebx,D [_iRowCt]
+    mov     ebx,D [lm_iRowCt]
 rowLoop:
     push    ebx
     movd    ebx,mm1         // EBX = slL2Point
     movq    mm3,mm1
     psrlq   mm3,32          // MM3 = 0 | slDL2oDU
     // loop thru pixels in current row
-    mov     ecx,D [_iPixCt]
+    mov     ecx,D [lm_iPixCt]
 pixLoop:
     // check if pixel need to be drawn; i.e. draw if( [esi] & ubMask && (slL2Point<FTOX))
     cmp     ebx,FTOX
@@ -696,11 +710,11 @@ pixLoop:
     sar     eax,SHIFTX
     and     eax,(SQRTTABLESIZE-1)
     movzx   eax,W auw1oSqrt[eax*2]
-    mov     ecx,D [_slLightMax]
+    mov     ecx,D [lm_slLightMax]
     cmp     eax,D [slMax1oL]
     jge     skipInterpolation
     lea     ecx,[eax-256]
-    imul    ecx,D [_slLightStep]
+    imul    ecx,D [lm_slLightStep]
 skipInterpolation:
     // mix underlaying pixels with the calculated one
     movd    mm6,ecx 
@@ -726,7 +740,7 @@ skipPixel:
     jnz     pixLoop
     // advance to the next row
     pop     ebx
-    add     edi,D [_slModulo]
+    add     edi,D [lm_slModulo]
     paddd   mm1,mm2
     paddd   mm2,Q [mmDDL2oDV]
     dec     ebx
@@ -738,27 +752,27 @@ skipPixel:
 
 
   // for each pixel in the shadow map
-  UBYTE* pubLayer = (UBYTE*)_pulLayer;
-  for( PIX pixV=0; pixV<_iRowCt; pixV++)
+  UBYTE* pubLayer = (UBYTE*)lm_pulLayer;
+  for( PIX pixV=0; pixV<lm_iRowCt; pixV++)
   {
-    SLONG slL2Point = _slL2Row;
-    SLONG slDL2oDU  = _slDL2oDURow;
-    for( PIX pixU=0; pixU<_iPixCt; pixU++)
+    SLONG slL2Point = lm_slL2Row;
+    SLONG slDL2oDU  = lm_slDL2oDURow;
+    for( PIX pixU=0; pixU<lm_iPixCt; pixU++)
     {
       // if the point is not masked
       if( *pubMask&ubMask && (slL2Point<FTOX)) {
         SLONG sl1oL = (slL2Point>>SHIFTX)&(SQRTTABLESIZE-1);  // and is just for degenerate cases
         sl1oL = auw1oSqrt[sl1oL];
-        SLONG slIntensity = _slLightMax;
+        SLONG slIntensity = lm_slLightMax;
 		if( sl1oL<256) slIntensity = 0;
-        else if( sl1oL<slMax1oL) slIntensity = ((sl1oL-256)*_slLightStep);
+        else if( sl1oL<slMax1oL) slIntensity = ((sl1oL-256)*lm_slLightStep);
         // add the intensity to the pixel
         AddToCluster( pubLayer, (slIntensity>>8)/255.0f);
       } 
       // advance to next pixel
       pubLayer+=4;
       slL2Point +=  slDL2oDU;
-      slDL2oDU  += _slDDL2oDU;
+      slDL2oDU  += lm_slDDL2oDU;
       ubMask<<=1;
       if( ubMask==0) {
         pubMask++;
@@ -766,10 +780,10 @@ skipPixel:
       }
     }
     // advance to next row
-    pubLayer     += _slModulo;
-    _slL2Row     += _slDL2oDV;
-    _slDL2oDV    += _slDDL2oDV;
-    _slDL2oDURow += _slDDL2oDUoDV;
+    pubLayer     += lm_slModulo;
+    lm_slL2Row     += lm_slDL2oDV;
+    lm_slDL2oDV    += lm_slDDL2oDV;
+    lm_slDL2oDURow += lm_slDDL2oDUoDV;
   }
 
 #endif
@@ -777,48 +791,47 @@ skipPixel:
 }
 
 // prepares point light that creates layer (returns TRUE if there is infulence)
-BOOL CLayerMixer::PrepareOneLayerPoint( CBrushShadowLayer *pbsl, BOOL bNoMask)
+BOOL CLayerMixer::PrepareOneLayerPoint( const CShadowMixLayer &sml, BOOL bNoMask)
 {
+  const CBrushShadowLayer *pbsl = sml.sml_pbsl;
   // determine light infulence dimensions
-  _iPixCt = pbsl->bsl_pixSizeU >>lm_iMipShift;
-  _iRowCt = pbsl->bsl_pixSizeV >>lm_iMipShift;
+  lm_iPixCt = pbsl->bsl_pixSizeU >>lm_iMipShift;
+  lm_iRowCt = pbsl->bsl_pixSizeV >>lm_iMipShift;
   PIX pixMinU = pbsl->bsl_pixMinU >>lm_iMipShift;
   PIX pixMinV = pbsl->bsl_pixMinV >>lm_iMipShift;
   // clamp influence to polygon size
-  if( (pixMinU+_iPixCt) > lm_pixPolygonSizeU && bNoMask) _iPixCt = lm_pixPolygonSizeU-pixMinU;
-  if( (pixMinV+_iRowCt) > lm_pixPolygonSizeV)            _iRowCt = lm_pixPolygonSizeV-pixMinV;
-  _slModulo = (lm_pixCanvasSizeU-_iPixCt) *BYTES_PER_TEXEL;
-  _pulLayer = lm_pulShadowMap + (pixMinV*lm_pixCanvasSizeU)+pixMinU;
+  if( (pixMinU+lm_iPixCt) > lm_pixPolygonSizeU && bNoMask) lm_iPixCt = lm_pixPolygonSizeU-pixMinU;
+  if( (pixMinV+lm_iRowCt) > lm_pixPolygonSizeV)            lm_iRowCt = lm_pixPolygonSizeV-pixMinV;
+  lm_slModulo = (lm_pixCanvasSizeU-lm_iPixCt) *BYTES_PER_TEXEL;
+  lm_pulLayer = lm_pulShadowMap + (pixMinV*lm_pixCanvasSizeU)+pixMinU;
   ASSERT( pixMinU>=0 && pixMinU<lm_pixCanvasSizeU && pixMinV>=0 && pixMinV<lm_pixCanvasSizeV);
 
   // get the light source properties of the layer
-  lm_plsLight = pbsl->bsl_plsLightSource;
-  _vLight = &lm_plsLight->ls_penEntity->GetPlacement().pl_PositionVector;
-  _fMinLightDistance = lm_pbpoPolygon->bpo_pbplPlane->bpl_plAbsolute.PointDistance(*_vLight);
-  _f1oFallOff   = 1.0f / lm_plsLight->ls_rFallOff;
-  _ulLightFlags = lm_plsLight->ls_ulFlags;
-  _ulPolyFlags  = lm_pbpoPolygon->bpo_ulFlags;
-  lm_colLight   = lm_plsLight->GetLightColor();
-  pbsl->bsl_colLastAnim = lm_colLight;
+  lm_vLight = &sml.sml_vLight;
+  lm_fMinLightDistance = lm_psmi->smi_plAbsolute.PointDistance(*lm_vLight);
+  lm_f1oFallOff   = 1.0f / sml.sml_rFallOff;
+  lm_ulLightFlags = sml.sml_ulLightFlags;
+  lm_ulPolyFlags  = lm_psmi->smi_ulPolygonFlags;
+  lm_colLight     = sml.sml_colLight;
 
   // if there is no influence, do nothing
   if( (pbsl->bsl_pixSizeU>>lm_iMipShift)==0 || (pbsl->bsl_pixSizeV>>lm_iMipShift)==0
-    || _iPixCt<=0 || _iRowCt<=0) return FALSE;
+    || lm_iPixCt<=0 || lm_iRowCt<=0) return FALSE;
 
   // adjust for sector ambient
-  if( _ulLightFlags&LSF_SUBSTRACTSECTORAMBIENT) {
-    COLOR colAmbient = lm_pbpoPolygon->bpo_pbscSector->bsc_colAmbient;
+  if( lm_ulLightFlags&LSF_SUBSTRACTSECTORAMBIENT) {
+    COLOR colAmbient = lm_psmi->smi_colSectorAmbient;
     IncrementByteWithClip( ((UBYTE*)&lm_colLight)[1], -((UBYTE*)&colAmbient)[1]);
     IncrementByteWithClip( ((UBYTE*)&lm_colLight)[2], -((UBYTE*)&colAmbient)[2]);
     IncrementByteWithClip( ((UBYTE*)&lm_colLight)[3], -((UBYTE*)&colAmbient)[3]);
-    if( _ulPolyFlags&BPOF_HASDIRECTIONALAMBIENT)
+    if( lm_ulPolyFlags&BPOF_HASDIRECTIONALAMBIENT)
     { // find directional layers for each shadow layer
-      FOREACHINLIST( CBrushShadowLayer, bsl_lnInShadowMap, lm_pbsmShadowMap->bsm_lhLayers, itbsl)
+      for( INDEX iLayer=0; iLayer<lm_psmi->smi_asmlLayers.Count(); iLayer++)
       { // loop thru layers
-        CBrushShadowLayer &bsl = *itbsl;
-        if( bsl.bsl_plsLightSource->ls_ulFlags&LSF_DIRECTIONAL)
+        const CShadowMixLayer &smlOther = lm_psmi->smi_asmlLayers[iLayer];
+        if( smlOther.sml_ulLightFlags&LSF_DIRECTIONAL)
         { // skip if no ambient color
-          colAmbient = bsl.bsl_plsLightSource->ls_colAmbient & 0xFFFFFF00;
+          colAmbient = smlOther.sml_colAmbientBase & 0xFFFFFF00;
           if( IsBlack(colAmbient)) continue;
           // substract ambient
           IncrementByteWithClip( ((UBYTE*)&lm_colLight)[1], -((UBYTE*)&colAmbient)[1]);
@@ -830,8 +843,8 @@ BOOL CLayerMixer::PrepareOneLayerPoint( CBrushShadowLayer *pbsl, BOOL bNoMask)
   }
 
   // prepare intermediate light interpolants
-  FLOAT3D v00 = (lm_vO+lm_vStepU*pixMinU + lm_vStepV*pixMinV) - *_vLight;
-  FLOAT fFactor = FTOX * _f1oFallOff*_f1oFallOff;
+  FLOAT3D v00 = (lm_vO+lm_vStepU*pixMinU + lm_vStepV*pixMinV) - *lm_vLight;
+  FLOAT fFactor = FTOX * lm_f1oFallOff*lm_f1oFallOff;
   FLOAT fL2Row  = v00%v00;
   FLOAT fDDL2oDU    = lm_vStepU%lm_vStepU;
   FLOAT fDDL2oDV    = lm_vStepV%lm_vStepV;
@@ -861,33 +874,33 @@ BOOL CLayerMixer::PrepareOneLayerPoint( CBrushShadowLayer *pbsl, BOOL bNoMask)
     fmul    st(4),st(0)
     fmul    st(5),st(0)
     fmulp   st(6),st(0)
-    fistp   D [_slDL2oDV]
-    fistp   D [_slDL2oDURow]
-    fistp   D [_slL2Row]
-    fistp   D [_slDDL2oDUoDV]
-    fistp   D [_slDDL2oDV]
-    fistp   D [_slDDL2oDU]
+    fistp   D [lm_slDL2oDV]
+    fistp   D [lm_slDL2oDURow]
+    fistp   D [lm_slL2Row]
+    fistp   D [lm_slDDL2oDUoDV]
+    fistp   D [lm_slDDL2oDV]
+    fistp   D [lm_slDDL2oDU]
   }
 #else
   fDDL2oDU     *= 2;
   fDDL2oDV     *= 2;
   fDDL2oDUoDV  *= 2;
-  _slL2Row      = FloatToInt( fL2Row      * fFactor);
-  _slDDL2oDU    = FloatToInt( fDDL2oDU    * fFactor);
-  _slDDL2oDV    = FloatToInt( fDDL2oDV    * fFactor);
-  _slDDL2oDUoDV = FloatToInt( fDDL2oDUoDV * fFactor);
-  _slDL2oDURow  = FloatToInt( fDL2oDURow  * fFactor);
-  _slDL2oDV     = FloatToInt( fDL2oDV     * fFactor);
+  lm_slL2Row      = FloatToInt( fL2Row      * fFactor);
+  lm_slDDL2oDU    = FloatToInt( fDDL2oDU    * fFactor);
+  lm_slDDL2oDV    = FloatToInt( fDDL2oDV    * fFactor);
+  lm_slDDL2oDUoDV = FloatToInt( fDDL2oDUoDV * fFactor);
+  lm_slDL2oDURow  = FloatToInt( fDL2oDURow  * fFactor);
+  lm_slDL2oDV     = FloatToInt( fDL2oDV     * fFactor);
 #endif
 
   // prepare final light interpolants
-  _slLightMax  = 255;
-  _slHotSpot   = FloatToInt( 255.0f * lm_plsLight->ls_rHotSpot * _f1oFallOff);
-  _slLightStep = FloatToInt( 65535.0f / (255.0f - _slHotSpot));
+  lm_slLightMax  = 255;
+  lm_slHotSpot   = FloatToInt( 255.0f * sml.sml_rHotSpot * lm_f1oFallOff);
+  lm_slLightStep = FloatToInt( 65535.0f / (255.0f - lm_slHotSpot));
   // dark light inverts parameters
-  if( _ulLightFlags & LSF_DARKLIGHT) {
-    _slLightMax  = -_slLightMax;
-    _slLightStep = -_slLightStep;
+  if( lm_ulLightFlags & LSF_DARKLIGHT) {
+    lm_slLightMax  = -lm_slLightMax;
+    lm_slLightStep = -lm_slLightStep;
   }
 
   // saturate light color
@@ -898,17 +911,17 @@ BOOL CLayerMixer::PrepareOneLayerPoint( CBrushShadowLayer *pbsl, BOOL bNoMask)
 
 
 // add one layer to the shadow map (pubMask=NULL for no mask)
-void CLayerMixer::AddOneLayerPoint( CBrushShadowLayer *pbsl, UBYTE *pubMask, UBYTE ubMask)
+void CLayerMixer::AddOneLayerPoint( const CShadowMixLayer &sml, UBYTE *pubMask, UBYTE ubMask)
 {
   // try to prepare layer for this point light
-  _pfWorldEditingProfile.StartTimer( CWorldEditingProfile::PTI_ADDONELAYERPOINT);
-  if( !PrepareOneLayerPoint( pbsl, pubMask==NULL)) {
-    _pfWorldEditingProfile.StopTimer( CWorldEditingProfile::PTI_ADDONELAYERPOINT);
+  LM_STARTTIMER(CWorldEditingProfile::PTI_ADDONELAYERPOINT);
+  if( !PrepareOneLayerPoint( sml, pubMask==NULL)) {
+    LM_STOPTIMER(CWorldEditingProfile::PTI_ADDONELAYERPOINT);
     return;
   }
 
   // determine diffusion presence and corresponding routine
-  BOOL bDiffusion = (_ulLightFlags&LSF_DIFFUSION) && !(_ulPolyFlags&BPOF_NOPLANEDIFFUSION);
+  BOOL bDiffusion = (lm_ulLightFlags&LSF_DIFFUSION) && !(lm_ulPolyFlags&BPOF_NOPLANEDIFFUSION);
   // masked or non-masked?
   if( pubMask==NULL) {
     // non-masked
@@ -930,13 +943,13 @@ void CLayerMixer::AddOneLayerPoint( CBrushShadowLayer *pbsl, UBYTE *pubMask, UBY
   }
 
   // all done
-  _pfWorldEditingProfile.StopTimer(CWorldEditingProfile::PTI_ADDONELAYERPOINT);
+  LM_STOPTIMER(CWorldEditingProfile::PTI_ADDONELAYERPOINT);
 }
 
 
 
 // apply gradient to layer
-void CLayerMixer::AddOneLayerGradient( CGradientParameters &gp)
+void CLayerMixer::AddOneLayerGradient( const CGradientParameters &gp)
 {
   // convert gradient parameters for plane
   ASSERT( Abs(gp.gp_fH1-gp.gp_fH0)>0.0001f);
@@ -950,7 +963,7 @@ void CLayerMixer::AddOneLayerGradient( CGradientParameters &gp)
   SLONG fixDGroDJ = FloatToInt(fDGroDJ*32767.0f); // 16:15
   COLOR col0 = gp.gp_col0;
   COLOR col1 = gp.gp_col1;
-  _pulLayer  = lm_pulShadowMap;
+  lm_pulLayer  = lm_pulShadowMap;
   FLOAT fStart = Clamp( fGr00-(fDGroDJ+fDGroDI)*0.5f, 0.0f, 1.0f);
 
 #if ASMOPT == 1
@@ -1013,7 +1026,7 @@ skipDark:
     psraw   mm6,1   // ending color
     pxor    mm0,mm0
     mov     esi,D [fixGRow]
-    mov     edi,D [_pulLayer]
+    mov     edi,D [lm_pulLayer]
     mov     edx,D [ctRows]
 rowLoop:
     mov     ebx,esi
@@ -1107,9 +1120,9 @@ rowDone:
       SLONG slR = Clamp( fixRcol>>6, -255, +255);
       SLONG slG = Clamp( fixGcol>>6, -255, +255);
       SLONG slB = Clamp( fixBcol>>6, -255, +255);
-      IncrementByteWithClip( ((UBYTE*)&_pulLayer[pixOffset])[0], slR);
-      IncrementByteWithClip( ((UBYTE*)&_pulLayer[pixOffset])[1], slG);
-      IncrementByteWithClip( ((UBYTE*)&_pulLayer[pixOffset])[2], slB);
+      IncrementByteWithClip( ((UBYTE*)&lm_pulLayer[pixOffset])[0], slR);
+      IncrementByteWithClip( ((UBYTE*)&lm_pulLayer[pixOffset])[1], slG);
+      IncrementByteWithClip( ((UBYTE*)&lm_pulLayer[pixOffset])[2], slB);
       // advance to next pixel
       fGrCol += fDGroDI;
       pixOffset++;
@@ -1160,12 +1173,12 @@ void CLayerMixer::AddDirectional(void)
   ULONG ulLight = ByteSwap( lm_colLight);
   __asm {
     // prepare pointers and variables
-    mov     edi,D [_pulLayer]
-    mov     ebx,D [_iRowCt]
+    mov     edi,D [lm_pulLayer]
+    mov     ebx,D [lm_iRowCt]
     movd    mm6,D [ulLight]
     punpckldq mm6,mm6
 rowLoop: 
-    mov     ecx,D [_iPixCt]
+    mov     ecx,D [lm_iPixCt]
     shr     ecx,1
     jz      pixRest
 pixLoop:
@@ -1178,7 +1191,7 @@ pixLoop:
     dec     ecx
     jnz     pixLoop
 pixRest:
-    test    D [_iPixCt],1
+    test    D [lm_iPixCt],1
     jz      rowNext
     movd    mm5,D [edi]
     paddusb mm5,mm6
@@ -1186,7 +1199,7 @@ pixRest:
     add     edi,4
 rowNext:
     // advance to the next row
-    add     edi,D [_slModulo]
+    add     edi,D [lm_slModulo]
     dec     ebx
     jnz     rowLoop
     emms
@@ -1195,14 +1208,14 @@ rowNext:
 #else
 
   // for each pixel in the shadow map
-  UBYTE* pubLayer = (UBYTE*)_pulLayer;
-  for( PIX pixV=0; pixV<_iRowCt; pixV++) {
-    for( PIX pixU=0; pixU<_iPixCt; pixU++) {
+  UBYTE* pubLayer = (UBYTE*)lm_pulLayer;
+  for( PIX pixV=0; pixV<lm_iRowCt; pixV++) {
+    for( PIX pixU=0; pixU<lm_iPixCt; pixU++) {
       // add the intensity to the pixel
       AddToCluster( pubLayer);
       pubLayer+=4; // go to the next pixel
     } // go to the next row
-    pubLayer += _slModulo;
+    pubLayer += lm_slModulo;
   }
 
 #endif
@@ -1221,11 +1234,11 @@ void CLayerMixer::AddMaskDirectional( UBYTE *pubMask, UBYTE ubMask)
     // prepare pointers and variables
     movzx   edx,B [ubMask]
     mov     esi,D [pubMask]
-    mov     edi,D [_pulLayer]
-    mov     ebx,D [_iRowCt]
+    mov     edi,D [lm_pulLayer]
+    mov     ebx,D [lm_iRowCt]
     movd    mm6,D [ulLight]
 rowLoop:
-    mov     ecx,D [_iPixCt]
+    mov     ecx,D [lm_iPixCt]
 pixLoop:
     // mix underlaying pixels with the constant light color if not shaded
     test    dl,B [esi]
@@ -1241,7 +1254,7 @@ skipLight:
     dec     ecx
     jnz     pixLoop
     // advance to the next row
-    add     edi,D [_slModulo]
+    add     edi,D [lm_slModulo]
     dec     ebx
     jnz     rowLoop
     emms
@@ -1250,9 +1263,9 @@ skipLight:
 #else
 
   // for each pixel in the shadow map
-  UBYTE* pubLayer = (UBYTE*)_pulLayer;
-  for( PIX pixV=0; pixV<_iRowCt; pixV++) {
-    for( PIX pixU=0; pixU<_iPixCt; pixU++) {
+  UBYTE* pubLayer = (UBYTE*)lm_pulLayer;
+  for( PIX pixV=0; pixV<lm_iRowCt; pixV++) {
+    for( PIX pixU=0; pixU<lm_iPixCt; pixU++) {
       // if the point is not masked
       if( *pubMask&ubMask) {
         // add the intensity to the pixel
@@ -1265,7 +1278,7 @@ skipLight:
         ubMask = 1;
       }
     } // go to the next row
-    pubLayer += _slModulo;
+    pubLayer += lm_slModulo;
   }
 
 #endif
@@ -1275,45 +1288,42 @@ skipLight:
 
 // apply directional light to layer
 // (pubMask=NULL for no mask, ubMask = 0xFF for full mask)
-void CLayerMixer::AddOneLayerDirectional( CBrushShadowLayer *pbsl, UBYTE *pubMask, UBYTE ubMask)
+void CLayerMixer::AddOneLayerDirectional( const CShadowMixLayer &sml, UBYTE *pubMask, UBYTE ubMask)
 {
   // only if there is color light (ambient is added at initial fill)
-  if( !(lm_pbpoPolygon->bpo_ulFlags&BPOF_HASDIRECTIONALLIGHT)) return;
-  _pfWorldEditingProfile.StartTimer(CWorldEditingProfile::PTI_ADDONELAYERDIRECTIONAL);
+  if( !(lm_psmi->smi_ulPolygonFlags&BPOF_HASDIRECTIONALLIGHT)) return;
+  const CBrushShadowLayer *pbsl = sml.sml_pbsl;
+  LM_STARTTIMER(CWorldEditingProfile::PTI_ADDONELAYERDIRECTIONAL);
 
   // determine light influence dimensions
-  _iPixCt = pbsl->bsl_pixSizeU >>lm_iMipShift;
-  _iRowCt = pbsl->bsl_pixSizeV >>lm_iMipShift;
+  lm_iPixCt = pbsl->bsl_pixSizeU >>lm_iMipShift;
+  lm_iRowCt = pbsl->bsl_pixSizeV >>lm_iMipShift;
   PIX pixMinU = pbsl->bsl_pixMinU >>lm_iMipShift;
   PIX pixMinV = pbsl->bsl_pixMinV >>lm_iMipShift;
   ASSERT( pixMinU==0 && pixMinV==0);
   // clamp influence to polygon size
-  if( _iPixCt > lm_pixPolygonSizeU && pubMask==NULL) _iPixCt = lm_pixPolygonSizeU;
-  if( _iRowCt > lm_pixPolygonSizeV)                  _iRowCt = lm_pixPolygonSizeV;
-  _slModulo = (lm_pixCanvasSizeU-_iPixCt) *BYTES_PER_TEXEL;
-  _pulLayer = lm_pulShadowMap;
+  if( lm_iPixCt > lm_pixPolygonSizeU && pubMask==NULL) lm_iPixCt = lm_pixPolygonSizeU;
+  if( lm_iRowCt > lm_pixPolygonSizeV)                  lm_iRowCt = lm_pixPolygonSizeV;
+  lm_slModulo = (lm_pixCanvasSizeU-lm_iPixCt) *BYTES_PER_TEXEL;
+  lm_pulLayer = lm_pulShadowMap;
 
   // if there is no influence, do nothing
   if( (pbsl->bsl_pixSizeU>>lm_iMipShift)==0 || (pbsl->bsl_pixSizeV>>lm_iMipShift)==0
-    || _iPixCt<=0 || _iRowCt<=0) {
-    _pfWorldEditingProfile.StopTimer(CWorldEditingProfile::PTI_ADDONELAYERDIRECTIONAL);
+    || lm_iPixCt<=0 || lm_iRowCt<=0) {
+    LM_STOPTIMER(CWorldEditingProfile::PTI_ADDONELAYERDIRECTIONAL);
     return;
   }
 
   // get the light source of the layer
-  lm_plsLight = pbsl->bsl_plsLightSource;
-  const FLOAT3D &vLight = lm_plsLight->ls_penEntity->GetPlacement().pl_PositionVector;
-  AnglesToDirectionVector( lm_plsLight->ls_penEntity->GetPlacement().pl_OrientationAngle,
-                           lm_vLightDirection);
+  lm_vLightDirection = sml.sml_vLightDirection;
   // calculate intensity
   FLOAT fIntensity = 1.0f;
-  if( !(lm_pbpoPolygon->bpo_ulFlags&BPOF_NOPLANEDIFFUSION)) {
-    fIntensity = -((lm_pbpoPolygon->bpo_pbplPlane->bpl_plAbsolute)%lm_vLightDirection);
+  if( !(lm_psmi->smi_ulPolygonFlags&BPOF_NOPLANEDIFFUSION)) {
+    fIntensity = -(lm_psmi->smi_plAbsolute%lm_vLightDirection);
     fIntensity = ClampDn( fIntensity, 0.0f);
   }
   // calculate light color and ambient
-  lm_colLight = lm_plsLight->GetLightColor();
-  pbsl->bsl_colLastAnim = lm_colLight;
+  lm_colLight = sml.sml_colLight;
   ULONG ulIntensity = NormFloatToByte(fIntensity);
   ulIntensity = (ulIntensity<<CT_RSHIFT)|(ulIntensity<<CT_GSHIFT)|(ulIntensity<<CT_BSHIFT);
   lm_colLight = MulColors(   lm_colLight, ulIntensity);
@@ -1329,7 +1339,7 @@ void CLayerMixer::AddOneLayerDirectional( CBrushShadowLayer *pbsl, UBYTE *pubMas
   }
 
   // all done
-  _pfWorldEditingProfile.StopTimer(CWorldEditingProfile::PTI_ADDONELAYERDIRECTIONAL);
+  LM_STOPTIMER(CWorldEditingProfile::PTI_ADDONELAYERDIRECTIONAL);
 }
 
 
@@ -1355,7 +1365,7 @@ void CLayerMixer::MixOneMipmap(CBrushShadowMap *pbsm, INDEX iMipmap)
 {
   // remember general data
   CalculateData( pbsm, iMipmap);
-  const BOOL bDynamicOnly = lm_pbpoPolygon->bpo_ulFlags&BPOF_DYNAMICLIGHTSONLY;
+  const BOOL bDynamicOnly = lm_psmi->smi_ulPolygonFlags&BPOF_DYNAMICLIGHTSONLY;
 
 #if WITH_BOUND_CHECK
   g_pbsm = pbsm;
@@ -1364,22 +1374,19 @@ void CLayerMixer::MixOneMipmap(CBrushShadowMap *pbsm, INDEX iMipmap)
 #endif
 
   // fill with sector ambient
-  _pfWorldEditingProfile.StartTimer(CWorldEditingProfile::PTI_AMBIENTFILL);
+  LM_STARTTIMER(CWorldEditingProfile::PTI_AMBIENTFILL);
 
   // eventually add ambient component of all directional layers that might contribute
   COLOR colAmbient = 0x80808000UL; // overide ambient light color for dynamic lights only
   if( !bDynamicOnly) {
-    colAmbient = AdjustColor( lm_pbpoPolygon->bpo_pbscSector->bsc_colAmbient, _slShdHueShift, _slShdSaturation);
-    if( lm_pbpoPolygon->bpo_ulFlags&BPOF_HASDIRECTIONALAMBIENT) {
-      {FOREACHINLIST( CBrushShadowLayer, bsl_lnInShadowMap, lm_pbsmShadowMap->bsm_lhLayers, itbsl) {
-        CBrushShadowLayer &bsl = *itbsl;
-        ASSERT( bsl.bsl_plsLightSource!=NULL);
-        if( bsl.bsl_plsLightSource==NULL) continue; // safety check
-        CLightSource &ls = *bsl.bsl_plsLightSource;
-        if( !(ls.ls_ulFlags&LSF_DIRECTIONAL)) continue;  // skip non-directional layers
-        COLOR col = AdjustColor( ls.GetLightAmbient(), _slShdHueShift, _slShdSaturation);
+    colAmbient = AdjustColor( lm_psmi->smi_colSectorAmbient, _slShdHueShift, _slShdSaturation);
+    if( lm_psmi->smi_ulPolygonFlags&BPOF_HASDIRECTIONALAMBIENT) {
+      for( INDEX iLayer=0; iLayer<lm_psmi->smi_asmlLayers.Count(); iLayer++) {
+        const CShadowMixLayer &sml = lm_psmi->smi_asmlLayers[iLayer];
+        if( !(sml.sml_ulLightFlags&LSF_DIRECTIONAL)) continue;  // skip non-directional layers
+        COLOR col = AdjustColor( sml.sml_colAmbient, _slShdHueShift, _slShdSaturation);
         colAmbient = AddColors( colAmbient, col);
-      }}
+      }
     }
   } // set initial color
 //  __asm {
@@ -1400,62 +1407,78 @@ void CLayerMixer::MixOneMipmap(CBrushShadowMap *pbsm, INDEX iMipmap)
     *edi = eax;
     edi++;
   }
-  _pfWorldEditingProfile.StopTimer(CWorldEditingProfile::PTI_AMBIENTFILL);
+  LM_STOPTIMER(CWorldEditingProfile::PTI_AMBIENTFILL);
 
   // find gradient layer
-  CGradientParameters gpGradient;
-  BOOL  bHasGradient   = FALSE;
-  ULONG ulGradientType = lm_pbpoPolygon->bpo_bppProperties.bpp_ubGradientType;
-  if( ulGradientType>0) {
-    CEntity *pen = lm_pbpoPolygon->bpo_pbscSector->bsc_pbmBrushMip->bm_pbrBrush->br_penEntity;
-    if( pen!=NULL) bHasGradient = pen->GetGradient( ulGradientType, gpGradient);
-  }
+  const CGradientParameters &gpGradient = lm_psmi->smi_gpGradient;
+  const BOOL bHasGradient = lm_psmi->smi_bHasGradient;
   // add gradient if gradient is light
   if( bHasGradient && !gpGradient.gp_bDark) AddOneLayerGradient( gpGradient);
 
   // for each shadow layer
-  lm_pbsmShadowMap->sm_ulFlags &= ~SMF_ANIMATINGLIGHTS;
-  {FORDELETELIST( CBrushShadowLayer, bsl_lnInShadowMap, lm_pbsmShadowMap->bsm_lhLayers, itbsl)
+  lm_bAnimatingLights = FALSE;
+  for( INDEX iLayer=0; iLayer<lm_psmi->smi_asmlLayers.Count(); iLayer++)
   {
-    CBrushShadowLayer &bsl = *itbsl;
-    ASSERT( bsl.bsl_plsLightSource!=NULL);
-    if( bsl.bsl_plsLightSource==NULL) continue; // safety check
-    CLightSource &ls = *bsl.bsl_plsLightSource;
+    const CShadowMixLayer &sml = lm_psmi->smi_asmlLayers[iLayer];
+    const ULONG ulLightFlags = sml.sml_ulLightFlags;
 
     // skip if should not be applied
-    if( (bDynamicOnly && !(ls.ls_ulFlags&LSF_NONPERSISTENT)) || ls.ls_ulFlags&LSF_DYNAMIC) continue;
+    if( (bDynamicOnly && !(ulLightFlags&LSF_NONPERSISTENT)) || ulLightFlags&LSF_DYNAMIC) continue;
 
     // set corresponding shadowmap flag if this is an animating light
-    if( ls.ls_paoLightAnimation!=NULL) lm_pbsmShadowMap->sm_ulFlags |= SMF_ANIMATINGLIGHTS;
+    if( sml.sml_bAnimating) lm_bAnimatingLights = TRUE;
 
     // if the layer is calculated
+    CBrushShadowLayer &bsl = *sml.sml_pbsl;
     if( bsl.bsl_pubLayer!=NULL)
     {
       UBYTE *pub;
       UBYTE ubMask;
-      FindLayerMipmap( itbsl, pub, ubMask);
+      FindLayerMipmap( &bsl, pub, ubMask);
       // add the layer to the shadow map with masking
-      if( ls.ls_ulFlags&LSF_DIRECTIONAL) {
-        AddOneLayerDirectional( itbsl, pub, ubMask);
+      if( ulLightFlags&LSF_DIRECTIONAL) {
+        AddOneLayerDirectional( sml, pub, ubMask);
       } else {
-        AddOneLayerPoint( itbsl, pub, ubMask);
+        AddOneLayerPoint( sml, pub, ubMask);
       }
     }
     // if the layer is all light
     else if( !(bsl.bsl_ulFlags&BSLF_CALCULATED) || (bsl.bsl_ulFlags&BSLF_ALLLIGHT))
     {
       // add the layer to the shadow map without masking
-      if( ls.ls_ulFlags&LSF_DIRECTIONAL) {
-        AddOneLayerDirectional( itbsl, NULL);
+      if( ulLightFlags&LSF_DIRECTIONAL) {
+        AddOneLayerDirectional( sml, NULL);
       } else {
-        AddOneLayerPoint( itbsl, NULL);
+        AddOneLayerPoint( sml, NULL);
       }
     }
-  }}
+  }
 
   // if gradient is dark, substract gradient
   if( bHasGradient && gpGradient.gp_bDark) AddOneLayerGradient( gpGradient);
 
+  // background mixer leaves filtering to main thread (filters are not thread safe)
+  if( !lm_bAsync) {
+    if( lm_bAnimatingLights) lm_pbsmShadowMap->sm_ulFlags |=  SMF_ANIMATINGLIGHTS;
+    else                     lm_pbsmShadowMap->sm_ulFlags &= ~SMF_ANIMATINGLIGHTS;
+    FilterOneMipmap();
+  }
+
+#if WITH_BOUND_CHECK
+  for (int i = g_pbsm->sm_slMemoryUsed; i < g_pbsm->sm_slMemoryUsed * 2; i++) {
+    if (((UBYTE *) lm_pulShadowMap)[i]) {
+      FatalError("Invalid write");
+    }
+  }
+  FreeMemory(lm_pulShadowMap);
+#endif
+}
+
+
+
+// filter and dither one mixed mip-map
+void CLayerMixer::FilterOneMipmap(void)
+{
   // do eventual filtering of shadow layer
   shd_iFiltering = Clamp( shd_iFiltering, 0L, +6L);
   if( shd_iFiltering>0) {
@@ -1469,19 +1492,9 @@ void CLayerMixer::MixOneMipmap(CBrushShadowMap *pbsm, INDEX iMipmap)
     DitherBitmap( iDither, lm_pulShadowMap, lm_pulShadowMap,
                   lm_pixPolygonSizeU, lm_pixPolygonSizeV, lm_pixCanvasSizeU, lm_pixCanvasSizeV);
   }
-
-#if WITH_BOUND_CHECK
-  for (int i = g_pbsm->sm_slMemoryUsed; i < g_pbsm->sm_slMemoryUsed * 2; i++) {
-    if (((UBYTE *) lm_pulShadowMap)[i]) {
-      FatalError("Invalid write");
-    }
-  }
-  FreeMemory(lm_pulShadowMap);
-#endif
 }
 
 
-
 // copy from static shadow map to dynamic layer
 __forceinline void CLayerMixer::CopyShadowLayer(void)
 {
@@ -1538,18 +1551,13 @@ void CLayerMixer::MixOneMipmapDynamic( CBrushShadowMap *pbsm, INDEX iMipmap)
   }
 
   // for each shadow layer
-  {FORDELETELIST( CBrushShadowLayer, bsl_lnInShadowMap, lm_pbsmShadowMap->bsm_lhLayers, itbsl)
-  { // the layer's light source must be valid
-    CBrushShadowLayer &bsl = *itbsl;
-    CLightSource &ls = *bsl.bsl_plsLightSource;
-    ASSERT( &ls!=NULL);
-    if( !(ls.ls_ulFlags&LSF_DYNAMIC)) continue;
-    COLOR colLight = ls.GetLightColor() & ~CT_AMASK;
-    if( IsBlack(colLight)) continue;
-    // apply one layer
-    colLight = AdjustColor( colLight, _slShdHueShift, _slShdSaturation);
-    AddOneLayerPoint( itbsl, NULL);
-  }}
+  for( INDEX iLayer=0; iLayer<lm_psmi->smi_asmlLayers.Count(); iLayer++)
+  { // apply one layer if its light is dynamic and not black
+    const CShadowMixLayer &sml = lm_psmi->smi_asmlLayers[iLayer];
+    if( !(sml.sml_ulLightFlags&LSF_DYNAMIC)) continue;
+    if( IsBlack( sml.sml_colLight & ~CT_AMASK)) continue;
+    AddOneLayerPoint( sml, NULL);
+  }
 }
 
 
@@ -1557,6 +1565,10 @@ void CLayerMixer::MixOneMipmapDynamic( CBrushShadowMap *pbsm, INDEX iMipmap)
 CLayerMixer::CLayerMixer( CBrushShadowMap *pbsm, INDEX iFirstMip, INDEX iLastMip, BOOL bDynamic)
 {
   lm_bDynamic = bDynamic;
+  lm_bAsync = FALSE;
+  lm_pulTarget = NULL;
+  lm_slTargetSize = 0;
+  lm_psmi = &lm_smiTaken;
   if( bDynamic) {
     // check dynamic layers for complete blackness
     BOOL bAllBlack = TRUE;
@@ -1575,22 +1587,143 @@ CLayerMixer::CLayerMixer( CBrushShadowMap *pbsm, INDEX iFirstMip, INDEX iLastMip
       return;
     }
     // need to mix in
+    pbsm->TakeMixInputs( lm_smiTaken, TRUE);
     for( INDEX iMipmap=iFirstMip; iMipmap<=iLastMip; iMipmap++) MixOneMipmapDynamic( pbsm, iMipmap);
   }
   // mix static layers
   else {
+    pbsm->TakeMixInputs( lm_smiTaken, FALSE);
     for( INDEX iMipmap=iFirstMip; iMipmap<=iLastMip; iMipmap++) MixOneMipmap( pbsm, iMipmap);
   }
 }
 
 
+// constructor for background mixing
+CLayerMixer::CLayerMixer( ULONG *pulTarget, SLONG slTargetSize, const CShadowMixInputs &smi)
+{
+  lm_bDynamic = FALSE;
+  lm_bAsync = pulTarget!=NULL;
+  lm_pulTarget = pulTarget;
+  lm_slTargetSize = slTargetSize;
+  lm_bAnimatingLights = FALSE;
+  lm_psmi = &smi;
+}
+
+
 // mix all layers into cached shadow map
 void CBrushShadowMap::MixLayers( INDEX iFirstMip, INDEX iLastMip, BOOL bDynamic/*=FALSE*/)
 {
   _sfStats.StartTimer( CStatForm::STI_SHADOWUPDATE);
   _pfWorldEditingProfile.StartTimer( CWorldEditingProfile::PTI_MIXLAYERS);
-  // mix the layers with a shadow mixer
-  CLayerMixer lmMixer( this, iFirstMip, iLastMip, bDynamic);
+  // static layers might have been mixed already in some previous run
+  ULONG ulParamsCRC, ulLayersCRC;
+  if( !bDynamic && GetPersistentCacheKey( ulParamsCRC, ulLayersCRC)) {
+    if( LoadFromPersistentCache( ulParamsCRC, ulLayersCRC, iFirstMip, iLastMip)) {
+      // lights in cached shadows never animate
+      sm_ulFlags &= ~SMF_ANIMATINGLIGHTS;
+    } else {
+      CLayerMixer lmMixer( this, iFirstMip, iLastMip, FALSE);
+      StoreToPersistentCache( ulParamsCRC, ulLayersCRC, iFirstMip, iLastMip);
+    }
+  } else {
+    // mix the layers with a shadow mixer
+    CLayerMixer lmMixer( this, iFirstMip, iLastMip, bDynamic);
+  }
   _pfWorldEditingProfile.StopTimer( CWorldEditingProfile::PTI_MIXLAYERS);
   _sfStats.StopTimer( CStatForm::STI_SHADOWUPDATE);
 }
+
+
+// remember current state of lights and polygon for mixing (called on main thread)
+void CBrushShadowMap::TakeMixInputs( CShadowMixInputs &smi, BOOL bDynamic)
+{
+  CBrushPolygon *pbpo = GetBrushPolygon();
+  CEntity *pen = pbpo->bpo_pbscSector->bsc_pbmBrushMip->bm_pbrBrush->br_penEntity;
+  ASSERT( pen!=NULL);
+  smi.smi_ulPolygonFlags   = pbpo->bpo_ulFlags;
+  smi.smi_colSectorAmbient = pbpo->bpo_pbscSector->bsc_colAmbient;
+  smi.smi_plAbsolute = pbpo->bpo_pbplPlane->bpl_plAbsolute;
+  smi.smi_mvRelative = pbpo->bpo_pbplPlane->bpl_pwplWorking->wpl_mvRelative;
+  smi.smi_mRotation  = pen->en_mRotation;
+  smi.smi_vPosition  = pen->GetPlacement().pl_PositionVector;
+  // gradients are applied only to static layers
+  smi.smi_bHasGradient = FALSE;
+  const ULONG ulGradientType = pbpo->bpo_bppProperties.bpp_ubGradientType;
+  if( !bDynamic && ulGradientType>0) {
+    smi.smi_bHasGradient = pen->GetGradient( ulGradientType, smi.smi_gpGradient);
+  }
+
+  // for each layer with valid light source
+  smi.smi_asmlLayers.PopAll();
+  FOREACHINLIST( CBrushShadowLayer, bsl_lnInShadowMap, bsm_lhLayers, itbsl) {
+    CBrushShadowLayer &bsl = *itbsl;
+    ASSERT( bsl.bsl_plsLightSource!=NULL);
+    if( bsl.bsl_plsLightSource==NULL) continue; // safety check
+    CLightSource &ls = *bsl.bsl_plsLightSource;
+    const CPlacement3D &plLight = ls.ls_penEntity->GetPlacement();
+    CShadowMixLayer &sml = smi.smi_asmlLayers.Push();
+    sml.sml_pbsl = &bsl;
+    sml.sml_ulLightFlags = ls.ls_ulFlags;
+    sml.sml_vLight = plLight.pl_PositionVector;
+    if( ls.ls_ulFlags&LSF_DIRECTIONAL) {
+      AnglesToDirectionVector( plLight.pl_OrientationAngle, sml.sml_vLightDirection);
+    } else {
+      sml.sml_vLightDirection = FLOAT3D(0,0,0);
+    }
+    sml.sml_rHotSpot   = ls.ls_rHotSpot;
+    sml.sml_rFallOff   = ls.ls_rFallOff;
+    sml.sml_colLight   = ls.GetLightColor();
+    sml.sml_colAmbient = ls.GetLightAmbient();
+    sml.sml_colAmbientBase = ls.ls_colAmbient;
+    sml.sml_bAnimating = ls.ls_paoLightAnimation!=NULL;
+    // remember color of layers that are mixed, so animation changes can be detected
+    if( (ls.ls_ulFlags&LSF_DYNAMIC) ? bDynamic : !bDynamic) bsl.bsl_colLastAnim = sml.sml_colLight;
+  }
+}
+
+
+// remember lights for background mixing (returns FALSE if it cannot or need not be mixed in background)
+BOOL CBrushShadowMap::PrepareBackgroundMixing( INDEX iFirstMip, INDEX iLastMip, CShadowMixInputs &smi)
+{
+  // mip-maps from persistent cache are loaded faster than a task would be started
+  ULONG ulParamsCRC, ulLayersCRC;
+  if( GetPersistentCacheKey( ulParamsCRC, ulLayersCRC)) {
+    INDEX iMip=iFirstMip;
+    for( ; iMip<=iLastMip; iMip++) {
+      if( !_shcShadowCache.Contains( ulParamsCRC, ulLayersCRC, iMip)) break;
+    }
+    if( iMip>iLastMip) return FALSE;
+  }
+  // lights and entities cannot be read from worker threads, so everything is taken now
+  FOREACHINLIST( CBrushShadowLayer, bsl_lnInShadowMap, bsm_lhLayers, itbsl) {
+    if( itbsl->bsl_plsLightSource==NULL) return FALSE;
+  }
+  TakeMixInputs( smi, FALSE);
+  return TRUE;
+}
+
+
+// mix static layers into given buffer (called from a worker thread)
+void CBrushShadowMap::MixLayersInBackground( ULONG *pulShadowMap, SLONG slMemoryUsed, INDEX iFirstMip, INDEX iLastMip,
+                                             const CShadowMixInputs &smi, BOOL &bAnimatingLights)
+{
+  CLayerMixer lmMixer( pulShadowMap, slMemoryUsed, smi);
+  for( INDEX iMipmap=iFirstMip; iMipmap<=iLastMip; iMipmap++) lmMixer.MixOneMipmap( this, iMipmap);
+  bAnimatingLights = lmMixer.lm_bAnimatingLights;
+}
+
+
+// filter layers that were mixed in background (called on main thread once they are cached)
+void CBrushShadowMap::FinishBackgroundMixing( INDEX iFirstMip, INDEX iLastMip, const CShadowMixInputs &smi)
+{
+  CLayerMixer lmMixer( NULL, 0, smi);
+  for( INDEX iMipmap=iFirstMip; iMipmap<=iLastMip; iMipmap++) {
+    lmMixer.CalculateData( this, iMipmap);
+    lmMixer.FilterOneMipmap();
+  }
+  // remember them for next runs
+  ULONG ulParamsCRC, ulLayersCRC;
+  if( GetPersistentCacheKey( ulParamsCRC, ulLayersCRC)) {
+    StoreToPersistentCache( ulParamsCRC, ulLayersCRC, iFirstMip, iLastMip);
+  }
+}
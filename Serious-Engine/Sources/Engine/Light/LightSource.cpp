@@ -174,9 +174,25 @@ void CLightSource::UncacheShadowMaps(void)
   }
 }
 
+// stop background mixing of shadow maps that have layers from this light
+static void StopMixingLayers(CLightSource &ls)
+{
+  // dynamic layers are never mixed in background
+  if (ls.ls_ulFlags&LSF_DYNAMIC) {
+    return;
+  }
+  // for each shadow layer
+  FOREACHINLIST(CBrushShadowLayer, bsl_lnInLightSource, ls.ls_lhLayers, itbsl) {
+    // its shadow map will have to be mixed again anyway
+    itbsl->bsl_pbsmShadowMap->FinishBackgroundCache(TRUE);
+  }
+}
+
 // discard all linked shadow layers
 void CLightSource::DiscardShadowLayers(void)
 {
+  // layers must not be mixed in background while they change
+  StopMixingLayers(*this);
   // for each shadow layer
   FORDELETELIST(CBrushShadowLayer, bsl_lnInLightSource, ls_lhLayers, itbsl) {
     // invalidate its shadow map
@@ -525,6 +541,8 @@ void CLightSource::FindShadowLayersPoint(BOOL bSelectedOnly)
 
 void CLightSource::FindShadowLayers(BOOL bSelectedOnly)
 {
+  // layers must not be mixed in background while they change
+  StopMixingLayers(*this);
   // if the light is used for lens flares only
   if (ls_ulFlags&LSF_LENSFLAREONLY) {
     // do nothing
@@ -0,0 +1,531 @@
+/* Copyright (c) 2002-2012 Croteam Ltd.
+This program is free software; you can redistribute it and/or modify
+it under the terms of version 2 of the GNU General Public License as published by
+the Free Software Foundation
+
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA. */
+
+#include "StdH.h"
+
+#include <Engine/Light/ShadowCache.h>
+#include <Engine/Brushes/Brush.h>
+#include <Engine/Light/LightSource.h>
+#include <Engine/Light/Gradient.h>
+#include <Engine/World/World.h>
+#include <Engine/Entities/Entity.h>
+#include <Engine/Base/Console.h>
+#include <Engine/Base/Translation.h>
+#include <Engine/Base/Stream.h>
+#include <Engine/Base/Memory.h>
+#include <Engine/Base/CRC.h>
+#include <Engine/Base/ListIterator.inl>
+#include <Engine/Graphics/GfxLibrary.h>
+#include <Engine/Templates/StaticArray.cpp>
+#include <Engine/Templates/StaticStackArray.cpp>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+extern INDEX shd_iFiltering;
+extern INDEX shd_iDithering;
+extern SLONG _slShdSaturation;
+extern SLONG _slShdHueShift;
+extern INDEX shd_bPersistentCache;
+extern INDEX shd_iPersistentCacheMB;
+
+// cache of the world that is currently played
+CShadowCache _shcShadowCache;
+
+#define SHADOWCACHE_ID    (('S')|('H'<<8)|('C'<<16)|('F'<<24))
+#define NEWHASH_BUCKETS   4096
+#define TEXELS_ALIGNMENT  16
+
+
+// get cache file name for a world
+static CTFileName CacheFileName( const CTFileName &fnmWorld)
+{
+  // different worlds with same name may exist in different directories
+  ULONG ulPathCRC;
+  CRC_Start( ulPathCRC);
+  CRC_AddBlock( ulPathCRC, (UBYTE*)(const char*)fnmWorld, strlen(fnmWorld));
+  CRC_Finish( ulPathCRC);
+  CTString strName;
+  strName.PrintF( "Temp\\Shadows_%s_%08X.shc", (const char*)fnmWorld.FileName(), ulPathCRC);
+  return CTFileName(strName);
+}
+
+
+// compare cache entries by their keys
+static int qsort_CompareEntries( const void *pv0, const void *pv1)
+{
+  const CShadowCacheEntry &sce0 = *(const CShadowCacheEntry*)pv0;
+  const CShadowCacheEntry &sce1 = *(const CShadowCacheEntry*)pv1;
+  if( sce0.sce_ulParamsCRC<sce1.sce_ulParamsCRC) return -1;
+  if( sce0.sce_ulParamsCRC>sce1.sce_ulParamsCRC) return +1;
+  if( sce0.sce_ulLayersCRC<sce1.sce_ulLayersCRC) return -1;
+  if( sce0.sce_ulLayersCRC>sce1.sce_ulLayersCRC) return +1;
+  if( sce0.sce_ulMipLevel <sce1.sce_ulMipLevel)  return -1;
+  if( sce0.sce_ulMipLevel >sce1.sce_ulMipLevel)  return +1;
+  return 0;
+}
+
+
+CShadowCache::CShadowCache(void)
+{
+  shc_pwoWorld = NULL;
+  shc_ulWorldCRC = 0;
+  shc_iFile = -1;
+  shc_slFileSize = 0;
+  shc_ctHits = 0;
+  shc_ctMisses = 0;
+  shc_aubNewTexels.SetAllocationStep(256*1024);
+  shc_asceNew.SetAllocationStep(256);
+  shc_aiNewNext.SetAllocationStep(256);
+}
+
+CShadowCache::~CShadowCache(void)
+{
+  // nothing can be saved this late
+  Unmap();
+}
+
+
+// release loaded file
+void CShadowCache::Unmap(void)
+{
+  if( shc_iFile>=0) close( shc_iFile);
+  shc_iFile = -1;
+  shc_slFileSize = 0;
+  shc_asceLoaded.Clear();
+  shc_aubLoadedUsed.Clear();
+}
+
+
+// get CRC of world file (throws if it cannot be read)
+ULONG CShadowCache::GetWorldCRC_t( const CTFileName &fnmWorld)
+{
+  // reading whole world is slow, so it is done only once per run unless the file changes
+  const SLONG slTimeStamp = GetFileTimeStamp_t( fnmWorld);
+  for( INDEX iWorld=0; iWorld<shc_ascwWorlds.Count(); iWorld++) {
+    const CShadowCacheWorld &scw = shc_ascwWorlds[iWorld];
+    if( scw.scw_fnmWorld==fnmWorld && scw.scw_slTimeStamp==slTimeStamp) return scw.scw_ulWorldCRC;
+  }
+  const ULONG ulWorldCRC = GetFileCRC32_t( fnmWorld);
+  CShadowCacheWorld &scw = shc_ascwWorlds.Push();
+  scw.scw_fnmWorld    = fnmWorld;
+  scw.scw_slTimeStamp = slTimeStamp;
+  scw.scw_ulWorldCRC  = ulWorldCRC;
+  return ulWorldCRC;
+}
+
+
+// start using the cache for a world that was just loaded
+void CShadowCache::Open( CWorld *pwo)
+{
+  Close();
+  if( !shd_bPersistentCache || pwo==NULL || pwo->wo_fnmFileName=="") return;
+
+  // world contents must be same as when cache was made
+  ULONG ulWorldCRC;
+  try {
+    ulWorldCRC = GetWorldCRC_t( pwo->wo_fnmFileName);
+  } catch( const char *strError) {
+    CPrintF( TRANS("Cannot use shadow cache: %s\n"), strError);
+    return;
+  }
+  shc_pwoWorld   = pwo;
+  shc_ulWorldCRC = ulWorldCRC;
+  shc_fnmFile    = CacheFileName( pwo->wo_fnmFileName);
+  shc_aiNewHash.Push(NEWHASH_BUCKETS);
+  for( INDEX iBucket=0; iBucket<NEWHASH_BUCKETS; iBucket++) shc_aiNewHash[iBucket] = -1;
+
+  // open the cache file if it exists
+  CTFileName fnmExpanded;
+  if( ExpandFilePath( EFP_READ|EFP_NOZIPS, shc_fnmFile, fnmExpanded)!=EFP_FILE) return;
+  shc_iFile = open( fnmExpanded, O_RDONLY);
+  if( shc_iFile<0) return;
+  struct stat stFile;
+  CShadowCacheHeader sch;
+  if( fstat( shc_iFile, &stFile)!=0 || stFile.st_size<(off_t)sizeof(sch) || stFile.st_size>0x7FFFFFFF
+   || pread( shc_iFile, &sch, sizeof(sch), 0)!=(ssize_t)sizeof(sch)) {
+    Unmap();
+    return;
+  }
+  shc_slFileSize = stFile.st_size;
+
+  // check that it belongs to this version of the world
+  const ULONG ulMaxEntries = (shc_slFileSize-sizeof(CShadowCacheHeader)) / sizeof(CShadowCacheEntry);
+  if( sch.sch_ulID!=SHADOWCACHE_ID || sch.sch_ulVersion!=SHADOWCACHE_VERSION
+   || sch.sch_ulWorldCRC!=shc_ulWorldCRC || sch.sch_ctEntries>ulMaxEntries) {
+    // outdated, will be overwritten
+    Unmap();
+    return;
+  }
+  // only the table is read now, texels are read directly to shadow maps
+  const INDEX ctEntries = sch.sch_ctEntries;
+  const ULONG ulTableEnd = sizeof(CShadowCacheHeader) + ctEntries*sizeof(CShadowCacheEntry);
+  if( ctEntries>0) {
+    shc_asceLoaded.New(ctEntries);
+    shc_aubLoadedUsed.New(ctEntries);
+    const ssize_t slTableSize = ctEntries*sizeof(CShadowCacheEntry);
+    if( pread( shc_iFile, &shc_asceLoaded[0], slTableSize, sizeof(CShadowCacheHeader))!=slTableSize) {
+      Unmap();
+      return;
+    }
+    memset( &shc_aubLoadedUsed[0], 0, ctEntries);
+  }
+  // drop file if some entry points outside of it
+  for( INDEX iEntry=0; iEntry<ctEntries; iEntry++) {
+    const CShadowCacheEntry &sce = shc_asceLoaded[iEntry];
+    if( sce.sce_ulOffset<ulTableEnd || sce.sce_ulOffset>(ULONG)shc_slFileSize
+     || sce.sce_ulSize>(ULONG)shc_slFileSize-sce.sce_ulOffset) {
+      Unmap();
+      return;
+    }
+  }
+}
+
+
+// stop using the cache (saves new entries)
+void CShadowCache::Close(void)
+{
+  if( shc_pwoWorld==NULL) return;
+  // save only if something was added
+  if( shc_asceNew.Count()>0) {
+    try {
+      Save_t();
+      CPrintF( TRANS("Shadow cache: %d mip-maps reused, %d mixed and saved\n"), shc_ctHits, shc_asceNew.Count());
+    } catch( const char *strError) {
+      CPrintF( TRANS("Cannot save shadow cache: %s\n"), strError);
+    }
+  }
+  Unmap();
+  shc_asceNew.PopAll();
+  shc_aubNewTexels.PopAll();
+  shc_aiNewHash.PopAll();
+  shc_aiNewNext.PopAll();
+  shc_pwoWorld = NULL;
+  shc_ctHits = 0;
+  shc_ctMisses = 0;
+}
+
+
+// write loaded and new entries to the file
+void CShadowCache::Save_t(void)
+{
+  // mip-maps mixed or used in this run are kept first, others only while there is room
+  const ULONG ulMaxTexels = Clamp( shd_iPersistentCacheMB, 0L, 1024L) *1024*1024;
+  const INDEX ctLoaded = shc_asceLoaded.Count();
+  CStaticStackArray<CShadowCacheEntry> asceAll;
+  ULONG ulTexels = 0;
+  INDEX iNew;
+  for( iNew=0; iNew<shc_asceNew.Count(); iNew++) {
+    const CShadowCacheEntry &sce = shc_asceNew[iNew];
+    if( sce.sce_ulSize>ulMaxTexels-ulTexels) continue;
+    ulTexels += sce.sce_ulSize;
+    asceAll.Push() = sce;
+    // mark as new by offset past loaded file
+    asceAll[asceAll.Count()-1].sce_ulOffset += shc_slFileSize;
+  }
+  for( INDEX iPass=0; iPass<2; iPass++) {
+    for( INDEX iLoaded=0; iLoaded<ctLoaded; iLoaded++) {
+      const CShadowCacheEntry &sce = shc_asceLoaded[iLoaded];
+      if( shc_aubLoadedUsed[iLoaded]!=(iPass==0) || sce.sce_ulSize>ulMaxTexels-ulTexels) continue;
+      ulTexels += sce.sce_ulSize;
+      asceAll.Push() = sce;
+    }
+  }
+  const INDEX ctEntries = asceAll.Count();
+  if( ctEntries>0) qsort( &asceAll[0], ctEntries, sizeof(CShadowCacheEntry), qsort_CompareEntries);
+
+  // lay out texels after the table, remembering where they come from
+  CStaticArray<ULONG> aulSource;
+  aulSource.New(ctEntries);
+  ULONG ulOffset = sizeof(CShadowCacheHeader) + ctEntries*sizeof(CShadowCacheEntry);
+  INDEX iEntry;
+  for( iEntry=0; iEntry<ctEntries; iEntry++) {
+    CShadowCacheEntry &sce = asceAll[iEntry];
+    aulSource[iEntry] = sce.sce_ulOffset;
+    ulOffset = (ulOffset+TEXELS_ALIGNMENT-1) & ~(TEXELS_ALIGNMENT-1);
+    sce.sce_ulOffset = ulOffset;
+    ulOffset += sce.sce_ulSize;
+  }
+
+  // write to temporary file, because loaded one is still in use
+  CTFileName fnmTemp = shc_fnmFile.NoExt()+".tmp";
+  CTFileStream strmFile;
+  strmFile.Create_t( fnmTemp);
+  CShadowCacheHeader sch;
+  sch.sch_ulID       = SHADOWCACHE_ID;
+  sch.sch_ulVersion  = SHADOWCACHE_VERSION;
+  sch.sch_ulWorldCRC = shc_ulWorldCRC;
+  sch.sch_ctEntries  = ctEntries;
+  strmFile.Write_t( &sch, sizeof(sch));
+  if( ctEntries>0) strmFile.Write_t( &asceAll[0], ctEntries*sizeof(CShadowCacheEntry));
+  static const UBYTE aubPadding[TEXELS_ALIGNMENT] = {0};
+  CStaticStackArray<UBYTE> aubLoaded;
+  ULONG ulWritten = sizeof(CShadowCacheHeader) + ctEntries*sizeof(CShadowCacheEntry);
+  for( iEntry=0; iEntry<ctEntries; iEntry++) {
+    const CShadowCacheEntry &sce = asceAll[iEntry];
+    if( sce.sce_ulOffset>ulWritten) strmFile.Write_t( aubPadding, sce.sce_ulOffset-ulWritten);
+    const ULONG ulSource = aulSource[iEntry];
+    if( ulSource>=(ULONG)shc_slFileSize) {
+      strmFile.Write_t( &shc_aubNewTexels[ulSource-shc_slFileSize], sce.sce_ulSize);
+    } else {
+      // texels of loaded entries are read from old file
+      aubLoaded.PopAll();
+      UBYTE *pubTexels = aubLoaded.Push(sce.sce_ulSize);
+      if( pread( shc_iFile, pubTexels, sce.sce_ulSize, ulSource)!=(ssize_t)sce.sce_ulSize) {
+        ThrowF_t( TRANS("Cannot read from '%s'"), (const char*)shc_fnmFile);
+      }
+      strmFile.Write_t( pubTexels, sce.sce_ulSize);
+    }
+    ulWritten = sce.sce_ulOffset + sce.sce_ulSize;
+  }
+  strmFile.Close();
+
+  // replace old file with the new one
+  Unmap();
+  CTFileName fnmTempExpanded, fnmFileExpanded;
+  ExpandFilePath( EFP_WRITE, fnmTemp, fnmTempExpanded);
+  ExpandFilePath( EFP_WRITE, shc_fnmFile, fnmFileExpanded);
+  if( rename( fnmTempExpanded, fnmFileExpanded)!=0) {
+    ThrowF_t( TRANS("Cannot rename '%s' to '%s'"), (const char*)fnmTemp, (const char*)shc_fnmFile);
+  }
+}
+
+
+// find entry in loaded file (-1 if none)
+INDEX CShadowCache::FindLoaded( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iMipLevel)
+{
+  CShadowCacheEntry sceKey;
+  sceKey.sce_ulParamsCRC = ulParamsCRC;
+  sceKey.sce_ulLayersCRC = ulLayersCRC;
+  sceKey.sce_ulMipLevel  = iMipLevel;
+  INDEX iLow=0, iHigh=shc_asceLoaded.Count()-1;
+  while( iLow<=iHigh) {
+    const INDEX iMiddle = (iLow+iHigh)/2;
+    const int iCompare = qsort_CompareEntries( &sceKey, &shc_asceLoaded[iMiddle]);
+    if( iCompare==0) return iMiddle;
+    if( iCompare<0) iHigh = iMiddle-1;
+    else            iLow  = iMiddle+1;
+  }
+  return -1;
+}
+
+static inline INDEX NewHashBucket( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iMipLevel)
+{
+  return (ulParamsCRC ^ (ulLayersCRC*31) ^ iMipLevel) & (NEWHASH_BUCKETS-1);
+}
+
+// find a new entry
+const CShadowCacheEntry *CShadowCache::FindNew( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iMipLevel)
+{
+  INDEX iEntry = shc_aiNewHash[NewHashBucket( ulParamsCRC, ulLayersCRC, iMipLevel)];
+  while( iEntry>=0) {
+    const CShadowCacheEntry &sce = shc_asceNew[iEntry];
+    if( sce.sce_ulParamsCRC==ulParamsCRC && sce.sce_ulLayersCRC==ulLayersCRC
+     && sce.sce_ulMipLevel==(ULONG)iMipLevel) return &sce;
+    iEntry = shc_aiNewNext[iEntry];
+  }
+  return NULL;
+}
+
+
+// check if a mip-map is cached
+BOOL CShadowCache::Contains( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iMipLevel)
+{
+  if( shc_pwoWorld==NULL) return FALSE;
+  return FindLoaded( ulParamsCRC, ulLayersCRC, iMipLevel)>=0
+      || FindNew( ulParamsCRC, ulLayersCRC, iMipLevel)!=NULL;
+}
+
+
+// copy mixed mip-map from cache (returns FALSE if not cached)
+BOOL CShadowCache::Load( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iMipLevel, ULONG *pulTexels, SLONG slSize)
+{
+  if( shc_pwoWorld==NULL) return FALSE;
+  // loaded texels are read from file straight into the shadow map
+  const INDEX iLoaded = FindLoaded( ulParamsCRC, ulLayersCRC, iMipLevel);
+  if( iLoaded>=0) {
+    const CShadowCacheEntry &sce = shc_asceLoaded[iLoaded];
+    if( sce.sce_ulSize==(ULONG)slSize && pread( shc_iFile, pulTexels, slSize, sce.sce_ulOffset)==(ssize_t)slSize) {
+      shc_aubLoadedUsed[iLoaded] = TRUE;
+      shc_ctHits++;
+      return TRUE;
+    }
+    shc_ctMisses++;
+    return FALSE;
+  }
+  const CShadowCacheEntry *psce = FindNew( ulParamsCRC, ulLayersCRC, iMipLevel);
+  if( psce==NULL || psce->sce_ulSize!=(ULONG)slSize) {
+    shc_ctMisses++;
+    return FALSE;
+  }
+  memcpy( pulTexels, &shc_aubNewTexels[psce->sce_ulOffset], slSize);
+  shc_ctHits++;
+  return TRUE;
+}
+
+
+// add mixed mip-map to cache
+void CShadowCache::Store( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iMipLevel, const ULONG *pulTexels, SLONG slSize)
+{
+  if( shc_pwoWorld==NULL || Contains( ulParamsCRC, ulLayersCRC, iMipLevel)) return;
+  const INDEX iEntry = shc_asceNew.Count();
+  CShadowCacheEntry &sce = shc_asceNew.Push();
+  sce.sce_ulParamsCRC = ulParamsCRC;
+  sce.sce_ulLayersCRC = ulLayersCRC;
+  sce.sce_ulMipLevel  = iMipLevel;
+  sce.sce_ulSize      = slSize;
+  sce.sce_ulOffset    = shc_aubNewTexels.Count();
+  memcpy( shc_aubNewTexels.Push(slSize), pulTexels, slSize);
+  // link in hash
+  const INDEX iBucket = NewHashBucket( ulParamsCRC, ulLayersCRC, iMipLevel);
+  shc_aiNewNext.Push() = shc_aiNewHash[iBucket];
+  shc_aiNewHash[iBucket] = iEntry;
+}
+
+
+// get keys of static layers for persistent shadow cache (returns FALSE if it cannot be cached)
+BOOL CBrushShadowMap::GetPersistentCacheKey( ULONG &ulParamsCRC, ULONG &ulLayersCRC)
+{
+  CBrushPolygon *pbpo = GetBrushPolygon();
+  CBrushSector  *pbsc = pbpo->bpo_pbscSector;
+  CEntity *penBrush = pbsc->bsc_pbmBrushMip->bm_pbrBrush->br_penEntity;
+  if( penBrush==NULL || !_shcShadowCache.IsOpenFor(penBrush->en_pwoWorld)) return FALSE;
+
+  CRC_Start( ulParamsCRC);
+  CRC_Start( ulLayersCRC);
+  // mixing settings
+  CRC_AddLONG( ulParamsCRC, shd_iFiltering);
+  CRC_AddLONG( ulParamsCRC, shd_iDithering);
+  CRC_AddLONG( ulParamsCRC, _slShdSaturation);
+  CRC_AddLONG( ulParamsCRC, _slShdHueShift);
+  // shadow map and polygon
+  CRC_AddLONG( ulParamsCRC, sm_mexOffsetX);
+  CRC_AddLONG( ulParamsCRC, sm_mexOffsetY);
+  CRC_AddLONG( ulParamsCRC, sm_mexWidth);
+  CRC_AddLONG( ulParamsCRC, sm_mexHeight);
+  CRC_AddLONG( ulParamsCRC, sm_iFirstMipLevel);
+  CRC_AddLONG( ulParamsCRC, sm_pixPolygonSizeU);
+  CRC_AddLONG( ulParamsCRC, sm_pixPolygonSizeV);
+  CRC_AddLONG( ulParamsCRC, pbpo->bpo_ulFlags);
+  CRC_AddLONG( ulParamsCRC, pbsc->bsc_colAmbient);
+  const FLOATplane3D &plPolygon = pbpo->bpo_pbplPlane->bpl_plAbsolute;
+  CRC_AddFLOAT( ulParamsCRC, plPolygon(1));
+  CRC_AddFLOAT( ulParamsCRC, plPolygon(2));
+  CRC_AddFLOAT( ulParamsCRC, plPolygon(3));
+  CRC_AddFLOAT( ulParamsCRC, plPolygon.Distance());
+  const CMappingDefinition &md = pbpo->bpo_mdShadow;
+  CRC_AddFLOAT( ulParamsCRC, md.md_fUoS);
+  CRC_AddFLOAT( ulParamsCRC, md.md_fUoT);
+  CRC_AddFLOAT( ulParamsCRC, md.md_fVoS);
+  CRC_AddFLOAT( ulParamsCRC, md.md_fVoT);
+  CRC_AddFLOAT( ulParamsCRC, md.md_fUOffset);
+  CRC_AddFLOAT( ulParamsCRC, md.md_fVOffset);
+  const CPlacement3D &plBrush = penBrush->GetPlacement();
+  for( INDEX i=1; i<=3; i++) {
+    CRC_AddFLOAT( ulParamsCRC, plBrush.pl_PositionVector(i));
+    CRC_AddFLOAT( ulParamsCRC, plBrush.pl_OrientationAngle(i));
+  }
+  // gradient
+  const ULONG ulGradientType = pbpo->bpo_bppProperties.bpp_ubGradientType;
+  CRC_AddLONG( ulParamsCRC, ulGradientType);
+  CGradientParameters gp;
+  if( ulGradientType>0 && penBrush->GetGradient( ulGradientType, gp)) {
+    CRC_AddFLOAT( ulParamsCRC, gp.gp_vGradientDir(1));
+    CRC_AddFLOAT( ulParamsCRC, gp.gp_vGradientDir(2));
+    CRC_AddFLOAT( ulParamsCRC, gp.gp_vGradientDir(3));
+    CRC_AddFLOAT( ulParamsCRC, gp.gp_fH0);
+    CRC_AddFLOAT( ulParamsCRC, gp.gp_fH1);
+    CRC_AddLONG(  ulParamsCRC, gp.gp_bDark);
+    CRC_AddLONG(  ulParamsCRC, gp.gp_col0);
+    CRC_AddLONG(  ulParamsCRC, gp.gp_col1);
+  }
+
+  // static layers
+  FOREACHINLIST( CBrushShadowLayer, bsl_lnInShadowMap, bsm_lhLayers, itbsl) {
+    CBrushShadowLayer &bsl = *itbsl;
+    if( bsl.bsl_plsLightSource==NULL) return FALSE;
+    CLightSource &ls = *bsl.bsl_plsLightSource;
+    if( ls.ls_ulFlags&LSF_DYNAMIC) continue;
+    // animating lights change the result all the time
+    if( ls.ls_paoLightAnimation!=NULL || ls.ls_paoAmbientLightAnimation!=NULL) return FALSE;
+    CRC_AddLONG(  ulParamsCRC, ls.ls_ulFlags);
+    CRC_AddLONG(  ulParamsCRC, ls.GetLightColor());
+    CRC_AddLONG(  ulParamsCRC, ls.GetLightAmbient());
+    CRC_AddFLOAT( ulParamsCRC, ls.ls_rHotSpot);
+    CRC_AddFLOAT( ulParamsCRC, ls.ls_rFallOff);
+    const CPlacement3D &plLight = ls.ls_penEntity->GetPlacement();
+    for( INDEX i=1; i<=3; i++) {
+      CRC_AddFLOAT( ulParamsCRC, plLight.pl_PositionVector(i));
+      CRC_AddFLOAT( ulParamsCRC, plLight.pl_OrientationAngle(i));
+    }
+    CRC_AddLONG( ulLayersCRC, bsl.bsl_ulFlags);
+    CRC_AddLONG( ulLayersCRC, bsl.bsl_pixMinU);
+    CRC_AddLONG( ulLayersCRC, bsl.bsl_pixMinV);
+    CRC_AddLONG( ulLayersCRC, bsl.bsl_pixSizeU);
+    CRC_AddLONG( ulLayersCRC, bsl.bsl_pixSizeV);
+    CRC_AddLONG( ulLayersCRC, bsl.bsl_slSizeInPixels);
+    // masks don't change once calculated, so their CRC is calculated only once
+    if( bsl.bsl_pubLayer!=NULL) {
+      if( bsl.bsl_pubMaskCRC!=bsl.bsl_pubLayer) {
+        CRC_Start( bsl.bsl_ulMaskCRC);
+        CRC_AddBlock( bsl.bsl_ulMaskCRC, bsl.bsl_pubLayer, (bsl.bsl_slSizeInPixels+7)/8);
+        CRC_Finish( bsl.bsl_ulMaskCRC);
+        bsl.bsl_pubMaskCRC = bsl.bsl_pubLayer;
+      }
+      CRC_AddLONG( ulLayersCRC, bsl.bsl_ulMaskCRC);
+    }
+  }
+  CRC_Finish( ulParamsCRC);
+  CRC_Finish( ulLayersCRC);
+  return TRUE;
+}
+
+
+// get texels of one mip-map of static shadow map
+static ULONG *MipmapTexels( CBrushShadowMap &bsm, ULONG *pulShadowMap, SLONG slMemoryUsed, INDEX iMipLevel, SLONG &slSize)
+{
+  const PIX pixSizeU = bsm.sm_mexWidth >>iMipLevel;
+  const PIX pixSizeV = bsm.sm_mexHeight>>iMipLevel;
+  slSize = pixSizeU*pixSizeV*BYTES_PER_TEXEL;
+  return pulShadowMap + slMemoryUsed/BYTES_PER_TEXEL - GetMipmapOffset( 15, pixSizeU, pixSizeV);
+}
+
+
+// load static mip-maps from persistent cache (returns FALSE if some are missing)
+BOOL CBrushShadowMap::LoadFromPersistentCache( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iFirstMip, INDEX iLastMip)
+{
+  // check first so nothing is overwritten if some mip-map is missing
+  for( INDEX iMip=iFirstMip; iMip<=iLastMip; iMip++) {
+    if( !_shcShadowCache.Contains( ulParamsCRC, ulLayersCRC, iMip)) return FALSE;
+  }
+  for( INDEX iMip=iFirstMip; iMip<=iLastMip; iMip++) {
+    SLONG slSize;
+    ULONG *pulTexels = MipmapTexels( *this, sm_pulCachedShadowMap, sm_slMemoryUsed, iMip, slSize);
+    if( !_shcShadowCache.Load( ulParamsCRC, ulLayersCRC, iMip, pulTexels, slSize)) return FALSE;
+  }
+  return TRUE;
+}
+
+
+// save static mip-maps to persistent cache
+void CBrushShadowMap::StoreToPersistentCache( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iFirstMip, INDEX iLastMip)
+{
+  for( INDEX iMip=iFirstMip; iMip<=iLastMip; iMip++) {
+    SLONG slSize;
+    const ULONG *pulTexels = MipmapTexels( *this, sm_pulCachedShadowMap, sm_slMemoryUsed, iMip, slSize);
+    _shcShadowCache.Store( ulParamsCRC, ulLayersCRC, iMip, pulTexels, slSize);
+  }
+}
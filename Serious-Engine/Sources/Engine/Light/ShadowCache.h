@@ -0,0 +1,119 @@
+/* Copyright (c) 2002-2012 Croteam Ltd.
+This program is free software; you can redistribute it and/or modify
+it under the terms of version 2 of the GNU General Public License as published by
+the Free Software Foundation
+
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA. */
+
+#ifndef SE_INCL_SHADOWCACHE_H
+#define SE_INCL_SHADOWCACHE_H
+#ifdef PRAGMA_ONCE
+  #pragma once
+#endif
+
+#include <Engine/Base/FileName.h>
+#include <Engine/Templates/StaticArray.h>
+#include <Engine/Templates/StaticStackArray.h>
+
+/*
+ * Cache file layout (native byte order):
+ *   CShadowCacheHeader
+ *   CShadowCacheEntry[sch_ctEntries]   (sorted by key)
+ *   texels of each entry               (aligned to 16 bytes)
+ */
+
+#define SHADOWCACHE_VERSION 2
+
+class CShadowCacheHeader {
+public:
+  ULONG sch_ulID;         // 'SHCF'
+  ULONG sch_ulVersion;    // SHADOWCACHE_VERSION
+  ULONG sch_ulWorldCRC;   // CRC of world file that the cache was made for
+  ULONG sch_ctEntries;    // number of mixed mip-maps in file
+};
+
+// one mixed mip-map of a shadow map
+class CShadowCacheEntry {
+public:
+  ULONG sce_ulParamsCRC;  // CRC of shadow map, polygon and light parameters
+  ULONG sce_ulLayersCRC;  // CRC of all shadow layer masks
+  ULONG sce_ulMipLevel;   // which mip-map this is
+  ULONG sce_ulSize;       // size of texels in bytes
+  ULONG sce_ulOffset;     // offset of texels (from start of file or of new data)
+};
+
+// world file that was already checked in this run
+class CShadowCacheWorld {
+public:
+  CTFileName scw_fnmWorld;
+  SLONG scw_slTimeStamp;  // modification time of the file when CRC was calculated
+  ULONG scw_ulWorldCRC;
+};
+
+// persistent cache of mixed static shadow maps of one world
+class ENGINE_API CShadowCache {
+public:
+  class CWorld *shc_pwoWorld;   // world the cache is used for (NULL if none)
+  CTFileName shc_fnmFile;       // cache file
+  ULONG shc_ulWorldCRC;         // CRC of the world file
+  // cache file as loaded (texels are read from it when needed)
+  int   shc_iFile;              // -1 if not opened
+  SLONG shc_slFileSize;
+  CStaticArray<CShadowCacheEntry> shc_asceLoaded;
+  CStaticArray<UBYTE> shc_aubLoadedUsed;    // which loaded entries were used in this run
+  // mip-maps mixed since the file was loaded
+  CStaticStackArray<CShadowCacheEntry> shc_asceNew;
+  CStaticStackArray<UBYTE> shc_aubNewTexels;
+  CStaticStackArray<INDEX> shc_aiNewHash;   // first new entry in each hash bucket (-1 if none)
+  CStaticStackArray<INDEX> shc_aiNewNext;   // next new entry in same bucket
+  // world files that were already checked (so they are not read again on each load)
+  CStaticStackArray<CShadowCacheWorld> shc_ascwWorlds;
+  // statistics
+  INDEX shc_ctHits;
+  INDEX shc_ctMisses;
+
+  // get CRC of world file (throws if it cannot be read)
+  ULONG GetWorldCRC_t( const CTFileName &fnmWorld);
+  // find entry in loaded file (-1 if none)
+  INDEX FindLoaded( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iMipLevel);
+  // find a new entry
+  const CShadowCacheEntry *FindNew( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iMipLevel);
+  // release loaded file
+  void Unmap(void);
+  // write loaded and new entries to the file
+  void Save_t(void);  // throw char *
+
+public:
+  // constructor/destructor
+  CShadowCache(void);
+  ~CShadowCache(void);
+
+  // start using the cache for a world that was just loaded
+  void Open( CWorld *pwo);
+  // stop using the cache (saves new entries)
+  void Close(void);
+  // check if the cache is used for given world
+  inline BOOL IsOpenFor( CWorld *pwo) const { return pwo!=NULL && shc_pwoWorld==pwo; };
+
+  // copy mixed mip-map from cache (returns FALSE if not cached)
+  BOOL Load( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iMipLevel, ULONG *pulTexels, SLONG slSize);
+  // check if a mip-map is cached
+  BOOL Contains( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iMipLevel);
+  // add mixed mip-map to cache
+  void Store( ULONG ulParamsCRC, ULONG ulLayersCRC, INDEX iMipLevel, const ULONG *pulTexels, SLONG slSize);
+};
+
+// cache of the world that is currently played
+ENGINE_API extern CShadowCache _shcShadowCache;
+
+
+#endif  /* include-once check. */
+
@@ -101,6 +101,8 @@ CModelProfile::CModelProfile(void)
   SETCOUNTERNAME(PCI_SHADOWTRIANGLES_USEDMIP,  "ShadowTriangles_usedmip");
 
   SETCOUNTERNAME(PCI_VIEW_TRIANGLES, "View_Triangles");
+  SETCOUNTERNAME(PCI_VIEW_UNPACKEDFRAMES, "View_UnpackedFrames");
+  SETCOUNTERNAME(PCI_VIEW_SHAREDFRAMES,   "View_SharedFrames");
 
   SETCOUNTERNAME(PCI_MASK_TRIANGLES, "Mask_Triangles");
   SETCOUNTERNAME(PCI_MASK_POLYGONS,  "Mask_Polygons");
@@ -101,6 +101,8 @@ public:
     PCI_SHADOWTRIANGLES_USEDMIP,
 
     PCI_VIEW_TRIANGLES,
+    PCI_VIEW_UNPACKEDFRAMES,
+    PCI_VIEW_SHAREDFRAMES,
 
     PCI_MASK_TRIANGLES,
     PCI_MASK_POLYGONS,
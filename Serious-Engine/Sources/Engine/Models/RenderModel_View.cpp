@@ -17,6 +17,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <Engine/Base/Statistics_Internal.h>
 #include <Engine/Base/Console.h>
+#include <Engine/Base/Shell.h>
+#include <Engine/Base/Timer.h>
+#include <Engine/Base/Translation.h>
 #include <Engine/Models/ModelObject.h>
 #include <Engine/Models/ModelData.h>
 #include <Engine/Models/ModelProfile.h>
@@ -44,6 +47,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define ASMOPT 0
 #define ARRAYBUFFER_OPT 0
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MDL_NEON 1
+#else
+#define MDL_NEON 0
+#endif
+
 extern INDEX mdl_bRenderBump;
 
 extern BOOL CVA_bModels;
@@ -1539,6 +1549,337 @@ static void AttenuateColor( const UBYTE *pshdMip, const INDEX ctVertices)
 }
 
 
+// FRAME UNPACKING KERNELS *****************************************************************************
+
+// number of steps that lerp ratio is quantized to when unpacked frames are shared
+// (only for models that use same frames as another model in same render frame)
+#define SHARED_LERP_STEPS 64
+
+extern INDEX mdl_bShareUnpackedFrames;
+static BOOL _bScalarUnpack = FALSE;  // for benchmarking only
+
+// normals for shading when they are not kept
+static CStaticStackArray<GFXNormal3> _anorUnpack;
+
+
+// unpack (and lerp) 16-bit compressed vertices and normals of a mip
+static void UnpackVertices16( const ModelFrameVertex16 *pFrame0, const ModelFrameVertex16 *pFrame1, FLOAT fRatio,
+                              const UWORD *puwMipToMdl, INDEX ctVx,
+                              FLOAT fOffsetX, FLOAT fOffsetY, FLOAT fOffsetZ,
+                              FLOAT fStretchX, FLOAT fStretchY, FLOAT fStretchZ,
+                              GFXVertex3 *pvtx, GFXNormal3 *pnor)
+{
+  // lerping to ends of interval is same as not lerping
+  if( fRatio==1) { pFrame0 = pFrame1;  fRatio = 0; }
+  if( fRatio==0) pFrame1 = pFrame0;
+  INDEX iMipVx = 0;
+
+#if MDL_NEON
+  if( !_bScalarUnpack) {
+    const float32x4_t vOffsetX  = vdupq_n_f32(fOffsetX);
+    const float32x4_t vOffsetY  = vdupq_n_f32(fOffsetY);
+    const float32x4_t vOffsetZ  = vdupq_n_f32(fOffsetZ);
+    // for each 4 vertices in mip
+    for( ; iMipVx+4<=ctVx; iMipVx+=4) {
+      // gather components of both frames
+      FLOAT afPX0[4], afPY0[4], afPZ0[4], afNX0[4], afNY0[4], afNZ0[4];
+      FLOAT afPX1[4], afPY1[4], afPZ1[4], afNX1[4], afNY1[4], afNZ1[4];
+      for( INDEX i=0; i<4; i++) {
+        const INDEX iMdlVx = puwMipToMdl[iMipVx+i];
+        const ModelFrameVertex16 &mfv0 = pFrame0[iMdlVx];
+        const ModelFrameVertex16 &mfv1 = pFrame1[iMdlVx];
+        afPX0[i] = mfv0.mfv_SWPoint(1);  afPX1[i] = mfv1.mfv_SWPoint(1);
+        afPY0[i] = mfv0.mfv_SWPoint(2);  afPY1[i] = mfv1.mfv_SWPoint(2);
+        afPZ0[i] = mfv0.mfv_SWPoint(3);  afPZ1[i] = mfv1.mfv_SWPoint(3);
+        const FLOAT fCosP0 = pfCosTable[mfv0.mfv_ubNormP];  const FLOAT fCosP1 = pfCosTable[mfv1.mfv_ubNormP];
+        afNX0[i] = -pfSinTable[mfv0.mfv_ubNormH]*fCosP0;    afNX1[i] = -pfSinTable[mfv1.mfv_ubNormH]*fCosP1;
+        afNY0[i] = +pfSinTable[mfv0.mfv_ubNormP];           afNY1[i] = +pfSinTable[mfv1.mfv_ubNormP];
+        afNZ0[i] = -pfCosTable[mfv0.mfv_ubNormH]*fCosP0;    afNZ1[i] = -pfCosTable[mfv1.mfv_ubNormH]*fCosP1;
+      }
+      // lerp, decompress and store
+      float32x4x3_t vVtx, vNor;
+      float32x4_t v0;
+      v0 = vld1q_f32(afPX0);  vVtx.val[0] = vmulq_n_f32( vsubq_f32( vmlaq_n_f32( v0, vsubq_f32(vld1q_f32(afPX1),v0), fRatio), vOffsetX), fStretchX);
+      v0 = vld1q_f32(afPY0);  vVtx.val[1] = vmulq_n_f32( vsubq_f32( vmlaq_n_f32( v0, vsubq_f32(vld1q_f32(afPY1),v0), fRatio), vOffsetY), fStretchY);
+      v0 = vld1q_f32(afPZ0);  vVtx.val[2] = vmulq_n_f32( vsubq_f32( vmlaq_n_f32( v0, vsubq_f32(vld1q_f32(afPZ1),v0), fRatio), vOffsetZ), fStretchZ);
+      v0 = vld1q_f32(afNX0);  vNor.val[0] = vmlaq_n_f32( v0, vsubq_f32(vld1q_f32(afNX1),v0), fRatio);
+      v0 = vld1q_f32(afNY0);  vNor.val[1] = vmlaq_n_f32( v0, vsubq_f32(vld1q_f32(afNY1),v0), fRatio);
+      v0 = vld1q_f32(afNZ0);  vNor.val[2] = vmlaq_n_f32( v0, vsubq_f32(vld1q_f32(afNZ1),v0), fRatio);
+      vst3q_f32( &pvtx[iMipVx].x,  vVtx);
+      vst3q_f32( &pnor[iMipVx].nx, vNor);
+    }
+  }
+#endif
+
+  // for each (remaining) vertex in mip
+  for( ; iMipVx<ctVx; iMipVx++) {
+    const INDEX iMdlVx = puwMipToMdl[iMipVx];
+    const ModelFrameVertex16 &mfv0 = pFrame0[iMdlVx];
+    const ModelFrameVertex16 &mfv1 = pFrame1[iMdlVx];
+    // store lerped vertex
+    GFXVertex3 &vtx = pvtx[iMipVx];
+    vtx.x = (Lerp( (FLOAT)mfv0.mfv_SWPoint(1), (FLOAT)mfv1.mfv_SWPoint(1), fRatio) -fOffsetX) * fStretchX;
+    vtx.y = (Lerp( (FLOAT)mfv0.mfv_SWPoint(2), (FLOAT)mfv1.mfv_SWPoint(2), fRatio) -fOffsetY) * fStretchY;
+    vtx.z = (Lerp( (FLOAT)mfv0.mfv_SWPoint(3), (FLOAT)mfv1.mfv_SWPoint(3), fRatio) -fOffsetZ) * fStretchZ;
+    // store lerped normal
+    const FLOAT fSinH0 = pfSinTable[mfv0.mfv_ubNormH];  const FLOAT fSinH1 = pfSinTable[mfv1.mfv_ubNormH];
+    const FLOAT fSinP0 = pfSinTable[mfv0.mfv_ubNormP];  const FLOAT fSinP1 = pfSinTable[mfv1.mfv_ubNormP];
+    const FLOAT fCosH0 = pfCosTable[mfv0.mfv_ubNormH];  const FLOAT fCosH1 = pfCosTable[mfv1.mfv_ubNormH];
+    const FLOAT fCosP0 = pfCosTable[mfv0.mfv_ubNormP];  const FLOAT fCosP1 = pfCosTable[mfv1.mfv_ubNormP];
+    pnor[iMipVx].nx = Lerp( -fSinH0*fCosP0, -fSinH1*fCosP1, fRatio);
+    pnor[iMipVx].ny = Lerp( +fSinP0,        +fSinP1,        fRatio);
+    pnor[iMipVx].nz = Lerp( -fCosH0*fCosP0, -fCosH1*fCosP1, fRatio);
+  }
+}
+
+
+// unpack (and lerp) 8-bit compressed vertices and normals of a mip
+static void UnpackVertices8( const ModelFrameVertex8 *pFrame0, const ModelFrameVertex8 *pFrame1, FLOAT fRatio,
+                             const UWORD *puwMipToMdl, INDEX ctVx,
+                             FLOAT fOffsetX, FLOAT fOffsetY, FLOAT fOffsetZ,
+                             FLOAT fStretchX, FLOAT fStretchY, FLOAT fStretchZ,
+                             GFXVertex3 *pvtx, GFXNormal3 *pnor)
+{
+  // lerping to ends of interval is same as not lerping
+  if( fRatio==1) { pFrame0 = pFrame1;  fRatio = 0; }
+  if( fRatio==0) pFrame1 = pFrame0;
+  INDEX iMipVx = 0;
+
+#if MDL_NEON
+  if( !_bScalarUnpack) {
+    const float32x4_t vOffsetX  = vdupq_n_f32(fOffsetX);
+    const float32x4_t vOffsetY  = vdupq_n_f32(fOffsetY);
+    const float32x4_t vOffsetZ  = vdupq_n_f32(fOffsetZ);
+    // for each 4 vertices in mip
+    for( ; iMipVx+4<=ctVx; iMipVx+=4) {
+      // gather components of both frames
+      FLOAT afPX0[4], afPY0[4], afPZ0[4], afNX0[4], afNY0[4], afNZ0[4];
+      FLOAT afPX1[4], afPY1[4], afPZ1[4], afNX1[4], afNY1[4], afNZ1[4];
+      for( INDEX i=0; i<4; i++) {
+        const INDEX iMdlVx = puwMipToMdl[iMipVx+i];
+        const ModelFrameVertex8 &mfv0 = pFrame0[iMdlVx];
+        const ModelFrameVertex8 &mfv1 = pFrame1[iMdlVx];
+        afPX0[i] = mfv0.mfv_SBPoint(1);  afPX1[i] = mfv1.mfv_SBPoint(1);
+        afPY0[i] = mfv0.mfv_SBPoint(2);  afPY1[i] = mfv1.mfv_SBPoint(2);
+        afPZ0[i] = mfv0.mfv_SBPoint(3);  afPZ1[i] = mfv1.mfv_SBPoint(3);
+        const FLOAT3D &vNormal0 = avGouraudNormals[mfv0.mfv_NormIndex];
+        const FLOAT3D &vNormal1 = avGouraudNormals[mfv1.mfv_NormIndex];
+        afNX0[i] = vNormal0(1);  afNX1[i] = vNormal1(1);
+        afNY0[i] = vNormal0(2);  afNY1[i] = vNormal1(2);
+        afNZ0[i] = vNormal0(3);  afNZ1[i] = vNormal1(3);
+      }
+      // lerp, decompress and store
+      float32x4x3_t vVtx, vNor;
+      float32x4_t v0;
+      v0 = vld1q_f32(afPX0);  vVtx.val[0] = vmulq_n_f32( vsubq_f32( vmlaq_n_f32( v0, vsubq_f32(vld1q_f32(afPX1),v0), fRatio), vOffsetX), fStretchX);
+      v0 = vld1q_f32(afPY0);  vVtx.val[1] = vmulq_n_f32( vsubq_f32( vmlaq_n_f32( v0, vsubq_f32(vld1q_f32(afPY1),v0), fRatio), vOffsetY), fStretchY);
+      v0 = vld1q_f32(afPZ0);  vVtx.val[2] = vmulq_n_f32( vsubq_f32( vmlaq_n_f32( v0, vsubq_f32(vld1q_f32(afPZ1),v0), fRatio), vOffsetZ), fStretchZ);
+      v0 = vld1q_f32(afNX0);  vNor.val[0] = vmlaq_n_f32( v0, vsubq_f32(vld1q_f32(afNX1),v0), fRatio);
+      v0 = vld1q_f32(afNY0);  vNor.val[1] = vmlaq_n_f32( v0, vsubq_f32(vld1q_f32(afNY1),v0), fRatio);
+      v0 = vld1q_f32(afNZ0);  vNor.val[2] = vmlaq_n_f32( v0, vsubq_f32(vld1q_f32(afNZ1),v0), fRatio);
+      vst3q_f32( &pvtx[iMipVx].x,  vVtx);
+      vst3q_f32( &pnor[iMipVx].nx, vNor);
+    }
+  }
+#endif
+
+  // for each (remaining) vertex in mip
+  for( ; iMipVx<ctVx; iMipVx++) {
+    const INDEX iMdlVx = puwMipToMdl[iMipVx];
+    const ModelFrameVertex8 &mfv0 = pFrame0[iMdlVx];
+    const ModelFrameVertex8 &mfv1 = pFrame1[iMdlVx];
+    // store lerped vertex
+    GFXVertex3 &vtx = pvtx[iMipVx];
+    vtx.x = (Lerp( (FLOAT)mfv0.mfv_SBPoint(1), (FLOAT)mfv1.mfv_SBPoint(1), fRatio) -fOffsetX) * fStretchX;
+    vtx.y = (Lerp( (FLOAT)mfv0.mfv_SBPoint(2), (FLOAT)mfv1.mfv_SBPoint(2), fRatio) -fOffsetY) * fStretchY;
+    vtx.z = (Lerp( (FLOAT)mfv0.mfv_SBPoint(3), (FLOAT)mfv1.mfv_SBPoint(3), fRatio) -fOffsetZ) * fStretchZ;
+    // store lerped normal
+    const FLOAT3D &vNormal0 = avGouraudNormals[mfv0.mfv_NormIndex];
+    const FLOAT3D &vNormal1 = avGouraudNormals[mfv1.mfv_NormIndex];
+    pnor[iMipVx].nx = Lerp( (FLOAT)vNormal0(1), (FLOAT)vNormal1(1), fRatio);
+    pnor[iMipVx].ny = Lerp( (FLOAT)vNormal0(2), (FLOAT)vNormal1(2), fRatio);
+    pnor[iMipVx].nz = Lerp( (FLOAT)vNormal0(3), (FLOAT)vNormal1(3), fRatio);
+  }
+}
+
+
+// calculate vertex shades from normals (light direction is premultiplied by -255)
+static void ShadeVertices( const GFXNormal3 *pnor, SWORD *pswShade, INDEX ctVx,
+                           FLOAT fLightX, FLOAT fLightY, FLOAT fLightZ)
+{
+  INDEX iMipVx = 0;
+#if MDL_NEON
+  if( !_bScalarUnpack) {
+    // for each 4 vertices in mip
+    for( ; iMipVx+4<=ctVx; iMipVx+=4) {
+      const float32x4x3_t vNor = vld3q_f32( &pnor[iMipVx].nx);
+      float32x4_t vDot = vmulq_n_f32( vNor.val[0], fLightX);
+      vDot = vmlaq_n_f32( vDot, vNor.val[1], fLightY);
+      vDot = vmlaq_n_f32( vDot, vNor.val[2], fLightZ);
+      // round same as FloatToInt() (add 0.5 with sign of the value and truncate)
+      const float32x4_t vBias = vreinterpretq_f32_u32( vorrq_u32(
+        vandq_u32( vreinterpretq_u32_f32(vDot), vdupq_n_u32(0x80000000)), vreinterpretq_u32_f32(vdupq_n_f32(0.5f))));
+      vst1_s16( &pswShade[iMipVx], vqmovn_s32( vcvtq_s32_f32( vaddq_f32( vDot, vBias))));
+    }
+  }
+#endif
+  // for each (remaining) vertex in mip
+  for( ; iMipVx<ctVx; iMipVx++) {
+    const GFXNormal3 &nor = pnor[iMipVx];
+    pswShade[iMipVx] = FloatToInt( nor.nx*fLightX + nor.ny*fLightY + nor.nz*fLightZ);
+  }
+}
+
+
+// generate vertex colors from shades (shades may be stored in upper half of color array)
+static void ColorizeVertices( const SWORD *pswShade, GFXColor *pcol, INDEX ctVx)
+{
+  INDEX iMipVx = 0;
+#if MDL_NEON
+  if( !_bScalarUnpack) {
+    const int16x4_t vLight = { (SWORD)_slLR, (SWORD)_slLG, (SWORD)_slLB, 0 };
+    const int32x4_t vAmbR  = vdupq_n_s32(_slAR);
+    const int32x4_t vAmbG  = vdupq_n_s32(_slAG);
+    const int32x4_t vAmbB  = vdupq_n_s32(_slAB);
+    // for each 8 vertices in mip (all shades are read before any color is written,
+    // so colors of 8 vertices cannot overwrite shades that are still needed)
+    for( ; iMipVx+8<=ctVx; iMipVx+=8) {
+      int16x8_t vShade = vld1q_s16( &pswShade[iMipVx]);
+      vShade = vminq_s16( vmaxq_s16( vShade, vdupq_n_s16(0)), vdupq_n_s16(255));
+      const int16x4_t vLo = vget_low_s16(vShade);
+      const int16x4_t vHi = vget_high_s16(vShade);
+      uint8x8x4_t vCol;
+      vCol.val[0] = vqmovn_u16( vcombine_u16(
+        vqmovun_s32( vaddq_s32( vAmbR, vshrq_n_s32( vmull_lane_s16( vLo, vLight, 0), 8))),
+        vqmovun_s32( vaddq_s32( vAmbR, vshrq_n_s32( vmull_lane_s16( vHi, vLight, 0), 8)))));
+      vCol.val[1] = vqmovn_u16( vcombine_u16(
+        vqmovun_s32( vaddq_s32( vAmbG, vshrq_n_s32( vmull_lane_s16( vLo, vLight, 1), 8))),
+        vqmovun_s32( vaddq_s32( vAmbG, vshrq_n_s32( vmull_lane_s16( vHi, vLight, 1), 8)))));
+      vCol.val[2] = vqmovn_u16( vcombine_u16(
+        vqmovun_s32( vaddq_s32( vAmbB, vshrq_n_s32( vmull_lane_s16( vLo, vLight, 2), 8))),
+        vqmovun_s32( vaddq_s32( vAmbB, vshrq_n_s32( vmull_lane_s16( vHi, vLight, 2), 8)))));
+      vCol.val[3] = vmovn_u16( vreinterpretq_u16_s16(vShade));
+      vst4_u8( &pcol[iMipVx].gfxcol.ub.r, vCol);
+    }
+  }
+#endif
+  // for each (remaining) vertex in mip
+  for( ; iMipVx<ctVx; iMipVx++) {
+    GFXColor &col = pcol[iMipVx];
+    const SLONG slShade = Clamp( (SLONG)pswShade[iMipVx], 0L, 255L);
+    col.gfxcol.ub.r = pubClipByte[_slAR + ((_slLR*slShade)>>8)];
+    col.gfxcol.ub.g = pubClipByte[_slAG + ((_slLG*slShade)>>8)];
+    col.gfxcol.ub.b = pubClipByte[_slAB + ((_slLB*slShade)>>8)];
+    col.gfxcol.ub.a = slShade;
+  }
+}
+
+
+// SHARED UNPACKED FRAMES ******************************************************************************
+
+// vertices and normals of a mip unpacked for one model that can be reused by other
+// models that use same frames in same render frame (shades depend on lighting, so they are not shared)
+struct SharedFrame {
+  const ModelMipInfo *sf_pmmi;
+  const void *sf_pvFrame0;
+  const void *sf_pvFrame1;
+  INDEX sf_iRatio;          // quantized lerp ratio
+  FLOAT3D sf_vStretch;
+  FLOAT3D sf_vOffset;
+  INDEX sf_ctVx;
+  INDEX sf_iFirstVx;        // in shared vertex and normal arrays (-1 if not unpacked with quantized ratio yet)
+  INDEX sf_iNext;           // next frame in same hash bucket (-1 if none)
+};
+
+#define SHARED_HASH_SIZE 256
+static CStaticStackArray<SharedFrame> _asfShared;
+static CStaticStackArray<GFXVertex3>  _avtxShared;
+static CStaticStackArray<GFXNormal3>  _anorShared;
+static INDEX _aiSharedHash[SHARED_HASH_SIZE];
+static INDEX _iSharedFrameNumber = -1;
+
+
+static void MakeSharedFrameKey( const CRenderModel &rm, SharedFrame &sf)
+{
+  sf.sf_pmmi     = rm.rm_pmmiMip;
+  sf.sf_pvFrame0 = rm.rm_pFrame16_0;  // same as 8-bit frame (in union)
+  sf.sf_pvFrame1 = rm.rm_pFrame16_1;
+  sf.sf_iRatio   = (sf.sf_pvFrame0==sf.sf_pvFrame1) ? 0 : FloatToInt( rm.rm_fRatio*SHARED_LERP_STEPS);
+  sf.sf_vStretch = rm.rm_vStretch;
+  sf.sf_vOffset  = rm.rm_vOffset;
+  sf.sf_ctVx     = _ctAllMipVx;
+}
+
+
+static INDEX SharedFrameBucket( const SharedFrame &sf)
+{
+  ULONG ul = (ULONG)(size_t)sf.sf_pmmi ^ ((ULONG)(size_t)sf.sf_pvFrame0>>4) ^ ((ULONG)(size_t)sf.sf_pvFrame1>>8);
+  ul = ul*2654435761UL + sf.sf_iRatio;
+  return (ul>>8) & (SHARED_HASH_SIZE-1);
+}
+
+
+static BOOL SameSharedFrame( const SharedFrame &sf1, const SharedFrame &sf2)
+{
+  return sf1.sf_pmmi==sf2.sf_pmmi && sf1.sf_pvFrame0==sf2.sf_pvFrame0 && sf1.sf_pvFrame1==sf2.sf_pvFrame1
+      && sf1.sf_iRatio==sf2.sf_iRatio && sf1.sf_ctVx==sf2.sf_ctVx
+      && sf1.sf_vStretch==sf2.sf_vStretch && sf1.sf_vOffset==sf2.sf_vOffset;
+}
+
+
+// forget frames shared in previous render frame
+static void ResetSharedFrames(void)
+{
+  _asfShared.PopAll();
+  _avtxShared.PopAll();
+  _anorShared.PopAll();
+  for( INDEX i=0; i<SHARED_HASH_SIZE; i++) _aiSharedHash[i] = -1;
+  _iSharedFrameNumber = _pGfx->gl_iFrameNumber;
+}
+
+
+// find frame that another model used in this render frame, or remember it for others (returns -1 if not found)
+static INDEX FindSharedFrame( const SharedFrame &sfKey)
+{
+  if( _iSharedFrameNumber!=_pGfx->gl_iFrameNumber) ResetSharedFrames();
+  const INDEX iBucket = SharedFrameBucket(sfKey);
+  for( INDEX isf=_aiSharedHash[iBucket]; isf>=0; isf=_asfShared[isf].sf_iNext) {
+    if( SameSharedFrame( _asfShared[isf], sfKey)) return isf;
+  }
+  // first model that uses this frame
+  SharedFrame &sf = _asfShared.Push();
+  sf = sfKey;
+  sf.sf_iFirstVx = -1;
+  sf.sf_iNext = _aiSharedHash[iBucket];
+  _aiSharedHash[iBucket] = _asfShared.Count()-1;
+  return -1;
+}
+
+
+// copy vertices and normals from frame unpacked for another model (returns FALSE if not unpacked yet)
+static BOOL CopySharedFrame( INDEX isf, GFXVertex3 *pvtx, GFXNormal3 *pnor, INDEX ctVx)
+{
+  const SharedFrame &sf = _asfShared[isf];
+  if( sf.sf_iFirstVx<0) return FALSE;
+  memcpy( pvtx, &_avtxShared[sf.sf_iFirstVx], ctVx*sizeof(GFXVertex3));
+  memcpy( pnor, &_anorShared[sf.sf_iFirstVx], ctVx*sizeof(GFXNormal3));
+  _pfModelProfile.IncrementCounter( CModelProfile::PCI_VIEW_SHAREDFRAMES);
+  return TRUE;
+}
+
+
+// remember unpacked vertices and normals for other models
+static void StoreSharedFrame( INDEX isf, const GFXVertex3 *pvtx, const GFXNormal3 *pnor, INDEX ctVx)
+{
+  SharedFrame &sf = _asfShared[isf];
+  ASSERT( sf.sf_iFirstVx<0);
+  sf.sf_iFirstVx = _avtxShared.Count();
+  memcpy( _avtxShared.Push(ctVx), pvtx, ctVx*sizeof(GFXVertex3));
+  memcpy( _anorShared.Push(ctVx), pnor, ctVx*sizeof(GFXNormal3));
+  _pfModelProfile.IncrementCounter( CModelProfile::PCI_VIEW_UNPACKEDFRAMES);
+}
+
+
 // unpack vertices (and eventually normals) of one frame
 static void UnpackFrame( CRenderModel &rm, BOOL bKeepNormals)
 {
@@ -1559,6 +1900,7 @@ static void UnpackFrame( CRenderModel &rm, BOOL bKeepNormals)
   const UWORD *puwMipToMdl = (const UWORD*)&rm.rm_pmmiMip->mmpi_auwMipToMdl[0];
         SWORD *pswMipCol   = (SWORD*)&pcolMipBase[_ctAllMipVx>>1];
 
+#if ASMOPT == 1
   // if 16 bit compression
   if( rm.rm_pmdModelData->md_Flags & MF_COMPRESSED_16BIT)
   {
@@ -1567,7 +1909,6 @@ static void UnpackFrame( CRenderModel &rm, BOOL bKeepNormals)
     const ModelFrameVertex16 *pFrame1 = rm.rm_pFrame16_1;
     if( pFrame0==pFrame1)
     {
-#if ASMOPT == 1
       // for each vertex in mip
       const SLONG fixLerpRatio = FloatToInt(fLerpRatio*256.0f); // fix 8:8
       SLONG slTmp1, slTmp2, slTmp3;
@@ -1650,40 +1991,10 @@ vtxNext16:
         cmp     ecx,D [_ctAllMipVx]
         jl      vtxLoop16
       }
-#else
-      // for each vertex in mip
-      for( INDEX iMipVx=0; iMipVx<_ctAllMipVx; iMipVx++) {
-        // get destination for unpacking
-        const INDEX iMdlVx = puwMipToMdl[iMipVx];
-        const ModelFrameVertex16 &mfv0 = pFrame0[iMdlVx];
-        // store vertex
-        GFXVertex3 &vtx = pvtxMipBase[iMipVx];
-        vtx.x = (mfv0.mfv_SWPoint(1) -fOffsetX) *fStretchX;
-        vtx.y = (mfv0.mfv_SWPoint(2) -fOffsetY) *fStretchY;
-        vtx.z = (mfv0.mfv_SWPoint(3) -fOffsetZ) *fStretchZ;
-        // determine normal
-        const FLOAT fSinH0 = pfSinTable[mfv0.mfv_ubNormH];
-        const FLOAT fSinP0 = pfSinTable[mfv0.mfv_ubNormP];
-        const FLOAT fCosH0 = pfCosTable[mfv0.mfv_ubNormH];
-        const FLOAT fCosP0 = pfCosTable[mfv0.mfv_ubNormP];
-        const FLOAT fNX = -fSinH0*fCosP0;
-        const FLOAT fNY = +fSinP0;
-        const FLOAT fNZ = -fCosH0*fCosP0;
-        // store vertex shade
-        pswMipCol[iMipVx] = FloatToInt(fNX*fLightObjX + fNY*fLightObjY + fNZ*fLightObjZ);
-        // store normal (if needed)
-        if( bKeepNormals) {
-          pnorMipBase[iMipVx].nx = fNX;
-          pnorMipBase[iMipVx].ny = fNY;
-          pnorMipBase[iMipVx].nz = fNZ;
-        }
-      }
-#endif
     }
     // if lerping
     else
     {
-#if ASMOPT == 1
       // for each vertex in mip
       const SLONG fixLerpRatio = FloatToInt(fLerpRatio*256.0f); // fix 8:8
       SLONG slTmp1, slTmp2, slTmp3;
@@ -1811,36 +2122,6 @@ vtxNext16L:
         cmp     ecx,D [_ctAllMipVx]
         jl      vtxLoop16L
       }
-#else
-      // for each vertex in mip
-      for( INDEX iMipVx=0; iMipVx<_ctAllMipVx; iMipVx++) {
-        // get destination for unpacking
-        const INDEX iMdlVx = puwMipToMdl[iMipVx];
-        const ModelFrameVertex16 &mfv0 = pFrame0[iMdlVx];
-        const ModelFrameVertex16 &mfv1 = pFrame1[iMdlVx];
-        // store lerped vertex
-        GFXVertex3 &vtx = pvtxMipBase[iMipVx];
-        vtx.x = (Lerp( (FLOAT)mfv0.mfv_SWPoint(1), (FLOAT)mfv1.mfv_SWPoint(1), fLerpRatio) -fOffsetX) * fStretchX;
-        vtx.y = (Lerp( (FLOAT)mfv0.mfv_SWPoint(2), (FLOAT)mfv1.mfv_SWPoint(2), fLerpRatio) -fOffsetY) * fStretchY;
-        vtx.z = (Lerp( (FLOAT)mfv0.mfv_SWPoint(3), (FLOAT)mfv1.mfv_SWPoint(3), fLerpRatio) -fOffsetZ) * fStretchZ;
-        // determine lerped normal
-        const FLOAT fSinH0 = pfSinTable[mfv0.mfv_ubNormH];  const FLOAT fSinH1 = pfSinTable[mfv1.mfv_ubNormH];
-        const FLOAT fSinP0 = pfSinTable[mfv0.mfv_ubNormP];  const FLOAT fSinP1 = pfSinTable[mfv1.mfv_ubNormP];
-        const FLOAT fCosH0 = pfCosTable[mfv0.mfv_ubNormH];  const FLOAT fCosH1 = pfCosTable[mfv1.mfv_ubNormH];
-        const FLOAT fCosP0 = pfCosTable[mfv0.mfv_ubNormP];  const FLOAT fCosP1 = pfCosTable[mfv1.mfv_ubNormP];
-        const FLOAT fNX = Lerp( -fSinH0*fCosP0, -fSinH1*fCosP1, fLerpRatio);
-        const FLOAT fNY = Lerp( +fSinP0,        +fSinP1,        fLerpRatio);
-        const FLOAT fNZ = Lerp( -fCosH0*fCosP0, -fCosH1*fCosP1, fLerpRatio);
-        // store vertex shade
-        pswMipCol[iMipVx] = FloatToInt(fNX*fLightObjX + fNY*fLightObjY + fNZ*fLightObjZ);
-        // store lerped normal (if needed)
-        if( bKeepNormals) {
-          pnorMipBase[iMipVx].nx = fNX;
-          pnorMipBase[iMipVx].ny = fNY;
-          pnorMipBase[iMipVx].nz = fNZ;
-        }
-      }
-#endif
 
     }
   }
@@ -1852,7 +2133,6 @@ vtxNext16L:
     // if no lerping
     if( pFrame0==pFrame1)
     {
-#if ASMOPT == 1
       // for each vertex in mip
       const SLONG fixLerpRatio = FloatToInt(fLerpRatio*256.0f); // fix 8:8
       SLONG slTmp1, slTmp2, slTmp3;
@@ -1921,37 +2201,10 @@ vtxNext8:
         cmp     ecx,D [_ctAllMipVx]
         jl      vtxLoop8
       }
-#else
-      // for each vertex in mip
-      for( INDEX iMipVx=0; iMipVx<_ctAllMipVx; iMipVx++) {
-        // get destination for unpacking
-        const INDEX iMdlVx = puwMipToMdl[iMipVx];
-        const ModelFrameVertex8 &mfv0 = pFrame0[iMdlVx];
-        // store vertex
-        GFXVertex3 &vtx = pvtxMipBase[iMipVx];
-        vtx.x = (mfv0.mfv_SBPoint(1) -fOffsetX) * fStretchX;
-        vtx.y = (mfv0.mfv_SBPoint(2) -fOffsetY) * fStretchY;
-        vtx.z = (mfv0.mfv_SBPoint(3) -fOffsetZ) * fStretchZ;
-        // determine normal
-        const FLOAT3D &vNormal0 = avGouraudNormals[mfv0.mfv_NormIndex];
-        const FLOAT fNX = vNormal0(1);
-        const FLOAT fNY = vNormal0(2);
-        const FLOAT fNZ = vNormal0(3);
-        // store vertex shade
-        pswMipCol[iMipVx] = FloatToInt(fNX*fLightObjX + fNY*fLightObjY + fNZ*fLightObjZ);
-        // store lerped normal (if needed)
-        if( bKeepNormals) {
-          pnorMipBase[iMipVx].nx = fNX;
-          pnorMipBase[iMipVx].ny = fNY;
-          pnorMipBase[iMipVx].nz = fNZ;
-        }
-      }
-#endif
     }
     // if lerping
     else
     {
-#if ASMOPT == 1
       const SLONG fixLerpRatio = FloatToInt(fLerpRatio*256.0f); // fix 8:8
       SLONG slTmp1, slTmp2, slTmp3;
       // re-adjust stretching factors because of fixint lerping (divide by 256)
@@ -2065,36 +2318,44 @@ vtxNext8L:
         cmp     ecx,D [_ctAllMipVx]
         jl      vtxLoop8L
       }
+    }
+  }
 #else
-      // for each vertex in mip
-      for( INDEX iMipVx=0; iMipVx<_ctAllMipVx; iMipVx++) {
-        // get destination for unpacking
-        const INDEX iMdlVx = puwMipToMdl[iMipVx];
-        const ModelFrameVertex8 &mfv0 = pFrame0[iMdlVx];
-        const ModelFrameVertex8 &mfv1 = pFrame1[iMdlVx];
-        // store lerped vertex
-        GFXVertex3 &vtx = pvtxMipBase[iMipVx];
-        vtx.x = (Lerp( (FLOAT)mfv0.mfv_SBPoint(1), (FLOAT)mfv1.mfv_SBPoint(1), fLerpRatio) -fOffsetX) * fStretchX;
-        vtx.y = (Lerp( (FLOAT)mfv0.mfv_SBPoint(2), (FLOAT)mfv1.mfv_SBPoint(2), fLerpRatio) -fOffsetY) * fStretchY;
-        vtx.z = (Lerp( (FLOAT)mfv0.mfv_SBPoint(3), (FLOAT)mfv1.mfv_SBPoint(3), fLerpRatio) -fOffsetZ) * fStretchZ;
-        // determine lerped normal
-        const FLOAT3D &vNormal0 = avGouraudNormals[mfv0.mfv_NormIndex];
-        const FLOAT3D &vNormal1 = avGouraudNormals[mfv1.mfv_NormIndex];
-        const FLOAT fNX = Lerp( (FLOAT)vNormal0(1), (FLOAT)vNormal1(1), fLerpRatio);
-        const FLOAT fNY = Lerp( (FLOAT)vNormal0(2), (FLOAT)vNormal1(2), fLerpRatio);
-        const FLOAT fNZ = Lerp( (FLOAT)vNormal0(3), (FLOAT)vNormal1(3), fLerpRatio);
-        // store vertex shade
-        pswMipCol[iMipVx] = FloatToInt(fNX*fLightObjX + fNY*fLightObjY + fNZ*fLightObjZ);
-        // store lerped normal (if needed)
-        if( bKeepNormals) {
-          pnorMipBase[iMipVx].nx = fNX;
-          pnorMipBase[iMipVx].ny = fNY;
-          pnorMipBase[iMipVx].nz = fNZ;
-        }
-      }
-#endif
+  // normals are needed for shading even if they are not kept
+  GFXNormal3 *pnorUnpack = pnorMipBase;
+  if( !bKeepNormals) {
+    _anorUnpack.PopAll();
+    _anorUnpack.Push(_ctAllMipVx);
+    pnorUnpack = &_anorUnpack[0];
+  }
+
+  // models in crowds often use same frames, so vertices unpacked for another model can be reused
+  INDEX isfShared = -1;
+  BOOL bShared = FALSE;
+  FLOAT fRatio = fLerpRatio;
+  if( mdl_bShareUnpackedFrames) {
+    SharedFrame sfKey;
+    MakeSharedFrameKey( rm, sfKey);
+    isfShared = FindSharedFrame(sfKey);
+    // if another model uses same frames, lerp ratio is quantized to match it
+    if( isfShared>=0) {
+      fRatio = (FLOAT)sfKey.sf_iRatio / SHARED_LERP_STEPS;
+      bShared = CopySharedFrame( isfShared, pvtxMipBase, pnorUnpack, _ctAllMipVx);
+    }
+  }
+  if( !bShared) {
+    if( rm.rm_pmdModelData->md_Flags & MF_COMPRESSED_16BIT) {
+      UnpackVertices16( rm.rm_pFrame16_0, rm.rm_pFrame16_1, fRatio, puwMipToMdl, _ctAllMipVx,
+                        fOffsetX, fOffsetY, fOffsetZ, fStretchX, fStretchY, fStretchZ, pvtxMipBase, pnorUnpack);
+    } else {
+      UnpackVertices8(  rm.rm_pFrame8_0,  rm.rm_pFrame8_1,  fRatio, puwMipToMdl, _ctAllMipVx,
+                        fOffsetX, fOffsetY, fOffsetZ, fStretchX, fStretchY, fStretchZ, pvtxMipBase, pnorUnpack);
     }
+    if( isfShared>=0) StoreSharedFrame( isfShared, pvtxMipBase, pnorUnpack, _ctAllMipVx);
   }
+  // shading depends on placement of each model
+  ShadeVertices( pnorUnpack, pswMipCol, _ctAllMipVx, fLightObjX, fLightObjY, fLightObjZ);
+#endif
 
   // generate colors from shades
 #if ASMOPT == 1
@@ -2184,15 +2445,7 @@ colEnd:
     emms
   }
 #else
-    // generate colors from shades
-    for( INDEX iMipVx=0; iMipVx<_ctAllMipVx; iMipVx++) {
-      GFXColor &col = pcolMipBase[iMipVx];
-      const SLONG slShade = Clamp( (SLONG)pswMipCol[iMipVx], 0L, 255L);
-      col.gfxcol.ub.r = pubClipByte[_slAR + ((_slLR*slShade)>>8)];
-      col.gfxcol.ub.g = pubClipByte[_slAG + ((_slLG*slShade)>>8)];
-      col.gfxcol.ub.b = pubClipByte[_slAB + ((_slLB*slShade)>>8)];
-      col.gfxcol.ub.a = slShade;
-    }
+  ColorizeVertices( pswMipCol, pcolMipBase, _ctAllMipVx);
 #endif
 
   // all done
@@ -3949,3 +4202,116 @@ void RenderBatchedSimpleShadows_View(void)
 
 
 
+
+
+// unpack frames of many models that use same animation, with and without vector kernels and sharing
+void ModelUnpackBenchmark(void *pArgs)
+{
+  INDEX ctModels = NEXTARGUMENT(INDEX);
+  if( ctModels<=0) ctModels = 100;
+  const INDEX ctMdlVx = 1000;
+  const INDEX ctMipVx = 1200;  // some vertices are duplicated in mip (texture seams)
+
+  // synthetic frames
+  ModelFrameVertex16 *pFrame16 = (ModelFrameVertex16*)AllocMemory( 2*ctMdlVx*sizeof(ModelFrameVertex16));
+  ModelFrameVertex8  *pFrame8  = (ModelFrameVertex8 *)AllocMemory( 2*ctMdlVx*sizeof(ModelFrameVertex8));
+  UWORD *puwMipToMdl = (UWORD*)AllocMemory( ctMipVx*sizeof(UWORD));
+  ULONG ulSeed = 0x12345678;
+  for( INDEX iVx=0; iVx<2*ctMdlVx; iVx++) {
+    for( INDEX i=1; i<=3; i++) {
+      ulSeed = ulSeed*1103515245+12345;
+      pFrame16[iVx].mfv_SWPoint(i) = (SWORD)(ulSeed>>16);
+      pFrame8[iVx].mfv_SBPoint(i)  = (SBYTE)(ulSeed>>16);
+    }
+    pFrame16[iVx].mfv_ubNormH = (UBYTE)(ulSeed>>8);
+    pFrame16[iVx].mfv_ubNormP = (UBYTE)(ulSeed>>16);
+    pFrame8[iVx].mfv_NormIndex = (UBYTE)((ulSeed>>8) % MAX_GOURAUDNORMALS);
+  }
+  for( INDEX iMipVx=0; iMipVx<ctMipVx; iMipVx++) puwMipToMdl[iMipVx] = iMipVx % ctMdlVx;
+
+  GFXVertex3 *pvtxScalar = (GFXVertex3*)AllocMemory( ctMipVx*sizeof(GFXVertex3));
+  GFXVertex3 *pvtxVector = (GFXVertex3*)AllocMemory( ctMipVx*sizeof(GFXVertex3));
+  GFXNormal3 *pnorScalar = (GFXNormal3*)AllocMemory( ctMipVx*sizeof(GFXNormal3));
+  GFXNormal3 *pnorVector = (GFXNormal3*)AllocMemory( ctMipVx*sizeof(GFXNormal3));
+  GFXColor   *pcolScalar = (GFXColor*)  AllocMemory( ctMipVx*sizeof(GFXColor));
+  GFXColor   *pcolVector = (GFXColor*)  AllocMemory( ctMipVx*sizeof(GFXColor));
+  _slLR = 200;  _slLG = 180;  _slLB = 160;
+  _slAR = 40;   _slAG = 40;   _slAB = 50;
+  const FLOAT fRatio = 0.375f;  // exactly representable with SHARED_LERP_STEPS
+  const FLOAT3D vStretch( 0.01f, 0.01f, 0.01f);
+  const FLOAT3D vOffset( 0.5f, 0.0f, -0.5f);
+
+  CPrintF( TRANS("Model unpack benchmark (%d models, %d vertices each, %s):\n"),
+           ctModels, ctMipVx, MDL_NEON ? "NEON" : "no SIMD");
+  for( INDEX iCompression=0; iCompression<2; iCompression++) {
+    const BOOL b16 = iCompression==0;
+    DOUBLE adMs[3];
+    FLOAT fMaxError = 0;
+    BOOL bColorsMatch = TRUE;
+    // 0=scalar, 1=vector, 2=vector with shared frames
+    for( INDEX iMode=0; iMode<3; iMode++) {
+      _bScalarUnpack = iMode==0;
+      GFXVertex3 *pvtx = iMode==0 ? pvtxScalar : pvtxVector;
+      GFXNormal3 *pnor = iMode==0 ? pnorScalar : pnorVector;
+      GFXColor   *pcol = iMode==0 ? pcolScalar : pcolVector;
+      SWORD *pswShade  = (SWORD*)&pcol[ctMipVx>>1];
+      SharedFrame sfKey;
+      sfKey.sf_pmmi     = NULL;
+      sfKey.sf_pvFrame0 = b16 ? (const void*)pFrame16 : (const void*)pFrame8;
+      sfKey.sf_pvFrame1 = b16 ? (const void*)(pFrame16+ctMdlVx) : (const void*)(pFrame8+ctMdlVx);
+      sfKey.sf_iRatio   = FloatToInt( fRatio*SHARED_LERP_STEPS);
+      sfKey.sf_vStretch = vStretch;
+      sfKey.sf_vOffset  = vOffset;
+      sfKey.sf_ctVx     = ctMipVx;
+      ResetSharedFrames();
+      INDEX isfShared = -1;
+
+      CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+      for( INDEX iModel=0; iModel<ctModels; iModel++) {
+        // first model only remembers the frame, second one unpacks it for all others
+        if( iMode==2 && isfShared<0) isfShared = FindSharedFrame(sfKey);
+        if( iMode<2 || isfShared<0 || !CopySharedFrame( isfShared, pvtx, pnor, ctMipVx)) {
+          if( b16) {
+            UnpackVertices16( pFrame16, pFrame16+ctMdlVx, fRatio, puwMipToMdl, ctMipVx, vOffset(1), vOffset(2), vOffset(3),
+                              vStretch(1), vStretch(2), vStretch(3), pvtx, pnor);
+          } else {
+            UnpackVertices8(  pFrame8,  pFrame8 +ctMdlVx, fRatio, puwMipToMdl, ctMipVx, vOffset(1), vOffset(2), vOffset(3),
+                              vStretch(1), vStretch(2), vStretch(3), pvtx, pnor);
+          }
+          if( iMode==2 && isfShared>=0) StoreSharedFrame( isfShared, pvtx, pnor, ctMipVx);
+        }
+        // each model is lit from different direction
+        const FLOAT3D vLight = FLOAT3D( Sin(iModel*7.0f), 0.5f, Cos(iModel*7.0f)).Normalize() * -255.0f;
+        ShadeVertices( pnor, pswShade, ctMipVx, vLight(1), vLight(2), vLight(3));
+        ColorizeVertices( pswShade, pcol, ctMipVx);
+      }
+      CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+      adMs[iMode] = (tv1-tv0).GetSeconds()*1000.0;
+
+      // compare results of last model with scalar ones
+      if( iMode==0) continue;
+      for( INDEX iMipVx=0; iMipVx<ctMipVx; iMipVx++) {
+        fMaxError = Max( fMaxError, Abs(pvtxVector[iMipVx].x-pvtxScalar[iMipVx].x));
+        fMaxError = Max( fMaxError, Abs(pvtxVector[iMipVx].y-pvtxScalar[iMipVx].y));
+        fMaxError = Max( fMaxError, Abs(pvtxVector[iMipVx].z-pvtxScalar[iMipVx].z));
+        // shades may be off by one if rounded dot product is halfway
+        for( INDEX iComponent=0; iComponent<4; iComponent++) {
+          const SLONG slDiff = (SLONG)((UBYTE*)&pcolVector[iMipVx])[iComponent] - ((UBYTE*)&pcolScalar[iMipVx])[iComponent];
+          if( Abs(slDiff)>1) bColorsMatch = FALSE;
+        }
+      }
+    }
+    _bScalarUnpack = FALSE;
+    CPrintF( TRANS("  %s: scalar %7.2f ms, vector %7.2f ms, shared %7.2f ms, max error %g, %s\n"),
+             b16 ? "16-bit" : " 8-bit", adMs[0], adMs[1], adMs[2], fMaxError,
+             (bColorsMatch && fMaxError<0.001f) ? TRANS("match") : TRANS("MISMATCH!"));
+  }
+  ResetSharedFrames();
+
+  FreeMemory(pcolVector);  FreeMemory(pcolScalar);
+  FreeMemory(pnorVector);  FreeMemory(pnorScalar);
+  FreeMemory(pvtxVector);  FreeMemory(pvtxScalar);
+  FreeMemory(puwMipToMdl);
+  FreeMemory(pFrame8);
+  FreeMemory(pFrame16);
+}
@@ -184,6 +184,8 @@ CCommunicationInterface::CCommunicationInterface(void)
   cm_ciLocalClient.ci_bClientLocal = FALSE;
 
 	cci_hSocket=INVALID_SOCKET;
+  cci_llBytesSent = 0;
+  cci_llBytesReceived = 0;
 
 };
 
@@ -1207,6 +1209,7 @@ void CCommunicationInterface::UpdateMasterBuffers()
 
 			// if block received
 			} else {
+        cci_llBytesReceived += slSizeReceived;
 				// if there is not at least one byte more in the packet than the header size
 				if (slSizeReceived <= MAX_HEADER_SIZE) {
 					// the packet is in error
@@ -1269,6 +1272,7 @@ void CCommunicationInterface::UpdateMasterBuffers()
 				CPrintF("%lu: Sent sequence: %d to ID: %d, reliable flag: %d\n",(ULONG)tvNow.GetMilliseconds(),ppaNewPacket->pa_ulSequence,ppaNewPacket->pa_adrAddress.adr_uwID,ppaNewPacket->pa_ubReliable);
 			}
 
+      cci_llBytesSent += slSizeSent;
 			cci_pbMasterOutput.RemoveFirstPacket(TRUE);
       bSomethingDone=TRUE;
     }
@@ -1280,4 +1284,37 @@ void CCommunicationInterface::UpdateMasterBuffers()
 
 };
 
+// block until there is incoming data on the socket or timeout expires (TRUE if data is waiting)
+BOOL CCommunicationInterface::WaitForTraffic(TIME tmTimeout)
+{
+  const DWORD dwTimeoutMS = DWORD(ClampDn(tmTimeout, 0.0f)*1000.0f);
+  // if there is no socket, there is nothing to wait for but time
+  if (!cci_bSocketOpen || cci_hSocket==INVALID_SOCKET) {
+    Sleep(dwTimeoutMS);
+    return FALSE;
+  }
+  fd_set fdsRead;
+  FD_ZERO(&fdsRead);
+  FD_SET(cci_hSocket, &fdsRead);
+  timeval tvTimeout;
+  tvTimeout.tv_sec  = dwTimeoutMS/1000;
+  tvTimeout.tv_usec = (dwTimeoutMS%1000)*1000;
+  const CTimerValue tvEnd = _pTimer->GetHighPrecisionTimer() + CTimerValue((DOUBLE)ClampDn(tmTimeout, 0.0f));
+  int iResult = select(cci_hSocket+1, &fdsRead, NULL, NULL, &tvTimeout);
+  // if interrupted, wait for the rest of the time
+  while (iResult==SOCKET_ERROR && WSAGetLastError()==WSAEINTR) {
+    const DWORD dwLeftMS = DWORD(ClampDn((tvEnd-_pTimer->GetHighPrecisionTimer()).GetSeconds(), 0.0)*1000.0);
+    FD_ZERO(&fdsRead);
+    FD_SET(cci_hSocket, &fdsRead);
+    tvTimeout.tv_sec  = dwLeftMS/1000;
+    tvTimeout.tv_usec = (dwLeftMS%1000)*1000;
+    iResult = select(cci_hSocket+1, &fdsRead, NULL, NULL, &tvTimeout);
+  }
+  if (iResult==SOCKET_ERROR) {
+    Sleep(dwTimeoutMS);
+    return FALSE;
+  }
+  return iResult>0;
+}
+
 
@@ -39,6 +39,8 @@ public:
   CPacketBuffer cci_pbMasterInput;					// master input buffer
 
   int cci_hSocket;            // the socket handle itself
+  __int64 cci_llBytesSent;      // total bytes sent through the socket
+  __int64 cci_llBytesReceived;  // total bytes received through the socket
 
   bool cci_bFirstByteReceived = false;
 
@@ -48,6 +50,8 @@ public:
   void Client_OpenNet_t(ULONG ulServerAddress);
   // update master UDP socket and route its messages
   void UpdateMasterBuffers(void);
+  // block until there is incoming data on the socket or timeout expires (TRUE if data is waiting)
+  BOOL WaitForTraffic(TIME tmTimeout);
 
 public:
   CCommunicationInterface(void);
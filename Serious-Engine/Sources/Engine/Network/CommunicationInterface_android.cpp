@@ -24,6 +24,7 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <poll.h>
 #include <config.h>
 
 #define HOSTENT hostent
@@ -128,6 +129,8 @@ CCommunicationInterface::CCommunicationInterface(void) {
   cm_ciLocalClient.ci_bClientLocal = FALSE;
 
   cci_hSocket = INVALID_SOCKET;
+  cci_llBytesSent = 0;
+  cci_llBytesReceived = 0;
 
 };
 
@@ -957,6 +960,7 @@ void CCommunicationInterface::UpdateMasterBuffers() {
         }
       } else {
         //CPrintF("Received %i bytes\n", slSizeReceived);
+        cci_llBytesReceived += slSizeReceived;
         if (!cci_bFirstByteReceived) {
           cci_bFirstByteReceived = true;
           CPrintF("Receiving data\n");
@@ -1020,6 +1024,7 @@ void CCommunicationInterface::UpdateMasterBuffers() {
         CPrintF("%lu: Sent sequence: %d to ID: %d, reliable flag: %d\n", (ULONG) tvNow.GetMilliseconds(), ppaNewPacket->pa_ulSequence, ppaNewPacket->pa_adrAddress.adr_uwID, ppaNewPacket->pa_ubReliable);
       }
 
+      cci_llBytesSent += slSizeSent;
       cci_pbMasterOutput.RemoveFirstPacket(TRUE);
       bSomethingDone = TRUE;
     }
@@ -1028,4 +1033,30 @@ void CCommunicationInterface::UpdateMasterBuffers() {
 
 };
 
-
+// block until there is incoming data on the socket or timeout expires (TRUE if data is waiting)
+BOOL CCommunicationInterface::WaitForTraffic(TIME tmTimeout) {
+  const CTimerValue tvEnd = _pTimer->GetHighPrecisionTimer() + CTimerValue((DOUBLE)ClampDn(tmTimeout, 0.0f));
+  int iTimeoutMS = int(ClampDn(tmTimeout, 0.0f)*1000.0f);
+  if (cci_bSocketOpen && cci_hSocket!=INVALID_SOCKET) {
+    struct pollfd pfd;
+    pfd.fd = cci_hSocket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int iResult = poll(&pfd, 1, iTimeoutMS);
+    // if interrupted by a signal, wait for the rest of the time
+    while (iResult<0 && errno==EINTR) {
+      iTimeoutMS = int(ClampDn((tvEnd-_pTimer->GetHighPrecisionTimer()).GetSeconds(), 0.0)*1000.0);
+      iResult = poll(&pfd, 1, iTimeoutMS);
+    }
+    // if socket is usable, poll did all the waiting
+    if (iResult==0 || (iResult>0 && !(pfd.revents&POLLNVAL))) {
+      return iResult>0 && (pfd.revents&POLLIN);
+    }
+  }
+  // if there is no socket, there is nothing to wait for but time
+  iTimeoutMS = int(ClampDn((tvEnd-_pTimer->GetHighPrecisionTimer()).GetSeconds(), 0.0)*1000.0);
+  if (iTimeoutMS>0) {
+    usleep(iTimeoutMS*1000);
+  }
+  return FALSE;
+}
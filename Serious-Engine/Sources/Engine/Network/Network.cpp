@@ -127,6 +127,7 @@ INDEX cli_bPredictLocalPlayers = TRUE;
 INDEX cli_bPredictRemotePlayers = FALSE;
 FLOAT cli_fPredictEntitiesRange = 20.0f;
 INDEX cli_bLerpActions = FALSE;
+INDEX cli_bPersistentPredictors = TRUE;
 INDEX cli_bReportPredicted = FALSE;
 INDEX cli_iSendBehind = 3;
 INDEX cli_iPredictionFlushing = 1;
@@ -283,6 +284,7 @@ extern BOOL MatchesBanMask(const CTString &strString, const CTString &strMask)
 }
 
 extern CTString RemoveSubstring(const CTString &strFull, const CTString &strSub);
+extern void PredictionBenchmark(void *pArgs);
 
 static void AddIPMask(void* pArgs)
 {
@@ -831,6 +833,8 @@ void CNetworkLibrary::Init(const CTString &strGameID)
   _pShell->DeclareSymbol("persistent user FLOAT cli_fPredictionFilter;", &cli_fPredictionFilter);
   _pShell->DeclareSymbol("persistent user INDEX cli_iSendBehind;", &cli_iSendBehind);
   _pShell->DeclareSymbol("persistent user INDEX cli_iPredictionFlushing;", &cli_iPredictionFlushing);
+  _pShell->DeclareSymbol("persistent user INDEX cli_bPersistentPredictors;", &cli_bPersistentPredictors);
+  _pShell->DeclareSymbol("user void PredictionBenchmark(INDEX, FLOAT);", (void *)&PredictionBenchmark);
 
   _pShell->DeclareSymbol("persistent user INDEX cli_iBufferActions;",  &cli_iBufferActions);
   _pShell->DeclareSymbol("persistent user INDEX cli_iMaxBPS;",     &cli_iMaxBPS);
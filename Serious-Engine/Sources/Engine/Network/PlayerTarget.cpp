@@ -242,3 +242,21 @@ void CPlayerTarget::ApplyPredictedAction(INDEX iAction, FLOAT fFactor)
   // apply a prediction action packet to the entity's predictor
   ((CPlayerEntity*)penPredictor)->ApplyAction(pa, 0.0f);
 }
+
+// get time tag of the action that prediction starts with
+__int64 CPlayerTarget::GetPredictionOrigin(void)
+{
+  CTSingleLock slActions(&plt_csAction, TRUE);
+
+  // local players predict from the oldest buffered action
+  if (_pNetwork->IsPlayerLocal(plt_penPlayerEntity)) {
+    if (plt_abPrediction.GetCount()<=0) {
+      return -1;
+    }
+    CPlayerAction pa;
+    plt_abPrediction.GetActionByIndex(0, pa);
+    return pa.pa_llCreated;
+  }
+  // others reuse last received action
+  return plt_paLastAction.pa_llCreated;
+}
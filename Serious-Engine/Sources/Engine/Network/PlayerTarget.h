@@ -62,6 +62,8 @@ public:
   INDEX GetNumberOfPredictions(void);
   /* Apply predicted action with given index. */
   void ApplyPredictedAction(INDEX iAction, FLOAT fFactor);
+  // get time tag of the action that prediction starts with
+  __int64 GetPredictionOrigin(void);
 
   /* Read player information from a stream. */
   void Read_t(CTStream *pstr);   // throw char *
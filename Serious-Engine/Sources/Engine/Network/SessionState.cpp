@@ -100,6 +100,7 @@ CSessionState::CSessionState(void)
   ses_bAllowRandom = TRUE;  // random allowed when not in game
   ses_bPredicting = FALSE;
   ses_tmPredictionHeadTick = -2.0f;
+  ses_ctPredictedSteps = 0;
   ses_tmLastSyncCheck = 0;
   ses_tmLastPredictionProcessed = -200;
 
@@ -143,6 +144,7 @@ void CSessionState::Stop(void)
   ses_bAllowRandom = TRUE;  // random allowed when not in game
   ses_bPredicting = FALSE;
   ses_tmPredictionHeadTick = -2.0f;
+  ses_ctPredictedSteps = 0;
   ses_tmLastSyncCheck = 0;
   ses_bPause = FALSE;
   ses_bWantPause = FALSE;
@@ -199,6 +201,7 @@ void CSessionState::Start_t(INDEX ctLocalPlayers)
   ses_bAllowRandom = FALSE;  // random not allowed in game
   ses_bPredicting = FALSE;
   ses_tmPredictionHeadTick = -2.0f;
+  ses_ctPredictedSteps = 0;
   ses_tmLastSyncCheck = 0;
   ses_bPause = FALSE;
   ses_bWantPause = FALSE;
@@ -1278,12 +1281,80 @@ INDEX CSessionState::GetPredictionStepsCount(void)
   return ctPredictionSteps;
 }
 
+// prediction benchmark state
+static INDEX _ctPredictionBenchFrames = 0;
+static INDEX _ctBenchCompared = 0;
+static INDEX _ctBenchMismatches = 0;
+static INDEX _ctBenchNotContinued = 0;
+static DOUBLE _tmBenchContinued = 0;
+static DOUBLE _tmBenchRebuilt = 0;
+static FLOAT _fBenchOldLatencySend = 0;
+static FLOAT _fBenchOldLatencyRecv = 0;
+static FLOAT _fBenchDemoLatency = -1.0f;   // latency emulated while replaying a demo (-1 if live)
+static INDEX _bBenchOldPrediction = FALSE;
+static INDEX _bBenchOldPredictRemote = FALSE;
+
+static void ReportPredictionBenchmark(void)
+{
+  // restore latency and prediction settings
+  if (_fBenchDemoLatency>=0) {
+    extern INDEX cli_bPrediction;
+    extern INDEX cli_bPredictRemotePlayers;
+    cli_bPrediction = _bBenchOldPrediction;
+    cli_bPredictRemotePlayers = _bBenchOldPredictRemote;
+    _fBenchDemoLatency = -1.0f;
+  } else {
+    _pShell->SetFLOAT("net_fLimitLatencySend", _fBenchOldLatencySend);
+    _pShell->SetFLOAT("net_fLimitLatencyRecv", _fBenchOldLatencyRecv);
+  }
+
+  INDEX ct = ClampDn(_ctBenchCompared, 1L);
+  CPrintF(TRANS("Prediction benchmark: %d frames compared, %d mismatches\n"), _ctBenchCompared, _ctBenchMismatches);
+  // (predictors cannot be continued over a processed tick, so these are rebuilt as before)
+  CPrintF(TRANS("  %d frames rebuilt predictors after a tick or change\n"), _ctBenchNotContinued);
+  CPrintF(TRANS("  continued: %.3f ms per frame\n"), _tmBenchContinued*1000/ct);
+  CPrintF(TRANS("  rebuilt:   %.3f ms per frame\n"), _tmBenchRebuilt*1000/ct);
+}
+
+// A demo has no local actions that would be waiting for the server, so while benchmarking
+// on a demo, buffer for each player as many actions as would be pending at emulated latency.
+// Predicted players are not local, so they reuse their last received action for each step.
+static void BufferDemoBenchmarkActions(CStaticArray<CPlayerTarget> &apltPlayers, TIME tmSinceLastTick)
+{
+  const INDEX ctPending = (INDEX)floor((_fBenchDemoLatency+tmSinceLastTick)/_pTimer->TickQuantum);
+  FOREACHINSTATICARRAY(apltPlayers, CPlayerTarget, itplt) {
+    if (!itplt->IsActive()) {
+      continue;
+    }
+    // tag them right after last received action, so they are flushed when next one arrives
+    CPlayerAction pa = itplt->plt_paLastAction;
+    const __int64 llLastAction = pa.pa_llCreated;
+    for(INDEX iAction=1; iAction<=ctPending; iAction++) {
+      pa.pa_llCreated = llLastAction+iAction;
+      itplt->PrebufferActionPacket(pa);
+    }
+  }
+}
+
 /* Process all eventual available prediction actions. */
 void CSessionState::ProcessPrediction(void)
 {
   // FPU must be in 24-bit mode
   CSetFPUPrecision FPUPrecision(FPT_24BIT);
 
+  // if benchmarking on a demo, emulate actions that are waiting for the server
+  if (_ctPredictionBenchFrames>0 && _fBenchDemoLatency>=0) {
+    // if demo is not playing any more, report what was measured
+    if (!_pNetwork->ga_bDemoPlay) {
+      _ctPredictionBenchFrames = 0;
+      ReportPredictionBenchmark();
+      return;
+    }
+    // (last demo sequence is one tick ahead of the last processed tick)
+    TIME tmSinceLastTick = _pNetwork->ga_fDemoTimer-ses_tmLastDemoSequence+_pTimer->TickQuantum;
+    BufferDemoBenchmarkActions(ses_apltPlayers, tmSinceLastTick);
+  }
+
   // get number of steps that could be predicted
   INDEX ctSteps = GetPredictionStepsCount();
 
@@ -1310,22 +1381,202 @@ void CSessionState::ProcessPrediction(void)
   ULONG ulOldRandom = ses_ulRandomSeed;
   ULONG ulEntityID = _pNetwork->ga_World.wo_ulNextEntityID;
 
-  // delete all predictors (if any left from last time)
-  _pNetwork->ga_World.DeletePredictors();
-  // create new predictors
-  _pNetwork->ga_World.CreatePredictors();
+  BOOL bContinue = CanContinuePrediction(ctSteps);
+
+  // if benchmarking, verify continued predictors against rebuilt ones
+  if (_ctPredictionBenchFrames>0 && bContinue) {
+    CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+    PredictSteps(ses_ctPredictedSteps, ctSteps);
+    CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+    ULONG ulContinued = GetPredictorsChecksum();
+
+    ses_ulRandomSeed = ulOldRandom;
+    _pNetwork->ga_World.wo_ulNextEntityID = ulEntityID;
+    CTimerValue tv2 = _pTimer->GetHighPrecisionTimer();
+    _pNetwork->ga_World.DeletePredictors();
+    _pNetwork->ga_World.CreatePredictors();
+    PredictSteps(0, ctSteps);
+    CTimerValue tv3 = _pTimer->GetHighPrecisionTimer();
+    ULONG ulRebuilt = GetPredictorsChecksum();
+
+    _tmBenchContinued += (tv1-tv0).GetSeconds();
+    _tmBenchRebuilt   += (tv3-tv2).GetSeconds();
+    _ctBenchCompared++;
+    if (ulContinued!=ulRebuilt) {
+      _ctBenchMismatches++;
+    }
+
+  // if predictors from last time are still valid
+  } else if (bContinue) {
+    // just advance them by the new steps
+    PredictSteps(ses_ctPredictedSteps, ctSteps);
+
+  } else {
+    if (_ctPredictionBenchFrames>0) {
+      _ctBenchNotContinued++;
+    }
+    // delete all predictors (if any left from last time)
+    _pNetwork->ga_World.DeletePredictors();
+    // create new predictors
+    _pNetwork->ga_World.CreatePredictors();
+    // predict all steps
+    PredictSteps(0, ctSteps);
+  }
+
+  // restore random seed and entity ID
+  ses_ulRandomSeed = ulOldRandom;
+  _pNetwork->ga_World.wo_ulNextEntityID = ulEntityID;
+
+  // count benchmarked frames
+  if (_ctPredictionBenchFrames>0) {
+    _ctPredictionBenchFrames--;
+    if (_ctPredictionBenchFrames==0) {
+      ReportPredictionBenchmark();
+    }
+  }
+}
+
+// check if predictors from last cycle can be advanced to given number of steps
+BOOL CSessionState::CanContinuePrediction(INDEX ctSteps)
+{
+  extern INDEX cli_bPersistentPredictors;
+  extern INDEX cli_bLerpActions;
+  // (if there are no new steps, predictors are already where they should be)
+  if (!cli_bPersistentPredictors || ses_ctPredictedSteps<=0 || ctSteps<ses_ctPredictedSteps) {
+    return FALSE;
+  }
+  // nothing may have been processed since the predictors were made
+  // (predictors are already advanced past the old tick, so they cannot be refreshed from
+  // changed originals without copying them again - that is the same as rebuilding them)
+  if (ses_tmPredictionBase!=ses_tmLastProcessedTick || ses_iPredictionSequence!=ses_iLastProcessedSequence) {
+    return FALSE;
+  }
+
+  // all players must start predicting from the same actions as before
+  if (ses_allPredictionOrigins.Count()!=ses_apltPlayers.Count()) {
+    return FALSE;
+  }
+  for(INDEX iPlayer=0; iPlayer<ses_apltPlayers.Count(); iPlayer++) {
+    CPlayerTarget &plt = ses_apltPlayers[iPlayer];
+    __int64 llOrigin = -1;
+    if (plt.IsActive()) {
+      // lerped actions of remote players depend on number of steps
+      if (cli_bLerpActions && !_pNetwork->IsPlayerLocal(plt.plt_penPlayerEntity)) {
+        return FALSE;
+      }
+      llOrigin = plt.GetPredictionOrigin();
+    }
+    if (ses_allPredictionOrigins[iPlayer]!=llOrigin) {
+      return FALSE;
+    }
+  }
+
+  // the set of entities marked for prediction must be the one that is predicted
+  CWorld &wo = _pNetwork->ga_World;
+  INDEX ctMarked = 0;
+  {FOREACHINDYNAMICCONTAINER(wo.wo_cenWillBePredicted, CEntity, iten) {
+    if (iten->en_ulFlags&ENF_DELETED) {
+      continue;
+    }
+    if (!iten->IsPredicted()) {
+      return FALSE;
+    }
+    ctMarked++;
+  }}
+  return ctMarked==wo.wo_cenPredicted.Count();
+}
+
+// predict steps from given one until given count (predictors must exist)
+void CSessionState::PredictSteps(INDEX iFirstStep, INDEX ctSteps)
+{
+  // if continuing, restore random seed and entity ID as they were after last predicted step
+  if (iFirstStep>0) {
+    ses_ulRandomSeed = ses_ulPredictionRandomSeed;
+    _pNetwork->ga_World.wo_ulNextEntityID = ses_ulPredictionEntityID;
+  }
 
   // for each step
   TIME tmPredictedTick = ses_tmLastProcessedTick;
   for(INDEX iPredictionStep=0; iPredictionStep<ctSteps; iPredictionStep++) {
+    // (tick is always accumulated from start, so that times match when continuing)
     tmPredictedTick+=_pTimer->TickQuantum;
+    if (iPredictionStep<iFirstStep) {
+      continue;
+    }
     //ses_tmPredictionHeadTick = Max(ses_tmPredictionHeadTick, tmPredictedTick);
     // predict it
     ProcessPredictedGameTick(iPredictionStep, FLOAT(iPredictionStep)/ctSteps, tmPredictedTick);
   }
-  // restore random seed and entity ID
-  ses_ulRandomSeed = ulOldRandom;
-  _pNetwork->ga_World.wo_ulNextEntityID = ulEntityID;
+
+  // remember where the predictors are now
+  ses_ctPredictedSteps = ctSteps;
+  ses_tmPredictionBase = ses_tmLastProcessedTick;
+  ses_iPredictionSequence = ses_iLastProcessedSequence;
+  ses_ulPredictionRandomSeed = ses_ulRandomSeed;
+  ses_ulPredictionEntityID = _pNetwork->ga_World.wo_ulNextEntityID;
+  ses_allPredictionOrigins.PopAll();
+  for(INDEX iPlayer=0; iPlayer<ses_apltPlayers.Count(); iPlayer++) {
+    CPlayerTarget &plt = ses_apltPlayers[iPlayer];
+    ses_allPredictionOrigins.Push() = plt.IsActive() ? plt.GetPredictionOrigin() : -1;
+  }
+}
+
+// get checksum of all predictors (for verifying prediction)
+ULONG CSessionState::GetPredictorsChecksum(void)
+{
+  // sum of checksums of each predictor, so that order of entities doesn't matter
+  ULONG ulSum = 0;
+  FOREACHINDYNAMICCONTAINER(_pNetwork->ga_World.wo_cenEntities, CEntity, iten) {
+    if (!iten->IsPredictor() || (iten->en_ulFlags&ENF_DELETED)) {
+      continue;
+    }
+    ULONG ulCRC;
+    CRC_Start(ulCRC);
+    iten->ChecksumForSync(ulCRC, 1);
+    CRC_Finish(ulCRC);
+    ulSum += ulCRC;
+  }
+  return ulSum;
+}
+
+// compare continued prediction with full predictor rebuilds for some frames
+// (while a demo is playing, its players are predicted as if the demo was received with given latency)
+void PredictionBenchmark(void *pArgs)
+{
+  INDEX ctFrames = NEXTARGUMENT(INDEX);
+  FLOAT fLatency = NEXTARGUMENT(FLOAT);
+  if (_ctPredictionBenchFrames>0) {
+    CPrintF(TRANS("Prediction benchmark already running.\n"));
+    return;
+  }
+  if (ctFrames<=0) {
+    return;
+  }
+  if (_pNetwork->IsPlayingDemo()) {
+    // demo players are remote, so they must be predicted
+    extern INDEX cli_bPrediction;
+    extern INDEX cli_bPredictRemotePlayers;
+    _bBenchOldPrediction = cli_bPrediction;
+    _bBenchOldPredictRemote = cli_bPredictRemotePlayers;
+    cli_bPrediction = TRUE;
+    cli_bPredictRemotePlayers = TRUE;
+    _fBenchDemoLatency = ClampDn(fLatency, 0.0f);
+  } else {
+    // emulate given round trip latency
+    _fBenchOldLatencySend = _pShell->GetFLOAT("net_fLimitLatencySend");
+    _fBenchOldLatencyRecv = _pShell->GetFLOAT("net_fLimitLatencyRecv");
+    _pShell->SetFLOAT("net_fLimitLatencySend", fLatency/2);
+    _pShell->SetFLOAT("net_fLimitLatencyRecv", fLatency/2);
+  }
+
+  _ctBenchCompared = 0;
+  _ctBenchMismatches = 0;
+  _ctBenchNotContinued = 0;
+  _tmBenchContinued = 0;
+  _tmBenchRebuilt = 0;
+  _ctPredictionBenchFrames = ctFrames;
+  CPrintF(TRANS("Comparing prediction in %d frames at %.0f ms latency%s...\n"), ctFrames, fLatency*1000,
+    _fBenchDemoLatency>=0 ? TRANS(" (demo replay)") : "");
 }
 
 /*
@@ -86,6 +86,13 @@ public:
   TIME ses_tmPredictionHeadTick;     // newest tick that was ever predicted
   TIME ses_tmLastSyncCheck;          // last time sync-check was generated
   TIME ses_tmLastPredictionProcessed;  // for determining when to do a new prediction cycle
+  // state of predictors kept from last prediction cycle
+  INDEX ses_ctPredictedSteps;        // number of steps predictors were advanced (0 if none)
+  TIME ses_tmPredictionBase;         // last processed tick that the predictors started from
+  INDEX ses_iPredictionSequence;     // last processed sequence that the predictors started from
+  ULONG ses_ulPredictionRandomSeed;  // random seed after last predicted step
+  ULONG ses_ulPredictionEntityID;    // next entity ID after last predicted step
+  CStaticStackArray<__int64> ses_allPredictionOrigins; // first predicted action of each player
 
   INDEX ses_iMissingSequence;       // first missing sequence
   CTimerValue ses_tvResendTime;     // timer for missing sequence retransmission
@@ -167,6 +174,12 @@ public:
   INDEX GetPredictionStepsCount(void);
   /* Process all eventual avaliable prediction actions. */
   void ProcessPrediction(void);
+  // check if predictors from last cycle can be advanced to given number of steps
+  BOOL CanContinuePrediction(INDEX ctSteps);
+  // predict steps from given one until given count (predictors must exist)
+  void PredictSteps(INDEX iFirstStep, INDEX ctSteps);
+  // get checksum of all predictors (for verifying prediction)
+  ULONG GetPredictorsChecksum(void);
   /* Get number of active players. */
   INDEX GetPlayersCount(void);
   /* Remember predictor positions of all players. */
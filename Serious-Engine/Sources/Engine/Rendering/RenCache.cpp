@@ -588,6 +588,7 @@ CScreenPolygon *CRenderer::MakeScreenPolygon(CBrushPolygon &bpo)
   _pfRenderProfile.IncrementTimerAveragingCounter(CRenderProfile::PTI_MAKESCREENPOLYGON, 1);
   // create a new screen polygon
   CScreenPolygon &spo = re_aspoScreenPolygons.Push();
+  spo.spo_iIndex = re_aspoScreenPolygons.Count()-1;
   ScenePolygon  &sppo = spo.spo_spoScenePolygon;
   bpo.bpo_pspoScreenPolygon = &spo;
   CBrush3D &br = *re_pbrCurrent;
@@ -837,29 +838,56 @@ void CRenderer::MakeSpan(CScreenPolygon &spo, CScreenEdge *psed0, CScreenEdge *p
   }
   // if rendering view
   else {
-    // if no span added to this polygon yet
-    if( !spo.spo_ubSpanAdded) {
-      spo.spo_ubSpanAdded = 1;
-      // add mirror if needed
-      AddMirror(spo);
-      // add polygon to scene polygons
-      AddPolygonToScene(&spo);
-      const PIX pixI0 = PIXCoord(psed0->sed_xI);
-      const PIX pixI1 = PIXCoord(psed1->sed_xI);
-      spo.spo_pixMinI = pixI0;
-      spo.spo_pixMaxI = pixI1;
-      spo.spo_pixMinJ = re_pixCurrentScanJ;
-      spo.spo_pixMaxJ = re_pixCurrentScanJ;
-      spo.spo_pixTotalArea = pixI1-pixI0;
-    } else {
-      const PIX pixI0 = PIXCoord(psed0->sed_xI);
-      const PIX pixI1 = PIXCoord(psed1->sed_xI);
-      spo.spo_pixMinI = Min(spo.spo_pixMinI, pixI0);
-      spo.spo_pixMaxI = Max(spo.spo_pixMaxI, pixI1);
-      spo.spo_pixMinJ = Min(spo.spo_pixMinJ, re_pixCurrentScanJ);
-      spo.spo_pixMaxJ = Max(spo.spo_pixMaxJ, re_pixCurrentScanJ);
-      spo.spo_pixTotalArea += pixI1-pixI0;
-    }
+    AddSpanToPolygon( spo, PIXCoord(psed0->sed_xI), PIXCoord(psed1->sed_xI));
+  }
+}
+
+/*
+ * Add a span on current scan line to polygon's bounding box (when rendering view).
+ */
+void CRenderer::AddSpanToPolygon(CScreenPolygon &spo, PIX pixI0, PIX pixI1)
+{
+  // if no span added to this polygon yet
+  if( !spo.spo_ubSpanAdded) {
+    spo.spo_ubSpanAdded = 1;
+    // add mirror if needed
+    AddMirror(spo);
+    // add polygon to scene polygons
+    AddPolygonToScene(&spo);
+    spo.spo_pixMinI = pixI0;
+    spo.spo_pixMaxI = pixI1;
+    spo.spo_pixMinJ = re_pixCurrentScanJ;
+    spo.spo_pixMaxJ = re_pixCurrentScanJ;
+    spo.spo_pixTotalArea = pixI1-pixI0;
+  } else {
+    spo.spo_pixMinI = Min(spo.spo_pixMinI, pixI0);
+    spo.spo_pixMaxI = Max(spo.spo_pixMaxI, pixI1);
+    spo.spo_pixMinJ = Min(spo.spo_pixMinJ, re_pixCurrentScanJ);
+    spo.spo_pixMaxJ = Max(spo.spo_pixMaxJ, re_pixCurrentScanJ);
+    spo.spo_pixTotalArea += pixI1-pixI0;
+  }
+}
+
+/*
+ * Add a span to shadow mask (when rendering shadows).
+ */
+void CRenderer::AddShadowSpan(UBYTE *&pubShadow, const CScreenPolygon &spo, PIX pixLen)
+{
+  // if the span's polygon is background and of proper illumination
+  if ((spo.spo_spoScenePolygon.spo_ulFlags & SPOF_BACKLIGHT)
+    &&(spo.spo_ubIllumination==re_ubLightIllumination)) {
+    // mark those pixels as lighted
+    memset(pubShadow, 255, pixLen);
+    pubShadow+=pixLen;
+    // mark that at least one pixel is lighted
+    re_bSomeLightExists = TRUE;
+  // if the spans polygon is some other polygon
+  } else {
+    // mark those pixels as shadowed
+    memset(pubShadow, 0, pixLen);
+    pubShadow+=pixLen;
+    // mark that at least one pixel is darkened
+    re_bSomeDarkExists = TRUE;
   }
 }
 
@@ -892,23 +920,8 @@ void CRenderer::AddSpansToScene(void)
     PIX pixLen = pixI1-pixI0;
     // skip this span if zero pixels long
     if( pixLen<=0) continue;
-
-    // if the span's polygon is background and of proper illumination
-    if ((spSpan.sp_pspoPolygon->spo_spoScenePolygon.spo_ulFlags & SPOF_BACKLIGHT)
-      &&(spSpan.sp_pspoPolygon->spo_ubIllumination==re_ubLightIllumination)) {
-      // mark those pixels as lighted
-      memset(pubShadow, 255, pixLen);
-      pubShadow+=pixLen;
-      // mark that at least one pixel is lighted
-      re_bSomeLightExists = TRUE;
-    // if the spans polygon is some other polygon
-    } else {
-      // mark those pixels as shadowed
-      memset(pubShadow, 0, pixLen);
-      pubShadow+=pixLen;
-      // mark that at least one pixel is darkened
-      re_bSomeDarkExists = TRUE;
-    }
+    // fill the shadow mask
+    AddShadowSpan( pubShadow, *spSpan.sp_pspoPolygon, pixLen);
     // add to pixel counter
     ctPixels+=pixLen;
   }
@@ -472,6 +472,19 @@ void CRenderer::EndScanEdges(void)
   _pfRenderProfile.StopTimer(CRenderProfile::PTI_ENDSCANEDGES);
 }
 
+// depth of a polygon on given point of current scan line
+static inline FLOAT SurfaceOoK(const CPlanarGradients &pg, FLOAT fScanI, FLOAT fScanJ)
+{
+  return pg.pg_f00 + pg.pg_fDOverDI*fScanI + pg.pg_fDOverDJ*fScanJ;
+}
+
+// how much is a new polygon closer than a polygon in surface stack
+// (shared by serial and band scanning, so both sort exactly the same)
+static inline FLOAT SurfaceDelta(FLOAT fOoK, const CPlanarGradients &pg, FLOAT fScanI, FLOAT fScanJ)
+{
+  return fOoK - pg.pg_f00 - pg.pg_fDOverDI*fScanI - pg.pg_fDOverDJ*fScanJ;
+}
+
 /*
  * Add a polygon to surface stack.
  */
@@ -493,8 +506,7 @@ BOOL CRenderer::AddPolygonToSurfaceStack(CScreenPolygon &spo)
   FLOAT fScanJ = re_fCurrentScanJ;//+re_fMinJ;
 
   // calculate 1/k for new polygon
-  CPlanarGradients &pg = spo.spo_pgOoK; 
-  FLOAT fOoK = pg.pg_f00 + pg.pg_fDOverDI*fScanI + pg.pg_fDOverDJ*fScanJ;
+  FLOAT fOoK = SurfaceOoK(spo.spo_pgOoK, fScanI, fScanJ);
 
   // bias for right edges - fix against generating extra trapezoids
   fOoK*=re_fEdgeAdjustK;
@@ -510,32 +522,24 @@ BOOL CRenderer::AddPolygonToSurfaceStack(CScreenPolygon &spo)
   if (!re_prProjection.IsPerspective()) {
     // while new polygon is further than polygon in stack
     while(
-     ((fOoK - 
-      itspo->spo_pgOoK.pg_f00 -
-      itspo->spo_pgOoK.pg_fDOverDI*fScanI -
-      itspo->spo_pgOoK.pg_fDOverDJ*fScanJ)<0)
+     (SurfaceDelta(fOoK, itspo->spo_pgOoK, fScanI, fScanJ)<0)
       && (&*itspo != &re_spoFarSentinel)) {
       // move to next polygon in stack
       itspo.MoveToNext();
     }
   } else {
     // while new polygon is further than polygon in stack
-    FLOAT fDelta = fOoK -
-      itspo->spo_pgOoK.pg_f00 -
-      itspo->spo_pgOoK.pg_fDOverDI*fScanI -
-      itspo->spo_pgOoK.pg_fDOverDJ*fScanJ;
+    // (sign is tested as 32-bit integer - SLONG is wider on 64-bit targets)
+    FLOAT fDelta = SurfaceDelta(fOoK, itspo->spo_pgOoK, fScanI, fScanJ);
 
-    if (((SLONG &)fDelta) < 0) {
+    if (((SINT &)fDelta) < 0) {
       do {
         // the polygon in stack must not be far sentinel
         ASSERT(&*itspo != &re_spoFarSentinel);
         // move to next polygon in stack
         itspo.MoveToNext();
-        fDelta = fOoK -
-          itspo->spo_pgOoK.pg_f00 -
-          itspo->spo_pgOoK.pg_fDOverDI*fScanI -
-          itspo->spo_pgOoK.pg_fDOverDJ*fScanJ;
-      } while (((SLONG &)fDelta) < 0);
+        fDelta = SurfaceDelta(fOoK, itspo->spo_pgOoK, fScanI, fScanJ);
+      } while (((SINT &)fDelta) < 0);
     }
   }
 
@@ -775,6 +779,547 @@ CScreenPolygon *CRenderer::ScanOneLine(void)
   return NULL;
 }
 
+/*
+ * Scanning in horizontal bands.
+ *
+ * Lines below the current one are split into bands that are scanned on worker threads, each
+ * with its own copy of the active list and its own surface stack. Instead of being added to
+ * the scene, spans are recorded and added afterwards in scan-line order, so that the result is
+ * exactly the same as with serial scanning. Passing a portal adds new edges to all lines below,
+ * so a band stops at the first line where a portal is encountered, and scanning continues
+ * serially from there.
+ */
+
+#define SCANBAND_MAXBANDS   16
+#define SCANBAND_MINLINES   16    // minimum number of lines in one band
+#define SCANBAND_MAXRETRIES  4    // how many times per frame to start banding again after a portal
+
+// span recorded in a band
+class CScanBandSpan {
+public:
+  CScreenPolygon *sbs_pspo;
+  PIX sbs_pixI0;
+  PIX sbs_pixI1;
+  inline void Clear(void) {};
+};
+
+// surface stack state of a screen polygon in a band
+class CScanBandPolygon {
+public:
+  INDEX sbp_iScanLine;     // line in which the state was initialized
+  INDEX sbp_iInStack;      // counter of additions to surface stack
+  INDEX sbp_iInStackLine;  // counter at start of the line
+  FIX16_16 sbp_xSpanStart; // where polygon's span started
+  inline void Clear(void) {};
+};
+
+class CScanBand {
+public:
+  INDEX sb_iBand;
+  INDEX sb_iFirstLine;     // first scan line of the band
+  INDEX sb_iLastLine;      // last scan line of the band +1
+  INDEX sb_iStopLine;      // first line that was not scanned
+  INDEX sb_ctEdgeTransitions;
+  CStaticStackArray<CActiveEdge> sb_aaceActive;   // active list for current line
+  CStaticStackArray<CActiveEdge> sb_aaceTmp;
+  CStaticStackArray<CScreenPolygon *> sb_apspoStack; // surface stack - closest first, without far sentinel
+  CStaticStackArray<CScanBandPolygon> sb_asbpPolygons; // state of each screen polygon
+  CStaticStackArray<INDEX> sb_aiTouched;          // polygons whose state was used in current line
+  CStaticStackArray<CScanBandSpan> sb_asbsSpans;   // spans of all scanned lines
+  CStaticStackArray<INDEX> sb_aiLineSpans;        // first span of each scanned line
+};
+
+static CScanBand _asbBands[SCANBAND_MAXBANDS];
+static CStaticStackArray<CActiveEdge> _aaceBandWalk;
+static CStaticStackArray<CActiveEdge> _aaceBandWalkTmp;
+// first band that had to stop (bands after it need not finish)
+static volatile INDEX _iFirstStoppedBand = 0;
+
+// lower first stopped band to given one (bands of different threads may stop at the same time)
+static void StopBandsFrom(INDEX iBand)
+{
+  INDEX iOld = _iFirstStoppedBand;
+  while (iBand<iOld) {
+#ifdef _MSC_VER
+    const INDEX iSeen = InterlockedCompareExchange((LONG volatile *)&_iFirstStoppedBand, iBand, iOld);
+#else
+    const INDEX iSeen = __sync_val_compare_and_swap(&_iFirstStoppedBand, iOld, iBand);
+#endif
+    if (iSeen==iOld) return;
+    iOld = iSeen;
+  }
+}
+// statistics for visibility benchmark
+static INDEX _ctBandScanLines = 0;
+static INDEX _ctAllScanLines  = 0;
+
+static void CopyActiveList(CStaticStackArray<CActiveEdge> &aaceDst, const CStaticStackArray<CActiveEdge> &aaceSrc)
+{
+  aaceDst.PopAll();
+  aaceDst.Push(aaceSrc.Count());
+  memcpy(&aaceDst[0], &aaceSrc[0], aaceSrc.Count()*sizeof(CActiveEdge));
+}
+
+// check if a polygon is a portal that scanning must fail on
+static inline BOOL IsPortalToPass(CScreenPolygon &spo, UBYTE ubLightIllumination)
+{
+  return spo.IsPortal() && (ubLightIllumination==0 || ubLightIllumination!=spo.spo_ubIllumination);
+}
+
+/*
+ * Merge add list of a scan line into active list of a band (add list is left intact).
+ */
+void CRenderer::AddAddListToBandList(CStaticStackArray<CActiveEdge> &aace, CStaticStackArray<CActiveEdge> &aaceTmp, INDEX iScanLine)
+{
+  INDEX ctAddEdges = re_actAddCounts[iScanLine];
+  if (ctAddEdges==0) {
+    return;
+  }
+  // same merging as in AddAddListToActiveList()
+  INDEX ctActiveEdges = aace.Count();
+  aaceTmp.PopAll();
+  aaceTmp.Push(ctAddEdges+ctActiveEdges);
+  LISTITER(CAddEdge, ade_lnInAdd) itadeAdd(re_alhAddLists[iScanLine]);
+  CActiveEdge *paceSrc = &aace[0];
+  CActiveEdge *paceEnd = &aace[ctActiveEdges-1];
+  CActiveEdge *paceDst = &aaceTmp[0];
+  while(!itadeAdd.IsPastEnd()) {
+    while (paceSrc<=paceEnd && paceSrc->ace_xI.slHolder < itadeAdd->ade_xI.slHolder) {
+      *paceDst++=*paceSrc++;
+    }
+    *paceDst = CActiveEdge(itadeAdd->ade_psedEdge);
+    paceDst->ace_ulBandRemoved = 0;
+    paceDst++;
+    itadeAdd.MoveToNext();
+  }
+  while (paceSrc<=paceEnd) {
+    *paceDst++=*paceSrc++;
+  }
+  Swap(aace.sa_Count    , aaceTmp.sa_Count    );
+  Swap(aace.sa_Array    , aaceTmp.sa_Array    );
+  Swap(aace.sa_UsedCount, aaceTmp.sa_UsedCount);
+}
+
+/*
+ * Mark edges of inactive polygons in active list of a band as they would be when scanned.
+ */
+void CRenderer::MarkInactiveBandEdges(CStaticStackArray<CActiveEdge> &aace)
+{
+  // scanning skips lines with sentinels sorted wrong
+  INDEX ctEdges = aace.Count();
+  if (aace[0].ace_psedEdge!=&re_sedLeftSentinel
+    ||aace[ctEdges-1].ace_psedEdge!=&re_sedRightSentinel) {
+    return;
+  }
+  for (INDEX iEdge=1; iEdge<ctEdges-1; iEdge++) {
+    CScreenPolygon *pspo = aace[iEdge].ace_psedEdge->sed_pspo;
+    if (pspo==NULL || !pspo->spo_bActive) {
+      aace[iEdge].ace_ulBandRemoved = 1;
+    }
+  }
+}
+
+/*
+ * Remove edges that stop on a scan line from active list of a band.
+ */
+void CRenderer::RemRemoveListFromBandList(CStaticStackArray<CActiveEdge> &aace, INDEX iScanLine)
+{
+  // if the remove list is empty, even marked edges stay in list
+  if (re_apsedRemoveFirst[iScanLine]==NULL) {
+    return;
+  }
+  // edges in remove list are those that end on this line
+  const PIX pixBottomJ = iScanLine+re_pixTopScanLineJ+1;
+  CActiveEdge *paceEnd = &aace[aace.Count()-1];
+  CActiveEdge *paceSrc = &aace[1];
+  CActiveEdge *paceDst = paceSrc;
+  do {
+    const CScreenEdge *psed = paceSrc->ace_psedEdge;
+    const BOOL bRemoved = paceSrc->ace_ulBandRemoved
+      || (psed->sed_pixBottomJ==pixBottomJ && psed!=&re_sedLeftSentinel && psed!=&re_sedRightSentinel);
+    if (!bRemoved) {
+      *paceDst = *paceSrc;
+      paceDst++;
+    }
+    paceSrc++;
+  } while (paceSrc<=paceEnd);
+  aace.PopUntil(paceDst-&aace[0]-1);
+}
+
+/*
+ * Step all edges in active list of a band by one scan line and resort them.
+ */
+void CRenderer::StepAndResortBandList(CStaticStackArray<CActiveEdge> &aace)
+{
+  // same as StepAndResortActiveList()
+  CActiveEdge *pace = &aace[1];
+  CActiveEdge *paceEnd = &aace[aace.Count()-1];
+  do {
+    pace->ace_xI.slHolder += pace->ace_xIStep.slHolder;
+    if (pace[-1].ace_xI.slHolder > pace->ace_xI.slHolder) {
+      CActiveEdge *pacePred = pace;
+      do {
+        pacePred--;
+      } while(pacePred->ace_xI.slHolder > pace->ace_xI.slHolder);
+      CActiveEdge aceCurrent = *pace;
+      CActiveEdge *paceMove=pace-1;
+      do {
+        paceMove[1]=paceMove[0];
+        paceMove--;
+      } while (paceMove>pacePred);
+      paceMove[1] = aceCurrent;
+    }
+    pace++;
+  } while (pace < paceEnd);
+}
+
+// get state of a polygon in current line of a band
+static inline CScanBandPolygon &GetBandPolygon(CScanBand &sb, CScreenPolygon &spo, INDEX iScanLine)
+{
+  CScanBandPolygon &sbp = sb.sb_asbpPolygons[spo.spo_iIndex];
+  // counters are same at start of each line (unless scanning fails)
+  if (sbp.sbp_iScanLine!=iScanLine) {
+    sbp.sbp_iScanLine = iScanLine;
+    sbp.sbp_iInStack = sbp.sbp_iInStackLine = spo.spo_iInStack;
+    sb.sb_aiTouched.Push() = spo.spo_iIndex;
+  }
+  return sbp;
+}
+
+static inline void RecordBandSpan(CScanBand &sb, CScreenPolygon *pspo, FIX16_16 x0, FIX16_16 x1)
+{
+  CScanBandSpan &sbs = sb.sb_asbsSpans.Push();
+  sbs.sbs_pspo  = pspo;
+  sbs.sbs_pixI0 = PIXCoord(x0);
+  sbs.sbs_pixI1 = PIXCoord(x1);
+}
+
+/*
+ * Scan one line of a band into recorded spans (returns FALSE if it must be scanned serially).
+ */
+BOOL CRenderer::ScanBandLine(CScanBand &sb, INDEX iScanLine)
+{
+  CStaticStackArray<CActiveEdge> &aace = sb.sb_aaceActive;
+  CStaticStackArray<CScreenPolygon *> &apspoStack = sb.sb_apspoStack;
+  const INDEX ctSpans0 = sb.sb_asbsSpans.Count();
+  sb.sb_aiLineSpans.Push() = ctSpans0;
+
+  // if left and right sentinels are sorted wrong, skip entire line (as ScanOneLine() does)
+  INDEX ctEdges = aace.Count();
+  if (aace[0].ace_psedEdge!=&re_sedLeftSentinel
+    ||aace[ctEdges-1].ace_psedEdge!=&re_sedRightSentinel) {
+    return TRUE;
+  }
+
+  const FLOAT fScanJ = FLOAT(iScanLine+re_pixTopScanLineJ);
+  const BOOL bPerspective = re_prProjection.IsPerspective();
+  FIX16_16 xFarSpanStart = re_sedLeftSentinel.sed_xI;
+  apspoStack.PopAll();
+  sb.sb_aiTouched.PopAll();
+
+  // for all edges in the line
+  CActiveEdge *pace = &aace[1];
+  CActiveEdge *paceEnd = &aace[ctEdges-1];
+  for (; pace<paceEnd; pace++) {
+    CScreenEdge &sed = *pace->ace_psedEdge;
+    const FIX16_16 xI = pace->ace_xI;
+
+    // if this edge has no active polygon
+    CScreenPolygon *pspo = sed.sed_pspo;
+    if (pspo==NULL || !pspo->spo_bActive) {
+      // mark it for removal
+      pace->ace_ulBandRemoved = 1;
+      continue;
+    }
+    CScreenPolygon &spo = *pspo;
+    CScanBandPolygon &sbp = GetBandPolygon(sb, spo, iScanLine);
+    const INDEX ctStack = apspoStack.Count();
+
+    // if it is right edge of the polygon
+    if (sed.sed_ldtDirection==LDT_ASCENDING) {
+      // remove the polygon from stack
+      sbp.sbp_iInStack--;
+      if (sbp.sbp_iInStack!=0) {
+        continue;
+      }
+      INDEX iPos = 0;
+      while (iPos<ctStack && apspoStack[iPos]!=&spo) iPos++;
+      if (iPos==ctStack) {
+        return FALSE;
+      }
+      CScreenPolygon **ppspo = &apspoStack[0];
+      memmove(ppspo+iPos, ppspo+iPos+1, (ctStack-iPos-1)*sizeof(CScreenPolygon *));
+      apspoStack.Pop();
+      // if that was top polygon in surface stack
+      if (iPos==0) {
+        // portal must be passed serially
+        if (IsPortalToPass(spo, re_ubLightIllumination)) {
+          return FALSE;
+        }
+        // generate a span for it and mark that span of new top starts here
+        RecordBandSpan(sb, &spo, sbp.sbp_xSpanStart, xI);
+        if (ctStack>1) {
+          GetBandPolygon(sb, *apspoStack[0], iScanLine).sbp_xSpanStart = xI;
+        } else {
+          xFarSpanStart = xI;
+        }
+      }
+
+    // if it is left edge of the polygon
+    } else {
+      ASSERT(sed.sed_ldtDirection==LDT_DESCENDING);
+      // add the polygon to stack
+      sbp.sbp_iInStack++;
+      if (sbp.sbp_iInStack!=1) {
+        continue;
+      }
+      // find its place in stack same as AddPolygonToSurfaceStack() does
+      const FLOAT fScanI = FLOAT(xI)+BIAS;
+      FLOAT fOoK = SurfaceOoK(spo.spo_pgOoK, fScanI, fScanJ);
+      fOoK*=re_fEdgeAdjustK;
+      INDEX iPos = 0;
+      CScreenPolygon *pspoInStack = ctStack>0 ? apspoStack[0] : &re_spoFarSentinel;
+      if (!bPerspective) {
+        while (SurfaceDelta(fOoK, pspoInStack->spo_pgOoK, fScanI, fScanJ)<0
+            && pspoInStack!=&re_spoFarSentinel) {
+          iPos++;
+          pspoInStack = iPos<ctStack ? apspoStack[iPos] : &re_spoFarSentinel;
+        }
+      } else {
+        FLOAT fDelta = SurfaceDelta(fOoK, pspoInStack->spo_pgOoK, fScanI, fScanJ);
+        while (((SINT &)fDelta) < 0) {
+          if (pspoInStack==&re_spoFarSentinel) {
+            return FALSE;
+          }
+          iPos++;
+          pspoInStack = iPos<ctStack ? apspoStack[iPos] : &re_spoFarSentinel;
+          fDelta = SurfaceDelta(fOoK, pspoInStack->spo_pgOoK, fScanI, fScanJ);
+        }
+      }
+      apspoStack.Push();
+      CScreenPolygon **ppspo = &apspoStack[0];
+      memmove(ppspo+iPos+1, ppspo+iPos, (ctStack-iPos)*sizeof(CScreenPolygon *));
+      ppspo[iPos] = &spo;
+
+      // if it is the new top of surface stack
+      if (iPos==0) {
+        // get the old top
+        CScreenPolygon &spoOldTop = *pspoInStack;
+        const FIX16_16 xOldStart = (&spoOldTop==&re_spoFarSentinel)
+          ? xFarSpanStart : GetBandPolygon(sb, spoOldTop, iScanLine).sbp_xSpanStart;
+        if (IsPortalToPass(spoOldTop, re_ubLightIllumination)) {
+          // if its span has at least one pixel in length, portal must be passed serially
+          if (PIXCoord(xI)-PIXCoord(xOldStart)>0) {
+            return FALSE;
+          }
+        } else {
+          // generate span for old top
+          RecordBandSpan(sb, &spoOldTop, xOldStart, xI);
+        }
+        // mark that span of new polygon starts here
+        sbp.sbp_xSpanStart = xI;
+      }
+    }
+  }
+
+  // if anything is left in surface stack or some counter is not as before, leave cleanup to ScanOneLine()
+  if (apspoStack.Count()>0) {
+    return FALSE;
+  }
+  for (INDEX iTouched=0; iTouched<sb.sb_aiTouched.Count(); iTouched++) {
+    const CScanBandPolygon &sbp = sb.sb_asbpPolygons[sb.sb_aiTouched[iTouched]];
+    if (sbp.sbp_iInStack!=sbp.sbp_iInStackLine) {
+      return FALSE;
+    }
+  }
+
+  // generate span for far sentinel
+  RecordBandSpan(sb, &re_spoFarSentinel, xFarSpanStart, re_sedRightSentinel.sed_xI);
+  sb.sb_ctEdgeTransitions += ctEdges-2;
+  return TRUE;
+}
+
+/*
+ * Scan all lines of a band.
+ */
+void CRenderer::ScanOneBand(CScanBand &sb)
+{
+  sb.sb_aaceTmp.SetAllocationStep(256);
+  sb.sb_asbsSpans.SetAllocationStep(1024);
+  sb.sb_aiLineSpans.SetAllocationStep(256);
+  sb.sb_asbsSpans.PopAll();
+  sb.sb_aiLineSpans.PopAll();
+  sb.sb_ctEdgeTransitions = 0;
+  sb.sb_iStopLine = sb.sb_iLastLine;
+
+  // no polygon has state for any line yet
+  const INDEX ctPolygons = re_aspoScreenPolygons.Count();
+  sb.sb_asbpPolygons.PopAll();
+  if (ctPolygons>0) {
+    sb.sb_asbpPolygons.Push(ctPolygons);
+    for (INDEX ispo=0; ispo<ctPolygons; ispo++) {
+      sb.sb_asbpPolygons[ispo].sbp_iScanLine = -1;
+    }
+  }
+
+  for (INDEX iScanLine=sb.sb_iFirstLine; iScanLine<sb.sb_iLastLine; iScanLine++) {
+    // if some band above had to stop, results of this one will not be used
+    if (_iFirstStoppedBand<sb.sb_iBand) {
+      sb.sb_iStopLine = iScanLine;
+      return;
+    }
+    AddAddListToBandList(sb.sb_aaceActive, sb.sb_aaceTmp, iScanLine);
+    if (!ScanBandLine(sb, iScanLine)) {
+      // rest of the band must be scanned serially
+      sb.sb_aiLineSpans.Pop();
+      sb.sb_iStopLine = iScanLine;
+      StopBandsFrom(sb.sb_iBand);
+      return;
+    }
+    RemRemoveListFromBandList(sb.sb_aaceActive, iScanLine);
+    StepAndResortBandList(sb.sb_aaceActive);
+  }
+}
+
+/*
+ * Add spans recorded for one line of a band to the scene.
+ */
+void CRenderer::AddBandSpansToScene(CScanBand &sb, INDEX iScanLine)
+{
+  re_iCurrentScan = iScanLine;
+  re_pixCurrentScanJ = re_iCurrentScan + re_pixTopScanLineJ;
+  re_fCurrentScanJ = FLOAT(re_pixCurrentScanJ);
+  _pfRenderProfile.IncrementCounter(CRenderProfile::PCI_OVERALLSCANLINES);
+
+  const INDEX iLine = iScanLine-sb.sb_iFirstLine;
+  const INDEX iSpan0 = sb.sb_aiLineSpans[iLine];
+  const INDEX iSpan1 = (iLine+1<sb.sb_aiLineSpans.Count()) ? sb.sb_aiLineSpans[iLine+1] : sb.sb_asbsSpans.Count();
+
+  // if rendering view
+  if( !re_bRenderingShadows) {
+    // generate spans just as MakeSpan() would
+    for( INDEX iSpan=iSpan0; iSpan<iSpan1; iSpan++) {
+      const CScanBandSpan &sbs = sb.sb_asbsSpans[iSpan];
+      AddSpanToPolygon( *sbs.sbs_pspo, sbs.sbs_pixI0, sbs.sbs_pixI1);
+    }
+  // if rendering shadows
+  } else {
+    // fill shadow mask just as AddSpansToScene() would
+    UBYTE *pubShadow = re_pubShadow+re_slShadowWidth*re_iCurrentScan;
+    for( INDEX iSpan=iSpan0; iSpan<iSpan1; iSpan++) {
+      const CScanBandSpan &sbs = sb.sb_asbsSpans[iSpan];
+      const PIX pixLen = sbs.sbs_pixI1-sbs.sbs_pixI0;
+      if( pixLen<=0) continue;
+      AddShadowSpan( pubShadow, *sbs.sbs_pspo, pixLen);
+    }
+  }
+}
+
+// job that scans bands in parallel
+class CScanBandsJob : public CWorkerJob {
+public:
+  CRenderer *sbj_pre;
+  void ProcessRange(INDEX iFirst, INDEX iLast) {
+    for (INDEX iBand=iFirst; iBand<iLast; iBand++) {
+      sbj_pre->ScanOneBand(_asbBands[iBand]);
+    }
+  }
+};
+
+/*
+ * Scan lines from current one down in parallel bands, as far as possible.
+ * On return, current scan line is the first one that must be scanned serially.
+ */
+void CRenderer::ScanBands(INDEX ctBands)
+{
+  const INDEX iFirstLine = re_iCurrentScan;
+  const INDEX ctLines = re_ctScanLines-iFirstLine;
+  ASSERT(ctBands>1 && ctBands<=SCANBAND_MAXBANDS && ctLines>=ctBands);
+
+  // split the lines into bands
+  for (INDEX iBand=0; iBand<ctBands; iBand++) {
+    CScanBand &sb = _asbBands[iBand];
+    sb.sb_iBand = iBand;
+    sb.sb_iFirstLine = iFirstLine + ctLines*iBand/ctBands;
+    sb.sb_iLastLine  = iFirstLine + ctLines*(iBand+1)/ctBands;
+  }
+
+  // start from current active list (with edges that scanning marked as removed)
+  CopyActiveList(_aaceBandWalk, re_aaceActiveEdges);
+  for (INDEX iEdge=0; iEdge<_aaceBandWalk.Count(); iEdge++) {
+    CActiveEdge &ace = _aaceBandWalk[iEdge];
+    ace.ace_ulBandRemoved = ace.ace_psedEdge->sed_xI.slHolder==ACE_REMOVED;
+  }
+  // walk the active list down to the start of each band
+  INDEX iScanLine = iFirstLine;
+  for (INDEX iBand=0; iBand<ctBands; iBand++) {
+    CScanBand &sb = _asbBands[iBand];
+    for (; iScanLine<sb.sb_iFirstLine; iScanLine++) {
+      AddAddListToBandList(_aaceBandWalk, _aaceBandWalkTmp, iScanLine);
+      MarkInactiveBandEdges(_aaceBandWalk);
+      RemRemoveListFromBandList(_aaceBandWalk, iScanLine);
+      StepAndResortBandList(_aaceBandWalk);
+    }
+    CopyActiveList(sb.sb_aaceActive, _aaceBandWalk);
+  }
+
+  // scan all bands
+  _iFirstStoppedBand = ctBands;
+  CScanBandsJob sbj;
+  sbj.sbj_pre = this;
+  _pWorkerPool->Run(sbj, ctBands, 1);
+
+  // add spans to scene in order of lines, up to the first line that was not scanned
+  INDEX iStopLine = re_ctScanLines;
+  CScanBand *psbStopped = NULL;
+  for (INDEX iBand=0; iBand<ctBands; iBand++) {
+    CScanBand &sb = _asbBands[iBand];
+    for (INDEX iLine=sb.sb_iFirstLine; iLine<sb.sb_iStopLine; iLine++) {
+      AddBandSpansToScene(sb, iLine);
+    }
+    _pfRenderProfile.IncrementCounter(CRenderProfile::PCI_EDGETRANSITIONS, sb.sb_ctEdgeTransitions);
+    _sfStats.IncrementCounter(CStatForm::SCI_EDGETRANSITIONS, sb.sb_ctEdgeTransitions);
+    if (sb.sb_iStopLine<sb.sb_iLastLine) {
+      iStopLine = sb.sb_iStopLine;
+      psbStopped = &sb;
+      break;
+    }
+  }
+  _ctBandScanLines += iStopLine-iFirstLine;
+
+  // add lists of scanned lines are used up (including the stop line, it is merged in band's list)
+  const INDEX iLastUsedLine = Min(iStopLine, re_ctScanLines-1);
+  for (INDEX iLine=iFirstLine; iLine<=iLastUsedLine; iLine++) {
+    re_alhAddLists[iLine].Clear();
+    re_actAddCounts[iLine] = 0;
+  }
+
+  // if some line has to be scanned serially
+  if (psbStopped!=NULL) {
+    // continue with active list of the band that stopped
+    CopyActiveList(re_aaceActiveEdges, psbStopped->sb_aaceActive);
+    for (INDEX iEdge=0; iEdge<re_aaceActiveEdges.Count(); iEdge++) {
+      CActiveEdge &ace = re_aaceActiveEdges[iEdge];
+      if (ace.ace_ulBandRemoved) {
+        ace.ace_psedEdge->sed_xI.slHolder = ACE_REMOVED;
+      }
+    }
+  }
+  re_bCoherentScanLine = 0;
+  re_iCurrentScan = iStopLine;
+}
+
+// get number of bands to scan in parallel
+static INDEX GetScanBandsCount(void)
+{
+  extern INDEX wld_iScanBands;
+  INDEX ctBands = wld_iScanBands;
+  if (ctBands<=0) {
+    ctBands = _pWorkerPool->GetThreadsCount();
+  }
+  return Clamp(ctBands, 1L, (INDEX)SCANBAND_MAXBANDS);
+}
+
 /*
  * Rasterize edges into spans.
  */
@@ -787,8 +1332,25 @@ void CRenderer::ScanEdges(void)
   // mark that first line is never coherent with previous one
   re_bCoherentScanLine = 0;
 
+  // find in how many bands lines can be scanned
+  const INDEX ctBands = GetScanBandsCount();
+  INDEX ctBandRetries = 0;
+  _ctAllScanLines += re_ctScanLines;
+
   // for each scan line, top to bottom
   for (re_iCurrentScan = 0; re_iCurrentScan<re_ctScanLines; re_iCurrentScan++) {
+    // if there are enough lines left, scan as many as possible in parallel bands
+    if (ctBands>1 && ctBandRetries<=SCANBAND_MAXRETRIES
+     && re_ctScanLines-re_iCurrentScan >= ctBands*SCANBAND_MINLINES) {
+      ctBandRetries++;
+      ScanBands(ctBands);
+      // if all lines are done
+      if (re_iCurrentScan>=re_ctScanLines) {
+        break;
+      }
+      // otherwise, current line needs a portal to be passed
+    }
+
     re_pixCurrentScanJ = re_iCurrentScan + re_pixTopScanLineJ;
     re_fCurrentScanJ = FLOAT(re_pixCurrentScanJ);
 
@@ -20,6 +20,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Rendering/Render.h>
 #include <Engine/Rendering/Render_internal.h>
 #include <Engine/Base/Console.h>
+#include <Engine/Base/Shell.h>
+#include <Engine/Base/Timer.h>
+#include <Engine/Base/Translation.h>
+#include <Engine/Base/WorkerPool.h>
+#include <Engine/Network/Network.h>
 #include <Engine/Templates/DynamicContainer.h>
 #include <Engine/Templates/DynamicContainer.cpp>
 
@@ -49,6 +54,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <Engine/Graphics/DrawPort.h>
 #include <Engine/Graphics/GfxLibrary.h>
+#include <Engine/Graphics/Raster.h>
 #include <Engine/Graphics/Fog_internal.h>
 
 #include <Engine/Base/Statistics_Internal.h>
@@ -456,9 +462,52 @@ void CRenderer::ScanForOtherSectors(void)
   }
   ChangeStatsMode(CStatForm::STI_WORLDTRANSFORM);
 }
+// start background mixing of shadows in sectors that are just behind visible portals
+void CRenderer::PrefetchShadows(void)
+{
+  extern INDEX shd_bBackgroundMixing;
+  extern INDEX shd_iPrefetchShadows;
+  if( !shd_bBackgroundMixing || shd_iPrefetchShadows<=0
+   || _wrpWorldRenderPrefs.wrp_shtShadows==CWorldRenderPrefs::SHT_NONE) return;
+
+  // only portals in front of the viewer are interesting
+  const FLOAT3D vViewer = re_prProjection->pr_vViewerPosition;
+  FLOAT3D vViewDir;
+  AnglesToDirectionVector( re_prProjection->ViewerPlacementR().pl_OrientationAngle, vViewDir);
+  INDEX ctBudget = shd_iPrefetchShadows;
+
+  // for all portals in active sectors
+  {FOREACHINLIST(CBrushSector, bsc_lnInActiveSectors, re_lhActiveSectors, itbsc) {
+    FOREACHINSTATICARRAY(itbsc->bsc_abpoPolygons, CBrushPolygon, itpo) {
+      CBrushPolygon &bpo = *itpo;
+      if( !(bpo.bpo_ulFlags&BPOF_PORTAL)) continue;
+      if( (bpo.bpo_boxBoundingBox.Center()-vViewer)%vViewDir < 0) continue;
+      // for all sectors behind it that were not rendered
+      {FOREACHDSTOFSRC(bpo.bpo_rsOtherSideSectors, CBrushSector, bsc_rdOtherSidePortals, pbsc)
+        if( pbsc->bsc_lnInActiveSectors.IsLinked() || (pbsc->bsc_ulFlags&BSCF_HIDDEN)) continue;
+        // for all polygons that have shadows
+        FOREACHINSTATICARRAY(pbsc->bsc_abpoPolygons, CBrushPolygon, itpoOther) {
+          CBrushPolygon &bpoOther = *itpoOther;
+          const ULONG ulFlags = bpoOther.bpo_ulFlags;
+          if( (ulFlags&BPOF_FULLBRIGHT)
+          || ((ulFlags&BPOF_PORTAL) && !(ulFlags&(BPOF_TRANSLUCENT|BPOF_TRANSPARENT)))) continue;
+          // start mixing it
+          if( bpoOther.bpo_smShadowMap.Prefetch()) {
+            ctBudget--;
+            if( ctBudget<=0) return;
+          }
+        }
+      ENDFOR}
+    }
+  }}
+}
+
 // cleanup after scanning
 void CRenderer::CleanupScanning(void)
 {
+  // sectors just out of view will probably be needed soon
+  if( !re_bRenderingShadows && re_iIndex==0) PrefetchShadows();
+
   _pfRenderProfile.StartTimer(CRenderProfile::PTI_CLEANUP);
 
   // for all active sectors
@@ -1035,3 +1084,267 @@ ULONG RenderShadows(CWorld &woWorld, CEntity &enViewer,
 
   return ulFlags;
 }
+
+
+// time scanning of visibility from player's view with different numbers of bands
+void VisibilityBenchmark(void *pArgs)
+{
+  INDEX ctFrames = NEXTARGUMENT(INDEX);
+  if( ctFrames<=0) ctFrames = 20;
+  const PIX pixSizeI = 1024;
+  const PIX pixSizeJ = 768;
+
+  CEntity *penViewer = CEntity::GetPlayerEntity(0);
+  if( penViewer==NULL) {
+    CPrintF( TRANS("Visibility benchmark needs a game in progress.\n"));
+    return;
+  }
+
+  // project as seen by the player, to an offscreen mask (same as when rendering shadows)
+  CPerspectiveProjection3D prPerspective;
+  prPerspective.FOVL() = AngleDeg(90.0f);
+  prPerspective.ScreenBBoxL() = FLOATaabbox2D( FLOAT2D(0.0f, 0.0f), FLOAT2D(pixSizeI, pixSizeJ));
+  prPerspective.AspectRatioL() = 1.0f;
+  prPerspective.FrontClipDistanceL() = 0.3f;
+  prPerspective.ViewerPlacementL() = penViewer->GetLerpedPlacement();
+  CAnyProjection3D apr;
+  apr = prPerspective;
+  CStaticArray<UBYTE> aubMask[2];
+  aubMask[0].New(pixSizeI*pixSizeJ);
+  aubMask[1].New(pixSizeI*pixSizeJ);
+
+  extern INDEX wld_iScanBands;
+  const INDEX iOldScanBands = wld_iScanBands;
+  CPrintF( TRANS("Visibility benchmark (%dx%d, %d frames, %d threads):\n"), pixSizeI, pixSizeJ, ctFrames,
+           _pWorkerPool->GetThreadsCount());
+  for( INDEX ctBands=1; ctBands<=8; ctBands*=2) {
+    wld_iScanBands = ctBands;
+    _ctBandScanLines = 0;
+    _ctAllScanLines  = 0;
+    UBYTE *pubMask = &aubMask[ctBands>1][0];
+    CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+    for( INDEX iFrame=0; iFrame<ctFrames; iFrame++) {
+      memset( pubMask, 0x55, pixSizeI*pixSizeJ);
+      RenderShadows( *penViewer->en_pwoWorld, *penViewer, apr, FLOATaabbox3D(), pubMask, pixSizeI, pixSizeJ, 0);
+    }
+    CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+    const DOUBLE dMs = (tv1-tv0).GetSeconds()*1000.0/ctFrames;
+    const FLOAT fBanded = _ctBandScanLines*100.0f/Max(_ctAllScanLines, 1L);
+    if( ctBands==1) {
+      CPrintF( TRANS("  %d band:  %6.2f ms/frame\n"), ctBands, dMs);
+    } else {
+      const BOOL bMatch = memcmp( &aubMask[0][0], &aubMask[1][0], pixSizeI*pixSizeJ)==0;
+      CPrintF( TRANS("  %d bands: %6.2f ms/frame, %3.0f%% lines in bands, %s\n"), ctBands, dMs, fBanded,
+               bMatch ? TRANS("match") : TRANS("MISMATCH!"));
+    }
+  }
+  wld_iScanBands = iOldScanBands;
+}
+
+
+// render the world as seen by the player through the recording (NONE) graphics API,
+// so that engine-side CPU cost can be measured without any driver or GPU in the way
+void RenderBenchmark(void *pArgs)
+{
+  INDEX ctFrames = NEXTARGUMENT(INDEX);
+  if( ctFrames<=0) ctFrames = 100;
+  const PIX pixSizeI = 1024;
+  const PIX pixSizeJ = 768;
+
+  if( _pGfx->gl_eCurrentAPI!=GAT_NONE) {
+    CPrintF( TRANS("Render benchmark needs the NONE graphics API (headless mode).\n"));
+    return;
+  }
+  CEntity *penViewer = CEntity::GetPlayerEntity(0);
+  if( penViewer==NULL) {
+    CPrintF( TRANS("Render benchmark needs a game in progress.\n"));
+    return;
+  }
+
+  // offscreen raster without any viewport
+  CRaster raNull( pixSizeI, pixSizeJ, 0);
+  CDrawPort &dp = raNull.ra_MainDrawPort;
+
+  CPerspectiveProjection3D prPerspective;
+  prPerspective.FOVL() = AngleDeg(90.0f);
+  prPerspective.ScreenBBoxL() = FLOATaabbox2D( FLOAT2D(0.0f, 0.0f), FLOAT2D(pixSizeI, pixSizeJ));
+  prPerspective.AspectRatioL() = 1.0f;
+  prPerspective.FrontClipDistanceL() = 0.3f;
+  prPerspective.ViewerPlacementL() = penViewer->GetLerpedPlacement();
+  CAnyProjection3D apr;
+  apr = prPerspective;
+
+  // one warm-up frame to get textures and shadows cached
+  if( dp.Lock()) {
+    RenderView( *penViewer->en_pwoWorld, *penViewer, apr, dp);
+    dp.Unlock();
+  }
+  _pGfx->SwapBuffers(NULL);
+
+  // remember stat timers so that only this run gets measured
+  static const INDEX aiStages[] = {
+    CStatForm::STI_WORLDTRANSFORM, CStatForm::STI_WORLDVISIBILITY, CStatForm::STI_WORLDRENDERING,
+    CStatForm::STI_MODELSETUP, CStatForm::STI_MODELRENDERING, CStatForm::STI_PARTICLERENDERING,
+    CStatForm::STI_FLARESRENDERING, CStatForm::STI_SHADOWUPDATE, CStatForm::STI_EFFECTRENDER,
+    CStatForm::STI_BINDTEXTURE, CStatForm::STI_GFXAPI,
+  };
+  static const char *astrStages[] = {
+    "world transform", "world visibility", "world rendering",
+    "model setup", "model rendering", "particle rendering",
+    "flares rendering", "shadow update", "effect render",
+    "bind texture", "gfx API",
+  };
+  const INDEX ctStages = ARRAYCOUNT(aiStages);
+  CTimerValue atvStart[ARRAYCOUNT(aiStages)];
+  for( INDEX iStage=0; iStage<ctStages; iStage++) {
+    atvStart[iStage] = _sfStats.sf_astTimers[aiStages[iStage]].st_tvElapsed;
+  }
+  GFX_nsNullAPI.Clear();
+
+  CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+  for( INDEX iFrame=0; iFrame<ctFrames; iFrame++) {
+    if( dp.Lock()) {
+      RenderView( *penViewer->en_pwoWorld, *penViewer, apr, dp);
+      dp.Unlock();
+    }
+    _pGfx->SwapBuffers(NULL);
+  }
+  CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+
+  CPrintF( TRANS("Render benchmark (%dx%d, %d frames): %6.3f ms/frame\n"), pixSizeI, pixSizeJ, ctFrames,
+           (tv1-tv0).GetSeconds()*1000.0/ctFrames);
+  // (stages nest, so they don't add up to total)
+  for( INDEX iStage=0; iStage<ctStages; iStage++) {
+    CTimerValue tvStage = _sfStats.sf_astTimers[aiStages[iStage]].st_tvElapsed - atvStart[iStage];
+    CPrintF( "  %-20s %6.3f ms\n", astrStages[iStage], tvStage.GetSeconds()*1000.0/ctFrames);
+  }
+  GFX_ReportNullAPI(ctFrames);
+}
+
+
+// checksum of lights found for one model (independent of order in which they were found)
+static ULONG ModelLightsChecksum( BOOL bShadow, COLOR colLight, COLOR colAmbient, const FLOAT3D &vDirection)
+{
+  ULONG ulSum = colLight*3 + colAmbient*5 + bShadow*7 + _amlLights.Count()*11;
+  for( INDEX i=1; i<=3; i++) ulSum = ulSum*31 + *(ULONG*)&vDirection(i);
+  return ulSum;
+}
+
+// time sorting of models and finding of their lights serially and on worker threads,
+// for all models in the world (multiplied as many times as needed for a heavy scene)
+void ModelSetupBenchmark(void *pArgs)
+{
+  INDEX ctCopies = NEXTARGUMENT(INDEX);
+  if( ctCopies<=0) ctCopies = 10;
+  const INDEX ctRepeats = 10;
+
+  CEntity *penViewer = CEntity::GetPlayerEntity(0);
+  if( penViewer==NULL) {
+    CPrintF( TRANS("Model setup benchmark needs a game in progress.\n"));
+    return;
+  }
+  CWorld &wo = *penViewer->en_pwoWorld;
+  const FLOAT3D vViewer = penViewer->GetLerpedPlacement().pl_PositionVector;
+
+  // add all models in world as if they were visible
+  CRenderer &re = _areRenderers[0];
+  re.re_pwoWorld  = &wo;
+  re.re_penViewer = penViewer;
+  re.re_bRenderingShadows  = FALSE;
+  re.re_bBackgroundEnabled = FALSE;
+  re.re_admDelayedModels.PopAll();
+  for( INDEX iCopy=0; iCopy<ctCopies; iCopy++) {
+    FOREACHINDYNAMICCONTAINER( wo.wo_cenEntities, CEntity, iten) {
+      CEntity &en = *iten;
+      if( en.en_RenderType!=CEntity::RT_MODEL && en.en_RenderType!=CEntity::RT_SKAMODEL) continue;
+      CDelayedModel &dm = re.re_admDelayedModels.Push();
+      dm.dm_penModel = &en;
+      dm.dm_pmoModel = NULL;
+      dm.dm_fDistance  = (en.GetLerpedPlacement().pl_PositionVector-vViewer).Length();
+      dm.dm_fMipFactor = 0.0f;
+      dm.dm_ulFlags = DMF_VISIBLE;
+      if( en.en_RenderType==CEntity::RT_MODEL) {
+        dm.dm_pmoModel = en.GetModelObject();
+        if( dm.dm_pmoModel->HasAlpha()) dm.dm_ulFlags |= DMF_HASALPHA;
+      } else {
+        if( en.GetModelInstance()->HasAlpha()) dm.dm_ulFlags |= DMF_HASALPHA;
+      }
+    }
+  }
+  const INDEX ctModels = re.re_admDelayedModels.Count();
+  if( ctModels==0) {
+    CPrintF( TRANS("Model setup benchmark found no models in world.\n"));
+    return;
+  }
+  // remember order in which models were added
+  CStaticArray<CDelayedModel *> apdmAdded, apdmSerial;
+  apdmAdded.New(ctModels);
+  apdmSerial.New(ctModels);
+  CDelayedModel **apdm = re.re_admDelayedModels.GetArrayOfPointers();
+  memcpy( &apdmAdded[0], apdm, ctModels*sizeof(CDelayedModel *));
+  CStaticArray<ULONG> aulSerial;
+  aulSerial.New(ctModels);
+
+  extern INDEX mdl_bParallelSetup;
+  const INDEX bOldParallelSetup = mdl_bParallelSetup;
+  CPrintF( TRANS("Model setup benchmark (%d models, %d threads):\n"), ctModels, _pWorkerPool->GetThreadsCount());
+
+  // sort with qsort and find lights one by one
+  CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+  for( INDEX iRepeat=0; iRepeat<ctRepeats; iRepeat++) {
+    memcpy( apdm, &apdmAdded[0], ctModels*sizeof(CDelayedModel *));
+    qsort( apdm, ctModels, sizeof(CDelayedModel *), qsort_CompareDelayedModels);
+    for( INDEX iModel=0; iModel<ctModels; iModel++) {
+      CEntity &en = *re.re_admDelayedModels[iModel].dm_penModel;
+      COLOR colLight = C_GRAY, colAmbient = C_dGRAY;
+      FLOAT fTotalShadowIntensity = 0.0f;
+      FLOAT3D vTotalLightDirection( 1.0f, -1.0f, 1.0f);
+      FLOATplane3D plFloorPlane(FLOAT3D( 0.0f, 1.0f, 0.0f), 0.0f);
+      const BOOL bShadow = re.FindModelLights( en, en.GetLerpedPlacement(), colLight, colAmbient,
+                                               fTotalShadowIntensity, vTotalLightDirection, plFloorPlane);
+      aulSerial[iModel] = ModelLightsChecksum( bShadow, colLight, colAmbient, vTotalLightDirection);
+    }
+  }
+  CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+  memcpy( &apdmSerial[0], apdm, ctModels*sizeof(CDelayedModel *));
+
+  // radix sort and find lights on worker threads
+  mdl_bParallelSetup = TRUE;
+  CTimerValue tv2 = _pTimer->GetHighPrecisionTimer();
+  for( INDEX iRepeat=0; iRepeat<ctRepeats; iRepeat++) {
+    memcpy( apdm, &apdmAdded[0], ctModels*sizeof(CDelayedModel *));
+    re.PrepareModels(FALSE);
+  }
+  CTimerValue tv3 = _pTimer->GetHighPrecisionTimer();
+  mdl_bParallelSetup = bOldParallelSetup;
+
+  // models at same distance may come in different order, so compare only what rendering depends on
+  BOOL bMatch = TRUE;
+  for( INDEX iModel=0; iModel<ctModels; iModel++) {
+    const CDelayedModel &dmSerial = *apdmSerial[iModel];
+    const CDelayedModel &dmParallel = re.re_admDelayedModels[iModel];
+    if( dmSerial.dm_fDistance!=dmParallel.dm_fDistance
+     || (dmSerial.dm_ulFlags&DMF_HASALPHA)!=(dmParallel.dm_ulFlags&DMF_HASALPHA)) {
+      bMatch = FALSE;
+      break;
+    }
+    COLOR colLight, colAmbient;
+    FLOAT fTotalShadowIntensity;
+    FLOAT3D vTotalLightDirection;
+    FLOATplane3D plFloorPlane;
+    const BOOL bShadow = _apmPrepared[iModel].GetLights( colLight, colAmbient,
+                                          fTotalShadowIntensity, vTotalLightDirection, plFloorPlane);
+    // (lights of same entity are found the same way, so compare checksums of equal entities only)
+    if( dmSerial.dm_penModel==dmParallel.dm_penModel
+     && aulSerial[iModel]!=ModelLightsChecksum( bShadow, colLight, colAmbient, vTotalLightDirection)) {
+      bMatch = FALSE;
+      break;
+    }
+  }
+  const DOUBLE dSerialMs   = (tv1-tv0).GetSeconds()*1000.0/ctRepeats;
+  const DOUBLE dParallelMs = (tv3-tv2).GetSeconds()*1000.0/ctRepeats;
+  CPrintF( TRANS("  serial:   %6.3f ms/frame\n"), dSerialMs);
+  CPrintF( TRANS("  parallel: %6.3f ms/frame, %s\n"), dParallelMs, bMatch ? TRANS("match") : TRANS("MISMATCH!"));
+  re.re_admDelayedModels.PopAll();
+  _amlLights.PopAll();
+}
@@ -20,6 +20,8 @@ extern INDEX mdl_iShadowQuality;
 // 1 = one simple shadow
 // 2 = one complex shadow
 // 3 = all shadows
+extern INDEX mdl_bParallelSetup;
+extern INDEX ska_bMultiThreadedSkinning;
 
 
 /*
@@ -56,32 +58,19 @@ static inline FLOAT IntensityAtDistance( FLOAT fFallOff, FLOAT fHotSpot, FLOAT f
 }
 
 
-/* Find lights for one model. */
-BOOL CRenderer::FindModelLights( CEntity &en, const CPlacement3D &plModel,
-                                 COLOR &colLight, COLOR &colAmbient, FLOAT &fTotalShadowIntensity,
-                                 FLOAT3D &vTotalLightDirection, FLOATplane3D &plFloorPlane)
+/* Find lights for one model into given array (shading info must be already found).
+ * This only reads the world, so it can be called from worker threads. */
+static BOOL GatherModelLights( CWorld *pwo, CEntity &en, const CPlacement3D &plModel,
+                               COLOR &colLight, COLOR &colAmbient, FLOAT &fTotalShadowIntensity,
+                               FLOAT3D &vTotalLightDirection, FLOATplane3D &plFloorPlane,
+                               CDynamicStackArray<struct ModelLight> &amlLights)
 {
-  // find shading info if not already cached
-  if (en.en_psiShadingInfo!=NULL && !(en.en_ulFlags&ENF_VALIDSHADINGINFO)) {
-    _pfRenderProfile.StartTimer(CRenderProfile::PTI_FINDSHADINGINFO);
-    _pfRenderProfile.IncrementTimerAveragingCounter(CRenderProfile::PTI_FINDSHADINGINFO, 1);
-    if (en.en_ulFlags&ENF_NOSHADINGINFO) {
-      en.en_psiShadingInfo=NULL;
-    } else {
-      en.FindShadingInfo();
-    }
-    _pfRenderProfile.StopTimer(CRenderProfile::PTI_FINDSHADINGINFO);
-  }
-
-  _pfRenderProfile.StartTimer(CRenderProfile::PTI_FINDLIGHTS);
-
   // clear list of active lights
-  _amlLights.PopAll();
+  amlLights.PopAll();
 
   // if there is no valid shading info
   if( en.en_psiShadingInfo==NULL/* || en.en_psiShadingInfo->si_pbpoPolygon==NULL*/)
   { // no shadow
-    _pfRenderProfile.StopTimer(CRenderProfile::PTI_FINDLIGHTS);
     return FALSE;
   }
   // if there is valid shading info
@@ -96,7 +85,6 @@ BOOL CRenderer::FindModelLights( CEntity &en, const CPlacement3D &plModel,
         colLight = C_BLACK;
         colAmbient = C_GRAY;
         vTotalLightDirection = FLOAT3D(1.0f, -1.0f, 1.0f);
-        _pfRenderProfile.StopTimer(CRenderProfile::PTI_FINDLIGHTS);
         return FALSE;
       }
 
@@ -118,7 +106,6 @@ BOOL CRenderer::FindModelLights( CEntity &en, const CPlacement3D &plModel,
         colLight = C_BLACK;
         colAmbient = C_GRAY;
         vTotalLightDirection = FLOAT3D(1.0f, -1.0f, 1.0f);
-        _pfRenderProfile.StopTimer(CRenderProfile::PTI_FINDLIGHTS);
         return FALSE;
       }
 
@@ -134,7 +121,6 @@ BOOL CRenderer::FindModelLights( CEntity &en, const CPlacement3D &plModel,
         colAmbient = LerpColor( C_BLACK, col, 0.33f);
         fTotalShadowIntensity = NormByteToFloat((en.en_psiShadingInfo->si_pbpoPolygon->bpo_colShadow&CT_AMASK)>>CT_ASHIFT);
         vTotalLightDirection  = FLOAT3D(1.0f, -1.0f, 1.0f);
-        _pfRenderProfile.StopTimer(CRenderProfile::PTI_FINDLIGHTS);
         return TRUE;
       }
 
@@ -204,7 +190,7 @@ BOOL CRenderer::FindModelLights( CEntity &en, const CPlacement3D &plModel,
           }
         }
         // add the light to active lights
-        struct ModelLight &ml = _amlLights.Push();
+        struct ModelLight &ml = amlLights.Push();
         ml.ml_plsLight = plsLight;
         // normalize direction vector
         if (fDistance>0.001f) {
@@ -237,8 +223,8 @@ BOOL CRenderer::FindModelLights( CEntity &en, const CPlacement3D &plModel,
       FLOAT fTR=0.0f; FLOAT fTG=0.0f; FLOAT fTB=0.0f;
       FLOAT3D vDirection(0.0f,0.0f,0.0f);
       // for each active light
-      {for(INDEX iLight=0; iLight<_amlLights.Count(); iLight++) {
-        struct ModelLight &ml = _amlLights[iLight];
+      {for(INDEX iLight=0; iLight<amlLights.Count(); iLight++) {
+        struct ModelLight &ml = amlLights[iLight];
         // add it to total intensity
         fTR += ml.ml_fR;
         fTG += ml.ml_fG;
@@ -257,8 +243,8 @@ BOOL CRenderer::FindModelLights( CEntity &en, const CPlacement3D &plModel,
 
       // for each active light
       FLOAT fDR=0.0f; FLOAT fDG=0.0f; FLOAT fDB=0.0f;
-      {for(INDEX iLight=0; iLight<_amlLights.Count(); iLight++) {
-        struct ModelLight &ml = _amlLights[iLight];
+      {for(INDEX iLight=0; iLight<amlLights.Count(); iLight++) {
+        struct ModelLight &ml = amlLights[iLight];
         // find its contribution to direction vector
         const FLOAT fFactor = ClampDn( vDirection%ml.ml_vDirection, 0.0f);
         // add it to directional intensity
@@ -301,7 +287,7 @@ BOOL CRenderer::FindModelLights( CEntity &en, const CPlacement3D &plModel,
 
       // adjust for changed polygon shadow color
       COLOR colShadowMap = en.en_psiShadingInfo->si_pbpoPolygon->bpo_colShadow;
-      CTextureBlending &tbShadow = re_pwoWorld->wo_atbTextureBlendings[
+      CTextureBlending &tbShadow = pwo->wo_atbTextureBlendings[
         en.en_psiShadingInfo->si_pbpoPolygon->bpo_bppProperties.bpp_ubShadowBlend];
       COLOR colShadowMapAdjusted = MulColors(colShadowMap, tbShadow.tb_colMultiply);
       colLight   = MulColors( colLight,   colShadowMapAdjusted);
@@ -310,20 +296,188 @@ BOOL CRenderer::FindModelLights( CEntity &en, const CPlacement3D &plModel,
       // else no valid shading info
     } else {
       // no shadow
-      _pfRenderProfile.StopTimer(CRenderProfile::PTI_FINDLIGHTS);
       return FALSE;
     }
   }
-  _pfRenderProfile.StopTimer(CRenderProfile::PTI_FINDLIGHTS);
   return TRUE;
 }
 
 
+/* Find shading info for one model if not already cached. */
+static void FindModelShadingInfo( CEntity &en)
+{
+  // find shading info if not already cached
+  if (en.en_psiShadingInfo!=NULL && !(en.en_ulFlags&ENF_VALIDSHADINGINFO)) {
+    _pfRenderProfile.StartTimer(CRenderProfile::PTI_FINDSHADINGINFO);
+    _pfRenderProfile.IncrementTimerAveragingCounter(CRenderProfile::PTI_FINDSHADINGINFO, 1);
+    if (en.en_ulFlags&ENF_NOSHADINGINFO) {
+      en.en_psiShadingInfo=NULL;
+    } else {
+      en.FindShadingInfo();
+    }
+    _pfRenderProfile.StopTimer(CRenderProfile::PTI_FINDSHADINGINFO);
+  }
+}
+
+
+/* Find lights for one model. */
+BOOL CRenderer::FindModelLights( CEntity &en, const CPlacement3D &plModel,
+                                 COLOR &colLight, COLOR &colAmbient, FLOAT &fTotalShadowIntensity,
+                                 FLOAT3D &vTotalLightDirection, FLOATplane3D &plFloorPlane)
+{
+  FindModelShadingInfo(en);
+
+  _pfRenderProfile.StartTimer(CRenderProfile::PTI_FINDLIGHTS);
+  const BOOL bShadow = GatherModelLights( re_pwoWorld, en, plModel, colLight, colAmbient,
+                                          fTotalShadowIntensity, vTotalLightDirection, plFloorPlane, _amlLights);
+  _pfRenderProfile.StopTimer(CRenderProfile::PTI_FINDLIGHTS);
+  return bShadow;
+}
+
+
+// lights of a delayed model found before rendering
+class CPreparedModel {
+public:
+  BOOL  pm_bPrepared;               // set if lights are found for current pass
+  BOOL  pm_bShadow;                 // result of light search (model may have shadow)
+  COLOR pm_colLight;
+  COLOR pm_colAmbient;
+  FLOAT pm_fTotalShadowIntensity;
+  FLOAT3D pm_vLightDirection;
+  FLOATplane3D pm_plFloorPlane;
+  CDynamicStackArray<struct ModelLight> pm_amlLights;
+
+  /* Get found lights as FindModelLights() would. */
+  BOOL GetLights( COLOR &colLight, COLOR &colAmbient, FLOAT &fTotalShadowIntensity,
+                  FLOAT3D &vTotalLightDirection, FLOATplane3D &plFloorPlane) const
+  {
+    ASSERT(pm_bPrepared);
+    colLight   = pm_colLight;
+    colAmbient = pm_colAmbient;
+    fTotalShadowIntensity = pm_fTotalShadowIntensity;
+    vTotalLightDirection  = pm_vLightDirection;
+    plFloorPlane = pm_plFloorPlane;
+    _amlLights.PopAll();
+    for( INDEX iLight=0; iLight<pm_amlLights.Count(); iLight++) {
+      _amlLights.Push() = pm_amlLights[iLight];
+    }
+    return pm_bShadow;
+  }
+};
+
+// prepared models (in order of sorted delayed models)
+static CStaticArray<CPreparedModel> _apmPrepared;
+// buffers for sorting of delayed models
+static CStaticStackArray<ULONG> _aulModelKeys, _aulModelKeysTmp;
+static CStaticStackArray<INDEX> _aiModelOrder, _aiModelOrderTmp;
+static CStaticStackArray<CDelayedModel *> _apdmSorted;
+
+// stable sort of indices by keys (in DrawPort_Particles.cpp)
+extern void RadixSortIndices( ULONG *aulKeys, INDEX *aiIndices, ULONG *aulKeysTmp, INDEX *aiIndicesTmp, INDEX ctKeys);
+
+// radix sort key of model distance (nearer models first)
+static inline ULONG ModelSortKey( FLOAT fDistance)
+{
+  if( fDistance==0) fDistance = 0.0f; // same key for negative zero
+  ULONG ul = *(ULONG*)&fDistance;
+  // make unsigned order same as float order
+  ul ^= (ul&0x80000000) ? 0xFFFFFFFF : 0x80000000;
+  return ul;
+}
+
+class CModelLightsJob : public CWorkerJob {
+public:
+  CRenderer *mlj_pre;
+  TIME mlj_tmCurrentTick;   // light animations must see the same time as rendering thread
+  void ProcessRange(INDEX iFirst, INDEX iLast) {
+    _pTimer->SetCurrentTick(mlj_tmCurrentTick);
+    for( INDEX iModel=iFirst; iModel<iLast; iModel++) {
+      CPreparedModel &pm = _apmPrepared[iModel];
+      if( !pm.pm_bPrepared) continue;
+      CEntity &en = *mlj_pre->re_admDelayedModels[iModel].dm_penModel;
+      // same defaults as when rendering a model
+      pm.pm_colLight   = C_GRAY;
+      pm.pm_colAmbient = C_dGRAY;
+      pm.pm_vLightDirection = FLOAT3D( 1.0f, -1.0f, 1.0f);
+      pm.pm_plFloorPlane = FLOATplane3D(FLOAT3D( 0.0f, 1.0f, 0.0f), 0.0f);
+      pm.pm_fTotalShadowIntensity = 0.0f;
+      pm.pm_bShadow = GatherModelLights( mlj_pre->re_pwoWorld, en, en.GetLerpedPlacement(),
+                                         pm.pm_colLight, pm.pm_colAmbient, pm.pm_fTotalShadowIntensity,
+                                         pm.pm_vLightDirection, pm.pm_plFloorPlane, pm.pm_amlLights);
+    }
+  }
+};
+
+/*
+ * Sort delayed models by distance (same order as qsort, but models at same distance keep
+ * the order in which they were added), and find lights of models in this pass on worker threads.
+ */
+void CRenderer::PrepareModels( BOOL bBackground)
+{
+  const INDEX ctModels = re_admDelayedModels.Count();
+  if( ctModels<=0) return;
+  CDelayedModel **apdm = re_admDelayedModels.GetArrayOfPointers();
+
+  // radix sort models by distance
+  _aulModelKeys.PopAll();  _aulModelKeysTmp.PopAll();
+  _aiModelOrder.PopAll();  _aiModelOrderTmp.PopAll();
+  ULONG *aulKeys  = _aulModelKeys.Push(ctModels);
+  INDEX *aiOrder  = _aiModelOrder.Push(ctModels);
+  for( INDEX iModel=0; iModel<ctModels; iModel++) {
+    aulKeys[iModel] = ModelSortKey(apdm[iModel]->dm_fDistance);
+    aiOrder[iModel] = iModel;
+  }
+  RadixSortIndices( aulKeys, aiOrder, _aulModelKeysTmp.Push(ctModels), _aiModelOrderTmp.Push(ctModels), ctModels);
+  // then put models without alpha before ones with alpha
+  _apdmSorted.PopAll();
+  CDelayedModel **apdmSorted = _apdmSorted.Push(ctModels);
+  INDEX ctSorted = 0;
+  for( INDEX iPass=0; iPass<2; iPass++) {
+    const ULONG ulAlpha = iPass==0 ? 0 : DMF_HASALPHA;
+    for( INDEX iModel=0; iModel<ctModels; iModel++) {
+      CDelayedModel *pdm = apdm[aiOrder[iModel]];
+      if( (pdm->dm_ulFlags&DMF_HASALPHA)==ulAlpha) apdmSorted[ctSorted++] = pdm;
+    }
+  }
+  ASSERT(ctSorted==ctModels);
+  memcpy( apdm, apdmSorted, ctModels*sizeof(CDelayedModel *));
+
+  // lights are not needed when rendering shadows
+  if( re_bRenderingShadows) return;
+
+  if( _apmPrepared.Count()<ctModels) {
+    _apmPrepared.Clear();
+    _apmPrepared.New(ctModels);
+  }
+  // for each model that will be rendered in this pass
+  for( INDEX iModel=0; iModel<ctModels; iModel++) {
+    CDelayedModel &dm = re_admDelayedModels[iModel];
+    CEntity &en = *dm.dm_penModel;
+    CPreparedModel &pm = _apmPrepared[iModel];
+    const BOOL bIsBackground = re_bBackgroundEnabled && (en.en_ulFlags&ENF_BACKGROUND);
+    const BOOL bSka = en.en_RenderType==CEntity::RT_SKAMODEL || en.en_RenderType==CEntity::RT_SKAEDITORMODEL;
+    pm.pm_bPrepared = (bBackground==bIsBackground) && (dm.dm_ulFlags&DMF_VISIBLE)
+      && (bSka ? en.GetModelInstance()->mi_vStretch : dm.dm_pmoModel->mo_Stretch)!=FLOAT3D(0,0,0);
+    // shading info changes the entity, so it must be found here
+    if( pm.pm_bPrepared) FindModelShadingInfo(en);
+  }
+
+  // find lights
+  _pfRenderProfile.StartTimer(CRenderProfile::PTI_FINDLIGHTS);
+  CModelLightsJob mlj;
+  mlj.mlj_pre = this;
+  mlj.mlj_tmCurrentTick = _pTimer->CurrentTick();
+  _pWorkerPool->Run( mlj, ctModels, 8);
+  _pfRenderProfile.StopTimer(CRenderProfile::PTI_FINDLIGHTS);
+}
+
+
 /*
  * Render one model with shadow (eventually)
  */
 void CRenderer::RenderOneModel( CEntity &en, CModelObject &moModel, const CPlacement3D &plModel,
-                                const FLOAT fDistanceFactor, BOOL bRenderShadow, ULONG ulDMFlags)
+                                const FLOAT fDistanceFactor, BOOL bRenderShadow, ULONG ulDMFlags,
+                                const CPreparedModel *ppm/*=NULL*/)
 {
   // skip invisible models
   if( moModel.mo_Stretch == FLOAT3D(0,0,0)) return;
@@ -346,9 +500,14 @@ void CRenderer::RenderOneModel( CEntity &en, CModelObject &moModel, const CPlace
   FLOAT fTotalShadowIntensity = 0.0f;
   // if not rendering cluster shadows
   if( !re_bRenderingShadows) {
-    // find model lights
-    bRenderModelShadow = FindModelLights( en, plModel, colLight, colAmbient,
-                                          fTotalShadowIntensity, vTotalLightDirection, plFloorPlane);
+    // find model lights (unless already found)
+    if( ppm!=NULL) {
+      bRenderModelShadow = ppm->GetLights( colLight, colAmbient,
+                                           fTotalShadowIntensity, vTotalLightDirection, plFloorPlane);
+    } else {
+      bRenderModelShadow = FindModelLights( en, plModel, colLight, colAmbient,
+                                            fTotalShadowIntensity, vTotalLightDirection, plFloorPlane);
+    }
   }
 
   // let the entity adjust shading parameters if it wants to
@@ -450,7 +609,8 @@ void CRenderer::RenderOneModel( CEntity &en, CModelObject &moModel, const CPlace
  * Render one ska model with shadow (eventually)
  */
 void CRenderer::RenderOneSkaModel( CEntity &en, const CPlacement3D &plModel,
-                                  const FLOAT fDistanceFactor, BOOL bRenderShadow, ULONG ulDMFlags)
+                                  const FLOAT fDistanceFactor, BOOL bRenderShadow, ULONG ulDMFlags,
+                                  const CPreparedModel *ppm/*=NULL*/)
 {
   // skip invisible models
   if( en.GetModelInstance()->mi_vStretch == FLOAT3D(0,0,0)) return;
@@ -473,9 +633,14 @@ void CRenderer::RenderOneSkaModel( CEntity &en, const CPlacement3D &plModel,
   FLOAT fTotalShadowIntensity = 0.0f;
   // if not rendering cluster shadows
   if( !re_bRenderingShadows) {
-    // find model lights
-    bRenderModelShadow = FindModelLights( en, plModel, colLight, colAmbient,
-                                          fTotalShadowIntensity, vTotalLightDirection, plFloorPlane);
+    // find model lights (unless already found)
+    if( ppm!=NULL) {
+      bRenderModelShadow = ppm->GetLights( colLight, colAmbient,
+                                           fTotalShadowIntensity, vTotalLightDirection, plFloorPlane);
+    } else {
+      bRenderModelShadow = FindModelLights( en, plModel, colLight, colAmbient,
+                                            fTotalShadowIntensity, vTotalLightDirection, plFloorPlane);
+    }
   }
 
   // let the entity adjust shading parameters if it wants to
@@ -573,6 +738,34 @@ void CRenderer::RenderOneSkaModel( CEntity &en, const CPlacement3D &plModel,
 
 }
 
+/*
+ * Skin meshes of all ska models that will be rendered in this pass at once (on worker threads),
+ * with same placement and flags that they will be rendered with.
+ */
+void CRenderer::SkinSkaModels( BOOL bBackground)
+{
+  ASSERT( !re_bRenderingShadows);
+  for( INDEX iModel=0; iModel<re_admDelayedModels.Count(); iModel++) {
+    CDelayedModel &dm = re_admDelayedModels[iModel];
+    CEntity &en = *dm.dm_penModel;
+    const BOOL bIsBackground = re_bBackgroundEnabled && (en.en_ulFlags&ENF_BACKGROUND);
+    if( bBackground!=bIsBackground || !(dm.dm_ulFlags&DMF_VISIBLE) || re_penViewer==&en) continue;
+    if( en.en_RenderType!=CEntity::RT_SKAMODEL && en.en_RenderType!=CEntity::RT_SKAEDITORMODEL) continue;
+    if( en.GetModelInstance()->mi_vStretch == FLOAT3D(0,0,0)) continue;
+
+    ULONG &ulRenFlags = RM_GetRenderFlags();
+    ulRenFlags = 0;
+    if( dm.dm_ulFlags & DMF_FOG)      ulRenFlags |= RMF_FOG;
+    if( dm.dm_ulFlags & DMF_HAZE)     ulRenFlags |= RMF_HAZE;
+    if( dm.dm_ulFlags & DMF_INSIDE)   ulRenFlags |= RMF_INSIDE;
+    if( dm.dm_ulFlags & DMF_INMIRROR) ulRenFlags |= RMF_INMIRROR;
+    RM_SetObjectPlacement(en.GetLerpedPlacement());
+    RM_SetBoneAdjustCallback(&EntityAdjustBonesCallback,&en);
+    RM_AddToSkinBatch(*en.GetModelInstanceForRendering());
+  }
+  RM_SkinBatch();
+}
+
 /* 
  * Render models that were kept for delayed rendering.
  */
@@ -584,8 +777,14 @@ void CRenderer::RenderModels( BOOL bBackground)
   _pfRenderProfile.StartTimer(CRenderProfile::PTI_RENDERMODELS);
 
   // sort all the delayed models by distance
-  qsort(re_admDelayedModels.GetArrayOfPointers(), re_admDelayedModels.Count(),
-      sizeof(CDelayedModel *), qsort_CompareDelayedModels);
+  const BOOL bPrepared = mdl_bParallelSetup;
+  if( bPrepared) {
+    // (and find their lights in parallel)
+    PrepareModels(bBackground);
+  } else {
+    qsort(re_admDelayedModels.GetArrayOfPointers(), re_admDelayedModels.Count(),
+        sizeof(CDelayedModel *), qsort_CompareDelayedModels);
+  }
 
   CAnyProjection3D *papr;
   if( bBackground) {
@@ -598,6 +797,7 @@ void CRenderer::RenderModels( BOOL bBackground)
   if( !re_bRenderingShadows) {
     BeginModelRenderingView( *papr, re_pdpDrawPort);
     RM_BeginRenderingView(   *papr, re_pdpDrawPort);
+    if( ska_bMultiThreadedSkinning) SkinSkaModels(bBackground);
   } else {
     BeginModelRenderingMask(    *papr, re_pubShadow, re_slShadowWidth, re_slShadowHeight);
     RM_BeginModelRenderingMask( *papr, re_pubShadow, re_slShadowWidth, re_slShadowHeight);
@@ -614,10 +814,11 @@ void CRenderer::RenderModels( BOOL bBackground)
     if(  (bBackground && !bIsBackground)
      || (!bBackground &&  bIsBackground)
      || !(dm.dm_ulFlags&DMF_VISIBLE)) continue;
+    const CPreparedModel *ppm = (bPrepared && !re_bRenderingShadows) ? &_apmPrepared[iModel] : NULL;
 
     if(en.en_RenderType == CEntity::RT_SKAMODEL || en.en_RenderType == CEntity::RT_SKAEDITORMODEL)
     {
-      RenderOneSkaModel(en, en.GetLerpedPlacement(), dm.dm_fMipFactor, TRUE, dm.dm_ulFlags);
+      RenderOneSkaModel(en, en.GetLerpedPlacement(), dm.dm_fMipFactor, TRUE, dm.dm_ulFlags, ppm);
 
       // if selected entities should be drawn and this one is selected
       if( !re_bRenderingShadows && _wrpWorldRenderPrefs.wrp_stSelection==CWorldRenderPrefs::ST_ENTITIES
@@ -649,7 +850,7 @@ void CRenderer::RenderModels( BOOL bBackground)
     {
       // render the model with its shadow
       CModelObject &moModelObject = *dm.dm_pmoModel;
-      RenderOneModel( en, moModelObject, en.GetLerpedPlacement(), dm.dm_fMipFactor, TRUE, dm.dm_ulFlags);
+      RenderOneModel( en, moModelObject, en.GetLerpedPlacement(), dm.dm_fMipFactor, TRUE, dm.dm_ulFlags, ppm);
 
       // if selected entities should be drawn and this one is selected
       if( !re_bRenderingShadows && _wrpWorldRenderPrefs.wrp_stSelection==CWorldRenderPrefs::ST_ENTITIES
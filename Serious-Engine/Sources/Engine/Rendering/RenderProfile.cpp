@@ -85,4 +85,9 @@ CRenderProfile::CRenderProfile(void) :
   SETCOUNTERNAME(CRenderProfile::PCI_COHERENTSCANLINES, "coherent scan lines");
   SETCOUNTERNAME(CRenderProfile::PCI_SPANS, "total generated spans");
   SETCOUNTERNAME(CRenderProfile::PCI_TRAPEZOIDS, "total generated trapezoids");
+  SETCOUNTERNAME(CRenderProfile::PCI_SHADOWMIXESSTARTED, "shadow maps queued for background mixing");
+  SETCOUNTERNAME(CRenderProfile::PCI_SHADOWPREFETCHES, "shadow maps prefetched");
+  SETCOUNTERNAME(CRenderProfile::PCI_SHADOWSTALLSAVOIDED, "shadow mixing stalls avoided");
+  SETCOUNTERNAME(CRenderProfile::PCI_SHADOWMIXESFINISHED, "background mixed shadow maps used");
+  SETCOUNTERNAME(CRenderProfile::PCI_SHADOWMIXLATENCY, "background shadow mixing latency (ms total)");
 }
@@ -82,6 +82,11 @@ public:
     PCI_COHERENTSCANLINES,      // scan lines that were coherent with previous one
     PCI_SPANS,                  // total generated spans
     PCI_TRAPEZOIDS,             // total generated trapezoids
+    PCI_SHADOWMIXESSTARTED,     // shadow maps sent to background mixing
+    PCI_SHADOWPREFETCHES,       // shadow maps sent to background mixing before being visible
+    PCI_SHADOWSTALLSAVOIDED,    // shadow maps shown in lower quality instead of waiting for mixing
+    PCI_SHADOWMIXESFINISHED,    // background mixed shadow maps taken for rendering
+    PCI_SHADOWMIXLATENCY,       // total milliseconds from start of mixing until taken for rendering
     PCI_COUNT
   };
 
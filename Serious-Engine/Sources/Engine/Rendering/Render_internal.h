@@ -79,6 +79,7 @@ public:
   PIX spo_pixMaxI;
   PIX spo_pixMaxJ;
   PIX spo_pixTotalArea; // sum of all visible spans
+  INDEX spo_iIndex;     // index in renderer's screen polygons (for scanning in bands)
 
   /* Default constructor. */
   CScreenPolygon(void) {
@@ -141,7 +142,7 @@ public:
   FIX16_16 ace_xI;            // top I coordinate
   FIX16_16 ace_xIStep;        // I coordinate step per scan line
   CScreenEdge *ace_psedEdge;  // the edge
-  ULONG ace_ulDummy;  // alignment to 16 bytes
+  ULONG ace_ulBandRemoved;  // set if marked as removed while scanning in bands (also alignment to 16 bytes)
 
   ALIGNED_NEW_AND_DELETE(32)
 
@@ -455,6 +456,10 @@ public:
 
   /* Generate a span for a polygon on current scan line. */
   inline void MakeSpan(CScreenPolygon &spo, CScreenEdge *psed0, CScreenEdge *psed1);
+  /* Add a span on current scan line to polygon's bounding box (when rendering view). */
+  inline void AddSpanToPolygon(CScreenPolygon &spo, PIX pixI0, PIX pixI1);
+  /* Add a span to shadow mask (when rendering shadows). */
+  inline void AddShadowSpan(UBYTE *&pubShadow, const CScreenPolygon &spo, PIX pixLen);
 
   /* Add spans in current line to scene. */
   void AddSpansToScene(void);
@@ -483,6 +488,23 @@ public:
   /* Rasterize edges into spans. */
   void ScanEdges(void);
 
+  /* Merge add list of a scan line into active list of a band (add list is left intact). */
+  void AddAddListToBandList(CStaticStackArray<CActiveEdge> &aace, CStaticStackArray<CActiveEdge> &aaceTmp, INDEX iScanLine);
+  /* Mark edges of inactive polygons in active list of a band as they would be when scanned. */
+  void MarkInactiveBandEdges(CStaticStackArray<CActiveEdge> &aace);
+  /* Remove edges that stop on a scan line from active list of a band. */
+  void RemRemoveListFromBandList(CStaticStackArray<CActiveEdge> &aace, INDEX iScanLine);
+  /* Step all edges in active list of a band by one scan line and resort them. */
+  static void StepAndResortBandList(CStaticStackArray<CActiveEdge> &aace);
+  /* Scan one line of a band into recorded spans (returns FALSE if it must be scanned serially). */
+  BOOL ScanBandLine(class CScanBand &sb, INDEX iScanLine);
+  /* Scan all lines of a band. */
+  void ScanOneBand(CScanBand &sb);
+  /* Add spans recorded for one line of a band to the scene. */
+  void AddBandSpansToScene(CScanBand &sb, INDEX iScanLine);
+  /* Scan lines from current one down in parallel bands, as far as possible. */
+  void ScanBands(INDEX ctBands);
+
   /* Render wireframe brushes. */
   void RenderWireFrameBrushes(void);
   /* Find lights for one model. */
@@ -490,10 +512,16 @@ public:
                         FLOAT &fTotalShadowIntensity, FLOAT3D &vTotalLightDirection, FLOATplane3D &plFloorPlane);
   /* Render a model. */
   void RenderOneModel( CEntity &en, CModelObject &moModel, const CPlacement3D &plModel,
-                       const FLOAT fDistanceFactor, BOOL bRenderShadow, ULONG ulDMFlags);
+                       const FLOAT fDistanceFactor, BOOL bRenderShadow, ULONG ulDMFlags,
+                       const class CPreparedModel *ppm=NULL);
   /* Render a ska model. */
   void RenderOneSkaModel( CEntity &en, const CPlacement3D &plModel,
-                                  const FLOAT fDistanceFactor, BOOL bRenderShadow, ULONG ulDMFlags);
+                                  const FLOAT fDistanceFactor, BOOL bRenderShadow, ULONG ulDMFlags,
+                                  const class CPreparedModel *ppm=NULL);
+  /* Find lights and sort keys of delayed models in parallel, and radix sort them. */
+  void PrepareModels(BOOL bBackground);
+  /* Skin meshes of all visible ska models at once, before they are rendered. */
+  void SkinSkaModels(BOOL bBackground);
   /* Render models that were kept for delayed rendering. */
   void RenderModels(BOOL bBackground);
   /* Render active terrains */
@@ -557,6 +585,8 @@ public:
   void AddInitialSectors(void);
   // scan through portals for other sectors
   void ScanForOtherSectors(void);
+  // start background mixing of shadows in sectors that are just behind visible portals
+  void PrefetchShadows(void);
   // cleanup after scanning
   void CleanupScanning(void);
   // draw the prepared things to screen
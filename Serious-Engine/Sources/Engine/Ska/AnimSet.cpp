@@ -36,6 +36,7 @@ static CStaticArray<ANGLE3D> aangAngles;
 
 // if rotations are compresed does loader also fills array of uncompresed rotations
 static BOOL bAllRotations = FALSE;
+INDEX _ctAnimSetChanges = 0;
 void RememberUnCompresedRotatations(BOOL bRemember)
 {
   bAllRotations = bRemember;
@@ -325,6 +326,7 @@ void CAnimSet::OptimizeAnimation(Animation &an, FLOAT fTreshold)
 // add animation to animset
 void CAnimSet::AddAnimation(Animation *pan)
 {
+  _ctAnimSetChanges++;
   INDEX ctan = as_Anims.Count();
   as_Anims.Expand(ctan+1);
   Animation &an = as_Anims[ctan];
@@ -333,6 +335,7 @@ void CAnimSet::AddAnimation(Animation *pan)
 // remove animation from animset
 void CAnimSet::RemoveAnimation(Animation *pan)
 {
+  _ctAnimSetChanges++;
   INDEX ctan = as_Anims.Count();
   ASSERT(ctan>0);
   ASSERT(pan!=NULL);
@@ -446,6 +449,7 @@ void CAnimSet::Write_t(CTStream *ostrFile)
 // read from stream
 void CAnimSet::Read_t(CTStream *istrFile)
 {
+  _ctAnimSetChanges++;
   INDEX iFileVersion;
   // read chunk id
   istrFile->ExpectID_t(CChunkID(ANIMSET_ID));
@@ -587,6 +591,7 @@ void CAnimSet::Read_t(CTStream *istrFile)
 // clear animset
 void CAnimSet::Clear(void)
 {
+  _ctAnimSetChanges++;
   INDEX ctAnims = as_Anims.Count();
   for(INDEX iAnims=0;iAnims<ctAnims;iAnims++)
   {
@@ -103,4 +103,6 @@ public:
 
 // if rotations are compresed does loader also fills array of uncompresed rotations
 ENGINE_API void RememberUnCompresedRotatations(BOOL bRemember);
+// incremented whenever animations in any anim set change (to refresh anim lookups in model instances)
+ENGINE_API extern INDEX _ctAnimSetChanges;
 #endif  /* include-once check. */
@@ -0,0 +1,85 @@
+/* Copyright (c) 2002-2012 Croteam Ltd. 
+This program is free software; you can redistribute it and/or modify
+it under the terms of version 2 of the GNU General Public License as published by
+the Free Software Foundation
+
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA. */
+
+#ifndef SE_INCL_IDLOOKUP_H
+#define SE_INCL_IDLOOKUP_H
+#ifdef PRAGMA_ONCE
+  #pragma once
+#endif
+
+#include <Engine/Templates/StaticArray.h>
+
+// maps ska IDs (indices in string table) to array indices (hash with open addressing)
+struct SkaIDLookup
+{
+  CStaticArray<INDEX> il_aiIDs;      // ID in each slot (-1 if slot is empty)
+  CStaticArray<INDEX> il_aiIndices;  // index for each slot
+  INDEX il_ctEntries;                // how many IDs were added
+
+  SkaIDLookup() { il_ctEntries = -1; };
+
+  // check if lookup is built for given number of entries
+  inline BOOL IsBuiltFor(INDEX ctEntries) const { return il_ctEntries==ctEntries; };
+
+  // forget all IDs
+  inline void Clear(void) {
+    il_aiIDs.Clear();
+    il_aiIndices.Clear();
+    il_ctEntries = -1;
+  };
+
+  // prepare slots for given number of IDs
+  inline void Start(INDEX ctEntries) {
+    Clear();
+    INDEX ctSlots = 4;
+    while(ctSlots<ctEntries*2) ctSlots<<=1;
+    il_aiIDs.New(ctSlots);
+    il_aiIndices.New(ctSlots);
+    for(INDEX i=0;i<ctSlots;i++) il_aiIDs[i] = -1;
+    il_ctEntries = ctEntries;
+  };
+
+  inline INDEX FirstSlot(INDEX iID) const {
+    return (INDEX)(((ULONG)iID*2654435761UL)>>8) & (il_aiIDs.Count()-1);
+  };
+
+  // add ID (if same ID is added more than once, first one is kept)
+  inline void Add(INDEX iID, INDEX iIndex) {
+    if(iID<0) return;
+    const INDEX iMask = il_aiIDs.Count()-1;
+    for(INDEX iSlot=FirstSlot(iID);;iSlot=(iSlot+1)&iMask) {
+      if(il_aiIDs[iSlot]==iID) return;
+      if(il_aiIDs[iSlot]<0) {
+        il_aiIDs[iSlot] = iID;
+        il_aiIndices[iSlot] = iIndex;
+        return;
+      }
+    }
+  };
+
+  // get index for ID (-1 if not found)
+  inline INDEX Find(INDEX iID) const {
+    if(il_ctEntries<=0 || iID<0) return -1;
+    const INDEX iMask = il_aiIDs.Count()-1;
+    for(INDEX iSlot=FirstSlot(iID);;iSlot=(iSlot+1)&iMask) {
+      const INDEX iSlotID = il_aiIDs[iSlot];
+      if(iSlotID==iID) return il_aiIndices[iSlot];
+      if(iSlotID<0) return -1;
+    }
+  };
+};
+
+
+#endif  /* include-once check. */
@@ -363,6 +363,9 @@ void CMesh::OptimizeLod(MeshLOD &mLod)
   mLod.mlod_aMorphMaps.CopyArray(mshOptimized.mlod_aMorphMaps);
   mLod.mlod_aWeightMaps.CopyArray(mshOptimized.mlod_aWeightMaps);
   mLod.mlod_aUVMaps.CopyArray(mshOptimized.mlod_aUVMaps);
+  // vertices were reordered, so rebuild skinning streams
+  mLod.mlod_aiSkinFirst.Clear();
+  mLod.mlod_ilMorphMaps.Clear();
 
   // clear memory
   ClearSortArray(ctVertices);
@@ -471,6 +474,8 @@ void CMesh::NormalizeWeightsInLod(MeshLOD &mlod)
       mwh.mww_fWeight /= aWeightFactors[mwh.mww_iVertex];
     }
   }
+  // rebuild skinning streams with new weights
+  mlod.mlod_aiSkinFirst.Clear();
   // clear weight array
   aWeightFactors.Clear();
 }
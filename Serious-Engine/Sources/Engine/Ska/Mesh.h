@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Math/Placement.h>
 #include <Engine/Templates/DynamicArray.h>
 #include <Engine/Templates/StaticArray.h>
+#include <Engine/Ska/IDLookup.h>
 #include <Engine/Graphics/Texture.h>
 #include <Engine/Graphics/Shader.h>
 
@@ -47,6 +48,11 @@ struct ENGINE_API MeshLOD
   CStaticArray<struct MeshWeightMap> mlod_aWeightMaps; // weight maps
   CStaticArray<struct MeshMorphMap>  mlod_aMorphMaps;  // morph maps
   CTString mlod_fnSourceFile;// file name of ascii am file, used in Ska studio
+  // weight maps sorted by vertices, built for skinning when first rendered (not saved)
+  CStaticArray<INDEX> mlod_aiSkinFirst;       // first influence of each vertex (and one past last)
+  CStaticArray<UWORD> mlod_auwSkinWeightMap;  // weight map of each influence
+  CStaticArray<FLOAT> mlod_afSkinWeight;      // weight of each influence
+  SkaIDLookup mlod_ilMorphMaps;               // morph map indices by ID (built on first use)
 };
 
 struct ENGINE_API MeshVertex
@@ -22,6 +22,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Base/ErrorReporting.h>
 #include <Engine/Base/Stream.h>
 #include <Engine/Base/Console.h>
+#include <Engine/Base/Shell.h>
+#include <Engine/Base/Timer.h>
+#include <Engine/Base/Translation.h>
 #include <Engine/Math/Quaternion.h>
 #include <Engine/Templates/DynamicStackArray.cpp>
 #include <Engine/Templates/DynamicContainer.cpp>
@@ -111,6 +114,9 @@ CModelInstance::CModelInstance()
   memset(&mi_qvOffset,0,sizeof(QVect));
   mi_qvOffset.qRot.q_w = 1;
   mi_iCurentBBox = -1;
+  mi_ctLookupAnimSets = -1;
+  mi_iLookupAnimSetChanges = -1;
+  mi_iLookupMissedAnimID = -1;
   // set default all frames bbox
 //  mi_cbAllFramesBBox.SetName("All Frames Bounding box");
   mi_cbAllFramesBBox.SetMin(FLOAT3D(-0.5,0,-0.5));
@@ -346,6 +352,8 @@ void CModelInstance::AddAnimSet_t(CTFileName fnAnimSet)
 {
   CAnimSet *Anim = _pAnimSetStock->Obtain_t(fnAnimSet);
   mi_aAnimSet.Add(Anim);
+  // anim lookup must be rebuilt
+  mi_ctLookupAnimSets = -1;
 }
 
 // Add texture to ModelInstance (if no mesh instance given, add texture to last mesh instance)
@@ -755,30 +763,66 @@ void CModelInstance::OffSetAnimationQueue(TIME fOffsetTime)
   }
 }
 
+// Build lookup of animations by ID
+void CModelInstance::BuildAnimLookup(void)
+{
+  INDEX ctas = mi_aAnimSet.Count();
+  INDEX ctAnims = 0;
+  for(INDEX ias=0;ias<ctas;ias++) {
+    ctAnims += mi_aAnimSet[ias].as_Anims.Count();
+  }
+  mi_ilAnims.Start(ctAnims);
+  // last anim set has priority, and first animation in it
+  for(INDEX ias=ctas-1;ias>=0;ias--) {
+    CAnimSet &asAnimSet = mi_aAnimSet[ias];
+    INDEX ctan = asAnimSet.as_Anims.Count();
+    for(INDEX ian=0;ian<ctan;ian++) {
+      ASSERT(ias<=0x7FFF && ian<=0xFFFF);
+      mi_ilAnims.Add(asAnimSet.as_Anims[ian].an_iID, (ias<<16)|ian);
+    }
+  }
+  mi_ctLookupAnimSets = ctas;
+  mi_iLookupAnimSetChanges = _ctAnimSetChanges;
+  mi_iLookupMissedAnimID = -1;
+}
+
 // Find animation by ID
 BOOL CModelInstance::FindAnimationByID(int iAnimID,INDEX *piAnimSetIndex,INDEX *piAnimIndex)
 {
   INDEX ctas = mi_aAnimSet.Count();
   if (ctas<=0) return FALSE;
-  // for each animset
-  for(int ias=ctas-1;ias>=0;ias--) {
-    CAnimSet &asAnimSet = mi_aAnimSet[ias];
-    INDEX ctan = asAnimSet.as_Anims.Count();
-    // for each animation
-    for(int ian=0;ian<ctan;ian++) {
-      Animation &an = asAnimSet.as_Anims[ian];
-      // if this is animation to find
-      if(an.an_iID == iAnimID) {
+  // rebuild lookup if anim sets were added, removed or changed
+  BOOL bRebuilt = FALSE;
+  if(mi_ctLookupAnimSets!=ctas || mi_iLookupAnimSetChanges!=_ctAnimSetChanges) {
+    BuildAnimLookup();
+    bRebuilt = TRUE;
+  }
+  FOREVER {
+    INDEX iFound = mi_ilAnims.Find(iAnimID);
+    if(iFound>=0) {
+      INDEX ias = iFound>>16;
+      INDEX ian = iFound&0xFFFF;
+      // if anim set is still the same one (it might have been replaced by another anim set)
+      if(ias<ctas && ian<mi_aAnimSet[ias].as_Anims.Count() && mi_aAnimSet[ias].as_Anims[ian].an_iID==iAnimID) {
         // set pointers of indices to animset and animation
         *piAnimSetIndex = ias;
         *piAnimIndex = ian;
         // retrun succesfully
         return TRUE;
       }
+      ASSERT(!bRebuilt);
+    }
+    // animation was't found (even in fresh lookup)
+    if(bRebuilt) {
+      if(iFound<0) mi_iLookupMissedAnimID = iAnimID;
+      return FALSE;
     }
+    // don't rebuild again for animation that wasn't there when lookup was built
+    if(iFound<0 && mi_iLookupMissedAnimID==iAnimID) return FALSE;
+    // lookup might be stale, so rebuild it and try again
+    BuildAnimLookup();
+    bRebuilt = TRUE;
   }
-  // animation was't found
-  return FALSE;
 }
 
 // Find animation by ID
@@ -993,6 +1037,7 @@ void CModelInstance::Copy(CModelInstance &miOther)
     CAnimSet &asOther = miOther.mi_aAnimSet[ias];
     AddAnimSet_t(asOther.GetName());
   }
+  mi_ctLookupAnimSets = -1;
 
   // copy children
   INDEX ctch = miOther.mi_cmiChildren.Count();
@@ -1069,6 +1114,7 @@ void CModelInstance::Clear(void)
     _pAnimSetStock->Release(&mi_aAnimSet[ias]);  
   }
   mi_aAnimSet.Clear();
+  mi_ctLookupAnimSets = -1;
 
   // clear all colision boxes 
   mi_cbAABox.Clear();
@@ -1103,3 +1149,96 @@ void CModelInstance::EnableSrcRememberFN(BOOL bEnable)
 {
   bRememberSourceFN = bEnable;
 }
+
+// find animation by ID the way it was done before lookups (used as reference in benchmark)
+static BOOL FindAnimationLinear(CModelInstance &mi,int iAnimID,INDEX *piAnimSetIndex,INDEX *piAnimIndex)
+{
+  for(INDEX ias=mi.mi_aAnimSet.Count()-1;ias>=0;ias--) {
+    CAnimSet &asAnimSet = mi.mi_aAnimSet[ias];
+    INDEX ctan = asAnimSet.as_Anims.Count();
+    for(INDEX ian=0;ian<ctan;ian++) {
+      if(asAnimSet.as_Anims[ian].an_iID == iAnimID) {
+        *piAnimSetIndex = ias;
+        *piAnimIndex = ian;
+        return TRUE;
+      }
+    }
+  }
+  return FALSE;
+}
+
+// compare linear and hashed searches of animations and string IDs
+void SkaLookupBenchmark(void *pArgs)
+{
+  INDEX ctAnimSets = NEXTARGUMENT(INDEX);
+  if(ctAnimSets<=0) ctAnimSets = 8;
+  const INDEX ctAnims = 50;
+  const INDEX ctRepeats = 100;
+
+  // make anim sets with named animations
+  CModelInstance mi;
+  CStaticArray<CAnimSet> aasAnimSets;
+  aasAnimSets.New(ctAnimSets);
+  CStaticArray<CTString> astrNames;
+  astrNames.New(ctAnimSets*ctAnims);
+  for(INDEX ias=0;ias<ctAnimSets;ias++) {
+    CAnimSet &as = aasAnimSets[ias];
+    as.as_Anims.New(ctAnims);
+    for(INDEX ian=0;ian<ctAnims;ian++) {
+      CTString &strName = astrNames[ias*ctAnims+ian];
+      strName.PrintF("BenchAnim_%d_%d", ias, ian);
+      as.as_Anims[ian].an_iID = ska_GetIDFromStringTable(strName);
+      as.as_Anims[ian].an_iFrames = 0;
+    }
+    mi.mi_aAnimSet.Add(&as);
+  }
+  const INDEX ctNames = astrNames.Count();
+
+  INDEX ctMismatches = 0;
+  INDEX iSum0 = 0, iSum1 = 0;
+  CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+  for(INDEX iRepeat=0;iRepeat<ctRepeats;iRepeat++) {
+    for(INDEX iName=0;iName<ctNames;iName++) {
+      INDEX ias=-1, ian=-1;
+      FindAnimationLinear(mi, aasAnimSets[iName/ctAnims].as_Anims[iName%ctAnims].an_iID, &ias, &ian);
+      iSum0 += ias*ctAnims+ian;
+    }
+  }
+  CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+  for(INDEX iRepeat=0;iRepeat<ctRepeats;iRepeat++) {
+    for(INDEX iName=0;iName<ctNames;iName++) {
+      INDEX ias=-1, ian=-1;
+      mi.FindAnimationByID(aasAnimSets[iName/ctAnims].as_Anims[iName%ctAnims].an_iID, &ias, &ian);
+      iSum1 += ias*ctAnims+ian;
+    }
+  }
+  CTimerValue tv2 = _pTimer->GetHighPrecisionTimer();
+  if(iSum0!=iSum1) ctMismatches++;
+
+  // string to ID, comparing strings one by one vs. string table hash
+  iSum0 = iSum1 = 0;
+  CTimerValue tv3 = _pTimer->GetHighPrecisionTimer();
+  for(INDEX iName=0;iName<ctNames;iName++) {
+    for(INDEX i=0;i<ctNames;i++) {
+      if(astrNames[i]==astrNames[iName]) { iSum0 += i; break; }
+    }
+  }
+  CTimerValue tv4 = _pTimer->GetHighPrecisionTimer();
+  for(INDEX iName=0;iName<ctNames;iName++) {
+    INDEX iID = ska_FindStringInTable(astrNames[iName]);
+    if(iID!=aasAnimSets[iName/ctAnims].as_Anims[iName%ctAnims].an_iID) ctMismatches++;
+    iSum1 += iName;
+  }
+  CTimerValue tv5 = _pTimer->GetHighPrecisionTimer();
+  if(iSum0!=iSum1) ctMismatches++;
+
+  // anim sets are not in stock, so just forget them
+  mi.mi_aAnimSet.Clear();
+
+  CPrintF(TRANS("SKA lookup benchmark (%d anim sets, %d animations):\n"), ctAnimSets, ctNames);
+  CPrintF(TRANS("  anim by ID: linear %7.3f ms, hashed %7.3f ms (%d searches)\n"),
+          (tv1-tv0).GetSeconds()*1000.0, (tv2-tv1).GetSeconds()*1000.0, ctNames*ctRepeats);
+  CPrintF(TRANS("  ID by name: linear %7.3f ms, hashed %7.3f ms, %s\n"),
+          (tv4-tv3).GetSeconds()*1000.0, (tv5-tv4).GetSeconds()*1000.0,
+          ctMismatches==0 ? TRANS("match") : TRANS("MISMATCH!"));
+}
@@ -201,6 +201,8 @@ public:
   void OffSetAnimationQueue(TIME fOffsetTime);
   // Find animation by ID
   BOOL FindAnimationByID(int iAnimID, INDEX *piAnimSetIndex, INDEX *piAnimIndex);
+  // Build lookup of animations by ID
+  void BuildAnimLookup(void);
   // Find first animation of all animations in ModelInstance (safety function)
   INDEX FindFirstAnimationID();
   // Get animation length
@@ -260,6 +262,11 @@ public:
   FLOAT3D mi_vStretch;    // stretch of this model instance
   ColisionBox mi_cbAllFramesBBox; // all frames colision box
   CTFileName mi_fnSourceFile;     // source file name of this model instance (used only for ska studio)
+  // animations by ID, index is (animset<<16)|anim (built on first use)
+  SkaIDLookup mi_ilAnims;
+  INDEX mi_ctLookupAnimSets;      // count of anim sets when lookup was built
+  INDEX mi_iLookupAnimSetChanges; // anim set changes when lookup was built
+  INDEX mi_iLookupMissedAnimID;   // animation that wasn't found even in freshly built lookup
 
 private:
   INDEX mi_iModelID;      // ID of this model instance (this is ID for mi_strName)
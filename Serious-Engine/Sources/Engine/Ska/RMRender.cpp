@@ -28,9 +28,21 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Ska/AnimSet.h>
 #include <Engine/Ska/StringTable.h>
 #include <Engine/Templates/DynamicContainer.cpp>
+#include <Engine/Templates/DynamicStackArray.cpp>
 #include <Engine/Graphics/DrawPort.h>
 #include <Engine/Graphics/Fog_internal.h>
 #include <Engine/Base/Statistics_Internal.h>
+#include <Engine/Base/WorkerPool.h>
+#include <Engine/Base/Shell.h>
+#include <Engine/Base/Timer.h>
+#include <Engine/Base/Translation.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SKA_NEON 1
+#else
+#define SKA_NEON 0
+#endif
 
 static CAnyProjection3D _aprProjection;
 static CDrawPort *_pdp = NULL;
@@ -63,10 +75,6 @@ static CStaticStackArray<struct RenBone> _aRenBones;
 static CStaticStackArray<struct RenMesh> _aRenMesh;
 static CStaticStackArray<struct RenMorph> _aRenMorph;
 static CStaticStackArray<struct RenWeight> _aRenWeights;
-static CStaticStackArray<struct MeshVertex> _aMorphedVtxs;
-static CStaticStackArray<struct MeshNormal> _aMorphedNormals;
-static CStaticStackArray<struct MeshVertex> _aFinalVtxs;
-static CStaticStackArray<struct MeshNormal> _aFinalNormals;
 static CStaticStackArray<struct GFXColor> _aMeshColors;
 static CStaticStackArray<struct GFXTexCoord> _aTexMipFogy;
 static CStaticStackArray<struct GFXTexCoord> _aTexMipHazey;
@@ -74,6 +82,57 @@ static CStaticStackArray<struct GFXTexCoord> _aTexMipHazey;
 static MeshVertex *_pavFinalVertices = NULL;  // pointer to final arrays
 static MeshNormal *_panFinalNormals = NULL;   // pointer to final normals
 static INDEX _ctFinalVertices;                // final vertices count
+
+// skinning inputs and skinned vertices and normals of one ren mesh
+struct MeshSkin {
+  // inputs (everything final vertices depend on, besides mesh lod itself)
+  MeshLOD *ms_pmlod;
+  INDEX ms_iSkinType;                               // one of SKIN_* types
+  CStaticStackArray<MeshMorphMap*> ms_apmmmMorphs;  // morph maps with factor above zero
+  CStaticStackArray<FLOAT> ms_afMorphFactors;
+  CStaticStackArray<FLOAT> ms_afPalette;  // transforms of all weight maps (or one transform for boneless mesh)
+  // results
+  CStaticStackArray<struct MeshVertex> ms_aMorphedVtxs;
+  CStaticStackArray<struct MeshNormal> ms_aMorphedNormals;
+  CStaticStackArray<struct MeshVertex> ms_aFinalVtxs;
+  CStaticStackArray<struct MeshNormal> ms_aFinalNormals;
+  MeshVertex *ms_pavVertices;  // final vertices (may point to mesh lod)
+  MeshNormal *ms_panNormals;   // final normals
+  INDEX ms_ctVertices;
+  BOOL  ms_bViewSpace;         // are vertices transformed to view space
+
+  void Clear(void) {
+    ms_apmmmMorphs.Clear();
+    ms_afMorphFactors.Clear();
+    ms_afPalette.Clear();
+    ms_aMorphedVtxs.Clear();
+    ms_aMorphedNormals.Clear();
+    ms_aFinalVtxs.Clear();
+    ms_aFinalNormals.Clear();
+  };
+};
+#define SKIN_OBJECTSPACE 0  // vertices are left as they are in mesh lod
+#define SKIN_PALETTE     1  // vertices are blended by transforms of their weight maps
+#define SKIN_TRANSFORM   2  // all vertices are transformed by one transform (boneless meshes)
+
+static CDynamicStackArray<MeshSkin> _amsMeshSkins;  // one for each ren mesh
+static CStaticStackArray<MeshSkin*> _apmsSkinned;   // skin used for each ren mesh (own or from batch)
+static CStaticStackArray<MeshSkin*> _apmsToSkin;    // skins that are yet to be skinned
+static BOOL _bMeshesSkinned = FALSE;  // set if all ren meshes are already skinned
+
+// meshes of all models in render batch are skinned at once, before the models are rendered
+struct SkinBatchModel {
+  CModelInstance *sbm_pmi;
+  INDEX sbm_iFirstSkin;
+  INDEX sbm_ctSkins;
+};
+static CDynamicStackArray<MeshSkin> _amsBatchSkins;
+static CStaticStackArray<SkinBatchModel> _asbmBatchModels;
+static INDEX _iNextBatchModel = 0;  // models are expected to be rendered in same order as they were added
+
+#define SKIN_PALETTE_FLOATS 28           // 4 columns of vertex transform, 3 columns of normal rotation
+#define SKIN_MIN_PARALLEL_VERTICES 2048  // don't bother with worker threads for fewer vertices
+extern INDEX ska_bMultiThreadedSkinning;
 BOOL _bTransformBonelessModelToViewSpace = TRUE; // are boneless models transformed to view space
 
 // Pointers for bone adjustment function
@@ -87,6 +146,7 @@ static BOOL FindRenBone(RenModel &rm,int iBoneID,INDEX *piBoneIndex);
 static void PrepareMeshForRendering(RenMesh &rmsh, INDEX iSkeletonlod);
 static void CalculateRenderingData(CModelInstance &mi);
 static void ClearRenArrays();
+static void ClearSkinBatch(void);
 
 // load our 3x4 matrix from old-fashioned matrix+vector combination
 inline void MatrixVectorToMatrix12(Matrix12 &m12,const FLOATmatrix3D &m, const FLOAT3D &v)
@@ -934,7 +994,7 @@ static void RenderNormals()
   if( _iRenderingType!=1) return;
 
   gfxDisableTexture();
-  INDEX ctNormals = _aFinalNormals.Count();
+  INDEX ctNormals = _ctFinalVertices;
   for(INDEX ivx=0;ivx<ctNormals;ivx++)
   {
     FLOAT3D vNormal = FLOAT3D(_panFinalNormals[ivx].nx,_panFinalNormals[ivx].ny,_panFinalNormals[ivx].nz);
@@ -1240,17 +1300,15 @@ static INDEX FindFrame(UBYTE *pFirstMember, INDEX iFind, INDEX ctfn, UINT uiSize
 // Find renbone in given renmodel
 static BOOL FindRenBone(RenModel &rm,int iBoneID,INDEX *piBoneIndex)
 {
-  int ctb = rm.rm_iFirstBone + rm.rm_ctBones;
-  // for each renbone in this ren model
-  for(int ib=rm.rm_iFirstBone;ib<ctb;ib++) {
-    // if bone id's match 
-    if(iBoneID == _aRenBones[ib].rb_psbBone->sb_iID) {
-      // return index of this renbone
-      *piBoneIndex = ib;
-      return TRUE;
-    }
-  }
-  return FALSE;
+  // renbones of model are in same order as bones in its skeleton lod
+  CSkeleton *pskl = rm.rm_pmiModel->mi_psklSkeleton;
+  if(pskl==NULL || rm.rm_iSkeletonLODIndex<0 || rm.rm_ctBones<=0) return FALSE;
+  INDEX ib = pskl->FindBoneInLOD(iBoneID,rm.rm_iSkeletonLODIndex);
+  if(ib<0 || ib>=rm.rm_ctBones) return FALSE;
+  // return index of this renbone
+  *piBoneIndex = rm.rm_iFirstBone + ib;
+  ASSERT(_aRenBones[*piBoneIndex].rb_psbBone->sb_iID==iBoneID);
+  return TRUE;
 }
 
 // Find renbone in whole array on renbones
@@ -1286,16 +1344,25 @@ static BOOL FindRenMorph(RenModel &rm,int iMorphID,INDEX *piMorphIndex)
   // for each renmesh in given renmodel
   INDEX ctmsh = rm.rm_iFirstMesh + rm.rm_ctMeshes;
   for(INDEX irmsh=rm.rm_iFirstMesh;irmsh<ctmsh;irmsh++) {
-    // for each renmorph in this renmesh
-    INDEX ctmm = _aRenMesh[irmsh].rmsh_iFirstMorph + _aRenMesh[irmsh].rmsh_ctMorphs;
-    for(INDEX imm=_aRenMesh[irmsh].rmsh_iFirstMorph;imm<ctmm;imm++) {
-      // if id's match
-      if(iMorphID == _aRenMorph[imm].rmp_pmmmMorphMap->mmp_iID) {
-        // return this renmorph
-        *piMorphIndex = imm;
-        return TRUE;
+    RenMesh &rmsh = _aRenMesh[irmsh];
+    if(rmsh.rmsh_ctMorphs<=0) continue;
+    // renmorphs of mesh are in same order as morph maps in its mesh lod
+    MeshLOD &mlod = rmsh.rmsh_pMeshInst->mi_pMesh->msh_aMeshLODs[rmsh.rmsh_iMeshLODIndex];
+    INDEX ctmm = mlod.mlod_aMorphMaps.Count();
+    // build lookup of morph maps if needed
+    if(!mlod.mlod_ilMorphMaps.IsBuiltFor(ctmm)) {
+      mlod.mlod_ilMorphMaps.Start(ctmm);
+      for(INDEX imm=0;imm<ctmm;imm++) {
+        mlod.mlod_ilMorphMaps.Add(mlod.mlod_aMorphMaps[imm].mmp_iID, imm);
       }
     }
+    INDEX imm = mlod.mlod_ilMorphMaps.Find(iMorphID);
+    // if found
+    if(imm>=0 && imm<rmsh.rmsh_ctMorphs) {
+      // return this renmorph
+      *piMorphIndex = rmsh.rmsh_iFirstMorph + imm;
+      return TRUE;
+    }
   }
   // renmorph was not found
   return FALSE;
@@ -1320,16 +1387,14 @@ static BOOL FindBone(int iBoneID, INDEX *piBoneIndex, CModelInstance *pmi,INDEX
     ASSERT(FALSE);
   }
 
-  SkeletonLOD &slod = pmi->mi_psklSkeleton->skl_aSkeletonLODs[iSkeletonLod];
-  // for each bone in skeleton lod
-  for(int i=0;i<slod.slod_aBones.Count();i++) {
-    // check if bone id's match
-    if(iBoneID == slod.slod_aBones[i].sb_iID) {
-      // bone index is allready set just return true
-      return TRUE;
-    }
-    *piBoneIndex += 1;
+  // check if bone is in this skeleton lod
+  INDEX isb = pmi->mi_psklSkeleton->FindBoneInLOD(iBoneID,iSkeletonLod);
+  if(isb>=0) {
+    *piBoneIndex += isb;
+    return TRUE;
   }
+  // skip all bones in this skeleton lod
+  *piBoneIndex += pmi->mi_psklSkeleton->skl_aSkeletonLODs[iSkeletonLod].slod_aBones.Count();
 
   // for each child of given model instance
   INDEX ctmich = pmi->mi_cmiChildren.Count();
@@ -1398,6 +1463,7 @@ void RM_EndRenderingView( BOOL bRestoreOrtho/*=TRUE*/)
   _pdp->SetOrtho();
   _iRenderingType = 0;
   _pdp = NULL;
+  ClearSkinBatch();
 }
 
 
@@ -2189,85 +2255,207 @@ static void RenderMesh(RenMesh &rmsh,RenModel &rm)
   }
 }
 
-// Prepare ren mesh for rendering
-static void PrepareMeshForRendering(RenMesh &rmsh, INDEX iSkeletonlod)
+// build per-vertex skinning streams from weight maps of mesh lod (weight maps are per-bone lists of vertices)
+static void BuildSkinStreams(MeshLOD &mlod)
+{
+  const INDEX ctVertices = mlod.mlod_aVertices.Count();
+  // already built?
+  if(mlod.mlod_aiSkinFirst.Count()==ctVertices+1) return;
+
+  // count influences of each vertex
+  mlod.mlod_aiSkinFirst.Clear();
+  mlod.mlod_auwSkinWeightMap.Clear();
+  mlod.mlod_afSkinWeight.Clear();
+  mlod.mlod_aiSkinFirst.New(ctVertices+1);
+  memset(&mlod.mlod_aiSkinFirst[0],0,sizeof(INDEX)*(ctVertices+1));
+  INDEX ctwm = mlod.mlod_aWeightMaps.Count();
+  INDEX ctInfluences = 0;
+  for(INDEX iwm=0;iwm<ctwm;iwm++) {
+    MeshWeightMap &mwm = mlod.mlod_aWeightMaps[iwm];
+    INDEX ctvw = mwm.mwm_aVertexWeight.Count();
+    for(INDEX ivw=0;ivw<ctvw;ivw++) {
+      mlod.mlod_aiSkinFirst[mwm.mwm_aVertexWeight[ivw].mww_iVertex+1]++;
+    }
+    ctInfluences += ctvw;
+  }
+  for(INDEX ivx=0;ivx<ctVertices;ivx++) {
+    mlod.mlod_aiSkinFirst[ivx+1] += mlod.mlod_aiSkinFirst[ivx];
+  }
+  if(ctInfluences==0) return;
+
+  // sort influences by vertex
+  mlod.mlod_auwSkinWeightMap.New(ctInfluences);
+  mlod.mlod_afSkinWeight.New(ctInfluences);
+  CStaticArray<INDEX> aiNext;
+  aiNext.New(ctVertices);
+  memcpy(&aiNext[0],&mlod.mlod_aiSkinFirst[0],sizeof(INDEX)*ctVertices);
+  for(INDEX iwm=0;iwm<ctwm;iwm++) {
+    MeshWeightMap &mwm = mlod.mlod_aWeightMaps[iwm];
+    INDEX ctvw = mwm.mwm_aVertexWeight.Count();
+    for(INDEX ivw=0;ivw<ctvw;ivw++) {
+      MeshVertexWeight &vw = mwm.mwm_aVertexWeight[ivw];
+      INDEX iInfluence = aiNext[vw.mww_iVertex]++;
+      mlod.mlod_auwSkinWeightMap[iInfluence] = (UWORD)iwm;
+      mlod.mlod_afSkinWeight[iInfluence] = vw.mww_fWeight;
+    }
+  }
+}
+
+// store weight map transforms as matrix columns, so they can be blended and applied with vector ops
+static void MakeSkinPaletteEntry(FLOAT *pf, const Matrix12 &mStrTransform, const Matrix12 &mTransform)
+{
+  // 4 columns of stretched transform for vertices
+  pf[ 0] = mStrTransform[0];  pf[ 1] = mStrTransform[4];  pf[ 2] = mStrTransform[ 8];  pf[ 3] = 0;
+  pf[ 4] = mStrTransform[1];  pf[ 5] = mStrTransform[5];  pf[ 6] = mStrTransform[ 9];  pf[ 7] = 0;
+  pf[ 8] = mStrTransform[2];  pf[ 9] = mStrTransform[6];  pf[10] = mStrTransform[10];  pf[11] = 0;
+  pf[12] = mStrTransform[3];  pf[13] = mStrTransform[7];  pf[14] = mStrTransform[11];  pf[15] = 0;
+  // 3 columns of rotation for normals (don't stretch normals)
+  pf[16] = mTransform[0];  pf[17] = mTransform[4];  pf[18] = mTransform[ 8];  pf[19] = 0;
+  pf[20] = mTransform[1];  pf[21] = mTransform[5];  pf[22] = mTransform[ 9];  pf[23] = 0;
+  pf[24] = mTransform[2];  pf[25] = mTransform[6];  pf[26] = mTransform[10];  pf[27] = 0;
+}
+
+// skin vertices and normals by blending palette transforms of their weight maps (range of vertices)
+static void SkinVertices(const MeshLOD &mlod, const MeshVertex *pavSrc, const MeshNormal *panSrc, const FLOAT *pfPalette,
+                         MeshVertex *pavDst, MeshNormal *panDst, INDEX iFirstVx, INDEX iLastVx)
+{
+  const INDEX *piFirst = &mlod.mlod_aiSkinFirst[0];
+  const UWORD *puwWeightMap = mlod.mlod_auwSkinWeightMap.Count()>0 ? &mlod.mlod_auwSkinWeightMap[0] : NULL;
+  const FLOAT *pfWeight     = mlod.mlod_afSkinWeight.Count()>0     ? &mlod.mlod_afSkinWeight[0]     : NULL;
+
+  for(INDEX ivx=iFirstVx;ivx<iLastVx;ivx++) {
+    const MeshVertex &mv = pavSrc[ivx];
+    const MeshNormal &mn = panSrc[ivx];
+    const INDEX iLast = piFirst[ivx+1];
+#if SKA_NEON
+    // blend transforms of all influences
+    float32x4_t vC0 = vdupq_n_f32(0), vC1 = vC0, vC2 = vC0, vC3 = vC0;
+    float32x4_t vN0 = vC0, vN1 = vC0, vN2 = vC0;
+    for(INDEX i=piFirst[ivx];i<iLast;i++) {
+      const FLOAT *pf = pfPalette + puwWeightMap[i]*SKIN_PALETTE_FLOATS;
+      const FLOAT fWeight = pfWeight[i];
+      vC0 = vmlaq_n_f32(vC0, vld1q_f32(pf+ 0), fWeight);
+      vC1 = vmlaq_n_f32(vC1, vld1q_f32(pf+ 4), fWeight);
+      vC2 = vmlaq_n_f32(vC2, vld1q_f32(pf+ 8), fWeight);
+      vC3 = vmlaq_n_f32(vC3, vld1q_f32(pf+12), fWeight);
+      vN0 = vmlaq_n_f32(vN0, vld1q_f32(pf+16), fWeight);
+      vN1 = vmlaq_n_f32(vN1, vld1q_f32(pf+20), fWeight);
+      vN2 = vmlaq_n_f32(vN2, vld1q_f32(pf+24), fWeight);
+    }
+    // apply blended transform (4th component stays 0)
+    float32x4_t vVtx = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vC3, vC0, mv.x), vC1, mv.y), vC2, mv.z);
+    vst1q_f32(&pavDst[ivx].x, vVtx);
+    float32x4_t vNor = vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(vN0, mn.nx), vN1, mn.ny), vN2, mn.nz);
+    panDst[ivx].nx = vgetq_lane_f32(vNor,0);
+    panDst[ivx].ny = vgetq_lane_f32(vNor,1);
+    panDst[ivx].nz = vgetq_lane_f32(vNor,2);
+#else
+    // blend transforms of all influences
+    FLOAT af[SKIN_PALETTE_FLOATS];
+    memset(af,0,sizeof(af));
+    for(INDEX i=piFirst[ivx];i<iLast;i++) {
+      const FLOAT *pf = pfPalette + puwWeightMap[i]*SKIN_PALETTE_FLOATS;
+      const FLOAT fWeight = pfWeight[i];
+      for(INDEX j=0;j<SKIN_PALETTE_FLOATS;j++) af[j] += pf[j]*fWeight;
+    }
+    // apply blended transform
+    pavDst[ivx].x = af[0]*mv.x + af[4]*mv.y + af[ 8]*mv.z + af[12];
+    pavDst[ivx].y = af[1]*mv.x + af[5]*mv.y + af[ 9]*mv.z + af[13];
+    pavDst[ivx].z = af[2]*mv.x + af[6]*mv.y + af[10]*mv.z + af[14];
+    pavDst[ivx].dummy = 0;
+    panDst[ivx].nx = af[16]*mn.nx + af[20]*mn.ny + af[24]*mn.nz;
+    panDst[ivx].ny = af[17]*mn.nx + af[21]*mn.ny + af[25]*mn.nz;
+    panDst[ivx].nz = af[18]*mn.nx + af[22]*mn.ny + af[26]*mn.nz;
+#endif
+  }
+}
+
+// skin vertices one weight map after another (old way, kept as reference for benchmark)
+static void SkinVerticesPerWeight(const MeshLOD &mlod, const MeshVertex *pavSrc, const MeshNormal *panSrc,
+                                  const Matrix12 *pmStrTransforms, const Matrix12 *pmTransforms,
+                                  MeshVertex *pavDst, MeshNormal *panDst)
+{
+  const INDEX ctVertices = mlod.mlod_aVertices.Count();
+  memset(pavDst,0,sizeof(MeshVertex)*ctVertices);
+  memset(panDst,0,sizeof(MeshNormal)*ctVertices);
+  INDEX ctwm = mlod.mlod_aWeightMaps.Count();
+  for(INDEX iwm=0;iwm<ctwm;iwm++) {
+    const MeshWeightMap &mwm = mlod.mlod_aWeightMaps[iwm];
+    INDEX ctvw = mwm.mwm_aVertexWeight.Count();
+    for(INDEX ivw=0;ivw<ctvw;ivw++) {
+      const MeshVertexWeight &vw = mwm.mwm_aVertexWeight[ivw];
+      INDEX ivx = vw.mww_iVertex;
+      MeshVertex mv = pavSrc[ivx];
+      MeshNormal mn = panSrc[ivx];
+      TransformVector((FLOAT3&)mv,pmStrTransforms[iwm]);
+      RotateVector((FLOAT3&)mn,pmTransforms[iwm]);
+      pavDst[ivx].x += mv.x * vw.mww_fWeight;
+      pavDst[ivx].y += mv.y * vw.mww_fWeight;
+      pavDst[ivx].z += mv.z * vw.mww_fWeight;
+      panDst[ivx].nx += mn.nx * vw.mww_fWeight;
+      panDst[ivx].ny += mn.ny * vw.mww_fWeight;
+      panDst[ivx].nz += mn.nz * vw.mww_fWeight;
+    }
+  }
+}
+
+// transform all vertices and normals with one palette entry (for boneless models)
+static void TransformVertices(const MeshVertex *pavSrc, const MeshNormal *panSrc, INDEX ctVertices,
+                              const FLOAT *af, MeshVertex *pavDst, MeshNormal *panDst)
+{
+  for(INDEX ivx=0;ivx<ctVertices;ivx++) {
+    const MeshVertex &mv = pavSrc[ivx];
+    const MeshNormal &mn = panSrc[ivx];
+#if SKA_NEON
+    float32x4_t vVtx = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vld1q_f32(af+12), vld1q_f32(af+0), mv.x), vld1q_f32(af+4), mv.y), vld1q_f32(af+8), mv.z);
+    vst1q_f32(&pavDst[ivx].x, vVtx);
+#else
+    pavDst[ivx].x = af[0]*mv.x + af[4]*mv.y + af[ 8]*mv.z + af[12];
+    pavDst[ivx].y = af[1]*mv.x + af[5]*mv.y + af[ 9]*mv.z + af[13];
+    pavDst[ivx].z = af[2]*mv.x + af[6]*mv.y + af[10]*mv.z + af[14];
+    pavDst[ivx].dummy = 0;
+#endif
+    panDst[ivx].nx = af[16]*mn.nx + af[20]*mn.ny + af[24]*mn.nz;
+    panDst[ivx].ny = af[17]*mn.nx + af[21]*mn.ny + af[25]*mn.nz;
+    panDst[ivx].nz = af[18]*mn.nx + af[22]*mn.ny + af[26]*mn.nz;
+  }
+}
+
+// Gather everything that skinning of ren mesh depends on (reads ren arrays, so main thread only)
+static void PrepareSkin(RenMesh &rmsh, INDEX iSkeletonlod, MeshSkin &ms)
 {
   // set curent mesh lod
   MeshLOD &mlod = rmsh.rmsh_pMeshInst->mi_pMesh->msh_aMeshLODs[rmsh.rmsh_iMeshLODIndex];
-  // clear vertices array
-  _aMorphedVtxs.PopAll();
-  _aMorphedNormals.PopAll();
-  _aFinalVtxs.PopAll();
-  _aFinalNormals.PopAll();
-  _pavFinalVertices = NULL;
-  _panFinalNormals  = NULL;
-  // Reset light direction
-  _vLightDirInView = _vLightDir;
-
-  
+  RenModel &rm = _aRenModels[rmsh.rmsh_iRenModelIndex];
+  // streams must be built here, as several meshes can share one mesh lod
+  BuildSkinStreams(mlod);
   // Get vertices count
   INDEX ctVertices = mlod.mlod_aVertices.Count();
-  // Allocate memory for vertices
-  _aMorphedVtxs.Push(ctVertices);
-  _aMorphedNormals.Push(ctVertices);
-  _aFinalVtxs.Push(ctVertices);
-  _aFinalNormals.Push(ctVertices);
-  // Remember final vertex count
-  _ctFinalVertices = ctVertices;
-  
-  // Copy original vertices and normals to _aMorphedVtxs
-  memcpy(&_aMorphedVtxs[0],&mlod.mlod_aVertices[0],sizeof(mlod.mlod_aVertices[0]) * ctVertices);
-  memcpy(&_aMorphedNormals[0],&mlod.mlod_aNormals[0],sizeof(mlod.mlod_aNormals[0]) * ctVertices);
-  // Set final vertices and normals to 0
-  memset(&_aFinalVtxs[0],0,sizeof(_aFinalVtxs[0])*ctVertices);
-  memset(&_aFinalNormals[0],0,sizeof(_aFinalNormals[0])*ctVertices);
-  
+  ms.ms_pmlod = &mlod;
+  ms.ms_iSkinType = SKIN_OBJECTSPACE;
+  ms.ms_ctVertices = ctVertices;
+  ms.ms_pavVertices = NULL;
+  ms.ms_panNormals  = NULL;
+  ms.ms_bViewSpace  = TRUE;
+  ms.ms_apmmmMorphs.PopAll();
+  ms.ms_afMorphFactors.PopAll();
+  ms.ms_afPalette.PopAll();
+  if(ctVertices==0) return;
 
   INDEX ctmm = rmsh.rmsh_iFirstMorph + rmsh.rmsh_ctMorphs;
-  // blend vertices and normals for each RenMorph 
+  // remember each RenMorph that will be blended
   for(int irm=rmsh.rmsh_iFirstMorph;irm<ctmm;irm++)
   {
-    RenMorph &rm = _aRenMorph[irm];
+    RenMorph &rmp = _aRenMorph[irm];
     // blend only if factor is > 0
-    if(rm.rmp_fFactor > 0.0f) {
-      // for each vertex and normal in morphmap
-      for(int ivx=0;ivx<rm.rmp_pmmmMorphMap->mmp_aMorphMap.Count();ivx++) {
-        // blend vertices and normals
-        if(rm.rmp_pmmmMorphMap->mmp_bRelative) {
-          // blend relative (new = cur + f*(dst-src))
-          INDEX vtx = rm.rmp_pmmmMorphMap->mmp_aMorphMap[ivx].mwm_iVxIndex;
-          MeshVertex &mvSrc = mlod.mlod_aVertices[vtx];
-          MeshNormal &mnSrc = mlod.mlod_aNormals[vtx];
-          MeshVertexMorph &mvmDst = rm.rmp_pmmmMorphMap->mmp_aMorphMap[ivx];
-          // blend vertices
-          _aMorphedVtxs[vtx].x += rm.rmp_fFactor*(mvmDst.mwm_x - mvSrc.x);
-          _aMorphedVtxs[vtx].y += rm.rmp_fFactor*(mvmDst.mwm_y - mvSrc.y);
-          _aMorphedVtxs[vtx].z += rm.rmp_fFactor*(mvmDst.mwm_z - mvSrc.z);
-          // blend normals
-          _aMorphedNormals[vtx].nx += rm.rmp_fFactor*(mvmDst.mwm_nx - mnSrc.nx);
-          _aMorphedNormals[vtx].ny += rm.rmp_fFactor*(mvmDst.mwm_ny - mnSrc.ny);
-          _aMorphedNormals[vtx].nz += rm.rmp_fFactor*(mvmDst.mwm_nz - mnSrc.nz);
-        } else {
-          // blend absolute (1-f)*cur + f*dst
-          INDEX vtx = rm.rmp_pmmmMorphMap->mmp_aMorphMap[ivx].mwm_iVxIndex;
-          MeshVertex &mvSrc = mlod.mlod_aVertices[vtx];
-          MeshVertexMorph &mvmDst = rm.rmp_pmmmMorphMap->mmp_aMorphMap[ivx];
-          // blend vertices
-          _aMorphedVtxs[vtx].x = (1.0f-rm.rmp_fFactor) * _aMorphedVtxs[vtx].x + rm.rmp_fFactor*mvmDst.mwm_x;
-          _aMorphedVtxs[vtx].y = (1.0f-rm.rmp_fFactor) * _aMorphedVtxs[vtx].y + rm.rmp_fFactor*mvmDst.mwm_y;
-          _aMorphedVtxs[vtx].z = (1.0f-rm.rmp_fFactor) * _aMorphedVtxs[vtx].z + rm.rmp_fFactor*mvmDst.mwm_z;
-          // blend normals
-          _aMorphedNormals[vtx].nx = (1.0f-rm.rmp_fFactor) * _aMorphedNormals[vtx].nx + rm.rmp_fFactor*mvmDst.mwm_nx;
-          _aMorphedNormals[vtx].ny = (1.0f-rm.rmp_fFactor) * _aMorphedNormals[vtx].ny + rm.rmp_fFactor*mvmDst.mwm_ny;
-          _aMorphedNormals[vtx].nz = (1.0f-rm.rmp_fFactor) * _aMorphedNormals[vtx].nz + rm.rmp_fFactor*mvmDst.mwm_nz;
-        }
-      }
-    }
+    if(rmp.rmp_fFactor <= 0.0f) continue;
+    ms.ms_apmmmMorphs.Push() = rmp.rmp_pmmmMorphMap;
+    ms.ms_afMorphFactors.Push() = rmp.rmp_fFactor;
   }
 
   INDEX ctrw = rmsh.rmsh_iFirstWeight + rmsh.rmsh_ctWeights;
   INDEX ctbones = 0;
-  CSkeleton *pskl = _aRenModels[rmsh.rmsh_iRenModelIndex].rm_pmiModel->mi_psklSkeleton;
+  CSkeleton *pskl = rm.rm_pmiModel->mi_psklSkeleton;
   // if skeleton for this model exists and its currently visible
   if((pskl!=NULL) && (iSkeletonlod > -1)) {
     // count bones in skeleton
@@ -2276,118 +2464,267 @@ static void PrepareMeshForRendering(RenMesh &rmsh, INDEX iSkeletonlod)
 
   // if there is skeleton attached to this mesh transfrom all vertices
   if(ctbones > 0 && ctrw>0) {
-    // for each renweight
+    // make palette of transforms for all weight maps
+    ms.ms_iSkinType = SKIN_PALETTE;
+    FLOAT *pfPalette = ms.ms_afPalette.Push(rmsh.rmsh_ctWeights*SKIN_PALETTE_FLOATS);
     for(int irw=rmsh.rmsh_iFirstWeight; irw<ctrw; irw++) {
       RenWeight &rw = _aRenWeights[irw];
-      Matrix12 mTransform;
       Matrix12 mStrTransform;
       // if no bone for this weight 
+      const Matrix12 *pmTransform;
       if(rw.rw_iBoneIndex == (-1)) {
         // transform vertex using default model transform matrix (for boneless models)
-        MatrixCopy(mStrTransform, _aRenModels[rmsh.rmsh_iRenModelIndex].rm_mStrTransform);
-        MatrixCopy(mTransform,    _aRenModels[rmsh.rmsh_iRenModelIndex].rm_mTransform);
+        MatrixCopy(mStrTransform, rm.rm_mStrTransform);
+        pmTransform = &rm.rm_mTransform;
       } else {
         // use bone transform matrix
         MatrixCopy(mStrTransform, _aRenBones[rw.rw_iBoneIndex].rb_mStrTransform);
-        MatrixCopy(mTransform,    _aRenBones[rw.rw_iBoneIndex].rb_mTransform);
+        pmTransform = &_aRenBones[rw.rw_iBoneIndex].rb_mTransform;
       }
-
       // if this is front face mesh remove rotation from transfrom matrix
       if(mlod.mlod_ulFlags & ML_FULL_FACE_FORWARD) {
         RemoveRotationFromMatrix(mStrTransform);
       }
-
-      // for each vertex in this weight
-      INDEX ctvw = rw.rw_pwmWeightMap->mwm_aVertexWeight.Count();
-      for(int ivw=0; ivw<ctvw; ivw++) {
-        MeshVertexWeight &vw = rw.rw_pwmWeightMap->mwm_aVertexWeight[ivw];
-        INDEX ivx = vw.mww_iVertex;
-        MeshVertex mv = _aMorphedVtxs[ivx];
-        MeshNormal mn = _aMorphedNormals[ivx];
-        
-        // transform vertex and normal with this weight transform matrix
-        TransformVector((FLOAT3&)mv,mStrTransform);
-        RotateVector((FLOAT3&)mn,mTransform); // Don't stretch normals
-
-        // Add new values to final vertices
-        _aFinalVtxs[ivx].x += mv.x * vw.mww_fWeight;
-        _aFinalVtxs[ivx].y += mv.y * vw.mww_fWeight;
-        _aFinalVtxs[ivx].z += mv.z * vw.mww_fWeight;
-        _aFinalNormals[ivx].nx += mn.nx * vw.mww_fWeight;
-        _aFinalNormals[ivx].ny += mn.ny * vw.mww_fWeight;
-        _aFinalNormals[ivx].nz += mn.nz * vw.mww_fWeight;
-      }
+      MakeSkinPaletteEntry(pfPalette + (irw-rmsh.rmsh_iFirstWeight)*SKIN_PALETTE_FLOATS, mStrTransform, *pmTransform);
     }
-    _pavFinalVertices = &_aFinalVtxs[0];
-    _panFinalNormals  = &_aFinalNormals[0];
-    // mesh is in view space so transform light to view space
-    RotateVector(_vLightDirInView.vector,_mObjToView);
-    // set flag that mesh is in view space
-    rmsh.rmsh_bTransToViewSpace = TRUE;
-    // reset view matrix bacause model is allready transformed in view space
-    gfxSetViewMatrix(NULL);
   // if no skeleton
   } else {
     // if flag is set to transform all vertices to view space
     if(_bTransformBonelessModelToViewSpace) {
       // transform every vertex using default model transform matrix (for boneless models)
-      Matrix12 mTransform;
+      ms.ms_iSkinType = SKIN_TRANSFORM;
       Matrix12 mStrTransform;
-      MatrixCopy(mTransform,    _aRenModels[rmsh.rmsh_iRenModelIndex].rm_mTransform);
-      MatrixCopy(mStrTransform, _aRenModels[rmsh.rmsh_iRenModelIndex].rm_mStrTransform);
-
+      MatrixCopy(mStrTransform, rm.rm_mStrTransform);
       // if this is front face mesh remove rotation from transfrom matrix
       if(mlod.mlod_ulFlags & ML_FULL_FACE_FORWARD) {
         RemoveRotationFromMatrix(mStrTransform);
       }
-      
-      // for each vertex
-      for(int ivx=0;ivx<ctVertices;ivx++) {
-        MeshVertex &mv = _aMorphedVtxs[ivx];
-        MeshNormal &mn = _aMorphedNormals[ivx];
-        // Transform vertex
-        TransformVector((FLOAT3&)mv,mStrTransform);
-        // Rotate normal
-        RotateVector((FLOAT3&)mn,mTransform);
-        _aFinalVtxs[ivx].x = mv.x;
-        _aFinalVtxs[ivx].y = mv.y;
-        _aFinalVtxs[ivx].z = mv.z;
-        _aFinalNormals[ivx].nx = mn.nx;
-        _aFinalNormals[ivx].ny = mn.ny;
-        _aFinalNormals[ivx].nz = mn.nz;
-      }
-      _pavFinalVertices = &_aFinalVtxs[0];
-      _panFinalNormals  = &_aFinalNormals[0];
-      // mesh is in view space so transform light to view space
-      RotateVector(_vLightDirInView.vector,_mObjToView);
-      // set flag that mesh is in view space
-      rmsh.rmsh_bTransToViewSpace = TRUE;
-      // reset view matrix bacause model is allready transformed in view space
-      gfxSetViewMatrix(NULL);
+      MakeSkinPaletteEntry(ms.ms_afPalette.Push(SKIN_PALETTE_FLOATS), mStrTransform, rm.rm_mTransform);
     // leave vertices in obj space
     } else {
-      Matrix12 &m12 = _aRenModels[rmsh.rmsh_iRenModelIndex].rm_mStrTransform;
-      FLOAT gfxm[16];
-      #pragma message(">> Fix face forward meshes, when objects are left in object space")
-
-      // set view matrix to gfx
-      gfxm[ 0] = m12[ 0];  gfxm[ 1] = m12[ 4];  gfxm[ 2] = m12[ 8];  gfxm[ 3] = 0;
-      gfxm[ 4] = m12[ 1];  gfxm[ 5] = m12[ 5];  gfxm[ 6] = m12[ 9];  gfxm[ 7] = 0;
-      gfxm[ 8] = m12[ 2];  gfxm[ 9] = m12[ 6];  gfxm[10] = m12[10];  gfxm[11] = 0;
-      gfxm[12] = m12[ 3];  gfxm[13] = m12[ 7];  gfxm[14] = m12[11];  gfxm[15] = 1;
-      gfxSetViewMatrix(gfxm);
-
-      RenModel &rm = _aRenModels[rmsh.rmsh_iRenModelIndex];
-      RenBone &rb = _aRenBones[rm.rm_iParentBoneIndex];
-      RotateVector(_vLightDirInView.vector,rb.rb_mBonePlacement);
-      _pavFinalVertices = &mlod.mlod_aVertices[0];
-      _panFinalNormals  = &mlod.mlod_aNormals[0];
-      // mark this mesh as in object space
-      rmsh.rmsh_bTransToViewSpace = FALSE;
+      ms.ms_pavVertices = &mlod.mlod_aVertices[0];
+      ms.ms_panNormals  = &mlod.mlod_aNormals[0];
+      ms.ms_bViewSpace  = FALSE;
+    }
+  }
+}
+
+// check if two mesh skins have the same inputs (and so the same final vertices)
+static BOOL SameSkinInputs(const MeshSkin &ms1, const MeshSkin &ms2)
+{
+  if(ms1.ms_pmlod!=ms2.ms_pmlod || ms1.ms_iSkinType!=ms2.ms_iSkinType || ms1.ms_ctVertices!=ms2.ms_ctVertices) return FALSE;
+  const INDEX ctmm = ms1.ms_apmmmMorphs.Count();
+  const INDEX ctf  = ms1.ms_afPalette.Count();
+  if(ctmm!=ms2.ms_apmmmMorphs.Count() || ctf!=ms2.ms_afPalette.Count()) return FALSE;
+  if(ctmm>0) {
+    if(memcmp(&ms1.ms_apmmmMorphs[0], &ms2.ms_apmmmMorphs[0], sizeof(MeshMorphMap*)*ctmm)!=0) return FALSE;
+    if(memcmp(&ms1.ms_afMorphFactors[0], &ms2.ms_afMorphFactors[0], sizeof(FLOAT)*ctmm)!=0) return FALSE;
+  }
+  return ctf==0 || memcmp(&ms1.ms_afPalette[0], &ms2.ms_afPalette[0], sizeof(FLOAT)*ctf)==0;
+}
+
+// Calculate final vertices and normals of prepared skin (doesn't touch any global state, so meshes can be skinned in parallel)
+static void SkinMesh(MeshSkin &ms)
+{
+  if(ms.ms_iSkinType==SKIN_OBJECTSPACE) return;
+  const MeshLOD &mlod = *ms.ms_pmlod;
+  const INDEX ctVertices = ms.ms_ctVertices;
+  const MeshVertex *pavSrc = &mlod.mlod_aVertices[0];
+  const MeshNormal *panSrc = &mlod.mlod_aNormals[0];
+
+  // blend vertices and normals for each morph
+  const INDEX ctmm = ms.ms_apmmmMorphs.Count();
+  if(ctmm>0) {
+    // copy original vertices and normals before first morph
+    ms.ms_aMorphedVtxs.PopAll();
+    ms.ms_aMorphedNormals.PopAll();
+    memcpy(ms.ms_aMorphedVtxs.Push(ctVertices),pavSrc,sizeof(MeshVertex)*ctVertices);
+    memcpy(ms.ms_aMorphedNormals.Push(ctVertices),panSrc,sizeof(MeshNormal)*ctVertices);
+    pavSrc = &ms.ms_aMorphedVtxs[0];
+    panSrc = &ms.ms_aMorphedNormals[0];
+  }
+  for(INDEX imm=0;imm<ctmm;imm++)
+  {
+    const MeshMorphMap &mmm = *ms.ms_apmmmMorphs[imm];
+    MeshVertex *pavMorphed = &ms.ms_aMorphedVtxs[0];
+    MeshNormal *panMorphed = &ms.ms_aMorphedNormals[0];
+    const FLOAT fFactor = ms.ms_afMorphFactors[imm];
+    // for each vertex and normal in morphmap
+    const INDEX ctmvm = mmm.mmp_aMorphMap.Count();
+    for(int ivx=0;ivx<ctmvm;ivx++) {
+      const MeshVertexMorph &mvmDst = mmm.mmp_aMorphMap[ivx];
+      INDEX vtx = mvmDst.mwm_iVxIndex;
+      // blend vertices and normals
+      if(mmm.mmp_bRelative) {
+        // blend relative (new = cur + f*(dst-src))
+        const MeshVertex &mvSrc = mlod.mlod_aVertices[vtx];
+        const MeshNormal &mnSrc = mlod.mlod_aNormals[vtx];
+        pavMorphed[vtx].x += fFactor*(mvmDst.mwm_x - mvSrc.x);
+        pavMorphed[vtx].y += fFactor*(mvmDst.mwm_y - mvSrc.y);
+        pavMorphed[vtx].z += fFactor*(mvmDst.mwm_z - mvSrc.z);
+        panMorphed[vtx].nx += fFactor*(mvmDst.mwm_nx - mnSrc.nx);
+        panMorphed[vtx].ny += fFactor*(mvmDst.mwm_ny - mnSrc.ny);
+        panMorphed[vtx].nz += fFactor*(mvmDst.mwm_nz - mnSrc.nz);
+      } else {
+        // blend absolute (1-f)*cur + f*dst
+        pavMorphed[vtx].x = (1.0f-fFactor) * pavMorphed[vtx].x + fFactor*mvmDst.mwm_x;
+        pavMorphed[vtx].y = (1.0f-fFactor) * pavMorphed[vtx].y + fFactor*mvmDst.mwm_y;
+        pavMorphed[vtx].z = (1.0f-fFactor) * pavMorphed[vtx].z + fFactor*mvmDst.mwm_z;
+        panMorphed[vtx].nx = (1.0f-fFactor) * panMorphed[vtx].nx + fFactor*mvmDst.mwm_nx;
+        panMorphed[vtx].ny = (1.0f-fFactor) * panMorphed[vtx].ny + fFactor*mvmDst.mwm_ny;
+        panMorphed[vtx].nz = (1.0f-fFactor) * panMorphed[vtx].nz + fFactor*mvmDst.mwm_nz;
+      }
+    }
+  }
+
+  ms.ms_aFinalVtxs.PopAll();
+  ms.ms_aFinalNormals.PopAll();
+  ms.ms_pavVertices = ms.ms_aFinalVtxs.Push(ctVertices);
+  ms.ms_panNormals  = ms.ms_aFinalNormals.Push(ctVertices);
+  if(ms.ms_iSkinType==SKIN_PALETTE) {
+    // blend palette per vertex
+    ASSERT(mlod.mlod_aiSkinFirst.Count()==ctVertices+1);
+    SkinVertices(mlod, pavSrc, panSrc, &ms.ms_afPalette[0], ms.ms_pavVertices, ms.ms_panNormals, 0, ctVertices);
+  } else {
+    ASSERT(ms.ms_iSkinType==SKIN_TRANSFORM);
+    TransformVertices(pavSrc, panSrc, ctVertices, &ms.ms_afPalette[0], ms.ms_pavVertices, ms.ms_panNormals);
+  }
+}
+
+// Use skinned mesh for rendering (sets final arrays, light direction and view matrix)
+static void SetMeshForRendering(RenMesh &rmsh, MeshSkin &ms)
+{
+  _pavFinalVertices = ms.ms_pavVertices;
+  _panFinalNormals  = ms.ms_panNormals;
+  _ctFinalVertices  = ms.ms_ctVertices;
+  // Reset light direction
+  _vLightDirInView = _vLightDir;
+
+  if(ms.ms_bViewSpace) {
+    // mesh is in view space so transform light to view space
+    RotateVector(_vLightDirInView.vector,_mObjToView);
+    // set flag that mesh is in view space
+    rmsh.rmsh_bTransToViewSpace = TRUE;
+    // reset view matrix bacause model is allready transformed in view space
+    gfxSetViewMatrix(NULL);
+  // leave vertices in obj space
+  } else {
+    Matrix12 &m12 = _aRenModels[rmsh.rmsh_iRenModelIndex].rm_mStrTransform;
+    FLOAT gfxm[16];
+    #pragma message(">> Fix face forward meshes, when objects are left in object space")
+
+    // set view matrix to gfx
+    gfxm[ 0] = m12[ 0];  gfxm[ 1] = m12[ 4];  gfxm[ 2] = m12[ 8];  gfxm[ 3] = 0;
+    gfxm[ 4] = m12[ 1];  gfxm[ 5] = m12[ 5];  gfxm[ 6] = m12[ 9];  gfxm[ 7] = 0;
+    gfxm[ 8] = m12[ 2];  gfxm[ 9] = m12[ 6];  gfxm[10] = m12[10];  gfxm[11] = 0;
+    gfxm[12] = m12[ 3];  gfxm[13] = m12[ 7];  gfxm[14] = m12[11];  gfxm[15] = 1;
+    gfxSetViewMatrix(gfxm);
+
+    RenModel &rm = _aRenModels[rmsh.rmsh_iRenModelIndex];
+    RenBone &rb = _aRenBones[rm.rm_iParentBoneIndex];
+    RotateVector(_vLightDirInView.vector,rb.rb_mBonePlacement);
+    // mark this mesh as in object space
+    rmsh.rmsh_bTransToViewSpace = FALSE;
+  }
+}
+
+// get skin of ren mesh
+static MeshSkin &GetMeshSkin(RenMesh &rmsh)
+{
+  const INDEX imsh = &rmsh - &_aRenMesh[0];
+  while(_amsMeshSkins.Count()<=imsh) {
+    _amsMeshSkins.Push();
+  }
+  return _amsMeshSkins[imsh];
+}
+
+// Prepare ren mesh for rendering
+static void PrepareMeshForRendering(RenMesh &rmsh, INDEX iSkeletonlod)
+{
+  // use skin made before, if all meshes were already skinned
+  if(_bMeshesSkinned) {
+    SetMeshForRendering(rmsh, *_apmsSkinned[&rmsh - &_aRenMesh[0]]);
+    return;
+  }
+  MeshSkin &ms = GetMeshSkin(rmsh);
+  PrepareSkin(rmsh, iSkeletonlod, ms);
+  SkinMesh(ms);
+  SetMeshForRendering(rmsh, ms);
+}
+
+// skins several mesh skins at once
+class CSkinMeshesJob : public CWorkerJob {
+public:
+  MeshSkin **smj_apms;
+  void ProcessRange(INDEX iFirst, INDEX iLast)
+  {
+    for(INDEX ims=iFirst;ims<iLast;ims++) {
+      SkinMesh(*smj_apms[ims]);
+    }
+  }
+};
+
+// skin given mesh skins, on worker threads if worth it
+static void SkinMeshes(MeshSkin **apms, INDEX ctms)
+{
+  // count vertices that would be skinned
+  INDEX ctVertices = 0;
+  for(INDEX ims=0;ims<ctms;ims++) {
+    if(apms[ims]->ms_iSkinType!=SKIN_OBJECTSPACE) ctVertices += apms[ims]->ms_ctVertices;
+  }
+  if(ska_bMultiThreadedSkinning && ctms>=2 && ctVertices>=SKIN_MIN_PARALLEL_VERTICES && _pWorkerPool->GetThreadsCount()>=2) {
+    CSkinMeshesJob smj;
+    smj.smj_apms = apms;
+    _pWorkerPool->Run(smj, ctms);
+  } else {
+    for(INDEX ims=0;ims<ctms;ims++) SkinMesh(*apms[ims]);
+  }
+}
+
+// find batch model that was added for given model instance (-1 if none)
+static INDEX FindBatchModel(CModelInstance &mi)
+{
+  const INDEX ctsbm = _asbmBatchModels.Count();
+  for(INDEX isbm=_iNextBatchModel;isbm<ctsbm;isbm++) {
+    if(_asbmBatchModels[isbm].sbm_pmi==&mi) {
+      _iNextBatchModel = isbm+1;
+      return isbm;
+    }
+  }
+  return -1;
+}
+
+// skin all meshes in hierarchy (reusing skins from render batch where inputs didn't change)
+static void SkinAllMeshes(INDEX iBatchModel)
+{
+  const INDEX ctmsh = _aRenMesh.Count();
+  _apmsSkinned.PopAll();
+  if(ctmsh==0) return;
+  MeshSkin **apmsSkinned = _apmsSkinned.Push(ctmsh);
+  _apmsToSkin.PopAll();
+  for(INDEX imsh=0;imsh<ctmsh;imsh++) {
+    RenMesh &rmsh = _aRenMesh[imsh];
+    MeshSkin &ms = GetMeshSkin(rmsh);
+    PrepareSkin(rmsh, _aRenModels[rmsh.rmsh_iRenModelIndex].rm_iSkeletonLODIndex, ms);
+    apmsSkinned[imsh] = &ms;
+    // use skin from batch if it has the same inputs
+    if(iBatchModel>=0) {
+      const SkinBatchModel &sbm = _asbmBatchModels[iBatchModel];
+      if(imsh<sbm.sbm_ctSkins) {
+        MeshSkin &msBatch = _amsBatchSkins[sbm.sbm_iFirstSkin+imsh];
+        if(SameSkinInputs(msBatch, ms)) {
+          apmsSkinned[imsh] = &msBatch;
+          continue;
+        }
+      }
     }
+    _apmsToSkin.Push() = &ms;
   }
+  if(_apmsToSkin.Count()>0) SkinMeshes(&_apmsToSkin[0], _apmsToSkin.Count());
+  _bMeshesSkinned = TRUE;
 }
 
+
 // render one ren model
 static void RenderModel_View(RenModel &rm)
 {
@@ -2481,6 +2818,7 @@ BOOL RM_GetBoneAbsPosition(CModelInstance &mi,INDEX iBoneID, FLOAT3D &vStartPoin
 // Calculate complete rendering data for model instance
 static void CalculateRenderingData(CModelInstance &mi)
 {
+  _bMeshesSkinned = FALSE;
   RM_SetObjectMatrices(mi);
   // distance to model is z param in objtoview matrix 
   _fDistanceFactor = -_mObjToView[11];
@@ -2507,6 +2845,8 @@ void RM_RenderSKA(CModelInstance &mi)
   //if( _iRenderingType==2) CalculateRenderingData( mi, 0);
   //else 
   CalculateRenderingData(mi);
+  // skin meshes of all models at once
+  SkinAllMeshes( _iRenderingType==1 ? FindBatchModel(mi) : -1);
 
   // for each renmodel
   INDEX ctrmsh = _aRenModels.Count();
@@ -2584,6 +2924,47 @@ void RM_RenderSKA(CModelInstance &mi)
   ClearRenArrays();
 }
 
+// Add SKA model to render batch, so its meshes are skinned together with meshes of other models
+// (must be called with same settings as when model is rendered; meshes that turn out different are skinned again)
+void RM_AddToSkinBatch(CModelInstance &mi)
+{
+  ASSERT( _iRenderingType==1);
+  if( !ska_bMultiThreadedSkinning || _pWorkerPool->GetThreadsCount()<2) {
+    ClearRenArrays();
+    return;
+  }
+  CalculateRenderingData(mi);
+  SkinBatchModel &sbm = _asbmBatchModels.Push();
+  sbm.sbm_pmi = &mi;
+  sbm.sbm_iFirstSkin = _amsBatchSkins.Count();
+  sbm.sbm_ctSkins = _aRenMesh.Count();
+  for(INDEX imsh=0;imsh<sbm.sbm_ctSkins;imsh++) {
+    RenMesh &rmsh = _aRenMesh[imsh];
+    PrepareSkin(rmsh, _aRenModels[rmsh.rmsh_iRenModelIndex].rm_iSkeletonLODIndex, _amsBatchSkins.Push());
+  }
+  ClearRenArrays();
+}
+
+// Skin meshes of all models in render batch at once (on worker threads)
+void RM_SkinBatch(void)
+{
+  const INDEX ctms = _amsBatchSkins.Count();
+  _apmsToSkin.PopAll();
+  for(INDEX ims=0;ims<ctms;ims++) {
+    _apmsToSkin.Push() = &_amsBatchSkins[ims];
+  }
+  if(ctms>0) SkinMeshes(&_apmsToSkin[0], ctms);
+  _iNextBatchModel = 0;
+}
+
+// forget all models in render batch
+static void ClearSkinBatch(void)
+{
+  _asbmBatchModels.PopAll();
+  _amsBatchSkins.PopAll();
+  _iNextBatchModel = 0;
+}
+
 // clear all ren arrays
 static void ClearRenArrays()
 {
@@ -2598,7 +2979,144 @@ static void ClearRenArrays()
   _aRenMesh.PopAll();
   _aRenWeights.PopAll();
   _aRenMorph.PopAll();
+  _bMeshesSkinned = FALSE;
   _fCustomMlodDistance = -1;
   _fCustomSlodDistance = -1;
 }
 
+
+// pseudo-random number in 0..1 for benchmark data
+static FLOAT SkinRandom01(ULONG &ulSeed)
+{
+  ulSeed = ulSeed*1103515245+12345;
+  return ((ulSeed>>16)&0x7FFF)/32767.0f;
+}
+
+// skins many instances of one mesh (each with own bone transforms) for benchmark
+class CSkinBenchmarkJob : public CWorkerJob {
+public:
+  const MeshLOD *sbj_pmlod;
+  const FLOAT *sbj_pfPalettes;
+  MeshVertex *sbj_pavVertices;
+  MeshNormal *sbj_panNormals;
+
+  void ProcessRange(INDEX iFirst, INDEX iLast)
+  {
+    const INDEX ctVertices = sbj_pmlod->mlod_aVertices.Count();
+    const INDEX ctwm = sbj_pmlod->mlod_aWeightMaps.Count();
+    for(INDEX iModel=iFirst;iModel<iLast;iModel++) {
+      SkinVertices(*sbj_pmlod, &sbj_pmlod->mlod_aVertices[0], &sbj_pmlod->mlod_aNormals[0],
+                   sbj_pfPalettes + iModel*ctwm*SKIN_PALETTE_FLOATS,
+                   sbj_pavVertices + iModel*ctVertices, sbj_panNormals + iModel*ctVertices, 0, ctVertices);
+    }
+  }
+};
+
+// skin many skeletal models per weight map (old way), with palette blending, and on worker threads
+void SkaSkinningBenchmark(void *pArgs)
+{
+  INDEX ctModels = NEXTARGUMENT(INDEX);
+  if(ctModels<=0) ctModels = 100;
+  const INDEX ctVertices = 2000;
+  const INDEX ctWeightMaps = 32;
+
+  // make mesh where each vertex is influenced by 1 to 4 bones
+  MeshLOD mlod;
+  mlod.mlod_aVertices.New(ctVertices);
+  mlod.mlod_aNormals.New(ctVertices);
+  mlod.mlod_aWeightMaps.New(ctWeightMaps);
+  CStaticStackArray<MeshVertexWeight> aavw[ctWeightMaps];
+  ULONG ulSeed = 0x12345678;
+  for(INDEX ivx=0;ivx<ctVertices;ivx++) {
+    MeshVertex &mv = mlod.mlod_aVertices[ivx];
+    MeshNormal &mn = mlod.mlod_aNormals[ivx];
+    mv.x = SkinRandom01(ulSeed)*2-1;  mv.y = SkinRandom01(ulSeed)*2;  mv.z = SkinRandom01(ulSeed)*2-1;  mv.dummy = 0;
+    FLOAT3D vNormal;
+    vNormal(1) = SkinRandom01(ulSeed)-0.5f;
+    vNormal(2) = SkinRandom01(ulSeed)-0.5f;
+    vNormal(3) = SkinRandom01(ulSeed)+0.1f;
+    vNormal.Normalize();
+    mn.nx = vNormal(1);  mn.ny = vNormal(2);  mn.nz = vNormal(3);
+    const INDEX ctInfluences = 1 + (ivx%4);
+    for(INDEX i=0;i<ctInfluences;i++) {
+      MeshVertexWeight &vw = aavw[(ivx*7+i*5)%ctWeightMaps].Push();
+      vw.mww_iVertex = ivx;
+      vw.mww_fWeight = 1.0f/ctInfluences;
+    }
+  }
+  for(INDEX iwm=0;iwm<ctWeightMaps;iwm++) {
+    MeshWeightMap &mwm = mlod.mlod_aWeightMaps[iwm];
+    mwm.mwm_iID = iwm;
+    mwm.mwm_aVertexWeight.New(aavw[iwm].Count());
+    if(aavw[iwm].Count()>0) {
+      memcpy(&mwm.mwm_aVertexWeight[0], &aavw[iwm][0], sizeof(MeshVertexWeight)*aavw[iwm].Count());
+    }
+  }
+  BuildSkinStreams(mlod);
+
+  // every model has its own pose
+  CStaticArray<Matrix12> amStrTransforms, amTransforms;
+  amStrTransforms.New(ctModels*ctWeightMaps);
+  amTransforms.New(ctModels*ctWeightMaps);
+  CStaticArray<FLOAT> afPalettes;
+  afPalettes.New(ctModels*ctWeightMaps*SKIN_PALETTE_FLOATS);
+  for(INDEX im=0;im<ctModels*ctWeightMaps;im++) {
+    FLOATmatrix3D m;
+    ANGLE3D a;
+    a(1) = SkinRandom01(ulSeed)*360;
+    a(2) = SkinRandom01(ulSeed)*90-45;
+    a(3) = SkinRandom01(ulSeed)*90-45;
+    FLOAT3D v;
+    v(1) = SkinRandom01(ulSeed)*4-2;
+    v(2) = SkinRandom01(ulSeed)*4-2;
+    v(3) = SkinRandom01(ulSeed)*4-2;
+    MakeRotationMatrixFast(m, a);
+    MatrixVectorToMatrix12(amTransforms[im], m, v);
+    MatrixCopy(amStrTransforms[im], amTransforms[im]);
+    amStrTransforms[im][0] *= 1.5f;  amStrTransforms[im][4] *= 1.5f;  amStrTransforms[im][8] *= 1.5f;
+    MakeSkinPaletteEntry(&afPalettes[im*SKIN_PALETTE_FLOATS], amStrTransforms[im], amTransforms[im]);
+  }
+
+  // results of each method
+  CStaticArray<MeshVertex> aavVertices[3];
+  CStaticArray<MeshNormal> aanNormals[3];
+  for(INDEX iMethod=0;iMethod<3;iMethod++) {
+    aavVertices[iMethod].New(ctModels*ctVertices);
+    aanNormals[iMethod].New(ctModels*ctVertices);
+  }
+
+  CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+  for(INDEX iModel=0;iModel<ctModels;iModel++) {
+    SkinVerticesPerWeight(mlod, &mlod.mlod_aVertices[0], &mlod.mlod_aNormals[0],
+                          &amStrTransforms[iModel*ctWeightMaps], &amTransforms[iModel*ctWeightMaps],
+                          &aavVertices[0][iModel*ctVertices], &aanNormals[0][iModel*ctVertices]);
+  }
+  CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+  CSkinBenchmarkJob sbj;
+  sbj.sbj_pmlod = &mlod;
+  sbj.sbj_pfPalettes = &afPalettes[0];
+  sbj.sbj_pavVertices = &aavVertices[1][0];
+  sbj.sbj_panNormals  = &aanNormals[1][0];
+  sbj.ProcessRange(0, ctModels);
+  CTimerValue tv2 = _pTimer->GetHighPrecisionTimer();
+  sbj.sbj_pavVertices = &aavVertices[2][0];
+  sbj.sbj_panNormals  = &aanNormals[2][0];
+  _pWorkerPool->Run(sbj, ctModels);
+  CTimerValue tv3 = _pTimer->GetHighPrecisionTimer();
+
+  // compare with old way
+  FLOAT fMaxError = 0;
+  for(INDEX iMethod=1;iMethod<3;iMethod++) {
+    for(INDEX ivx=0;ivx<ctModels*ctVertices;ivx++) {
+      const MeshVertex &mv0 = aavVertices[0][ivx];  const MeshVertex &mv = aavVertices[iMethod][ivx];
+      const MeshNormal &mn0 = aanNormals[0][ivx];   const MeshNormal &mn = aanNormals[iMethod][ivx];
+      fMaxError = Max(fMaxError, Max(Abs(mv.x-mv0.x), Max(Abs(mv.y-mv0.y), Abs(mv.z-mv0.z))));
+      fMaxError = Max(fMaxError, Max(Abs(mn.nx-mn0.nx), Max(Abs(mn.ny-mn0.ny), Abs(mn.nz-mn0.nz))));
+    }
+  }
+  CPrintF(TRANS("SKA skinning benchmark (%d models, %d vertices, %d bones, %d threads, %s):\n"),
+          ctModels, ctVertices, ctWeightMaps, _pWorkerPool->GetThreadsCount(), SKA_NEON ? "NEON" : "no SIMD");
+  CPrintF(TRANS("  per weight %7.2f ms, palette %7.2f ms, palette parallel %7.2f ms, max error %g, %s\n"),
+          (tv1-tv0).GetSeconds()*1000.0, (tv2-tv1).GetSeconds()*1000.0, (tv3-tv2).GetSeconds()*1000.0,
+          fMaxError, fMaxError<0.001f ? TRANS("match") : TRANS("MISMATCH!"));
+}
@@ -118,6 +118,9 @@ ENGINE_API void RM_SetObjectMatrices(CModelInstance &mi);
 
 // render one SKA model with its children
 ENGINE_API void RM_RenderSKA(CModelInstance &mi);
+// skin meshes of several SKA models at once (models are then rendered in same order)
+ENGINE_API void RM_AddToSkinBatch(CModelInstance &mi);
+ENGINE_API void RM_SkinBatch(void);
 // render one bone in model instance
 ENGINE_API void RM_RenderBone(CModelInstance &mi,INDEX iBoneID);
 ENGINE_API void RM_RenderColisionBox(CModelInstance &mi,ColisionBox &cb, COLOR col);
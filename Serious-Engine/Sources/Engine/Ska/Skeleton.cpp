@@ -45,15 +45,14 @@ INDEX CSkeleton::FindBoneInLOD(INDEX iBoneID,INDEX iSkeletonLod)
 
   SkeletonLOD &slod = skl_aSkeletonLODs[iSkeletonLod];
   INDEX ctb = slod.slod_aBones.Count();
-  // for each bone in skeleton
-  for(INDEX isb=0;isb<ctb;isb++) {
-    // if bone id match
-    if(slod.slod_aBones[isb].sb_iID == iBoneID) {
-      // return index in array of bones
-      return isb;
+  // build lookup of bones if needed
+  if(!slod.slod_ilBones.IsBuiltFor(ctb)) {
+    slod.slod_ilBones.Start(ctb);
+    for(INDEX isb=0;isb<ctb;isb++) {
+      slod.slod_ilBones.Add(slod.slod_aBones[isb].sb_iID, isb);
     }
   }
-  return -1;
+  return slod.slod_ilBones.Find(iBoneID);
 }
 
 // Sorts bones in skeleton so parent bones are allways before child bones in array
@@ -70,6 +69,8 @@ void CSkeleton::SortSkeleton()
     SortSkeletonRecursive(-1,islod);
     // just copy sorted array
     skl_aSkeletonLODs[islod].slod_aBones.CopyArray(_aSortArray_SkeletonBone);
+    // bones were reordered
+    skl_aSkeletonLODs[islod].slod_ilBones.Clear();
     // clear array
     _aSortArray_SkeletonBone.Clear();
     // calculate abs transforms for bones in this lod
@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Graphics/Texture.h>
 #include <Engine/Templates/DynamicArray.h>
 #include <Engine/Templates/StaticArray.h>
+#include <Engine/Ska/IDLookup.h>
 #include <Engine/Base/Serial.h>
 
 
@@ -40,6 +41,7 @@ struct ENGINE_API SkeletonLOD
   FLOAT slod_fMaxDistance;                        // distance in witch this lod is visible
   CStaticArray<struct SkeletonBone> slod_aBones;  // array of bones for this lod
   CTString slod_fnSourceFile;                     // source filename of ascii skleton lod
+  SkaIDLookup slod_ilBones;                       // bone indices by ID (built on first use)
 };
 
 struct ENGINE_API SkeletonBone
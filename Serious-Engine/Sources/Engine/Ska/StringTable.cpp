@@ -16,6 +16,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "StdH.h"
 #include <Engine/Templates/StaticStackArray.h>
 #include <Engine/Base/CTString.h>
+#include <Engine/Math/Functions.h>
 #include <Engine/Ska/StringTable.h>
 #include <Engine/Templates/StaticStackArray.cpp>
 
@@ -23,8 +24,47 @@ struct stTable
 {
   INDEX st_iID;
   CTString strName;
+  INDEX st_iNextInBucket;   // next string with same hash (-1 if none)
 };
 CStaticStackArray<struct stTable> _arStringTable;
+// first string in each hash bucket (-1 if none), grows with table
+static CStaticStackArray<INDEX> _aiStringHash;
+
+// find string in hash buckets
+static INDEX FindStringInHash(const CTString &strName)
+{
+  INDEX ctBuckets = _aiStringHash.Count();
+  if(ctBuckets==0) return -1;
+  for(INDEX i=_aiStringHash[strName.GetHash()&(ctBuckets-1)];i>=0;i=_arStringTable[i].st_iNextInBucket) {
+    if(_arStringTable[i].strName == strName) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// link string in its hash bucket
+static void AddStringToHash(INDEX iString)
+{
+  INDEX ctBuckets = _aiStringHash.Count();
+  stTable &st = _arStringTable[iString];
+  INDEX &iFirst = _aiStringHash[st.strName.GetHash()&(ctBuckets-1)];
+  st.st_iNextInBucket = iFirst;
+  iFirst = iString;
+}
+
+// keep at most 2 strings per bucket on average
+static void GrowStringHash(void)
+{
+  INDEX ctStrings = _arStringTable.Count();
+  INDEX ctBuckets = _aiStringHash.Count();
+  if(ctStrings<=ctBuckets*2) return;
+  ctBuckets = Max(ctBuckets*2, (INDEX)256);
+  _aiStringHash.PopAll();
+  _aiStringHash.Push(ctBuckets);
+  for(INDEX i=0;i<ctBuckets;i++) _aiStringHash[i] = -1;
+  for(INDEX i=0;i<ctStrings-1;i++) AddStringToHash(i);
+}
 
 // add index in table
 INDEX AddIndexToTable(CTString strName)
@@ -34,6 +74,8 @@ INDEX AddIndexToTable(CTString strName)
   INDEX ctStrings = _arStringTable.Count();
   _arStringTable[ctStrings-1].strName = strName;
   _arStringTable[ctStrings-1].st_iID = ctStrings;
+  GrowStringHash();
+  AddStringToHash(ctStrings-1);
   return ctStrings-1;
 }
 // find string in table and return his index, if not found add new and return his index
@@ -41,30 +83,15 @@ INDEX ska_GetIDFromStringTable(CTString strName)
 {
   if(strName == "") return -1;
 
-  INDEX ctStrings = _arStringTable.Count();
-  for(INDEX i=0;i<ctStrings;i++)
-  {
-    if(_arStringTable[i].strName == strName)
-    {
-      return i;
-    }
-  }
+  INDEX iString = FindStringInHash(strName);
+  if(iString>=0) return iString;
   return AddIndexToTable(strName);  
 }
 // find string in table and return his index, if not found return -1
 INDEX ska_FindStringInTable(CTString strName)
 {
   if(strName == "") return -1;
-
-  INDEX ctStrings = _arStringTable.Count();
-  for(INDEX i=0;i<ctStrings;i++)
-  {
-    if(_arStringTable[i].strName == strName)
-    {
-      return i;
-    }
-  }
-  return -1;
+  return FindStringInHash(strName);
 }
 // return name for index iIndex
 CTString ska_GetStringFromTable(INDEX iIndex)
@@ -27,6 +27,22 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Light/LightSource.h>
 #include <Engine/Rendering/Render.h>
 #include <Engine/Terrain/TerrainRayCasting.h>
+#include <Engine/Base/WorkerPool.h>
+
+// SSE2 has IEEE square root and divide, so its results match scalar code exactly;
+// ARMv7 NEON has only estimates refined with Newton steps, so it can be off by one LSB
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TERRAIN_NEON 1
+#else
+#define TERRAIN_NEON 0
+#endif
+#if !TERRAIN_NEON && defined(__SSE2__)
+#include <emmintrin.h>
+#define TERRAIN_SSE2 1
+#else
+#define TERRAIN_SSE2 0
+#endif
 
 /*
  * Terrain raycasting and colision 
@@ -43,6 +59,7 @@ CStaticStackArray<INDEX>      _aiHitTiles;
 static ULONG *_pulSharedTopMap = NULL; // Shared memory used for topmap regeneration
 SLONG  _slSharedTopMapSize = 0; // Size of shared memory allocated for topmap regeneration
 extern INDEX  _ctShadowMapUpdates;
+extern INDEX ter_bMultiThreadedShadows;
 #pragma message(">> Create class with destructor to clear shared topmap memory")
 
 FLOATaabbox3D _bboxDrawOne;
@@ -666,152 +683,370 @@ void FreeSharedTopMapMemory(CTextureData *ptdTopMap, INDEX iTileIndex)
   ptdTopMap->td_pulFrames = NULL;
 }
 
-static FLOAT3D CalculateNormalFromPoint(FLOAT fPosX, FLOAT fPosZ, FLOAT3D *pvStrPos=NULL)
+// height map of the terrain that is being lit and its shadow map
+struct TerrainLightingInfo {
+  const UWORD *tli_puwHeightMap;    // terrain height map
+  PIX      tli_pixHeightMapWidth;   // width of height map
+  FLOAT3D  tli_vStretch;            // terrain stretch
+  FLOAT    tli_fSHDiffX;            // height map texels per one shadow map texel
+  FLOAT    tli_fSHDiffZ;
+  GFXColor *tli_pacolShadowMap;     // first texel of shadow map
+  PIX      tli_pixShadowMapWidth;   // width of shadow map
+};
+
+// one light that is being applied to terrain shadow map (all in terrain space)
+struct TerrainLight {
+  BOOL     tl_bDirectional;         // directional or point light
+  FLOAT3D  tl_vPosition;            // position of point light
+  FLOAT3D  tl_vLightNormal;         // direction towards directional light
+  COLOR    tl_colLight;             // light color
+  COLOR    tl_colAmbient;           // ambient color (directional lights only)
+  FLOAT    tl_fFallOff;             // point light range
+  FLOAT    tl_fHotSpot;
+  BOOL     tl_bOverBrightning;      // allow overbrightning (directional lights only)
+};
+
+static void SetupTerrainLightingInfo(TerrainLightingInfo &tli, CTerrain *ptrTerrain)
 {
-  FLOAT3D vNormal;
-  INDEX iPosX = (INDEX)fPosX;
-  INDEX iPosZ = (INDEX)fPosZ;
-  FLOAT fLerpX = fPosX - iPosX;
-  FLOAT fLerpZ = fPosZ - iPosZ;
+  tli.tli_puwHeightMap = ptrTerrain->tr_auwHeightMap;
+  tli.tli_pixHeightMapWidth = ptrTerrain->tr_pixHeightMapWidth;
+  tli.tli_vStretch = ptrTerrain->tr_vStretch;
+  tli.tli_fSHDiffX = (FLOAT)ptrTerrain->tr_pixHeightMapWidth  / ptrTerrain->GetShadowMapWidth();
+  tli.tli_fSHDiffZ = (FLOAT)ptrTerrain->tr_pixHeightMapHeight / ptrTerrain->GetShadowMapHeight();
+  tli.tli_pacolShadowMap = (GFXColor*)ptrTerrain->tr_tdShadowMap.td_pulFrames;
+  tli.tli_pixShadowMapWidth = ptrTerrain->GetShadowMapWidth();
+}
 
-  FLOAT3D avVtx[4];
-  INDEX iHMapWidth = _ptrTerrain->tr_pixHeightMapWidth;
-  FLOAT3D vStretch = _ptrTerrain->tr_vStretch;
+// use scalar normal and light calculation even if SIMD is available (for benchmark)
+static BOOL _bScalarTerrainLighting = FALSE;
 
-  avVtx[0](1) = (FLOAT)(iPosX  ) * vStretch(1);
-  avVtx[1](1) = (FLOAT)(iPosX+1) * vStretch(1);
-  avVtx[2](1) = (FLOAT)(iPosX  ) * vStretch(1);
-  avVtx[3](1) = (FLOAT)(iPosX+1) * vStretch(1);
+#if TERRAIN_NEON
+// ARMv7 NEON has no divide and square root, so use estimates refined with two Newton steps
+static inline float32x4_t NeonRecip(float32x4_t f)
+{
+  float32x4_t fEst = vrecpeq_f32(f);
+  fEst = vmulq_f32(vrecpsq_f32(f,fEst), fEst);
+  fEst = vmulq_f32(vrecpsq_f32(f,fEst), fEst);
+  return fEst;
+}
 
-  avVtx[0](3) = (FLOAT)(iPosZ  ) * vStretch(3);
-  avVtx[1](3) = (FLOAT)(iPosZ  ) * vStretch(3);
-  avVtx[2](3) = (FLOAT)(iPosZ+1) * vStretch(3);
-  avVtx[3](3) = (FLOAT)(iPosZ+1) * vStretch(3);
+static inline float32x4_t NeonRSqrt(float32x4_t f)
+{
+  float32x4_t fEst = vrsqrteq_f32(f);
+  fEst = vmulq_f32(vrsqrtsq_f32(vmulq_f32(f,fEst),fEst), fEst);
+  fEst = vmulq_f32(vrsqrtsq_f32(vmulq_f32(f,fEst),fEst), fEst);
+  return fEst;
+}
 
-  avVtx[0](2) = (FLOAT)_ptrTerrain->tr_auwHeightMap[ (iPosX  ) + (iPosZ  )*iHMapWidth ] * vStretch(2);
-  avVtx[1](2) = (FLOAT)_ptrTerrain->tr_auwHeightMap[ (iPosX+1) + (iPosZ  )*iHMapWidth ] * vStretch(2);
-  avVtx[2](2) = (FLOAT)_ptrTerrain->tr_auwHeightMap[ (iPosX  ) + (iPosZ+1)*iHMapWidth ] * vStretch(2);
-  avVtx[3](2) = (FLOAT)_ptrTerrain->tr_auwHeightMap[ (iPosX+1) + (iPosZ+1)*iHMapWidth ] * vStretch(2);
+static inline float32x4_t NeonSqrt(float32x4_t f)
+{
+  // x*rsqrt(x) gives NaN for zero, so keep zeros as they are
+  const float32x4_t fSqrt = vmulq_f32(f, NeonRSqrt(f));
+  return vbslq_f32(vceqq_f32(f,vdupq_n_f32(0.0f)), f, fSqrt);
+}
 
-  FLOAT fHDeltaX = Lerp(avVtx[1](2)-avVtx[0](2), avVtx[3](2)-avVtx[2](2), fLerpZ);
-  FLOAT fHDeltaZ = Lerp(avVtx[0](2)-avVtx[2](2), avVtx[1](2)-avVtx[3](2), fLerpX);
-  FLOAT fDeltaX  = avVtx[1](1) - avVtx[0](1);
-  FLOAT fDeltaZ  = avVtx[0](3) - avVtx[2](3);
+// Clamp() to 0..1 that, like scalar code, turns NaN into zero
+static inline float32x4_t NeonClamp01(float32x4_t f)
+{
+  f = vbslq_f32(vcgeq_f32(f,vdupq_n_f32(0.0f)), f, vdupq_n_f32(0.0f));
+  return vminq_f32(f, vdupq_n_f32(1.0f));
+}
+#endif
 
-  vNormal(2) = sqrt(1 / (((fHDeltaX*fHDeltaX)/(fDeltaX*fDeltaX)) + ((fHDeltaZ*fHDeltaZ)/(fDeltaZ*fDeltaZ)) + 1));
-  vNormal(1) = sqrt(vNormal(2)*vNormal(2) * ((fHDeltaX*fHDeltaX) / (fDeltaX*fDeltaX)));
-  vNormal(3) = sqrt(vNormal(2)*vNormal(2) * ((fHDeltaZ*fHDeltaZ) / (fDeltaZ*fDeltaZ)));
-  if (fHDeltaX>0) {
-    vNormal(1) = -vNormal(1);
+// Turn height deltas of a row into normals, in place: on input X and Z hold height
+// deltas and Y holds distance between vertices along X. Only divides, square roots
+// and multiplies that are not followed by adds are done here, so the SSE2 version
+// gives exactly the same results as the scalar one.
+static void NormalsFromDeltas(FLOAT *pfNormalX, FLOAT *pfNormalY, FLOAT *pfNormalZ, INDEX ctTexels, FLOAT fDeltaZ)
+{
+  const FLOAT fDeltaZ2 = fDeltaZ*fDeltaZ;
+  INDEX i=0;
+#if TERRAIN_NEON
+  if(!_bScalarTerrainLighting) {
+    const float32x4_t fOne = vdupq_n_f32(1.0f);
+    const float32x4_t fInvDZ2 = vdupq_n_f32(1.0f/fDeltaZ2);
+    const float32x4_t fZero = vdupq_n_f32(0.0f);
+    const uint32x4_t ulSign = vdupq_n_u32(0x80000000);
+    for(;i+4<=ctTexels;i+=4) {
+      const float32x4_t fHDeltaX = vld1q_f32(pfNormalX+i);
+      const float32x4_t fDeltaX  = vld1q_f32(pfNormalY+i);
+      const float32x4_t fHDeltaZ = vld1q_f32(pfNormalZ+i);
+      const float32x4_t fRatioX = vmulq_f32(vmulq_f32(fHDeltaX,fHDeltaX), NeonRecip(vmulq_f32(fDeltaX,fDeltaX)));
+      const float32x4_t fRatioZ = vmulq_f32(vmulq_f32(fHDeltaZ,fHDeltaZ), fInvDZ2);
+      const float32x4_t fNormalY = NeonRSqrt(vaddq_f32(vaddq_f32(fRatioX,fRatioZ), fOne));
+      const float32x4_t fNormalY2 = vmulq_f32(fNormalY,fNormalY);
+      const uint32x4_t ulNormalX = vreinterpretq_u32_f32(NeonSqrt(vmulq_f32(fNormalY2,fRatioX)));
+      const uint32x4_t ulNormalZ = vreinterpretq_u32_f32(NeonSqrt(vmulq_f32(fNormalY2,fRatioZ)));
+      vst1q_f32(pfNormalX+i, vreinterpretq_f32_u32(veorq_u32(ulNormalX, vandq_u32(vcgtq_f32(fHDeltaX,fZero), ulSign))));
+      vst1q_f32(pfNormalY+i, fNormalY);
+      vst1q_f32(pfNormalZ+i, vreinterpretq_f32_u32(veorq_u32(ulNormalZ, vandq_u32(vcltq_f32(fHDeltaZ,fZero), ulSign))));
+    }
   }
-  if (fHDeltaZ<0) {
-    vNormal(3) = -vNormal(3);
+#elif TERRAIN_SSE2
+  if(!_bScalarTerrainLighting) {
+    const __m128 fOne = _mm_set1_ps(1.0f);
+    const __m128 fDZ2 = _mm_set1_ps(fDeltaZ2);
+    const __m128 fZero = _mm_setzero_ps();
+    const __m128 fSign = _mm_set1_ps(-0.0f);
+    for(;i+4<=ctTexels;i+=4) {
+      const __m128 fHDeltaX = _mm_loadu_ps(pfNormalX+i);
+      const __m128 fDeltaX  = _mm_loadu_ps(pfNormalY+i);
+      const __m128 fHDeltaZ = _mm_loadu_ps(pfNormalZ+i);
+      const __m128 fRatioX = _mm_div_ps(_mm_mul_ps(fHDeltaX,fHDeltaX), _mm_mul_ps(fDeltaX,fDeltaX));
+      const __m128 fRatioZ = _mm_div_ps(_mm_mul_ps(fHDeltaZ,fHDeltaZ), fDZ2);
+      const __m128 fNormalY = _mm_sqrt_ps(_mm_div_ps(fOne, _mm_add_ps(_mm_add_ps(fRatioX,fRatioZ), fOne)));
+      const __m128 fNormalY2 = _mm_mul_ps(fNormalY,fNormalY);
+      const __m128 fNormalX = _mm_sqrt_ps(_mm_mul_ps(fNormalY2,fRatioX));
+      const __m128 fNormalZ = _mm_sqrt_ps(_mm_mul_ps(fNormalY2,fRatioZ));
+      _mm_storeu_ps(pfNormalX+i, _mm_xor_ps(fNormalX, _mm_and_ps(_mm_cmpgt_ps(fHDeltaX,fZero), fSign)));
+      _mm_storeu_ps(pfNormalY+i, fNormalY);
+      _mm_storeu_ps(pfNormalZ+i, _mm_xor_ps(fNormalZ, _mm_and_ps(_mm_cmplt_ps(fHDeltaZ,fZero), fSign)));
+    }
   }
-  ASSERT(Abs(vNormal.Length()-1)<0.01);
-
-  if(pvStrPos!=NULL) {
-    FLOAT fResX1 = Lerp(avVtx[0](2),avVtx[1](2),fLerpX);
-    FLOAT fResX2 = Lerp(avVtx[2](2),avVtx[3](2),fLerpX);
-    FLOAT fPosY  = Lerp(fResX1,fResX2,fLerpZ);
-
-    (*pvStrPos)(1) = fPosX * vStretch(1);
-    (*pvStrPos)(2) = fPosY; // * vStretch(2);
-    (*pvStrPos)(3) = fPosZ * vStretch(3);
+#endif
+  for(;i<ctTexels;i++) {
+    const FLOAT fHDeltaX = pfNormalX[i];
+    const FLOAT fDeltaX  = pfNormalY[i];
+    const FLOAT fHDeltaZ = pfNormalZ[i];
+    const FLOAT fRatioX = (fHDeltaX*fHDeltaX)/(fDeltaX*fDeltaX);
+    const FLOAT fRatioZ = (fHDeltaZ*fHDeltaZ)/fDeltaZ2;
+    FLOAT fNormalY = sqrt(1 / (fRatioX + fRatioZ + 1));
+    FLOAT fNormalX = sqrt(fNormalY*fNormalY * fRatioX);
+    FLOAT fNormalZ = sqrt(fNormalY*fNormalY * fRatioZ);
+    pfNormalX[i] = (fHDeltaX>0) ? -fNormalX : fNormalX;
+    pfNormalY[i] = fNormalY;
+    pfNormalZ[i] = (fHDeltaZ<0) ? -fNormalZ : fNormalZ;
   }
-
-  return vNormal;
 }
 
-static void CalcPointLight(CPlacement3D &plLight, CLightSource *plsLight, Rect &rcUpdate)
+// Calculate normals and stretched heights for a span of shadow map texels in one row.
+// Does exactly the same math as the old per-texel normal calculation, but with all
+// values that are constant for the row calculated only once and results written to
+// separate arrays so that normals can be calculated with SIMD.
+static void CalculateRowNormals(const TerrainLightingInfo &tli, PIX pixY, PIX pixLeft, PIX pixRight,
+                                FLOAT *pfNormalX, FLOAT *pfNormalY, FLOAT *pfNormalZ, FLOAT *pfPosY)
 {
-  FLOAT fSHDiffX = (FLOAT)_ptrTerrain->tr_pixHeightMapWidth  / _ptrTerrain->GetShadowMapWidth();
-  FLOAT fSHDiffZ = (FLOAT)_ptrTerrain->tr_pixHeightMapHeight / _ptrTerrain->GetShadowMapHeight();
-
-  PIX pixLeft   = rcUpdate.rc_iLeft;
-  PIX pixRight  = rcUpdate.rc_iRight;
-  PIX pixTop    = rcUpdate.rc_iTop;
-  PIX pixBottom = rcUpdate.rc_iBottom;
-  PIX pixWidth  = pixRight - pixLeft;
-  PIX pixStepX  = _ptrTerrain->GetShadowMapWidth()  - pixWidth;
-
-  // Get color pointer in shadow map
-  PIX       pixFirst   = pixLeft + pixTop*_ptrTerrain->GetShadowMapWidth();
-  GFXColor *pacolData  = (GFXColor*)&_ptrTerrain->tr_tdShadowMap.td_pulFrames[pixFirst];
-
-  // for each row in shadow map
-  for(PIX pixY=pixTop;pixY<pixBottom;pixY++) {
-    // for each in column
-    for(PIX pixX=pixLeft;pixX<pixRight;pixX++) {
-      FLOAT fPosX = (FLOAT)(pixX*fSHDiffX);
-      FLOAT fPosZ = (FLOAT)(pixY*fSHDiffZ);
-
-      FLOAT3D vPosStr;
-      FLOAT3D vNormal = CalculateNormalFromPoint(fPosX,fPosZ,&vPosStr);
-      
-      // Calculate normal from light position
-      FLOAT3D vDistance = vPosStr - plLight.pl_PositionVector;
-      FLOAT   fDistance = vDistance.Length();
-      FLOAT3D vLightNormal = -vDistance.Normalize();
-      GFXColor colLight   = plsLight->GetLightColor();
-
-      // Calculate light intensity
-      FLOAT fIntensity = 1.0f;
-      FLOAT fFallOff   = plsLight->ls_rFallOff;
-      FLOAT fHotSpot   = plsLight->ls_rHotSpot;
-      if(fDistance>fFallOff) {
-        fIntensity = 0;
-      } else if(fDistance>fHotSpot) {
-        fIntensity = CalculateRatio(fDistance, fHotSpot, fFallOff, 0.0f, 1.0f);
-      }
-      ULONG ulIntensity = NormFloatToByte(fIntensity);
-      ulIntensity = (ulIntensity<<CT_RSHIFT)|(ulIntensity<<CT_GSHIFT)|(ulIntensity<<CT_BSHIFT);
-      colLight = MulColors(ByteSwap(colLight.gfxcol.ul.abgr), ulIntensity);
-
-
-      FLOAT fDot = vNormal%vLightNormal;
-      fDot = Clamp(fDot,0.0f,1.0f);
-      SLONG slDot = NormFloatToByte(fDot);
+  const INDEX iHMapWidth = tli.tli_pixHeightMapWidth;
+  const FLOAT3D &vStretch = tli.tli_vStretch;
+
+  // values that are the same for whole row
+  const FLOAT fPosZ  = (FLOAT)(pixY*tli.tli_fSHDiffZ);
+  const INDEX iPosZ  = (INDEX)fPosZ;
+  const FLOAT fLerpZ = fPosZ - iPosZ;
+  const FLOAT fVtx0Z = (FLOAT)(iPosZ  ) * vStretch(3);
+  const FLOAT fVtx2Z = (FLOAT)(iPosZ+1) * vStretch(3);
+  const FLOAT fDeltaZ = fVtx0Z - fVtx2Z;
+  const UWORD *puwRow0 = &tli.tli_puwHeightMap[(iPosZ  )*iHMapWidth];
+  const UWORD *puwRow1 = &tli.tli_puwHeightMap[(iPosZ+1)*iHMapWidth];
+
+  // gather height deltas from height map
+  const INDEX ctTexels = pixRight-pixLeft;
+  for(INDEX i=0;i<ctTexels;i++) {
+    const FLOAT fPosX  = (FLOAT)((pixLeft+i)*tli.tli_fSHDiffX);
+    const INDEX iPosX  = (INDEX)fPosX;
+    const FLOAT fLerpX = fPosX - iPosX;
+
+    const FLOAT fVtx0X = (FLOAT)(iPosX  ) * vStretch(1);
+    const FLOAT fVtx1X = (FLOAT)(iPosX+1) * vStretch(1);
+    const FLOAT fVtx0Y = (FLOAT)puwRow0[iPosX  ] * vStretch(2);
+    const FLOAT fVtx1Y = (FLOAT)puwRow0[iPosX+1] * vStretch(2);
+    const FLOAT fVtx2Y = (FLOAT)puwRow1[iPosX  ] * vStretch(2);
+    const FLOAT fVtx3Y = (FLOAT)puwRow1[iPosX+1] * vStretch(2);
+
+    pfNormalX[i] = Lerp(fVtx1Y-fVtx0Y, fVtx3Y-fVtx2Y, fLerpZ);
+    pfNormalY[i] = fVtx1X - fVtx0X;
+    pfNormalZ[i] = Lerp(fVtx0Y-fVtx2Y, fVtx1Y-fVtx3Y, fLerpX);
+
+    if(pfPosY!=NULL) {
+      const FLOAT fResX1 = Lerp(fVtx0Y,fVtx1Y,fLerpX);
+      const FLOAT fResX2 = Lerp(fVtx2Y,fVtx3Y,fLerpX);
+      pfPosY[i] = Lerp(fResX1,fResX2,fLerpZ);
+    }
+  }
+  NormalsFromDeltas(pfNormalX, pfNormalY, pfNormalZ, ctTexels, fDeltaZ);
+}
 
-      pacolData->gfxcol.ub.r = ClampUp(pacolData->gfxcol.ub.r + ((colLight.gfxcol.ub.r*slDot)>>8),255L);
-      pacolData->gfxcol.ub.g = ClampUp(pacolData->gfxcol.ub.g + ((colLight.gfxcol.ub.g*slDot)>>8),255L);
-      pacolData->gfxcol.ub.b = ClampUp(pacolData->gfxcol.ub.b + ((colLight.gfxcol.ub.b*slDot)>>8),255L);
-      pacolData->gfxcol.ub.a = 255;
-      pacolData++;
+// Calculate clamped dot products of a row of normals with directional light normal.
+static void DirectionalLightDots(const FLOAT3D &vLightNormal, const FLOAT *pfNormalX, const FLOAT *pfNormalY,
+                                 const FLOAT *pfNormalZ, FLOAT *pfDot, INDEX ctTexels)
+{
+  INDEX i=0;
+#if TERRAIN_NEON
+  if(!_bScalarTerrainLighting) {
+    const float32x4_t fLightX = vdupq_n_f32(vLightNormal(1));
+    const float32x4_t fLightY = vdupq_n_f32(vLightNormal(2));
+    const float32x4_t fLightZ = vdupq_n_f32(vLightNormal(3));
+    for(;i+4<=ctTexels;i+=4) {
+      float32x4_t fDot = vmulq_f32(vld1q_f32(pfNormalX+i), fLightX);
+      fDot = vaddq_f32(fDot, vmulq_f32(vld1q_f32(pfNormalY+i), fLightY));
+      fDot = vaddq_f32(fDot, vmulq_f32(vld1q_f32(pfNormalZ+i), fLightZ));
+      vst1q_f32(pfDot+i, NeonClamp01(fDot));
+    }
+  }
+#elif TERRAIN_SSE2
+  if(!_bScalarTerrainLighting) {
+    const __m128 fLightX = _mm_set1_ps(vLightNormal(1));
+    const __m128 fLightY = _mm_set1_ps(vLightNormal(2));
+    const __m128 fLightZ = _mm_set1_ps(vLightNormal(3));
+    const __m128 fZero = _mm_setzero_ps();
+    const __m128 fOne  = _mm_set1_ps(1.0f);
+    for(;i+4<=ctTexels;i+=4) {
+      __m128 fDot = _mm_mul_ps(_mm_loadu_ps(pfNormalX+i), fLightX);
+      fDot = _mm_add_ps(fDot, _mm_mul_ps(_mm_loadu_ps(pfNormalY+i), fLightY));
+      fDot = _mm_add_ps(fDot, _mm_mul_ps(_mm_loadu_ps(pfNormalZ+i), fLightZ));
+      // max returns second operand for NaN, same as Clamp()
+      _mm_storeu_ps(pfDot+i, _mm_min_ps(_mm_max_ps(fDot,fZero), fOne));
     }
-    pacolData+=pixStepX;
+  }
+#endif
+  for(;i<ctTexels;i++) {
+    const FLOAT3D vNormal(pfNormalX[i], pfNormalY[i], pfNormalZ[i]);
+    ASSERT(Abs(vNormal.Length()-1)<0.01);
+    FLOAT fDot = vNormal%vLightNormal;
+    pfDot[i] = Clamp(fDot,0.0f,1.0f);
   }
 }
 
-static void CalcDirectionalLight(CPlacement3D &plLight, CLightSource *plsLight, Rect &rcUpdate)
+// Calculate clamped dot products of a row of normals with point light direction
+// and light intensity at each texel.
+static void PointLightDots(const TerrainLightingInfo &tli, const TerrainLight &tl, PIX pixY, PIX pixLeft,
+                           const FLOAT *pfNormalX, const FLOAT *pfNormalY, const FLOAT *pfNormalZ, const FLOAT *pfPosY,
+                           FLOAT *pfDot, FLOAT *pfIntensity, INDEX ctTexels)
 {
-  FLOAT fSHDiffX = (FLOAT)_ptrTerrain->tr_pixHeightMapWidth  / _ptrTerrain->GetShadowMapWidth();
-  FLOAT fSHDiffZ = (FLOAT)_ptrTerrain->tr_pixHeightMapHeight / _ptrTerrain->GetShadowMapHeight();
+  const FLOAT fPosZ = (FLOAT)(pixY*tli.tli_fSHDiffZ);
+  const FLOAT fStrPosZ = fPosZ * tli.tli_vStretch(3);
+  const FLOAT fFallOff = tl.tl_fFallOff;
+  const FLOAT fHotSpot = tl.tl_fHotSpot;
+  INDEX i=0;
+#if TERRAIN_NEON
+  if(!_bScalarTerrainLighting) {
+    const float32x4_t fSHDiffX = vdupq_n_f32(tli.tli_fSHDiffX);
+    const float32x4_t fStretchX = vdupq_n_f32(tli.tli_vStretch(1));
+    const float32x4_t fLightX = vdupq_n_f32(tl.tl_vPosition(1));
+    const float32x4_t fLightY = vdupq_n_f32(tl.tl_vPosition(2));
+    const float32x4_t fDistZ = vdupq_n_f32(fStrPosZ - tl.tl_vPosition(3));
+    const float32x4_t fFall = vdupq_n_f32(fFallOff);
+    const float32x4_t fHot  = vdupq_n_f32(fHotSpot);
+    const float32x4_t fInvDelta = vdupq_n_f32(1.0f/(fFallOff-fHotSpot));
+    const float32x4_t fZero = vdupq_n_f32(0.0f);
+    const float32x4_t fOne  = vdupq_n_f32(1.0f);
+    const int32x4_t slStep = {0,1,2,3};
+    for(;i+4<=ctTexels;i+=4) {
+      const float32x4_t fPosX = vmulq_f32(vcvtq_f32_s32(vaddq_s32(vdupq_n_s32(pixLeft+i), slStep)), fSHDiffX);
+      const float32x4_t fDistX = vsubq_f32(vmulq_f32(fPosX,fStretchX), fLightX);
+      const float32x4_t fDistY = vsubq_f32(vld1q_f32(pfPosY+i), fLightY);
+      float32x4_t fDist2 = vmulq_f32(fDistX,fDistX);
+      fDist2 = vaddq_f32(fDist2, vmulq_f32(fDistY,fDistY));
+      fDist2 = vaddq_f32(fDist2, vmulq_f32(fDistZ,fDistZ));
+      const float32x4_t fInvDist = NeonRSqrt(fDist2);
+      const float32x4_t fDist = NeonSqrt(fDist2);
+      // dot with negated normalized distance
+      float32x4_t fDot = vmulq_f32(vld1q_f32(pfNormalX+i), vmulq_f32(fDistX,fInvDist));
+      fDot = vaddq_f32(fDot, vmulq_f32(vld1q_f32(pfNormalY+i), vmulq_f32(fDistY,fInvDist)));
+      fDot = vaddq_f32(fDot, vmulq_f32(vld1q_f32(pfNormalZ+i), vmulq_f32(fDistZ,fInvDist)));
+      vst1q_f32(pfDot+i, NeonClamp01(vnegq_f32(fDot)));
+      // full intensity up to hot spot, fading out to zero at fall off
+      const float32x4_t fFade = vsubq_f32(fOne, vmulq_f32(vsubq_f32(fDist,fHot), fInvDelta));
+      const float32x4_t fIntensity = vbslq_f32(vcgtq_f32(fDist,fHot), vmaxq_f32(fFade,fZero), fOne);
+      vst1q_f32(pfIntensity+i, vbslq_f32(vcgtq_f32(fDist,fFall), fZero, fIntensity));
+    }
+  }
+#elif TERRAIN_SSE2
+  if(!_bScalarTerrainLighting) {
+    const __m128 fSHDiffX = _mm_set1_ps(tli.tli_fSHDiffX);
+    const __m128 fStretchX = _mm_set1_ps(tli.tli_vStretch(1));
+    const __m128 fLightX = _mm_set1_ps(tl.tl_vPosition(1));
+    const __m128 fLightY = _mm_set1_ps(tl.tl_vPosition(2));
+    const __m128 fDistZ = _mm_set1_ps(fStrPosZ - tl.tl_vPosition(3));
+    const __m128 fFall = _mm_set1_ps(fFallOff);
+    const __m128 fHot  = _mm_set1_ps(fHotSpot);
+    const __m128 fDelta = _mm_set1_ps(fFallOff-fHotSpot);
+    const __m128 fZero = _mm_setzero_ps();
+    const __m128 fOne  = _mm_set1_ps(1.0f);
+    const __m128 fSign = _mm_set1_ps(-0.0f);
+    const __m128i slStep = _mm_set_epi32(3,2,1,0);
+    for(;i+4<=ctTexels;i+=4) {
+      const __m128 fPosX = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(pixLeft+i), slStep)), fSHDiffX);
+      const __m128 fDistX = _mm_sub_ps(_mm_mul_ps(fPosX,fStretchX), fLightX);
+      const __m128 fDistY = _mm_sub_ps(_mm_loadu_ps(pfPosY+i), fLightY);
+      __m128 fDist2 = _mm_mul_ps(fDistX,fDistX);
+      fDist2 = _mm_add_ps(fDist2, _mm_mul_ps(fDistY,fDistY));
+      fDist2 = _mm_add_ps(fDist2, _mm_mul_ps(fDistZ,fDistZ));
+      const __m128 fDist = _mm_sqrt_ps(fDist2);
+      const __m128 fInvDist = _mm_div_ps(fOne, fDist);
+      // dot with negated normalized distance
+      __m128 fDot = _mm_mul_ps(_mm_loadu_ps(pfNormalX+i), _mm_xor_ps(_mm_mul_ps(fDistX,fInvDist), fSign));
+      fDot = _mm_add_ps(fDot, _mm_mul_ps(_mm_loadu_ps(pfNormalY+i), _mm_xor_ps(_mm_mul_ps(fDistY,fInvDist), fSign)));
+      fDot = _mm_add_ps(fDot, _mm_mul_ps(_mm_loadu_ps(pfNormalZ+i), _mm_xor_ps(_mm_mul_ps(fDistZ,fInvDist), fSign)));
+      _mm_storeu_ps(pfDot+i, _mm_min_ps(_mm_max_ps(fDot,fZero), fOne));
+      // full intensity up to hot spot, fading out to zero at fall off
+      const __m128 fFade = _mm_sub_ps(fOne, _mm_div_ps(_mm_sub_ps(fDist,fHot), fDelta));
+      const __m128 mHot = _mm_cmpgt_ps(fDist,fHot);
+      const __m128 fIntensity = _mm_or_ps(_mm_and_ps(mHot, _mm_max_ps(fFade,fZero)), _mm_andnot_ps(mHot, fOne));
+      _mm_storeu_ps(pfIntensity+i, _mm_andnot_ps(_mm_cmpgt_ps(fDist,fFall), fIntensity));
+    }
+  }
+#endif
+  for(;i<ctTexels;i++) {
+    const FLOAT fPosX = (FLOAT)((pixLeft+i)*tli.tli_fSHDiffX);
+    const FLOAT3D vNormal(pfNormalX[i], pfNormalY[i], pfNormalZ[i]);
+    const FLOAT3D vPosStr(fPosX * tli.tli_vStretch(1), pfPosY[i], fStrPosZ);
+    ASSERT(Abs(vNormal.Length()-1)<0.01);
+
+    // Calculate normal from light position
+    FLOAT3D vDistance = vPosStr - tl.tl_vPosition;
+    FLOAT   fDistance = vDistance.Length();
+    FLOAT3D vLightNormal = -vDistance.Normalize();
+
+    // Calculate light intensity
+    FLOAT fIntensity = 1.0f;
+    if(fDistance>fFallOff) {
+      fIntensity = 0;
+    } else if(fDistance>fHotSpot) {
+      fIntensity = CalculateRatio(fDistance, fHotSpot, fFallOff, 0.0f, 1.0f);
+    }
+    pfIntensity[i] = fIntensity;
 
-  PIX pixLeft   = rcUpdate.rc_iLeft;
-  PIX pixRight  = rcUpdate.rc_iRight;
-  PIX pixTop    = rcUpdate.rc_iTop;
-  PIX pixBottom = rcUpdate.rc_iBottom;
-  PIX pixWidth  = pixRight - pixLeft;
-  PIX pixStepX  = _ptrTerrain->GetShadowMapWidth()  - pixWidth;
+    FLOAT fDot = vNormal%vLightNormal;
+    pfDot[i] = Clamp(fDot,0.0f,1.0f);
+  }
+}
 
-  // Get color pointer in shadow map
-  PIX       pixFirst   = pixLeft + pixTop*_ptrTerrain->GetShadowMapWidth();
-  GFXColor *pacolData  = (GFXColor*)&_ptrTerrain->tr_tdShadowMap.td_pulFrames[pixFirst];
+static void CalcPointLightRow(const TerrainLightingInfo &tli, const TerrainLight &tl, PIX pixY, PIX pixLeft, PIX pixRight,
+                              const FLOAT *pfDot, const FLOAT *pfIntensity)
+{
+  const GFXColor colBase = tl.tl_colLight;
+  const ULONG ulLight = ByteSwap(colBase.gfxcol.ul.abgr);
+  GFXColor *pacolData = &tli.tli_pacolShadowMap[pixLeft + pixY*tli.tli_pixShadowMapWidth];
+
+  const INDEX ctTexels = pixRight-pixLeft;
+  for(INDEX i=0;i<ctTexels;i++) {
+    ULONG ulIntensity = NormFloatToByte(pfIntensity[i]);
+    ulIntensity = (ulIntensity<<CT_RSHIFT)|(ulIntensity<<CT_GSHIFT)|(ulIntensity<<CT_BSHIFT);
+    GFXColor colLight = MulColors(ulLight, ulIntensity);
+    SLONG slDot = NormFloatToByte(pfDot[i]);
+
+    pacolData->gfxcol.ub.r = ClampUp(pacolData->gfxcol.ub.r + ((colLight.gfxcol.ub.r*slDot)>>8),255L);
+    pacolData->gfxcol.ub.g = ClampUp(pacolData->gfxcol.ub.g + ((colLight.gfxcol.ub.g*slDot)>>8),255L);
+    pacolData->gfxcol.ub.b = ClampUp(pacolData->gfxcol.ub.b + ((colLight.gfxcol.ub.b*slDot)>>8),255L);
+    pacolData->gfxcol.ub.a = 255;
+    pacolData++;
+  }
+}
 
-  FLOAT3D vLightNormal;
-  GFXColor colLight   = plsLight->GetLightColor();
-  GFXColor colAmbient = plsLight->GetLightAmbient();
+static void CalcDirectionalLightRow(const TerrainLightingInfo &tli, const TerrainLight &tl, PIX pixY, PIX pixLeft, PIX pixRight,
+                                    const FLOAT *pfDot)
+{
+  GFXColor colLight   = tl.tl_colLight;
+  GFXColor colAmbient = tl.tl_colAmbient;
 
   UBYTE ubColShift = 8;
   SLONG slar = colAmbient.gfxcol.ub.r;
   SLONG slag = colAmbient.gfxcol.ub.g;
   SLONG slab = colAmbient.gfxcol.ub.b;
 
-  extern INDEX mdl_bAllowOverbright;
-  BOOL bOverBrightning = mdl_bAllowOverbright && _pGfx->gl_ctTextureUnits>1;
-
   // is overbrightning enabled
-  if(bOverBrightning) {
+  if(tl.tl_bOverBrightning) {
     slar = ClampUp(slar,127L);
     slag = ClampUp(slag,127L);
     slab = ClampUp(slab,127L);
@@ -823,33 +1058,110 @@ static void CalcDirectionalLight(CPlacement3D &plLight, CLightSource *plsLight,
     ubColShift = 7;
   }
 
-  // Calculate light normal
-  AnglesToDirectionVector(plLight.pl_OrientationAngle,vLightNormal);
-  vLightNormal *= !_ptrTerrain->tr_penEntity->en_mRotation;
-  vLightNormal = -vLightNormal.Normalize();
+  GFXColor *pacolData = &tli.tli_pacolShadowMap[pixLeft + pixY*tli.tli_pixShadowMapWidth];
 
-  // for each row in shadow map
-  for(PIX pixY=pixTop;pixY<pixBottom;pixY++) {
-    // for each in column
-    for(PIX pixX=pixLeft;pixX<pixRight;pixX++) {
-      FLOAT fPosX = (FLOAT)(pixX*fSHDiffX);
-      FLOAT fPosZ = (FLOAT)(pixY*fSHDiffZ);
-      FLOAT3D vNormal = CalculateNormalFromPoint(fPosX,fPosZ);
+  const INDEX ctTexels = pixRight-pixLeft;
+  for(INDEX i=0;i<ctTexels;i++) {
+    SLONG slDot = NormFloatToByte(pfDot[i]);
 
-      FLOAT fDot = vNormal%vLightNormal;
-      fDot = Clamp(fDot,0.0f,1.0f);
-      SLONG slDot = NormFloatToByte(fDot);
+    pacolData->gfxcol.ub.r = ClampUp(pacolData->gfxcol.ub.r + slar + ((colLight.gfxcol.ub.r*slDot)>>ubColShift),255L);
+    pacolData->gfxcol.ub.g = ClampUp(pacolData->gfxcol.ub.g + slag + ((colLight.gfxcol.ub.g*slDot)>>ubColShift),255L);
+    pacolData->gfxcol.ub.b = ClampUp(pacolData->gfxcol.ub.b + slab + ((colLight.gfxcol.ub.b*slDot)>>ubColShift),255L);
+    pacolData->gfxcol.ub.a = 255;
+    pacolData++;
+  }
+}
 
-      pacolData->gfxcol.ub.r = ClampUp(pacolData->gfxcol.ub.r + slar + ((colLight.gfxcol.ub.r*slDot)>>ubColShift),255L);
-      pacolData->gfxcol.ub.g = ClampUp(pacolData->gfxcol.ub.g + slag + ((colLight.gfxcol.ub.g*slDot)>>ubColShift),255L);
-      pacolData->gfxcol.ub.b = ClampUp(pacolData->gfxcol.ub.b + slab + ((colLight.gfxcol.ub.b*slDot)>>ubColShift),255L);
-      pacolData->gfxcol.ub.a = 255;
-      pacolData++;
+// applies one light to a rectangle of shadow map, split into rows that can be lit in parallel
+class CTerrainLightJob : public CWorkerJob {
+public:
+  const TerrainLightingInfo &tlj_tli;
+  const TerrainLight &tlj_tl;
+  Rect tlj_rcUpdate;
+
+  CTerrainLightJob(const TerrainLightingInfo &tli, const TerrainLight &tl, const Rect &rcUpdate)
+    : tlj_tli(tli), tlj_tl(tl), tlj_rcUpdate(rcUpdate) {}
+
+  void ProcessRange(INDEX iFirst, INDEX iLast)
+  {
+    const PIX pixLeft  = tlj_rcUpdate.rc_iLeft;
+    const PIX pixRight = tlj_rcUpdate.rc_iRight;
+    const INDEX ctTexels = pixRight-pixLeft;
+    if(ctTexels<=0) {
+      return;
     }
-    pacolData+=pixStepX;
+    // row buffers for normals, heights, dot products and light intensities
+    FLOAT *pfBuffer = (FLOAT*)AllocMemory(ctTexels*6*sizeof(FLOAT));
+    FLOAT *pfNormalX   = pfBuffer;
+    FLOAT *pfNormalY   = pfBuffer + ctTexels;
+    FLOAT *pfNormalZ   = pfBuffer + ctTexels*2;
+    FLOAT *pfPosY      = pfBuffer + ctTexels*3;
+    FLOAT *pfDot       = pfBuffer + ctTexels*4;
+    FLOAT *pfIntensity = pfBuffer + ctTexels*5;
+
+    for(INDEX iRow=iFirst;iRow<iLast;iRow++) {
+      const PIX pixY = tlj_rcUpdate.rc_iTop + iRow;
+      if(tlj_tl.tl_bDirectional) {
+        CalculateRowNormals(tlj_tli, pixY, pixLeft, pixRight, pfNormalX, pfNormalY, pfNormalZ, NULL);
+        DirectionalLightDots(tlj_tl.tl_vLightNormal, pfNormalX, pfNormalY, pfNormalZ, pfDot, ctTexels);
+        CalcDirectionalLightRow(tlj_tli, tlj_tl, pixY, pixLeft, pixRight, pfDot);
+      } else {
+        CalculateRowNormals(tlj_tli, pixY, pixLeft, pixRight, pfNormalX, pfNormalY, pfNormalZ, pfPosY);
+        PointLightDots(tlj_tli, tlj_tl, pixY, pixLeft, pfNormalX, pfNormalY, pfNormalZ, pfPosY, pfDot, pfIntensity, ctTexels);
+        CalcPointLightRow(tlj_tli, tlj_tl, pixY, pixLeft, pixRight, pfDot, pfIntensity);
+      }
+    }
+    FreeMemory(pfBuffer);
+  }
+};
+
+// apply one light to a rectangle of shadow map
+static void CalcTerrainLight(const TerrainLightingInfo &tli, const TerrainLight &tl, const Rect &rcUpdate, BOOL bMultiThreaded)
+{
+  const INDEX ctRows  = rcUpdate.rc_iBottom - rcUpdate.rc_iTop;
+  const INDEX ctWidth = rcUpdate.rc_iRight  - rcUpdate.rc_iLeft;
+  if(ctRows<=0 || ctWidth<=0) {
+    return;
+  }
+  CTerrainLightJob tlj(tli, tl, rcUpdate);
+  if(bMultiThreaded && _pWorkerPool!=NULL) {
+    // rows are independent of each other, so each chunk of rows can be lit separately
+    const INDEX ctRowsPerChunk = Max(1L, 8192L/ctWidth);
+    _pWorkerPool->Run(tlj, ctRows, ctRowsPerChunk);
+  } else {
+    tlj.ProcessRange(0, ctRows);
   }
 }
 
+static void CalcPointLight(const TerrainLightingInfo &tli, CPlacement3D &plLight, CLightSource *plsLight, Rect &rcUpdate)
+{
+  TerrainLight tl;
+  tl.tl_bDirectional = FALSE;
+  tl.tl_vPosition = plLight.pl_PositionVector;
+  tl.tl_colLight  = plsLight->GetLightColor();
+  tl.tl_fFallOff  = plsLight->ls_rFallOff;
+  tl.tl_fHotSpot  = plsLight->ls_rHotSpot;
+  CalcTerrainLight(tli, tl, rcUpdate, ter_bMultiThreadedShadows);
+}
+
+static void CalcDirectionalLight(const TerrainLightingInfo &tli, CPlacement3D &plLight, CLightSource *plsLight, Rect &rcUpdate)
+{
+  TerrainLight tl;
+  tl.tl_bDirectional = TRUE;
+  tl.tl_colLight   = plsLight->GetLightColor();
+  tl.tl_colAmbient = plsLight->GetLightAmbient();
+
+  extern INDEX mdl_bAllowOverbright;
+  tl.tl_bOverBrightning = mdl_bAllowOverbright && _pGfx->gl_ctTextureUnits>1;
+
+  // Calculate light normal
+  FLOAT3D vLightNormal;
+  AnglesToDirectionVector(plLight.pl_OrientationAngle,vLightNormal);
+  vLightNormal *= !_ptrTerrain->tr_penEntity->en_mRotation;
+  tl.tl_vLightNormal = -vLightNormal.Normalize();
+  CalcTerrainLight(tli, tl, rcUpdate, ter_bMultiThreadedShadows);
+}
+
 static void ClearPartOfShadowMap(CTerrain *ptrTerrain, Rect &rcUpdate)
 {
   PIX pixLeft   = rcUpdate.rc_iLeft;
@@ -964,6 +1276,9 @@ void UpdateTerrainShadowMap(CTerrain *ptrTerrain, FLOATaabbox3D *pboxUpdate/*=NU
   // Clear part of shadow map that will be updated
   ClearPartOfShadowMap(ptrTerrain,rcUpdate);
 
+  TerrainLightingInfo tli;
+  SetupTerrainLightingInfo(tli, ptrTerrain);
+
   // for each entity in the world
   FOREACHINDYNAMICCONTAINER(pwldWorld->wo_cenEntities, CEntity, iten) {
     // if it is light entity and it influences the given range
@@ -980,7 +1295,7 @@ void UpdateTerrainShadowMap(CTerrain *ptrTerrain, FLOATaabbox3D *pboxUpdate/*=NU
       // if light is directional
       if(pls->ls_ulFlags &LSF_DIRECTIONAL) {
         // Calculate lightning
-        CalcDirectionalLight(plLight,pls,rcUpdate);
+        CalcDirectionalLight(tli,plLight,pls,rcUpdate);
       // if it is point light
       } else {
         _bboxDrawOne = boxLight;
@@ -994,11 +1309,11 @@ void UpdateTerrainShadowMap(CTerrain *ptrTerrain, FLOATaabbox3D *pboxUpdate/*=NU
             boxLight.maxvect(1)<=boxUpdate.maxvect(1) && boxLight.maxvect(3)<=boxUpdate.maxvect(3)) {
             // Recalculate only light box
             Rect rcLightUpdate = GetUpdateRectFromBox(ptrTerrain,boxLight);
-            CalcPointLight(plLight,pls,rcLightUpdate);
+            CalcPointLight(tli,plLight,pls,rcLightUpdate);
           // else 
           } else {
             // Recalculate update box
-            CalcPointLight(plLight,pls,rcUpdate);
+            CalcPointLight(tli,plLight,pls,rcUpdate);
           }
         }
       }
@@ -1072,3 +1387,254 @@ FLOAT2D CalculateShadingTexCoords(CTerrain *ptrTerrain, FLOAT3D &vPoint)
   ASSERT(fV>0.0f && fV<ptrTerrain->GetShadingMapHeight());
   return FLOAT2D(fU,fV);
 }
+
+// normal at one point of height map (old per-texel way, kept as reference for benchmark)
+static FLOAT3D CalculateNormalFromPoint(const TerrainLightingInfo &tli, FLOAT fPosX, FLOAT fPosZ, FLOAT3D *pvStrPos=NULL)
+{
+  FLOAT3D vNormal;
+  INDEX iPosX = (INDEX)fPosX;
+  INDEX iPosZ = (INDEX)fPosZ;
+  FLOAT fLerpX = fPosX - iPosX;
+  FLOAT fLerpZ = fPosZ - iPosZ;
+
+  FLOAT3D avVtx[4];
+  INDEX iHMapWidth = tli.tli_pixHeightMapWidth;
+  FLOAT3D vStretch = tli.tli_vStretch;
+
+  avVtx[0](1) = (FLOAT)(iPosX  ) * vStretch(1);
+  avVtx[1](1) = (FLOAT)(iPosX+1) * vStretch(1);
+  avVtx[2](1) = (FLOAT)(iPosX  ) * vStretch(1);
+  avVtx[3](1) = (FLOAT)(iPosX+1) * vStretch(1);
+
+  avVtx[0](3) = (FLOAT)(iPosZ  ) * vStretch(3);
+  avVtx[1](3) = (FLOAT)(iPosZ  ) * vStretch(3);
+  avVtx[2](3) = (FLOAT)(iPosZ+1) * vStretch(3);
+  avVtx[3](3) = (FLOAT)(iPosZ+1) * vStretch(3);
+
+  avVtx[0](2) = (FLOAT)tli.tli_puwHeightMap[ (iPosX  ) + (iPosZ  )*iHMapWidth ] * vStretch(2);
+  avVtx[1](2) = (FLOAT)tli.tli_puwHeightMap[ (iPosX+1) + (iPosZ  )*iHMapWidth ] * vStretch(2);
+  avVtx[2](2) = (FLOAT)tli.tli_puwHeightMap[ (iPosX  ) + (iPosZ+1)*iHMapWidth ] * vStretch(2);
+  avVtx[3](2) = (FLOAT)tli.tli_puwHeightMap[ (iPosX+1) + (iPosZ+1)*iHMapWidth ] * vStretch(2);
+
+  FLOAT fHDeltaX = Lerp(avVtx[1](2)-avVtx[0](2), avVtx[3](2)-avVtx[2](2), fLerpZ);
+  FLOAT fHDeltaZ = Lerp(avVtx[0](2)-avVtx[2](2), avVtx[1](2)-avVtx[3](2), fLerpX);
+  FLOAT fDeltaX  = avVtx[1](1) - avVtx[0](1);
+  FLOAT fDeltaZ  = avVtx[0](3) - avVtx[2](3);
+
+  vNormal(2) = sqrt(1 / (((fHDeltaX*fHDeltaX)/(fDeltaX*fDeltaX)) + ((fHDeltaZ*fHDeltaZ)/(fDeltaZ*fDeltaZ)) + 1));
+  vNormal(1) = sqrt(vNormal(2)*vNormal(2) * ((fHDeltaX*fHDeltaX) / (fDeltaX*fDeltaX)));
+  vNormal(3) = sqrt(vNormal(2)*vNormal(2) * ((fHDeltaZ*fHDeltaZ) / (fDeltaZ*fDeltaZ)));
+  if (fHDeltaX>0) {
+    vNormal(1) = -vNormal(1);
+  }
+  if (fHDeltaZ<0) {
+    vNormal(3) = -vNormal(3);
+  }
+  ASSERT(Abs(vNormal.Length()-1)<0.01);
+
+  if(pvStrPos!=NULL) {
+    FLOAT fResX1 = Lerp(avVtx[0](2),avVtx[1](2),fLerpX);
+    FLOAT fResX2 = Lerp(avVtx[2](2),avVtx[3](2),fLerpX);
+    FLOAT fPosY  = Lerp(fResX1,fResX2,fLerpZ);
+
+    (*pvStrPos)(1) = fPosX * vStretch(1);
+    (*pvStrPos)(2) = fPosY; // * vStretch(2);
+    (*pvStrPos)(3) = fPosZ * vStretch(3);
+  }
+
+  return vNormal;
+}
+
+// apply one light to a rectangle of shadow map texel by texel (old way, kept as reference for benchmark)
+static void CalcTerrainLightPerTexel(const TerrainLightingInfo &tli, const TerrainLight &tl, const Rect &rcUpdate)
+{
+  PIX pixLeft   = rcUpdate.rc_iLeft;
+  PIX pixRight  = rcUpdate.rc_iRight;
+  PIX pixTop    = rcUpdate.rc_iTop;
+  PIX pixBottom = rcUpdate.rc_iBottom;
+  PIX pixWidth  = pixRight - pixLeft;
+  PIX pixStepX  = tli.tli_pixShadowMapWidth - pixWidth;
+
+  // Get color pointer in shadow map
+  GFXColor *pacolData = &tli.tli_pacolShadowMap[pixLeft + pixTop*tli.tli_pixShadowMapWidth];
+
+  GFXColor colLight   = tl.tl_colLight;
+  GFXColor colAmbient = tl.tl_colAmbient;
+  UBYTE ubColShift = 8;
+  SLONG slar = colAmbient.gfxcol.ub.r;
+  SLONG slag = colAmbient.gfxcol.ub.g;
+  SLONG slab = colAmbient.gfxcol.ub.b;
+  if(tl.tl_bOverBrightning) {
+    slar = ClampUp(slar,127L);
+    slag = ClampUp(slag,127L);
+    slab = ClampUp(slab,127L);
+    ubColShift = 8;
+  } else {
+    slar*=2;
+    slag*=2;
+    slab*=2;
+    ubColShift = 7;
+  }
+
+  // for each row in shadow map
+  for(PIX pixY=pixTop;pixY<pixBottom;pixY++) {
+    // for each in column
+    for(PIX pixX=pixLeft;pixX<pixRight;pixX++) {
+      FLOAT fPosX = (FLOAT)(pixX*tli.tli_fSHDiffX);
+      FLOAT fPosZ = (FLOAT)(pixY*tli.tli_fSHDiffZ);
+
+      if(tl.tl_bDirectional) {
+        FLOAT3D vNormal = CalculateNormalFromPoint(tli,fPosX,fPosZ);
+        FLOAT fDot = vNormal%tl.tl_vLightNormal;
+        fDot = Clamp(fDot,0.0f,1.0f);
+        SLONG slDot = NormFloatToByte(fDot);
+
+        pacolData->gfxcol.ub.r = ClampUp(pacolData->gfxcol.ub.r + slar + ((colLight.gfxcol.ub.r*slDot)>>ubColShift),255L);
+        pacolData->gfxcol.ub.g = ClampUp(pacolData->gfxcol.ub.g + slag + ((colLight.gfxcol.ub.g*slDot)>>ubColShift),255L);
+        pacolData->gfxcol.ub.b = ClampUp(pacolData->gfxcol.ub.b + slab + ((colLight.gfxcol.ub.b*slDot)>>ubColShift),255L);
+      } else {
+        FLOAT3D vPosStr;
+        FLOAT3D vNormal = CalculateNormalFromPoint(tli,fPosX,fPosZ,&vPosStr);
+
+        // Calculate normal from light position
+        FLOAT3D vDistance = vPosStr - tl.tl_vPosition;
+        FLOAT   fDistance = vDistance.Length();
+        FLOAT3D vLightNormal = -vDistance.Normalize();
+        GFXColor colPoint = colLight;
+
+        // Calculate light intensity
+        FLOAT fIntensity = 1.0f;
+        if(fDistance>tl.tl_fFallOff) {
+          fIntensity = 0;
+        } else if(fDistance>tl.tl_fHotSpot) {
+          fIntensity = CalculateRatio(fDistance, tl.tl_fHotSpot, tl.tl_fFallOff, 0.0f, 1.0f);
+        }
+        ULONG ulIntensity = NormFloatToByte(fIntensity);
+        ulIntensity = (ulIntensity<<CT_RSHIFT)|(ulIntensity<<CT_GSHIFT)|(ulIntensity<<CT_BSHIFT);
+        colPoint = MulColors(ByteSwap(colPoint.gfxcol.ul.abgr), ulIntensity);
+
+        FLOAT fDot = vNormal%vLightNormal;
+        fDot = Clamp(fDot,0.0f,1.0f);
+        SLONG slDot = NormFloatToByte(fDot);
+
+        pacolData->gfxcol.ub.r = ClampUp(pacolData->gfxcol.ub.r + ((colPoint.gfxcol.ub.r*slDot)>>8),255L);
+        pacolData->gfxcol.ub.g = ClampUp(pacolData->gfxcol.ub.g + ((colPoint.gfxcol.ub.g*slDot)>>8),255L);
+        pacolData->gfxcol.ub.b = ClampUp(pacolData->gfxcol.ub.b + ((colPoint.gfxcol.ub.b*slDot)>>8),255L);
+      }
+      pacolData->gfxcol.ub.a = 255;
+      pacolData++;
+    }
+    pacolData+=pixStepX;
+  }
+}
+
+// biggest difference of any color channel between two shadow maps
+static SLONG ShadowMapDifference(const GFXColor *pacol0, const GFXColor *pacol1, INDEX ctTexels)
+{
+  SLONG slMaxDiff = 0;
+  for(INDEX i=0;i<ctTexels;i++) {
+    slMaxDiff = Max(slMaxDiff, (SLONG)Abs((SLONG)pacol0[i].gfxcol.ub.r - (SLONG)pacol1[i].gfxcol.ub.r));
+    slMaxDiff = Max(slMaxDiff, (SLONG)Abs((SLONG)pacol0[i].gfxcol.ub.g - (SLONG)pacol1[i].gfxcol.ub.g));
+    slMaxDiff = Max(slMaxDiff, (SLONG)Abs((SLONG)pacol0[i].gfxcol.ub.b - (SLONG)pacol1[i].gfxcol.ub.b));
+  }
+  return slMaxDiff;
+}
+
+// Benchmark terrain shadow map lighting on synthetic terrains of several sizes
+// (compares old per-texel loop against new row based scalar, SIMD and multi-threaded lighting).
+void TerrainShadowBenchmark(void)
+{
+  static const PIX apixSizes[] = { 257, 513, 1025, 2049 };
+  const INDEX ctSizes = sizeof(apixSizes)/sizeof(apixSizes[0]);
+  const INDEX ctPointLights = 8;
+
+  CPrintF(TRANS("Terrain shadow map benchmark (%d threads, %s):\n"), _pWorkerPool->GetThreadsCount(),
+          TERRAIN_NEON ? "NEON" : (TERRAIN_SSE2 ? "SSE2" : "no SIMD"));
+  for(INDEX iSize=0;iSize<ctSizes;iSize++) {
+    const PIX pixHMapSize = apixSizes[iSize];
+    const PIX pixSMapSize = pixHMapSize-1;
+    const SLONG slSMapBytes = pixSMapSize*pixSMapSize*sizeof(GFXColor);
+
+    // make some hills
+    UWORD *puwHeightMap = (UWORD*)AllocMemory(pixHMapSize*pixHMapSize*sizeof(UWORD));
+    ULONG ulSeed = 0x12345678;
+    for(INDEX iz=0;iz<pixHMapSize;iz++) {
+      for(INDEX ix=0;ix<pixHMapSize;ix++) {
+        ulSeed = ulSeed*1103515245+12345;
+        const FLOAT fHill = (Sin(ix*3.0f)+Cos(iz*2.0f)+2.0f)*16000.0f;
+        puwHeightMap[ix+iz*pixHMapSize] = (UWORD)(fHill + ((ulSeed>>16)&0x3FF));
+      }
+    }
+    GFXColor *pacolOld    = (GFXColor*)AllocMemory(slSMapBytes);
+    GFXColor *pacolScalar = (GFXColor*)AllocMemory(slSMapBytes);
+    GFXColor *pacolSingle = (GFXColor*)AllocMemory(slSMapBytes);
+    GFXColor *pacolMulti  = (GFXColor*)AllocMemory(slSMapBytes);
+    memset(pacolOld,    0, slSMapBytes);
+    memset(pacolScalar, 0, slSMapBytes);
+    memset(pacolSingle, 0, slSMapBytes);
+    memset(pacolMulti,  0, slSMapBytes);
+
+    TerrainLightingInfo tli;
+    tli.tli_puwHeightMap = puwHeightMap;
+    tli.tli_pixHeightMapWidth = pixHMapSize;
+    tli.tli_vStretch = FLOAT3D(1.0f, 0.001f, 1.0f);
+    tli.tli_fSHDiffX = (FLOAT)pixHMapSize / pixSMapSize;
+    tli.tli_fSHDiffZ = (FLOAT)pixHMapSize / pixSMapSize;
+    tli.tli_pixShadowMapWidth = pixSMapSize;
+
+    // one sun and some point lights spread over the terrain
+    TerrainLight atl[ctPointLights+1];
+    atl[0].tl_bDirectional = TRUE;
+    atl[0].tl_vLightNormal = FLOAT3D(0.3f, 0.8f, 0.2f).Normalize();
+    atl[0].tl_colLight   = C_WHITE;
+    atl[0].tl_colAmbient = C_dGRAY;
+    atl[0].tl_bOverBrightning = FALSE;
+    for(INDEX il=1;il<=ctPointLights;il++) {
+      atl[il].tl_bDirectional = FALSE;
+      atl[il].tl_vPosition = FLOAT3D(pixHMapSize*il/(ctPointLights+1.0f), 80.0f, pixHMapSize*(ctPointLights+1-il)/(ctPointLights+1.0f));
+      atl[il].tl_colLight = C_ORANGE;
+      atl[il].tl_fHotSpot = pixHMapSize/8.0f;
+      atl[il].tl_fFallOff = pixHMapSize/4.0f;
+    }
+    const Rect rcAll(0, 0, pixSMapSize, pixSMapSize);
+
+    CTimerValue tvOld = _pTimer->GetHighPrecisionTimer();
+    tli.tli_pacolShadowMap = pacolOld;
+    for(INDEX il=0;il<=ctPointLights;il++) {
+      CalcTerrainLightPerTexel(tli, atl[il], rcAll);
+    }
+    CTimerValue tvScalar = _pTimer->GetHighPrecisionTimer();
+    _bScalarTerrainLighting = TRUE;
+    tli.tli_pacolShadowMap = pacolScalar;
+    for(INDEX il=0;il<=ctPointLights;il++) {
+      CalcTerrainLight(tli, atl[il], rcAll, FALSE);
+    }
+    _bScalarTerrainLighting = FALSE;
+    CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+    tli.tli_pacolShadowMap = pacolSingle;
+    for(INDEX il=0;il<=ctPointLights;il++) {
+      CalcTerrainLight(tli, atl[il], rcAll, FALSE);
+    }
+    CTimerValue tv1 = _pTimer->GetHighPrecisionTimer();
+    tli.tli_pacolShadowMap = pacolMulti;
+    for(INDEX il=0;il<=ctPointLights;il++) {
+      CalcTerrainLight(tli, atl[il], rcAll, TRUE);
+    }
+    CTimerValue tv2 = _pTimer->GetHighPrecisionTimer();
+
+    // row based scalar code must match the old loop exactly, SIMD may differ by one only on NEON
+    const INDEX ctTexels = pixSMapSize*pixSMapSize;
+    const SLONG slScalarDiff = ShadowMapDifference(pacolOld, pacolScalar, ctTexels);
+    const SLONG slSingleDiff = ShadowMapDifference(pacolOld, pacolSingle, ctTexels);
+    const SLONG slMultiDiff  = ShadowMapDifference(pacolOld, pacolMulti,  ctTexels);
+    CPrintF(TRANS("  %4dx%-4d: old %7.2f ms, scalar %7.2f ms, single %7.2f ms, multi %7.2f ms, max difference %d/%d/%d\n"),
+            pixSMapSize, pixSMapSize, (tvScalar-tvOld).GetSeconds()*1000.0, (tv0-tvScalar).GetSeconds()*1000.0,
+            (tv1-tv0).GetSeconds()*1000.0, (tv2-tv1).GetSeconds()*1000.0, slScalarDiff, slSingleDiff, slMultiDiff);
+
+    FreeMemory(pacolMulti);
+    FreeMemory(pacolSingle);
+    FreeMemory(pacolScalar);
+    FreeMemory(pacolOld);
+    FreeMemory(puwHeightMap);
+  }
+}
@@ -0,0 +1,888 @@
+/* Copyright (c) 2002-2012 Croteam Ltd.
+This program is free software; you can redistribute it and/or modify
+it under the terms of version 2 of the GNU General Public License as published by
+the Free Software Foundation
+
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA. */
+
+#include "StdH.h"
+
+#include <Engine/World/CookedWorld.h>
+#include <Engine/World/World.h>
+#include <Engine/Brushes/Brush.h>
+#include <Engine/Brushes/BrushTransformed.h>
+#include <Engine/Brushes/BrushArchive.h>
+#include <Engine/Base/Console.h>
+#include <Engine/Base/Translation.h>
+#include <Engine/Base/Stream.h>
+#include <Engine/Base/Memory.h>
+#include <Engine/Base/CRC.h>
+#include <Engine/Base/Shell.h>
+#include <Engine/Base/Timer.h>
+#include <Engine/Base/Relations.h>
+#include <Engine/Base/ReplaceFile.h>
+#include <Engine/Base/ProgressHook.h>
+#include <Engine/Base/ListIterator.inl>
+#include <Engine/Network/Network.h>
+#include <Engine/Templates/BSP.h>
+#include <Engine/Templates/BSP_internal.h>
+#include <Engine/Templates/StaticArray.cpp>
+#include <Engine/Templates/StaticStackArray.cpp>
+#include <Engine/Templates/DynamicArray.cpp>
+#include <Engine/Templates/DynamicStackArray.cpp>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+extern BOOL _bPortalSectorLinksPreLoaded;
+
+INDEX wld_bCookedBrushes = TRUE;  // keep parsed brushes of each world on disk for faster loading
+
+#define COOKEDWORLD_ID    (('C')|('W'<<8)|('L'<<16)|('D'<<24))
+#define BLOB_ALIGNMENT    16
+#define TEXTUREHASH_SIZE  256
+
+// size of one item in each blob
+static const SLONG _aslItemSize[CWB_COUNT] = {
+  sizeof(CCookedBrush),
+  sizeof(CCookedMip),
+  sizeof(CCookedSector),
+  sizeof(DOUBLE3D),
+  sizeof(DOUBLEplane3D),
+  sizeof(ULONG),
+  sizeof(CCookedPolygon),
+  sizeof(ULONG),
+  sizeof(ULONG),
+  sizeof(INDEX),
+  sizeof(CCookedBSPNode),
+  sizeof(CCookedShadowLayer),
+  sizeof(UBYTE),
+  sizeof(ULONG),
+  sizeof(ULONG),
+  sizeof(char),
+};
+
+
+// get cooked file name for a world
+static CTFileName CookedFileName( const CTFileName &fnmWorld)
+{
+  // different worlds with same name may exist in different directories
+  ULONG ulPathCRC;
+  CRC_Start( ulPathCRC);
+  CRC_AddBlock( ulPathCRC, (UBYTE*)(const char*)fnmWorld, strlen(fnmWorld));
+  CRC_Finish( ulPathCRC);
+  CTString strName;
+  strName.PrintF( "Temp\\Brushes_%s_%08X.cwb", (const char*)fnmWorld.FileName(), ulPathCRC);
+  return CTFileName(strName);
+}
+
+// checksum of all record sizes
+static ULONG LayoutCRC(void)
+{
+  ULONG ulCRC;
+  CRC_Start( ulCRC);
+  CRC_AddLONG( ulCRC, sizeof(CCookedWorldHeader));
+  for( INDEX iBlob=0; iBlob<CWB_COUNT; iBlob++) {
+    CRC_AddLONG( ulCRC, _aslItemSize[iBlob]);
+  }
+  CRC_Finish( ulCRC);
+  return ulCRC;
+}
+
+
+/*
+ * Cooking
+ */
+
+class CCookedWorldWriter {
+public:
+  CStaticStackArray<UBYTE> cww_aubBlobs[CWB_COUNT];
+  // textures already added (for sharing names)
+  CStaticStackArray<CTextureData *> cww_aptdTextures;
+  CStaticStackArray<INDEX> cww_aiTextureNext;
+  INDEX cww_aiTextureHash[TEXTUREHASH_SIZE];
+
+  CCookedWorldWriter(void);
+  // add items to a blob
+  inline void *Push( INDEX iBlob, INDEX ctItems) {
+    if( ctItems==0) return NULL;
+    return cww_aubBlobs[iBlob].Push( ctItems*_aslItemSize[iBlob]);
+  };
+  inline INDEX Count( INDEX iBlob) {
+    return cww_aubBlobs[iBlob].Count()/_aslItemSize[iBlob];
+  };
+  // add a string (returns its offset)
+  ULONG AddString( const CTString &str);
+  // add a texture (returns its index or -1 if none)
+  SLONG AddTexture( CTextureData *ptd);
+
+  void CookSector_t( CBrushSector &bsc);  // throw char *
+  void CookPolygon_t( CBrushSector &bsc, CBrushPolygon &bpo);  // throw char *
+  void Save_t( const CTFileName &fnmFile, const CCookedWorldHeader &cwhInfo);  // throw char *
+};
+
+
+CCookedWorldWriter::CCookedWorldWriter(void)
+{
+  for( INDEX iBlob=0; iBlob<CWB_COUNT; iBlob++) {
+    cww_aubBlobs[iBlob].SetAllocationStep(64*1024);
+  }
+  for( INDEX iBucket=0; iBucket<TEXTUREHASH_SIZE; iBucket++) {
+    cww_aiTextureHash[iBucket] = -1;
+  }
+  // empty string is always at start
+  cww_aubBlobs[CWB_STRINGS].Push() = 0;
+}
+
+
+ULONG CCookedWorldWriter::AddString( const CTString &str)
+{
+  const INDEX ctChars = strlen(str);
+  if( ctChars==0) return 0;
+  const ULONG ulOffset = cww_aubBlobs[CWB_STRINGS].Count();
+  memcpy( Push( CWB_STRINGS, ctChars+1), (const char*)str, ctChars+1);
+  return ulOffset;
+}
+
+
+SLONG CCookedWorldWriter::AddTexture( CTextureData *ptd)
+{
+  if( ptd==NULL) return -1;
+  const INDEX iBucket = (INDEX)(((size_t)ptd)>>4) & (TEXTUREHASH_SIZE-1);
+  for( INDEX iTexture=cww_aiTextureHash[iBucket]; iTexture>=0; iTexture=cww_aiTextureNext[iTexture]) {
+    if( cww_aptdTextures[iTexture]==ptd) return iTexture;
+  }
+  const INDEX iTexture = cww_aptdTextures.Count();
+  cww_aptdTextures.Push() = ptd;
+  cww_aiTextureNext.Push() = cww_aiTextureHash[iBucket];
+  cww_aiTextureHash[iBucket] = iTexture;
+  const ULONG ulName = AddString( ptd->GetName());
+  memcpy( Push( CWB_TEXTURES, 1), &ulName, sizeof(ulName));
+  return iTexture;
+}
+
+
+void CCookedWorldWriter::CookSector_t( CBrushSector &bsc)
+{
+  const INDEX ctVertices = bsc.bsc_abvxVertices.Count();
+  const INDEX ctPlanes   = bsc.bsc_abplPlanes.Count();
+  const INDEX ctEdges    = bsc.bsc_abedEdges.Count();
+  const INDEX ctPolygons = bsc.bsc_abpoPolygons.Count();
+  const INDEX ctNodes    = bsc.bsc_bspBSPTree.bt_abnNodes.Count();
+
+  CCookedSector cbs;
+  cbs.cbs_ulName      = AddString( bsc.bsc_strName);
+  cbs.cbs_colColor    = bsc.bsc_colColor;
+  cbs.cbs_colAmbient  = bsc.bsc_colAmbient;
+  cbs.cbs_ulFlags     = bsc.bsc_ulFlags;
+  cbs.cbs_ulFlags2    = bsc.bsc_ulFlags2;
+  cbs.cbs_ulVisFlags  = bsc.bsc_ulVisFlags;
+  cbs.cbs_ulTempFlags = bsc.bsc_ulTempFlags & (BSCTF_PRELOADEDBSP|BSCTF_PRELOADEDLINKS);
+  cbs.cbs_ctVertices  = ctVertices;
+  cbs.cbs_ctPlanes    = ctPlanes;
+  cbs.cbs_ctEdges     = ctEdges;
+  cbs.cbs_ctPolygons  = ctPolygons;
+  cbs.cbs_ctBSPNodes  = ctNodes;
+  cbs.cbs_ctLinks     = bsc.bsc_rdOtherSidePortals.Count();
+  memcpy( Push( CWB_SECTORS, 1), &cbs, sizeof(cbs));
+
+  DOUBLE3D *avd = (DOUBLE3D*)Push( CWB_VERTICES, ctVertices);
+  for( INDEX iVertex=0; iVertex<ctVertices; iVertex++) {
+    avd[iVertex] = bsc.bsc_abvxVertices[iVertex].bvx_vdPreciseRelative;
+  }
+  DOUBLEplane3D *apld = (DOUBLEplane3D*)Push( CWB_PLANES, ctPlanes);
+  for( INDEX iPlane=0; iPlane<ctPlanes; iPlane++) {
+    apld[iPlane] = bsc.bsc_abplPlanes[iPlane].bpl_pldPreciseRelative;
+  }
+  ULONG *aulEdges = (ULONG*)Push( CWB_EDGES, ctEdges*2);
+  for( INDEX iEdge=0; iEdge<ctEdges; iEdge++) {
+    const CBrushEdge &bed = bsc.bsc_abedEdges[iEdge];
+    aulEdges[iEdge*2+0] = bsc.bsc_abvxVertices.Index( bed.bed_pbvxVertex0);
+    aulEdges[iEdge*2+1] = bsc.bsc_abvxVertices.Index( bed.bed_pbvxVertex1);
+  }
+
+  for( INDEX iPolygon=0; iPolygon<ctPolygons; iPolygon++) {
+    CookPolygon_t( bsc, bsc.bsc_abpoPolygons[iPolygon]);
+  }
+
+  CStaticArray<BSPNode<DOUBLE, 3> > &abn = bsc.bsc_bspBSPTree.bt_abnNodes;
+  CCookedBSPNode *acbn = (CCookedBSPNode*)Push( CWB_BSPNODES, ctNodes);
+  for( INDEX iNode=0; iNode<ctNodes; iNode++) {
+    const BSPNode<DOUBLE, 3> &bn = abn[iNode];
+    CCookedBSPNode &cbn = acbn[iNode];
+    cbn.cbn_plPlane    = (const DOUBLEplane3D &)bn;
+    cbn.cbn_ulLocation = bn.bn_bnlLocation;
+    cbn.cbn_iFront     = (bn.bn_pbnFront==NULL) ? -1 : abn.Index( bn.bn_pbnFront);
+    cbn.cbn_iBack      = (bn.bn_pbnBack ==NULL) ? -1 : abn.Index( bn.bn_pbnBack);
+    cbn.cbn_ulPlaneTag = bn.bn_ulPlaneTag;
+  }
+
+  // portals that lead to this sector (by their index in world)
+  ULONG *aulLinks = (ULONG*)Push( CWB_LINKS, cbs.cbs_ctLinks);
+  INDEX iLink = 0;
+  {FOREACHSRCOFDST( bsc.bsc_rdOtherSidePortals, CBrushPolygon, bpo_rsOtherSideSectors, pbpo)
+    aulLinks[iLink++] = pbpo->bpo_iInWorld;
+  ENDFOR}
+}
+
+
+void CCookedWorldWriter::CookPolygon_t( CBrushSector &bsc, CBrushPolygon &bpo)
+{
+  CBrushShadowMap &bsm = bpo.bpo_smShadowMap;
+  const INDEX ctEdges     = bpo.bpo_abpePolygonEdges.Count();
+  const INDEX ctTriangles = bpo.bpo_apbvxTriangleVertices.Count();
+  const INDEX ctElements  = bpo.bpo_aiTriangleElements.Count();
+
+  CCookedPolygon cpo;
+  cpo.cpo_iPlane    = bsc.bsc_abplPlanes.Index( bpo.bpo_pbplPlane);
+  cpo.cpo_colColor  = bpo.bpo_colColor;
+  cpo.cpo_ulFlags   = bpo.bpo_ulFlags;
+  cpo.cpo_colShadow = bpo.bpo_colShadow;
+  for( INDEX iTexture=0; iTexture<3; iTexture++) {
+    CBrushPolygonTexture &bpt = bpo.bpo_abptTextures[iTexture];
+    CCookedTexture &cpt = cpo.cpo_actTextures[iTexture];
+    cpt.cpt_iTexture  = AddTexture( (CTextureData*)bpt.bpt_toTexture.GetData());
+    cpt.cpt_mdMapping = bpt.bpt_mdMapping;
+    cpt.cpt_ubScroll  = bpt.bpt.s.bpt_ubScroll;
+    cpt.cpt_ubBlend   = bpt.bpt.s.bpt_ubBlend;
+    cpt.cpt_ubFlags   = bpt.bpt.s.bpt_ubFlags;
+    cpt.cpt_ubDummy   = bpt.bpt.s.bpt_ubDummy;
+    cpt.cpt_colColor  = bpt.bpt.s.bpt_colColor;
+  }
+  cpo.cpo_bppProperties      = bpo.bpo_bppProperties;
+  cpo.cpo_ctEdges            = ctEdges;
+  cpo.cpo_ctTriangleVertices = ctTriangles;
+  cpo.cpo_ctElements         = ctElements;
+  cpo.cpo_ulShadowFlags      = bsm.sm_ulFlags;
+  cpo.cpo_iShadowFirstMip    = bsm.sm_iFirstMipLevel;
+  cpo.cpo_mexShadowOffsetX   = bsm.sm_mexOffsetX;
+  cpo.cpo_mexShadowOffsetY   = bsm.sm_mexOffsetY;
+  cpo.cpo_mexShadowWidth     = bsm.sm_mexWidth;
+  cpo.cpo_mexShadowHeight    = bsm.sm_mexHeight;
+  cpo.cpo_pixPolygonSizeU    = bsm.sm_pixPolygonSizeU;
+  cpo.cpo_pixPolygonSizeV    = bsm.sm_pixPolygonSizeV;
+  cpo.cpo_ctLayers           = bsm.bsm_lhLayers.Count();
+  cpo.cpo_bUncalculated      = bsm.bsm_lnInUncalculatedShadowMaps.IsLinked();
+  memcpy( Push( CWB_POLYGONS, 1), &cpo, sizeof(cpo));
+
+  ULONG *aulEdges = (ULONG*)Push( CWB_POLYGONEDGES, ctEdges);
+  for( INDEX iEdge=0; iEdge<ctEdges; iEdge++) {
+    const CBrushPolygonEdge &bpe = bpo.bpo_abpePolygonEdges[iEdge];
+    aulEdges[iEdge] = bsc.bsc_abedEdges.Index( bpe.bpe_pbedEdge);
+    if( bpe.bpe_bReverse) aulEdges[iEdge] |= 0x80000000;
+  }
+  ULONG *aulTriangles = (ULONG*)Push( CWB_TRIANGLEVERTICES, ctTriangles);
+  for( INDEX iVertex=0; iVertex<ctTriangles; iVertex++) {
+    aulTriangles[iVertex] = bsc.bsc_abvxVertices.Index( bpo.bpo_apbvxTriangleVertices[iVertex]);
+  }
+  if( ctElements>0) {
+    memcpy( Push( CWB_ELEMENTS, ctElements), &bpo.bpo_aiTriangleElements[0], ctElements*sizeof(INDEX));
+  }
+
+  FOREACHINLIST( CBrushShadowLayer, bsl_lnInShadowMap, bsm.bsm_lhLayers, itbsl) {
+    const CBrushShadowLayer &bsl = *itbsl;
+    CCookedShadowLayer csl;
+    csl.csl_ulFlags        = bsl.bsl_ulFlags;
+    csl.csl_slSizeInPixels = bsl.bsl_slSizeInPixels;
+    csl.csl_ulMaskSize     = 0;
+    if( bsl.bsl_pubLayer!=NULL) {
+      // masks of layers from before mip-mapped shadows have unknown size
+      if( bsl.bsl_slSizeInPixels<=0) ThrowF_t( TRANS("obsolete shadow layers"));
+      csl.csl_ulMaskSize = (bsl.bsl_slSizeInPixels+7)/8;
+      memcpy( Push( CWB_MASKS, csl.csl_ulMaskSize), bsl.bsl_pubLayer, csl.csl_ulMaskSize);
+    }
+    csl.csl_pixMinU  = bsl.bsl_pixMinU;
+    csl.csl_pixMinV  = bsl.bsl_pixMinV;
+    csl.csl_pixSizeU = bsl.bsl_pixSizeU;
+    csl.csl_pixSizeV = bsl.bsl_pixSizeV;
+    memcpy( Push( CWB_LAYERS, 1), &csl, sizeof(csl));
+  }
+}
+
+
+void CCookedWorldWriter::Save_t( const CTFileName &fnmFile, const CCookedWorldHeader &cwhInfo)
+{
+  // lay out blobs after the header
+  CCookedWorldHeader cwh = cwhInfo;
+  ULONG ulOffset = sizeof(CCookedWorldHeader);
+  for( INDEX iBlob=0; iBlob<CWB_COUNT; iBlob++) {
+    ulOffset = (ulOffset+BLOB_ALIGNMENT-1) & ~(BLOB_ALIGNMENT-1);
+    cwh.cwh_acbBlobs[iBlob].cb_ulOffset = ulOffset;
+    cwh.cwh_acbBlobs[iBlob].cb_ctItems  = Count(iBlob);
+    ulOffset += cww_aubBlobs[iBlob].Count();
+  }
+
+  // write to temporary file, so that a partially written one is never mapped
+  CTFileName fnmTemp = fnmFile.NoExt()+".tmp";
+  CTFileStream strmFile;
+  strmFile.Create_t( fnmTemp);
+  strmFile.Write_t( &cwh, sizeof(cwh));
+  static const UBYTE aubPadding[BLOB_ALIGNMENT] = {0};
+  ULONG ulWritten = sizeof(CCookedWorldHeader);
+  for( INDEX iBlob=0; iBlob<CWB_COUNT; iBlob++) {
+    const CCookedBlob &cb = cwh.cwh_acbBlobs[iBlob];
+    if( cb.cb_ulOffset>ulWritten) strmFile.Write_t( aubPadding, cb.cb_ulOffset-ulWritten);
+    const INDEX ctBytes = cww_aubBlobs[iBlob].Count();
+    if( ctBytes>0) strmFile.Write_t( &cww_aubBlobs[iBlob][0], ctBytes);
+    ulWritten = cb.cb_ulOffset + ctBytes;
+  }
+  strmFile.Close();
+
+  CTFileName fnmTempExpanded, fnmFileExpanded;
+  ExpandFilePath( EFP_WRITE, fnmTemp, fnmTempExpanded);
+  ExpandFilePath( EFP_WRITE, fnmFile, fnmFileExpanded);
+  if( rename( fnmTempExpanded, fnmFileExpanded)!=0) {
+    ThrowF_t( TRANS("Cannot rename '%s' to '%s'"), (const char*)fnmTemp, (const char*)fnmFile);
+  }
+}
+
+
+// cook brushes that were just read from raw world file
+void WriteCookedBrushes( CWorld *pwo, ULONG ulWorldCRC, SLONG slRawStart, SLONG slRawEnd)
+{
+  if( !wld_bCookedBrushes || pwo->wo_fnmFileName=="") return;
+
+  CBrushArchive &ba = pwo->wo_baBrushes;
+  ba.MakeIndices();
+  try {
+    CCookedWorldWriter cww;
+    FOREACHINDYNAMICARRAY( ba.ba_abrBrushes, CBrush3D, itbr) {
+      CCookedBrush &cbr = *(CCookedBrush*)cww.Push( CWB_BRUSHES, 1);
+      cbr.cbr_ctMips = itbr->br_lhBrushMips.Count();
+      FOREACHINLIST( CBrushMip, bm_lnInBrush, itbr->br_lhBrushMips, itbm) {
+        CCookedMip &cbm = *(CCookedMip*)cww.Push( CWB_MIPS, 1);
+        cbm.cbm_fMaxDistance = itbm->bm_fMaxDistance;
+        cbm.cbm_ctSectors = itbm->bm_abscSectors.Count();
+        FOREACHINDYNAMICARRAY( itbm->bm_abscSectors, CBrushSector, itbsc) {
+          cww.CookSector_t( *itbsc);
+        }
+      }
+    }
+    CCookedWorldHeader cwh;
+    memset( &cwh, 0, sizeof(cwh));
+    cwh.cwh_ulID       = COOKEDWORLD_ID;
+    cwh.cwh_ulVersion  = COOKEDWORLD_VERSION;
+    cwh.cwh_ulLayout   = LayoutCRC();
+    cwh.cwh_ulWorldCRC = ulWorldCRC;
+    cwh.cwh_slRawStart = slRawStart;
+    cwh.cwh_slRawEnd   = slRawEnd;
+    cwh.cwh_ulFlags    = _bPortalSectorLinksPreLoaded ? CWHF_PORTALLINKS : 0;
+    cww.Save_t( CookedFileName( pwo->wo_fnmFileName), cwh);
+  } catch( const char *strError) {
+    CPrintF( TRANS("Cannot cook brushes of '%s': %s\n"), (const char*)pwo->wo_fnmFileName, strError);
+  }
+}
+
+
+/*
+ * Loading
+ */
+
+// cooked file mapped in memory
+class CCookedWorldFile {
+public:
+  UBYTE *cwf_pubFile;
+  SLONG  cwf_slSize;
+
+  CCookedWorldFile(void) { cwf_pubFile = NULL; cwf_slSize = 0; };
+  ~CCookedWorldFile(void) { if( cwf_pubFile!=NULL) munmap( cwf_pubFile, cwf_slSize); };
+
+  BOOL Map( const CTFileName &fnmFile);
+  // check that the file was made from this world file at this position
+  BOOL IsValidFor( ULONG ulWorldCRC, SLONG slRawStart, SLONG slRawSize) const;
+
+  inline const CCookedWorldHeader &Header(void) const {
+    return *(const CCookedWorldHeader*)cwf_pubFile;
+  };
+  inline const void *Blob( INDEX iBlob) const {
+    return cwf_pubFile + Header().cwh_acbBlobs[iBlob].cb_ulOffset;
+  };
+  inline INDEX Count( INDEX iBlob) const {
+    return Header().cwh_acbBlobs[iBlob].cb_ctItems;
+  };
+};
+
+
+BOOL CCookedWorldFile::Map( const CTFileName &fnmFile)
+{
+  CTFileName fnmExpanded;
+  if( ExpandFilePath( EFP_READ|EFP_NOZIPS, fnmFile, fnmExpanded)!=EFP_FILE) return FALSE;
+  int iFile = open( fnmExpanded, O_RDONLY);
+  if( iFile<0) return FALSE;
+  struct stat stFile;
+  if( fstat( iFile, &stFile)==0 && stFile.st_size>=(off_t)sizeof(CCookedWorldHeader)) {
+    void *pvFile = mmap( NULL, stFile.st_size, PROT_READ, MAP_PRIVATE, iFile, 0);
+    if( pvFile!=MAP_FAILED) {
+      cwf_pubFile = (UBYTE*)pvFile;
+      cwf_slSize = stFile.st_size;
+    }
+  }
+  close( iFile);
+  return cwf_pubFile!=NULL;
+}
+
+
+BOOL CCookedWorldFile::IsValidFor( ULONG ulWorldCRC, SLONG slRawStart, SLONG slRawSize) const
+{
+  const CCookedWorldHeader &cwh = Header();
+  if( cwh.cwh_ulID!=COOKEDWORLD_ID || cwh.cwh_ulVersion!=COOKEDWORLD_VERSION
+   || cwh.cwh_ulLayout!=LayoutCRC() || cwh.cwh_ulWorldCRC!=ulWorldCRC
+   || cwh.cwh_slRawStart!=slRawStart || cwh.cwh_slRawEnd<slRawStart || cwh.cwh_slRawEnd>slRawSize) {
+    return FALSE;
+  }
+  // all blobs must be inside of file
+  for( INDEX iBlob=0; iBlob<CWB_COUNT; iBlob++) {
+    const CCookedBlob &cb = cwh.cwh_acbBlobs[iBlob];
+    if( (cb.cb_ulOffset&(BLOB_ALIGNMENT-1)) || cb.cb_ulOffset<sizeof(CCookedWorldHeader)
+     || cb.cb_ulOffset>(ULONG)cwf_slSize || cb.cb_ctItems>(cwf_slSize-cb.cb_ulOffset)/_aslItemSize[iBlob]) {
+      return FALSE;
+    }
+  }
+  // strings must be terminated
+  const INDEX ctChars = Count(CWB_STRINGS);
+  if( ctChars==0 || ((const char*)Blob(CWB_STRINGS))[ctChars-1]!=0) return FALSE;
+
+  // counts in records must add up to sizes of blobs (summed in 64 bits, so they cannot wrap around)
+  __int64 slMips=0, slSectors=0, slVertices=0, slPlanes=0, slEdges=0, slPolygons=0, slNodes=0, slLinks=0;
+  __int64 slPolygonEdges=0, slTriangles=0, slElements=0, slLayers=0, slMasks=0;
+  const CCookedBrush *acbr = (const CCookedBrush*)Blob(CWB_BRUSHES);
+  for( INDEX iBrush=0; iBrush<Count(CWB_BRUSHES); iBrush++) slMips += acbr[iBrush].cbr_ctMips;
+  const CCookedMip *acbm = (const CCookedMip*)Blob(CWB_MIPS);
+  for( INDEX iMip=0; iMip<Count(CWB_MIPS); iMip++) slSectors += acbm[iMip].cbm_ctSectors;
+  const CCookedSector *acbs = (const CCookedSector*)Blob(CWB_SECTORS);
+  for( INDEX iSector=0; iSector<Count(CWB_SECTORS); iSector++) {
+    const CCookedSector &cbs = acbs[iSector];
+    if( cbs.cbs_ulName>=(ULONG)ctChars) return FALSE;
+    slVertices += cbs.cbs_ctVertices;
+    slPlanes   += cbs.cbs_ctPlanes;
+    slEdges    += cbs.cbs_ctEdges*2;
+    slPolygons += cbs.cbs_ctPolygons;
+    slNodes    += cbs.cbs_ctBSPNodes;
+    slLinks    += cbs.cbs_ctLinks;
+  }
+  const CCookedPolygon *acpo = (const CCookedPolygon*)Blob(CWB_POLYGONS);
+  for( INDEX iPolygon=0; iPolygon<Count(CWB_POLYGONS); iPolygon++) {
+    const CCookedPolygon &cpo = acpo[iPolygon];
+    for( INDEX iTexture=0; iTexture<3; iTexture++) {
+      if( cpo.cpo_actTextures[iTexture].cpt_iTexture>=Count(CWB_TEXTURES)) return FALSE;
+    }
+    slPolygonEdges += cpo.cpo_ctEdges;
+    slTriangles    += cpo.cpo_ctTriangleVertices;
+    slElements     += cpo.cpo_ctElements;
+    slLayers       += cpo.cpo_ctLayers;
+  }
+  const CCookedShadowLayer *acsl = (const CCookedShadowLayer*)Blob(CWB_LAYERS);
+  for( INDEX iLayer=0; iLayer<Count(CWB_LAYERS); iLayer++) {
+    // masks are read for all pixels of the layer
+    const CCookedShadowLayer &csl = acsl[iLayer];
+    if( csl.csl_ulMaskSize!=0 && (csl.csl_slSizeInPixels<=0 || csl.csl_ulMaskSize!=ULONG(csl.csl_slSizeInPixels+7)/8)) return FALSE;
+    slMasks += csl.csl_ulMaskSize;
+  }
+  const ULONG *aulTextures = (const ULONG*)Blob(CWB_TEXTURES);
+  for( INDEX iTexture=0; iTexture<Count(CWB_TEXTURES); iTexture++) {
+    if( aulTextures[iTexture]>=(ULONG)ctChars) return FALSE;
+  }
+  if( slMips!=Count(CWB_MIPS) || slSectors!=Count(CWB_SECTORS)
+   || slVertices!=Count(CWB_VERTICES) || slPlanes!=Count(CWB_PLANES) || slEdges!=Count(CWB_EDGES)
+   || slPolygons!=Count(CWB_POLYGONS) || slNodes!=Count(CWB_BSPNODES) || slLinks!=Count(CWB_LINKS)
+   || slPolygonEdges!=Count(CWB_POLYGONEDGES) || slTriangles!=Count(CWB_TRIANGLEVERTICES)
+   || slElements!=Count(CWB_ELEMENTS) || slLayers!=Count(CWB_LAYERS) || slMasks!=Count(CWB_MASKS)) {
+    return FALSE;
+  }
+
+  // all indices must point inside of their sector or polygon (they are used without checking)
+  const ULONG *aulEdges     = (const ULONG*)Blob(CWB_EDGES);
+  const ULONG *aulPolyEdges = (const ULONG*)Blob(CWB_POLYGONEDGES);
+  const ULONG *aulTriangles = (const ULONG*)Blob(CWB_TRIANGLEVERTICES);
+  const INDEX *aiElements   = (const INDEX*)Blob(CWB_ELEMENTS);
+  const CCookedBSPNode *acbn = (const CCookedBSPNode*)Blob(CWB_BSPNODES);
+  const ULONG *aulLinks     = (const ULONG*)Blob(CWB_LINKS);
+  const ULONG ctAllPolygons = Count(CWB_POLYGONS);
+  for( INDEX iSector=0; iSector<Count(CWB_SECTORS); iSector++) {
+    const CCookedSector &cbs = acbs[iSector];
+    for( ULONG iEdge=0; iEdge<cbs.cbs_ctEdges*2; iEdge++) {
+      if( *aulEdges++>=cbs.cbs_ctVertices) return FALSE;
+    }
+    for( ULONG iPolygon=0; iPolygon<cbs.cbs_ctPolygons; iPolygon++) {
+      const CCookedPolygon &cpo = *acpo++;
+      if( cpo.cpo_iPlane>=cbs.cbs_ctPlanes) return FALSE;
+      for( ULONG iEdge=0; iEdge<cpo.cpo_ctEdges; iEdge++) {
+        if( (*aulPolyEdges++&~0x80000000)>=cbs.cbs_ctEdges) return FALSE;
+      }
+      for( ULONG iVertex=0; iVertex<cpo.cpo_ctTriangleVertices; iVertex++) {
+        if( *aulTriangles++>=cbs.cbs_ctVertices) return FALSE;
+      }
+      for( ULONG iElement=0; iElement<cpo.cpo_ctElements; iElement++) {
+        if( (ULONG)*aiElements++>=cpo.cpo_ctTriangleVertices) return FALSE;
+      }
+    }
+    for( ULONG iNode=0; iNode<cbs.cbs_ctBSPNodes; iNode++) {
+      const CCookedBSPNode &cbn = *acbn++;
+      if( cbn.cbn_iFront<-1 || cbn.cbn_iFront>=(SLONG)cbs.cbs_ctBSPNodes
+       || cbn.cbn_iBack <-1 || cbn.cbn_iBack >=(SLONG)cbs.cbs_ctBSPNodes) return FALSE;
+    }
+    for( ULONG iLink=0; iLink<cbs.cbs_ctLinks; iLink++) {
+      if( *aulLinks++>=ctAllPolygons) return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+
+// reading positions in all blobs
+class CCookedWorldReader {
+public:
+  const CCookedWorldFile &cwr_cwf;
+  const char *cwr_strStrings;
+  CStaticArray<CTextureObject> cwr_atoTextures;
+  INDEX cwr_aiNext[CWB_COUNT];
+
+  CCookedWorldReader( const CCookedWorldFile &cwf) : cwr_cwf(cwf) {
+    cwr_strStrings = (const char*)cwf.Blob(CWB_STRINGS);
+    for( INDEX iBlob=0; iBlob<CWB_COUNT; iBlob++) cwr_aiNext[iBlob] = 0;
+  };
+  // get next items of a blob
+  inline const void *Next( INDEX iBlob, INDEX ctItems) {
+    const UBYTE *pubItems = (const UBYTE*)cwr_cwf.Blob(iBlob) + cwr_aiNext[iBlob]*_aslItemSize[iBlob];
+    cwr_aiNext[iBlob] += ctItems;
+    ASSERT( cwr_aiNext[iBlob]<=cwr_cwf.Count(iBlob));
+    return pubItems;
+  };
+
+  void LoadTextures_t(void);  // throw char *
+  void ReadSector_t( CBrushSector &bsc);  // throw char *
+  void ReadPolygon_t( CBrushSector &bsc, CBrushPolygon &bpo);
+};
+
+
+void CCookedWorldReader::LoadTextures_t(void)
+{
+  const INDEX ctTextures = cwr_cwf.Count(CWB_TEXTURES);
+  if( ctTextures==0) return;
+  cwr_atoTextures.New(ctTextures);
+  const ULONG *aulNames = (const ULONG*)cwr_cwf.Blob(CWB_TEXTURES);
+  for( INDEX iTexture=0; iTexture<ctTextures; iTexture++) {
+    CTFileName fnmTexture = CTString( cwr_strStrings+aulNames[iTexture]);
+    CTextureObject &to = cwr_atoTextures[iTexture];
+    SetTextureWithPossibleReplacing_t( to, fnmTexture);
+    // gather CRC of that texture
+    if( to.GetData()!=NULL) to.GetData()->AddToCRCTable();
+  }
+}
+
+
+void CCookedWorldReader::ReadSector_t( CBrushSector &bsc)
+{
+  const CCookedSector &cbs = *(const CCookedSector*)Next( CWB_SECTORS, 1);
+  bsc.bsc_strName     = cwr_strStrings+cbs.cbs_ulName;
+  bsc.bsc_colColor    = cbs.cbs_colColor;
+  bsc.bsc_colAmbient  = cbs.cbs_colAmbient;
+  bsc.bsc_ulFlags     = cbs.cbs_ulFlags;
+  bsc.bsc_ulFlags2    = cbs.cbs_ulFlags2;
+  bsc.bsc_ulVisFlags  = cbs.cbs_ulVisFlags;
+  // volume was calculated and polygons triangulated when cooking
+  bsc.bsc_ulTempFlags = cbs.cbs_ulTempFlags;
+
+  const INDEX ctVertices = cbs.cbs_ctVertices;
+  bsc.bsc_abvxVertices.New(ctVertices);
+  bsc.bsc_awvxVertices.New(ctVertices);
+  const DOUBLE3D *avd = (const DOUBLE3D*)Next( CWB_VERTICES, ctVertices);
+  for( INDEX iVertex=0; iVertex<ctVertices; iVertex++) {
+    CBrushVertex &bvx = bsc.bsc_abvxVertices[iVertex];
+    bvx.bvx_vdPreciseRelative = avd[iVertex];
+    bvx.bvx_pbscSector = &bsc;
+  }
+
+  const INDEX ctPlanes = cbs.cbs_ctPlanes;
+  bsc.bsc_abplPlanes.New(ctPlanes);
+  bsc.bsc_awplPlanes.New(ctPlanes);
+  const DOUBLEplane3D *apld = (const DOUBLEplane3D*)Next( CWB_PLANES, ctPlanes);
+  for( INDEX iPlane=0; iPlane<ctPlanes; iPlane++) {
+    bsc.bsc_abplPlanes[iPlane].bpl_pldPreciseRelative = apld[iPlane];
+  }
+
+  const INDEX ctEdges = cbs.cbs_ctEdges;
+  bsc.bsc_abedEdges.New(ctEdges);
+  bsc.bsc_awedEdges.New(ctEdges);
+  const ULONG *aulEdges = (const ULONG*)Next( CWB_EDGES, ctEdges*2);
+  for( INDEX iEdge=0; iEdge<ctEdges; iEdge++) {
+    CBrushEdge &bed = bsc.bsc_abedEdges[iEdge];
+    CWorkingEdge &wed = bsc.bsc_awedEdges[iEdge];
+    const INDEX iVertex0 = aulEdges[iEdge*2+0];
+    const INDEX iVertex1 = aulEdges[iEdge*2+1];
+    ASSERT( iVertex0<ctVertices && iVertex1<ctVertices);
+    bed.bed_pbvxVertex0 = &bsc.bsc_abvxVertices[iVertex0];
+    bed.bed_pbvxVertex1 = &bsc.bsc_abvxVertices[iVertex1];
+    bed.bed_pwedWorking = &wed;
+    wed.wed_iwvx0 = iVertex0;
+    wed.wed_iwvx1 = iVertex1;
+  }
+
+  const INDEX ctPolygons = cbs.cbs_ctPolygons;
+  bsc.bsc_abpoPolygons.New(ctPolygons);
+  for( INDEX iPolygon=0; iPolygon<ctPolygons; iPolygon++) {
+    ReadPolygon_t( bsc, bsc.bsc_abpoPolygons[iPolygon]);
+  }
+
+  const INDEX ctNodes = cbs.cbs_ctBSPNodes;
+  DOUBLEbsptree3D &bt = bsc.bsc_bspBSPTree;
+  bt.Destroy();
+  bt.bt_pbnRoot = NULL;
+  if( ctNodes>0) {
+    bt.bt_abnNodes.New(ctNodes);
+    const CCookedBSPNode *acbn = (const CCookedBSPNode*)Next( CWB_BSPNODES, ctNodes);
+    for( INDEX iNode=0; iNode<ctNodes; iNode++) {
+      const CCookedBSPNode &cbn = acbn[iNode];
+      BSPNode<DOUBLE, 3> &bn = bt.bt_abnNodes[iNode];
+      (DOUBLEplane3D &)bn = cbn.cbn_plPlane;
+      bn.bn_bnlLocation = (BSPNodeLocation)cbn.cbn_ulLocation;
+      bn.bn_pbnFront = (cbn.cbn_iFront<0) ? NULL : &bt.bt_abnNodes[cbn.cbn_iFront];
+      bn.bn_pbnBack  = (cbn.cbn_iBack <0) ? NULL : &bt.bt_abnNodes[cbn.cbn_iBack];
+      bn.bn_ulPlaneTag = cbn.cbn_ulPlaneTag;
+    }
+    bt.bt_pbnRoot = &bt.bt_abnNodes[0];
+  }
+}
+
+
+void CCookedWorldReader::ReadPolygon_t( CBrushSector &bsc, CBrushPolygon &bpo)
+{
+  const CCookedPolygon &cpo = *(const CCookedPolygon*)Next( CWB_POLYGONS, 1);
+  ASSERT( cpo.cpo_iPlane<(ULONG)bsc.bsc_abplPlanes.Count());
+  bpo.bpo_pbplPlane = &bsc.bsc_abplPlanes[cpo.cpo_iPlane];
+  bpo.bpo_colColor  = cpo.cpo_colColor;
+  bpo.bpo_ulFlags   = cpo.cpo_ulFlags;
+  bpo.bpo_colShadow = cpo.cpo_colShadow;
+  bpo.bpo_pbscSector = &bsc;
+  for( INDEX iTexture=0; iTexture<3; iTexture++) {
+    const CCookedTexture &cpt = cpo.cpo_actTextures[iTexture];
+    CBrushPolygonTexture &bpt = bpo.bpo_abptTextures[iTexture];
+    if( cpt.cpt_iTexture>=0) bpt.bpt_toTexture.SetData( cwr_atoTextures[cpt.cpt_iTexture].GetData());
+    bpt.bpt_mdMapping = cpt.cpt_mdMapping;
+    bpt.bpt.s.bpt_ubScroll = cpt.cpt_ubScroll;
+    bpt.bpt.s.bpt_ubBlend  = cpt.cpt_ubBlend;
+    bpt.bpt.s.bpt_ubFlags  = cpt.cpt_ubFlags;
+    bpt.bpt.s.bpt_ubDummy  = cpt.cpt_ubDummy;
+    bpt.bpt.s.bpt_colColor = cpt.cpt_colColor;
+  }
+  bpo.bpo_bppProperties = cpo.cpo_bppProperties;
+
+  const INDEX ctEdges = cpo.cpo_ctEdges;
+  bpo.bpo_abpePolygonEdges.New(ctEdges);
+  const ULONG *aulEdges = (const ULONG*)Next( CWB_POLYGONEDGES, ctEdges);
+  for( INDEX iEdge=0; iEdge<ctEdges; iEdge++) {
+    CBrushPolygonEdge &bpe = bpo.bpo_abpePolygonEdges[iEdge];
+    bpe.bpe_bReverse = (aulEdges[iEdge]&0x80000000) ? TRUE : FALSE;
+    bpe.bpe_pbedEdge = &bsc.bsc_abedEdges[aulEdges[iEdge]&~0x80000000];
+  }
+
+  const INDEX ctTriangles = cpo.cpo_ctTriangleVertices;
+  bpo.bpo_apbvxTriangleVertices.New(ctTriangles);
+  const ULONG *aulTriangles = (const ULONG*)Next( CWB_TRIANGLEVERTICES, ctTriangles);
+  for( INDEX iVertex=0; iVertex<ctTriangles; iVertex++) {
+    bpo.bpo_apbvxTriangleVertices[iVertex] = &bsc.bsc_abvxVertices[aulTriangles[iVertex]];
+  }
+
+  const INDEX ctElements = cpo.cpo_ctElements;
+  bpo.bpo_aiTriangleElements.New(ctElements);
+  if( ctElements>0) {
+    memcpy( &bpo.bpo_aiTriangleElements[0], Next( CWB_ELEMENTS, ctElements), ctElements*sizeof(INDEX));
+  }
+
+  // shadow map and its layers (lights are set while loading them)
+  CBrushShadowMap &bsm = bpo.bpo_smShadowMap;
+  bsm.sm_ulFlags         = cpo.cpo_ulShadowFlags;
+  bsm.sm_iFirstMipLevel  = cpo.cpo_iShadowFirstMip;
+  bsm.sm_mexOffsetX      = cpo.cpo_mexShadowOffsetX;
+  bsm.sm_mexOffsetY      = cpo.cpo_mexShadowOffsetY;
+  bsm.sm_mexWidth        = cpo.cpo_mexShadowWidth;
+  bsm.sm_mexHeight       = cpo.cpo_mexShadowHeight;
+  bsm.sm_pixPolygonSizeU = cpo.cpo_pixPolygonSizeU;
+  bsm.sm_pixPolygonSizeV = cpo.cpo_pixPolygonSizeV;
+  if( bsm.sm_mexWidth>0 && bsm.sm_mexHeight>0) {
+    bsm.sm_iLastMipLevel = FastLog2( Min( bsm.sm_mexWidth, bsm.sm_mexHeight));
+  }
+  const CCookedShadowLayer *acsl = (const CCookedShadowLayer*)Next( CWB_LAYERS, cpo.cpo_ctLayers);
+  for( ULONG iLayer=0; iLayer<cpo.cpo_ctLayers; iLayer++) {
+    const CCookedShadowLayer &csl = acsl[iLayer];
+    CBrushShadowLayer *pbsl = new CBrushShadowLayer;
+    pbsl->bsl_colLastAnim = 0x12345678;
+    bsm.bsm_lhLayers.AddTail( pbsl->bsl_lnInShadowMap);
+    pbsl->bsl_pbsmShadowMap  = &bsm;
+    pbsl->bsl_plsLightSource = NULL;
+    pbsl->bsl_ulFlags        = csl.csl_ulFlags;
+    pbsl->bsl_slSizeInPixels = csl.csl_slSizeInPixels;
+    pbsl->bsl_pubLayer = NULL;
+    if( csl.csl_ulMaskSize>0) {
+      pbsl->bsl_pubLayer = (UBYTE *)AllocMemory( csl.csl_ulMaskSize);
+      memcpy( pbsl->bsl_pubLayer, Next( CWB_MASKS, csl.csl_ulMaskSize), csl.csl_ulMaskSize);
+    }
+    pbsl->bsl_pixMinU  = csl.csl_pixMinU;
+    pbsl->bsl_pixMinV  = csl.csl_pixMinV;
+    pbsl->bsl_pixSizeU = csl.csl_pixSizeU;
+    pbsl->bsl_pixSizeV = csl.csl_pixSizeV;
+  }
+  if( cpo.cpo_bUncalculated) {
+    extern CWorld *_pwoCurrentLoading;  // world that is currently loading
+    _pwoCurrentLoading->wo_baBrushes.ba_lhUncalculatedShadowMaps.AddTail( bsm.bsm_lnInUncalculatedShadowMaps);
+  }
+}
+
+
+// read brushes of the world from cooked file (returns FALSE if raw brushes must be read)
+BOOL ReadCookedBrushes_t( CWorld *pwo, CTStream *pstrm, ULONG ulWorldCRC)
+{
+  if( !wld_bCookedBrushes || pwo->wo_fnmFileName=="") return FALSE;
+  CCookedWorldFile cwf;
+  if( !cwf.Map( CookedFileName( pwo->wo_fnmFileName))) return FALSE;
+  if( !cwf.IsValidFor( ulWorldCRC, pstrm->GetPos_t(), pstrm->GetStreamSize())) return FALSE;
+
+  CBrushArchive &ba = pwo->wo_baBrushes;
+  CCookedWorldReader cwr(cwf);
+  cwr.LoadTextures_t();
+
+  const INDEX ctBrushes = cwf.Count(CWB_BRUSHES);
+  if( ctBrushes>0) {
+    CBrush3D *abrBrushes = ba.ba_abrBrushes.New(ctBrushes);
+    for( INDEX iBrush=0; iBrush<ctBrushes; iBrush++) {
+      CallProgressHook_t( FLOAT(iBrush)/ctBrushes);
+      CBrush3D &br = abrBrushes[iBrush];
+      const CCookedBrush &cbr = *(const CCookedBrush*)cwr.Next( CWB_BRUSHES, 1);
+      for( ULONG iMip=0; iMip<cbr.cbr_ctMips; iMip++) {
+        const CCookedMip &cbm = *(const CCookedMip*)cwr.Next( CWB_MIPS, 1);
+        CBrushMip *pbm = new CBrushMip;
+        br.br_lhBrushMips.AddTail( pbm->bm_lnInBrush);
+        pbm->bm_pbrBrush = &br;
+        pbm->bm_fMaxDistance = cbm.cbm_fMaxDistance;
+        pbm->bm_abscSectors.New( cbm.cbm_ctSectors);
+        pbm->bm_abscSectors.Lock();
+        for( ULONG iSector=0; iSector<cbm.cbm_ctSectors; iSector++) {
+          CBrushSector &bsc = pbm->bm_abscSectors[iSector];
+          bsc.bsc_pbmBrushMip = pbm;
+          cwr.ReadSector_t( bsc);
+        }
+        pbm->bm_abscSectors.Unlock();
+      }
+    }
+  }
+
+  // portal-sector links (sectors and polygons are in same order as in world)
+  _bPortalSectorLinksPreLoaded = FALSE;
+  ba.MakeIndices();
+  const CCookedSector *acbs = (const CCookedSector*)cwf.Blob(CWB_SECTORS);
+  for( INDEX iSector=0; iSector<cwf.Count(CWB_SECTORS); iSector++) {
+    CBrushSector *pbsc = ba.ba_apbsc[iSector];
+    const ULONG *aulLinks = (const ULONG*)cwr.Next( CWB_LINKS, acbs[iSector].cbs_ctLinks);
+    for( ULONG iLink=0; iLink<acbs[iSector].cbs_ctLinks; iLink++) {
+      AddRelationPair( ba.ba_apbpo[aulLinks[iLink]]->bpo_rsOtherSideSectors, pbsc->bsc_rdOtherSidePortals);
+    }
+  }
+  _bPortalSectorLinksPreLoaded = (cwf.Header().cwh_ulFlags&CWHF_PORTALLINKS) ? TRUE : FALSE;
+
+  // continue reading world after raw brushes
+  pstrm->SetPos_t( cwf.Header().cwh_slRawEnd);
+  return TRUE;
+}
+
+
+// checksum of brush geometry (to compare raw and cooked loading)
+static ULONG BrushesCRC( CWorld &wo)
+{
+  ULONG ulCRC;
+  CRC_Start( ulCRC);
+  FOREACHINDYNAMICARRAY( wo.wo_baBrushes.ba_abrBrushes, CBrush3D, itbr) {
+    FOREACHINLIST( CBrushMip, bm_lnInBrush, itbr->br_lhBrushMips, itbm) {
+      FOREACHINDYNAMICARRAY( itbm->bm_abscSectors, CBrushSector, itbsc) {
+        CBrushSector &bsc = *itbsc;
+        CRC_AddLONG( ulCRC, bsc.bsc_ulFlags);
+        CRC_AddLONG( ulCRC, bsc.bsc_bspBSPTree.bt_abnNodes.Count());
+        CRC_AddLONG( ulCRC, bsc.bsc_rdOtherSidePortals.Count());
+        for( INDEX iVertex=0; iVertex<bsc.bsc_abvxVertices.Count(); iVertex++) {
+          CRC_AddBlock( ulCRC, (UBYTE*)&bsc.bsc_abvxVertices[iVertex].bvx_vdPreciseRelative, sizeof(DOUBLE3D));
+        }
+        for( INDEX iPolygon=0; iPolygon<bsc.bsc_abpoPolygons.Count(); iPolygon++) {
+          CBrushPolygon &bpo = bsc.bsc_abpoPolygons[iPolygon];
+          CRC_AddLONG( ulCRC, bpo.bpo_ulFlags);
+          CRC_AddLONG( ulCRC, bsc.bsc_abplPlanes.Index( bpo.bpo_pbplPlane));
+          CRC_AddLONG( ulCRC, bpo.bpo_smShadowMap.bsm_lhLayers.Count());
+          const INDEX ctElements = bpo.bpo_aiTriangleElements.Count();
+          if( ctElements>0) CRC_AddBlock( ulCRC, (UBYTE*)&bpo.bpo_aiTriangleElements[0], ctElements*sizeof(INDEX));
+        }
+      }
+    }
+  }
+  CRC_Finish( ulCRC);
+  return ulCRC;
+}
+
+// read brushes from a world file the same way as when loading the world
+static DOUBLE LoadBrushes_t( CWorld &wo, const CTFileName &fnmWorld)
+{
+  extern BOOL _bReadingWorldFile;
+  wo.Clear();
+  CTimerValue tv0 = _pTimer->GetHighPrecisionTimer();
+  wo.wo_fnmFileName = fnmWorld;
+  CTFileStream strmFile;
+  strmFile.Open_t( fnmWorld);
+  BOOL bNeedsReinit;
+  _pNetwork->CheckVersion_t( strmFile, FALSE, bNeedsReinit);
+  strmFile.ExpectID_t("WRLD");
+  _bReadingWorldFile = TRUE;
+  wo.ReadBrushes_t( &strmFile);
+  return (_pTimer->GetHighPrecisionTimer()-tv0).GetSeconds()*1000.0;
+}
+
+// compare loading of world brushes from raw and cooked files
+void WorldLoadBenchmark(void *pArgs)
+{
+  CTString strWorld = *NEXTARGUMENT(CTString*);
+  // all stock levels if no world given
+  CDynamicStackArray<CTFileName> afnmWorlds;
+  if( strWorld!="") {
+    afnmWorlds.Push() = CTFileName(strWorld);
+  } else {
+    MakeDirList( afnmWorlds, CTString("Levels\\"), CTString("*.wld"), DLI_RECURSIVE);
+  }
+
+  const INDEX iOldCooked = wld_bCookedBrushes;
+  DOUBLE dRawTotal = 0, dCookedTotal = 0;
+  INDEX ctWorlds = 0;
+  CPrintF( TRANS("World load benchmark (brushes only):\n"));
+  for( INDEX iWorld=0; iWorld<afnmWorlds.Count(); iWorld++) {
+    const CTFileName &fnmWorld = afnmWorlds[iWorld];
+    try {
+      CWorld wo;
+      // first load only gets textures in memory
+      wld_bCookedBrushes = FALSE;
+      LoadBrushes_t( wo, fnmWorld);
+      const DOUBLE dRaw = LoadBrushes_t( wo, fnmWorld);
+      const ULONG ulRawCRC = BrushesCRC( wo);
+      // first cooked load makes the cooked file if it's not there yet
+      wld_bCookedBrushes = TRUE;
+      LoadBrushes_t( wo, fnmWorld);
+      const DOUBLE dCooked = LoadBrushes_t( wo, fnmWorld);
+      const BOOL bMatch = BrushesCRC( wo)==ulRawCRC;
+      CPrintF( TRANS("  %-40s raw %7.1f ms, cooked %7.1f ms (%4.1fx), %s\n"), (const char*)fnmWorld.FileName(),
+               dRaw, dCooked, dRaw/Max(dCooked, 0.001), bMatch ? TRANS("match") : TRANS("MISMATCH!"));
+      dRawTotal += dRaw;
+      dCookedTotal += dCooked;
+      ctWorlds++;
+    } catch( const char *strError) {
+      CPrintF( TRANS("  %-40s %s\n"), (const char*)fnmWorld.FileName(), strError);
+    }
+  }
+  wld_bCookedBrushes = iOldCooked;
+  if( ctWorlds>0) {
+    CPrintF( TRANS("  total for %d worlds: raw %.1f ms, cooked %.1f ms\n"), ctWorlds, dRawTotal, dCookedTotal);
+  }
+}
@@ -0,0 +1,165 @@
+/* Copyright (c) 2002-2012 Croteam Ltd.
+This program is free software; you can redistribute it and/or modify
+it under the terms of version 2 of the GNU General Public License as published by
+the Free Software Foundation
+
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA. */
+
+#ifndef SE_INCL_COOKEDWORLD_H
+#define SE_INCL_COOKEDWORLD_H
+#ifdef PRAGMA_ONCE
+  #pragma once
+#endif
+
+#include <Engine/Math/Vector.h>
+#include <Engine/Math/Plane.h>
+#include <Engine/Math/TextureMapping.h>
+#include <Engine/Brushes/Brush.h>
+
+/*
+ * Cooked brushes of a world, made when the world file is parsed for the first time.
+ * File layout (native byte order, used directly when mapped in memory):
+ *   CCookedWorldHeader
+ *   blobs of records, each aligned to 16 bytes
+ * All brushes, mips, sectors and their elements are stored in the order in which they
+ * are in the world, each record only holds count of its sub-elements, and references
+ * are indices, so nothing needs to be relocated.
+ */
+
+#define COOKEDWORLD_VERSION 1
+
+// blobs in the cooked file
+enum CookedWorldBlob {
+  CWB_BRUSHES = 0,      // CCookedBrush
+  CWB_MIPS,             // CCookedMip
+  CWB_SECTORS,          // CCookedSector
+  CWB_VERTICES,         // DOUBLE3D
+  CWB_PLANES,           // DOUBLEplane3D
+  CWB_EDGES,            // ULONG pairs of vertex indices
+  CWB_POLYGONS,         // CCookedPolygon
+  CWB_POLYGONEDGES,     // ULONG edge index (highest bit set if reversed)
+  CWB_TRIANGLEVERTICES, // ULONG vertex index
+  CWB_ELEMENTS,         // INDEX
+  CWB_BSPNODES,         // CCookedBSPNode
+  CWB_LAYERS,           // CCookedShadowLayer
+  CWB_MASKS,            // UBYTE bit packed shadow layer masks
+  CWB_LINKS,            // ULONG index of portal polygon in world
+  CWB_TEXTURES,         // ULONG offset of texture name in strings
+  CWB_STRINGS,          // zero terminated sector and texture names
+  CWB_COUNT,
+};
+
+#define CWHF_PORTALLINKS  (1UL<<0)   // portal-sector links were saved in world
+
+class CCookedBlob {
+public:
+  ULONG cb_ulOffset;    // from start of file
+  ULONG cb_ctItems;
+};
+
+class CCookedWorldHeader {
+public:
+  ULONG cwh_ulID;         // 'CWLD'
+  ULONG cwh_ulVersion;    // COOKEDWORLD_VERSION
+  ULONG cwh_ulLayout;     // checksum of record sizes (different builds cannot share the file)
+  ULONG cwh_ulWorldCRC;   // CRC of world file that the brushes were cooked from
+  SLONG cwh_slRawStart;   // where brush archive starts in world file
+  SLONG cwh_slRawEnd;     // where it ends (reading of world continues there)
+  ULONG cwh_ulFlags;      // CWHF_...
+  CCookedBlob cwh_acbBlobs[CWB_COUNT];
+};
+
+class CCookedBrush {
+public:
+  ULONG cbr_ctMips;
+};
+
+class CCookedMip {
+public:
+  FLOAT cbm_fMaxDistance;
+  ULONG cbm_ctSectors;
+};
+
+class CCookedSector {
+public:
+  ULONG cbs_ulName;       // offset in strings
+  COLOR cbs_colColor;
+  COLOR cbs_colAmbient;
+  ULONG cbs_ulFlags;
+  ULONG cbs_ulFlags2;
+  ULONG cbs_ulVisFlags;
+  ULONG cbs_ulTempFlags;  // only BSCTF_PRELOADEDBSP and BSCTF_PRELOADEDLINKS
+  ULONG cbs_ctVertices;
+  ULONG cbs_ctPlanes;
+  ULONG cbs_ctEdges;
+  ULONG cbs_ctPolygons;
+  ULONG cbs_ctBSPNodes;
+  ULONG cbs_ctLinks;      // portals pointing to this sector
+};
+
+class CCookedTexture {
+public:
+  SLONG cpt_iTexture;     // in textures (-1 if none)
+  CMappingDefinition cpt_mdMapping;
+  UBYTE cpt_ubScroll;
+  UBYTE cpt_ubBlend;
+  UBYTE cpt_ubFlags;
+  UBYTE cpt_ubDummy;
+  COLOR cpt_colColor;
+};
+
+class CCookedPolygon {
+public:
+  ULONG cpo_iPlane;       // in sector
+  COLOR cpo_colColor;
+  ULONG cpo_ulFlags;
+  COLOR cpo_colShadow;
+  CCookedTexture cpo_actTextures[3];
+  CBrushPolygonProperties cpo_bppProperties;
+  ULONG cpo_ctEdges;
+  ULONG cpo_ctTriangleVertices;
+  ULONG cpo_ctElements;
+  // shadow map
+  ULONG cpo_ulShadowFlags;
+  INDEX cpo_iShadowFirstMip;
+  MEX cpo_mexShadowOffsetX, cpo_mexShadowOffsetY;
+  MEX cpo_mexShadowWidth,   cpo_mexShadowHeight;
+  PIX cpo_pixPolygonSizeU,  cpo_pixPolygonSizeV;
+  ULONG cpo_ctLayers;
+  BOOL  cpo_bUncalculated; // shadow map waits for calculation
+};
+
+class CCookedShadowLayer {
+public:
+  ULONG csl_ulFlags;
+  SLONG csl_slSizeInPixels;
+  ULONG csl_ulMaskSize;   // bytes of mask in masks blob (0 if none)
+  PIX csl_pixMinU, csl_pixMinV;
+  PIX csl_pixSizeU, csl_pixSizeV;
+};
+
+class CCookedBSPNode {
+public:
+  DOUBLEplane3D cbn_plPlane;
+  ULONG cbn_ulLocation;
+  SLONG cbn_iFront;       // in sector (-1 if none)
+  SLONG cbn_iBack;
+  ULONG cbn_ulPlaneTag;
+};
+
+
+// read brushes of the world from cooked file (returns FALSE if raw brushes must be read)
+BOOL ReadCookedBrushes_t( CWorld *pwo, CTStream *pstrm, ULONG ulWorldCRC); // throw char *
+// cook brushes that were just read from raw world file
+void WriteCookedBrushes( CWorld *pwo, ULONG ulWorldCRC, SLONG slRawStart, SLONG slRawEnd);
+
+
+#endif  /* include-once check. */
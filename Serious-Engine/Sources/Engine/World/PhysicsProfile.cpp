@@ -119,5 +119,9 @@ CPhysicsProfile::CPhysicsProfile(void)
   SETCOUNTERNAME(PCI_NEARCELLSFOUND,  "cells found in FindEntitiesNearBox()");
   SETCOUNTERNAME(PCI_NEAROCCUPIEDCELLSFOUND, "occupied cells found in FindEntitiesNearBox()");
   SETCOUNTERNAME(PCI_NEARENTITIESFOUND,  "entities found in FindEntitiesNearBox()");
+
+  SETCOUNTERNAME(PCI_EVENTSPOOLED,    "sent events copied into pool");
+  SETCOUNTERNAME(PCI_EVENTHEAPCOPIES, "sent events copied on heap");
+  SETCOUNTERNAME(PCI_EVENTPOOLBLOCKS, "event pool blocks allocated");
 }
 
@@ -126,6 +126,10 @@ public:
     PCI_NEARCELLSFOUND,           // cells found in FindEntitiesNearBox()
     PCI_NEAROCCUPIEDCELLSFOUND,   // occupied cells found in FindEntitiesNearBox()
     PCI_NEARENTITIESFOUND,        // near entities found in FindEntitiesNearBox()
+
+    PCI_EVENTSPOOLED,             // sent events copied into event pool
+    PCI_EVENTHEAPCOPIES,          // sent events copied on heap
+    PCI_EVENTPOOLBLOCKS,          // blocks allocated for event pool
     PCI_COUNT
   };
   // constructor
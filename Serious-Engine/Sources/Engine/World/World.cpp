@@ -35,6 +35,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Templates/DynamicArray.cpp>
 #include <Engine/Brushes/Brush.h>
 #include <Engine/Light/LightSource.h>
+#include <Engine/Light/ShadowCache.h>
 #include <Engine/Base/ProgressHook.h>
 #include <Engine/Templates/StaticArray.cpp>
 #include <Engine/Templates/Selection.cpp>
@@ -146,6 +147,14 @@ CWorld::~CWorld()
  */
 void CWorld::Clear(void)
 {
+  // shadow maps must not be mixed in background while brushes and lights are destroyed
+  FinishShadowMixing();
+
+  // save shadows mixed while playing
+  if (_shcShadowCache.IsOpenFor(this)) {
+    _shcShadowCache.Close();
+  }
+
   // detach worldbase class
   if (wo_pecWorldBaseClass!=NULL) {
     if ( wo_pecWorldBaseClass->ec_pdecDLLClass!=NULL
@@ -1092,6 +1101,8 @@ void CWorld::DeletePredictors(void)
 
   wo_cenPredictor.Clear();
   wo_cenPredicted.Clear();
+  // predictors must be created and predicted again
+  _pNetwork->ga_sesSessionState.ses_ctPredictedSteps = 0;
 
   // for each entity in the world
   FOREACHINDYNAMICCONTAINER(wo_cenEntities, CEntity, iten) {
@@ -29,6 +29,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <Engine/Network/Network.h>
 #include <Engine/Templates/StaticArray.cpp>
 #include <Engine/Terrain/Terrain.h>
+#include <Engine/Light/ShadowCache.h>
+#include <Engine/World/CookedWorld.h>
 
 #define WORLDSTATEVERSION_NOCLASSCONTAINER 9
 #define WORLDSTATEVERSION_MULTITEXTURING 8
@@ -39,6 +41,8 @@ extern BOOL _bPortalSectorLinksPreLoaded;
 extern BOOL _bEntitySectorLinksPreLoaded;
 extern BOOL _bFileReplacingApplied;
 BOOL _bReadEntitiesByID = FALSE;
+// set while world is read from its own file, so that brushes can be cooked
+BOOL _bReadingWorldFile = FALSE;
 
 /*
  * Save entire world (both brushes  current state).
@@ -72,7 +76,13 @@ void CWorld::Load_t(const CTFileName &fnmWorld) // throw char *
   _pNetwork->CheckVersion_t(strmFile, TRUE, bNeedsReinit);
 
   // read the world from the file
-  Read_t(&strmFile);
+  _bReadingWorldFile = TRUE;
+  try {
+    Read_t(&strmFile);
+  } catch( const char *) {
+    _bReadingWorldFile = FALSE;
+    throw;
+  }
 
   // close the file
   strmFile.Close();
@@ -90,6 +100,9 @@ void CWorld::Load_t(const CTFileName &fnmWorld) // throw char *
     Save_t(fnmWorld);
     CallProgressHook_t(1.0f);
   }
+
+  // use shadows mixed in previous runs
+  _shcShadowCache.Open(this);
 }
 
 /*
@@ -168,7 +181,11 @@ void CWorld::LoadBrushes_t(const CTFileName &fnmWorld) // throw char *
 
   strmFile.ExpectID_t("WRLD"); // 'world'
   // read the world brushes from the file
+  _bReadingWorldFile = TRUE;
   ReadBrushes_t(&strmFile);
+
+  // use shadows mixed in previous runs
+  _shcShadowCache.Open(this);
 }
 
 /*
@@ -180,6 +197,11 @@ void CWorld::ReadBrushes_t( CTStream *istrm)// throw char *
 
   // must be in 53bit mode when managing brushes
   CSetFPUPrecision FPUPrecision(FPT_53BIT);
+
+  // brushes can be cooked only when read directly from world file
+  extern INDEX wld_bCookedBrushes;
+  const BOOL bCookable = _bReadingWorldFile && wld_bCookedBrushes;
+  _bReadingWorldFile = FALSE;
   
   ReadInfo_t(istrm, FALSE);
 
@@ -192,7 +214,15 @@ void CWorld::ReadBrushes_t( CTStream *istrm)// throw char *
   CallProgressHook_t(1.0f);
   SetProgressDescription(TRANS("loading brushes"));
   CallProgressHook_t(0.0f);
-  wo_baBrushes.Read_t(istrm);
+  // use cooked brushes if they were made from this very file
+  const ULONG ulWorldCRC = bCookable ? istrm->GetStreamCRC32_t() : 0;
+  if( !bCookable || !ReadCookedBrushes_t(this, istrm, ulWorldCRC)) {
+    const SLONG slRawStart = istrm->GetPos_t();
+    wo_baBrushes.Read_t(istrm);
+    if( bCookable) {
+      WriteCookedBrushes(this, ulWorldCRC, slRawStart, istrm->GetPos_t());
+    }
+  }
   CallProgressHook_t(1.0f);
 
   // if there are some terrais in world
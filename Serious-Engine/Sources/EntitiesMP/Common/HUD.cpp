@@ -1152,7 +1152,8 @@ extern void DrawHUD( const CPlayer *penPlayerCurrent, CDrawPort *pdpCurrent, BOO
     if( bCooperative) eKey = (SortKeys)Clamp( (INDEX)eKey, 0L, 3L);
     if( eKey==PSK_HEALTH && (bScoreMatch || bFragMatch)) { eKey = PSK_NAME; }; // prevent health snooping in deathmatch
     INDEX iPlayers = SetAllPlayersStats(eKey);
-    // loop thru players 
+    // loop thru players (their text is drawn at once)
+    _pDP->BeginTextBatch();
     for( INDEX i=0; i<iPlayers; i++)
     { // get player name and mana
       CPlayer *penPlayer = _apenPlayers[i];
@@ -1204,6 +1205,7 @@ extern void DrawHUD( const CPlayer *penPlayerCurrent, CDrawPort *pdpCurrent, BOO
       // calculate summ of scores (for coop mode)
       iScoreSum += iScore;  
     }
+    _pDP->EndTextBatch();
     // draw remaining time if time based death- or scorematch
     if ((bScoreMatch || bFragMatch) && hud_bShowMatchInfo){
       CTString strLimitsInfo="";  
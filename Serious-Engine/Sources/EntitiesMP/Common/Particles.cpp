@@ -136,6 +136,11 @@ BOOL UpdateGrowthCache(CEntity *pen, CTextureData *ptdGrowthMap, FLOATaabbox3D &
 
 // array for model vertices in absolute space
 CStaticStackArray<FLOAT3D> avVertices;
+// particles collected for batched rendering
+static CStaticStackArray<FLOAT3D> _avBatchPos;
+static CStaticStackArray<FLOAT> _afBatchSize;
+static CStaticStackArray<ANGLE> _aaBatchRotation;
+static CStaticStackArray<COLOR> _acolBatch;
 
 // current player projection
 extern CAnyProjection3D prPlayerProjection;
@@ -2981,6 +2986,10 @@ void Particles_Snow(CEntity *pen, FLOAT fGridSize, INDEX ctGrids, FLOAT fFactor,
   
   Particle_PrepareTexture(&_toSnowdrop, PBT_BLEND);
   Particle_SetTexturePart( 512, 512, 0, 0);
+  _avBatchPos.PopAll();
+  _afBatchSize.PopAll();
+  _aaBatchRotation.PopAll();
+  _acolBatch.PopAll();
 
   FLOAT fMinX = boxSnowMap.Min()(1);
   FLOAT fMinY = boxSnowMap.Min()(2);
@@ -3051,10 +3060,18 @@ void Particles_Snow(CEntity *pen, FLOAT fGridSize, INDEX ctGrids, FLOAT fFactor,
             continue;
           }
         }
-        Particle_RenderSquare( vRender, fSize, fAngle, colDrop);
+        _avBatchPos.Push() = vRender;
+        _afBatchSize.Push() = fSize;
+        _aaBatchRotation.Push() = fAngle;
+        _acolBatch.Push() = colDrop;
       }
     }
   }
+  // render all flakes at once
+  const INDEX ctFlakes = _avBatchPos.Count();
+  if( ctFlakes>0) {
+    Particle_RenderSquares( ctFlakes, &_avBatchPos[0], &_afBatchSize[0], &_aaBatchRotation[0], &_acolBatch[0]);
+  }
   // all done
   Particle_Flush();
 }
@@ -172,7 +172,8 @@ void CGame::ConsoleRender(CDrawPort *pdp)
   dpConsole.SetFont( _pfdConsoleFont);
   dpConsole.SetTextScaling(consoleScale);
 
-  // print editing line of text
+  // print editing line of text (all console text is drawn at once)
+  dpConsole.BeginTextBatch();
   dpConsole.SetTextMode(-1);
   CTString strPrompt;
   if (_pGame->gm_csConsoleState == CS_TALK) {
@@ -203,6 +204,7 @@ void CGame::ConsoleRender(CDrawPort *pdp)
     iBackwardLine++;
     pixYLine -= pixLineSpacing;
   }
+  dpConsole.EndTextBatch();
 
   // all done
   dpConsole.Unlock();
@@ -226,10 +228,12 @@ void CGame::ConsolePrintLastLines(CDrawPort *pdp)
   // put some filter underneath for easier reading
   pdp->Fill( 0, 0, pdp->GetWidth(), pixCharHeight*ctLines, C_BLACK|128);
   // for each line
+  pdp->BeginTextBatch();
   for( INDEX iLine=0; iLine<ctLines; iLine++) {
     CTString strLine = CON_GetLastLine(iLine+1);
     pdp->PutText( strLine, 0, pixCharHeight*(ctLines-iLine-1), SE_COL_BLUE_LIGHT|255);
   }
+  pdp->EndTextBatch();
 }
 
 
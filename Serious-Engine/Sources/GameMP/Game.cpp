@@ -2169,9 +2169,10 @@ void CGame::GameRedrawView( CDrawPort *pdpDrawPort, ULONG ulFlags)
     INDEX ctViewers = 0;
 
     // check if input is enabled
+    static CShellSymbolHandle sshAllowPrescan("inp_bAllowPrescan");
     BOOL bDoPrescan = _pInput->IsInputEnabled() &&
       !_pNetwork->IsPaused() && !_pNetwork->GetLocalPause() &&
-      _pShell->GetINDEX("inp_bAllowPrescan");
+      sshAllowPrescan.GetINDEX();
     // prescan input
     if (bDoPrescan) {
       _pInput->GetInput(TRUE);
@@ -2374,7 +2375,8 @@ void CGame::GameRedrawView( CDrawPort *pdpDrawPort, ULONG ulFlags)
 
   // check for new chat message
   static INDEX ctChatMessages=0;
-  INDEX ctNewChatMessages = _pShell->GetINDEX("net_ctChatMessages");
+  static CShellSymbolHandle sshChatMessages("net_ctChatMessages");
+  INDEX ctNewChatMessages = sshChatMessages.GetINDEX();
   if (ctNewChatMessages!=ctChatMessages) {
     ctChatMessages=ctNewChatMessages;
     PlayScriptSound(MAX_SCRIPTSOUNDS-1, CTFILENAME("Sounds\\Menu\\Chat.wav"), 4.0f*gam_fChatSoundVolume, 1.0f, FALSE);
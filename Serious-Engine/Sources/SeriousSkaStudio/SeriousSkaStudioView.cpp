@@ -1839,6 +1839,7 @@ void CSeriousSkaStudioView::OnDeleteselected()
     {
       CAnimSet *pas = (CAnimSet*)pni->ni_pPtr;
       pmiSelected->mi_aAnimSet.Remove(pas);
+      pmiSelected->mi_ctLookupAnimSets = -1;
       _pAnimSetStock->Release(pas);
       // update root model instance
       theApp.UpdateRootModelInstance();